@@ -149,6 +149,8 @@ static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
   NSTimeInterval elapsedTime = [queryControllerStartTime_ timeIntervalSinceNow];
   NSString *value = [NSString stringWithFormat:@"%0.3f ms", elapsedTime * -1000];
   [gatheringTime_ setStringValue:value];
+  [gatheringTime_ setToolTip:
+   [[HGSLatencyHistogramRegistry sharedRegistry] report]];
   [gatheringProgress_ stopAnimation:self];
 }
 
@@ -326,6 +328,17 @@ static NSInteger QSBDWSortOperations(HGSSearchOperation *op1,
       cellData = [NSString stringWithFormat:@"%@ (%d)",
                   name, [operation resultCountForFilter:filter]];
     }
+    // Show how this source usually does next to how it did this time.
+    HGSLatencyHistogram *histogram
+      = [[HGSLatencyHistogramRegistry sharedRegistry]
+         histogramForStage:kHGSLatencyStageRun
+                    source:[[operation source] identifier]];
+    if ([histogram count]) {
+      cellData = [cellData stringByAppendingFormat:
+                  @" [p50 %0.3fms p99 %0.3fms]",
+                  [histogram nanosecondsAtPercentile:50] / 1e6,
+                  [histogram nanosecondsAtPercentile:99] / 1e6];
+    }
     [cell setStringValue:cellData];
   } else {
     NSInteger selectedOp = [operations_ selectedRowInColumn:0];
@@ -91,6 +91,33 @@
 //      character sets should always be expressed as a set of single UniChars
 //      or ranges between single UniChars.
 //
+//  - The CF collations and LIKE build CFStrings for every comparison, which
+//  adds up when sorting or scanning large tables. Folded keys move that work
+//  to insert time:
+//
+//    * FOLDEDKEY(x) returns x folded according to the folded key options
+//      (case and diacritic insensitive and non-literal by default) as a UTF8
+//      blob. Store it in a shadow column next to x, e.g.
+//        INSERT INTO t (name, name_key) VALUES (?1, FOLDEDKEY(?1));
+//
+//    * Blobs always compare with memcmp, so "ORDER BY name_key" sorts by
+//      the folded string without calling back into CF, and SQLite can use
+//      an index on the key column to do it.
+//
+//    * FOLDEDLIKE(pattern, name_key [, escape]) is LIKE against a key. The
+//      pattern is folded once per statement and rows are matched straight
+//      from the key bytes.
+//
+//    * Only NOCASE, NONLITERAL, NODIACRITIC and WIDTHINSENSITIVE can be
+//      folded into a key. Equal keys match the CF comparisons with the same
+//      options. Keys order by code point, like the non-localized CF
+//      comparisons apart from characters outside the Basic Multilingual
+//      Plane. '_' in FOLDEDLIKE matches one code point rather than a
+//      composed character sequence.
+//
+//    * Keys depend on the options that were active when they were made, so
+//      keys must be recomputed if the options change.
+//
 
 //  SQLite is preinstalled on 10.4 only. As long as we're using the OS version
 //  of the library, limit ourself to Tiger+
@@ -117,6 +144,7 @@ extern NSString *const kGTMSQLiteDatabaseWillClose;
   BOOL hasCFAdditions_;
   CFOptionFlags likeOptions_;
   CFOptionFlags globOptions_;
+  CFOptionFlags foldedKeyOptions_;
   NSMutableArray *userArgDataPool_;  // strong
 }
 
@@ -225,6 +253,38 @@ extern NSString *const kGTMSQLiteDatabaseWillClose;
 //
 - (CFOptionFlags)globComparisonOptions;
 
+//  Set comparison options for the FOLDEDKEY and FOLDEDLIKE functions for
+//  databases with our CF additions active. Keys already stored are not
+//  updated.
+//
+//  Args:
+//    options: CFStringCompareFlags value. Only kCFCompareCaseInsensitive,
+//             kCFCompareNonliteral, kCFCompareDiacriticInsensitive and
+//             kCFCompareWidthInsensitive are supported.
+//
+- (void)setFoldedKeyComparisonOptions:(CFOptionFlags)options;
+
+//  Get current comparison options for FOLDEDKEY and FOLDEDLIKE in a database
+//  with our CF additions active.
+//
+//  Returns:
+//    Current comparison options or zero if CF additions are inactive.
+//
+- (CFOptionFlags)foldedKeyComparisonOptions;
+
+//  Compute the same key as FOLDEDKEY for binding from code.
+//
+//  Args:
+//    string: String to fold.
+//    options: CFStringCompareFlags value, as for
+//             setFoldedKeyComparisonOptions:.
+//
+//  Returns:
+//    Autoreleased UTF8 key, bind it with bindBlobAtPosition:data:.
+//
++ (NSData *)foldedKeyForString:(NSString *)string
+                       options:(CFOptionFlags)options;
+
 //  Obtain the last error code from the database
 //
 //  Returns:
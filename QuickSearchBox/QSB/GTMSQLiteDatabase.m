@@ -27,6 +27,7 @@
 #import "GTMMethodCheck.h"
 #import "GTMDefines.h"
 #include <limits.h>
+#include <ctype.h>
 #import "GTMGarbageCollection.h"
 
 typedef struct {
@@ -103,6 +104,25 @@ GTM_INLINE CFOptionFlags FilteredStringCompareFlags(CFOptionFlags inOptions) {
   return outOptions;
 }
 
+// Helper inline for filtering the flags folded keys can honor. Everything
+// else needs a real comparison and can't be baked into a key.
+GTM_INLINE CFOptionFlags FilteredFoldedKeyFlags(CFOptionFlags inOptions) {
+  CFOptionFlags outOptions = 0;
+  if (inOptions & kCFCompareCaseInsensitive) {
+    outOptions |= kCFCompareCaseInsensitive;
+  }
+  if (inOptions & kCFCompareNonliteral) outOptions |= kCFCompareNonliteral;
+#if MAC_OS_X_VERSION_MIN_REQUIRED >= MAC_OS_X_VERSION_10_5
+  if (inOptions & kCFCompareDiacriticInsensitive) {
+    outOptions |= kCFCompareDiacriticInsensitive;
+  }
+  if (inOptions & kCFCompareWidthInsensitive) {
+    outOptions |= kCFCompareWidthInsensitive;
+  }
+#endif
+  return outOptions;
+}
+
 //  Function prototypes for our custom implementations of UPPER/LOWER using
 //  CFString so that we handle Unicode and localization more cleanly than
 //  native SQLite.
@@ -127,6 +147,15 @@ static void Like16(sqlite3_context *context, int argc, sqlite3_value **argv);
 static void Glob8(sqlite3_context *context, int argc, sqlite3_value **argv);
 static void Glob16(sqlite3_context *context, int argc, sqlite3_value **argv);
 
+//  Function prototypes for folded keys and LIKE over folded keys
+static UInt8 *CopyFoldedKeyBytes(CFStringRef string,
+                                 CFOptionFlags options,
+                                 CFIndex *keyLength);
+static void FoldedKey(sqlite3_context *context, int argc, sqlite3_value **argv);
+static void FoldedLike(sqlite3_context *context,
+                       int argc,
+                       sqlite3_value **argv);
+
 //  The CFLocale of the current user at process start
 static CFLocaleRef gCurrentLocale = NULL;
 
@@ -400,6 +429,46 @@ static CFLocaleRef gCurrentLocale = NULL;
                  // sqlite3_create_function is static
   }
 
+  // Folded keys start case and diacritic insensitive, canonical composition
+  // is always folded.
+  foldedKeyOptions_ = kCFCompareCaseInsensitive | kCFCompareNonliteral;
+#if MAC_OS_X_VERSION_MIN_REQUIRED >= MAC_OS_X_VERSION_10_5
+  foldedKeyOptions_ |= kCFCompareDiacriticInsensitive;
+#endif
+  const struct {
+    const char          *sqlName;
+    int                 numArgs;
+    void                *function;
+  } customFolded[] = {
+    { "foldedkey", 1, &FoldedKey },
+    { "foldedlike", 2, &FoldedLike },
+    { "foldedlike", 3, &FoldedLike },
+  };
+
+  for (size_t i = 0; i < (sizeof(customFolded) / sizeof(customFolded[0]));
+       i++) {
+    NSMutableData *argsData
+      = [NSMutableData dataWithLength:sizeof(LikeGlobUserArgs)];
+    if (!argsData) return SQLITE_INTERNAL;
+    [userArgDataPool_ addObject:argsData];
+    LikeGlobUserArgs *args = (LikeGlobUserArgs *)[argsData bytes];
+    args->compareOptionPtr = &foldedKeyOptions_;
+    args->textRep = SQLITE_UTF8;
+    // Registered for UTF8 only, SQLite converts UTF16 arguments for us and
+    // keys are blobs so never need converting.
+    rc = sqlite3_create_function(db_,
+                                 customFolded[i].sqlName,
+                                 customFolded[i].numArgs,
+                                 SQLITE_UTF8,
+                                 args,
+                                 customFolded[i].function,
+                                 NULL,
+                                 NULL);
+    if (rc != SQLITE_OK)
+      return rc; // COV_NF_LINE because input to
+                 // sqlite3_create_function is static
+  }
+
   hasCFAdditions_ = YES;
   return SQLITE_OK;
 }
@@ -451,6 +520,29 @@ static CFLocaleRef gCurrentLocale = NULL;
   return globOptions;
 }
 
+- (void)setFoldedKeyComparisonOptions:(CFOptionFlags)options {
+  if (hasCFAdditions_)
+    foldedKeyOptions_ = FilteredFoldedKeyFlags(options);
+}
+
+- (CFOptionFlags)foldedKeyComparisonOptions {
+  CFOptionFlags flags = 0;
+  if (hasCFAdditions_)
+    flags = foldedKeyOptions_;
+  return flags;
+}
+
++ (NSData *)foldedKeyForString:(NSString *)string
+                       options:(CFOptionFlags)options {
+  if (!string) return nil;
+  CFIndex keyLength = 0;
+  UInt8 *key = CopyFoldedKeyBytes((CFStringRef)string,
+                                  FilteredFoldedKeyFlags(options),
+                                  &keyLength);
+  if (!key) return nil;  // COV_NF_LINE
+  return [NSData dataWithBytesNoCopy:key length:keyLength freeWhenDone:YES];
+}
+
 - (int)lastErrorCode {
   return sqlite3_errcode(db_);
 }
@@ -1661,6 +1753,233 @@ static void Glob16(sqlite3_context *context, int argc, sqlite3_value **argv) {
   }
 }
 
+#pragma mark Folded Keys
+
+// Private helper to fold a string into the UTF8 bytes of its key. Folding
+// never uses the locale so a key is the same wherever it was computed.
+// Returns a malloc'd buffer the caller owns, or NULL on failure.
+static UInt8 *CopyFoldedKeyBytes(CFStringRef string,
+                                 CFOptionFlags options,
+                                 CFIndex *keyLength) {
+  CFMutableStringRef folded
+    = CFStringCreateMutableCopy(kCFAllocatorDefault, 0, string);
+  if (!folded) return NULL;  // COV_NF_LINE
+#if MAC_OS_X_VERSION_MIN_REQUIRED >= MAC_OS_X_VERSION_10_5
+  CFOptionFlags foldOptions
+    = options & (kCFCompareCaseInsensitive
+                 | kCFCompareDiacriticInsensitive
+                 | kCFCompareWidthInsensitive);
+  if (foldOptions) {
+    CFStringFold(folded, foldOptions, NULL);
+  }
+#else
+  if (options & kCFCompareCaseInsensitive) {
+    CFStringLowercase(folded, NULL);
+  }
+#endif
+  // Folding can decompose characters, so normalize afterwards.
+  if (options & kCFCompareNonliteral) {
+    CFStringNormalize(folded, kCFStringNormalizationFormC);
+  }
+  CFIndex length = CFStringGetLength(folded);
+  CFIndex bufferSize
+    = CFStringGetMaximumSizeForEncoding(length, kCFStringEncodingUTF8);
+  // Always allocate something so an empty string has a non NULL key
+  UInt8 *buffer = malloc(bufferSize + 1);
+  if (buffer) {
+    CFIndex convertedBytes = 0;
+    CFStringGetBytes(folded, CFRangeMake(0, length), kCFStringEncodingUTF8,
+                     0, false, buffer, bufferSize, &convertedBytes);
+    *keyLength = convertedBytes;
+  }
+  CFRelease(folded);
+  return buffer;
+}
+
+// Private helper to build the folded key of a UTF8 SQLite value
+static UInt8 *CopyFoldedKeyBytesForValue(sqlite3_value *value,
+                                         CFOptionFlags options,
+                                         CFIndex *keyLength) {
+  const UInt8 *text = sqlite3_value_text(value);
+  if (!text) return NULL;
+  CFStringRef string = CFStringCreateWithBytes(kCFAllocatorDefault,
+                                               text,
+                                               sqlite3_value_bytes(value),
+                                               kCFStringEncodingUTF8,
+                                               false);
+  if (!string) return NULL;  // COV_NF_LINE
+  UInt8 *key = CopyFoldedKeyBytes(string, options, keyLength);
+  CFRelease(string);
+  return key;
+}
+
+// FOLDEDKEY(x) returns x folded by the database's folded key options as a
+// UTF8 blob. Blobs compare with memcmp, which orders UTF8 by code point, and
+// are never converted between text encodings.
+static void FoldedKey(sqlite3_context *context,
+                      int argc,
+                      sqlite3_value **argv) {
+  LikeGlobUserArgs *keyArgs = sqlite3_user_data(context);
+  if (!keyArgs) {
+    // COV_NF_START
+    sqlite3_result_error(context, "FOLDEDKEY no user args", -1);
+    return;
+    // COV_NF_END
+  }
+  if ((argc < 1) || (sqlite3_value_type(argv[0]) == SQLITE_NULL)) {
+    sqlite3_result_null(context);
+    return;
+  }
+  CFIndex keyLength = 0;
+  UInt8 *key = CopyFoldedKeyBytesForValue(argv[0],
+                                          *(keyArgs->compareOptionPtr),
+                                          &keyLength);
+  if (!key) {
+    // COV_NF_START
+    sqlite3_result_error(context, "FOLDEDKEY failed to fold value", -1);
+    return;
+    // COV_NF_END
+  }
+  sqlite3_result_blob(context, key, (int)keyLength, &free);
+}
+
+// The folded form of a FOLDEDLIKE pattern. Kept as auxiliary data on the
+// pattern argument so it is only folded once per statement.
+typedef struct {
+  CFOptionFlags options;
+  CFIndex length;
+  UInt8 bytes[1];
+} FoldedLikePattern;
+
+// Private helper to step over one UTF8 encoded code point
+GTM_INLINE const UInt8 *NextUTF8CodePoint(const UInt8 *bytes,
+                                          const UInt8 *end) {
+  ++bytes;
+  while ((bytes < end) && ((*bytes & 0xC0) == 0x80)) {
+    ++bytes;
+  }
+  return bytes;
+}
+
+// Private helper to match a folded pattern against a folded key. Both are
+// UTF8 so everything but '%', '_' and the escape is compared bytewise.
+// Whenever '_' or a '%' retry moves through the key it moves a whole code
+// point, so matches always stay on code point boundaries. Backtracking only
+// goes to the most recent '%', which is enough as any earlier one would
+// only match more of the key.
+static BOOL FoldedLikeMatch(const UInt8 *pattern, const UInt8 *patternEnd,
+                            const UInt8 *key, const UInt8 *keyEnd,
+                            int escape) {
+  const UInt8 *retryPattern = NULL;
+  const UInt8 *retryKey = NULL;
+  while (key < keyEnd) {
+    if (pattern < patternEnd) {
+      UInt8 patternByte = *pattern;
+      if ((patternByte == escape) && (pattern + 1 < patternEnd)) {
+        if (pattern[1] == *key) {
+          pattern += 2;
+          ++key;
+          continue;
+        }
+      } else if (patternByte == '%') {
+        retryPattern = ++pattern;
+        retryKey = key;
+        continue;
+      } else if (patternByte == '_') {
+        ++pattern;
+        key = NextUTF8CodePoint(key, keyEnd);
+        continue;
+      } else if (patternByte == *key) {
+        ++pattern;
+        ++key;
+        continue;
+      }
+    }
+    if (!retryPattern) return NO;
+    pattern = retryPattern;
+    retryKey = NextUTF8CodePoint(retryKey, keyEnd);
+    key = retryKey;
+  }
+  while ((pattern < patternEnd) && (*pattern == '%')) {
+    ++pattern;
+  }
+  return pattern == patternEnd;
+}
+
+// FOLDEDLIKE(pattern, key [, escape]) is LIKE against a key from FOLDEDKEY.
+// The pattern is folded the same way as the keys, once per statement, and
+// each row is matched straight from the blob without any allocation.
+static void FoldedLike(sqlite3_context *context,
+                       int argc,
+                       sqlite3_value **argv) {
+  LikeGlobUserArgs *likeArgs = sqlite3_user_data(context);
+  if (!likeArgs) {
+    // COV_NF_START
+    sqlite3_result_error(context, "FOLDEDLIKE no user args", -1);
+    return;
+    // COV_NF_END
+  }
+  if ((sqlite3_value_type(argv[0]) == SQLITE_NULL)
+      || (sqlite3_value_type(argv[1]) == SQLITE_NULL)) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  int escape = -1;
+  if (argc == 3) {
+    // Keep the escape out of folding's way by restricting it to ASCII
+    // characters that folding leaves alone.
+    const unsigned char *escapeText = sqlite3_value_text(argv[2]);
+    if (!escapeText || (sqlite3_value_bytes(argv[2]) != 1)
+        || (escapeText[0] & 0x80) || isalnum(escapeText[0])) {
+      sqlite3_result_error(context,
+                           "FOLDEDLIKE ESCAPE expression must be a single " \
+                           "ASCII character that is not a letter or digit",
+                           -1);
+      return;
+    }
+    escape = escapeText[0];
+  }
+
+  CFOptionFlags options = *(likeArgs->compareOptionPtr);
+  FoldedLikePattern *pattern = sqlite3_get_auxdata(context, 0);
+  BOOL newPattern = (!pattern || pattern->options != options);
+  if (newPattern) {
+    CFIndex length = 0;
+    UInt8 *bytes = CopyFoldedKeyBytesForValue(argv[0], options, &length);
+    if (bytes) {
+      pattern = malloc(sizeof(FoldedLikePattern) + length);
+      if (pattern) {
+        pattern->options = options;
+        pattern->length = length;
+        memcpy(pattern->bytes, bytes, length);
+      }
+      free(bytes);
+    } else {
+      pattern = NULL;  // COV_NF_LINE
+    }
+    if (!pattern) {
+      // COV_NF_START
+      sqlite3_result_error(context, "FOLDEDLIKE failed to fold pattern", -1);
+      return;
+      // COV_NF_END
+    }
+  }
+
+  const UInt8 *key = sqlite3_value_blob(argv[1]);
+  int keyLength = sqlite3_value_bytes(argv[1]);
+  BOOL match = FoldedLikeMatch(pattern->bytes,
+                               pattern->bytes + pattern->length,
+                               key,
+                               key + keyLength,
+                               escape);
+  sqlite3_result_int(context, match ? 1 : 0);
+  if (newPattern) {
+    // SQLite may free the pattern right away, so hand it over last.
+    sqlite3_set_auxdata(context, 0, pattern, &free);
+  }
+}
+
 // -----------------------------------------------------------------------------
 
 @interface GTMSQLiteStatement(PrivateMethods)
@@ -1035,6 +1035,200 @@ static void TestUpperLower16Impl(sqlite3_context *context,
   }
 }
 
+#if MAC_OS_X_VERSION_MIN_REQUIRED >= MAC_OS_X_VERSION_10_5
+- (void)testFoldedKeys {
+  int err;
+  GTMSQLiteDatabase *db8 =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:YES
+                                                       utf8:YES
+                                                  errorCode:&err]
+      autorelease];
+  STAssertNotNil(db8, @"Failed to create database");
+  GTMSQLiteDatabase *db16 =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:YES
+                                                       utf8:NO
+                                                  errorCode:&err]
+      autorelease];
+  STAssertNotNil(db16, @"Failed to create database");
+
+  CFOptionFlags defaultOptions = (kCFCompareCaseInsensitive
+                                  | kCFCompareNonliteral
+                                  | kCFCompareDiacriticInsensitive);
+  NSArray *databases = [NSArray arrayWithObjects:db8, db16, nil];
+  GTMSQLiteDatabase *db;
+  GTM_FOREACH_OBJECT(db, databases) {
+    STAssertEquals([db foldedKeyComparisonOptions], defaultOptions, nil);
+    err = [db executeSQL:@"CREATE TABLE t1 (x TEXT, k BLOB);"];
+    STAssertEquals(err, SQLITE_OK, @"Failed to create table");
+    NSString *values[] = {
+      @"Zoe", @"frédéric", @"FREDERIC", @"Frédéric",
+      @"abc", @"a%c", @"École", @"",
+    };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      NSString *sql
+        = [NSString stringWithFormat:
+           @"INSERT INTO t1 VALUES (%@, FOLDEDKEY(%@));",
+           [GTMSQLiteStatement quoteAndEscapeString:values[i]],
+           [GTMSQLiteStatement quoteAndEscapeString:values[i]]];
+      err = [db executeSQL:sql];
+      STAssertEquals(err, SQLITE_OK, @"Failed to insert %@", values[i]);
+    }
+    err = [db executeSQL:@"INSERT INTO t1 VALUES (NULL, FOLDEDKEY(NULL));"];
+    STAssertEquals(err, SQLITE_OK, nil);
+
+    // All the spellings of Frederic share a key
+    GTMSQLiteStatement *statement = nil;
+    NSArray *result
+      = LikeGlobTestHelper(db, @"SELECT COUNT(DISTINCT k) FROM t1 "
+                               @"WHERE FOLDEDLIKE('frederic', k);");
+    STAssertEqualObjects(result,
+                         [NSArray arrayWithObject:[NSNumber numberWithInt:1]],
+                         nil);
+    result = LikeGlobTestHelper(db, @"SELECT COUNT(*) FROM t1 "
+                                    @"WHERE FOLDEDLIKE('FRÉD%', k);");
+    STAssertEqualObjects(result,
+                         [NSArray arrayWithObject:[NSNumber numberWithInt:3]],
+                         nil);
+    result = LikeGlobTestHelper(db, @"SELECT x FROM t1 "
+                                    @"WHERE FOLDEDLIKE('_c%', k);");
+    STAssertEqualObjects(result, [NSArray arrayWithObject:@"École"], nil);
+    result = LikeGlobTestHelper(db, @"SELECT x FROM t1 "
+                                    @"WHERE FOLDEDLIKE('a%c', k) ORDER BY x;");
+    STAssertEqualObjects(result,
+                         ([NSArray arrayWithObjects:@"a%c", @"abc", nil]),
+                         nil);
+    result = LikeGlobTestHelper(db, @"SELECT x FROM t1 "
+                                    @"WHERE FOLDEDLIKE('a!%c', k, '!');");
+    STAssertEqualObjects(result, [NSArray arrayWithObject:@"a%c"], nil);
+    result = LikeGlobTestHelper(db, @"SELECT x FROM t1 "
+                                    @"WHERE FOLDEDLIKE('%', k) ORDER BY k;");
+    STAssertEquals([result count], (NSUInteger)8, nil);
+    STAssertEqualObjects([result objectAtIndex:0], @"", nil);
+    STAssertEqualObjects([result lastObject], @"Zoe", nil);
+    statement
+      = [GTMSQLiteStatement statementWithSQL:@"SELECT x FROM t1 WHERE "
+                                             @"FOLDEDLIKE('a', k, 'ab');"
+                                  inDatabase:db
+                                   errorCode:&err];
+    STAssertNotNil(statement, nil);
+    STAssertEquals([statement stepRow], SQLITE_ERROR,
+                   @"Multi character escape should fail");
+    [statement finalizeStatement];
+
+    // The keys from code and SQL agree
+    NSData *key = [GTMSQLiteDatabase foldedKeyForString:@"ÉCOLE"
+                                                options:defaultOptions];
+    STAssertEqualObjects(key, [@"ecole" dataUsingEncoding:NSUTF8StringEncoding],
+                         nil);
+    statement
+      = [GTMSQLiteStatement statementWithSQL:@"SELECT x FROM t1 WHERE k = ?;"
+                                  inDatabase:db
+                                   errorCode:&err];
+    STAssertNotNil(statement, nil);
+    STAssertEquals([statement bindBlobAtPosition:1 data:key], SQLITE_OK, nil);
+    STAssertEquals([statement stepRow], SQLITE_ROW, nil);
+    STAssertEqualObjects([statement resultStringAtPosition:0],
+                         @"École", nil);
+    [statement finalizeStatement];
+
+    // Unsupported options are dropped, supported ones change new keys
+    [db setFoldedKeyComparisonOptions:(kCFCompareNonliteral
+                                       | kCFCompareNumerically)];
+    STAssertEquals([db foldedKeyComparisonOptions],
+                   (CFOptionFlags)kCFCompareNonliteral, nil);
+    result = LikeGlobTestHelper(db, @"SELECT COUNT(*) FROM t1 "
+                                    @"WHERE FOLDEDLIKE('FR%', k);");
+    STAssertEqualObjects(result,
+                         [NSArray arrayWithObject:[NSNumber numberWithInt:0]],
+                         nil);
+    result = LikeGlobTestHelper(db, @"SELECT HEX(FOLDEDKEY('Ab'));");
+    STAssertEqualObjects(result, [NSArray arrayWithObject:@"4162"], nil);
+  }
+}
+
+- (void)testFoldedKeyPerformance {
+  // Compares the CF collation and LIKE with folded keys. Set
+  // GTMSQLITE_BENCHMARK_ROWS to run bigger tables, e.g. 1000000.
+  int rowCount = 20000;
+  NSString *rowString
+    = [[[NSProcessInfo processInfo] environment]
+       objectForKey:@"GTMSQLITE_BENCHMARK_ROWS"];
+  if ([rowString intValue] > 0) {
+    rowCount = [rowString intValue];
+  }
+  int err;
+  GTMSQLiteDatabase *db =
+    [[[GTMSQLiteDatabase alloc] initInMemoryWithCFAdditions:YES
+                                                       utf8:YES
+                                                  errorCode:&err]
+      autorelease];
+  STAssertNotNil(db, @"Failed to create database");
+  CFOptionFlags options = (kCFCompareCaseInsensitive
+                           | kCFCompareNonliteral
+                           | kCFCompareDiacriticInsensitive);
+  [db setLikeComparisonOptions:options];
+  [db setFoldedKeyComparisonOptions:options];
+  err = [db executeSQL:@"CREATE TABLE t1 (x TEXT COLLATE "
+                       @"NOCASE_NONLITERAL_NODIACRITIC, k BLOB);"];
+  STAssertEquals(err, SQLITE_OK, @"Failed to create table");
+
+  NSString *words[] = {
+    @"Frédéric", @"zoë", @"NAÏVE", @"résumé",
+    @"Café", @"angström", @"Beyoncé", @"école",
+    @"Señor", @"plain",
+  };
+  const int kWordCount = sizeof(words) / sizeof(words[0]);
+  GTMSQLiteStatement *insert
+    = [GTMSQLiteStatement statementWithSQL:@"INSERT INTO t1 "
+                                           @"VALUES (?1, FOLDEDKEY(?1));"
+                                inDatabase:db
+                                 errorCode:&err];
+  STAssertNotNil(insert, nil);
+  STAssertTrue([db beginDeferredTransaction], nil);
+  for (int i = 0; i < rowCount; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSString *value
+      = [NSString stringWithFormat:@"%@ %@ %d",
+         words[(i * 7) % kWordCount], words[i % kWordCount], rowCount - i];
+    [insert bindStringAtPosition:1 string:value];
+    STAssertEquals([insert stepRow], SQLITE_DONE, nil);
+    [insert reset];
+    [pool release];
+  }
+  STAssertTrue([db commit], nil);
+  [insert finalizeStatement];
+
+  // Sorting has to finish before the middle row is known, and both orders
+  // should agree on its key.
+  NSString *middleSort
+    = [NSString stringWithFormat:@"SELECT HEX(k) FROM t1 ORDER BY %%@ "
+                                 @"LIMIT 1 OFFSET %d;", rowCount / 2];
+  struct {
+    NSString *name;
+    NSString *cfSQL;
+    NSString *foldedSQL;
+  } benchmarks[] = {
+    { @"sort",
+      [NSString stringWithFormat:middleSort, @"x"],
+      [NSString stringWithFormat:middleSort, @"k"] },
+    { @"LIKE",
+      @"SELECT COUNT(*) FROM t1 WHERE x LIKE '%FREDERIC%';",
+      @"SELECT COUNT(*) FROM t1 WHERE FOLDEDLIKE('%FREDERIC%', k);" },
+  };
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+    NSDate *start = [NSDate date];
+    NSArray *cfResult = LikeGlobTestHelper(db, benchmarks[i].cfSQL);
+    NSTimeInterval cfTime = -[start timeIntervalSinceNow];
+    start = [NSDate date];
+    NSArray *foldedResult = LikeGlobTestHelper(db, benchmarks[i].foldedSQL);
+    NSTimeInterval foldedTime = -[start timeIntervalSinceNow];
+    STAssertNotNil(cfResult, nil);
+    STAssertEqualObjects(cfResult, foldedResult, @"%@", benchmarks[i].name);
+    STAssertLessThan(foldedTime, cfTime, @"%@", benchmarks[i].name);
+  }
+}
+#endif // MAC_OS_X_VERSION_MIN_REQUIRED >= MAC_OS_X_VERSION_10_5
+
 - (void)testDescription {
   int err;
   GTMSQLiteDatabase *db8 =
@@ -39,6 +39,7 @@
 @class QSBSearchWindowController;
 @class QSBPreferenceWindowController;
 @class QSBHGSDelegate;
+@class HGSQueryTraceRecorder;
 @class QSBUserMessenger;
 @class GTMCarbonHotKey;
 @class GTMHotKey;
@@ -65,6 +66,7 @@ extern NSString *const kQSBBeenLaunchedPrefKey;
   QSBHGSDelegate *hgsDelegate_;
   QSBUserMessenger *userMessenger_;
   NSAppleEventDescriptor *applicationASDictionary_;
+  HGSQueryTraceRecorder *queryTraceRecorder_;
   BOOL activateOnStartup_;
 }
 
@@ -834,6 +834,12 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   // Inventory and process all plugins and extensions.
   [self inventoryPlugins];
 
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  if ([defaults stringForKey:kHGSQueryTraceFilePrefKey]) {
+    queryTraceRecorder_ = [[HGSQueryTraceRecorder alloc] init];
+    [queryTraceRecorder_ startRecording];
+  }
+
   // Now that all the plugins are loaded, start listening to them. We didn't
   // want to do it earlier as there is a lot of enabled/disabled messages
   // flying around that we don't actually care about.
@@ -916,6 +922,15 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   [[NSUserDefaults standardUserDefaults] setBool:YES
                                           forKey:kQSBBeenLaunchedPrefKey];
 
+  if (queryTraceRecorder_) {
+    [queryTraceRecorder_ stopRecording];
+    NSString *tracePath = [[NSUserDefaults standardUserDefaults]
+                           stringForKey:kHGSQueryTraceFilePrefKey];
+    [queryTraceRecorder_ writeToFile:[tracePath stringByStandardizingPath]];
+    [queryTraceRecorder_ release];
+    queryTraceRecorder_ = nil;
+  }
+
   // Uninstall all extensions.
   [[self plugins] makeObjectsPerformSelector:@selector(uninstall)];
 }
@@ -60,6 +60,7 @@
  @private
   NSArray *categories_;
   QSBCategory *otherCategory_;
+  NSMutableDictionary *categoriesByType_;
 }
 + (QSBCategoryManager *)sharedManager;
 - (QSBCategory *)categoryForType:(NSString *)type;
@@ -131,8 +131,7 @@ static NSString *const kQSBCategoryOthersType
 - (BOOL)isResultMember:(HGSResult *)result {
   NSString *type = [result type];
   QSBCategoryManager *manager = [QSBCategoryManager sharedManager];
-  QSBCategory *category = [manager categoryForType:type];
-  return [[category class] isKindOfClass:[self class]];
+  return [manager categoryForType:type] == self;
 }
 
 @end
@@ -180,7 +179,8 @@ GTMOBJECT_SINGLETON_BOILERPLATE(QSBCategoryManager, sharedManager);
     otherCategory_ = [[QSBCategory alloc] initWithName:kQSBCategoryOthersType
                                              dictionary:otherDict];
     [tempCategories addObject:otherCategory_];
-    categories_ = [tempCategories retain];
+    categories_ = [tempCategories copy];
+    categoriesByType_ = [[NSMutableDictionary alloc] init];
   }
   return self;
 }
@@ -188,19 +188,34 @@ GTMOBJECT_SINGLETON_BOILERPLATE(QSBCategoryManager, sharedManager);
 - (void) dealloc {
   [categories_ release];
   [otherCategory_ release];
+  [categoriesByType_ release];
   [super dealloc];
 }
 
 - (QSBCategory *)categoryForType:(NSString *)type {
+  // The answer for a type never changes, so it is kept for the life of the
+  // app without invalidation: categories_ is an immutable copy built once
+  // from the plist, HGSTypeConformsToType is a pure prefix match with no
+  // type registry behind it, and the "other" category's conform set is the
+  // constant "*". There are only a few hundred types, so the cache stays
+  // small.
   QSBCategory *category = nil;
-  for (category in categories_) {
-    if ([category isValidType:type]) {
-      break;
+  @synchronized (categoriesByType_) {
+    category = [categoriesByType_ objectForKey:type];
+    if (!category) {
+      for (category in categories_) {
+        if ([category isValidType:type]) {
+          break;
+        }
+      }
+      if (!category) {
+        category = otherCategory_;
+      }
+      if (type) {
+        [categoriesByType_ setObject:category forKey:type];
+      }
     }
   }
-  if (!category) {
-    category = otherCategory_;
-  }
   return category;
 }
 
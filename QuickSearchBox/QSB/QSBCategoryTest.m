@@ -103,6 +103,64 @@
   }
 }
 
+- (void)testCategoryForTypeCaching {
+  QSBCategoryManager *mgr = [QSBCategoryManager sharedManager];
+  QSBCategory *first = [mgr categoryForType:kHGSTypeFileMusic];
+  QSBCategory *second = [mgr categoryForType:kHGSTypeFileMusic];
+  STAssertEquals(first, second, nil);
+  // A type nobody has asked about yet falls through to "Others".
+  QSBCategory *other = [mgr categoryForType:@"qsbcategorytest.unknown"];
+  QSBCategory *onebox = [mgr categoryForType:kHGSTypeOnebox];
+  STAssertEquals(other, onebox, nil);
+  STAssertEquals([mgr categoryForType:@"qsbcategorytest.unknown"], other, nil);
+}
+
+- (void)testCategorizationSpeed {
+  // Roughly what a keystroke sees: a couple of hundred results spread over a
+  // handful of types, each of which needs a category.
+  NSString *types[] = {
+    kHGSTypeContact, kHGSTypeFile, kHGSTypeEmail, kHGSTypeWebpage,
+    kHGSTypeOnebox, kHGSTypeAction, kHGSTypeDirectory, kHGSTypeTextFile,
+    kHGSTypeFileApplication, kHGSTypeWebBookmark, kHGSTypeFileMusic,
+    kHGSTypeFileImage, kHGSTypeFileMovie, kHGSTypeFilePDF,
+    kHGSTypeGoogleSuggest, kHGSTypeTextPhoneNumber,
+  };
+  const NSUInteger kTypeCount = sizeof(types) / sizeof(types[0]);
+  const NSUInteger kResultCount = 200;
+  const NSUInteger kKeystrokeCount = 50;
+  QSBCategoryManager *mgr = [QSBCategoryManager sharedManager];
+  NSArray *categories = [mgr categories];
+
+  // What we used to do: ask every category about every result.
+  NSUInteger scanMatches = 0;
+  NSDate *start = [NSDate date];
+  for (NSUInteger k = 0; k < kKeystrokeCount; ++k) {
+    for (NSUInteger i = 0; i < kResultCount; ++i) {
+      NSString *type = types[i % kTypeCount];
+      for (QSBCategory *category in categories) {
+        if ([category isValidType:type]) {
+          ++scanMatches;
+        }
+      }
+    }
+  }
+  NSTimeInterval scanTime = -[start timeIntervalSinceNow];
+
+  NSUInteger lookups = 0;
+  start = [NSDate date];
+  for (NSUInteger k = 0; k < kKeystrokeCount; ++k) {
+    for (NSUInteger i = 0; i < kResultCount; ++i) {
+      if ([mgr categoryForType:types[i % kTypeCount]]) {
+        ++lookups;
+      }
+    }
+  }
+  NSTimeInterval lookupTime = -[start timeIntervalSinceNow];
+  STAssertEquals(lookups, kResultCount * kKeystrokeCount, nil);
+  STAssertGreaterThanOrEqual(scanMatches, lookups, nil);
+  STAssertLessThan(lookupTime, scanTime, nil);
+}
+
 - (void)testCategoryCompare {
   QSBCategoryManager *mgr = [QSBCategoryManager sharedManager];
   QSBCategory *otherCategory = [mgr categoryForType:kHGSTypeOnebox];
@@ -230,7 +230,7 @@ GTM_METHOD_CHECK(NSObject, gtm_addObserver:forKeyPath:selector:userInfo:options:
 
   QSBResultsViewTableView *resultsTableView = [self resultsTableView];
   NSUInteger selectedRow = [resultsTableView selectedRow];
-  [resultsTableView reloadData];
+  [self reloadAllRows];
   NSIndexSet *selRowSet = [NSIndexSet indexSetWithIndex:selectedRow];
   [resultsTableView selectRowIndexes:selRowSet byExtendingSelection:NO];
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
@@ -295,6 +295,20 @@ GTM_METHOD_CHECK(NSObject, gtm_addObserver:forKeyPath:selector:userInfo:options:
   }
 }
 
+#pragma mark QSBResultsViewBaseController Overrides
+
+// Only the visible rows are compared between updates. The rest are built
+// lazily as they scroll into view.
+- (NSRange)rowModelRangeForRowCount:(NSUInteger)rowCount {
+  NSTableView *tableView = [self resultsTableView];
+  NSRange rows = [tableView rowsInRect:[tableView visibleRect]];
+  if (rows.location > rowCount) {
+    rows.location = rowCount;
+  }
+  rows.length = MIN(NSMaxRange(rows), rowCount) - rows.location;
+  return rows;
+}
+
 #pragma mark NSResponder Overrides
 
 - (void)moveUp:(id)sender {
@@ -417,16 +431,14 @@ changedVisibleRowsFrom:(NSRange)oldVisible
   NSDictionary *change = [notification change];
   NSNumber *valueOfChange = [change valueForKey:NSKeyValueChangeNewKey];
   moreCategoryResultCount_ = [valueOfChange unsignedIntegerValue];
-  NSTableView *resultsTableView = [self resultsTableView];
-  [resultsTableView reloadData];
+  [self reloadAllRows];
 }
 
 - (void)maxMoreResultCountBeforeAbridgingChanged:(GTMKeyValueChangeNotification *)notification {
   NSDictionary *change = [notification change];
   NSNumber *valueOfChange = [change valueForKey:NSKeyValueChangeNewKey];
   maxMoreResultCountBeforeAbridging_ = [valueOfChange unsignedIntegerValue];
-  NSTableView *resultsTableView = [self resultsTableView];
-  [resultsTableView reloadData];
+  [self reloadAllRows];
 }
 
 @end
@@ -0,0 +1,95 @@
+//
+//  QSBResultRowModel.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+@class QSBResultRowDiff;
+
+// The rows a results table is showing, kept between result updates. Rows are
+// matched up by -isEqual: so a row that is still present keeps the instance
+// the table already has, wherever it moves to. Nothing here depends on
+// AppKit, so any kind of object can be a row.
+@interface QSBResultRowModel : NSObject {
+ @private
+  NSMutableArray *rows_;
+}
+
+- (NSArray *)rows;
+- (NSUInteger)count;
+
+// Returns nil if |idx| is out of range.
+- (id)rowAtIndex:(NSUInteger)idx;
+
+// Replaces the rows with |rows| and returns what changed. Rows equal to a
+// current row are replaced by the current instance.
+- (QSBResultRowDiff *)updateRows:(NSArray *)rows;
+
+// Forgets the current rows, so the next update treats every row as new.
+- (void)removeAllRows;
+
+@end
+
+// The difference between two successive lists of rows. Deleted indexes are
+// in the old list, all other indexes are in the new one. Moves are kept to a
+// minimum: rows that kept their order relative to each other stay put and
+// only the rest are reported as moved.
+@interface QSBResultRowDiff : NSObject {
+ @private
+  NSIndexSet *deletedIndexes_;
+  NSIndexSet *insertedIndexes_;
+  NSIndexSet *movedIndexes_;
+  NSIndexSet *changedIndexes_;
+  NSUInteger *previousIndexes_;
+  NSUInteger count_;
+}
+
+// Rows of the old list that are gone.
+@property (readonly, retain) NSIndexSet *deletedIndexes;
+
+// Rows of the new list that were not in the old one.
+@property (readonly, retain) NSIndexSet *insertedIndexes;
+
+// Rows of the new list that were in the old one but changed order.
+@property (readonly, retain) NSIndexSet *movedIndexes;
+
+// Every row index whose contents are different from before, including the
+// indexes past the end of the shorter list. These are the rows a table has
+// to redisplay.
+@property (readonly, retain) NSIndexSet *changedIndexes;
+
+- (BOOL)hasChanges;
+
+// The index |row| of the new list had in the old list, or NSNotFound if it
+// was inserted.
+- (NSUInteger)previousIndexOfRow:(NSUInteger)row;
+
+@end
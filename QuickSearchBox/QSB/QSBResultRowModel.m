@@ -0,0 +1,256 @@
+//
+//  QSBResultRowModel.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "QSBResultRowModel.h"
+
+@interface QSBResultRowDiff ()
+// Takes ownership of |previousIndexes|, which must have been malloced.
+- (id)initWithDeletedIndexes:(NSIndexSet *)deletedIndexes
+             insertedIndexes:(NSIndexSet *)insertedIndexes
+                movedIndexes:(NSIndexSet *)movedIndexes
+              changedIndexes:(NSIndexSet *)changedIndexes
+             previousIndexes:(NSUInteger *)previousIndexes
+                       count:(NSUInteger)count;
+@end
+
+@implementation QSBResultRowModel
+
+- (id)init {
+  if ((self = [super init])) {
+    rows_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [rows_ release];
+  [super dealloc];
+}
+
+- (NSArray *)rows {
+  return [[rows_ copy] autorelease];
+}
+
+- (NSUInteger)count {
+  return [rows_ count];
+}
+
+- (id)rowAtIndex:(NSUInteger)idx {
+  id row = nil;
+  if (idx < [rows_ count]) {
+    row = [rows_ objectAtIndex:idx];
+  }
+  return row;
+}
+
+- (void)removeAllRows {
+  [rows_ removeAllObjects];
+}
+
+- (QSBResultRowDiff *)updateRows:(NSArray *)rows {
+  NSUInteger oldCount = [rows_ count];
+  NSUInteger newCount = [rows count];
+  id *oldRows = malloc(oldCount * sizeof(id));
+  id *newRows = malloc(newCount * sizeof(id));
+  [rows_ getObjects:oldRows range:NSMakeRange(0, oldCount)];
+  [rows getObjects:newRows range:NSMakeRange(0, newCount)];
+
+  // Index the old rows by value. Equal rows are chained together in order
+  // through |nextEqualIndexes|, and the table holds the first of them.
+  CFMutableDictionaryRef oldIndexes
+    = CFDictionaryCreateMutable(NULL, oldCount,
+                                &kCFTypeDictionaryKeyCallBacks, NULL);
+  NSUInteger *nextEqualIndexes = malloc(oldCount * sizeof(NSUInteger));
+  for (NSUInteger i = oldCount; i > 0; --i) {
+    const void *value = NULL;
+    if (CFDictionaryGetValueIfPresent(oldIndexes, oldRows[i - 1], &value)) {
+      nextEqualIndexes[i - 1] = (NSUInteger)value;
+    } else {
+      nextEqualIndexes[i - 1] = NSNotFound;
+    }
+    CFDictionarySetValue(oldIndexes, oldRows[i - 1], (const void *)(i - 1));
+  }
+
+  // Match each new row with the first unmatched old row equal to it. Once
+  // the old rows run out, further equal rows count as inserted.
+  NSUInteger *previousIndexes = malloc(newCount * sizeof(NSUInteger));
+  BOOL *wasKept = calloc(oldCount, sizeof(BOOL));
+  NSMutableIndexSet *insertedIndexes = [NSMutableIndexSet indexSet];
+  for (NSUInteger j = 0; j < newCount; ++j) {
+    const void *value = NULL;
+    if (CFDictionaryGetValueIfPresent(oldIndexes, newRows[j], &value)) {
+      NSUInteger i = (NSUInteger)value;
+      NSUInteger nextEqualIndex = nextEqualIndexes[i];
+      if (nextEqualIndex == NSNotFound) {
+        CFDictionaryRemoveValue(oldIndexes, newRows[j]);
+      } else {
+        CFDictionarySetValue(oldIndexes, newRows[j],
+                             (const void *)nextEqualIndex);
+      }
+      previousIndexes[j] = i;
+      newRows[j] = oldRows[i];
+      wasKept[i] = YES;
+    } else {
+      previousIndexes[j] = NSNotFound;
+      [insertedIndexes addIndex:j];
+    }
+  }
+  free(nextEqualIndexes);
+  CFRelease(oldIndexes);
+
+  NSMutableIndexSet *deletedIndexes = [NSMutableIndexSet indexSet];
+  for (NSUInteger i = 0; i < oldCount; ++i) {
+    if (!wasKept[i]) {
+      [deletedIndexes addIndex:i];
+    }
+  }
+  free(wasKept);
+
+  // The longest run of kept rows that are still in their old order can stay
+  // where they are; everything else that was kept has moved. This is the
+  // usual patience sort: |tails[k]| is the row ending the best run of length
+  // k + 1 found so far.
+  NSUInteger *tails = malloc(newCount * sizeof(NSUInteger));
+  NSUInteger *predecessors = malloc(newCount * sizeof(NSUInteger));
+  NSUInteger runLength = 0;
+  for (NSUInteger j = 0; j < newCount; ++j) {
+    NSUInteger previousIndex = previousIndexes[j];
+    if (previousIndex == NSNotFound) continue;
+    NSUInteger low = 0;
+    NSUInteger high = runLength;
+    while (low < high) {
+      NSUInteger mid = low + (high - low) / 2;
+      if (previousIndexes[tails[mid]] < previousIndex) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    predecessors[j] = low > 0 ? tails[low - 1] : NSNotFound;
+    tails[low] = j;
+    if (low == runLength) {
+      ++runLength;
+    }
+  }
+  BOOL *stays = calloc(newCount, sizeof(BOOL));
+  NSUInteger row = runLength > 0 ? tails[runLength - 1] : NSNotFound;
+  while (row != NSNotFound) {
+    stays[row] = YES;
+    row = predecessors[row];
+  }
+  free(predecessors);
+  free(tails);
+
+  NSMutableIndexSet *movedIndexes = [NSMutableIndexSet indexSet];
+  for (NSUInteger j = 0; j < newCount; ++j) {
+    if (previousIndexes[j] != NSNotFound && !stays[j]) {
+      [movedIndexes addIndex:j];
+    }
+  }
+  free(stays);
+
+  NSMutableIndexSet *changedIndexes = [NSMutableIndexSet indexSet];
+  NSUInteger maxCount = MAX(oldCount, newCount);
+  for (NSUInteger j = 0; j < maxCount; ++j) {
+    if (j >= oldCount || j >= newCount || oldRows[j] != newRows[j]) {
+      [changedIndexes addIndex:j];
+    }
+  }
+
+  NSArray *newRowArray = [NSArray arrayWithObjects:newRows count:newCount];
+  [rows_ setArray:newRowArray];
+  free(newRows);
+  free(oldRows);
+
+  return [[[QSBResultRowDiff alloc] initWithDeletedIndexes:deletedIndexes
+                                           insertedIndexes:insertedIndexes
+                                              movedIndexes:movedIndexes
+                                            changedIndexes:changedIndexes
+                                           previousIndexes:previousIndexes
+                                                     count:newCount]
+          autorelease];
+}
+
+@end
+
+@implementation QSBResultRowDiff
+
+@synthesize deletedIndexes = deletedIndexes_;
+@synthesize insertedIndexes = insertedIndexes_;
+@synthesize movedIndexes = movedIndexes_;
+@synthesize changedIndexes = changedIndexes_;
+
+- (id)initWithDeletedIndexes:(NSIndexSet *)deletedIndexes
+             insertedIndexes:(NSIndexSet *)insertedIndexes
+                movedIndexes:(NSIndexSet *)movedIndexes
+              changedIndexes:(NSIndexSet *)changedIndexes
+             previousIndexes:(NSUInteger *)previousIndexes
+                       count:(NSUInteger)count {
+  if ((self = [super init])) {
+    deletedIndexes_ = [deletedIndexes copy];
+    insertedIndexes_ = [insertedIndexes copy];
+    movedIndexes_ = [movedIndexes copy];
+    changedIndexes_ = [changedIndexes copy];
+    previousIndexes_ = previousIndexes;
+    count_ = count;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [deletedIndexes_ release];
+  [insertedIndexes_ release];
+  [movedIndexes_ release];
+  [changedIndexes_ release];
+  free(previousIndexes_);
+  [super dealloc];
+}
+
+- (BOOL)hasChanges {
+  return [changedIndexes_ count] > 0;
+}
+
+- (NSUInteger)previousIndexOfRow:(NSUInteger)row {
+  NSUInteger previousIndex = NSNotFound;
+  if (row < count_) {
+    previousIndex = previousIndexes_[row];
+  }
+  return previousIndex;
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"%@: %p - deleted %@ inserted %@ "
+          @"moved %@ changed %@", [self class], self, deletedIndexes_,
+          insertedIndexes_, movedIndexes_, changedIndexes_];
+}
+
+@end
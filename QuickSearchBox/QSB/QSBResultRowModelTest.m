@@ -0,0 +1,185 @@
+//
+//  QSBResultRowModelTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import "QSBResultRowModel.h"
+
+@interface QSBResultRowModelTest : GTMTestCase
+@end
+
+@implementation QSBResultRowModelTest
+
+- (NSArray *)rowsFromString:(NSString *)string {
+  NSMutableArray *rows = [NSMutableArray arrayWithCapacity:[string length]];
+  for (NSUInteger i = 0; i < [string length]; ++i) {
+    // Fresh instances, so we can tell whether the model kept its own.
+    NSString *row = [NSMutableString stringWithFormat:@"%C",
+                     [string characterAtIndex:i]];
+    [rows addObject:row];
+  }
+  return rows;
+}
+
+- (NSIndexSet *)indexes:(NSUInteger)count, ... {
+  NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+  va_list args;
+  va_start(args, count);
+  for (NSUInteger i = 0; i < count; ++i) {
+    [indexes addIndex:va_arg(args, NSUInteger)];
+  }
+  va_end(args);
+  return indexes;
+}
+
+- (void)testFirstUpdate {
+  QSBResultRowModel *model = [[[QSBResultRowModel alloc] init] autorelease];
+  STAssertEquals([model count], (NSUInteger)0, nil);
+  STAssertNil([model rowAtIndex:0], nil);
+  QSBResultRowDiff *diff = [model updateRows:[self rowsFromString:@"abc"]];
+  STAssertTrue([diff hasChanges], nil);
+  STAssertEqualObjects([diff insertedIndexes], [self indexes:3, 0, 1, 2], nil);
+  STAssertEquals([[diff deletedIndexes] count], (NSUInteger)0, nil);
+  STAssertEquals([[diff movedIndexes] count], (NSUInteger)0, nil);
+  STAssertEqualObjects([diff changedIndexes], [diff insertedIndexes], nil);
+  STAssertEquals([diff previousIndexOfRow:1], (NSUInteger)NSNotFound, nil);
+  STAssertEqualObjects([model rowAtIndex:2], @"c", nil);
+
+  diff = [model updateRows:[self rowsFromString:@"abc"]];
+  STAssertFalse([diff hasChanges], nil);
+}
+
+- (void)testStableRows {
+  QSBResultRowModel *model = [[[QSBResultRowModel alloc] init] autorelease];
+  [model updateRows:[self rowsFromString:@"abcd"]];
+  NSArray *oldRows = [model rows];
+  QSBResultRowDiff *diff = [model updateRows:[self rowsFromString:@"xdabc"]];
+  STAssertEqualObjects([diff insertedIndexes], [self indexes:1, 0], nil);
+  STAssertEqualObjects([diff movedIndexes], [self indexes:1, 1], nil);
+  STAssertEquals([[diff deletedIndexes] count], (NSUInteger)0, nil);
+  STAssertEquals([diff previousIndexOfRow:1], (NSUInteger)3, nil);
+  STAssertEquals([diff previousIndexOfRow:4], (NSUInteger)2, nil);
+  // Rows that are still there are the instances we had before.
+  NSArray *rows = [model rows];
+  STAssertEquals([rows objectAtIndex:1], [oldRows objectAtIndex:3], nil);
+  STAssertEquals([rows objectAtIndex:2], [oldRows objectAtIndex:0], nil);
+  STAssertEquals([rows objectAtIndex:4], [oldRows objectAtIndex:2], nil);
+}
+
+- (void)testDiff {
+  struct {
+    NSString *oldRows;
+    NSString *newRows;
+    NSUInteger deletedCount;
+    NSUInteger insertedCount;
+    NSUInteger movedCount;
+    NSUInteger changedCount;
+  } tests[] = {
+    { @"abcde", @"abcde", 0, 0, 0, 0 },
+    { @"abcde", @"", 5, 0, 0, 5 },
+    { @"abcde", @"abde", 1, 0, 0, 3 },
+    { @"abcde", @"abcdef", 0, 1, 0, 1 },
+    { @"abcde", @"bacde", 0, 0, 1, 2 },
+    { @"abcde", @"eabcd", 0, 0, 1, 5 },
+    { @"abcde", @"edcba", 0, 0, 4, 4 },
+    { @"abcde", @"axcye", 2, 2, 0, 2 },
+    { @"aab", @"baa", 0, 0, 1, 3 },
+    { @"ab", @"abbb", 0, 2, 0, 2 },
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    QSBResultRowModel *model = [[[QSBResultRowModel alloc] init] autorelease];
+    [model updateRows:[self rowsFromString:tests[i].oldRows]];
+    NSArray *newRows = [self rowsFromString:tests[i].newRows];
+    QSBResultRowDiff *diff = [model updateRows:newRows];
+    STAssertEquals([[diff deletedIndexes] count], tests[i].deletedCount,
+                   @"%@ -> %@", tests[i].oldRows, tests[i].newRows);
+    STAssertEquals([[diff insertedIndexes] count], tests[i].insertedCount,
+                   @"%@ -> %@", tests[i].oldRows, tests[i].newRows);
+    STAssertEquals([[diff movedIndexes] count], tests[i].movedCount,
+                   @"%@ -> %@", tests[i].oldRows, tests[i].newRows);
+    STAssertEquals([[diff changedIndexes] count], tests[i].changedCount,
+                   @"%@ -> %@", tests[i].oldRows, tests[i].newRows);
+    STAssertEqualObjects([model rows], newRows,
+                         @"%@ -> %@", tests[i].oldRows, tests[i].newRows);
+  }
+}
+
+- (void)testRemoveAllRows {
+  QSBResultRowModel *model = [[[QSBResultRowModel alloc] init] autorelease];
+  [model updateRows:[self rowsFromString:@"abc"]];
+  [model removeAllRows];
+  STAssertEquals([model count], (NSUInteger)0, nil);
+  QSBResultRowDiff *diff = [model updateRows:[self rowsFromString:@"abc"]];
+  STAssertEquals([[diff insertedIndexes] count], (NSUInteger)3, nil);
+}
+
+// Ranked lists the size of a large result set, where each update re-ranks a
+// few rows, drops a few and adds a few, as a query update does.
+- (void)testRankedListUpdates {
+  const NSUInteger kRowCount = 5000;
+  const NSUInteger kUpdates = 200;
+  srandom(42);
+  NSMutableArray *rows = [NSMutableArray arrayWithCapacity:kRowCount];
+  NSUInteger nextRow = 0;
+  for (; nextRow < kRowCount; ++nextRow) {
+    [rows addObject:[NSString stringWithFormat:@"result %lu",
+                     (unsigned long)nextRow]];
+  }
+  QSBResultRowModel *model = [[[QSBResultRowModel alloc] init] autorelease];
+  [model updateRows:rows];
+  for (NSUInteger update = 0; update < kUpdates; ++update) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSUInteger i = 0; i < 10; ++i) {
+      NSUInteger from = random() % [rows count];
+      NSUInteger to = random() % [rows count];
+      id row = [[rows objectAtIndex:from] retain];
+      [rows removeObjectAtIndex:from];
+      [rows insertObject:row atIndex:to];
+      [row release];
+    }
+    for (NSUInteger i = 0; i < 5; ++i) {
+      [rows removeObjectAtIndex:random() % [rows count]];
+    }
+    for (NSUInteger i = 0; i < 5; ++i) {
+      NSString *row = [NSString stringWithFormat:@"result %lu",
+                       (unsigned long)nextRow++];
+      [rows insertObject:row atIndex:random() % [rows count]];
+    }
+    QSBResultRowDiff *diff = [model updateRows:rows];
+    STAssertEquals([[diff insertedIndexes] count], (NSUInteger)5, nil);
+    STAssertEquals([[diff deletedIndexes] count], (NSUInteger)5, nil);
+    STAssertLessThanOrEqual([[diff movedIndexes] count], (NSUInteger)10, nil);
+    [pool release];
+  }
+  STAssertEqualObjects([model rows], rows, nil);
+}
+
+@end
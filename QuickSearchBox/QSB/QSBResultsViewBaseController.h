@@ -35,6 +35,7 @@
 @class QSBResultsViewTableView;
 @class QSBTableResult;
 @class QSBSearchController;
+@class QSBResultRowModel;
 
 // Abstract base class for the result views which manages the presentation
 // of results in the Top Results and the More Results views.
@@ -42,6 +43,8 @@
  @private
   IBOutlet QSBResultsViewTableView *resultsTableView_;
   QSBSearchController *searchController_;
+  QSBResultRowModel *rowModel_;
+  NSUInteger rowModelOffset_;  // Table row of the first row in rowModel_
 }
 
 @property (readonly, retain) QSBSearchController *searchController;
@@ -64,7 +67,22 @@
 // Pick the currently selected table result.
 - (IBAction)qsb_pickCurrentTableResult:(id)sender;
 
-// Called when the results have been updated.
+// Called when the results have been updated. Subclasses update their data
+// and then call super, which reloads the rows that changed.
 - (void)searchControllerDidUpdateResults:(NSNotification *)notification;
 
+// The table results displayed in the table since the last update, starting
+// at the first row of -rowModelRangeForRowCount:.
+- (QSBResultRowModel *)rowModel;
+
+// The rows of the table that are compared between updates to find the ones
+// that need reloading. Defaults to all of them.
+- (NSRange)rowModelRangeForRowCount:(NSUInteger)rowCount;
+
+// The table results for |rows|. Defaults to calling tableResultForRow:.
+- (NSArray *)tableResultsInRange:(NSRange)rows;
+
+// Reloads every row in the table.
+- (void)reloadAllRows;
+
 @end
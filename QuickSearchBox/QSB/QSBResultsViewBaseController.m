@@ -40,6 +40,12 @@
 #import "QSBSearchWindowController.h"
 #import "GTMGeometryUtils.h"
 #import "QSBSearchController.h"
+#import "QSBResultRowModel.h"
+
+// Our subclasses are the data sources for their tables.
+@interface QSBResultsViewBaseController (QSBResultsViewBaseControllerDataSource)
+- (NSInteger)numberOfRowsInTableView:(NSTableView *)tableView;
+@end
 
 @implementation QSBResultsViewBaseController
 
@@ -49,6 +55,7 @@
                        nibName:(NSString *)nibName {
   if ((self = [super initWithNibName:nibName bundle:nil])) {
     searchController_ = [controller retain];
+    rowModel_ = [[QSBResultRowModel alloc] init];
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc addObserver:self
            selector:@selector(searchControllerDidUpdateResults:)
@@ -65,6 +72,7 @@
 
 - (void)dealloc {
   [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [rowModel_ release];
   [super dealloc];
 }
 
@@ -76,9 +84,54 @@
   return [self tableResultForRow:[resultsTableView_ selectedRow]];
 }
 
+- (QSBResultRowModel *)rowModel {
+  return rowModel_;
+}
+
+- (NSRange)rowModelRangeForRowCount:(NSUInteger)rowCount {
+  return NSMakeRange(0, rowCount);
+}
+
+- (NSArray *)tableResultsInRange:(NSRange)rows {
+  NSMutableArray *tableResults = [NSMutableArray arrayWithCapacity:rows.length];
+  for (NSUInteger row = rows.location; row < NSMaxRange(rows); ++row) {
+    QSBTableResult *tableResult = [self tableResultForRow:row];
+    [tableResults addObject:tableResult ? (id)tableResult : [NSNull null]];
+  }
+  return tableResults;
+}
+
+- (void)reloadAllRows {
+  [rowModel_ removeAllRows];
+  [[self resultsTableView] reloadData];
+}
+
 - (void)searchControllerDidUpdateResults:(NSNotification *)notification {
-  NSTableView *resultsTableView = [self resultsTableView];
-  [resultsTableView reloadData];
+  QSBResultsViewTableView *resultsTableView = [self resultsTableView];
+  NSUInteger rowCount = [self numberOfRowsInTableView:resultsTableView];
+  NSRange rows = [self rowModelRangeForRowCount:rowCount];
+  NSArray *tableResults = [self tableResultsInRange:rows];
+  QSBResultRowDiff *diff = [rowModel_ updateRows:tableResults];
+  if (rows.location == rowModelOffset_) {
+    NSMutableIndexSet *changedRows
+      = [[[diff changedIndexes] mutableCopy] autorelease];
+    [changedRows shiftIndexesStartingAtIndex:0 by:rows.location];
+    // Rows past the ones we compare are new whenever the table grows.
+    NSInteger oldRowCount = [resultsTableView numberOfRows];
+    if ((NSInteger)rowCount > oldRowCount) {
+      NSRange addedRows = NSMakeRange(oldRowCount, rowCount - oldRowCount);
+      [changedRows addIndexesInRange:addedRows];
+    } else if ((NSInteger)rowCount < oldRowCount) {
+      NSRange removedRows = NSMakeRange(rowCount, oldRowCount - rowCount);
+      [changedRows addIndexesInRange:removedRows];
+    }
+    [resultsTableView reloadDataForRowIndexes:changedRows];
+  } else {
+    // The rows we compare have scrolled, so the diff doesn't line up with
+    // the table.
+    rowModelOffset_ = rows.location;
+    [resultsTableView reloadData];
+  }
   if ([resultsTableView selectedRow] == -1) {
     [resultsTableView selectRowIndexes:[NSIndexSet indexSetWithIndex:0]
                   byExtendingSelection:NO];
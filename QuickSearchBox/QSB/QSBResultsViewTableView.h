@@ -39,4 +39,10 @@
   QSBViewTableViewDelegateProxy *delegateProxy_;
   QSBViewTableViewDataSourceProxy *dataSourceProxy_;
 }
+
+// Like reloadData, but only the rows in |rows| are reloaded. The number of
+// rows is refetched, and rows below the first changed one are redrawn in case
+// row heights changed, but they keep their views.
+- (void)reloadDataForRowIndexes:(NSIndexSet *)rows;
+
 @end
@@ -564,4 +564,34 @@ sortDescriptorsDidChange:(NSArray *)oldDescriptors {
   }
   [super reloadData];
 }
+
+- (void)reloadDataForRowIndexes:(NSIndexSet *)rows {
+  NSUInteger firstRow = [rows firstIndex];
+  if (firstRow == NSNotFound) return;
+  // Strip out the views of the rows that are changing while we still know
+  // where they are. The rest are moved into place as their rows are drawn.
+  NSArray *subviews = [[[self subviews] copy] autorelease];
+  for (NSView *subview in subviews) {
+    NSRange subviewRows = [self rowsInRect:[subview frame]];
+    if (!subviewRows.length
+        || [rows intersectsIndexesInRange:subviewRows]) {
+      [subview removeFromSuperviewWithoutNeedingDisplay];
+    }
+  }
+  [self noteNumberOfRowsChanged];
+  NSInteger rowCount = [self numberOfRows];
+  NSRect dirtyRect = [self visibleRect];
+  if ((NSInteger)firstRow < rowCount) {
+    NSMutableIndexSet *changedRows = [[rows mutableCopy] autorelease];
+    [changedRows removeIndexesInRange:NSMakeRange(rowCount,
+                                                  NSNotFound - rowCount)];
+    [self noteHeightOfRowsWithIndexesChanged:changedRows];
+    CGFloat top = NSMinY([self rectOfRow:firstRow]);
+    dirtyRect.size.height = MAX(NSMaxY(dirtyRect) - top, 0);
+    dirtyRect.origin.y = top;
+  }
+  [self setNeedsDisplayInRect:dirtyRect];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc postNotificationName:kQSBResultTableViewDidReloadData object:self];
+}
 @end
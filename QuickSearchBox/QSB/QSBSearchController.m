@@ -326,19 +326,18 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 - (NSDictionary *)resultCountByCategory {
   QSBCategoryManager *categoryMgr = [QSBCategoryManager sharedManager];
   NSArray *categories = [categoryMgr categories];
-  NSMutableDictionary *resultCountByCategory
-    = [NSMutableDictionary dictionaryWithCapacity:[categories count]];
-  for (QSBCategory *category in categories) {
-    HGSTypeFilter *typeFilter = [category typeFilter];
-    NSUInteger count = [queryController_ resultCountForFilter:typeFilter];
-    NSNumber *value = [NSNumber numberWithUnsignedInteger:count];
-    [resultCountByCategory setObject:value forKey:category];
-  }
-  return resultCountByCategory;
+  NSArray *typeFilters = [categories valueForKey:@"typeFilter"];
+  // Count all the categories in one pass over the results.
+  NSArray *counts = [queryController_ resultCountsForFilters:typeFilters];
+  return [NSDictionary dictionaryWithObjects:counts forKeys:categories];
 }
 
 - (void)setTokenizedQueryString:(HGSTokenizedString *)tokenizedQueryString
                    pivotObjects:(HGSResultArray *)pivotObjects {
+  if ([tokenizedQueryString originalLength] || [pivotObjects count]) {
+    // A new query replaces this one.
+    [queryController_ supersede];
+  }
   [self stopQuery];
   HGSTokenizedString *oldString = [self tokenizedQueryString];
   HGSResultArray *oldPivots = [self pivotObjects];
@@ -480,7 +479,11 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
 // called when enough time has elapsed that we want to display some results
 // to the user.
 - (void)displayTimerElapsed:(NSTimer*)timer {
-  [self updateResults];
+  // Nothing has reported in since the last tick, so don't rebuild and
+  // redisplay the same results.
+  if (resultsNeedUpdating_) {
+    [self updateResults];
+  }
   ++displayTimerStage_;
   NSUInteger stages
     = sizeof(kQSBDisplayTimerStages) / sizeof(kQSBDisplayTimerStages[0]);
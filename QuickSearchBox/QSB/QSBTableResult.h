@@ -132,7 +132,9 @@
 @end
 
 /*!
-  A result that comes from one of our sources.
+  A result that comes from one of our sources. The attributed strings it
+  renders are cached until the icon or the name, snippet or source URL of
+  the result change, unless the source marks any of those keys volatile.
 */
 @interface QSBSourceTableResult : QSBTableResult {
  @private
@@ -140,6 +142,8 @@
   NSImage *thumbnailImage_;
   NSImage *icon_;
   NSString *categoryName_;
+  NSMutableDictionary *renderedStrings_;
+  BOOL cachesRenderedStrings_;
 }
 
 @property (nonatomic, readonly) HGSScoredResult *representedResult;
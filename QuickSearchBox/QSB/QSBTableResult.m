@@ -90,8 +90,105 @@ static NSString *const kClipboardCopyActionIdentifier
 
 @interface QSBSourceTableResult ()
 - (void)objectIconChanged:(GTMKeyValueChangeNotification *)notification;
+- (void)objectAttributeChanged:(GTMKeyValueChangeNotification *)notification;
+- (void)invalidateRenderedStrings;
+- (BOOL)getRenderedString:(NSAttributedString **)string
+                 forStyle:(NSString *)style;
+- (NSAttributedString *)cacheRenderedString:(NSAttributedString *)string
+                                   forStyle:(NSString *)style;
+- (NSAttributedString *)renderSnippetString;
+- (NSAttributedString *)renderSourceURLString;
 @end
 
+// Keys for QSBSourceTableResult's cache of rendered strings. Each one is
+// also the name of the method that renders it, for KVO.
+static NSString *const kQSBRenderedTitleStyle = @"titleString";
+static NSString *const kQSBRenderedSnippetStyle = @"snippetString";
+static NSString *const kQSBRenderedSourceURLStyle = @"sourceURLString";
+static NSString *const kQSBRenderedTitleSnippetStyle = @"titleSnippetString";
+static NSString *const kQSBRenderedTitleSourceURLStyle
+  = @"titleSourceURLString";
+static NSString *const kQSBRenderedTitleSnippetSourceURLStyle
+  = @"titleSnippetSourceURLString";
+
+// Scans |html| once. <b> and </b>, in any case, become ranges of the
+// returned text that are added to |boldRanges|. HTML entities are unescaped
+// in the text between tags. Any other markup is left as text.
+static NSString *QSBTextFromHTMLString(NSString *html,
+                                       NSMutableArray *boldRanges) {
+  CFStringRef cfHTML = (CFStringRef)html;
+  CFIndex length = CFStringGetLength(cfHTML);
+  CFStringInlineBuffer buffer;
+  CFStringInitInlineBuffer(cfHTML, &buffer, CFRangeMake(0, length));
+  NSMutableString *text = nil;
+  CFIndex runStart = 0;
+  BOOL runHasEntity = NO;
+  NSUInteger boldDepth = 0;
+  NSUInteger boldStart = 0;
+  for (CFIndex i = 0; i <= length; ++i) {
+    BOOL isEnd = i == length;
+    UniChar c = isEnd ? 0 : CFStringGetCharacterFromInlineBuffer(&buffer, i);
+    if (c == '&') {
+      runHasEntity = YES;
+      continue;
+    }
+    CFIndex tagEnd = 0;
+    BOOL isCloseTag = NO;
+    if (c == '<') {
+      CFIndex j = i + 1;
+      if (j < length
+          && CFStringGetCharacterFromInlineBuffer(&buffer, j) == '/') {
+        isCloseTag = YES;
+        ++j;
+      }
+      if (j + 1 < length) {
+        UniChar tag = CFStringGetCharacterFromInlineBuffer(&buffer, j);
+        UniChar close = CFStringGetCharacterFromInlineBuffer(&buffer, j + 1);
+        if ((tag == 'b' || tag == 'B') && close == '>') {
+          tagEnd = j + 2;
+        }
+      }
+    }
+    if (!isEnd && !tagEnd) continue;
+    NSString *run = nil;
+    if (runStart == 0 && isEnd) {
+      // No tags at all, which is the usual case.
+      run = html;
+    } else {
+      run = [html substringWithRange:NSMakeRange(runStart, i - runStart)];
+    }
+    if (runHasEntity) {
+      run = [run gtm_stringByUnescapingFromHTML];
+    }
+    if (!text) {
+      if (isEnd) return run;
+      text = [NSMutableString stringWithCapacity:length];
+    }
+    [text appendString:run];
+    if (isCloseTag) {
+      if (boldDepth && --boldDepth == 0 && [text length] > boldStart) {
+        NSRange range = NSMakeRange(boldStart, [text length] - boldStart);
+        [boldRanges addObject:[NSValue valueWithRange:range]];
+      }
+    } else if (tagEnd) {
+      if (boldDepth++ == 0) {
+        boldStart = [text length];
+      }
+    }
+    if (tagEnd) {
+      runStart = tagEnd;
+      runHasEntity = NO;
+      i = tagEnd - 1;
+    }
+  }
+  // An unclosed <b> runs to the end.
+  if (boldDepth && [text length] > boldStart) {
+    NSRange range = NSMakeRange(boldStart, [text length] - boldStart);
+    [boldRanges addObject:[NSValue valueWithRange:range]];
+  }
+  return text;
+}
+
 @interface NSString(QSBDisplayPathAdditions)
 // Converts a path to a pretty, localized, arrow separated version
 // Returns autoreleased string with beautified path
@@ -103,8 +200,6 @@ static NSString *const kClipboardCopyActionIdentifier
 
 GTM_METHOD_CHECK(NSMutableAttributedString, addAttribute:value:);
 GTM_METHOD_CHECK(NSMutableAttributedString, addAttributes:);
-GTM_METHOD_CHECK(NSMutableAttributedString,
-                 addAttributes:fontTraits:toTextDelimitedBy:postDelimiter:);
 GTM_METHOD_CHECK(NSString, qsb_displayPath);
 GTM_METHOD_CHECK(NSString, gtm_stringByUnescapingFromHTML);
 
@@ -271,29 +366,43 @@ static NSDictionary *gBaseStringAttributes_ = nil;
 
 - (NSMutableAttributedString *)mutableAttributedStringFromHTMLString:(NSString*)item
                                                      prettyPrintPath:(BOOL)prettyPrintPath {
-  NSMutableString *mutableItem = [NSMutableString stringWithString:item];
-
-  NSString* boldPrefix = @"%QSB_MAC_BOLD_PREFIX%";
-  NSString* boldSuffix = @"%QSB_MAC_BOLD_SUFFIX%";
-  [mutableItem replaceOccurrencesOfString:@"<b>"
-                               withString:boldPrefix
-                                  options:NSCaseInsensitiveSearch
-                                    range:NSMakeRange(0, [mutableItem length])];
-  [mutableItem replaceOccurrencesOfString:@"</b>"
-                               withString:boldSuffix
-                                  options:NSCaseInsensitiveSearch
-                                    range:NSMakeRange(0, [mutableItem length])];
   if (prettyPrintPath) {
-    NSString *displayString = [mutableItem qsb_displayPath];
-    mutableItem = [NSMutableString stringWithString:displayString];
-  }
-  NSString *unescapedItem = [mutableItem gtm_stringByUnescapingFromHTML];
-  NSMutableAttributedString* mutableAttributedItem =
-  [self mutableAttributedStringWithString:unescapedItem];
-  [mutableAttributedItem addAttributes:nil
-                            fontTraits:NSBoldFontMask
-                     toTextDelimitedBy:boldPrefix
-                         postDelimiter:boldSuffix];
+    // qsb_displayPath would treat the slash in </b> as a path separator.
+    NSString *boldPrefix = @"%QSB_MAC_BOLD_PREFIX%";
+    NSString *boldSuffix = @"%QSB_MAC_BOLD_SUFFIX%";
+    NSMutableString *mutableItem = [NSMutableString stringWithString:item];
+    NSArray *swaps = [NSArray arrayWithObjects:
+                      @"<b>", boldPrefix, @"</b>", boldSuffix, nil];
+    for (NSUInteger i = 0; i < [swaps count]; i += 2) {
+      NSRange all = NSMakeRange(0, [mutableItem length]);
+      [mutableItem replaceOccurrencesOfString:[swaps objectAtIndex:i]
+                                   withString:[swaps objectAtIndex:i + 1]
+                                      options:NSCaseInsensitiveSearch
+                                        range:all];
+    }
+    mutableItem
+      = [NSMutableString stringWithString:[mutableItem qsb_displayPath]];
+    for (NSUInteger i = 0; i < [swaps count]; i += 2) {
+      NSRange all = NSMakeRange(0, [mutableItem length]);
+      [mutableItem replaceOccurrencesOfString:[swaps objectAtIndex:i + 1]
+                                   withString:[swaps objectAtIndex:i]
+                                      options:0
+                                        range:all];
+    }
+    item = mutableItem;
+  }
+  NSMutableArray *boldRanges = [NSMutableArray array];
+  NSString *text = QSBTextFromHTMLString(item, boldRanges);
+  NSMutableAttributedString* mutableAttributedItem 
+    = [self mutableAttributedStringWithString:text];
+  if ([boldRanges count]) {
+    [mutableAttributedItem beginEditing];
+    for (NSValue *boldRange in boldRanges) {
+      [mutableAttributedItem applyFontTraits:NSBoldFontMask
+                                       range:[boldRange rangeValue]];
+    }
+    [mutableAttributedItem endEditing];
+  }
   return mutableAttributedItem;
 }
 
@@ -360,12 +469,31 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
                                selector:@selector(objectIconChanged:)
                                userInfo:nil
                                 options:NSKeyValueObservingOptionNew];
+    NSArray *renderedKeys
+      = [NSArray arrayWithObjects:kHGSObjectAttributeNameKey,
+         kHGSObjectAttributeSnippetKey, kHGSObjectAttributeSourceURLKey, nil];
+    for (NSString *key in renderedKeys) {
+      [representedResult_ gtm_addObserver:self
+                               forKeyPath:key
+                                 selector:@selector(objectAttributeChanged:)
+                                 userInfo:nil
+                                  options:0];
+    }
+    // Values for volatile keys are fetched from the source every time, so
+    // there is nothing to tell us when they change.
+    NSSet *volatileKeys = [[result source] volatileResultKeys];
+    NSSet *renderedKeySet = [NSSet setWithArray:renderedKeys];
+    cachesRenderedStrings_ = ![volatileKeys intersectsSet:renderedKeySet];
+    if (cachesRenderedStrings_) {
+      renderedStrings_ = [[NSMutableDictionary alloc] initWithCapacity:6];
+    }
   }
   return self;
 }
 
 - (void)dealloc {
   [self gtm_stopObservingAllKeyPaths];
+  [renderedStrings_ release];
   [representedResult_ release];
   [thumbnailImage_ release];
   [icon_ release];
@@ -397,6 +525,111 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   }
   [self didChangeValueForKey:@"displayThumbnail"];
   [self didChangeValueForKey:@"displayIcon"];
+  [self invalidateRenderedStrings];
+}
+
+- (void)objectAttributeChanged:(GTMKeyValueChangeNotification *)notification {
+  [self invalidateRenderedStrings];
+}
+
+- (void)invalidateRenderedStrings {
+  if (!cachesRenderedStrings_) return;
+  NSArray *styles
+    = [NSArray arrayWithObjects:kQSBRenderedTitleStyle,
+       kQSBRenderedSnippetStyle, kQSBRenderedSourceURLStyle,
+       kQSBRenderedTitleSnippetStyle, kQSBRenderedTitleSourceURLStyle,
+       kQSBRenderedTitleSnippetSourceURLStyle, nil];
+  for (NSString *style in styles) {
+    [self willChangeValueForKey:style];
+  }
+  @synchronized(renderedStrings_) {
+    [renderedStrings_ removeAllObjects];
+  }
+  for (NSString *style in [styles reverseObjectEnumerator]) {
+    [self didChangeValueForKey:style];
+  }
+}
+
+- (BOOL)getRenderedString:(NSAttributedString **)string
+                 forStyle:(NSString *)style {
+  if (!cachesRenderedStrings_) return NO;
+  id value = nil;
+  @synchronized(renderedStrings_) {
+    value = [[[renderedStrings_ objectForKey:style] retain] autorelease];
+  }
+  if (!value) return NO;
+  *string = (value == [NSNull null]) ? nil : value;
+  return YES;
+}
+
+- (NSAttributedString *)cacheRenderedString:(NSAttributedString *)string
+                                   forStyle:(NSString *)style {
+  // Callers may mutate what they get back, so keep our own copy.
+  NSAttributedString *cached = [[string copy] autorelease];
+  if (cachesRenderedStrings_) {
+    @synchronized(renderedStrings_) {
+      [renderedStrings_ setObject:cached ? (id)cached : [NSNull null]
+                           forKey:style];
+    }
+  }
+  return cached;
+}
+
+- (NSAttributedString *)titleString {
+  NSAttributedString *string = nil;
+  if (![self getRenderedString:&string forStyle:kQSBRenderedTitleStyle]) {
+    string = [self cacheRenderedString:[super titleString]
+                              forStyle:kQSBRenderedTitleStyle];
+  }
+  return string;
+}
+
+- (NSAttributedString *)titleSnippetSourceURLString {
+  NSAttributedString *string = nil;
+  NSString *style = kQSBRenderedTitleSnippetSourceURLStyle;
+  if (![self getRenderedString:&string forStyle:style]) {
+    string = [self cacheRenderedString:[super titleSnippetSourceURLString]
+                              forStyle:style];
+  }
+  return string;
+}
+
+- (NSAttributedString *)titleSnippetString {
+  NSAttributedString *string = nil;
+  NSString *style = kQSBRenderedTitleSnippetStyle;
+  if (![self getRenderedString:&string forStyle:style]) {
+    string = [self cacheRenderedString:[super titleSnippetString]
+                              forStyle:style];
+  }
+  return string;
+}
+
+- (NSAttributedString *)titleSourceURLString {
+  NSAttributedString *string = nil;
+  NSString *style = kQSBRenderedTitleSourceURLStyle;
+  if (![self getRenderedString:&string forStyle:style]) {
+    string = [self cacheRenderedString:[super titleSourceURLString]
+                              forStyle:style];
+  }
+  return string;
+}
+
+- (NSAttributedString *)snippetString {
+  NSAttributedString *string = nil;
+  if (![self getRenderedString:&string forStyle:kQSBRenderedSnippetStyle]) {
+    string = [self cacheRenderedString:[self renderSnippetString]
+                              forStyle:kQSBRenderedSnippetStyle];
+  }
+  return string;
+}
+
+- (NSAttributedString *)sourceURLString {
+  NSAttributedString *string = nil;
+  if (![self getRenderedString:&string forStyle:kQSBRenderedSourceURLStyle]) {
+    string = [self cacheRenderedString:[self renderSourceURLString]
+                              forStyle:kQSBRenderedSourceURLStyle];
+  }
+  return string;
 }
 
 - (BOOL)isPivotable {
@@ -523,7 +756,7 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   return title;
 }
 
-- (NSAttributedString*)snippetString {
+- (NSAttributedString*)renderSnippetString {
   // Snippet is rendered as 12 pt gray (50% black).
   NSMutableAttributedString *snippetString = nil;
   HGSScoredResult *result = [self representedResult];
@@ -535,7 +768,7 @@ GTM_METHOD_CHECK(NSObject, gtm_stopObservingAllKeyPaths);
   return snippetString;
 }
 
-- (NSAttributedString*)sourceURLString {
+- (NSAttributedString*)renderSourceURLString {
   // SourceURL is rendered as 12 pt green.
   NSMutableAttributedString *sourceURLString = nil;
   HGSScoredResult *result = [self representedResult];
@@ -0,0 +1,216 @@
+//
+//  QSBTableResultTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import <Vermilion/Vermilion.h>
+#import "QSBTableResult.h"
+
+@interface QSBTableResult (QSBTableResultTestPrivate)
+- (NSMutableAttributedString *)
+    mutableAttributedStringFromHTMLString:(NSString *)html;
+- (NSAttributedString*)snippetString;
+@end
+
+// Stands in for a source, optionally marking some keys volatile.
+@interface QSBTableResultTestSource : NSObject {
+ @private
+  NSSet *volatileResultKeys_;
+}
+- (id)initWithVolatileResultKeys:(NSSet *)keys;
+- (NSSet *)volatileResultKeys;
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result;
+@end
+
+@implementation QSBTableResultTestSource
+
+- (id)initWithVolatileResultKeys:(NSSet *)keys {
+  if ((self = [super init])) {
+    volatileResultKeys_ = [keys retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [volatileResultKeys_ release];
+  [super dealloc];
+}
+
+- (NSSet *)volatileResultKeys {
+  return volatileResultKeys_;
+}
+
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result {
+  return nil;
+}
+
+@end
+
+@interface QSBTableResultTest : GTMTestCase
+@end
+
+@implementation QSBTableResultTest
+
+- (QSBSourceTableResult *)tableResultWithSnippet:(NSString *)snippet
+                                          source:(id)source {
+  NSDictionary *attributes
+    = [NSDictionary dictionaryWithObject:snippet
+                                  forKey:kHGSObjectAttributeSnippetKey];
+  HGSScoredResult *result
+    = [HGSScoredResult resultWithURI:@"http://www.google.com/"
+                                name:@"Google"
+                                type:kHGSTypeWebpage
+                              source:source
+                          attributes:attributes
+                               score:0
+                               flags:0
+                         matchedTerm:nil
+                      matchedIndexes:nil];
+  STAssertNotNil(result, nil);
+  return [QSBSourceTableResult tableResultWithResult:result];
+}
+
+- (NSArray *)boldRangesOfString:(NSAttributedString *)string {
+  NSMutableArray *ranges = [NSMutableArray array];
+  NSFontManager *fontManager = [NSFontManager sharedFontManager];
+  NSUInteger index = 0;
+  while (index < [string length]) {
+    NSRange range;
+    NSFont *font = [string attribute:NSFontAttributeName
+                             atIndex:index
+                      effectiveRange:&range];
+    if ([fontManager traitsOfFont:font] & NSBoldFontMask) {
+      [ranges addObject:[NSValue valueWithRange:range]];
+    }
+    index = NSMaxRange(range);
+  }
+  return ranges;
+}
+
+- (void)testHTMLRendering {
+  QSBSourceTableResult *tableResult
+    = [self tableResultWithSnippet:@"snippet" source:nil];
+  struct {
+    NSString *html;
+    NSString *text;
+    NSUInteger boldLocation;
+    NSUInteger boldLength;
+  } tests[] = {
+    { @"", @"", 0, 0 },
+    { @"plain", @"plain", 0, 0 },
+    { @"a &amp; b", @"a & b", 0, 0 },
+    { @"a <b>bold</b> c", @"a bold c", 2, 4 },
+    { @"<B>Bold</B> c", @"Bold c", 0, 4 },
+    { @"x <b>&lt;y&gt;</b>", @"x <y>", 2, 3 },
+    { @"&lt;b&gt;not bold&lt;/b&gt;", @"<b>not bold</b>", 0, 0 },
+    { @"<i>kept</i> <b>open", @"<i>kept</i> open", 12, 4 },
+    { @"stray</b> <b></b>close", @"stray close", 0, 0 },
+    { @"<b>a <b>b</b> c</b>", @"a b c", 0, 5 },
+  };
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    NSAttributedString *string
+      = [tableResult mutableAttributedStringFromHTMLString:tests[i].html];
+    STAssertEqualObjects([string string], tests[i].text,
+                         @"Rendering %@", tests[i].html);
+    NSArray *boldRanges = [self boldRangesOfString:string];
+    if (tests[i].boldLength) {
+      NSRange expected = NSMakeRange(tests[i].boldLocation,
+                                     tests[i].boldLength);
+      STAssertEquals([boldRanges count], (NSUInteger)1,
+                     @"Rendering %@", tests[i].html);
+      STAssertEquals([[boldRanges lastObject] rangeValue], expected,
+                     @"Rendering %@", tests[i].html);
+    } else {
+      STAssertEquals([boldRanges count], (NSUInteger)0,
+                     @"Rendering %@", tests[i].html);
+    }
+  }
+}
+
+- (void)testRenderedStringCache {
+  QSBSourceTableResult *tableResult
+    = [self tableResultWithSnippet:@"a <b>snippet</b>" source:nil];
+  NSAttributedString *snippet = [tableResult snippetString];
+  STAssertEqualObjects([snippet string], @"a snippet", nil);
+  STAssertEquals([tableResult snippetString], snippet, nil);
+  NSAttributedString *title = [tableResult titleSnippetString];
+  STAssertEqualObjects([title string], @"Google\na snippet", nil);
+  STAssertEquals([tableResult titleSnippetString], title, nil);
+
+  // A change to the result throws the rendered strings away.
+  HGSScoredResult *result = [tableResult representedResult];
+  [result willChangeValueForKey:kHGSObjectAttributeSnippetKey];
+  [result didChangeValueForKey:kHGSObjectAttributeSnippetKey];
+  STAssertNotEquals([tableResult snippetString], snippet, nil);
+  STAssertEqualObjects([tableResult snippetString], snippet, nil);
+  STAssertNotEquals([tableResult titleSnippetString], title, nil);
+
+  // Volatile snippets are rendered every time.
+  NSSet *keys = [NSSet setWithObject:kHGSObjectAttributeSnippetKey];
+  QSBTableResultTestSource *source
+    = [[[QSBTableResultTestSource alloc] initWithVolatileResultKeys:keys]
+       autorelease];
+  tableResult = [self tableResultWithSnippet:@"a <b>snippet</b>"
+                                      source:source];
+  snippet = [tableResult snippetString];
+  STAssertEqualObjects([snippet string], @"a snippet", nil);
+  STAssertNotEquals([tableResult snippetString], snippet, nil);
+}
+
+- (void)testSnippetRenderingSpeed {
+  NSString *html
+    = @"Results for <b>quick</b> <b>search</b> &amp; launch, "
+      @"with &quot;entities&quot; and a <B>bold</B> ending";
+  const NSUInteger kRenders = 10000;
+  NSMutableArray *tableResults = [NSMutableArray arrayWithCapacity:100];
+  for (NSUInteger i = 0; i < 100; ++i) {
+    NSString *snippet = [NSString stringWithFormat:@"%@ %lu", html,
+                         (unsigned long)i];
+    [tableResults addObject:[self tableResultWithSnippet:snippet source:nil]];
+  }
+  QSBSourceTableResult *tableResult = [tableResults objectAtIndex:0];
+  NSDate *start = [NSDate date];
+  for (NSUInteger i = 0; i < kRenders; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [tableResult mutableAttributedStringFromHTMLString:html];
+    [pool release];
+  }
+  NSTimeInterval renderTime = -[start timeIntervalSinceNow];
+  start = [NSDate date];
+  for (NSUInteger i = 0; i < kRenders; ++i) {
+    tableResult = [tableResults objectAtIndex:i % [tableResults count]];
+    STAssertNotNil([tableResult snippetString], nil);
+  }
+  NSTimeInterval cachedTime = -[start timeIntervalSinceNow];
+  STAssertLessThan(cachedTime, renderTime, nil);
+}
+
+@end
@@ -39,6 +39,7 @@
 #import "QSBTableResult.h"
 #import "QSBTopResultsRowViewControllers.h"
 #import "QSBResultsWindowController.h"
+#import "QSBResultRowModel.h"
 
 @implementation QSBTopResultsViewController
 
@@ -62,7 +63,15 @@
 #pragma mark QSBResultsViewBaseController Overrides
 
 - (QSBTableResult *)tableResultForRow:(NSInteger)row {
-  return [[self searchController] topResultForIndex:row];
+  QSBTableResult *result = nil;
+  if (row >= 0) {
+    result = [[self rowModel] rowAtIndex:row];
+  }
+  return result;
+}
+
+- (NSArray *)tableResultsInRange:(NSRange)rows {
+  return [[self searchController] topResultsInRange:rows];
 }
 
 #pragma mark Actions
@@ -0,0 +1,415 @@
+//
+//  CalculatorExpression.c
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "CalculatorExpression.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every token adds at most one operator node, one instruction and one
+// constant, so the expression length bounds all of them.
+#define kMaxLength kCalculatorExpressionMaxLength
+
+// Largest mantissa a double holds exactly.
+static const uint64_t kMaxExactMantissa = 1ULL << 53;
+
+// Powers of ten a double holds exactly. Dividing an exact mantissa by one of
+// them rounds correctly, so numbers are read without strtod and its locale.
+static const double kExactPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef enum {
+  kOpPush,  // Pushes the next constant.
+  kOpAdd,
+  kOpSubtract,
+  kOpMultiply,
+  kOpDivide,
+  kOpPower,
+  kOpNegate,
+  kOpOpenParen  // Only on the operator stack, never emitted.
+} CalculatorOp;
+
+// The operator stack is a linked list of nodes that are never changed once
+// added. A checkpoint only needs the top of the stack and the node count to
+// restore it.
+typedef struct {
+  uint8_t op;
+  int16_t next;
+} CalculatorOperatorNode;
+
+typedef struct {
+  uint16_t position;  // Characters consumed.
+  // Characters looked at to get here. One past the length if the end of the
+  // input was seen, so a checkpoint is only reused if everything it looked
+  // at is unchanged.
+  uint16_t examined;
+  uint16_t codeLength;
+  uint16_t constantCount;
+  uint16_t nodeCount;
+  int16_t top;
+  bool expectOperand;
+  bool afterNegate;
+} CalculatorCheckpoint;
+
+struct CalculatorExpression {
+  uint16_t decimal_;
+  uint16_t grouping_;
+  uint16_t chars_[kMaxLength];
+  size_t length_;
+  size_t reusedLength_;
+  // Checkpoint 0 is the empty state and is always valid.
+  CalculatorCheckpoint checkpoints_[kMaxLength + 1];
+  size_t checkpointCount_;
+  CalculatorOperatorNode nodes_[kMaxLength];
+  uint8_t code_[kMaxLength];
+  double constants_[kMaxLength];
+  // Zero unless the last compile succeeded.
+  size_t programLength_;
+};
+
+static int CalculatorOpPrecedence(uint8_t op) {
+  switch (op) {
+    case kOpAdd:
+    case kOpSubtract:
+      return 1;
+    case kOpMultiply:
+    case kOpDivide:
+      return 2;
+    case kOpNegate:
+      return 3;
+    case kOpPower:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+static bool CalculatorIsDigit(uint16_t c) {
+  return c >= '0' && c <= '9';
+}
+
+// Reads the character at |idx| and notes that it was looked at. Returns false
+// at the end of the input.
+static bool CalculatorPeek(const CalculatorExpression *expression,
+                           CalculatorCheckpoint *state,
+                           size_t idx,
+                           uint16_t *c) {
+  if (idx >= expression->length_) {
+    state->examined = expression->length_ + 1;
+    return false;
+  }
+  if (idx + 1 > state->examined) {
+    state->examined = idx + 1;
+  }
+  *c = expression->chars_[idx];
+  return true;
+}
+
+static void CalculatorPushOperator(CalculatorExpression *expression,
+                                   CalculatorCheckpoint *state,
+                                   uint8_t op) {
+  CalculatorOperatorNode *node = &expression->nodes_[state->nodeCount];
+  node->op = op;
+  node->next = state->top;
+  state->top = state->nodeCount++;
+}
+
+// Emits operators off the stack while they bind at least as tightly as |op|.
+// Pass kOpOpenParen to emit everything down to the next open paren.
+static void CalculatorPopOperators(CalculatorExpression *expression,
+                                   CalculatorCheckpoint *state,
+                                   uint8_t op) {
+  int precedence = CalculatorOpPrecedence(op);
+  while (state->top >= 0) {
+    uint8_t topOp = expression->nodes_[state->top].op;
+    if (topOp == kOpOpenParen) break;
+    int topPrecedence = CalculatorOpPrecedence(topOp);
+    // Power is right associative.
+    if (topPrecedence < precedence
+        || (topPrecedence == precedence && op == kOpPower)) {
+      break;
+    }
+    expression->code_[state->codeLength++] = topOp;
+    state->top = expression->nodes_[state->top].next;
+  }
+}
+
+// Reads a number starting at the current position. Grouping separators are
+// skipped when a digit follows them and no decimal separator has been seen.
+static bool CalculatorReadNumber(CalculatorExpression *expression,
+                                 CalculatorCheckpoint *state) {
+  uint64_t mantissa = 0;
+  size_t scale = 0;
+  bool seenDigit = false;
+  bool seenDecimal = false;
+  size_t idx = state->position;
+  uint16_t c;
+  while (CalculatorPeek(expression, state, idx, &c)) {
+    if (CalculatorIsDigit(c)) {
+      uint64_t digit = c - '0';
+      if (mantissa > (kMaxExactMantissa - digit) / 10) return false;
+      mantissa = mantissa * 10 + digit;
+      if (seenDecimal) ++scale;
+      seenDigit = true;
+    } else if (c == expression->decimal_ && !seenDecimal) {
+      seenDecimal = true;
+    } else if (c == expression->grouping_ && expression->grouping_
+               && seenDigit && !seenDecimal) {
+      uint16_t next;
+      if (!CalculatorPeek(expression, state, idx + 1, &next)
+          || !CalculatorIsDigit(next)) {
+        break;
+      }
+    } else {
+      break;
+    }
+    ++idx;
+  }
+  if (!seenDigit) return false;
+  if (scale >= sizeof(kExactPowersOfTen) / sizeof(kExactPowersOfTen[0])) {
+    return false;
+  }
+  expression->constants_[state->constantCount++]
+    = (double)mantissa / kExactPowersOfTen[scale];
+  expression->code_[state->codeLength++] = kOpPush;
+  state->position = idx;
+  return true;
+}
+
+// Reads one token. Returns false if the expression can't be handled.
+static bool CalculatorReadToken(CalculatorExpression *expression,
+                                CalculatorCheckpoint *state,
+                                uint16_t c) {
+  bool afterNegate = state->afterNegate;
+  state->afterNegate = false;
+  if (state->expectOperand) {
+    if (CalculatorIsDigit(c) || c == expression->decimal_) {
+      if (!CalculatorReadNumber(expression, state)) return false;
+      state->expectOperand = false;
+      return true;
+    }
+    ++state->position;
+    if (c == '(') {
+      CalculatorPushOperator(expression, state, kOpOpenParen);
+      return true;
+    }
+    // Calculate.framework's handling of runs of signs isn't worth guessing.
+    if (c == '-' && !afterNegate) {
+      CalculatorPushOperator(expression, state, kOpNegate);
+      state->afterNegate = true;
+      return true;
+    }
+    return false;
+  }
+  ++state->position;
+  uint8_t op;
+  switch (c) {
+    case '+':
+      op = kOpAdd;
+      break;
+    case '-':
+      op = kOpSubtract;
+      break;
+    case '*':
+      op = kOpMultiply;
+      break;
+    case '/':
+      op = kOpDivide;
+      break;
+    case '^':
+      op = kOpPower;
+      break;
+    case ')':
+      CalculatorPopOperators(expression, state, kOpOpenParen);
+      if (state->top < 0) return false;
+      state->top = expression->nodes_[state->top].next;
+      return true;
+    default:
+      return false;
+  }
+  CalculatorPopOperators(expression, state, op);
+  // Whether -2^2 is -4 or 4 depends on who you ask, so don't answer.
+  if (op == kOpPower && state->top >= 0
+      && expression->nodes_[state->top].op == kOpNegate) {
+    return false;
+  }
+  CalculatorPushOperator(expression, state, op);
+  state->expectOperand = true;
+  return true;
+}
+
+CalculatorExpression *CalculatorExpressionCreate(void) {
+  CalculatorExpression *expression = calloc(1, sizeof(CalculatorExpression));
+  if (expression) {
+    expression->decimal_ = '.';
+    expression->grouping_ = ',';
+    CalculatorCheckpoint *empty = &expression->checkpoints_[0];
+    empty->top = -1;
+    empty->expectOperand = true;
+    expression->checkpointCount_ = 1;
+  }
+  return expression;
+}
+
+void CalculatorExpressionFree(CalculatorExpression *expression) {
+  free(expression);
+}
+
+void CalculatorExpressionSetSeparators(CalculatorExpression *expression,
+                                       uint16_t decimal,
+                                       uint16_t grouping) {
+  if (expression->decimal_ != decimal || expression->grouping_ != grouping) {
+    expression->decimal_ = decimal;
+    expression->grouping_ = grouping;
+    expression->length_ = 0;
+    expression->checkpointCount_ = 1;
+    expression->programLength_ = 0;
+  }
+}
+
+bool CalculatorExpressionCompile(CalculatorExpression *expression,
+                                 const uint16_t *chars,
+                                 size_t length) {
+  expression->programLength_ = 0;
+  if (length > kMaxLength) {
+    expression->length_ = 0;
+    expression->checkpointCount_ = 1;
+    expression->reusedLength_ = 0;
+    return false;
+  }
+  size_t common = 0;
+  size_t limit = length < expression->length_ ? length : expression->length_;
+  while (common < limit && expression->chars_[common] == chars[common]) {
+    ++common;
+  }
+  memcpy(expression->chars_ + common, chars + common,
+         (length - common) * sizeof(uint16_t));
+  expression->length_ = length;
+
+  // Examined counts only grow, so walk back to the last checkpoint that
+  // didn't look past the common prefix.
+  size_t checkpointIdx = expression->checkpointCount_ - 1;
+  while (expression->checkpoints_[checkpointIdx].examined > common) {
+    --checkpointIdx;
+  }
+  CalculatorCheckpoint state = expression->checkpoints_[checkpointIdx];
+  expression->checkpointCount_ = checkpointIdx + 1;
+  expression->reusedLength_ = state.position;
+
+  uint16_t c;
+  for (;;) {
+    while (CalculatorPeek(expression, &state, state.position, &c)
+           && c == ' ') {
+      ++state.position;
+    }
+    if (state.position >= length) break;
+    if (!CalculatorReadToken(expression, &state, c)) return false;
+    expression->checkpoints_[expression->checkpointCount_++] = state;
+  }
+
+  if (state.expectOperand) return false;
+  CalculatorPopOperators(expression, &state, kOpOpenParen);
+  // An open paren left on the stack is unbalanced.
+  if (state.top >= 0) return false;
+  expression->programLength_ = state.codeLength;
+  return true;
+}
+
+size_t CalculatorExpressionReusedLength(
+    const CalculatorExpression *expression) {
+  return expression->reusedLength_;
+}
+
+bool CalculatorExpressionEvaluate(const CalculatorExpression *expression,
+                                  double *result) {
+  size_t programLength = expression->programLength_;
+  if (!programLength) return false;
+  double stack[kMaxLength];
+  size_t depth = 0;
+  const double *constant = expression->constants_;
+  for (size_t i = 0; i < programLength; ++i) {
+    uint8_t op = expression->code_[i];
+    if (op == kOpPush) {
+      stack[depth++] = *constant++;
+    } else if (op == kOpNegate) {
+      stack[depth - 1] = -stack[depth - 1];
+    } else {
+      double rhs = stack[--depth];
+      double *lhs = &stack[depth - 1];
+      switch (op) {
+        case kOpAdd:
+          *lhs += rhs;
+          break;
+        case kOpSubtract:
+          *lhs -= rhs;
+          break;
+        case kOpMultiply:
+          *lhs *= rhs;
+          break;
+        case kOpDivide:
+          *lhs /= rhs;
+          break;
+        case kOpPower:
+          *lhs = pow(*lhs, rhs);
+          break;
+      }
+    }
+  }
+  *result = stack[0];
+  return isfinite(*result) ? true : false;
+}
+
+bool CalculatorExpressionFormat(double value, char *answer) {
+  if (value == 0) {
+    // Includes -0.
+    strcpy(answer, "0");
+    return true;
+  }
+  double magnitude = fabs(value);
+  if (!(magnitude >= 1e-4 && magnitude < 1e10)) return false;
+  int count = snprintf(answer, kCalculatorExpressionAnswerSize,
+                       "%.10g", value);
+  if (count < 0 || count >= kCalculatorExpressionAnswerSize) return false;
+  for (char *c = answer; *c; ++c) {
+    // Rounding up can still push a value into exponent form.
+    if (*c == 'e') return false;
+    // The C library may be using a locale with a different decimal point.
+    if (*c != '-' && (*c < '0' || *c > '9')) {
+      *c = '.';
+    }
+  }
+  return true;
+}
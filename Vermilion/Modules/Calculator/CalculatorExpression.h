@@ -0,0 +1,105 @@
+//
+//  CalculatorExpression.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+// A small arithmetic engine for the calculator source.
+//
+// Expressions are numbers, + - * / ^, unary minus and parentheses. They are
+// compiled to a short postfix program over doubles. Numbers are read straight
+// from the query's UTF-16 characters using the locale's decimal and grouping
+// separators, so the query is never rewritten.
+//
+// Compiling is incremental. After each token the compiler saves a checkpoint
+// of its state. When the next query starts with the same characters as the
+// last one, as it does while the user types, compiling resumes from the
+// last checkpoint that only depended on those characters.
+//
+// Anything the engine isn't sure it computes exactly like Calculate.framework
+// (function names, unbalanced parentheses, division by zero, results that
+// would need an exponent, ...) is rejected, and the caller falls back to the
+// framework.
+//
+// Plain C with no dependencies beyond libc and libm. Not thread safe.
+
+#ifndef CALCULATOR_EXPRESSION_H
+#define CALCULATOR_EXPRESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest expression, in UTF-16 characters, that the engine compiles.
+#define kCalculatorExpressionMaxLength 256
+
+// Big enough for any string CalculatorExpressionFormat produces.
+#define kCalculatorExpressionAnswerSize 32
+
+typedef struct CalculatorExpression CalculatorExpression;
+
+// Returns NULL if out of memory. Separators start out as '.' for decimals
+// and ',' for grouping.
+CalculatorExpression *CalculatorExpressionCreate(void);
+void CalculatorExpressionFree(CalculatorExpression *expression);
+
+// Sets the separators numbers are read with. Pass 0 for |grouping| if the
+// locale has none. Changing them throws away saved checkpoints.
+void CalculatorExpressionSetSeparators(CalculatorExpression *expression,
+                                       uint16_t decimal,
+                                       uint16_t grouping);
+
+// Compiles |length| characters, reusing as much of the previous compile as
+// possible. Returns false if the engine doesn't handle the expression.
+bool CalculatorExpressionCompile(CalculatorExpression *expression,
+                                 const uint16_t *chars,
+                                 size_t length);
+
+// Characters of the last compiled expression that were not lexed again.
+size_t CalculatorExpressionReusedLength(const CalculatorExpression *expression);
+
+// Runs the last successfully compiled expression. Returns false if the
+// result isn't a finite number.
+bool CalculatorExpressionEvaluate(const CalculatorExpression *expression,
+                                  double *result);
+
+// Writes |value| the way CalculatePerformExpression does with 10 significant
+// digits. Returns false for values it would write with an exponent.
+// |answer| must hold kCalculatorExpressionAnswerSize chars.
+bool CalculatorExpressionFormat(double value, char *answer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CALCULATOR_EXPRESSION_H
@@ -0,0 +1,308 @@
+//
+//  CalculatorExpressionTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import "CalculatePrivate.h"
+#import "CalculatorExpression.h"
+
+typedef struct {
+  NSString *expression;
+  const char *answer;  // NULL if the engine should leave it to the framework.
+} CalculatorExpressionTestCase;
+
+// Expressions people type, one keystroke at a time.
+static NSString *const kCalculatorTypedExpressions[] = {
+  @"1,234.5*(3+4)/2-7^2",
+  @"((12+34)*56-78)/9",
+  @"-3.25*4+1,000,000/8",
+  @"19.99*3+4.5",
+  @"2^10-1",
+  @"(100-15)/100*2,400",
+  @"365*24*60*60",
+  @"1/3+1/6",
+};
+
+@interface CalculatorExpressionTest : GTMTestCase {
+ @private
+  CalculatorExpression *expression_;
+}
+@end
+
+@implementation CalculatorExpressionTest
+
+- (void)setUp {
+  expression_ = CalculatorExpressionCreate();
+}
+
+- (void)tearDown {
+  CalculatorExpressionFree(expression_);
+  expression_ = NULL;
+}
+
+// Returns the engine's answer to |string|, or nil if it has none.
+- (NSString *)answerFor:(NSString *)string
+             expression:(CalculatorExpression *)expression {
+  UniChar chars[kCalculatorExpressionMaxLength];
+  NSUInteger length = [string length];
+  if (length > kCalculatorExpressionMaxLength) return nil;
+  [string getCharacters:chars range:NSMakeRange(0, length)];
+  double value;
+  char answer[kCalculatorExpressionAnswerSize];
+  if (!CalculatorExpressionCompile(expression, chars, length)
+      || !CalculatorExpressionEvaluate(expression, &value)
+      || !CalculatorExpressionFormat(value, answer)) {
+    return nil;
+  }
+  return [NSString stringWithUTF8String:answer];
+}
+
+- (NSString *)answerFor:(NSString *)string {
+  return [self answerFor:string expression:expression_];
+}
+
+// What CalculatorSource asked Calculate.framework before it had an engine.
+- (NSString *)frameworkAnswerFor:(NSString *)string
+                         decimal:(NSString *)decimal
+                        grouping:(NSString *)grouping {
+  NSMutableString *fixed = [NSMutableString stringWithString:string];
+  [fixed replaceOccurrencesOfString:grouping
+                         withString:@""
+                            options:0
+                              range:NSMakeRange(0, [fixed length])];
+  [fixed replaceOccurrencesOfString:decimal
+                         withString:@"."
+                            options:0
+                              range:NSMakeRange(0, [fixed length])];
+  char answer[1024];
+  answer[0] = '\0';
+  if (!CalculatePerformExpression((char *)[fixed UTF8String],
+                                  10, 1, answer)) {
+    return nil;
+  }
+  return [NSString stringWithUTF8String:answer];
+}
+
+- (void)testExpressions {
+  CalculatorExpressionTestCase cases[] = {
+    { @"1+1", "2" },
+    { @" 1 + 1 ", "2" },
+    { @"1+2*3", "7" },
+    { @"(1+2)*3", "9" },
+    { @"((2))", "2" },
+    { @"7-2-1", "4" },
+    { @"16/4/2", "2" },
+    { @"10/4", "2.5" },
+    { @"1/3", "0.3333333333" },
+    { @"2/3", "0.6666666667" },
+    { @"0.1+0.2", "0.3" },
+    { @".5+.5", "1" },
+    { @"2^10", "1024" },
+    { @"2^3^2", "512" },
+    { @"2^-1", "0.5" },
+    { @"-3*2", "-6" },
+    { @"2*-3", "-6" },
+    { @"1--2", "3" },
+    { @"3-3", "0" },
+    { @"-0*1", "0" },
+    { @"1,000+1", "1001" },
+    { @"1,000.5*2", "2001" },
+    // Left to the framework.
+    { @"--2", NULL },
+    { @"-2^2", NULL },
+    { @"1+", NULL },
+    { @"(1+2", NULL },
+    { @"1+2)", NULL },
+    { @"()", NULL },
+    { @"1 2", NULL },
+    { @"1,+2", NULL },
+    { @"1.5.2", NULL },
+    { @"1e3+1", NULL },
+    { @"sqrt(4)", NULL },
+    { @"1/0", NULL },
+    { @"12345678901*1", NULL },
+    { @"0.00001*1", NULL },
+    { @"9999999999.5+0", NULL },
+    { @"12345678901234567890+1", NULL },
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    NSString *answer = [self answerFor:cases[i].expression];
+    NSString *expected = nil;
+    if (cases[i].answer) {
+      expected = [NSString stringWithUTF8String:cases[i].answer];
+    }
+    STAssertEqualObjects(answer, expected, @"%@", cases[i].expression);
+  }
+}
+
+- (void)testSeparators {
+  CalculatorExpressionSetSeparators(expression_, ',', '.');
+  STAssertEqualObjects([self answerFor:@"1.000,5*2"], @"2001", nil);
+  STAssertEqualObjects([self answerFor:@"1,5+1"], @"2.5", nil);
+  // Locales without grouping.
+  CalculatorExpressionSetSeparators(expression_, '.', 0);
+  STAssertEqualObjects([self answerFor:@"1.5+1"], @"2.5", nil);
+  STAssertNil([self answerFor:@"1,000+1"], nil);
+  // Non-breaking space grouping, as in French.
+  CalculatorExpressionSetSeparators(expression_, ',', 0x00A0);
+  NSString *french = [NSString stringWithFormat:@"1%C000,5*2", 0x00A0];
+  STAssertEqualObjects([self answerFor:french], @"2001", nil);
+}
+
+- (void)testIncrementalCompile {
+  size_t count = sizeof(kCalculatorTypedExpressions) / sizeof(NSString *);
+  for (size_t i = 0; i < count; ++i) {
+    NSString *typed = kCalculatorTypedExpressions[i];
+    for (NSUInteger length = 1; length <= [typed length]; ++length) {
+      // Type a character, and every so often take the one before back and
+      // retype it.
+      NSMutableArray *steps = [NSMutableArray array];
+      if (length > 2 && length % 3 == 0) {
+        [steps addObject:[typed substringToIndex:length - 2]];
+      }
+      [steps addObject:[typed substringToIndex:length]];
+      for (NSString *step in steps) {
+        NSString *answer = [self answerFor:step];
+        CalculatorExpression *fresh = CalculatorExpressionCreate();
+        STAssertEqualObjects(answer, [self answerFor:step expression:fresh],
+                             @"%@", step);
+        CalculatorExpressionFree(fresh);
+      }
+    }
+    // Picking up where the previous keystroke left off means only the last
+    // token or two are lexed again.
+    STAssertGreaterThan(CalculatorExpressionReusedLength(expression_),
+                        (size_t)0, @"%@", typed);
+    STAssertNotNil([self answerFor:typed], @"%@", typed);
+  }
+}
+
+// Every answer the engine gives must be the one Calculate.framework gives.
+- (void)testConformsToFramework {
+  NSArray *expressions = [NSArray arrayWithObjects:
+                          @"1+1", @"1+2*3", @"(1+2)*3", @"7-2-1", @"16/4/2",
+                          @"1/3", @"2/3", @"1/7", @"22/7", @"0.1+0.2",
+                          @".5+.5", @"2^10", @"2^3^2", @"2^-1", @"2^0.5",
+                          @"-3*2", @"2*-3", @"1--2", @"3-3", @"1-1.0001",
+                          @"1,000+1", @"1,000.5*2", @"9999999999-1",
+                          @"123456.789*1000", @"0.0001*1", @"100/3",
+                          @"(100-15)/100*2,400", @"365*24*60*60", nil];
+  NSMutableArray *allExpressions = [NSMutableArray arrayWithArray:expressions];
+  size_t count = sizeof(kCalculatorTypedExpressions) / sizeof(NSString *);
+  for (size_t i = 0; i < count; ++i) {
+    NSString *typed = kCalculatorTypedExpressions[i];
+    for (NSUInteger length = 1; length <= [typed length]; ++length) {
+      [allExpressions addObject:[typed substringToIndex:length]];
+    }
+  }
+  NSUInteger answered = 0;
+  for (NSString *expression in allExpressions) {
+    NSString *answer = [self answerFor:expression];
+    if (!answer) continue;
+    ++answered;
+    NSString *expected = [self frameworkAnswerFor:expression
+                                          decimal:@"."
+                                         grouping:@","];
+    STAssertEqualObjects(answer, expected, @"%@", expression);
+  }
+  STAssertGreaterThan(answered, [expressions count] / 2, nil);
+
+  // The same expressions with German separators.
+  CalculatorExpressionSetSeparators(expression_, ',', '.');
+  for (NSString *expression in expressions) {
+    NSMutableString *german = [NSMutableString stringWithString:expression];
+    [german replaceOccurrencesOfString:@","
+                            withString:@"_"
+                               options:0
+                                 range:NSMakeRange(0, [german length])];
+    [german replaceOccurrencesOfString:@"."
+                            withString:@","
+                               options:0
+                                 range:NSMakeRange(0, [german length])];
+    [german replaceOccurrencesOfString:@"_"
+                            withString:@"."
+                               options:0
+                                 range:NSMakeRange(0, [german length])];
+    NSString *answer = [self answerFor:german];
+    if (!answer) continue;
+    NSString *expected = [self frameworkAnswerFor:german
+                                          decimal:@","
+                                         grouping:@"."];
+    STAssertEqualObjects(answer, expected, @"%@", german);
+  }
+}
+
+// Replays the typed expressions keystroke by keystroke through the engine
+// and through the framework path CalculatorSource used to take on every
+// keystroke. The engine reuses most of what it parsed for the previous
+// keystroke, so it has to come out ahead.
+- (void)testTypedExpressionSpeed {
+  const NSUInteger kRepetitions = 200;
+  size_t count = sizeof(kCalculatorTypedExpressions) / sizeof(NSString *);
+  NSMutableArray *keystrokes = [NSMutableArray array];
+  for (size_t i = 0; i < count; ++i) {
+    NSString *typed = kCalculatorTypedExpressions[i];
+    for (NSUInteger length = 1; length <= [typed length]; ++length) {
+      [keystrokes addObject:[typed substringToIndex:length]];
+    }
+  }
+
+  NSUInteger engineAnswers = 0;
+  size_t reusedLength = 0;
+  size_t totalLength = 0;
+  NSDate *start = [NSDate date];
+  for (NSUInteger i = 0; i < kRepetitions; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSString *keystroke in keystrokes) {
+      if ([self answerFor:keystroke]) ++engineAnswers;
+      reusedLength += CalculatorExpressionReusedLength(expression_);
+      totalLength += [keystroke length];
+    }
+    [pool release];
+  }
+  NSTimeInterval engineTime = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  for (NSUInteger i = 0; i < kRepetitions; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    for (NSString *keystroke in keystrokes) {
+      [self frameworkAnswerFor:keystroke decimal:@"." grouping:@","];
+    }
+    [pool release];
+  }
+  NSTimeInterval frameworkTime = -[start timeIntervalSinceNow];
+
+  STAssertGreaterThan(engineAnswers, (NSUInteger)0, nil);
+  STAssertGreaterThan(reusedLength, totalLength / 2, nil);
+  STAssertLessThan(engineTime, frameworkTime, nil);
+}
+
+@end
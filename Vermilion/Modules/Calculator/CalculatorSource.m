@@ -36,6 +36,7 @@
 #import <GTM/GTMNSNumber+64Bit.h>
 
 #import "CalculatePrivate.h"
+#import "CalculatorExpression.h"
 #import "TextActions.h"
 
 @interface CalculatorSource : HGSCallbackSearchSource {
@@ -43,9 +44,21 @@
   NSCharacterSet *mathSet_;
   NSCharacterSet *nonAlphanumericSet_;
   NSString *calculatorAppPath_;
+  // Shared by all of our search operations, guarded by @synchronized.
+  // Successive queries usually extend the previous one, so keeping a single
+  // engine lets it reuse most of the last compile.
+  CalculatorExpression *expression_;
 }
 @end
 
+// Separators are only usable by the engine if they are a single character.
+static BOOL CalculatorSeparatorCharacter(NSString *separator, UniChar *c) {
+  NSUInteger length = [separator length];
+  if (length > 1) return NO;
+  *c = length ? [separator characterAtIndex:0] : 0;
+  return YES;
+}
+
 @implementation CalculatorSource
 
 GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
@@ -66,7 +79,9 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       NSURL *fileURL = [NSURL fileURLWithPath:calcPath];
       calculatorAppPath_ = [[fileURL absoluteString] retain];
     }
-    if (!mathSet_ || !nonAlphanumericSet_ || !calculatorAppPath_) {
+    expression_ = CalculatorExpressionCreate();
+    if (!mathSet_ || !nonAlphanumericSet_ || !calculatorAppPath_
+        || !expression_) {
       [self release];
       self = nil;
     }
@@ -78,6 +93,7 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   [mathSet_ release];
   [nonAlphanumericSet_ release];
   [calculatorAppPath_ release];
+  CalculatorExpressionFree(expression_);
   [super dealloc];
 }
 
@@ -93,6 +109,61 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   return action;
 }
 
+// Computes |rawQuery| with our own engine. Returns NO if the engine doesn't
+// handle it, in which case Calculate.framework should be asked.
+- (BOOL)calculateQuery:(NSString *)rawQuery
+                locale:(NSLocale *)locale
+                answer:(char *)answer {
+  NSUInteger length = [rawQuery length];
+  if (length > kCalculatorExpressionMaxLength) return NO;
+  NSString *decimalSeparator = [locale objectForKey:NSLocaleDecimalSeparator];
+  NSString *groupingSeparator
+    = [locale objectForKey:NSLocaleGroupingSeparator];
+  UniChar decimal;
+  UniChar grouping;
+  if (!CalculatorSeparatorCharacter(decimalSeparator, &decimal)
+      || !decimal
+      || !CalculatorSeparatorCharacter(groupingSeparator, &grouping)) {
+    return NO;
+  }
+  UniChar chars[kCalculatorExpressionMaxLength];
+  [rawQuery getCharacters:chars range:NSMakeRange(0, length)];
+  double value = 0;
+  BOOL isValid = NO;
+  @synchronized (self) {
+    CalculatorExpressionSetSeparators(expression_, decimal, grouping);
+    isValid = (CalculatorExpressionCompile(expression_, chars, length)
+               && CalculatorExpressionEvaluate(expression_, &value));
+  }
+  return isValid && CalculatorExpressionFormat(value, answer);
+}
+
+// Computes |rawQuery| with Calculate.framework. |answer| must hold 1024
+// chars.
+- (BOOL)frameworkCalculateQuery:(NSString *)rawQuery
+                         locale:(NSLocale *)locale
+                         answer:(char *)answer {
+  // Fix up separators and decimals. The Calculator framework wants
+  // '.' for decimals, and no grouping separators.
+  NSString *decimalSeparator = [locale objectForKey:NSLocaleDecimalSeparator];
+  NSString *groupingSeparator
+    = [locale objectForKey:NSLocaleGroupingSeparator];
+  NSMutableString *fixedQuery = [NSMutableString stringWithString:rawQuery];
+  [fixedQuery replaceOccurrencesOfString:groupingSeparator
+                              withString:@""
+                                 options:0
+                                   range:NSMakeRange(0, [fixedQuery length])];
+  [fixedQuery replaceOccurrencesOfString:decimalSeparator
+                              withString:@"."
+                                 options:0
+                                   range:NSMakeRange(0, [fixedQuery length])];
+  answer[0] = '\0';
+  int success
+    = CalculatePerformExpression((char *)[fixedQuery UTF8String],
+                                 10, 1, answer);
+  return success ? YES : NO;
+}
+
 #pragma mark -
 
 - (BOOL)isValidSourceForQuery:(HGSQuery *)query {
@@ -123,26 +194,15 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   HGSTokenizedString *queryString = [[operation query] tokenizedQueryString];
   NSString *rawQuery = [queryString originalString];
   if ([rawQuery length]) {
-    // Fix up separators and decimals. The Calculator framework wants
-    // '.' for decimals, and no grouping separators.
     NSLocale *locale = [NSLocale autoupdatingCurrentLocale];
-    NSString *decimalSeparator = [locale objectForKey:NSLocaleDecimalSeparator];
-    NSString *groupingSeparator
-      = [locale objectForKey:NSLocaleGroupingSeparator];
-    NSMutableString *fixedQuery = [NSMutableString stringWithString:rawQuery];
-    [fixedQuery replaceOccurrencesOfString:groupingSeparator
-                                withString:@""
-                                   options:0
-                                     range:NSMakeRange(0, [fixedQuery length])];
-    [fixedQuery replaceOccurrencesOfString:decimalSeparator
-                                withString:@"."
-                                   options:0
-                                     range:NSMakeRange(0, [fixedQuery length])];
     char answer[1024];
     answer[0] = '\0';
-    int success
-      = CalculatePerformExpression((char *)[fixedQuery UTF8String],
-                                   10, 1, answer);
+    BOOL success = [self calculateQuery:rawQuery locale:locale answer:answer];
+    if (!success) {
+      success = [self frameworkCalculateQuery:rawQuery
+                                       locale:locale
+                                       answer:answer];
+    }
     if (success) {
       NSString *answerString = [NSString stringWithUTF8String:answer];
       NSString *resultString
@@ -50,8 +50,6 @@ static NSString* const kChatBuddyAttributeInformationKey
  @private
   NSMutableSet *availableServices_;  // The names of my logged-in services.
   BOOL iWasOnline_;  // My last remembered I/M status.
-  NSMutableArray *buddyResults_; // the list of results in the index
-  BOOL rebuildIndex_;
   NSArray *imStatusStrings_;
   NSArray *serviceStatusStrings_;
   NSArray *buddyStatusStrings_;
@@ -65,8 +63,8 @@ static NSString* const kChatBuddyAttributeInformationKey
                                 service:(IMService *)service
                                  source:(HGSSearchSource *)source;
 
-// Pushes everything in our buddyResults_ down into the memory source
-- (void)updateIndex;
+// Replaces everything in the memory source with |buddies|.
+- (void)indexBuddies:(NSArray *)buddies;
 
 // Update our index in response to a change in a buddy's information.
 - (void)infoChangedNotification:(NSNotification*)notification;
@@ -83,6 +81,14 @@ static NSString* const kChatBuddyAttributeInformationKey
 @end
 
 
+// Buddies are looked up by service and case insensitive screen name.
+static NSString *ChatBuddyIndexKey(NSString *serviceName,
+                                   NSString *screenName) {
+  if (!serviceName || !screenName) return nil;
+  return [NSString stringWithFormat:@"%@:%@",
+          serviceName, [screenName lowercaseString]];
+}
+
 @implementation ChatBuddiesSource
 GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
 
@@ -93,7 +99,7 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
   // Collect and cache information about our buddies and set of
   // logged-in services.
   availableServices_ = [[NSMutableSet alloc] init];
-  buddyResults_ = [[NSMutableArray alloc] init];
+  NSMutableArray *buddyResults = [NSMutableArray array];
   IMPersonStatus myStatus = [IMService myStatus];
   iWasOnline_ = (myStatus == IMPersonStatusIdle
                  || myStatus == IMPersonStatusAway
@@ -112,11 +118,13 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
         = [self contactResultFromIMBuddy:buddy
                                  service:service
                                   source:self];
-      [buddyResults_ addObject:newBuddy];
+      if (newBuddy) {
+        [buddyResults addObject:newBuddy];
+      }
     }
     [pool release];
   }
-  [self updateIndex];
+  [self indexBuddies:buddyResults];
 
   // Register for notifications about changes to buddy information.
   NSNotificationCenter *nc = [IMService notificationCenter];
@@ -199,7 +207,6 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
 - (void)dealloc {
   [[IMService notificationCenter] removeObserver:self];
   [availableServices_ release];
-  [buddyResults_ release];
   [imStatusStrings_ release];
   [serviceStatusStrings_ release];
   [buddyStatusStrings_ release];
@@ -386,18 +393,6 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
   return isValid;
 }
 
-- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
-  // We use a bool to keep track of when we need to update the index so we don't
-  // spend lots of time doing this as buddies come and go.  This is needed
-  // because when the im service goes online/offline, it sends a notification
-  // for every buddy in the list.  If the index ever gets an api were we can
-  // remove individual objects, then we might not need to do this batching.
-  if (rebuildIndex_) {
-    [self updateIndex];
-  }
-  [super performSearchOperation:operation];
-}
-
 - (NSMutableDictionary *)archiveRepresentationForResult:(HGSResult *)result {
   // Don't want chat buddy results remembered in shortcuts
   // TODO: revisit when we don't use a subclass and see if we can save a few
@@ -453,22 +448,25 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
                         forKeys:imOtherTermKeys];
 }
 
-- (void)updateIndex {
-  rebuildIndex_ = NO;
+- (void)indexBuddies:(NSArray *)buddies {
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
-
-  @synchronized(buddyResults_) {
-    for (HGSResult *buddyResult in buddyResults_) {
-      NSString *name = [self nameStringForBuddy:buddyResult];
-      NSArray *otherStrings = [self otherTermStringsForBuddy:buddyResult];
-      [database indexResult:buddyResult
-                       name:name
-                 otherTerms:otherStrings];
-    }
+  for (HGSResult *buddyResult in buddies) {
+    NSString *name = [self nameStringForBuddy:buddyResult];
+    NSArray *otherStrings = [self otherTermStringsForBuddy:buddyResult];
+    [database indexResult:buddyResult
+                     name:name
+               otherTerms:otherStrings];
   }
   [self replaceCurrentDatabaseWith:database];
 }
 
+- (id)indexKeyForResult:(HGSResult *)result {
+  NSDictionary *imBuddyInfo
+    = [result valueForKey:kChatBuddyAttributeInformationKey];
+  return ChatBuddyIndexKey([imBuddyInfo objectForKey:IMPersonServiceNameKey],
+                           [imBuddyInfo objectForKey:IMPersonScreenNameKey]);
+}
+
 - (void)infoChangedNotification:(NSNotification*)notification {
   IMService *service = [notification object];
   // TODO(mrossetti): what happen if someone gets removed from the buddy list?
@@ -481,34 +479,30 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
     NSString *screenName = [userInfo objectForKey:IMPersonScreenNameKey];
     if ([screenName length]) {
       // See if we already know about this buddy.
-      @synchronized(buddyResults_) {
-        HGSResult *buddyResult = nil;
-        for (buddyResult in buddyResults_) {
-          NSDictionary *imBuddyInfo 
-            = [buddyResult valueForKey:kChatBuddyAttributeInformationKey];
-          NSString *buddyService 
-            = [imBuddyInfo objectForKey:IMPersonServiceNameKey];
-          if ([buddyService isEqualToString:serviceName]) {
-            NSString *buddyName 
-              = [imBuddyInfo objectForKey:IMPersonScreenNameKey];
-            BOOL sameName = (buddyName != nil)
-              && [buddyName caseInsensitiveCompare:screenName] == NSOrderedSame;
-            if (sameName) {
-              break;
-            }
-          }
-        }
+      @synchronized(self) {
+        HGSResult *buddyResult
+          = [self resultForIndexKey:ChatBuddyIndexKey(serviceName,
+                                                      screenName)];
+        NSArray *staleURIs = nil;
         if (buddyResult) {
           // Remove the results and add it new to pick up the changes
-          [buddyResults_ removeObjectIdenticalTo:buddyResult];
+          staleURIs = [NSArray arrayWithObject:[buddyResult uri]];
         } 
         HGSResult *newBuddy = [self contactResultFromIMBuddy:userInfo
                                                      service:service
                                                       source:self];
-        [buddyResults_ addObject:newBuddy];
-        // Next search will rebuild the index
-        rebuildIndex_ = YES;
-      }  // @syncronized(buddyResults_)
+        // When the im service goes online/offline it sends a notification
+        // for every buddy in the list, so only reindex the one that changed.
+        HGSMemorySearchSourceDB *database = nil;
+        if (newBuddy) {
+          database = [HGSMemorySearchSourceDB database];
+          [database indexResult:newBuddy
+                           name:[self nameStringForBuddy:newBuddy]
+                     otherTerms:[self otherTermStringsForBuddy:newBuddy]];
+        }
+        [self updateCurrentDatabaseWith:database
+                removingResultsWithURIs:staleURIs];
+      }  // @syncronized(self)
     } else {
       HGSLogDebug(@"IMService notification missing screen name.");
     }
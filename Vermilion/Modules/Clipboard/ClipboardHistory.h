@@ -0,0 +1,81 @@
+//
+//  ClipboardHistory.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+// The most recent clipboard entries, up to a fixed capacity.
+// Every entry has a digest of its pasteboard contents. When something
+// already in the history is copied again, the digest finds it without
+// comparing contents, and the entry moves to the front.
+// Adding, finding and evicting entries all take constant time.
+// Not thread safe.
+@interface ClipboardHistory : NSObject {
+ @private
+  NSUInteger capacity_;
+  NSUInteger count_;
+  // Entries live in fixed slots. The slots are linked from newest to
+  // oldest through next_ and prev_.
+  id *objects_;
+  NSData **digests_;
+  NSUInteger *next_;
+  NSUInteger *prev_;
+  NSUInteger newest_;
+  NSUInteger oldest_;
+  NSMutableDictionary *slotsByDigest_;
+}
+
+// Digest of a pasteboard value (see kHGSObjectAttributePasteboardValueKey).
+// The value maps pasteboard types to NSString, NSURL or NSData values.
+// Strings are digested in fixed size chunks, so large values aren't copied.
++ (NSData *)digestForPasteboardValue:(NSDictionary *)value;
+
+// |capacity| must be at least 1.
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+- (NSUInteger)capacity;
+- (NSUInteger)count;
+
+// Returns nil if no entry has |digest|.
+- (id)objectForDigest:(NSData *)digest;
+
+// Adds |object| as the newest entry. If an entry with |digest| is already
+// in the history it is replaced. Otherwise, if the history is full, the
+// oldest entry is evicted. Replaced and evicted objects are added to
+// |removed|, which may be nil.
+- (void)addObject:(id)object
+           digest:(NSData *)digest
+   removedObjects:(NSMutableArray *)removed;
+
+// Newest first.
+- (NSArray *)objects;
+
+@end
@@ -0,0 +1,206 @@
+//
+//  ClipboardHistory.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "ClipboardHistory.h"
+#import <CommonCrypto/CommonDigest.h>
+
+// Marks the end of the list of slots.
+static const NSUInteger kNoSlot = NSUIntegerMax;
+
+// Number of characters of a string value digested at a time.
+enum {
+  kDigestChunkLength = 4096
+};
+
+@interface ClipboardHistory ()
+- (void)unlinkSlot:(NSUInteger)slot;
+- (void)linkSlotAsNewest:(NSUInteger)slot;
+@end
+
+static void DigestString(CC_SHA1_CTX *context, NSString *string) {
+  unichar buffer[kDigestChunkLength];
+  NSUInteger length = [string length];
+  NSRange range = NSMakeRange(0, 0);
+  while (range.location < length) {
+    range.length = MIN(length - range.location, kDigestChunkLength);
+    [string getCharacters:buffer range:range];
+    CC_SHA1_Update(context, buffer, (CC_LONG)(range.length * sizeof(unichar)));
+    range.location += range.length;
+  }
+}
+
+@implementation ClipboardHistory
+
++ (NSData *)digestForPasteboardValue:(NSDictionary *)value {
+  CC_SHA1_CTX context;
+  CC_SHA1_Init(&context);
+  NSArray *types
+    = [[value allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  for (NSString *type in types) {
+    // The type and its value's length separate one value from the next.
+    DigestString(&context, type);
+    id typeValue = [value objectForKey:type];
+    if ([typeValue isKindOfClass:[NSURL class]]) {
+      typeValue = [typeValue absoluteString];
+    }
+    if ([typeValue isKindOfClass:[NSData class]]) {
+      NSUInteger length = [typeValue length];
+      CC_SHA1_Update(&context, &length, sizeof(length));
+      CC_SHA1_Update(&context, [typeValue bytes], (CC_LONG)length);
+    } else {
+      if (![typeValue isKindOfClass:[NSString class]]) {
+        typeValue = [typeValue description];
+      }
+      NSUInteger length = [typeValue length];
+      CC_SHA1_Update(&context, &length, sizeof(length));
+      DigestString(&context, typeValue);
+    }
+  }
+  unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+  CC_SHA1_Final(digest, &context);
+  return [NSData dataWithBytes:digest length:sizeof(digest)];
+}
+
+- (id)init {
+  return [self initWithCapacity:0];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity {
+  if ((self = [super init])) {
+    if (capacity == 0) {
+      [self release];
+      return nil;
+    }
+    capacity_ = capacity;
+    objects_ = calloc(capacity, sizeof(id));
+    digests_ = calloc(capacity, sizeof(NSData *));
+    next_ = calloc(capacity, sizeof(NSUInteger));
+    prev_ = calloc(capacity, sizeof(NSUInteger));
+    slotsByDigest_ 
+      = [[NSMutableDictionary alloc] initWithCapacity:capacity];
+    newest_ = kNoSlot;
+    oldest_ = kNoSlot;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (NSUInteger i = 0; i < count_; ++i) {
+    [objects_[i] release];
+    [digests_[i] release];
+  }
+  free(objects_);
+  free(digests_);
+  free(next_);
+  free(prev_);
+  [slotsByDigest_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)capacity {
+  return capacity_;
+}
+
+- (NSUInteger)count {
+  return count_;
+}
+
+- (id)objectForDigest:(NSData *)digest {
+  NSNumber *slot = [slotsByDigest_ objectForKey:digest];
+  return slot ? objects_[[slot unsignedIntegerValue]] : nil;
+}
+
+- (void)addObject:(id)object
+           digest:(NSData *)digest
+   removedObjects:(NSMutableArray *)removed {
+  if (!object || !digest) return;
+  NSUInteger slot;
+  NSNumber *existingSlot = [slotsByDigest_ objectForKey:digest];
+  if (existingSlot) {
+    slot = [existingSlot unsignedIntegerValue];
+    [self unlinkSlot:slot];
+  } else if (count_ < capacity_) {
+    slot = count_++;
+  } else {
+    slot = oldest_;
+    [self unlinkSlot:slot];
+    [slotsByDigest_ removeObjectForKey:digests_[slot]];
+  }
+  if (objects_[slot]) {
+    [removed addObject:objects_[slot]];
+  }
+  [objects_[slot] autorelease];
+  objects_[slot] = [object retain];
+  if (!existingSlot) {
+    [digests_[slot] release];
+    digests_[slot] = [digest copy];
+    [slotsByDigest_ setObject:[NSNumber numberWithUnsignedInteger:slot]
+                       forKey:digests_[slot]];
+  }
+  [self linkSlotAsNewest:slot];
+}
+
+- (NSArray *)objects {
+  NSMutableArray *objects = [NSMutableArray arrayWithCapacity:count_];
+  for (NSUInteger slot = newest_; slot != kNoSlot; slot = next_[slot]) {
+    [objects addObject:objects_[slot]];
+  }
+  return objects;
+}
+
+- (void)unlinkSlot:(NSUInteger)slot {
+  NSUInteger prev = prev_[slot];
+  NSUInteger next = next_[slot];
+  if (prev != kNoSlot) {
+    next_[prev] = next;
+  } else {
+    newest_ = next;
+  }
+  if (next != kNoSlot) {
+    prev_[next] = prev;
+  } else {
+    oldest_ = prev;
+  }
+}
+
+- (void)linkSlotAsNewest:(NSUInteger)slot {
+  prev_[slot] = kNoSlot;
+  next_[slot] = newest_;
+  if (newest_ != kNoSlot) {
+    prev_[newest_] = slot;
+  } else {
+    oldest_ = slot;
+  }
+  newest_ = slot;
+}
+
+@end
@@ -0,0 +1,90 @@
+//
+//  ClipboardPasteboardMonitor.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Cocoa/Cocoa.h>
+
+// The parts of NSPasteboard the clipboard source reads. NSPasteboard
+// already implements all of them, tests can substitute their own
+// pasteboard.
+@protocol ClipboardPasteboardProvider <NSObject>
+- (NSInteger)changeCount;
+- (NSArray *)types;
+- (NSString *)availableTypeFromArray:(NSArray *)types;
+- (NSData *)dataForType:(NSString *)dataType;
+- (NSString *)stringForType:(NSString *)dataType;
+- (id)propertyListForType:(NSString *)dataType;
+@end
+
+@interface NSPasteboard (ClipboardPasteboardProvider)
+  <ClipboardPasteboardProvider>
+@end
+
+// Tells a target when the change count of a pasteboard moves.
+// There is no notification for pasteboard changes, so the monitor polls.
+// It polls quickly just after a change, and backs off while the pasteboard
+// stays the same. It also checks whenever the application is about to
+// become active, so the history is current when the user looks at it.
+// Changes can also be checked for directly with -checkForChanges.
+// Must be used from the main thread.
+@interface ClipboardPasteboardMonitor : NSObject {
+ @private
+  id<ClipboardPasteboardProvider> pasteboard_;
+  __weak id target_;
+  SEL selector_;
+  NSInteger lastChangeCount_;
+  NSTimeInterval pollInterval_;
+  __weak NSTimer *pollTimer_;
+  BOOL isPolling_;
+}
+
+// |selector| takes the monitor as its only argument. |target| is not
+// retained. The change count at init time does not count as a change.
+- (id)initWithPasteboard:(id<ClipboardPasteboardProvider>)pasteboard
+                  target:(id)target
+                selector:(SEL)selector;
+
+- (id<ClipboardPasteboardProvider>)pasteboard;
+
+// The time until the next poll.
+- (NSTimeInterval)pollInterval;
+
+// Starts polling and watching for the application becoming active.
+- (void)start;
+
+// Must be called before the target goes away.
+- (void)stop;
+
+// Calls the target if the pasteboard changed since the last check.
+// Returns YES if it did.
+- (BOOL)checkForChanges;
+
+@end
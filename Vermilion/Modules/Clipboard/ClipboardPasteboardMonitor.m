@@ -0,0 +1,141 @@
+//
+//  ClipboardPasteboardMonitor.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "ClipboardPasteboardMonitor.h"
+#import <Vermilion/Vermilion.h>
+
+// Polling starts at kMinPollInterval after a change and stretches by
+// kPollBackoffFactor on every quiet poll, up to kMaxPollInterval.
+static const NSTimeInterval kMinPollInterval = 0.25;
+static const NSTimeInterval kMaxPollInterval = 2.0;
+static const double kPollBackoffFactor = 1.5;
+
+@interface ClipboardPasteboardMonitor ()
+- (void)schedulePoll;
+- (void)poll:(NSTimer *)timer;
+- (void)applicationWillBecomeActive:(NSNotification *)notification;
+@end
+
+@implementation NSPasteboard (ClipboardPasteboardProvider)
+@end
+
+@implementation ClipboardPasteboardMonitor
+
+- (id)initWithPasteboard:(id<ClipboardPasteboardProvider>)pasteboard
+                  target:(id)target
+                selector:(SEL)selector {
+  if ((self = [super init])) {
+    if (!pasteboard || !target || !selector) {
+      HGSLogDebug(@"Unable to create monitor for %@", pasteboard);
+      [self release];
+      return nil;
+    }
+    pasteboard_ = [pasteboard retain];
+    target_ = target;
+    selector_ = selector;
+    lastChangeCount_ = [pasteboard changeCount];
+    pollInterval_ = kMinPollInterval;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+  [pasteboard_ release];
+  [super dealloc];
+}
+
+- (id<ClipboardPasteboardProvider>)pasteboard {
+  return pasteboard_;
+}
+
+- (NSTimeInterval)pollInterval {
+  return pollInterval_;
+}
+
+- (void)start {
+  if (isPolling_) return;
+  isPolling_ = YES;
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(applicationWillBecomeActive:)
+             name:NSApplicationWillBecomeActiveNotification
+           object:nil];
+  [self schedulePoll];
+}
+
+- (void)stop {
+  isPolling_ = NO;
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [pollTimer_ invalidate];
+  pollTimer_ = nil;
+}
+
+- (BOOL)checkForChanges {
+  NSInteger changeCount = [pasteboard_ changeCount];
+  BOOL changed = changeCount != lastChangeCount_;
+  if (changed) {
+    lastChangeCount_ = changeCount;
+    pollInterval_ = kMinPollInterval;
+    [target_ performSelector:selector_ withObject:self];
+  } else {
+    pollInterval_ = MIN(pollInterval_ * kPollBackoffFactor, kMaxPollInterval);
+  }
+  return changed;
+}
+
+- (void)schedulePoll {
+  // The timer retains us until it fires, so we don't need to retain it.
+  pollTimer_ = [NSTimer scheduledTimerWithTimeInterval:pollInterval_
+                                                target:self
+                                              selector:@selector(poll:)
+                                              userInfo:nil
+                                               repeats:NO];
+}
+
+- (void)poll:(NSTimer *)timer {
+  pollTimer_ = nil;
+  [self checkForChanges];
+  if (isPolling_) {
+    [self schedulePoll];
+  }
+}
+
+- (void)applicationWillBecomeActive:(NSNotification *)notification {
+  if ([self checkForChanges] && isPolling_) {
+    // Poll again soon rather than at the end of a long backoff.
+    [pollTimer_ invalidate];
+    [self schedulePoll];
+  }
+}
+
+@end
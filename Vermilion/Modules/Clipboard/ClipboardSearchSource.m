@@ -34,30 +34,49 @@
 #import <Vermilion/Vermilion.h>
 #import <QSBPluginUI/QSBPluginUI.h>
 
+#import "ClipboardHistory.h"
+#import "ClipboardPasteboardMonitor.h"
 #import "GTMNSString+URLArguments.h"
 
-static const NSTimeInterval kPasteboardPollInterval = 1.0;
 static const NSInteger kMaxDisplayNameLength = 256;
 static const NSInteger kMaxHistoryItems = 25;
 static const NSInteger kMaxSnippetLines = 5;
+// Names and snippets only look at the start of a string.
+static const NSUInteger kMaxScannedTextLength = 4096;
 static NSString *const kClipboardUrlScheme = @"vermilionclip";
 static NSString *const kClipboardCopyAction
     = @"com.google.qsb.clipboard.action.copy";
 
 @interface ClipboardSearchSource : HGSMemorySearchSource {
  @private
-  __weak NSTimer *updateTimer_;
+  ClipboardPasteboardMonitor *monitor_;
+  ClipboardHistory *history_;
   NSArray *types_;
-  NSMutableArray *recentResults_;
-  NSInteger lastChangeCount_;
   NSImage *clipboardIcon_;
+  NSDateFormatter *dateFormatter_;
   HGSUnscoredResult *clipboardResult_;
 }
+- (void)setPasteboard:(id<ClipboardPasteboardProvider>)pasteboard;
+- (ClipboardPasteboardMonitor *)pasteboardMonitor;
+- (NSDictionary *)valueOfPasteboard:(id<ClipboardPasteboardProvider>)pb;
+- (NSMutableDictionary *)attributesForPasteboardValue:(NSDictionary *)value
+                                                 type:(NSString *)type
+                                          changeCount:(NSInteger)changeCount;
+- (NSArray *)pathCellsForDate:(NSDate *)date;
 - (NSString *)nameFromStringValue:(NSString *)stringValue;
 - (NSString *)snippetFromStringValue:(NSString *)stringValue;
-- (void)updatePasteboard:(NSTimer *)timer;
+- (void)pasteboardDidChange:(ClipboardPasteboardMonitor *)monitor;
 @end
 
+// Returns no more than the first kMaxScannedTextLength characters of
+// |string|, without splitting a composed character sequence.
+static NSString *ClipboardPrefixOfString(NSString *string) {
+  if ([string length] <= kMaxScannedTextLength) return string;
+  NSRange range
+    = [string rangeOfComposedCharacterSequenceAtIndex:kMaxScannedTextLength];
+  return [string substringToIndex:range.location];
+}
+
 @implementation ClipboardSearchSource
 
 - (id)initWithConfiguration:(NSDictionary *)configuration {
@@ -81,28 +100,47 @@ static NSString *const kClipboardCopyAction
                                           type:kTypeClipboardGeneric
                                         source:self
                                     attributes:attributes];
-    recentResults_ = [[NSMutableArray alloc] init];
+    history_ = [[ClipboardHistory alloc] initWithCapacity:kMaxHistoryItems];
+    HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+    [database indexResult:clipboardResult_];
+    [self replaceCurrentDatabaseWith:database];
     types_ = [[NSArray arrayWithObjects:NSRTFPboardType, NSURLPboardType,
                NSStringPboardType, NSTIFFPboardType, NSPDFPboardType,
                NSPICTPboardType, nil] retain];
-    updateTimer_
-      = [NSTimer scheduledTimerWithTimeInterval:kPasteboardPollInterval
-                                         target:self
-                                       selector:@selector(updatePasteboard:)
-                                       userInfo:nil
-                                        repeats:YES];
+    dateFormatter_ = [[NSDateFormatter alloc] init];
+    [dateFormatter_ setDateStyle:NSDateFormatterShortStyle];
+    [dateFormatter_ setTimeStyle:NSDateFormatterShortStyle];
+    [self setPasteboard:[NSPasteboard generalPasteboard]];
   }
   return self;
 }
 
 - (void)dealloc {
-  [updateTimer_ invalidate];
+  [monitor_ stop];
+  [monitor_ release];
+  [history_ release];
   [types_ release];
-  [recentResults_ release];
   [clipboardIcon_ release];
+  [dateFormatter_ release];
+  [clipboardResult_ release];
   [super dealloc];
 }
 
+- (void)setPasteboard:(id<ClipboardPasteboardProvider>)pasteboard {
+  [monitor_ stop];
+  [monitor_ release];
+  monitor_ 
+    = [[ClipboardPasteboardMonitor alloc] 
+       initWithPasteboard:pasteboard
+                   target:self
+                 selector:@selector(pasteboardDidChange:)];
+  [monitor_ start];
+}
+
+- (ClipboardPasteboardMonitor *)pasteboardMonitor {
+  return monitor_;
+}
+
 - (HGSResult *)preFilterResult:(HGSResult *)result
                matchesForQuery:(HGSQuery*)query
                   pivotObjects:(HGSResultArray *)pivotObjects {
@@ -116,186 +154,214 @@ static NSString *const kClipboardCopyAction
   return result;
 }
 
-- (void)updatePasteboard:(NSTimer *)timer {
-  NSPasteboard *pb = [NSPasteboard generalPasteboard];
-  NSInteger changeCount = [pb changeCount];
-  if (changeCount != lastChangeCount_) {
-    // Add all of the available data to the result
-    NSMutableDictionary *pasteboardValue = [NSMutableDictionary dictionary];
-    NSArray *types = [pb types];
-    for (NSString *type in types) {
-      id pbValue = nil;
-      if ([type isEqualToString:NSStringPboardType]) {
-        pbValue = [pb stringForType:NSStringPboardType];
-      } else if ([type isEqualToString:NSURLPboardType]) {
-        pbValue = [NSURL URLFromPasteboard:pb];
-      } else {
-        pbValue = [pb dataForType:type];
+- (void)pasteboardDidChange:(ClipboardPasteboardMonitor *)monitor {
+  id<ClipboardPasteboardProvider> pb = [monitor pasteboard];
+  NSDictionary *pasteboardValue = [self valueOfPasteboard:pb];
+  if (![pasteboardValue count]) return;
+  NSData *digest = [ClipboardHistory digestForPasteboardValue:pasteboardValue];
+  NSDate *now = [NSDate date];
+  NSArray *pathCells = [self pathCellsForDate:now];
+  HGSResult *result = nil;
+  HGSResult *recentResult = [history_ objectForDigest:digest];
+  if (recentResult) {
+    // Copied again, so everything but the date is still good.
+    NSArray *keptKeys 
+      = [NSArray arrayWithObjects:kHGSObjectAttributePasteboardValueKey,
+         kHGSObjectAttributeSnippetKey, kHGSObjectAttributeIconKey,
+         kHGSObjectAttributeDefaultActionKey, nil];
+    NSMutableDictionary *attributes = [NSMutableDictionary dictionary];
+    for (NSString *key in keptKeys) {
+      id value = [recentResult valueForKey:key];
+      if (value) {
+        [attributes setObject:value forKey:key];
       }
-      if (pbValue) {
-        [pasteboardValue setObject:pbValue
-                            forKey:type];
+    }
+    [attributes setObject:now forKey:kHGSObjectAttributeLastUsedDateKey];
+    [attributes setObject:pathCells forKey:kQSBObjectAttributePathCellsKey];
+    result = [HGSUnscoredResult resultWithURI:[recentResult uri]
+                                         name:[recentResult displayName]
+                                         type:[recentResult type]
+                                       source:self
+                                   attributes:attributes];
+  } else {
+    NSString *type = [pb availableTypeFromArray:types_];
+    NSMutableDictionary *dictionary 
+      = [self attributesForPasteboardValue:pasteboardValue
+                                      type:type
+                               changeCount:[pb changeCount]];
+    if (!dictionary) return;
+    [dictionary setObject:pasteboardValue
+                   forKey:kHGSObjectAttributePasteboardValueKey];
+    [dictionary setObject:now forKey:kHGSObjectAttributeLastUsedDateKey];
+    [dictionary setObject:pathCells forKey:kQSBObjectAttributePathCellsKey];
+    HGSAction *action
+      = [[HGSExtensionPoint actionsPoint]
+         extensionWithIdentifier:kClipboardCopyAction];
+    if (action) {
+      [dictionary setObject:action
+                     forKey:kHGSObjectAttributeDefaultActionKey];
+    }
+    result = [HGSUnscoredResult resultWithDictionary:dictionary source:self];
+  }
+  if (result) {
+    // A result that was copied again replaces itself at the top of the
+    // list, otherwise the oldest result may be pushed out.
+    NSMutableArray *removedResults = [NSMutableArray array];
+    [history_ addObject:result digest:digest removedObjects:removedResults];
+    NSMutableArray *staleURIs = [NSMutableArray array];
+    for (HGSResult *removedResult in removedResults) {
+      if (![[removedResult uri] isEqualToString:[result uri]]) {
+        [staleURIs addObject:[removedResult uri]];
       }
     }
+    HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+    [database indexResult:result];
+    [self updateCurrentDatabaseWith:database
+            removingResultsWithURIs:staleURIs];
+  }
+}
 
-    NSString *historyName
-      = [HGSLocalizedString(@"Clipboard History",
-                            @"The user-visible name for the clipboard "
-                            @"history search result")
-         gtm_stringByEscapingForURLArgument];
-    NSString *snippet = nil;
-    NSImage *icon = clipboardIcon_;
-
-    // Create the best available representation of the pasteboard data
-    // for the name, snippet, icon, etc.
-    NSMutableDictionary *dictionary = nil;
-    NSString *type = [pb availableTypeFromArray:types_];
-    OSType iconType = kClippingUnknownType;
+// All of the available data, so the copy action can put it all back.
+- (NSDictionary *)valueOfPasteboard:(id<ClipboardPasteboardProvider>)pb {
+  NSMutableDictionary *pasteboardValue = [NSMutableDictionary dictionary];
+  NSArray *types = [pb types];
+  for (NSString *type in types) {
+    id pbValue = nil;
     if ([type isEqualToString:NSStringPboardType]) {
-      // Plain text string
-      NSString *value = [pb stringForType:NSStringPboardType];
-      NSString *name = [self nameFromStringValue:value];
-      NSURL *url
-        = [NSURL URLWithString:[NSString stringWithFormat:@"%@://%@/%i",
-           kClipboardUrlScheme, historyName, changeCount]];
-      dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
-                    name, kHGSObjectAttributeNameKey,
-                    kTypeClipboardString, kHGSObjectAttributeTypeKey,
-                    url, kHGSObjectAttributeURIKey,
-                    nil];
-      if (![value isEqualToString:name]) {
-        snippet = [self snippetFromStringValue:value];
+      pbValue = [pb stringForType:NSStringPboardType];
+    } else if ([type isEqualToString:NSURLPboardType]) {
+      // Same as +[NSURL URLFromPasteboard:], which needs an NSPasteboard.
+      NSArray *urlStrings = [pb propertyListForType:NSURLPboardType];
+      if ([urlStrings count]) {
+        NSURL *baseURL = nil;
+        if ([urlStrings count] > 1
+            && [[urlStrings objectAtIndex:1] length]) {
+          baseURL = [NSURL URLWithString:[urlStrings objectAtIndex:1]];
+        }
+        pbValue = [NSURL URLWithString:[urlStrings objectAtIndex:0]
+                         relativeToURL:baseURL];
       }
-      iconType = kClippingTextType;
-    } else if ([type isEqualToString:NSRTFPboardType]) {
-      // RTF data
-      NSData *data = [pb dataForType:NSRTFPboardType];
-      NSAttributedString *attributedString
-        = [[[NSAttributedString alloc]
-            initWithRTF:data documentAttributes:NULL] autorelease];
-      NSString *value = [attributedString string];
-      NSString *name = [self nameFromStringValue:value];
-      NSURL *url
-        = [NSURL URLWithString:[NSString stringWithFormat:@"%@://%@/%i",
-           kClipboardUrlScheme, historyName, changeCount]];
-      dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
-                    name, kHGSObjectAttributeNameKey,
-                    kTypeClipboardRTF, kHGSObjectAttributeTypeKey,
-                    url, kHGSObjectAttributeURIKey,
-                    nil];
-      if (![value isEqualToString:name]) {
-        snippet = [self snippetFromStringValue:value];
+    } else {
+      pbValue = [pb dataForType:type];
+    }
+    if (pbValue) {
+      [pasteboardValue setObject:pbValue
+                          forKey:type];
+    }
+  }
+  return pasteboardValue;
+}
+
+// Create the best available representation of the pasteboard data
+// for the name, snippet, icon, etc. |type| is the best of types_ that
+// the pasteboard has.
+- (NSMutableDictionary *)attributesForPasteboardValue:(NSDictionary *)value
+                                                 type:(NSString *)type
+                                          changeCount:(NSInteger)changeCount {
+  NSString *historyName
+    = [HGSLocalizedString(@"Clipboard History",
+                          @"The user-visible name for the clipboard "
+                          @"history search result")
+       gtm_stringByEscapingForURLArgument];
+  NSURL *historyURL
+    = [NSURL URLWithString:[NSString stringWithFormat:@"%@://%@/%i",
+                            kClipboardUrlScheme, historyName, changeCount]];
+  NSString *snippet = nil;
+  NSMutableDictionary *dictionary = nil;
+  OSType iconType = kClippingUnknownType;
+  if ([type isEqualToString:NSStringPboardType]
+      || [type isEqualToString:NSRTFPboardType]) {
+    // Most applications put up plain text along with RTF, which saves
+    // parsing all of the RTF.
+    NSString *text = [value objectForKey:NSStringPboardType];
+    NSString *resultType = kTypeClipboardString;
+    if ([type isEqualToString:NSRTFPboardType]) {
+      if (!text) {
+        NSData *data = [value objectForKey:NSRTFPboardType];
+        NSAttributedString *attributedString
+          = [[[NSAttributedString alloc]
+              initWithRTF:data documentAttributes:NULL] autorelease];
+        text = [attributedString string];
       }
-      iconType = kClippingTextType;
-    } else if ([type isEqualToString:NSURLPboardType]) {
-      // URL
-      NSURL *url = [NSURL URLFromPasteboard:pb];
+      resultType = kTypeClipboardRTF;
+    }
+    NSString *prefix = ClipboardPrefixOfString(text);
+    NSString *name = [self nameFromStringValue:prefix];
+    dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                  name, kHGSObjectAttributeNameKey,
+                  resultType, kHGSObjectAttributeTypeKey,
+                  historyURL, kHGSObjectAttributeURIKey,
+                  nil];
+    if ([prefix length] < [text length] || ![prefix isEqualToString:name]) {
+      snippet = [self snippetFromStringValue:prefix];
+    }
+    iconType = kClippingTextType;
+  } else if ([type isEqualToString:NSURLPboardType]) {
+    // URL. The same URL can be copied along with different data, so the URL
+    // itself can't be the URI: pushing out one of those entries would
+    // remove the others from the index too.
+    NSURL *url = [value objectForKey:NSURLPboardType];
+    if (url) {
       dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
                     [url absoluteString], kHGSObjectAttributeNameKey,
                     kTypeClipboardURL, kHGSObjectAttributeTypeKey,
-                    url, kHGSObjectAttributeURIKey,
+                    historyURL, kHGSObjectAttributeURIKey,
                     nil];
-      iconType = kClippingUnknownType;
-    } else if ([type isEqualToString:NSTIFFPboardType] ||
-               [type isEqualToString:NSPDFPboardType] ||
-               [type isEqualToString:NSPICTPboardType]) {
-      // Image
-      icon = [[[NSImage alloc] initWithPasteboard:pb] autorelease];
-      if (icon) {
-        NSString *name
-          = HGSLocalizedString(@"Clipboard Image",
-                               @"The user-visible name for clipboard  "
-                               @"image results");
-        NSURL *url
-          = [NSURL URLWithString:[NSString stringWithFormat:@"%@://%@/%i",
-             kClipboardUrlScheme, historyName, changeCount]];
-        dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
-                      name, kHGSObjectAttributeNameKey,
-                      kTypeClipboardImage, kHGSObjectAttributeTypeKey,
-                      url, kHGSObjectAttributeURIKey,
-                      nil];
-      }
-      iconType = kClippingPictureType;
     }
-    // TODO(hawk): more specializations, such as files
-
-    if (dictionary && pasteboardValue) {
-      [dictionary setObject:pasteboardValue
-                     forKey:kHGSObjectAttributePasteboardValueKey];
-      [dictionary setObject:[NSDate date]
-                     forKey:kHGSObjectAttributeLastUsedDateKey];
-      HGSAction *action
-        = [[HGSExtensionPoint actionsPoint]
-           extensionWithIdentifier:kClipboardCopyAction];
-      if (action) {
-        [dictionary setObject:action
-                       forKey:kHGSObjectAttributeDefaultActionKey];
-      }
-      if (snippet) {
-        [dictionary setObject:snippet forKey:kHGSObjectAttributeSnippetKey];
-      }
-      if (icon) {
-        [dictionary setObject:icon forKey:kHGSObjectAttributeIconKey];
-      }
-
-      NSMutableArray *cellArray = [NSMutableArray array];
-      NSString *clipboard = HGSLocalizedString(@"Clipboard",
-                                               @"The generic search term used "
-                                               @"to bring up clipboard "
-                                               @"contents and history");
-      NSDictionary *clipboardCell
-        = [NSDictionary dictionaryWithObject:clipboard
-                                      forKey:kQSBPathCellDisplayTitleKey];
-      [cellArray addObject:clipboardCell];
-
-      NSDateFormatter *formatter = [[[NSDateFormatter alloc] init] autorelease];
-      [formatter setDateStyle:NSDateFormatterShortStyle];
-      [formatter setTimeStyle:NSDateFormatterShortStyle];
-      NSString *date = [formatter stringFromDate:[NSDate date]];
-      NSDictionary *userCell
-        = [NSDictionary dictionaryWithObject:date
-                                      forKey:kQSBPathCellDisplayTitleKey];
-      [cellArray addObject:userCell];
-
-      [dictionary setObject:cellArray forKey:kQSBObjectAttributePathCellsKey];
-
-      NSWorkspace *ws = [NSWorkspace sharedWorkspace];
-      NSString *nsIconType = NSFileTypeForHFSTypeCode(iconType);
-      NSImage *image = [ws iconForFileType:nsIconType];
-      [dictionary setObject:image forKey:kHGSObjectAttributeIconKey];
-      HGSUnscoredResult *result = [HGSUnscoredResult resultWithDictionary:dictionary
-                                                                   source:self];
-      if (result) {
-        // If the new pasteboard value is already in the list of results,
-        // remove it so the new result replaces it at the top of the list
-        for (HGSResult *recentResult in recentResults_) {
-          NSDictionary *recentPasteboardValue
-            = [recentResult valueForKey:kHGSObjectAttributePasteboardValueKey];
-          if ([recentPasteboardValue isEqualToDictionary:pasteboardValue]) {
-            [recentResults_ removeObject:recentResult];
-            break;
-          }
-        }
-        if ([recentResults_ count] > kMaxHistoryItems) {
-          [recentResults_ removeObjectAtIndex:0];
-        }
-        [recentResults_ addObject:result];
-        HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
-        [database indexResult:clipboardResult_];
-        for (HGSResult *recentResult in recentResults_) {
-          [database indexResult:recentResult];
-        }
-        [self replaceCurrentDatabaseWith:database];
-      }
+    iconType = kClippingUnknownType;
+  } else if ([type isEqualToString:NSTIFFPboardType] ||
+             [type isEqualToString:NSPDFPboardType] ||
+             [type isEqualToString:NSPICTPboardType]) {
+    // Image. Only the header is looked at, the image itself isn't decoded.
+    NSData *data = [value objectForKey:type];
+    if ([NSImageRep imageRepClassForData:data]) {
+      NSString *name
+        = HGSLocalizedString(@"Clipboard Image",
+                             @"The user-visible name for clipboard  "
+                             @"image results");
+      dictionary = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                    name, kHGSObjectAttributeNameKey,
+                    kTypeClipboardImage, kHGSObjectAttributeTypeKey,
+                    historyURL, kHGSObjectAttributeURIKey,
+                    nil];
     }
+    iconType = kClippingPictureType;
+  }
+  // TODO(hawk): more specializations, such as files
 
-    lastChangeCount_ = changeCount;
+  if (dictionary) {
+    if (snippet) {
+      [dictionary setObject:snippet forKey:kHGSObjectAttributeSnippetKey];
+    }
+    NSWorkspace *ws = [NSWorkspace sharedWorkspace];
+    NSString *nsIconType = NSFileTypeForHFSTypeCode(iconType);
+    NSImage *image = [ws iconForFileType:nsIconType];
+    if (!image) {
+      image = clipboardIcon_;
+    }
+    [dictionary setObject:image forKey:kHGSObjectAttributeIconKey];
   }
+  return dictionary;
+}
+
+- (NSArray *)pathCellsForDate:(NSDate *)date {
+  NSString *clipboard = HGSLocalizedString(@"Clipboard",
+                                           @"The generic search term used "
+                                           @"to bring up clipboard "
+                                           @"contents and history");
+  NSDictionary *clipboardCell
+    = [NSDictionary dictionaryWithObject:clipboard
+                                  forKey:kQSBPathCellDisplayTitleKey];
+  NSDictionary *userCell
+    = [NSDictionary dictionaryWithObject:[dateFormatter_ stringFromDate:date]
+                                  forKey:kQSBPathCellDisplayTitleKey];
+  return [NSArray arrayWithObjects:clipboardCell, userCell, nil];
 }
 
 // Flatten a possibly long pasteboard value (say, the entire contents of a file)
 // into something the can be displayed on a single line in a list.
 - (NSString *)nameFromStringValue:(NSString *)stringValue {
+  stringValue = ClipboardPrefixOfString(stringValue);
   stringValue = [stringValue stringByTrimmingCharactersInSet:
                  [NSCharacterSet whitespaceAndNewlineCharacterSet]];
   NSArray *parts = [stringValue componentsSeparatedByCharactersInSet:
@@ -309,6 +375,7 @@ static NSString *const kClipboardCopyAction
 
 // Reduce a multi-line string to just the first few lines
 - (NSString *)snippetFromStringValue:(NSString *)stringValue {
+  stringValue = ClipboardPrefixOfString(stringValue);
   NSArray *lines = [stringValue componentsSeparatedByCharactersInSet:
                     [NSCharacterSet newlineCharacterSet]];
   NSMutableArray *resultLines = [NSMutableArray array];
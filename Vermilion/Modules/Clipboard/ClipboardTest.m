@@ -31,8 +31,26 @@
 //
 
 #import "HGSUnitTestingUtilities.h"
+#import "ClipboardHistory.h"
+#import "ClipboardPasteboardMonitor.h"
+
 static NSString *const kClipboardTestString = @"Lazarus Long Text";
 
+// A pasteboard that only holds what the test puts on it.
+@interface ClipboardTestPasteboard : NSObject <ClipboardPasteboardProvider> {
+ @private
+  NSMutableDictionary *values_;
+  NSInteger changeCount_;
+}
+- (void)setString:(NSString *)string;
+- (void)setURL:(NSString *)urlString string:(NSString *)string;
+@end
+
+@interface HGSSearchSource (ClipboardSourceTest)
+- (void)setPasteboard:(id<ClipboardPasteboardProvider>)pasteboard;
+- (ClipboardPasteboardMonitor *)pasteboardMonitor;
+@end
+
 @interface ClipboardSourceTest : HGSSearchSourceAbstractTestCase {
  @private
   NSArray *results_;
@@ -43,6 +61,81 @@ static NSString *const kClipboardTestString = @"Lazarus Long Text";
 @interface ClipboardCopyActionTest : HGSActionAbstractTestCase
 @end
 
+@interface ClipboardHistoryTest : GTMTestCase
+@end
+
+@interface ClipboardPasteboardMonitorTest : GTMTestCase {
+ @private
+  NSUInteger changes_;
+}
+- (void)pasteboardDidChange:(ClipboardPasteboardMonitor *)monitor;
+@end
+
+@implementation ClipboardTestPasteboard
+
+- (id)init {
+  if ((self = [super init])) {
+    values_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [values_ release];
+  [super dealloc];
+}
+
+- (void)setString:(NSString *)string {
+  [values_ removeAllObjects];
+  [values_ setObject:string forKey:NSStringPboardType];
+  ++changeCount_;
+}
+
+- (void)setURL:(NSString *)urlString string:(NSString *)string {
+  [values_ removeAllObjects];
+  // NSURLPboardType holds the URL and its base, as NSURL writes it.
+  NSArray *urlStrings = [NSArray arrayWithObjects:urlString, @"", nil];
+  [values_ setObject:urlStrings forKey:NSURLPboardType];
+  if (string) {
+    [values_ setObject:string forKey:NSStringPboardType];
+  }
+  ++changeCount_;
+}
+
+- (NSInteger)changeCount {
+  return changeCount_;
+}
+
+- (NSArray *)types {
+  return [values_ allKeys];
+}
+
+- (NSString *)availableTypeFromArray:(NSArray *)types {
+  for (NSString *type in types) {
+    if ([values_ objectForKey:type]) return type;
+  }
+  return nil;
+}
+
+- (NSData *)dataForType:(NSString *)dataType {
+  id value = [values_ objectForKey:dataType];
+  if ([value isKindOfClass:[NSString class]]) {
+    value = [value dataUsingEncoding:NSUTF8StringEncoding];
+  }
+  return value;
+}
+
+- (NSString *)stringForType:(NSString *)dataType {
+  id value = [values_ objectForKey:dataType];
+  return [value isKindOfClass:[NSString class]] ? value : nil;
+}
+
+- (id)propertyListForType:(NSString *)dataType {
+  return [values_ objectForKey:dataType];
+}
+
+@end
+
 @implementation ClipboardSourceTest
   
 - (id)initWithInvocation:(NSInvocation *)invocation {
@@ -81,6 +174,104 @@ static NSString *const kClipboardTestString = @"Lazarus Long Text";
   results_ = nil;
 }
 
+- (void)testHistoryWithManyCopies {
+  HGSSearchSource *source = [self source];
+  ClipboardTestPasteboard *pb 
+    = [[[ClipboardTestPasteboard alloc] init] autorelease];
+  [source setPasteboard:pb];
+  ClipboardPasteboardMonitor *monitor = [source pasteboardMonitor];
+  STAssertEquals((id)[monitor pasteboard], (id)pb, nil);
+  
+  // About 4MB of text, the kind of thing that gets copied out of a log.
+  NSString *line = @"Zanzibar log line that goes on for a while.\n";
+  NSMutableString *bigString 
+    = [NSMutableString stringWithCapacity:[line length] * 100000];
+  for (NSUInteger i = 0; i < 100000; ++i) {
+    [bigString appendString:line];
+  }
+
+  const NSUInteger kCopies = 2000;
+  for (NSUInteger i = 0; i < kCopies; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BOOL isBig = (i % 100) == 0;
+    NSString *string = nil;
+    if (isBig) {
+      string = [bigString stringByAppendingFormat:@"%lu", (unsigned long)i];
+    } else {
+      // Every so often copy something that's already in the history.
+      NSUInteger copy = (i % 10 == 0) ? i - 5 : i;
+      string = [NSString stringWithFormat:@"Zanzibar copy %lu", 
+                (unsigned long)copy];
+    }
+    [pb setString:string];
+    STAssertTrue([monitor checkForChanges], nil);
+    [pool release];
+  }
+  STAssertFalse([monitor checkForChanges], nil);
+
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"Zanzibar" 
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil 
+                                           queryFlags:0] autorelease];
+  HGSSearchOperation *op = [source searchOperationForQuery:query];
+  [op runOnCurrentThread:YES];
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  NSRange resultRange = NSMakeRange(0, [op resultCountForFilter:filter]);
+  NSArray *results = [op sortedRankedResultsInRange:resultRange
+                                         typeFilter:filter];
+  // The history holds 25 entries, and copying something again doesn't
+  // add a second one.
+  STAssertEquals([results count], (NSUInteger)25, nil);
+  NSMutableSet *names = [NSMutableSet set];
+  for (HGSResult *result in results) {
+    STAssertLessThanOrEqual([[result displayName] length], (NSUInteger)256, 
+                            nil);
+    [names addObject:[result displayName]];
+  }
+  STAssertEquals([names count], [results count], nil);
+  STAssertTrue([names containsObject:@"Zanzibar copy 1999"], nil);
+  STAssertTrue([names containsObject:@"Zanzibar copy 1985"], nil);
+}
+
+- (void)testHistoryWithSharedURL {
+  HGSSearchSource *source = [self source];
+  ClipboardTestPasteboard *pb 
+    = [[[ClipboardTestPasteboard alloc] init] autorelease];
+  [source setPasteboard:pb];
+  ClipboardPasteboardMonitor *monitor = [source pasteboardMonitor];
+  NSString *urlString = @"http://www.zanzibar.com/";
+
+  // Two different copies that are both shown as the same URL.
+  [pb setURL:urlString string:@"Zanzibar home page"];
+  STAssertTrue([monitor checkForChanges], nil);
+  [pb setURL:urlString string:nil];
+  STAssertTrue([monitor checkForChanges], nil);
+
+  // Push the first one out of the history. The second must survive it.
+  for (NSUInteger i = 0; i < 24; ++i) {
+    [pb setString:[NSString stringWithFormat:@"Filler copy %lu", 
+                   (unsigned long)i]];
+    STAssertTrue([monitor checkForChanges], nil);
+  }
+
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:@"zanzibar" 
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil 
+                                           queryFlags:0] autorelease];
+  HGSSearchOperation *op = [source searchOperationForQuery:query];
+  [op runOnCurrentThread:YES];
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  NSRange resultRange = NSMakeRange(0, [op resultCountForFilter:filter]);
+  NSArray *results = [op sortedRankedResultsInRange:resultRange
+                                         typeFilter:filter];
+  STAssertEquals([results count], (NSUInteger)1, nil);
+  HGSResult *result = [results lastObject];
+  STAssertEqualObjects([result displayName], urlString, nil);
+  STAssertFalse([[result uri] isEqualToString:urlString], nil);
+}
+
 - (void)gotResults:(NSNotification *)notification {
   HGSSearchOperation *op = [notification object];
   HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
@@ -157,3 +348,133 @@ static NSString *const kClipboardTestString = @"Lazarus Long Text";
 
 @end
 
+@implementation ClipboardHistoryTest
+
+- (void)testDigest {
+  NSDictionary *value 
+    = [NSDictionary dictionaryWithObject:kClipboardTestString
+                                  forKey:NSStringPboardType];
+  NSData *digest = [ClipboardHistory digestForPasteboardValue:value];
+  STAssertNotNil(digest, nil);
+  NSDictionary *sameValue 
+    = [NSDictionary dictionaryWithObject:[[kClipboardTestString mutableCopy] 
+                                          autorelease]
+                                  forKey:NSStringPboardType];
+  STAssertEqualObjects([ClipboardHistory digestForPasteboardValue:sameValue],
+                       digest, nil);
+  NSDictionary *otherType 
+    = [NSDictionary dictionaryWithObject:kClipboardTestString
+                                  forKey:NSRTFPboardType];
+  STAssertNotEqualObjects([ClipboardHistory digestForPasteboardValue:otherType],
+                          digest, nil);
+  NSDictionary *data 
+    = [NSDictionary dictionaryWithObject:
+       [kClipboardTestString dataUsingEncoding:NSUTF8StringEncoding]
+                                  forKey:NSStringPboardType];
+  NSData *dataDigest = [ClipboardHistory digestForPasteboardValue:data];
+  STAssertNotEqualObjects(dataDigest, digest, nil);
+  NSDictionary *url 
+    = [NSDictionary dictionaryWithObject:
+       [NSURL URLWithString:@"http://www.google.com/"]
+                                  forKey:NSURLPboardType];
+  STAssertNotNil([ClipboardHistory digestForPasteboardValue:url], nil);
+}
+
+- (void)testRingBuffer {
+  STAssertNil([[[ClipboardHistory alloc] initWithCapacity:0] autorelease], 
+              nil);
+  ClipboardHistory *history 
+    = [[[ClipboardHistory alloc] initWithCapacity:3] autorelease];
+  STAssertEquals([history capacity], (NSUInteger)3, nil);
+  NSArray *names = [NSArray arrayWithObjects:@"a", @"b", @"c", @"d", nil];
+  NSMutableArray *removed = [NSMutableArray array];
+  for (NSString *name in names) {
+    NSData *digest = [name dataUsingEncoding:NSUTF8StringEncoding];
+    [history addObject:name digest:digest removedObjects:removed];
+  }
+  // "a" was pushed out by "d".
+  STAssertEquals([history count], (NSUInteger)3, nil);
+  STAssertEqualObjects(removed, [NSArray arrayWithObject:@"a"], nil);
+  NSArray *expected = [NSArray arrayWithObjects:@"d", @"c", @"b", nil];
+  STAssertEqualObjects([history objects], expected, nil);
+  NSData *aDigest = [@"a" dataUsingEncoding:NSUTF8StringEncoding];
+  STAssertNil([history objectForDigest:aDigest], nil);
+
+  // Adding "b" again moves it to the front without pushing anything out.
+  [removed removeAllObjects];
+  NSData *bDigest = [@"b" dataUsingEncoding:NSUTF8StringEncoding];
+  [history addObject:@"B" digest:bDigest removedObjects:removed];
+  STAssertEqualObjects(removed, [NSArray arrayWithObject:@"b"], nil);
+  expected = [NSArray arrayWithObjects:@"B", @"d", @"c", nil];
+  STAssertEqualObjects([history objects], expected, nil);
+  STAssertEqualObjects([history objectForDigest:bDigest], @"B", nil);
+
+  // Now "c" is the oldest.
+  [removed removeAllObjects];
+  [history addObject:@"e" 
+              digest:[@"e" dataUsingEncoding:NSUTF8StringEncoding] 
+      removedObjects:removed];
+  STAssertEqualObjects(removed, [NSArray arrayWithObject:@"c"], nil);
+  expected = [NSArray arrayWithObjects:@"e", @"B", @"d", nil];
+  STAssertEqualObjects([history objects], expected, nil);
+
+  // Re-adding the newest entry leaves the order alone.
+  [history addObject:@"E" 
+              digest:[@"e" dataUsingEncoding:NSUTF8StringEncoding] 
+      removedObjects:nil];
+  expected = [NSArray arrayWithObjects:@"E", @"B", @"d", nil];
+  STAssertEqualObjects([history objects], expected, nil);
+}
+
+@end
+
+@implementation ClipboardPasteboardMonitorTest
+
+- (void)pasteboardDidChange:(ClipboardPasteboardMonitor *)monitor {
+  ++changes_;
+}
+
+- (void)testMonitor {
+  ClipboardTestPasteboard *pb 
+    = [[[ClipboardTestPasteboard alloc] init] autorelease];
+  [pb setString:@"Before"];
+  ClipboardPasteboardMonitor *monitor 
+    = [[[ClipboardPasteboardMonitor alloc] 
+        initWithPasteboard:pb
+                    target:self
+                  selector:@selector(pasteboardDidChange:)] autorelease];
+  STAssertNotNil(monitor, nil);
+  
+  // What was there before doesn't count.
+  STAssertFalse([monitor checkForChanges], nil);
+  STAssertEquals(changes_, (NSUInteger)0, nil);
+  
+  // Polling backs off while nothing changes...
+  NSTimeInterval startInterval = [monitor pollInterval];
+  NSTimeInterval interval = startInterval;
+  for (int i = 0; i < 20; ++i) {
+    STAssertFalse([monitor checkForChanges], nil);
+    STAssertGreaterThanOrEqual([monitor pollInterval], interval, nil);
+    interval = [monitor pollInterval];
+  }
+  STAssertGreaterThan(interval, startInterval, nil);
+  
+  // ...and speeds up again after a change.
+  [pb setString:@"After"];
+  STAssertTrue([monitor checkForChanges], nil);
+  STAssertEquals(changes_, (NSUInteger)1, nil);
+  STAssertLessThan([monitor pollInterval], interval, nil);
+  
+  // The timer drives it as well.
+  [monitor start];
+  [pb setString:@"Polled"];
+  NSRunLoop *rl = [NSRunLoop currentRunLoop];
+  [rl runUntilDate:[NSDate dateWithTimeIntervalSinceNow:1.0]];
+  STAssertEquals(changes_, (NSUInteger)2, nil);
+  [monitor stop];
+  [pb setString:@"Stopped"];
+  [rl runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.5]];
+  STAssertEquals(changes_, (NSUInteger)2, nil);
+}
+
+@end
@@ -56,9 +56,12 @@ static NSString *const kHGSGenericContactIconName = @"HGSGenericContactImage";
   NSCondition *condition_;
   BOOL indexing_;
   NSMutableDictionary *imageLoadingTags_;
-  NSArray *results_;
 }
+- (HGSResult *)indexPerson:(ABPerson *)person
+                addressBook:(ABAddressBook *)sab
+               intoDatabase:(HGSMemorySearchSourceDB *)database;
 - (void)loadAddressBookContactsOperation;
+- (void)updateAddressBookContactsOperation:(NSDictionary *)changes;
 - (void)addressBookChanged:(NSNotification *)notification;
 
 // Return an ABPerson for a given result
@@ -124,109 +127,155 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   return sGenericImage;
 }
 
+- (HGSResult *)indexPerson:(ABPerson *)person
+                addressBook:(ABAddressBook *)sab
+               intoDatabase:(HGSMemorySearchSourceDB *)database {
+  HGSResult *result = nil;
+  NSString *name = nil;
+  NSString *firstName = [person valueForProperty:kABFirstNameProperty];
+  NSString *lastName = [person valueForProperty:kABLastNameProperty];
+  if (firstName && lastName) {
+    if ([sab defaultNameOrdering] == kABFirstNameFirst) {
+      name = [NSString stringWithFormat:@"%@ %@", firstName, lastName];
+    } else {
+      name = [NSString stringWithFormat:@"%@ %@", lastName, firstName];
+    }
+  } else if (lastName) {
+    name = lastName;
+  } else if (firstName) {
+    name = firstName;
+  } else {
+    name = [person valueForProperty:kABOrganizationProperty];
+  }
+  if (name) {
+    NSString *uniqueID = [person uniqueId];
+    NSString *urlString
+      = [@"addressbook://" stringByAppendingString:uniqueID];
+    NSString *multiValueKeys[] = {
+      kABEmailProperty,
+      kABAIMInstantProperty,
+      kABJabberInstantProperty,
+      kABMSNInstantProperty,
+      kABYahooInstantProperty,
+      kABICQInstantProperty
+    };
+
+    NSMutableArray *otherTermStrings = [NSMutableArray array];
+    size_t keyCount = sizeof(multiValueKeys) / sizeof(NSString *);
+    for (size_t i = 0; i < keyCount; i++) {
+      ABMultiValue *multiValues = [person valueForProperty:multiValueKeys[i]];
+      NSInteger valueCount = [multiValues count];
+      for (NSInteger idx = 0; idx < valueCount; idx++) {
+        NSString *value = [multiValues valueAtIndex:idx];
+        if (value) {
+          [otherTermStrings addObject:value];
+        }
+      }
+    }
+
+    NSString *nickname = [person valueForProperty:kABNicknameProperty];
+    if (nickname) {
+      [otherTermStrings addObject:nickname];
+    }
+
+    NSString *companyName = [person valueForProperty:kABOrganizationProperty];
+    if (companyName && ![companyName isEqualToString:name]) {
+      [otherTermStrings addObject:companyName];
+    }
+
+    NSDictionary *attributes
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         otherTermStrings, kHGSObjectAttributeUniqueIdentifiersKey,
+         uniqueID, kHGSObjectAttributeAddressBookRecordIdentifierKey,
+         nil];
+    HGSUnscoredResult* hgsResult
+      = [HGSUnscoredResult resultWithURI:urlString
+                                    name:name
+                                    type:kTypeContactAddressBook
+                                  source:self
+                              attributes:attributes];
+    [database indexResult:hgsResult
+                     name:name
+               otherTerms:otherTermStrings];
+    result = hgsResult;
+  }
+  return result;
+}
+
 - (void)loadAddressBookContactsOperation {
   [condition_ lock];
   indexing_ = YES;
 
   // clear the existing info
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
-  NSMutableArray *newResults = [NSMutableArray array];
+  // Company names and email domains repeat a lot across contacts.
+  [HGSTokenizer beginInterning];
 
   ABAddressBook *sab = [ABAddressBook sharedAddressBook];
   for (ABPerson *person in [sab people]) {
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-    NSString *name = nil;
-    NSString *firstName = [person valueForProperty:kABFirstNameProperty];
-    NSString *lastName = [person valueForProperty:kABLastNameProperty];
-    if (firstName && lastName) {
-      if ([sab defaultNameOrdering] == kABFirstNameFirst) {
-        name = [NSString stringWithFormat:@"%@ %@", firstName, lastName];
-      } else {
-        name = [NSString stringWithFormat:@"%@ %@", lastName, firstName];
-      }
-    } else if (lastName) {
-      name = lastName;
-    } else if (firstName) {
-      name = firstName;
-    } else {
-      name = [person valueForProperty:kABOrganizationProperty];
-    }
-    if (name) {
-      NSString *uniqueID = [person uniqueId];
-      NSString *urlString
-        = [@"addressbook://" stringByAppendingString:uniqueID];
-      NSString *multiValueKeys[] = {
-        kABEmailProperty,
-        kABAIMInstantProperty,
-        kABJabberInstantProperty,
-        kABMSNInstantProperty,
-        kABYahooInstantProperty,
-        kABICQInstantProperty
-      };
-
-      NSMutableArray *otherTermStrings = [NSMutableArray array];
-      for (unsigned i = 0; i < sizeof(multiValueKeys) / sizeof(NSString *); i++) {
-        ABMultiValue *multiValues = [person valueForProperty:multiValueKeys[i]];
-        NSInteger valueCount = [multiValues count];
-        for (NSInteger idx = 0; idx < valueCount; idx++) {
-          NSString *value = [multiValues valueAtIndex:idx];
-          if (value) {
-            [otherTermStrings addObject:value];
-          }
-        }
-      }
+    [self indexPerson:person addressBook:sab intoDatabase:database];
+    [pool release];
+  }
+  [HGSTokenizer endInterning];
 
-      NSString *nickname = [person valueForProperty:kABNicknameProperty];
-      if (nickname) {
-        [otherTermStrings addObject:nickname];
-      }
+  [self replaceCurrentDatabaseWith:database];
+  indexing_ = NO;
+  [condition_ signal];
+  [condition_ unlock];
+}
 
-      NSString *companyName = [person valueForProperty:kABOrganizationProperty];
-      if (companyName && ![companyName isEqualToString:name]) {
-        [otherTermStrings addObject:companyName];
-      }
+- (void)updateAddressBookContactsOperation:(NSDictionary *)changes {
+  [condition_ lock];
+  NSArray *inserted = [changes objectForKey:kABInsertedRecords];
+  NSArray *updated = [changes objectForKey:kABUpdatedRecords];
+  NSArray *deleted = [changes objectForKey:kABDeletedRecords];
+  NSMutableSet *staleURIs = [NSMutableSet set];
+  for (NSString *uniqueID in [updated arrayByAddingObjectsFromArray:deleted]) {
+    [staleURIs addObject:[@"addressbook://" stringByAppendingString:uniqueID]];
+  }
 
-      NSDictionary *attributes
-        = [NSDictionary dictionaryWithObjectsAndKeys:
-           otherTermStrings, kHGSObjectAttributeUniqueIdentifiersKey,
-           uniqueID, kHGSObjectAttributeAddressBookRecordIdentifierKey,
-           nil];
-      HGSUnscoredResult* hgsResult
-        = [HGSUnscoredResult resultWithURI:urlString
-                                      name:name
-                                      type:kTypeContactAddressBook
-                                    source:self
-                                attributes:attributes];
-      [newResults addObject:hgsResult];
-      [database indexResult:hgsResult
-                   name:name
-             otherTerms:otherTermStrings];
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  ABAddressBook *sab = [ABAddressBook sharedAddressBook];
+  for (NSString *uniqueID in [inserted arrayByAddingObjectsFromArray:updated]) {
+    ABRecord *record = [sab recordForUniqueId:uniqueID];
+    if ([record isKindOfClass:[ABPerson class]]) {
+      [self indexPerson:(ABPerson *)record
+            addressBook:sab
+           intoDatabase:database];
     }
-    [pool release];
   }
 
-  @synchronized(self) {
-    [results_ release];
-    results_ = [newResults retain];
-  }
-  [self replaceCurrentDatabaseWith:database];
-  indexing_ = NO;
+  [self updateCurrentDatabaseWith:database
+          removingResultsWithURIs:[staleURIs allObjects]];
   [condition_ signal];
   [condition_ unlock];
 }
 
 - (void)addressBookChanged:(NSNotification *)notification {
-  NSOperation *op
-    = [[[NSInvocationOperation alloc] initWithTarget:self
-                                            selector:@selector(loadAddressBookContactsOperation)
-                                              object:nil] autorelease];
+  // If the notification tells us what changed, only reindex those contacts.
+  NSDictionary *userInfo = [notification userInfo];
+  BOOL hasChanges = [userInfo objectForKey:kABInsertedRecords]
+    || [userInfo objectForKey:kABUpdatedRecords]
+    || [userInfo objectForKey:kABDeletedRecords];
+  NSOperation *op = nil;
+  if (hasChanges) {
+    op = [[[NSInvocationOperation alloc]
+           initWithTarget:self
+                 selector:@selector(updateAddressBookContactsOperation:)
+                   object:userInfo] autorelease];
+  } else {
+    op = [[[NSInvocationOperation alloc]
+           initWithTarget:self
+                 selector:@selector(loadAddressBookContactsOperation)
+                   object:nil] autorelease];
+  }
   [[HGSOperationQueue sharedOperationQueue] addOperation:op];
 }
 
 - (void)dealloc {
   [condition_ release];
   [imageLoadingTags_ release];
-  [results_ release];
   [super dealloc];
 }
 
@@ -671,25 +720,13 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
 }
 
 - (HGSResult *)resultWithArchivedRepresentation:(NSDictionary *)representation {
-  HGSResult *result = nil;
   NSString *uniqID
     = [representation objectForKey:kHGSObjectAttributeAddressBookRecordIdentifierKey];
-  if (uniqID) {
-    @synchronized(self) {
-      // Find the result w/ that ID.
-      for (HGSResult *hgsResult in results_) {
-        NSString *testUniqID
-          = [hgsResult valueForKey:kHGSObjectAttributeAddressBookRecordIdentifierKey];
-        if ([testUniqID isEqualToString:uniqID]) {
-          // make sure it lives on the calling thread's pool
-          result = [[hgsResult retain] autorelease];
-          break;
-        }
-      }
-    }
-  }
+  return [self resultForIndexKey:uniqID];
+}
 
-  return result;
+- (id)indexKeyForResult:(HGSResult *)result {
+  return [result valueForKey:kHGSObjectAttributeAddressBookRecordIdentifierKey];
 }
 
 - (NSString *)cleanPhoneNumber:(NSString *)dirtyPhone {
@@ -32,178 +32,144 @@
 
 #import <Vermilion/Vermilion.h>
 #import <QSBPluginUI/QSBPluginUI.h>
-#import "GTMSystemVersion.h"
+#import "DeveloperDocumentationTokenReader.h"
 
-// Private interface that we've borrowed.
-@interface DSADocSet : NSObject
-- (id)initWithDocRootDirectory:(id)fp8;
-@end
+static NSString *const kDocSetsPath = @"Documentation/DocSets";
+static NSString *const kiPhoneDocSetsPath
+  = @"Platforms/iPhoneOS.platform/Developer/Documentation/DocSets";
 
-static NSString *const kDocSetFrameworkPath 
-  = @"Library/PrivateFrameworks/DocSetAccess.framework";
-static NSString *const kCoreReferenceDocSetPath
-  = @"Documentation/DocSets/com.apple.ADC_Reference_Library.CoreReference.docset";
-static NSString *const kiPhoneReferenceDocSetPath
-  = @"Platforms/iPhoneOS.platform/Developer/Documentation/DocSets/"
-    @"com.apple.adc.documentation.AppleiPhone2_2.iPhoneLibrary.docset";
+// Tokens are handed to the search database in batches of this size, so
+// searches see the docsets fill in while they are being read.
+static const NSUInteger kTokensPerBatch = 5000;
 
 @interface DeveloperDocumentationSource : HGSMemorySearchSource {
  @private
-  NSCondition *condition_;
-  BOOL indexed_;
   NSImage *docSetIcon_;
+  // Path cell for each docset indexed, keyed by its documents URL string.
+  NSMutableDictionary *docSetCells_;
 }
 - (void)indexDocumentationOperation;
-- (void)indexDocSetAtPath:(NSString *)docSetPath 
-                     into:(HGSMemorySearchSourceDB *)database;
+- (NSUInteger)indexDocSetAtPath:(NSString *)docSetPath;
+- (NSDictionary *)docSetCellForResult:(HGSResult *)result;
 @end
 
 @implementation DeveloperDocumentationSource
 
 - (id)initWithConfiguration:(NSDictionary *)configuration {
   if ((self = [super initWithConfiguration:configuration])) {
-    if ([GTMSystemVersion isSnowLeopardOrGreater]) {
-      // We don't support Snow Leopard.
-      // TODO(mrossetti): Update this source for Snow Leopard.
-      HGSLog(@"The Developer Documentation source is not supported under "
-             @"Snow Leopard.");
-      [self release];
-      self = nil;
-    } else {
-      condition_ = [[NSCondition alloc] init];
-      NSOperation *op 
-        = [[[NSInvocationOperation alloc] initWithTarget:self
-                                                selector:@selector(indexDocumentationOperation)
-                                                  object:nil]
+    docSetCells_ = [[NSMutableDictionary alloc] init];
+    NSWorkspace *ws = [NSWorkspace sharedWorkspace];
+    docSetIcon_ = [[ws iconForFileType:@"docset"] retain];
+    NSOperation *op 
+      = [[[NSInvocationOperation alloc] initWithTarget:self
+                                              selector:@selector(indexDocumentationOperation)
+                                                object:nil]
          autorelease];
-      [[HGSOperationQueue sharedOperationQueue] addOperation:op];
-      NSWorkspace *ws = [NSWorkspace sharedWorkspace];
-      docSetIcon_ = [[ws iconForFileType:@"docset"] retain];
-    }
+    [[HGSOperationQueue sharedOperationQueue] addOperation:op];
   }
   return self;
 }
 
-- (void)indexDocSetAtPath:(NSString *)docSetPath 
-                     into:(HGSMemorySearchSourceDB *)database {
-  
-  if (!docSetPath) return;
-  
-  NSBundle *rootDirBundle = [NSBundle bundleWithPath:docSetPath];
-  if (!rootDirBundle) {
+- (void)dealloc {
+  [docSetIcon_ release];
+  [docSetCells_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)indexDocSetAtPath:(NSString *)docSetPath {
+  DeveloperDocumentationTokenReader *reader 
+    = [[[DeveloperDocumentationTokenReader alloc]
+        initWithDocSetPath:docSetPath] autorelease];
+  if (!reader) {
     HGSLogDebug(@"Unable to get developer docs at path %@", docSetPath);
-    return;
+    return 0;
   }
-  NSString *rootDirDocuments = [rootDirBundle resourcePath];
-  rootDirDocuments 
-    = [rootDirDocuments stringByAppendingPathComponent:@"Documents"];
-
   NSURL *docsURL = [NSURL fileURLWithPath:docSetPath isDirectory:YES];
-  if (!docsURL) {
-    HGSLogDebug(@"Unable to get developer docs URL");
-    return;
-  }
-  NSURL *rootDirURL = [NSURL fileURLWithPath:rootDirDocuments isDirectory:YES];
-  NSString *docSetName 
-    = [rootDirBundle objectForInfoDictionaryKey:(NSString*)kCFBundleNameKey];
   NSDictionary *docSetCell = [NSDictionary dictionaryWithObjectsAndKeys:
-                              docSetName, kQSBPathCellDisplayTitleKey,
+                              [reader docSetName], kQSBPathCellDisplayTitleKey,
                               docsURL, kQSBPathCellURLKey,
                               nil];
-  Class dsaDocSetClass = NSClassFromString(@"DSADocSet");
-  if (!dsaDocSetClass) {
-    HGSLogDebug(@"Unable to get DSADocSet class");
-    return;
+  // Docsets are only read when the source starts up, so one we have seen
+  // before is the same docset found twice and is skipped. Its tokens are
+  // already in the database, and adding them again would duplicate them.
+  @synchronized (docSetCells_) {
+    NSString *documentsURLString = [reader documentsURLString];
+    if ([docSetCells_ objectForKey:documentsURLString]) {
+      HGSLogDebug(@"Already indexed developer docs at path %@", docSetPath);
+      return 0;
+    }
+    [docSetCells_ setObject:docSetCell forKey:documentsURLString];
   }
   
-  // The next couple of operations allocate a lot of memory into autorelease
-  // pools. We want that memory cleaned up as soon as possible, so we have
-  // an autorelease pool outside the loop to clean up the array of nodes
-  // and the filtered array, and an innerpool to clean up the processing
-  // on the nodes themselves.
-  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
-  id docSet 
-    = [[[dsaDocSetClass alloc] initWithDocRootDirectory: docsURL] autorelease];
-  
-  NSArray *nodes 
-    = [docSet valueForKeyPath: @"rootNode.searchableNodesInHierarchy"];
-  NSPredicate *pred = [NSPredicate predicateWithFormat:@"domain == %d", 1];
-  nodes = [nodes filteredArrayUsingPredicate:pred];  
-
-  for (id node in nodes) {
-    NSAutoreleasePool *innerPool = [[NSAutoreleasePool alloc] init];
-    NSString *name = [node valueForKey:@"name"];
-    NSString *path = [node valueForKey:@"path"];
-    NSURL *url = nil;
-    if (!path) {
-      NSString *urlString = [node valueForKey:@"URL"];
-      if (urlString) {
-        url = [[NSURL alloc] initWithString:urlString];
-      }
-    } else {
-      url = [[NSURL alloc] initWithString:path relativeToURL:rootDirURL];
-    }
-    if (url) {
-      NSDictionary *docCell = [NSDictionary dictionaryWithObjectsAndKeys:
-                               name, kQSBPathCellDisplayTitleKey,
-                               url, kQSBPathCellURLKey,
-                               nil];
-      NSArray *docCells = [NSArray arrayWithObjects:docSetCell, docCell, nil];
-      NSDictionary *attributes
-        = [NSDictionary dictionaryWithObjectsAndKeys:
-           docCells, kQSBObjectAttributePathCellsKey, 
-           docSetIcon_, kHGSObjectAttributeIconKey,
-           nil];
+  // Results are kept as small as possible, everything beyond the name and
+  // URI is provided when it is asked for.
+  NSString *type = HGS_SUBTYPE(kHGSTypeFile, @"developerdocs");
+  NSUInteger tokenCount = 0;
+  BOOL moreTokens = YES;
+  while (moreTokens) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    HGSMemorySearchSourceDB *batch = [HGSMemorySearchSourceDB database];
+    NSUInteger batchCount = 0;
+    NSString *name = nil;
+    NSString *uri = nil;
+    while (batchCount < kTokensPerBatch 
+           && (moreTokens = [reader readTokenName:&name uri:&uri])) {
       HGSUnscoredResult *result 
-        = [HGSUnscoredResult resultWithURL:url
+        = [HGSUnscoredResult resultWithURI:uri
                                       name:name
-                                      type:HGS_SUBTYPE(kHGSTypeFile, @"developerdocs")
+                                      type:type
                                     source:self
-                                attributes:attributes];  
-      [database indexResult:result];
-      [url autorelease];
+                                attributes:nil];
+      if (result) {
+        [batch indexResult:result];
+        ++batchCount;
+      }
+    }
+    if (batchCount) {
+      [self addToCurrentDatabase:batch];
+      tokenCount += batchCount;
     }
-    [innerPool release];
+    [pool release];
   }
-  [outerPool release];
+  return tokenCount;
 }
 
 - (void)indexDocumentationOperation {
-  [condition_ lock];
-  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
   NSWorkspace *ws = [NSWorkspace sharedWorkspace];
   NSString *xcodePath = [ws fullPathForApplication:@"Xcode"];
-  if (xcodePath) {
-    NSString *devAppPath = [xcodePath stringByDeletingLastPathComponent];
-    NSString *developerPath = [devAppPath stringByDeletingLastPathComponent];
-    Class dsaDocSetClass = NSClassFromString(@"DSADocSet");
-    if (!dsaDocSetClass) {
-      NSString *frameworkPath 
-        = [developerPath stringByAppendingPathComponent:kDocSetFrameworkPath];
-      [[NSBundle bundleWithPath:frameworkPath] load];
-      HGSAssert(NSClassFromString(@"DSADocSet"), 
-                @"Unable to instantiate DSADocSet");
+  if (!xcodePath) return;
+  NSString *devAppPath = [xcodePath stringByDeletingLastPathComponent];
+  NSString *developerPath = [devAppPath stringByDeletingLastPathComponent];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  // TODO(dmaclach): badge iPhone doc sets differently than OS X docsets.
+  NSArray *docSetsPaths 
+    = [NSArray arrayWithObjects:kDocSetsPath, kiPhoneDocSetsPath, nil];
+  for (NSString *docSetsPath in docSetsPaths) {
+    docSetsPath = [developerPath stringByAppendingPathComponent:docSetsPath];
+    NSArray *docSets = [fm contentsOfDirectoryAtPath:docSetsPath error:NULL];
+    for (NSString *docSet in docSets) {
+      if (![[docSet pathExtension] isEqualToString:@"docset"]) continue;
+      NSString *docSetPath 
+        = [docSetsPath stringByAppendingPathComponent:docSet];
+      NSUInteger count = [self indexDocSetAtPath:docSetPath];
+      HGSLogDebug(@"Indexed %lu tokens from %@", 
+                  (unsigned long)count, docSetPath);
     }
-    
-    // TODO(dmaclach): add support for other docsets
-    // TODO(dmaclach): badge iPhone doc sets differently than OS X docsets.
-    NSString *coreReference 
-      = [developerPath stringByAppendingPathComponent:kCoreReferenceDocSetPath];
-    NSString *iPhoneReference 
-      = [developerPath stringByAppendingPathComponent:kiPhoneReferenceDocSetPath];
-    [self indexDocSetAtPath:coreReference into:database];
-    [self indexDocSetAtPath:iPhoneReference into:database];
-    [self replaceCurrentDatabaseWith:database];
   }
-  indexed_ = YES;
-  [condition_ signal];
-  [condition_ unlock];
 }
 
-- (void)dealloc {
-  [docSetIcon_ release];
-  [condition_ release];
-  [super dealloc];
+- (NSDictionary *)docSetCellForResult:(HGSResult *)result {
+  NSString *uri = [result uri];
+  NSDictionary *docSetCell = nil;
+  @synchronized (docSetCells_) {
+    for (NSString *documentsURLString in docSetCells_) {
+      if ([uri hasPrefix:documentsURLString]) {
+        docSetCell = [docSetCells_ objectForKey:documentsURLString];
+        break;
+      }
+    }
+  }
+  return docSetCell;
 }
 
 #pragma mark -
@@ -214,16 +180,31 @@ static NSString *const kiPhoneReferenceDocSetPath
           && [queryString tokenizedLength] >= 4);
 }
 
-- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
-  // make sure we're done any parsing
-  [condition_ lock];
-  while (!indexed_) {
-    [condition_ wait];
+- (BOOL)providesIconsForResults {
+  return YES;
+}
+
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result {
+  id value = nil;
+  if ([key isEqualToString:kHGSObjectAttributeIconKey]
+      || [key isEqualToString:kHGSObjectAttributeImmediateIconKey]) {
+    value = docSetIcon_;
+  } else if ([key isEqualToString:kQSBObjectAttributePathCellsKey]) {
+    NSDictionary *docSetCell = [self docSetCellForResult:result];
+    NSURL *url = [result url];
+    if (docSetCell && url) {
+      NSDictionary *docCell = [NSDictionary dictionaryWithObjectsAndKeys:
+                               [result displayName], 
+                               kQSBPathCellDisplayTitleKey,
+                               url, kQSBPathCellURLKey,
+                               nil];
+      value = [NSArray arrayWithObjects:docSetCell, docCell, nil];
+    }
   }
-  [condition_ signal];
-  [condition_ unlock];
-  
-  [super performSearchOperation:operation];
+  if (!value) {
+    value = [super provideValueForKey:key result:result];
+  }
+  return value;
 }
 
 @end
@@ -0,0 +1,297 @@
+//
+//  DeveloperDocumentationSourceTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSUnitTestingUtilities.h"
+#import "GTMSQLite.h"
+#import "DeveloperDocumentationTokenReader.h"
+
+// The size of a full reference library.
+static const NSUInteger kFixtureTokenCount = 200000;
+static const NSUInteger kFixtureTokensPerFile = 100;
+static NSString *const kFixtureLastTokenName = @"zyzzogetonFixtureToken";
+
+@interface HGSSearchSource (DeveloperDocumentationSourceTest)
+- (NSUInteger)indexDocSetAtPath:(NSString *)docSetPath;
+@end
+
+@interface DeveloperDocumentationSourceTest : HGSSearchSourceAbstractTestCase {
+ @private
+  NSString *fixturePath_;
+}
+- (NSString *)fixturePath;
+- (NSArray *)resultsForQuery:(NSString *)queryString;
+- (void)indexFixtureOnThread:(NSString *)path;
+@end
+
+// Builds a docset with |tokenCount| tokens the same shape as the ones
+// Xcode installs. It only needs SQLite, so the same SQL works anywhere
+// sqlite3 does.
+static BOOL CreateFixtureDocSet(NSString *docSetPath, NSUInteger tokenCount) {
+  NSString *resources
+    = [docSetPath stringByAppendingPathComponent:@"Contents/Resources"];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  if (![fm createDirectoryAtPath:resources
+     withIntermediateDirectories:YES
+                      attributes:nil
+                           error:NULL]) {
+    return NO;
+  }
+  NSDictionary *info
+    = [NSDictionary dictionaryWithObject:@"Synthetic Reference"
+                                  forKey:(NSString *)kCFBundleNameKey];
+  NSString *infoPath
+    = [docSetPath stringByAppendingPathComponent:@"Contents/Info.plist"];
+  if (![info writeToFile:infoPath atomically:YES]) return NO;
+
+  NSString *indexPath
+    = [resources stringByAppendingPathComponent:@"docSet.dsidx"];
+  int err = SQLITE_OK;
+  GTMSQLiteDatabase *db
+    = [[[GTMSQLiteDatabase alloc] initWithPath:indexPath
+                               withCFAdditions:NO
+                                          utf8:YES
+                                     errorCode:&err] autorelease];
+  if (!db) return NO;
+  [db synchronousMode:NO];
+  err = [db executeSQL:
+         @"CREATE TABLE ZTOKEN (Z_PK INTEGER PRIMARY KEY, Z_ENT INTEGER, "
+         @"Z_OPT INTEGER, ZTOKENTYPE INTEGER, ZCONTAINER INTEGER, "
+         @"ZMETAINFORMATION INTEGER, ZTOKENNAME VARCHAR);"
+         @"CREATE TABLE ZTOKENMETAINFORMATION (Z_PK INTEGER PRIMARY KEY, "
+         @"Z_ENT INTEGER, Z_OPT INTEGER, ZTOKEN INTEGER, ZFILE INTEGER, "
+         @"ZANCHOR VARCHAR, ZABSTRACT VARCHAR);"
+         @"CREATE TABLE ZFILEPATH (Z_PK INTEGER PRIMARY KEY, Z_ENT INTEGER, "
+         @"Z_OPT INTEGER, ZPATH VARCHAR);"];
+  if (err != SQLITE_OK) return NO;
+  if (![db beginDeferredTransaction]) return NO;
+  GTMSQLiteStatement *fileInsert
+    = [GTMSQLiteStatement statementWithSQL:@"INSERT INTO ZFILEPATH "
+                                           @"(Z_PK, ZPATH) VALUES (?, ?);"
+                                inDatabase:db
+                                 errorCode:&err];
+  GTMSQLiteStatement *metaInsert
+    = [GTMSQLiteStatement statementWithSQL:@"INSERT INTO "
+                                           @"ZTOKENMETAINFORMATION "
+                                           @"(Z_PK, ZTOKEN, ZFILE, ZANCHOR) "
+                                           @"VALUES (?, ?, ?, ?);"
+                                inDatabase:db
+                                 errorCode:&err];
+  GTMSQLiteStatement *tokenInsert
+    = [GTMSQLiteStatement statementWithSQL:@"INSERT INTO ZTOKEN "
+                                           @"(Z_PK, ZMETAINFORMATION, "
+                                           @"ZTOKENNAME) VALUES (?, ?, ?);"
+                                inDatabase:db
+                                 errorCode:&err];
+  if (!fileInsert || !metaInsert || !tokenInsert) return NO;
+  BOOL isGood = YES;
+  for (NSUInteger i = 0; isGood && i < tokenCount; ++i) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int pk = (int)i + 1;
+    NSUInteger file = i / kFixtureTokensPerFile;
+    if (i % kFixtureTokensPerFile == 0) {
+      NSString *path
+        = [NSString stringWithFormat:@"Classes/Fixture%lu/index.html",
+           (unsigned long)file];
+      [fileInsert bindInt32AtPosition:1 value:(int)file + 1];
+      [fileInsert bindStringAtPosition:2 string:path];
+      isGood &= [fileInsert stepRow] == SQLITE_DONE;
+      [fileInsert reset];
+    }
+    NSString *name = (i == tokenCount - 1)
+      ? kFixtureLastTokenName
+      : [NSString stringWithFormat:@"fixtureToken%lu", (unsigned long)i];
+    NSString *anchor
+      = [NSString stringWithFormat:@"//apple_ref/occ/instm/Fixture%lu/%@",
+         (unsigned long)file, name];
+    [metaInsert bindInt32AtPosition:1 value:pk];
+    [metaInsert bindInt32AtPosition:2 value:pk];
+    [metaInsert bindInt32AtPosition:3 value:(int)file + 1];
+    [metaInsert bindStringAtPosition:4 string:anchor];
+    isGood &= [metaInsert stepRow] == SQLITE_DONE;
+    [metaInsert reset];
+    [tokenInsert bindInt32AtPosition:1 value:pk];
+    [tokenInsert bindInt32AtPosition:2 value:pk];
+    [tokenInsert bindStringAtPosition:3 string:name];
+    isGood &= [tokenInsert stepRow] == SQLITE_DONE;
+    [tokenInsert reset];
+    [pool release];
+  }
+  // Tokens without documentation are skipped by the reader.
+  err = [db executeSQL:@"INSERT INTO ZTOKEN (ZTOKENNAME) "
+                       @"VALUES ('undocumentedFixtureToken');"];
+  isGood &= err == SQLITE_OK;
+  [fileInsert finalizeStatement];
+  [metaInsert finalizeStatement];
+  [tokenInsert finalizeStatement];
+  isGood &= [db commit];
+  return isGood;
+}
+
+@implementation DeveloperDocumentationSourceTest
+
+- (id)initWithInvocation:(NSInvocation *)invocation {
+  self = [super initWithInvocation:invocation 
+                       pluginNamed:@"DeveloperDocumentation" 
+               extensionIdentifier:@"com.google.qsb.developerdocumentation.source"];
+  return self;
+}
+
+- (void)tearDown {
+  if (fixturePath_) {
+    NSString *directory = [fixturePath_ stringByDeletingLastPathComponent];
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+    [fixturePath_ release];
+    fixturePath_ = nil;
+  }
+  [super tearDown];
+}
+
+- (NSString *)fixturePath {
+  if (!fixturePath_) {
+    NSString *directory 
+      = [NSTemporaryDirectory() stringByAppendingPathComponent:
+         [NSString stringWithFormat:@"DeveloperDocumentationSourceTest%d",
+          [[NSProcessInfo processInfo] processIdentifier]]];
+    NSString *path 
+      = [directory stringByAppendingPathComponent:@"Synthetic.docset"];
+    STAssertTrue(CreateFixtureDocSet(path, kFixtureTokenCount), nil);
+    fixturePath_ = [path retain];
+  }
+  return fixturePath_;
+}
+
+- (NSArray *)resultsForQuery:(NSString *)queryString {
+  HGSQuery *query = [[[HGSQuery alloc] initWithString:queryString 
+                                       actionArgument:nil
+                                      actionOperation:nil
+                                         pivotObjects:nil 
+                                           queryFlags:0] autorelease];
+  HGSSearchOperation *op = [[self source] searchOperationForQuery:query];
+  [op runOnCurrentThread:YES];
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  NSRange resultRange = NSMakeRange(0, [op resultCountForFilter:filter]);
+  return [op sortedRankedResultsInRange:resultRange typeFilter:filter];
+}
+
+- (void)indexFixtureOnThread:(NSString *)path {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [[self source] indexDocSetAtPath:path];
+  [pool release];
+}
+
+- (void)testTokenReader {
+  NSString *path = [self fixturePath];
+  DeveloperDocumentationTokenReader *reader 
+    = [[[DeveloperDocumentationTokenReader alloc] 
+        initWithDocSetPath:path] autorelease];
+  STAssertNotNil(reader, nil);
+  STAssertEqualObjects([reader docSetName], @"Synthetic Reference", nil);
+  NSString *documentsURLString = [reader documentsURLString];
+  STAssertTrue([documentsURLString hasPrefix:@"file://"], nil);
+
+  NSUInteger count = 0;
+  NSString *name = nil;
+  NSString *uri = nil;
+  NSString *lastName = nil;
+  while (YES) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    BOOL gotToken = [reader readTokenName:&name uri:&uri];
+    if (gotToken) {
+      if (count == 0) {
+        STAssertEqualObjects(name, @"fixtureToken0", nil);
+        NSString *expected 
+          = [documentsURLString stringByAppendingString:
+             @"Classes/Fixture0/index.html"
+             @"#//apple_ref/occ/instm/Fixture0/fixtureToken0"];
+        STAssertEqualObjects(uri, expected, nil);
+      }
+      [lastName release];
+      lastName = [name retain];
+      ++count;
+    }
+    [pool release];
+    if (!gotToken) break;
+  }
+  STAssertEquals(count, kFixtureTokenCount, nil);
+  STAssertEqualObjects(lastName, kFixtureLastTokenName, nil);
+  [lastName release];
+  STAssertFalse([reader readTokenName:&name uri:&uri], nil);
+}
+
+- (void)testMissingIndex {
+  NSString *path 
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:@"None.docset"];
+  DeveloperDocumentationTokenReader *reader 
+    = [[[DeveloperDocumentationTokenReader alloc] 
+        initWithDocSetPath:path] autorelease];
+  STAssertNil(reader, nil);
+}
+
+- (void)testIndexingTwice {
+  NSString *path = [self fixturePath];
+  STAssertEquals([[self source] indexDocSetAtPath:path],
+                 kFixtureTokenCount, nil);
+  // The same docset found a second time adds nothing.
+  STAssertEquals([[self source] indexDocSetAtPath:path], (NSUInteger)0, nil);
+  NSArray *results = [self resultsForQuery:kFixtureLastTokenName];
+  STAssertEquals([results count], (NSUInteger)1, nil);
+}
+
+- (void)testSearchWhileIndexing {
+  NSString *path = [self fixturePath];
+  [NSThread detachNewThreadSelector:@selector(indexFixtureOnThread:)
+                           toTarget:self
+                         withObject:path];
+  // Searches used to wait for all the docsets to be read. Now they see
+  // whatever has been read so far.
+  NSDate *start = [NSDate date];
+  [self resultsForQuery:kFixtureLastTokenName];
+  STAssertLessThan(-[start timeIntervalSinceNow], 1.0, nil);
+
+  NSArray *results = nil;
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:60];
+  while (![results count] && [timeout timeIntervalSinceNow] > 0) {
+    results = [self resultsForQuery:kFixtureLastTokenName];
+    if (![results count]) {
+      [NSThread sleepForTimeInterval:0.1];
+    }
+  }
+  STAssertGreaterThan([results count], (NSUInteger)0, 
+                      @"Never saw the last token");
+  HGSResult *result = [results objectAtIndex:0];
+  STAssertEqualObjects([result displayName], kFixtureLastTokenName, nil);
+  STAssertTrue([[result uri] hasSuffix:kFixtureLastTokenName], nil);
+  // Attributes are only provided when asked for.
+  STAssertNotNil([result valueForKey:kHGSObjectAttributeIconKey], nil);
+}
+
+@end
@@ -0,0 +1,68 @@
+//
+//  DeveloperDocumentationTokenReader.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+@class GTMSQLiteDatabase;
+@class GTMSQLiteStatement;
+
+// Reads the API tokens of a docset straight out of its token index
+// (Contents/Resources/docSet.dsidx, the SQLite store Xcode builds from the
+// docset's Tokens.xml). Tokens are read one row at a time, so memory use
+// doesn't depend on the size of the docset.
+@interface DeveloperDocumentationTokenReader : NSObject {
+ @private
+  GTMSQLiteDatabase *database_;
+  GTMSQLiteStatement *statement_;
+  NSString *docSetName_;
+  NSString *documentsURLString_;
+}
+
+// The name of the docset, from its Info.plist.
+@property (readonly, retain) NSString *docSetName;
+
+// URL string of the docset's Documents folder. The URI of every token
+// starts with it.
+@property (readonly, retain) NSString *documentsURLString;
+
+// Returns nil if |docSetPath| isn't a docset with a readable token index.
+- (id)initWithDocSetPath:(NSString *)docSetPath;
+
+// Reads the next token. |name| and |uri| are autoreleased. |uri| is the file
+// URL of the token's documentation, including its anchor.
+// Returns NO once all the tokens have been read.
+- (BOOL)readTokenName:(NSString **)name uri:(NSString **)uri;
+
+// Releases the index. Called for you when all the tokens have been read.
+- (void)close;
+
+@end
@@ -0,0 +1,133 @@
+//
+//  DeveloperDocumentationTokenReader.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "DeveloperDocumentationTokenReader.h"
+#import <Vermilion/Vermilion.h>
+#import "GTMSQLite.h"
+
+static NSString *const kDocSetIndexPath = @"Contents/Resources/docSet.dsidx";
+static NSString *const kDocSetDocumentsPath = @"Contents/Resources/Documents";
+
+// Tokens live in ZTOKEN, the page and anchor they are documented at in
+// ZTOKENMETAINFORMATION and ZFILEPATH. Every join is on a primary key and
+// there is no ORDER BY, so SQLite hands rows back as it walks ZTOKEN without
+// building any temporary tables.
+static NSString *const kTokenSelectStatement =
+  @"SELECT ZTOKEN.ZTOKENNAME, ZFILEPATH.ZPATH, ZTOKENMETAINFORMATION.ZANCHOR "
+  @"FROM ZTOKEN "
+  @"JOIN ZTOKENMETAINFORMATION "
+  @"ON ZTOKEN.ZMETAINFORMATION = ZTOKENMETAINFORMATION.Z_PK "
+  @"JOIN ZFILEPATH ON ZTOKENMETAINFORMATION.ZFILE = ZFILEPATH.Z_PK;";
+
+@implementation DeveloperDocumentationTokenReader
+
+@synthesize docSetName = docSetName_;
+@synthesize documentsURLString = documentsURLString_;
+
+- (id)initWithDocSetPath:(NSString *)docSetPath {
+  if ((self = [super init])) {
+    NSString *indexPath
+      = [docSetPath stringByAppendingPathComponent:kDocSetIndexPath];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    // GTMSQLiteDatabase would create an empty database if there was none.
+    if (![fm fileExistsAtPath:indexPath]) {
+      HGSLogDebug(@"No token index at %@", indexPath);
+      [self release];
+      return nil;
+    }
+    int err = SQLITE_OK;
+    database_ = [[GTMSQLiteDatabase alloc] initWithPath:indexPath
+                                        withCFAdditions:NO
+                                                   utf8:YES
+                                              errorCode:&err];
+    if (database_) {
+      statement_ = [[GTMSQLiteStatement alloc] initWithSQL:kTokenSelectStatement
+                                                inDatabase:database_
+                                                 errorCode:&err];
+    }
+    if (!statement_) {
+      HGSLog(@"Unable to read token index at %@ (%d)", indexPath, err);
+      [self release];
+      return nil;
+    }
+    NSBundle *docSetBundle = [NSBundle bundleWithPath:docSetPath];
+    NSString *name
+      = [docSetBundle objectForInfoDictionaryKey:(NSString*)kCFBundleNameKey];
+    if (!name) {
+      name = [[docSetPath lastPathComponent] stringByDeletingPathExtension];
+    }
+    docSetName_ = [name copy];
+    NSString *documentsPath
+      = [docSetPath stringByAppendingPathComponent:kDocSetDocumentsPath];
+    NSURL *documentsURL = [NSURL fileURLWithPath:documentsPath isDirectory:YES];
+    documentsURLString_ = [[documentsURL absoluteString] copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self close];
+  [docSetName_ release];
+  [documentsURLString_ release];
+  [super dealloc];
+}
+
+- (void)close {
+  [statement_ finalizeStatement];
+  [statement_ release];
+  statement_ = nil;
+  [database_ release];
+  database_ = nil;
+}
+
+- (BOOL)readTokenName:(NSString **)name uri:(NSString **)uri {
+  while ([statement_ stepRow] == SQLITE_ROW) {
+    NSString *tokenName = [statement_ resultStringAtPosition:0];
+    NSString *path = [statement_ resultStringAtPosition:1];
+    if (![tokenName length] || ![path length]) continue;
+    NSString *anchor = [statement_ resultStringAtPosition:2];
+    NSStringEncoding encoding = NSUTF8StringEncoding;
+    path = [path stringByAddingPercentEscapesUsingEncoding:encoding];
+    NSString *tokenURI = [documentsURLString_ stringByAppendingString:path];
+    if ([anchor length]) {
+      anchor = [anchor stringByAddingPercentEscapesUsingEncoding:encoding];
+      tokenURI = [NSString stringWithFormat:@"%@#%@", tokenURI, anchor];
+    }
+    if (name) *name = tokenName;
+    if (uri) *uri = tokenURI;
+    return YES;
+  }
+  [self close];
+  return NO;
+}
+
+@end
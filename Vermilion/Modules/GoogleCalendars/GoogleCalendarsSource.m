@@ -237,14 +237,18 @@ static NSString *const kGoogleCalendarEventEndTimeKey
 #pragma mark -
 #pragma mark HGSGDataServiceSource Overrides
 
-- (GDataServiceTicket *)fetchTicketForService:(GDataServiceGoogle *)service {
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context {
+  NSURL *calendarsURL
+    = [NSURL URLWithString:kGDataGoogleCalendarDefaultOwnCalendarsFeed];
   GDataServiceTicket *calendarTicket
-    = [service fetchFeedWithURL:[NSURL URLWithString:
-                                 kGDataGoogleCalendarDefaultOwnCalendarsFeed]
-                       delegate:self
-              didFinishSelector:@selector(calendarFeedTicket:
-                                          finishedWithFeed:
-                                          error:)];
+    = [self fetchFeedWithURL:calendarsURL
+                   feedClass:nil
+                deltaCapable:NO
+                     context:context
+           didFinishSelector:@selector(calendarFeedTicket:
+                                       finishedWithFeed:
+                                       error:)];
   return calendarTicket;
 }
 
@@ -259,6 +263,8 @@ static NSString *const kGoogleCalendarEventEndTimeKey
     = GTM_STATIC_CAST(HGSGDataServiceIndexContext, [ticket userData]);
   HGSAssert(context, nil);
   if (!error) {
+    // Calendars are always reindexed, as a calendar's entry doesn't change
+    // when its events do, and we need to check each one's events.
     NSArray *entries = [feed entries];
     for (GDataEntryCalendar *entry in entries) {
       if ([context isCancelled]) break;
@@ -365,16 +371,18 @@ static NSString *const kGoogleCalendarEventEndTimeKey
     [calendarQuery setMaxResults:100];
     [calendarQuery setMinimumStartTime:startOfToday];
     [calendarQuery setShouldShowDeleted:NO];
+    // The query starts today, so the feed URL changes daily and events
+    // (whose snippets say "Today" or "Tomorrow") are reindexed daily.
     GDataServiceTicket *eventTicket
-      = [[context service] fetchFeedWithQuery:calendarQuery
-                                     delegate:self
-                            didFinishSelector:@selector(eventsFetcher:
-                                                        finishedWithFeed:
-                                                        error:)];
+      = [self fetchFeedWithURL:[calendarQuery URL]
+                     feedClass:nil
+                  deltaCapable:NO
+                       context:context
+             didFinishSelector:@selector(eventsFetcher:
+                                         finishedWithFeed:
+                                         error:)];
     [calendarEntry setProperty:calendarURL forKey:kGoogleCalendarURLKey];
     [eventTicket setProperty:calendarEntry forKey:kGoogleCalendarEntryKey];
-    [eventTicket setUserData:context];
-    [context addTicket:eventTicket];
   }
 }
 
@@ -391,11 +399,14 @@ static NSString *const kGoogleCalendarEventEndTimeKey
     NSArray *eventList = [eventFeed entries];
     for (GDataEntryCalendarEvent *eventEntry in eventList) {
       if ([context isCancelled]) break;
-      GDataEntryCalendar *calendarEntry
-        = [ticket propertyForKey:kGoogleCalendarEntryKey];
-      [self indexEvent:eventEntry
-          withCalendar:calendarEntry
-             context:context];
+      if ([context beginIndexingEntry:eventEntry forTicket:ticket]) {
+        GDataEntryCalendar *calendarEntry
+          = [ticket propertyForKey:kGoogleCalendarEntryKey];
+        [self indexEvent:eventEntry
+            withCalendar:calendarEntry
+               context:context];
+        [context endIndexingEntry];
+      }
     }
   } else {
     NSString *fetchType
@@ -140,13 +140,17 @@ GTM_METHOD_CHECK(NSEnumerator,
 #pragma mark -
 #pragma mark Docs Fetching
 
-- (GDataServiceTicket *)fetchTicketForService:(GDataServiceGoogle *)service {
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context {
+  // The documents list supports updated-min, so we only get changes.
   NSURL *docURL = [GDataServiceGoogleDocs docsFeedURL];
-  return [service fetchFeedWithURL:docURL
-                          delegate:self
-                 didFinishSelector:@selector(docFeedTicket:
-                                             finishedWithFeed:
-                                             error:)];
+  return [self fetchFeedWithURL:docURL
+                      feedClass:nil
+                   deltaCapable:YES
+                        context:context
+              didFinishSelector:@selector(docFeedTicket:
+                                          finishedWithFeed:
+                                          error:)];
 }
 
 - (Class)serviceClass {
@@ -164,7 +168,10 @@ GTM_METHOD_CHECK(NSEnumerator,
     NSArray *docs = [docFeed entries];
     for (GDataEntryBase *doc in docs) {
       if ([context isCancelled]) break;
-      [self indexDoc:doc context:context];
+      if ([context beginIndexingEntry:doc forTicket:ticket]) {
+        [self indexDoc:doc context:context];
+        [context endIndexingEntry];
+      }
     }
   } else {
     NSString *fetchType = HGSLocalizedString(@"doc",
@@ -148,8 +148,9 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
 #pragma mark -
 #pragma mark HGSGDataServiceSource Overrides
 
-- (GDataServiceTicket *)fetchTicketForService:(GDataServiceGoogle *)service {
-  NSString *userName = [service username];
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context {
+  NSString *userName = [[context service] username];
   NSURL* albumFeedURL
     = [GDataServiceGooglePhotos photoFeedURLForUserID:userName
                                               albumID:nil
@@ -158,11 +159,13 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
                                                  kind:nil
                                                access:nil];
   GDataServiceTicket *albumFetchTicket
-    = [service fetchFeedWithURL:albumFeedURL
-                       delegate:self
-              didFinishSelector:@selector(albumInfoFetcher:
-                                          finishedWithAlbum:
-                                          error:)];
+    = [self fetchFeedWithURL:albumFeedURL
+                   feedClass:nil
+                deltaCapable:NO
+                     context:context
+           didFinishSelector:@selector(albumInfoFetcher:
+                                       finishedWithAlbum:
+                                       error:)];
   return albumFetchTicket;
 }
 
@@ -240,19 +243,19 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
                                name:albumTitle
                           otherTerm:albumDescription];
 
-    // Now index the photos in the album.
+    // Now index the photos in the album. An album's updated date changes
+    // with its photos, so while the album is unchanged so are they.
     NSURL *photoInfoFeedURL = [[album feedLink] URL];
     if (photoInfoFeedURL) {
-      GDataServiceGoogle *service = [context service];
       GDataServiceTicket *photoInfoTicket
-        = [service fetchFeedWithURL:photoInfoFeedURL
-                           delegate:self
-                  didFinishSelector:@selector(photoInfoFetcher:
-                                              finishedWithPhoto:
-                                              error:)];
+        = [self fetchFeedWithURL:photoInfoFeedURL
+                       feedClass:nil
+                    deltaCapable:NO
+                         context:context
+               didFinishSelector:@selector(photoInfoFetcher:
+                                           finishedWithPhoto:
+                                           error:)];
       [photoInfoTicket setProperty:album forKey:kPhotosAlbumKey];
-      [photoInfoTicket setUserData:context];
-      [context addTicket:photoInfoTicket];
     }
   }
 }
@@ -266,7 +269,10 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
   if (!error) {
     for (GDataEntryPhotoAlbum* album in [albumFeed entries]) {
       if ([context isCancelled]) break;
-      [self indexAlbum:album context:context];
+      if ([context beginIndexingEntry:album forTicket:ticket]) {
+        [self indexAlbum:album context:context];
+        [context endIndexingEntry];
+      }
     }
   } else {
     NSString *fetchType = HGSLocalizedString(@"album",
@@ -379,8 +385,11 @@ GTM_METHOD_CHECK(NSString, gtm_stringByEscapingForURLArgument);
     NSArray *photoList = [photoFeed entries];
     for (GDataEntryPhoto *photo in photoList) {
       if ([context isCancelled]) break;
-      GDataEntryPhotoAlbum *album = [ticket propertyForKey:kPhotosAlbumKey];
-      [self indexPhoto:photo withAlbum:album context:context];
+      if ([context beginIndexingEntry:photo forTicket:ticket]) {
+        GDataEntryPhotoAlbum *album = [ticket propertyForKey:kPhotosAlbumKey];
+        [self indexPhoto:photo withAlbum:album context:context];
+        [context endIndexingEntry];
+      }
     }
   } else {
     NSString *fetchType = HGSLocalizedString(@"photo",
@@ -30,7 +30,8 @@
 //  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
-// Shortcuts stores things in our user defaults.
+// Shortcuts stores things in a SQLite database in our application support
+// folder, one row per shortcut.
 // The top level is a dictionary keyed by "shortcut" where a shortcut is the
 // series of characters entered by the user for them to get a object (i.e.
 // 'ipho' could correspond to iPhoto. The value associated with the key is
@@ -58,6 +59,7 @@
 #import <GTM/GTMMethodCheck.h>
 #import <GTM/GTMExceptionalInlines.h>
 #import <GTM/GTMTypeCasting.h>
+#import "GTMSQLite.h"
 
 static NSString *const kHGSShortcutsDictionaryKey
   = @"kHGSShortcutsDictionaryKey";
@@ -68,7 +70,25 @@ static NSString *const kHGSShortcutsSourceIdentifierKey
 
 // The current version of the shortcuts DB. If you change how things are stored
 // in the shortcuts DB, you will have to change this.
-static NSString* const kHGSShortcutsVersion = @"0.93";
+static NSString* const kHGSShortcutsVersion = @"0.94";
+
+// The version used by the plist we stored shortcuts in before we moved
+// to SQLite.
+static NSString* const kHGSShortcutsLegacyVersion = @"0.93";
+
+// Each row holds the original shortcut string, the archived
+// HGSTokenizedString (so we don't have to tokenize at startup) and the
+// array of archived results as a binary plist.
+static NSString* const kShortcutsSchema 
+  = @"CREATE TABLE IF NOT EXISTS shortcuts ("
+    @"  shortcut TEXT PRIMARY KEY,"
+    @"  tokenized BLOB,"
+    @"  entries BLOB)";
+static NSString* const kShortcutsMetaDataSchema 
+  = @"CREATE TABLE IF NOT EXISTS metadata ("
+    @"  key TEXT PRIMARY KEY,"
+    @"  value TEXT)";
+static NSString* const kShortcutsMetaDataVersionKey = @"version";
 
 // Maximum number of entries per shortcut.
 static const unsigned int kMaxEntriesPerShortcut = 3;
@@ -80,8 +100,20 @@ static const unsigned int kMaxEntriesPerShortcut = 3;
   // Each object in the array is an NSDictionary representing a single
   // HGSResult.
   NSMutableDictionary *shortcuts_;
+  // The keys of shortcuts_ indexed by the first character of each of their
+  // tokenized words. HGSScoreTermForItem only starts matching a term at the
+  // start of a word, so these are the only keys that can match a query
+  // starting with that character.
+  NSMutableDictionary *wordStartIndex_;
+  // HGSResults we have already unarchived from shortcuts_, keyed by
+  // identifier.
+  NSMutableDictionary *unarchivedResults_;
   NSString *shortcutsFilePath_;
-  BOOL dirty_;
+  GTMSQLiteDatabase *db_;
+  // Shortcuts that have changed since we last wrote to db_.
+  NSMutableSet *dirtyShortcuts_;
+  // The last write we queued up. Writes have to land in order.
+  NSOperation *writeOperation_;
   NSTimer *writeShortcutsTimer_;
 }
 
@@ -95,13 +127,20 @@ static const unsigned int kMaxEntriesPerShortcut = 3;
 // Remove the given identifier for the shortcut.
 - (void)removeIdentifier:(NSString *)identifier
              forShortcut:(HGSTokenizedString *)shortcut;
+- (void)indexShortcut:(HGSTokenizedString *)shortcut;
+- (void)unindexShortcut:(HGSTokenizedString *)shortcut;
+- (HGSResult *)resultForArchive:(NSDictionary *)resultEntry;
 - (void)writeShortcuts:(NSTimer *)timer;
 - (NSDictionary *)readShortcuts:(NSString *)path;
+- (BOOL)openDatabaseAtPath:(NSString *)path;
+- (NSDictionary *)readLegacyShortcuts:(NSString *)path;
+- (void)commitShortcutRows:(NSArray *)rows;
 
 // Notifications
 - (void)qsbActionPresenterWillPivot:(NSNotification *)notification;
 - (void)qsbActionPresenterWillPerformAction:(NSNotification *)notification;
 - (void)updateShortcut:(NSNotification *)notification;
+- (void)extensionPointDidRemoveExtension:(NSNotification *)notification;
 
 @end
 
@@ -116,6 +155,26 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   return NSOrderedSame;
 }
 
+// The wordStartIndex_ keys for the first character of each word in
+// |shortcut|.
+static NSSet *WordStartKeys(HGSTokenizedString *shortcut) {
+  NSMutableSet *keys = [NSMutableSet set];
+  NSString *tokenizedString = [shortcut tokenizedString];
+  NSUInteger length = [tokenizedString length];
+  unichar separator = [HGSTokenizer tokenizerSeparator];
+  BOOL atWordStart = YES;
+  for (NSUInteger i = 0; i < length; ++i) {
+    unichar c = [tokenizedString characterAtIndex:i];
+    if (c == separator) {
+      atWordStart = YES;
+    } else if (atWordStart) {
+      atWordStart = NO;
+      [keys addObject:[NSNumber numberWithUnsignedShort:c]];
+    }
+  }
+  return keys;
+}
+
 @implementation ShortcutsSource
 
 - (id)initWithConfiguration:(NSDictionary *)configuration {
@@ -127,7 +186,8 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
     id<HGSDelegate> delegate = [[HGSPluginLoader sharedPluginLoader] delegate];
     NSString *appSupportPath = [delegate userApplicationSupportFolderForApp];
     shortcutsFilePath_
-      = [[appSupportPath stringByAppendingPathComponent:@"shortcuts.db"] retain];
+      = [[appSupportPath stringByAppendingPathComponent:@"shortcuts.sqlite"] 
+         retain];
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc addObserver:self
            selector:@selector(qsbActionPresenterWillPivot:)
@@ -141,8 +201,18 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
            selector:@selector(updateShortcut:)
                name:kShortcutsUpdateShortcutNotification
              object:nil];
+    [nc addObserver:self
+           selector:@selector(extensionPointDidRemoveExtension:)
+               name:kHGSExtensionPointDidRemoveExtensionNotification
+             object:[HGSExtensionPoint sourcesPoint]];
 #endif
+    dirtyShortcuts_ = [[NSMutableSet alloc] init];
     shortcuts_ = [[self readShortcuts:shortcutsFilePath_] retain];
+    wordStartIndex_ = [[NSMutableDictionary alloc] init];
+    unarchivedResults_ = [[NSMutableDictionary alloc] init];
+    for (HGSTokenizedString *shortcut in shortcuts_) {
+      [self indexShortcut:shortcut];
+    }
     writeShortcutsTimer_
       = [[NSTimer scheduledTimerWithTimeInterval:300
                                           target:self
@@ -159,7 +229,12 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   [writeShortcutsTimer_ release];
   [nc removeObserver:self];
   [shortcuts_ release];
+  [wordStartIndex_ release];
+  [unarchivedResults_ release];
   [shortcutsFilePath_ release];
+  [dirtyShortcuts_ release];
+  [writeOperation_ release];
+  [db_ release];
   [super dealloc];
 }
 
@@ -203,6 +278,45 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   return result;
 }
 
+// Must be called with shortcuts_ locked.
+- (HGSResult *)resultForArchive:(NSDictionary *)resultEntry {
+  NSString *identifier = [resultEntry objectForKey:kHGSObjectAttributeURIKey];
+  HGSResult *result = nil;
+  if (identifier) {
+    result = [unarchivedResults_ objectForKey:identifier];
+  }
+  if (!result) {
+    result = [self unarchiveResult:resultEntry];
+    if (result && identifier) {
+      [unarchivedResults_ setObject:result forKey:identifier];
+    }
+  }
+  return result;
+}
+
+// Must be called with shortcuts_ locked.
+- (void)indexShortcut:(HGSTokenizedString *)shortcut {
+  for (NSNumber *key in WordStartKeys(shortcut)) {
+    NSMutableSet *shortcuts = [wordStartIndex_ objectForKey:key];
+    if (!shortcuts) {
+      shortcuts = [NSMutableSet set];
+      [wordStartIndex_ setObject:shortcuts forKey:key];
+    }
+    [shortcuts addObject:shortcut];
+  }
+}
+
+// Must be called with shortcuts_ locked.
+- (void)unindexShortcut:(HGSTokenizedString *)shortcut {
+  for (NSNumber *key in WordStartKeys(shortcut)) {
+    NSMutableSet *shortcuts = [wordStartIndex_ objectForKey:key];
+    [shortcuts removeObject:shortcut];
+    if (shortcuts && ![shortcuts count]) {
+      [wordStartIndex_ removeObjectForKey:key];
+    }
+  }
+}
+
 - (NSDictionary *)archiveResult:(HGSScoredResult *)result {
   NSMutableDictionary *archive = nil;
   HGSSearchSource *source = [result source];
@@ -252,9 +366,12 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
     // Only perform the insertion/update if the current index changed
     // or if the array doesn't exist yet.
     if (!valueArray || newIndex != currentIndex) {
+      // Whatever we had unarchived for this identifier is out of date now.
+      [unarchivedResults_ removeObjectForKey:identifier];
       if (!valueArray) {
         valueArray = [NSMutableArray arrayWithObject:archiveDict];
         [shortcuts_ setObject:valueArray forKey:shortcut];
+        [self indexShortcut:shortcut];
       } else {
         if (currentIndex < [valueArray count]) {
           [valueArray removeObjectAtIndex:currentIndex];
@@ -273,7 +390,7 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
                            [valueArray count] - kMaxEntriesPerShortcut);
         [valueArray removeObjectsInRange:toRemove];
       }
-      dirty_ = YES;
+      [dirtyShortcuts_ addObject:shortcut];
       HGSLogDebug(@"Shortcut recorded: %@ = %@", shortcut, result);
     }
 
@@ -283,14 +400,20 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
 
 - (void)removeIdentifier:(NSString *)identifier
              forShortcut:(HGSTokenizedString *)shortcut {
-  NSString *tokenizedShortcut = [shortcut tokenizedString];
   @synchronized (shortcuts_) {
-    NSMutableArray *shortcutArray = [shortcuts_ objectForKey:tokenizedShortcut];
+    NSMutableArray *shortcutArray = [shortcuts_ objectForKey:shortcut];
     NSUInteger idx = [self indexOfResultWithIdentifier:identifier
                                              fromArray:shortcutArray];
     if (idx != NSNotFound) {
         [shortcutArray removeObjectAtIndex:idx];
-        dirty_ = YES;
+        [unarchivedResults_ removeObjectForKey:identifier];
+        [dirtyShortcuts_ addObject:shortcut];
+        // A shortcut with nothing left in it can never match, so stop
+        // looking at it. writeShortcuts: deletes its row.
+        if (![shortcutArray count]) {
+          [shortcuts_ removeObjectForKey:shortcut];
+          [self unindexShortcut:shortcut];
+        }
     }
   }
 }
@@ -304,15 +427,24 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
 
 - (NSArray *)rankedObjectsForShortcut:(HGSTokenizedString *)shortcut {
   NSMutableArray *results = [NSMutableArray array];
+  NSString *term = [shortcut tokenizedString];
+  if (![term length]) return results;
+  NSNumber *firstChar 
+    = [NSNumber numberWithUnsignedShort:[term characterAtIndex:0]];
+  // Index into results for each identifier we have added, so that we can
+  // de-dupe without scanning results.
+  NSMutableDictionary *resultIndexes = [NSMutableDictionary dictionary];
   @synchronized(shortcuts_) {
-    for (HGSTokenizedString *key in [shortcuts_ allKeys]) {
+    NSArray *candidates = [[wordStartIndex_ objectForKey:firstChar] allObjects];
+    for (HGSTokenizedString *key in candidates) {
       NSIndexSet *matchedIndexes = nil;
       CGFloat score = HGSScoreTermForItem(shortcut, key, &matchedIndexes);
       if (score > 0.0) {
         NSArray *resultArray = [shortcuts_ objectForKey:key];
+        NSMutableArray *badIdentifiers = nil;
         CGFloat base = 1.0;
         for (NSDictionary *resultDict in resultArray) {
-          HGSResult *result = [self unarchiveResult:resultDict];
+          HGSResult *result = [self resultForArchive:resultDict];
 
           // If we have an action, check to see if it can be displayed right
           // now.
@@ -341,18 +473,39 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
             // want to remove them from our shortcuts.
             NSString *status
               = [result valueForKey:kHGSObjectAttributeStatusKey];
-            if (![status isEqualToString:kHGSObjectStatusStaleValue]
-                && [results indexOfObject:scoredResult] == NSNotFound) {
-              [results addObject:scoredResult];
+            if (![status isEqualToString:kHGSObjectStatusStaleValue]) {
+              NSString *uri = [result uri];
+              NSNumber *resultIndex = [resultIndexes objectForKey:uri];
+              if (!resultIndex) {
+                NSUInteger count = [results count];
+                resultIndex = [NSNumber numberWithUnsignedInteger:count];
+                [resultIndexes setObject:resultIndex forKey:uri];
+                [results addObject:scoredResult];
+              } else {
+                // The same result is under more than one matching shortcut.
+                // Keep the best scoring one.
+                NSUInteger idx = [resultIndex unsignedIntegerValue];
+                HGSScoredResult *existing = [results objectAtIndex:idx];
+                if ([scoredResult score] > [existing score]) {
+                  [results replaceObjectAtIndex:idx withObject:scoredResult];
+                }
+              }
             }
           } else {
             NSString *identifier
               = [resultDict objectForKey:kHGSObjectAttributeURIKey];
             if (identifier) {
-              [self removeIdentifier:identifier forShortcut:shortcut];
+              if (!badIdentifiers) {
+                badIdentifiers = [NSMutableArray array];
+              }
+              [badIdentifiers addObject:identifier];
             }
           }
         }
+        // Can't mutate resultArray while we are enumerating it.
+        for (NSString *identifier in badIdentifiers) {
+          [self removeIdentifier:identifier forShortcut:key];
+        }
       }
     }
   }
@@ -367,6 +520,8 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   [defaults synchronize];
 
   [shortcuts_ removeAllObjects];
+  [wordStartIndex_ removeAllObjects];
+  [unarchivedResults_ removeAllObjects];
 }
 
 #else
@@ -442,42 +597,259 @@ static inline NSInteger KeyLength(NSString *a, NSString *b, void *c) {
   [super uninstall];
 }
 
+- (void)extensionPointDidRemoveExtension:(NSNotification *)notification {
+  // Results from sources that have gone away must be unarchived again (and
+  // will fail to be) rather than handed out from our cache.
+  @synchronized(shortcuts_) {
+    [unarchivedResults_ removeAllObjects];
+  }
+}
+
+- (BOOL)openDatabaseAtPath:(NSString *)path {
+  NSString *directory = [path stringByDeletingLastPathComponent];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSError *error = nil;
+  if (![fm fileExistsAtPath:directory]
+      && ![fm createDirectoryAtPath:directory
+        withIntermediateDirectories:YES
+                         attributes:nil
+                              error:&error]) {
+    HGSLog(@"Unable to create directory: %@", error);
+    return NO;
+  }
+  int errorCode = SQLITE_OK;
+  db_ = [[GTMSQLiteDatabase alloc] initWithPath:path
+                                withCFAdditions:NO
+                                           utf8:YES
+                                      errorCode:&errorCode];
+  if (errorCode != SQLITE_OK && errorCode != SQLITE_DONE) {
+    HGSLog(@"Unable to open shortcuts database %@: %d", path, errorCode);
+    [db_ release];
+    db_ = nil;
+    return NO;
+  }
+  // Has to happen before any tables are created. Lets us hand space from
+  // deleted shortcuts back in the background instead of vacuuming.
+  [db_ executeSQL:@"PRAGMA auto_vacuum = INCREMENTAL"];
+  if ([db_ executeSQL:kShortcutsSchema] != SQLITE_OK
+      || [db_ executeSQL:kShortcutsMetaDataSchema] != SQLITE_OK) {
+    HGSLog(@"Unable to create shortcuts tables: %@", [db_ lastErrorString]);
+    [db_ release];
+    db_ = nil;
+    return NO;
+  }
+  
+  GTMSQLiteStatement *statement
+    = [GTMSQLiteStatement statementWithSQL:@"SELECT value FROM metadata "
+                                           @"WHERE key = ?"
+                                inDatabase:db_
+                                 errorCode:&errorCode];
+  [statement bindStringAtPosition:1 string:kShortcutsMetaDataVersionKey];
+  NSString *version = nil;
+  if ([statement stepRow] == SQLITE_ROW) {
+    version = [statement resultStringAtPosition:0];
+  }
+  [statement finalizeStatement];
+  if (![version isEqualToString:kHGSShortcutsVersion]) {
+    [db_ executeSQL:@"DELETE FROM shortcuts"];
+    statement 
+      = [GTMSQLiteStatement statementWithSQL:@"INSERT OR REPLACE INTO "
+                                             @"metadata VALUES(?, ?)"
+                                  inDatabase:db_
+                                   errorCode:&errorCode];
+    [statement bindStringAtPosition:1 string:kShortcutsMetaDataVersionKey];
+    [statement bindStringAtPosition:2 string:kHGSShortcutsVersion];
+    if ([statement stepRow] == SQLITE_ERROR) {
+      HGSLog(@"Unable to set shortcuts version: %@", [db_ lastErrorString]);
+    }
+    [statement finalizeStatement];
+  }
+  return YES;
+}
+
 - (NSDictionary *)readShortcuts:(NSString *)path {
+  NSMutableDictionary *shortcuts = [NSMutableDictionary dictionary];
+  @synchronized(self) {
+    if (![self openDatabaseAtPath:path]) {
+      return shortcuts;
+    }
+    int errorCode = SQLITE_OK;
+    GTMSQLiteStatement *statement
+      = [GTMSQLiteStatement statementWithSQL:@"SELECT shortcut, tokenized, "
+                                             @"entries FROM shortcuts"
+                                  inDatabase:db_
+                                   errorCode:&errorCode];
+    while ([statement stepRow] == SQLITE_ROW) {
+      NSString *string = [statement resultStringAtPosition:0];
+      NSData *tokenizedData = [statement resultBlobDataAtPosition:1];
+      NSData *entriesData = [statement resultBlobDataAtPosition:2];
+      HGSTokenizedString *tokenizedString = nil;
+      @try {
+        tokenizedString 
+          = [NSKeyedUnarchiver unarchiveObjectWithData:tokenizedData];
+      }
+      @catch (NSException *e) {
+        HGSLog(@"Unable to unarchive shortcut %@ (%@)", string, e);
+      }
+      if (![tokenizedString isKindOfClass:[HGSTokenizedString class]]) {
+        tokenizedString = [HGSTokenizer tokenizeString:string];
+      }
+      NSMutableArray *entries = nil;
+      if (entriesData) {
+        entries 
+          = [NSPropertyListSerialization 
+             propertyListFromData:entriesData
+                 mutabilityOption:NSPropertyListMutableContainers
+                           format:NULL
+                 errorDescription:NULL];
+      }
+      if (tokenizedString && [entries isKindOfClass:[NSMutableArray class]]) {
+        [shortcuts setObject:entries forKey:tokenizedString];
+      }
+    }
+    [statement finalizeStatement];
+  }
+  
+  if (![shortcuts count]) {
+    // Pull in anything stored in the plist we used to keep shortcuts in, and
+    // write it all out in the new format.
+    NSString *directory = [path stringByDeletingLastPathComponent];
+    NSString *legacyPath 
+      = [directory stringByAppendingPathComponent:@"shortcuts.db"];
+    NSDictionary *legacyShortcuts = [self readLegacyShortcuts:legacyPath];
+    if ([legacyShortcuts count]) {
+      NSMutableArray *rows 
+        = [NSMutableArray arrayWithCapacity:[legacyShortcuts count]];
+      for (HGSTokenizedString *shortcut in legacyShortcuts) {
+        NSArray *entries = [legacyShortcuts objectForKey:shortcut];
+        [rows addObject:[NSArray arrayWithObjects:shortcut, entries, nil]];
+      }
+      [self commitShortcutRows:rows];
+      [shortcuts addEntriesFromDictionary:legacyShortcuts];
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:legacyPath error:nil];
+  }
+  return shortcuts;
+}
+
+- (NSDictionary *)readLegacyShortcuts:(NSString *)path {
   NSMutableDictionary *fileContents
-    = [NSMutableDictionary dictionaryWithContentsOfFile:shortcutsFilePath_];
+    = [NSMutableDictionary dictionaryWithContentsOfFile:path];
   NSString *vers = [fileContents objectForKey:kHGSShortcutsVersionStringKey];
   NSDictionary *storedData = [fileContents objectForKey:kHGSShortcutsDictionaryKey];
   NSMutableDictionary *shortcuts = [NSMutableDictionary dictionary];
-  if ([vers isEqualToString:kHGSShortcutsVersion] && storedData) {
+  if ([vers isEqualToString:kHGSShortcutsLegacyVersion] && storedData) {
     for (NSString *identifier in storedData) {
       HGSTokenizedString *tokenizedID = [HGSTokenizer tokenizeString:identifier];
-      NSArray *values = [storedData objectForKey:identifier];
+      NSMutableArray *values 
+        = [[[storedData objectForKey:identifier] mutableCopy] autorelease];
       [shortcuts setObject:values forKey:tokenizedID];
     }
   }
   return shortcuts;
 }
 
+// Only the shortcuts that have changed since the last write are written out.
+// Called from the timer the actual writing is done on the operation queue so
+// it doesn't hold up the main thread.
 - (void)writeShortcuts:(NSTimer *)timer {
-  NSMutableDictionary *shortCutData = nil;
+  NSMutableArray *rows = nil;
   @synchronized(shortcuts_) {
-    if (dirty_) {
-      shortCutData = [NSMutableDictionary dictionary];
-      for (HGSTokenizedString *tokenizedString in shortcuts_) {
-        NSString *string = [tokenizedString tokenizedString];
-        NSArray *valueArray = [shortcuts_ objectForKey:tokenizedString];
-        [shortCutData setObject:valueArray forKey:string];
+    if ([dirtyShortcuts_ count]) {
+      rows = [NSMutableArray arrayWithCapacity:[dirtyShortcuts_ count]];
+      for (HGSTokenizedString *shortcut in dirtyShortcuts_) {
+        NSArray *entries = [shortcuts_ objectForKey:shortcut];
+        // The entries are mutated under the lock, so hand off a copy.
+        entries = entries ? [NSArray arrayWithArray:entries] : [NSArray array];
+        [rows addObject:[NSArray arrayWithObjects:shortcut, entries, nil]];
+      }
+      [dirtyShortcuts_ removeAllObjects];
+    }
+  }
+  if (rows) {
+    if (timer) {
+      HGSInvocationOperation *op 
+        = [[[HGSInvocationOperation alloc] 
+            initWithTarget:self
+                  selector:@selector(commitShortcutRows:)
+                    object:rows] autorelease];
+      if (writeOperation_ && ![writeOperation_ isFinished]) {
+        [op addDependency:writeOperation_];
       }
+      [writeOperation_ release];
+      writeOperation_ = [op retain];
+      [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+    } else {
+      [writeOperation_ waitUntilFinished];
+      [self commitShortcutRows:rows];
     }
-    if (shortCutData) {
-      NSDictionary *fileData = [NSDictionary dictionaryWithObjectsAndKeys:
-        shortCutData, kHGSShortcutsDictionaryKey,
-        kHGSShortcutsVersion, kHGSShortcutsVersionStringKey,
-        nil];
-      if (![fileData writeToFile:shortcutsFilePath_ atomically:YES]) {
-        HGSLog(@"Unable to write shortcuts to %@", shortcutsFilePath_);
+  }
+}
+
+// Each row is an array of the HGSTokenizedString shortcut and its entries.
+// Shortcuts with no entries left are deleted.
+- (void)commitShortcutRows:(NSArray *)rows {
+  @synchronized(self) {
+    if (!db_) return;
+    int errorCode = SQLITE_OK;
+    GTMSQLiteStatement *insertStatement
+      = [GTMSQLiteStatement statementWithSQL:@"INSERT OR REPLACE INTO "
+                                             @"shortcuts VALUES(?, ?, ?)"
+                                  inDatabase:db_
+                                   errorCode:&errorCode];
+    GTMSQLiteStatement *deleteStatement
+      = [GTMSQLiteStatement statementWithSQL:@"DELETE FROM shortcuts "
+                                             @"WHERE shortcut = ?"
+                                  inDatabase:db_
+                                   errorCode:&errorCode];
+    BOOL deleted = NO;
+    BOOL goodWrite = YES;
+    [db_ beginDeferredTransaction];
+    for (NSArray *row in rows) {
+      HGSTokenizedString *shortcut = [row objectAtIndex:0];
+      NSArray *entries = [row objectAtIndex:1];
+      NSString *string = [shortcut originalString];
+      int stepResult;
+      if ([entries count]) {
+        NSData *tokenizedData 
+          = [NSKeyedArchiver archivedDataWithRootObject:shortcut];
+        NSData *entriesData 
+          = [NSPropertyListSerialization 
+             dataFromPropertyList:entries
+                           format:NSPropertyListBinaryFormat_v1_0
+                 errorDescription:NULL];
+        [insertStatement bindStringAtPosition:1 string:string];
+        [insertStatement bindBlobAtPosition:2 data:tokenizedData];
+        [insertStatement bindBlobAtPosition:3 data:entriesData];
+        stepResult = [insertStatement stepRow];
+        [insertStatement reset];
       } else {
-        dirty_ = NO;
+        [deleteStatement bindStringAtPosition:1 string:string];
+        stepResult = [deleteStatement stepRow];
+        [deleteStatement reset];
+        deleted = YES;
+      }
+      if (stepResult == SQLITE_ERROR) {
+        goodWrite = NO;
+        break;
+      }
+    }
+    [insertStatement finalizeStatement];
+    [deleteStatement finalizeStatement];
+    if (goodWrite) {
+      [db_ commit];
+      if (deleted) {
+        [db_ executeSQL:@"PRAGMA incremental_vacuum"];
+      }
+    } else {
+      HGSLog(@"Unable to write shortcuts to %@: %@", 
+             shortcutsFilePath_, [db_ lastErrorString]);
+      [db_ rollback];
+      // Try again next time around.
+      @synchronized(shortcuts_) {
+        for (NSArray *row in rows) {
+          [dirtyShortcuts_ addObject:[row objectAtIndex:0]];
+        }
       }
     }
   }
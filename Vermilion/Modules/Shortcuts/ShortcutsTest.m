@@ -135,15 +135,42 @@
 
 @end
 
+// Keeps a shortcuts database in a folder of our choosing.
+@interface ShortcutTestDelegate : HGSUnitTestingDelegate
+@end
+
+@implementation ShortcutTestDelegate
+
+- (NSString*)userApplicationSupportFolderForApp {
+  return [self path];
+}
+
+@end
+
 #pragma mark -
 #pragma mark Actual Test Code
 
+// ShortcutsSource isn't visible to the tests.
+@interface HGSSearchSource (ShortcutsSourceTesting)
+- (BOOL)updateShortcutForTokenizedString:(HGSTokenizedString *)shortcut
+                        withRankedResult:(HGSScoredResult *)result;
+- (NSArray *)rankedObjectsForShortcut:(HGSTokenizedString *)shortcut;
+- (void)removeIdentifier:(NSString *)identifier
+             forShortcut:(HGSTokenizedString *)shortcut;
+- (void)writeShortcuts:(NSTimer *)timer;
+@end
+
 @interface ShortcutsSourceTest : HGSSearchSourceAbstractTestCase {
  @private
   BOOL foundResult_;
 }
 - (void)emptyResults:(NSNotification *)notification;
 - (void)singlePivotDidUpdateResultsNotification:(NSNotification *)notification;
+- (NSString *)emptyFolderNamed:(NSString *)name;
+- (HGSSearchSource *)shortcutsSourceInFolder:(NSString *)folder;
+- (HGSScoredResult *)resultNamed:(NSString *)name;
+- (NSArray *)URIsForShortcut:(NSString *)shortcut
+                  fromSource:(HGSSearchSource *)source;
 @end
 
 @implementation ShortcutsSourceTest
@@ -249,12 +276,255 @@
   foundResult_ = YES;
 }
 
+- (void)testWordStartMatching {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSString *resultPath = [bundle pathForResource:@"SampleContact" 
+                                          ofType:@"abcdp"];
+  HGSSearchSource *source = [HGSUnitTestingSource sourceWithBundle:bundle];
+  HGSScoredResult *scoredResult = [HGSScoredResult resultWithFilePath:resultPath 
+                                                               source:source
+                                                           attributes:nil
+                                                                score:0
+                                                                flags:0
+                                                          matchedTerm:nil 
+                                                       matchedIndexes:nil];
+  STAssertNotNil(scoredResult, nil);
+  HGSSearchSource *shortcuts = [self source];
+  HGSTokenizedString *shortcut 
+    = [HGSTokenizer tokenizeString:@"wordstart zebra crossing"];
+  STAssertTrue([shortcuts updateShortcutForTokenizedString:shortcut
+                                          withRankedResult:scoredResult], nil);
+  // Recording it twice shouldn't give us two results.
+  STAssertTrue([shortcuts updateShortcutForTokenizedString:shortcut
+                                          withRankedResult:scoredResult], nil);
+  
+  NSArray *matches = [NSArray arrayWithObjects:@"wordst", @"zeb", @"cross", 
+                      @"zc", nil];
+  for (NSString *match in matches) {
+    HGSTokenizedString *query = [HGSTokenizer tokenizeString:match];
+    NSArray *results = [shortcuts rankedObjectsForShortcut:query];
+    STAssertEquals([results count], (NSUInteger)1, @"%@", match);
+  }
+  NSArray *misses = [NSArray arrayWithObjects:@"ebra", @"rossing", @"q", nil];
+  for (NSString *miss in misses) {
+    HGSTokenizedString *query = [HGSTokenizer tokenizeString:miss];
+    NSArray *results = [shortcuts rankedObjectsForShortcut:query];
+    STAssertEquals([results count], (NSUInteger)0, @"%@", miss);
+  }
+}
+
+- (void)testRemovingShortcut {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  HGSSearchSource *source = [HGSUnitTestingSource sourceWithBundle:bundle];
+  HGSScoredResult *scoredResult 
+    = [HGSScoredResult resultWithURI:@"http://shortcuts.test/removed"
+                                name:@"Removed"
+                                type:kHGSTypeWebpage
+                              source:source
+                          attributes:nil
+                               score:0
+                               flags:0
+                         matchedTerm:nil 
+                      matchedIndexes:nil];
+  HGSSearchSource *shortcuts = [self source];
+  HGSTokenizedString *shortcut = [HGSTokenizer tokenizeString:@"xylo quartz"];
+  STAssertTrue([shortcuts updateShortcutForTokenizedString:shortcut
+                                          withRankedResult:scoredResult], nil);
+  NSDictionary *wordStartIndex = [shortcuts valueForKey:@"wordStartIndex_"];
+  NSNumber *x = [NSNumber numberWithUnsignedShort:'x'];
+  NSNumber *q = [NSNumber numberWithUnsignedShort:'q'];
+  STAssertTrue([[wordStartIndex objectForKey:x] containsObject:shortcut], nil);
+  STAssertTrue([[wordStartIndex objectForKey:q] containsObject:shortcut], nil);
+  
+  // Once the last result is gone the shortcut is dropped from the index.
+  [shortcuts removeIdentifier:[scoredResult uri] forShortcut:shortcut];
+  STAssertFalse([[wordStartIndex objectForKey:x] containsObject:shortcut], nil);
+  STAssertFalse([[wordStartIndex objectForKey:q] containsObject:shortcut], nil);
+  HGSTokenizedString *query = [HGSTokenizer tokenizeString:@"xyl"];
+  NSArray *results = [shortcuts rankedObjectsForShortcut:query];
+  STAssertEquals([results count], (NSUInteger)0, nil);
+  
+  // And comes back if it is used again.
+  STAssertTrue([shortcuts updateShortcutForTokenizedString:shortcut
+                                          withRankedResult:scoredResult], nil);
+  results = [shortcuts rankedObjectsForShortcut:query];
+  STAssertEquals([results count], (NSUInteger)1, nil);
+}
+
+- (NSString *)emptyFolderNamed:(NSString *)name {
+  NSString *folder 
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"ShortcutsTest-%d-%@",
+        [[NSProcessInfo processInfo] processIdentifier], name]];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  [fm removeItemAtPath:folder error:nil];
+  STAssertTrue([fm createDirectoryAtPath:folder
+             withIntermediateDirectories:YES
+                              attributes:nil
+                                   error:nil], nil);
+  return folder;
+}
+
+// A second ShortcutsSource, separate from [self source], that keeps its
+// database in |folder|. Has to be uninstalled when the test is done with it.
+- (HGSSearchSource *)shortcutsSourceInFolder:(NSString *)folder {
+  HGSPluginLoader *loader = [HGSPluginLoader sharedPluginLoader];
+  id oldDelegate = [loader delegate];
+  ShortcutTestDelegate *delegate 
+    = [[[ShortcutTestDelegate alloc] initWithPath:folder] autorelease];
+  [loader setDelegate:delegate];
+  NSDictionary *config 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [[self source] bundle], kHGSExtensionBundleKey,
+       @"com.google.qsb.shortcuts.source.test", kHGSExtensionIdentifierKey,
+       nil];
+  HGSSearchSource *source
+    = [[[[[self source] class] alloc] initWithConfiguration:config] 
+       autorelease];
+  [loader setDelegate:oldDelegate];
+  STAssertNotNil(source, nil);
+  return source;
+}
+
+- (HGSScoredResult *)resultNamed:(NSString *)name {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  HGSSearchSource *source = [HGSUnitTestingSource sourceWithBundle:bundle];
+  NSString *uri = [@"http://shortcuts.test/" stringByAppendingString:name];
+  return [HGSScoredResult resultWithURI:uri
+                                   name:name
+                                   type:kHGSTypeWebpage
+                                 source:source
+                             attributes:nil
+                                  score:0
+                                  flags:0
+                            matchedTerm:nil 
+                         matchedIndexes:nil];
+}
+
+- (NSArray *)URIsForShortcut:(NSString *)shortcut
+                  fromSource:(HGSSearchSource *)source {
+  HGSTokenizedString *query = [HGSTokenizer tokenizeString:shortcut];
+  NSArray *results = [source rankedObjectsForShortcut:query];
+  NSMutableArray *uris = [NSMutableArray arrayWithCapacity:[results count]];
+  for (HGSScoredResult *result in results) {
+    [uris addObject:[result uri]];
+  }
+  return uris;
+}
+
+- (void)testDatabaseRoundTrip {
+  NSString *folder = [self emptyFolderNamed:@"RoundTrip"];
+  HGSSearchSource *source = [self shortcutsSourceInFolder:folder];
+  HGSTokenizedString *shortcut = [HGSTokenizer tokenizeString:@"round trip"];
+  HGSScoredResult *first = [self resultNamed:@"first"];
+  HGSScoredResult *second = [self resultNamed:@"second"];
+  STAssertTrue([source updateShortcutForTokenizedString:shortcut
+                                       withRankedResult:first], nil);
+  STAssertTrue([source updateShortcutForTokenizedString:shortcut
+                                       withRankedResult:second], nil);
+  NSArray *expected = [self URIsForShortcut:@"round" fromSource:source];
+  STAssertEquals([expected count], (NSUInteger)2, nil);
+  [source writeShortcuts:nil];
+  [source uninstall];
+  NSString *dbPath 
+    = [folder stringByAppendingPathComponent:@"shortcuts.sqlite"];
+  STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:dbPath], nil);
+  
+  // A new source reads back the same shortcut, with its results in order.
+  source = [self shortcutsSourceInFolder:folder];
+  STAssertEqualObjects([self URIsForShortcut:@"round" fromSource:source],
+                       expected, nil);
+  STAssertEqualObjects([self URIsForShortcut:@"trip" fromSource:source],
+                       expected, nil);
+  [source uninstall];
+  [[NSFileManager defaultManager] removeItemAtPath:folder error:nil];
+}
+
+- (void)testOnlyChangedShortcutsWritten {
+  NSString *folder = [self emptyFolderNamed:@"Dirty"];
+  HGSTokenizedString *alpha = [HGSTokenizer tokenizeString:@"alpha"];
+  HGSTokenizedString *beta = [HGSTokenizer tokenizeString:@"beta"];
+  HGSScoredResult *alphaOne = [self resultNamed:@"alphaOne"];
+  HGSScoredResult *alphaTwo = [self resultNamed:@"alphaTwo"];
+  HGSScoredResult *betaOne = [self resultNamed:@"betaOne"];
+  HGSScoredResult *betaTwo = [self resultNamed:@"betaTwo"];
+  HGSSearchSource *first = [self shortcutsSourceInFolder:folder];
+  STAssertTrue([first updateShortcutForTokenizedString:alpha
+                                      withRankedResult:alphaOne], nil);
+  STAssertTrue([first updateShortcutForTokenizedString:beta
+                                      withRankedResult:betaOne], nil);
+  [first writeShortcuts:nil];
+  
+  // Another source over the same database moves betaTwo to the top of beta
+  // behind first's back.
+  HGSSearchSource *second = [self shortcutsSourceInFolder:folder];
+  STAssertTrue([second updateShortcutForTokenizedString:beta
+                                       withRankedResult:betaTwo], nil);
+  STAssertTrue([second updateShortcutForTokenizedString:beta
+                                       withRankedResult:betaTwo], nil);
+  [second writeShortcuts:nil];
+  [second uninstall];
+  
+  // first only changes alpha, so its stale copy of beta must not be written
+  // over second's.
+  STAssertTrue([first updateShortcutForTokenizedString:alpha
+                                      withRankedResult:alphaTwo], nil);
+  [first writeShortcuts:nil];
+  [first uninstall];
+  
+  HGSSearchSource *third = [self shortcutsSourceInFolder:folder];
+  NSArray *expected = [NSArray arrayWithObjects:
+                       [betaTwo uri], [betaOne uri], nil];
+  STAssertEqualObjects([self URIsForShortcut:@"beta" fromSource:third],
+                       expected, nil);
+  expected = [NSArray arrayWithObjects:[alphaOne uri], [alphaTwo uri], nil];
+  STAssertEqualObjects([self URIsForShortcut:@"alpha" fromSource:third],
+                       expected, nil);
+  [third uninstall];
+  [[NSFileManager defaultManager] removeItemAtPath:folder error:nil];
+}
+
+- (void)testLegacyImport {
+  NSString *folder = [self emptyFolderNamed:@"Legacy"];
+  HGSScoredResult *result = [self resultNamed:@"legacy"];
+  HGSSearchSource *resultSource = [result source];
+  NSMutableDictionary *archive 
+    = [resultSource archiveRepresentationForResult:result];
+  STAssertNotNil(archive, nil);
+  [archive setObject:[resultSource identifier] 
+              forKey:@"kHGSShortcutsSourceIdentifierKey"];
+  NSDictionary *shortcuts 
+    = [NSDictionary dictionaryWithObject:[NSArray arrayWithObject:archive]
+                                  forKey:@"legacy import"];
+  NSDictionary *legacy 
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       @"0.93", @"kHGSShortcutsVersionStringKey",
+       shortcuts, @"kHGSShortcutsDictionaryKey",
+       nil];
+  NSString *legacyPath 
+    = [folder stringByAppendingPathComponent:@"shortcuts.db"];
+  STAssertTrue([legacy writeToFile:legacyPath atomically:YES], nil);
+  
+  NSArray *expected = [NSArray arrayWithObject:[result uri]];
+  HGSSearchSource *source = [self shortcutsSourceInFolder:folder];
+  STAssertEqualObjects([self URIsForShortcut:@"legacy" fromSource:source],
+                       expected, nil);
+  [source uninstall];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  STAssertFalse([fm fileExistsAtPath:legacyPath], 
+                @"legacy shortcuts weren't deleted");
+  
+  // The import landed in the database.
+  source = [self shortcutsSourceInFolder:folder];
+  STAssertEqualObjects([self URIsForShortcut:@"import" fromSource:source],
+                       expected, nil);
+  [source uninstall];
+  [fm removeItemAtPath:folder error:nil];
+}
+
 // TODO(dmaclach): Add more ShortcutsTests when time is available.
 // - Specifically adding multiple items and pivoting back and forth to
 // see which one stays in the first position.
-// - Adding an item which exists, and then deleting it, and making sure that
-// it gets cleaned up.
-// - Make sure that writing out and reading in function correctly.
 // Others...
 @end
 
@@ -35,7 +35,6 @@
 
 #import "GTMMethodCheck.h"
 #import "GTMGarbageCollection.h"
-#import "NSNotificationCenter+MainThread.h"
 #import "GTMTypeCasting.h"
 #import "MDItemPrivate.h"
 #import "MDQueryPrivate.h"
@@ -187,10 +186,7 @@ CFIndex SLFilesCategoryIndexForItem(const CFTypeRef attrs[], void *context) {
     [resultCountByFilter setObject:nsCount
                             forKey:filter];
     resultCountByFilter_ = [resultCountByFilter retain];
-    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-    [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidUpdateResultsNotification
-                                      object:self
-                                    userInfo:nil];
+    [self postResultsDidUpdate];
   }
 }
 
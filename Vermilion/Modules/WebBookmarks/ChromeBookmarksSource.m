@@ -31,17 +31,44 @@
 //
 
 #import "WebBookmarksSource.h"
-#import <JSON/JSON.h>
 
 static NSString *const kChromeBookmarksSourceSubdirectoryKey
   = @"ChromeBookmarksSourceSubdirectory";
 
 @interface ChromeBookmarksSource : WebBookmarksSource
-- (void)indexChromeBookmark:(NSDictionary *)dict
-                       into:(HGSMemorySearchSourceDB *)database;
-- (void)indexChromeBookmarksForDict:(NSDictionary *)dict
-                               into:(HGSMemorySearchSourceDB *)database
-                          operation:(NSOperation *)operation;
+@end
+
+// Where an open object or array sits in a Chrome bookmarks file. Bookmarks
+// live in "roots" -> <root folder> -> "children" -> <node> -> "children"...
+typedef enum {
+  kChromeBookmarkFrameOther,
+  kChromeBookmarkFrameFile,
+  kChromeBookmarkFrameRoots,
+  kChromeBookmarkFrameNode,
+  kChromeBookmarkFrameChildren
+} ChromeBookmarkFrameKind;
+
+typedef struct {
+  ChromeBookmarkFrameKind kind;
+  BOOL hasChildren;
+  NSString *key;
+  NSString *name;
+  NSString *url;
+} ChromeBookmarkFrame;
+
+// Indexes bookmarks as the Chrome bookmarks file is parsed, so the JSON
+// tree for the whole file never has to be built.
+@interface ChromeBookmarkIndexer : NSObject <HGSJSONStreamParserDelegate> {
+ @private
+  ChromeBookmarkFrame *frames_;
+  NSUInteger depth_;
+  ChromeBookmarksSource *source_;  // weak
+  HGSMemorySearchSourceDB *database_;
+  NSOperation *operation_;
+}
+- (id)initWithSource:(ChromeBookmarksSource *)source
+            database:(HGSMemorySearchSourceDB *)database
+           operation:(NSOperation *)operation;
 @end
 
 @implementation ChromeBookmarksSource
@@ -72,51 +99,147 @@ static NSString *const kChromeBookmarksSourceSubdirectoryKey
                           fileToWatch:fileToWatch];
 }
 
-- (void)indexChromeBookmark:(NSDictionary*)dict
-                       into:(HGSMemorySearchSourceDB *)database {
-  NSString* nameString = [dict objectForKey:@"name"];
-  NSString* urlString = [dict objectForKey:@"url"];
-  if (nameString && urlString) {
-    [self indexResultNamed:nameString 
-                       URL:urlString 
-           otherAttributes:nil 
-                      into:database];
+- (void)updateDatabase:(HGSMemorySearchSourceDB *)database
+               forPath:(NSString *)path 
+             operation:(NSOperation *)operation {
+  if (![operation isCancelled]) {
+    ChromeBookmarkIndexer *indexer
+      = [[[ChromeBookmarkIndexer alloc] initWithSource:self
+                                              database:database
+                                             operation:operation]
+         autorelease];
+    HGSJSONStreamParser *parser
+      = [[[HGSJSONStreamParser alloc] initWithDelegate:indexer
+                                               options:0] autorelease];
+    if (![parser parseContentsOfFile:path]) {
+      NSError *error = [parser parserError];
+      if ([error code] != kHGSJSONStreamParserAbortedError) {
+        HGSLogDebug(@"Unable to parse %@ (%@)", path, error);
+      }
+    }
+  }
+}
+
+@end
+
+@implementation ChromeBookmarkIndexer
+
+- (id)initWithSource:(ChromeBookmarksSource *)source
+            database:(HGSMemorySearchSourceDB *)database
+           operation:(NSOperation *)operation {
+  if ((self = [super init])) {
+    frames_ = calloc(kHGSJSONStreamParserMaxDepth,
+                     sizeof(ChromeBookmarkFrame));
+    if (!frames_) {
+      // COV_NF_START
+      [self release];
+      return nil;
+      // COV_NF_END
+    }
+    source_ = source;
+    database_ = [database retain];
+    operation_ = [operation retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (NSUInteger i = 0; i < depth_; ++i) {
+    [frames_[i].key release];
+    [frames_[i].name release];
+    [frames_[i].url release];
   }
+  free(frames_);
+  [database_ release];
+  [operation_ release];
+  [super dealloc];
 }
 
-- (void)indexChromeBookmarksForDict:(NSDictionary *)dict
-                               into:(HGSMemorySearchSourceDB *)database 
-                          operation:(NSOperation *)operation{
-  NSArray *children = [dict objectForKey:@"children"];
-  if (!children) {
-    [self indexChromeBookmark:dict into:database];
+- (void)pushFrame:(BOOL)isObject {
+  ChromeBookmarkFrameKind kind = kChromeBookmarkFrameOther;
+  if (depth_ == 0) {
+    if (isObject) kind = kChromeBookmarkFrameFile;
   } else {
-    for (NSDictionary *child in children) {
-      if ([operation isCancelled]) return;
-      [self indexChromeBookmarksForDict:child 
-                                   into:database 
-                              operation:operation];
+    ChromeBookmarkFrame *parent = &frames_[depth_ - 1];
+    switch (parent->kind) {
+      case kChromeBookmarkFrameFile:
+        if (isObject && [parent->key isEqualToString:@"roots"]) {
+          kind = kChromeBookmarkFrameRoots;
+        }
+        break;
+      case kChromeBookmarkFrameRoots:
+      case kChromeBookmarkFrameChildren:
+        if (isObject) kind = kChromeBookmarkFrameNode;
+        break;
+      case kChromeBookmarkFrameNode:
+        if ([parent->key isEqualToString:@"children"]) {
+          parent->hasChildren = YES;
+          if (!isObject) kind = kChromeBookmarkFrameChildren;
+        }
+        break;
+      default:
+        break;
     }
   }
+  // The parser never nests deeper than kHGSJSONStreamParserMaxDepth.
+  ChromeBookmarkFrame *frame = &frames_[depth_++];
+  bzero(frame, sizeof(*frame));
+  frame->kind = kind;
 }
 
-- (void)updateDatabase:(HGSMemorySearchSourceDB *)database
-               forPath:(NSString *)path 
-             operation:(NSOperation *)operation {
-  if (![operation isCancelled]) {
-    NSString *json = [NSString stringWithContentsOfFile:path
-                                               encoding:NSUTF8StringEncoding
-                                                  error:nil];
-    NSDictionary *roots = [[json JSONValue] objectForKey:@"roots"];
-    if (roots) {
-      for (NSString *name in roots) {
-        NSDictionary *dict = [roots objectForKey:name];
-        [self indexChromeBookmarksForDict:dict 
-                                     into:database 
-                                operation:operation];
-      }
+- (void)popFrame {
+  ChromeBookmarkFrame *frame = &frames_[--depth_];
+  [frame->key release];
+  [frame->name release];
+  [frame->url release];
+}
+
+- (void)parserDidStartObject:(HGSJSONStreamParser *)parser {
+  [self pushFrame:YES];
+}
+
+- (void)parserDidStartArray:(HGSJSONStreamParser *)parser {
+  [self pushFrame:NO];
+}
+
+- (void)parserDidEndArray:(HGSJSONStreamParser *)parser {
+  [self popFrame];
+}
+
+- (void)parserDidEndObject:(HGSJSONStreamParser *)parser {
+  ChromeBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (frame->kind == kChromeBookmarkFrameNode && !frame->hasChildren
+      && frame->name && frame->url) {
+    [source_ indexResultNamed:frame->name
+                          URL:frame->url
+              otherAttributes:nil
+                         into:database_];
+    if ([operation_ isCancelled]) {
+      [parser abortParsing];
     }
   }
+  [self popFrame];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key {
+  ChromeBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (frame->kind != kChromeBookmarkFrameOther) {
+    [frame->key release];
+    frame->key = [key copy];
+  }
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string {
+  if (!depth_) return;
+  ChromeBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (frame->kind != kChromeBookmarkFrameNode) return;
+  if ([frame->key isEqualToString:@"name"]) {
+    [frame->name release];
+    frame->name = [string copy];
+  } else if ([frame->key isEqualToString:@"url"]) {
+    [frame->url release];
+    frame->url = [string copy];
+  }
 }
 
 @end
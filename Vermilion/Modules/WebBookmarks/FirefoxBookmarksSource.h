@@ -67,4 +67,9 @@
 - (NSDictionary *)bookmarksFromFile:(NSString *)path;
 - (NSArray*)inventorySearchPluginsAtPath:(NSString *)path;
 - (NSArray *)inventoryBookmarks:(NSDictionary *)bookmarks;
+// Returns the same bookmarks as inventoryBookmarks: would for the contents
+// of |path|, picking them out while the file is being parsed. Stops early
+// if |operation| is cancelled.
+- (NSArray *)bookmarksInFile:(NSString *)path
+                   operation:(NSOperation *)operation;
 @end
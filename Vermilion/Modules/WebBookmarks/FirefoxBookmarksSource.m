@@ -51,23 +51,52 @@
 // THE SOFTWARE.
 
 #import "FirefoxBookmarksSource.h"
-#import <JSON/JSON.h>
 #import "GTMFileSystemKQueue.h"
 
+// Firefox may write non-standard trailing commas, and writes nulls for
+// missing values, which we treat as if they weren't there.
+static const HGSJSONStreamParserOptions kFirefoxJSONOptions
+  = kHGSJSONStreamParserAllowTrailingCommas | kHGSJSONStreamParserSkipNulls;
+
 @interface NSFileManager (FirefoxBookmarksSource)
 - (NSString *)mostRecentFileInDirectory:(NSString *)path;
 @end
 
-@interface FirefoxBookmarksSource ()
-// -[NSString JSONValue] can result in NSNull objects in the returned
-// dictionary for the FF JSON so we have to strip those out.
-- (id)removeNullsFromJSONObject:(id)object;
-@end
+// The keys of a Firefox bookmark entry that we care about.
+typedef enum {
+  kFirefoxBookmarkKeyOther,
+  kFirefoxBookmarkKeyType,
+  kFirefoxBookmarkKeyURI,
+  kFirefoxBookmarkKeyTitle,
+  kFirefoxBookmarkKeyLastModified,
+  kFirefoxBookmarkKeyChildren
+} FirefoxBookmarkKey;
 
-@interface NSString (FirefoxBookmarksSource)
-// Firefox may have unnecessary, non-standard commas which causes
-// -[NSString JSONValue] to fail.  Remove those commas.
-- (NSString *)stringByStrippingUnnecessaryCommasFromFirefoxJSONString;
+// One open object or array in a bookmarks backup. |isBookmarkTree| is set
+// for the root object, the "children" arrays hanging off it and the entries
+// in those arrays, which is everything inventoryBookmarks: would visit.
+typedef struct {
+  BOOL isObject;
+  BOOL isBookmarkTree;
+  BOOL hasChildren;
+  FirefoxBookmarkKey key;
+  NSString *type;
+  NSString *uri;
+  NSString *title;
+  double lastModified;
+} FirefoxBookmarkFrame;
+
+// Picks bookmarks out of a Firefox bookmarks backup as it is parsed, so
+// the JSON tree for the whole file never has to be built.
+@interface FirefoxBookmarkCollector : NSObject <HGSJSONStreamParserDelegate> {
+ @private
+  FirefoxBookmarkFrame *frames_;
+  NSUInteger depth_;
+  NSMutableArray *bookmarks_;
+  NSOperation *operation_;
+}
+- (id)initWithOperation:(NSOperation *)operation;
+- (NSArray *)bookmarks;
 @end
 
 @implementation FirefoxBookmarksSource
@@ -133,8 +162,7 @@
   }
   NSFileManager *fm = [NSFileManager defaultManager];
   NSString *bookmarksFile = [fm mostRecentFileInDirectory:bookmarksPath];
-  NSDictionary *bookmarksDict = [self bookmarksFromFile:bookmarksFile];
-  NSArray *bookmarks = [self inventoryBookmarks:bookmarksDict];
+  NSArray *bookmarks = [self bookmarksInFile:bookmarksFile operation:operation];
   for (NSDictionary *bookmark in bookmarks) {
     NSString *name = [bookmark objectForKey:kHGSObjectAttributeNameKey];
     NSString *urlString = [bookmark objectForKey:kHGSObjectAttributeURIKey];
@@ -246,47 +274,39 @@
   return [iniFilePath stringByAppendingPathComponent:@"profiles.ini"];
 }  
 
-- (id)removeNullsFromJSONObject:(id)object {
-  id newObject = nil;
-  if ([object isKindOfClass:[NSArray class]]) {
-    newObject = [NSMutableArray arrayWithCapacity:[object count]];
-    for (id element in object) {
-      id newElement = [self removeNullsFromJSONObject:element];
-      if (newElement) {
-        [newObject addObject:newElement];
-      }
-    }
-  } else if ([object isKindOfClass:[NSDictionary class]]) {
-    newObject = [NSMutableDictionary dictionaryWithCapacity:[object count]];
-    for (id key in object) {
-      id element = [object valueForKey:key];
-      id newElement = [self removeNullsFromJSONObject:element];
-      if (newElement) {
-        [newObject setObject:newElement forKey:key];
-      }
-    }
-  } else if (![object isEqual:[NSNull null]]) {
-    newObject = object;
-  }
-  return newObject;
-}     
-      
 - (NSDictionary *)bookmarksFromFile:(NSString *)path {
   NSError *error = nil;
-  NSDictionary *dictWithoutNulls = nil;
-  NSString *fileContents 
-    = [NSString stringWithContentsOfFile:path 
-                                encoding:NSUTF8StringEncoding 
-                                   error:&error];
-  if (error) {
+  NSDictionary *dict
+    = [HGSJSONStreamParser JSONObjectWithContentsOfFile:path
+                                                options:kFirefoxJSONOptions
+                                                  error:&error];
+  if (!dict) {
     HGSLog(@"Unable to load %@ (%@)", path, error);
-  } else {
-    fileContents
-      = [fileContents stringByStrippingUnnecessaryCommasFromFirefoxJSONString];
-    NSDictionary *dict = [fileContents JSONValue];
-    dictWithoutNulls = [self removeNullsFromJSONObject:dict];
+  } else if (![dict isKindOfClass:[NSDictionary class]]) {
+    HGSLog(@"Unexpected bookmarks format in %@", path);
+    dict = nil;
   }
-  return dictWithoutNulls;
+  return dict;
+}
+
+- (NSArray *)bookmarksInFile:(NSString *)path
+                   operation:(NSOperation *)operation {
+  if (!path) return [NSArray array];
+  FirefoxBookmarkCollector *collector
+    = [[[FirefoxBookmarkCollector alloc] initWithOperation:operation]
+       autorelease];
+  HGSJSONStreamParser *parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:collector
+                                             options:kFirefoxJSONOptions]
+       autorelease];
+  if (![parser parseContentsOfFile:path]) {
+    NSError *error = [parser parserError];
+    if ([error code] != kHGSJSONStreamParserAbortedError) {
+      HGSLog(@"Unable to load %@ (%@)", path, error);
+    }
+  }
+  // Whatever was collected before an error is still worth indexing.
+  return [collector bookmarks];
 }
 
 - (void)addBookmarksInDictionary:(NSDictionary *)bookmarks
@@ -430,14 +450,155 @@
 
 @end
 
-@implementation NSString (FirefoxBookmarksSource)
+@implementation FirefoxBookmarkCollector
+
+- (id)initWithOperation:(NSOperation *)operation {
+  if ((self = [super init])) {
+    frames_ = calloc(kHGSJSONStreamParserMaxDepth,
+                     sizeof(FirefoxBookmarkFrame));
+    if (!frames_) {
+      // COV_NF_START
+      [self release];
+      return nil;
+      // COV_NF_END
+    }
+    bookmarks_ = [[NSMutableArray alloc] init];
+    operation_ = [operation retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (NSUInteger i = 0; i < depth_; ++i) {
+    [frames_[i].type release];
+    [frames_[i].uri release];
+    [frames_[i].title release];
+  }
+  free(frames_);
+  [bookmarks_ release];
+  [operation_ release];
+  [super dealloc];
+}
+
+- (NSArray *)bookmarks {
+  return bookmarks_;
+}
+
+- (FirefoxBookmarkFrame *)pushFrame:(BOOL)isObject {
+  BOOL isBookmarkTree = NO;
+  if (depth_ == 0) {
+    isBookmarkTree = isObject;
+  } else {
+    FirefoxBookmarkFrame *parent = &frames_[depth_ - 1];
+    if (parent->isBookmarkTree) {
+      if (!parent->isObject) {
+        isBookmarkTree = isObject;
+      } else if (parent->key == kFirefoxBookmarkKeyChildren) {
+        parent->hasChildren = YES;
+        isBookmarkTree = !isObject;
+      }
+    }
+  }
+  // The parser never nests deeper than kHGSJSONStreamParserMaxDepth.
+  FirefoxBookmarkFrame *frame = &frames_[depth_++];
+  bzero(frame, sizeof(*frame));
+  frame->isObject = isObject;
+  frame->isBookmarkTree = isBookmarkTree;
+  return frame;
+}
+
+- (void)parserDidStartObject:(HGSJSONStreamParser *)parser {
+  [self pushFrame:YES];
+}
+
+- (void)parserDidStartArray:(HGSJSONStreamParser *)parser {
+  [self pushFrame:NO];
+}
+
+- (void)parserDidEndArray:(HGSJSONStreamParser *)parser {
+  --depth_;
+}
 
-- (NSString *)stringByStrippingUnnecessaryCommasFromFirefoxJSONString {
-  // The only known case at the moment is an extra comma at the end of
-  // the main 'children' section.  Fix: s/,\]/\]/.
-  NSString *cleanString
-    = [self stringByReplacingOccurrencesOfString:@",]" withString:@"]"];
-  return cleanString;
+- (void)parserDidEndObject:(HGSJSONStreamParser *)parser {
+  FirefoxBookmarkFrame *frame = &frames_[--depth_];
+  // Mirrors addBookmarksInDictionary:toArray:.
+  if (frame->isBookmarkTree && !frame->hasChildren
+      && [frame->type isEqualToString:@"text/x-moz-place"]
+      && [frame->uri hasPrefix:@"http"]
+      && frame->title) {
+    // Firefox stores its dates as microseconds since the epoch.
+    NSTimeInterval firefoxDate = floor(frame->lastModified / 1000000);
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:firefoxDate];
+    NSDictionary *bookmark = [NSDictionary dictionaryWithObjectsAndKeys:
+                              frame->title, kHGSObjectAttributeNameKey,
+                              frame->uri, kHGSObjectAttributeURIKey,
+                              date, kHGSObjectAttributeLastUsedDateKey,
+                              nil];
+    [bookmarks_ addObject:bookmark];
+    if ([operation_ isCancelled]) {
+      [parser abortParsing];
+    }
+  }
+  [frame->type release];
+  [frame->uri release];
+  [frame->title release];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key {
+  FirefoxBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (!frame->isBookmarkTree) return;
+  FirefoxBookmarkKey bookmarkKey = kFirefoxBookmarkKeyOther;
+  if ([key isEqualToString:@"type"]) {
+    bookmarkKey = kFirefoxBookmarkKeyType;
+  } else if ([key isEqualToString:@"uri"]) {
+    bookmarkKey = kFirefoxBookmarkKeyURI;
+  } else if ([key isEqualToString:@"title"]) {
+    bookmarkKey = kFirefoxBookmarkKeyTitle;
+  } else if ([key isEqualToString:@"lastModified"]) {
+    bookmarkKey = kFirefoxBookmarkKeyLastModified;
+  } else if ([key isEqualToString:@"children"]) {
+    bookmarkKey = kFirefoxBookmarkKeyChildren;
+  }
+  frame->key = bookmarkKey;
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string {
+  if (!depth_) return;
+  FirefoxBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (!(frame->isObject && frame->isBookmarkTree)) return;
+  NSString **field = NULL;
+  switch (frame->key) {
+    case kFirefoxBookmarkKeyType:
+      field = &frame->type;
+      break;
+    case kFirefoxBookmarkKeyURI:
+      field = &frame->uri;
+      break;
+    case kFirefoxBookmarkKeyTitle:
+      field = &frame->title;
+      break;
+    case kFirefoxBookmarkKeyChildren:
+      frame->hasChildren = YES;
+      break;
+    default:
+      break;
+  }
+  if (field) {
+    [*field release];
+    *field = [string copy];
+  }
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundNumber:(NSNumber *)number {
+  if (!depth_) return;
+  FirefoxBookmarkFrame *frame = &frames_[depth_ - 1];
+  if (frame->isObject && frame->isBookmarkTree) {
+    if (frame->key == kFirefoxBookmarkKeyLastModified) {
+      frame->lastModified = [number doubleValue];
+    } else if (frame->key == kFirefoxBookmarkKeyChildren) {
+      frame->hasChildren = YES;
+    }
+  }
 }
 
 @end
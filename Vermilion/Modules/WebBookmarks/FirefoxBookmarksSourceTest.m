@@ -210,6 +210,26 @@
   STAssertEqualObjects(bookmarks, masterItems, nil);
 }
 
+- (void)testBookmarksInFile {
+  FirefoxBookmarksSource *ffSource = (FirefoxBookmarksSource *)[self source];
+  NSBundle *pluginBundle = HGSGetPluginBundle();
+  NSString *jsonPath = [pluginBundle pathForResource:@"bookmarks" 
+                                              ofType:@"json"
+                                         inDirectory:@"Firefox"];
+  NSArray *bookmarks = [ffSource bookmarksInFile:jsonPath operation:nil];
+  NSString *masterPath = [pluginBundle pathForResource:@"bookmarksMaster" 
+                                                ofType:@"xml"
+                                           inDirectory:@"Firefox"];
+  STAssertNotNil(masterPath, nil);
+  NSArray *masterItems = [NSArray arrayWithContentsOfFile:masterPath];
+  STAssertEqualObjects(bookmarks, masterItems, nil);
+
+  bookmarks = [ffSource bookmarksInFile:@"/DoesNotExist.json" operation:nil];
+  STAssertEquals([bookmarks count], (NSUInteger)0, nil);
+  bookmarks = [ffSource bookmarksInFile:nil operation:nil];
+  STAssertEquals([bookmarks count], (NSUInteger)0, nil);
+}
+
 - (NSArray *)archivableResults {
   // TODO(dmaclach): add some results to test.
   return nil;
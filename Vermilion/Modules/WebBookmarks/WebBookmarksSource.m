@@ -162,7 +162,9 @@
 
 - (void)updateIndexForPath:(NSString *)path operation:(NSOperation *)operation {
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  [HGSTokenizer beginInterning];
   [self updateDatabase:database forPath:path operation:operation];
+  [HGSTokenizer endInterning];
   if (![indexingOperation_ isCancelled]) {
     [self replaceCurrentDatabaseWith:database];
   }
@@ -168,7 +168,7 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
       = [[[NSInvocationOperation alloc] initWithTarget:self
                                               selector:selector
                                                 object:nil] autorelease];
-    [[HGSOperationQueue sharedOperationQueue] addOperation:op];
+    [[HGSOperationQueue interactiveOperationQueue] addOperation:op];
   }
 }
 
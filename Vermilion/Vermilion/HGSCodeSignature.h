@@ -111,7 +111,10 @@ typedef enum {
 
 /*
   Generates a code signature for the bundle. The resulting signature must
-  be stored securely by the caller.
+  be stored securely by the caller. Bundles without a Mach-O executable get
+  a digest of every file in the bundle. Digest signatures generated by
+  earlier versions only covered Info.plist and Resources; they still verify
+  against just those files.
 */
 - (NSData *)generateDetachedSignature;
 
@@ -30,11 +30,15 @@
 //  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#import <fcntl.h>
+#import <sys/stat.h>
+#import <unistd.h>
 #import <uuid/uuid.h>
 #import <openssl/hmac.h>
 #import <openssl/sha.h>
 #import <Vermilion/Vermilion.h>
 #import "HGSCodeSignature.h"
+#import "HGSKeychainItem.h"
 
 // Definitions for the code signing framework SPIs
 typedef struct __SecRequirementRef *SecRequirementRef;
@@ -71,10 +75,234 @@ static NSString *kSignatureDateKey = @"SignatureDateKey";
 static NSString *kDetachedSignatureTypeKey = @"DetachedSignatureTypeKey";
 static const int kSignatureTypeStandard = 1;
 static const int kSignatureTypeDigest = 2;
+static const int kSignatureTypeMerkleDigest = 3;
+
+static NSString *const kHGSDigestCacheFile = @"PluginDigestCache.plist";
+static NSString *const kHGSDigestCacheVersionKey = @"Version";
+static NSString *const kHGSDigestCacheEntriesKey = @"Entries";
+static const NSInteger kHGSDigestCacheVersion = 2;
+// The cache lives in a user writable folder, so every entry carries an HMAC
+// keyed with a secret that is kept in the keychain. Without the secret the
+// cache is neither read nor written.
+static NSString *const kHGSDigestCacheKeychainService
+  = @"Vermilion Plugin Digest Cache";
+static NSString *const kHGSDigestCacheKeychainAccount = @"HMAC Key";
+static const size_t kHGSDigestCacheKeyLength = 32;
+static const size_t kHGSDigestReadChunkSize = 64 * 1024;
+// Files changed this recently (in seconds) are hashed but not cached. HFS+
+// timestamps have a one second resolution, so a write that lands in the same
+// second as our read would otherwise go unnoticed.
+static const time_t kHGSDigestRacyInterval = 2;
+
+// What we know about a file when deciding whether its cached digest is still
+// good. ctime is included because, unlike mtime, it can't be set with utimes.
+typedef struct {
+  dev_t device;
+  ino_t inode;
+  mode_t mode;
+  off_t size;
+  struct timespec modified;
+  struct timespec changed;
+} HGSFileDigestKey;
+
+typedef struct {
+  HGSFileDigestKey key;
+  unsigned char digest[kCodeSignatureDigestLength];
+} HGSFileDigestRecord;
+
+typedef struct {
+  HGSFileDigestRecord record;
+  unsigned char mac[kCodeSignatureDigestLength];
+} HGSFileDigestCacheEntry;
+
+// The original digest hashes all of its files in one go, so it can't be put
+// together from per file digests. Instead the whole digest is cached, along
+// with a hash of the paths and keys of every file it covered.
+typedef struct {
+  unsigned char files[kCodeSignatureDigestLength];
+  unsigned char digest[kCodeSignatureDigestLength];
+} HGSLegacyDigestRecord;
+
+typedef struct {
+  HGSLegacyDigestRecord record;
+  unsigned char mac[kCodeSignatureDigestLength];
+} HGSLegacyDigestCacheEntry;
+
+// Legacy digests are cached under their bundle path with this prefix, which
+// can't clash with the absolute paths of the per file entries.
+static NSString *const kHGSLegacyDigestCachePrefix = @"Legacy:";
+
+static NSMutableDictionary *gHGSDigestCache = nil;
+static BOOL gHGSDigestCacheDirty = NO;
+static NSData *gHGSDigestCacheKey = nil;
+static BOOL gHGSDigestCacheKeyLoaded = NO;
+static SecKeychainRef gHGSDigestCacheKeychain = NULL;
+
+static BOOL HGSFileDigestKeysEqual(const HGSFileDigestKey *a,
+                                   const HGSFileDigestKey *b) {
+  return (a->device == b->device
+          && a->inode == b->inode
+          && a->mode == b->mode
+          && a->size == b->size
+          && a->modified.tv_sec == b->modified.tv_sec
+          && a->modified.tv_nsec == b->modified.tv_nsec
+          && a->changed.tv_sec == b->changed.tv_sec
+          && a->changed.tv_nsec == b->changed.tv_nsec);
+}
+
+static void HGSGetFileDigestKey(const struct stat *st,
+                                HGSFileDigestKey *key) {
+  memset(key, 0, sizeof(*key));
+  key->device = st->st_dev;
+  key->inode = st->st_ino;
+  key->mode = st->st_mode & S_IFMT;
+  key->size = st->st_size;
+  key->modified = st->st_mtimespec;
+  key->changed = st->st_ctimespec;
+}
+
+// Authenticates the cache entry |record| (|length| bytes) stored under
+// |path|.
+static BOOL HGSDigestCacheMAC(NSData *key, NSString *path,
+                              const void *record, size_t length,
+                              unsigned char *mac) {
+  const char *pathString = [path fileSystemRepresentation];
+  HMAC_CTX ctx;
+  HMAC_CTX_init(&ctx);
+  HMAC_Init_ex(&ctx, [key bytes], (int)[key length], EVP_sha1(), NULL);
+  // The terminating NUL keeps the path from running into the record.
+  HMAC_Update(&ctx, (const unsigned char *)pathString, strlen(pathString) + 1);
+  HMAC_Update(&ctx, (const unsigned char *)record, length);
+  unsigned int length = 0;
+  HMAC_Final(&ctx, mac, &length);
+  HMAC_CTX_cleanup(&ctx);
+  return length == kCodeSignatureDigestLength;
+}
+
+// Streams the rest of |fd| through |ctx| using |buffer| as scratch space.
+static BOOL HGSDigestFileDescriptor(int fd, SHA_CTX *ctx,
+                                    unsigned char *buffer, off_t *total) {
+  BOOL result = YES;
+  *total = 0;
+  while (result) {
+    ssize_t bytesRead = read(fd, buffer, kHGSDigestReadChunkSize);
+    if (bytesRead == 0) {
+      break;
+    } else if (bytesRead < 0) {
+      result = (errno == EINTR);
+    } else {
+      result = SHA1_Update(ctx, buffer, bytesRead) != 0;
+      *total += bytesRead;
+    }
+  }
+  return result;
+}
+
+// Streams a single file (or the target of a symlink) through SHA1 using
+// |buffer| as scratch space. Fails if the file is no longer the one described
+// by the record's key.
+static BOOL HGSDigestFile(const char *path, HGSFileDigestRecord *record,
+                          unsigned char *buffer) {
+  SHA_CTX ctx;
+  if (!SHA1_Init(&ctx)) {
+    return NO;
+  }
+  BOOL result = NO;
+  if (S_ISLNK(record->key.mode)) {
+    ssize_t length = readlink(path, (char *)buffer, kHGSDigestReadChunkSize);
+    if (length >= 0) {
+      result = SHA1_Update(&ctx, buffer, length) != 0;
+    }
+  } else {
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (fd >= 0) {
+      struct stat st;
+      if (fstat(fd, &st) == 0
+          && st.st_dev == record->key.device
+          && st.st_ino == record->key.inode) {
+        off_t total = 0;
+        result = HGSDigestFileDescriptor(fd, &ctx, buffer, &total);
+        // A file that changed size under us won't match its cache key.
+        if (total != record->key.size) {
+          result = NO;
+        }
+      }
+      close(fd);
+    }
+  }
+  if (!SHA1_Final(record->digest, &ctx)) {
+    result = NO;
+  }
+  return result;
+}
+
+// Hashes a subset of the files in a bundle. Each operation writes only to its
+// own records, so the operations don't need to lock anything.
+@interface HGSFileDigestOperation : NSOperation {
+ @private
+  NSArray *paths_;
+  NSArray *indexes_;
+  HGSFileDigestRecord *records_;
+  BOOL succeeded_;
+}
+- (id)initWithPaths:(NSArray *)paths
+            indexes:(NSArray *)indexes
+            records:(HGSFileDigestRecord *)records;
+- (BOOL)succeeded;
+@end
 
 @interface HGSCodeSignature()
++ (NSMutableDictionary *)digestCache;
++ (NSData *)digestCacheKey;
++ (void)saveDigestCache;
++ (void)setDigestCacheKeychain:(SecKeychainRef)keychain;
 - (BOOL)digest:(unsigned char *)digest;
-- (BOOL)digestDirectory:(NSString *)path shaContext:(SHA_CTX *)shaCtx;
+- (BOOL)addLegacyDigestPathsInDirectory:(NSString *)path
+                                toArray:(NSMutableArray *)paths;
+- (BOOL)merkleDigest:(unsigned char *)digest;
+@end
+
+@implementation HGSFileDigestOperation
+
+- (id)initWithPaths:(NSArray *)paths
+            indexes:(NSArray *)indexes
+            records:(HGSFileDigestRecord *)records {
+  if ((self = [super init])) {
+    paths_ = [paths retain];
+    indexes_ = [indexes retain];
+    records_ = records;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [paths_ release];
+  [indexes_ release];
+  [super dealloc];
+}
+
+- (void)main {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  unsigned char *buffer = malloc(kHGSDigestReadChunkSize);
+  succeeded_ = (buffer != NULL);
+  NSUInteger count = [indexes_ count];
+  for (NSUInteger i = 0; succeeded_ && i < count; ++i) {
+    NSUInteger index = [[indexes_ objectAtIndex:i] unsignedIntegerValue];
+    NSString *path = [paths_ objectAtIndex:index];
+    succeeded_ = HGSDigestFile([path fileSystemRepresentation],
+                               &records_[index], buffer);
+    if (!succeeded_) {
+      HGSLogDebug(@"Could not digest %@ for plugin signing", path);
+    }
+  }
+  free(buffer);
+  [pool release];
+}
+
+- (BOOL)succeeded {
+  return succeeded_;
+}
+
 @end
 
 @implementation HGSCodeSignature
@@ -375,12 +603,12 @@ static const int kSignatureTypeDigest = 2;
       CFRelease(codeRef);
     } else if (err == errSecCSBadObjectFormat) {
       // Not a Mach-o plugin; generate a digest of the scripts, etc. in the
-      // Resources directory instead of a traditional code signature
+      // bundle instead of a traditional code signature
       unsigned char digest[kCodeSignatureDigestLength];
-      if ([self digest:digest]) {
+      if ([self merkleDigest:digest]) {
         sigData = [NSData dataWithBytes:digest
                                  length:kCodeSignatureDigestLength];
-        sigType = [NSNumber numberWithInt:kSignatureTypeDigest];
+        sigType = [NSNumber numberWithInt:kSignatureTypeMerkleDigest];
       }
     } else {
       HGSLog(@"Failed to generate code signature for %@ (%i)", bundle_, err);
@@ -440,81 +668,450 @@ static const int kSignatureTypeDigest = 2;
         result = eSignatureStatusOK;
       }
     }
+  } else if (sigType == kSignatureTypeMerkleDigest) {
+    if ([sigData length] == kCodeSignatureDigestLength) {
+      unsigned char digest[kCodeSignatureDigestLength];
+      if ([self merkleDigest:digest] &&
+          memcmp(digest, [sigData bytes], kCodeSignatureDigestLength) == 0) {
+        result = eSignatureStatusOK;
+      }
+    }
   }
   
   return result;
 }
 
+// The original digest: one SHA1 over Info.plist followed by everything
+// under Resources. New signatures use merkleDigest:, which covers a different
+// set of files, but signatures which were stored with kSignatureTypeDigest
+// still have to verify, so this hashes exactly the bytes it always did. It
+// streams the files rather than reading each one into memory, and the
+// result is cached for as long as none of the files change.
 - (BOOL)digest:(unsigned char *)digest {
+  NSString *bundlePath = [[bundle_ bundlePath] stringByStandardizingPath];
+  NSString *plistPath
+    = [[bundlePath stringByAppendingPathComponent:@"Contents"]
+       stringByAppendingPathComponent:@"Info.plist"];
+  NSMutableArray *paths = [NSMutableArray arrayWithObject:plistPath];
+  NSString *resourcePath = [[bundle_ resourcePath] stringByStandardizingPath];
+  if (![self addLegacyDigestPathsInDirectory:resourcePath toArray:paths]) {
+    HGSLogDebug(@"Could not list resources for plugin signing");
+    return NO;
+  }
+
+  // Hash what we know about every file, to tell whether the cached digest
+  // still holds.
   SHA_CTX ctx;
   if (!SHA1_Init(&ctx)) {
     HGSLogDebug(@"Could not instantiate a SHA1 context for plugin signing");
     return NO;
   }
-  
-  NSString *plistPath
-    = [[[bundle_ bundlePath] stringByAppendingPathComponent:@"Contents"]
-       stringByAppendingPathComponent:@"Info.plist"];
-  NSData *contents = [NSData dataWithContentsOfFile:plistPath];
-  if ([contents length]) {
-    SHA1_Update(&ctx, [contents bytes], [contents length]);
-  } else {
-    HGSLogDebug(@"Could not read Info.plist for plugin signing");
+  time_t racyLimit = time(NULL) - kHGSDigestRacyInterval;
+  BOOL cacheable = YES;
+  for (NSString *path in paths) {
+    // Like the original, follow symlinks.
+    struct stat st;
+    const char *fsPath = [path fileSystemRepresentation];
+    if (stat(fsPath, &st) != 0) {
+      HGSLogDebug(@"Could not stat %@ for plugin signing", path);
+      return NO;
+    }
+    if (path == plistPath && st.st_size == 0) {
+      HGSLogDebug(@"Could not read Info.plist for plugin signing");
+      return NO;
+    }
+    HGSFileDigestKey key;
+    HGSGetFileDigestKey(&st, &key);
+    if (key.modified.tv_sec >= racyLimit || key.changed.tv_sec >= racyLimit) {
+      cacheable = NO;
+    }
+    SHA1_Update(&ctx, fsPath, strlen(fsPath) + 1);
+    SHA1_Update(&ctx, &key, sizeof(key));
+  }
+  HGSLegacyDigestRecord record;
+  memset(&record, 0, sizeof(record));
+  if (!SHA1_Final(record.files, &ctx)) {
+    return NO;
+  }
+
+  NSString *cachePath
+    = [kHGSLegacyDigestCachePrefix stringByAppendingString:bundlePath];
+  NSData *cacheKey = nil;
+  @synchronized([HGSCodeSignature class]) {
+    cacheKey = [HGSCodeSignature digestCacheKey];
+    NSMutableDictionary *cache
+      = cacheKey ? [HGSCodeSignature digestCache] : nil;
+    NSData *cached = [cache objectForKey:cachePath];
+    const HGSLegacyDigestCacheEntry *entry = [cached bytes];
+    unsigned char mac[kCodeSignatureDigestLength];
+    if ([cached length] == sizeof(HGSLegacyDigestCacheEntry)
+        && memcmp(entry->record.files, record.files,
+                  kCodeSignatureDigestLength) == 0
+        && HGSDigestCacheMAC(cacheKey, cachePath, &entry->record,
+                             sizeof(entry->record), mac)
+        && memcmp(mac, entry->mac, kCodeSignatureDigestLength) == 0) {
+      memcpy(digest, entry->record.digest, kCodeSignatureDigestLength);
+      return YES;
+    }
+  }
+
+  if (!SHA1_Init(&ctx)) {
+    HGSLogDebug(@"Could not instantiate a SHA1 context for plugin signing");
     return NO;
   }
-  if (![self digestDirectory:[bundle_ resourcePath] shaContext:&ctx]) {
-    HGSLogDebug(@"Could not read Info.plist for plugin signing");
+  unsigned char *buffer = malloc(kHGSDigestReadChunkSize);
+  BOOL result = (buffer != NULL);
+  for (NSUInteger i = 0; result && i < [paths count]; ++i) {
+    NSString *path = [paths objectAtIndex:i];
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    off_t total = 0;
+    result = (fd >= 0) && HGSDigestFileDescriptor(fd, &ctx, buffer, &total);
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (!result) {
+      HGSLogDebug(@"Could not digest %@ for plugin signing", path);
+    }
+  }
+  free(buffer);
+  if (!SHA1_Final(record.digest, &ctx) || !result) {
     return NO;
   }
+  memcpy(digest, record.digest, kCodeSignatureDigestLength);
 
-  return (SHA1_Final(digest, &ctx) != 0);
+  if (cacheable && cacheKey) {
+    HGSLegacyDigestCacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.record = record;
+    if (HGSDigestCacheMAC(cacheKey, cachePath, &entry.record,
+                          sizeof(entry.record), entry.mac)) {
+      @synchronized([HGSCodeSignature class]) {
+        NSData *cached = [NSData dataWithBytes:&entry length:sizeof(entry)];
+        [[HGSCodeSignature digestCache] setObject:cached forKey:cachePath];
+        gHGSDigestCacheDirty = YES;
+        [HGSCodeSignature saveDigestCache];
+      }
+    }
+  }
+  return YES;
 }
 
-- (BOOL)digestDirectory:(NSString *)path shaContext:(SHA_CTX *)shaCtx {
-  BOOL result = YES;
-
+// Lists the files under |path| in the order the original digest hashed
+// them. It both let the directory enumerator descend and recursed into
+// every directory itself, so a file is listed once for every directory
+// between it and Resources, and it followed symlinks to directories. It
+// failed on anything it couldn't read.
+- (BOOL)addLegacyDigestPathsInDirectory:(NSString *)path
+                                toArray:(NSMutableArray *)paths {
   NSFileManager *fm = [NSFileManager defaultManager];
   NSDirectoryEnumerator *dirEnum = [fm enumeratorAtPath:path];
   if (!dirEnum) {
     return NO;
   }
+  // It also insisted on the size of the directory (not of the file) being
+  // usable.
+  NSDictionary *attrs = [fm fileAttributesAtPath:path traverseLink:YES];
+  unsigned long long size = [[attrs objectForKey:NSFileSize]
+                             unsignedLongLongValue];
+  BOOL sizeUsable = size > 0 && size <= 0xFFFFFFFFLL;
   NSString *filePath;
-  while (result && (filePath = [dirEnum nextObject])) {
+  while ((filePath = [dirEnum nextObject])) {
     filePath = [path stringByAppendingPathComponent:filePath];
-    BOOL isDirectory, succeeded = NO;
-    // Should always return YES
-    if ([fm fileExistsAtPath:filePath isDirectory:&isDirectory]) {
-      if (!isDirectory) {
-        // Must be digestable
-        if ([fm isReadableFileAtPath:filePath]) {
-          // Must be able to get file attributes
-          NSDictionary *attrs = [fm fileAttributesAtPath:path traverseLink:YES];
-          if (attrs) {
-            NSNumber *size = [attrs objectForKey:NSFileSize];
-            if (size && [size unsignedLongLongValue] <= 0xFFFFFFFFLL) {
-              // SHA1_Update() takes the length as an unsigned long
-              if (result && [size unsignedLongLongValue] > 0) {
-                NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-                NSData *contents = [NSData dataWithContentsOfFile:filePath];
-                if (contents) {
-                  if (SHA1_Update(shaCtx, [contents bytes], [contents length])) {
-                      succeeded = YES;
-                  }
-                }
-                [pool release];
-              }
-            }
-          }
-        }
+    BOOL isDirectory;
+    if (![fm fileExistsAtPath:filePath isDirectory:&isDirectory]) {
+      return NO;
+    }
+    if (isDirectory) {
+      if (![self addLegacyDigestPathsInDirectory:filePath toArray:paths]) {
+        return NO;
+      }
+    } else if (sizeUsable && [fm isReadableFileAtPath:filePath]) {
+      [paths addObject:filePath];
+    } else {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+// Digests every file in the bundle exactly once, in sorted order. Each file
+// is hashed on its own (in parallel, and skipped entirely when the digest
+// cache still has it) and the results are combined by hashing the list of
+// (relative path, type, file digest) entries. Unlike digest:, which only
+// covers Info.plist and Resources, this covers the whole bundle, so adding
+// or changing any file in it (scripts in Contents/MacOS, say) invalidates
+// the signature.
+- (BOOL)merkleDigest:(unsigned char *)digest {
+  NSString *bundlePath = [[bundle_ bundlePath] stringByStandardizingPath];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSDirectoryEnumerator *dirEnum = [fm enumeratorAtPath:bundlePath];
+  if (!dirEnum) {
+    return NO;
+  }
+  
+  // The enumerator descends into directories itself (and doesn't follow
+  // symlinks), so directories are simply skipped here.
+  NSMutableArray *relativePaths = [NSMutableArray array];
+  NSString *relativePath;
+  while ((relativePath = [dirEnum nextObject])) {
+    NSString *fileType = [[dirEnum fileAttributes] objectForKey:NSFileType];
+    if (![fileType isEqualToString:NSFileTypeDirectory]) {
+      [relativePaths addObject:relativePath];
+    }
+  }
+  NSUInteger count = [relativePaths count];
+  if (!count) {
+    HGSLogDebug(@"No files to digest for plugin signing in %@", bundlePath);
+    return NO;
+  }
+  [relativePaths sortUsingSelector:@selector(compare:)];
+  
+  NSMutableArray *fullPaths = [NSMutableArray arrayWithCapacity:count];
+  NSMutableData *recordData
+    = [NSMutableData dataWithLength:count * sizeof(HGSFileDigestRecord)];
+  HGSFileDigestRecord *records = [recordData mutableBytes];
+  for (NSUInteger i = 0; i < count; ++i) {
+    NSString *fullPath
+      = [bundlePath stringByAppendingPathComponent:
+         [relativePaths objectAtIndex:i]];
+    [fullPaths addObject:fullPath];
+    struct stat st;
+    if (lstat([fullPath fileSystemRepresentation], &st) != 0) {
+      HGSLogDebug(@"Could not stat %@ for plugin signing", fullPath);
+      return NO;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode)) {
+      HGSLogDebug(@"Unexpected file type for plugin signing: %@", fullPath);
+      return NO;
+    }
+    HGSGetFileDigestKey(&st, &records[i].key);
+  }
+  
+  NSMutableArray *misses = [NSMutableArray array];
+  NSData *cacheKey = nil;
+  @synchronized([HGSCodeSignature class]) {
+    cacheKey = [HGSCodeSignature digestCacheKey];
+    NSMutableDictionary *cache
+      = cacheKey ? [HGSCodeSignature digestCache] : nil;
+    for (NSUInteger i = 0; i < count; ++i) {
+      NSString *fullPath = [fullPaths objectAtIndex:i];
+      NSData *cached = [cache objectForKey:fullPath];
+      const HGSFileDigestCacheEntry *entry = [cached bytes];
+      unsigned char mac[kCodeSignatureDigestLength];
+      if ([cached length] == sizeof(HGSFileDigestCacheEntry)
+          && HGSFileDigestKeysEqual(&entry->record.key, &records[i].key)
+          && HGSDigestCacheMAC(cacheKey, fullPath, &entry->record,
+                               sizeof(entry->record), mac)
+          && memcmp(mac, entry->mac, kCodeSignatureDigestLength) == 0) {
+        memcpy(records[i].digest, entry->record.digest,
+               kCodeSignatureDigestLength);
       } else {
-        // Recurse into the directory
-        succeeded = [self digestDirectory:filePath shaContext:shaCtx];
+        [misses addObject:[NSNumber numberWithUnsignedInteger:i]];
+      }
+    }
+  }
+  
+  NSUInteger missCount = [misses count];
+  if (missCount) {
+    NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+    NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+    [queue setMaxConcurrentOperationCount:cores];
+    // Deal the files out round robin over a few operations per core so that
+    // one large file doesn't leave the other cores idle.
+    NSUInteger operationCount = MIN(missCount, cores * 4);
+    NSMutableArray *operations
+      = [NSMutableArray arrayWithCapacity:operationCount];
+    for (NSUInteger i = 0; i < operationCount; ++i) {
+      NSMutableArray *indexes = [NSMutableArray array];
+      for (NSUInteger j = i; j < missCount; j += operationCount) {
+        [indexes addObject:[misses objectAtIndex:j]];
+      }
+      HGSFileDigestOperation *operation
+        = [[[HGSFileDigestOperation alloc] initWithPaths:fullPaths
+                                                 indexes:indexes
+                                                 records:records]
+           autorelease];
+      [operations addObject:operation];
+      [queue addOperation:operation];
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    for (HGSFileDigestOperation *operation in operations) {
+      if (![operation succeeded]) {
+        return NO;
+      }
+    }
+    
+    time_t racyLimit = time(NULL) - kHGSDigestRacyInterval;
+    @synchronized([HGSCodeSignature class]) {
+      NSMutableDictionary *cache
+        = cacheKey ? [HGSCodeSignature digestCache] : nil;
+      for (NSNumber *missIndex in misses) {
+        NSUInteger i = [missIndex unsignedIntegerValue];
+        NSString *fullPath = [fullPaths objectAtIndex:i];
+        HGSFileDigestCacheEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.record = records[i];
+        if (cache
+            && records[i].key.modified.tv_sec < racyLimit
+            && records[i].key.changed.tv_sec < racyLimit
+            && HGSDigestCacheMAC(cacheKey, fullPath, &entry.record,
+                                 sizeof(entry.record), entry.mac)) {
+          NSData *cached = [NSData dataWithBytes:&entry length:sizeof(entry)];
+          [cache setObject:cached forKey:fullPath];
+          gHGSDigestCacheDirty = YES;
+        }
       }
+      // Forget files that have been removed from the bundle.
+      NSString *bundlePrefix = [bundlePath stringByAppendingString:@"/"];
+      NSSet *currentPaths = [NSSet setWithArray:fullPaths];
+      for (NSString *cachedPath in [cache allKeys]) {
+        if ([cachedPath hasPrefix:bundlePrefix]
+            && ![currentPaths containsObject:cachedPath]) {
+          [cache removeObjectForKey:cachedPath];
+          gHGSDigestCacheDirty = YES;
+        }
+      }
+      [HGSCodeSignature saveDigestCache];
     }
-    result = succeeded;
   }
+  
+  SHA_CTX ctx;
+  if (!SHA1_Init(&ctx)) {
+    HGSLogDebug(@"Could not instantiate a SHA1 context for plugin signing");
+    return NO;
+  }
+  for (NSUInteger i = 0; i < count; ++i) {
+    // The terminating NUL keeps one path from running into the next entry.
+    const char *path = [[relativePaths objectAtIndex:i] UTF8String];
+    unsigned char type = S_ISLNK(records[i].key.mode) ? 'l' : 'f';
+    SHA1_Update(&ctx, path, strlen(path) + 1);
+    SHA1_Update(&ctx, &type, sizeof(type));
+    SHA1_Update(&ctx, records[i].digest, kCodeSignatureDigestLength);
+  }
+  return (SHA1_Final(digest, &ctx) != 0);
+}
 
-  return result;
++ (NSString *)digestCachePath {
+  id<HGSDelegate> delegate = [[HGSPluginLoader sharedPluginLoader] delegate];
+  NSString *cacheFolder = [delegate userCacheFolderForApp];
+  return [cacheFolder stringByAppendingPathComponent:kHGSDigestCacheFile];
+}
+
+// Must be called while synchronized on the class.
++ (NSMutableDictionary *)digestCache {
+  if (!gHGSDigestCache) {
+    NSString *path = [self digestCachePath];
+    NSDictionary *plist = nil;
+    if (path) {
+      @try {
+        plist = [NSDictionary dictionaryWithContentsOfFile:path];
+      }
+      @catch (NSException *e) {
+        HGSLog(@"Unable to load plugin digest cache (%@)", e);
+      }
+    }
+    NSInteger version
+      = [[plist objectForKey:kHGSDigestCacheVersionKey] integerValue];
+    NSDictionary *entries = nil;
+    if (version == kHGSDigestCacheVersion) {
+      entries = [plist objectForKey:kHGSDigestCacheEntriesKey];
+    }
+    if ([entries isKindOfClass:[NSDictionary class]]) {
+      gHGSDigestCache = [entries mutableCopy];
+    } else {
+      gHGSDigestCache = [[NSMutableDictionary alloc] init];
+    }
+  }
+  return gHGSDigestCache;
+}
+
+// Must be called while synchronized on the class. Returns nil (and the cache
+// must not be used) if the keychain can't give us a key.
++ (NSData *)digestCacheKey {
+  if (!gHGSDigestCacheKeyLoaded) {
+    gHGSDigestCacheKeyLoaded = YES;
+    HGSKeychainItem *item
+      = [HGSKeychainItem keychainItemForService:kHGSDigestCacheKeychainService
+                                       username:kHGSDigestCacheKeychainAccount
+                                     inKeychain:gHGSDigestCacheKeychain];
+    NSString *hexKey = [item password];
+    if (!item) {
+      NSFileHandle *random
+        = [NSFileHandle fileHandleForReadingAtPath:@"/dev/urandom"];
+      NSData *bytes = [random readDataOfLength:kHGSDigestCacheKeyLength];
+      [random closeFile];
+      if ([bytes length] == kHGSDigestCacheKeyLength) {
+        NSMutableString *newKey = [NSMutableString string];
+        const unsigned char *keyBytes = [bytes bytes];
+        for (size_t i = 0; i < kHGSDigestCacheKeyLength; ++i) {
+          [newKey appendFormat:@"%02x", keyBytes[i]];
+        }
+        item = [HGSKeychainItem
+                addKeychainItemForService:kHGSDigestCacheKeychainService
+                             withUsername:kHGSDigestCacheKeychainAccount
+                                 password:newKey
+                               toKeychain:gHGSDigestCacheKeychain];
+        hexKey = item ? newKey : nil;
+      }
+    }
+    if ([hexKey length] == kHGSDigestCacheKeyLength * 2) {
+      gHGSDigestCacheKey
+        = [[hexKey dataUsingEncoding:NSUTF8StringEncoding] retain];
+    } else {
+      HGSLog(@"Unable to get the plugin digest cache key from the keychain");
+    }
+  }
+  return gHGSDigestCacheKey;
+}
+
+// Keeps the cache key in |keychain| instead of the default keychain, so that
+// tests don't touch the user's keychains. Pass NULL to go back.
++ (void)setDigestCacheKeychain:(SecKeychainRef)keychain {
+  @synchronized(self) {
+    if (keychain) {
+      CFRetain(keychain);
+    }
+    if (gHGSDigestCacheKeychain) {
+      CFRelease(gHGSDigestCacheKeychain);
+    }
+    gHGSDigestCacheKeychain = keychain;
+    // Entries made with the old key no longer check out, which is fine.
+    [gHGSDigestCacheKey release];
+    gHGSDigestCacheKey = nil;
+    gHGSDigestCacheKeyLoaded = NO;
+  }
+}
+
+// Must be called while synchronized on the class.
++ (void)saveDigestCache {
+  NSString *path = [self digestCachePath];
+  if (!gHGSDigestCacheDirty || !path) {
+    return;
+  }
+  NSDictionary *plist
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithInteger:kHGSDigestCacheVersion],
+       kHGSDigestCacheVersionKey,
+       gHGSDigestCache, kHGSDigestCacheEntriesKey,
+       nil];
+  NSString *error = nil;
+  NSData *data
+    = [NSPropertyListSerialization
+       dataFromPropertyList:plist
+                     format:NSPropertyListBinaryFormat_v1_0
+           errorDescription:&error];
+  if (data && [data writeToFile:path atomically:YES]) {
+    NSDictionary *attributes
+      = [NSDictionary dictionaryWithObject:[NSNumber numberWithShort:0600]
+                                    forKey:NSFilePosixPermissions];
+    [[NSFileManager defaultManager] setAttributes:attributes
+                                     ofItemAtPath:path
+                                            error:nil];
+    gHGSDigestCacheDirty = NO;
+  } else {
+    HGSLog(@"Unable to save plugin digest cache to %@ (%@)", path, error);
+    [error release];
+  }
 }
 
 @end
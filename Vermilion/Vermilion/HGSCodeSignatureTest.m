@@ -32,17 +32,55 @@
 //
 
 #import <Foundation/Foundation.h>
+#import <Security/Security.h>
+#import <openssl/sha.h>
 #import "GTMSenTestCase.h"
 #import "HGSCodeSignature.h"
 
+@interface HGSCodeSignature (HGSCodeSignatureTestPrivate)
++ (NSMutableDictionary *)digestCache;
++ (void)setDigestCacheKeychain:(SecKeychainRef)keychain;
+- (BOOL)digest:(unsigned char *)digest;
+@end
 
-@interface HGSCodeSignatureTest : GTMTestCase
+@interface HGSCodeSignatureTest : GTMTestCase {
+ @private
+  NSString *keychainPath_;
+  SecKeychainRef keychain_;
+}
 @end
 
 static NSString *kAppPath = @"/Applications/System Preferences.app";
 
 @implementation HGSCodeSignatureTest
 
+- (void)setUp {
+  // The digest cache keeps its key in the keychain; keep it out of the
+  // user's keychains.
+  keychainPath_
+    = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+        [NSString stringWithFormat:@"HGSCodeSignatureTest-%d.keychain",
+         [[NSProcessInfo processInfo] processIdentifier]]] retain];
+  [[NSFileManager defaultManager] removeItemAtPath:keychainPath_ error:nil];
+  const char *password = "HGSCodeSignatureTest";
+  OSStatus status = SecKeychainCreate([keychainPath_ fileSystemRepresentation],
+                                      (UInt32)strlen(password), password,
+                                      FALSE, NULL, &keychain_);
+  STAssertEquals(status, (OSStatus)noErr, nil);
+  [HGSCodeSignature setDigestCacheKeychain:keychain_];
+}
+
+- (void)tearDown {
+  [HGSCodeSignature setDigestCacheKeychain:NULL];
+  if (keychain_) {
+    SecKeychainDelete(keychain_);
+    CFRelease(keychain_);
+    keychain_ = NULL;
+  }
+  [keychainPath_ release];
+  keychainPath_ = nil;
+}
+
 - (void)testKeyedSignature {
   NSBundle *appBundle
     = [NSBundle bundleWithPath:kAppPath];
@@ -110,4 +148,170 @@ static NSString *kAppPath = @"/Applications/System Preferences.app";
   CFRelease(cert);
 }
 
+- (void)testDigestSignature {
+  // Build a script style bundle (no Mach-O executable) with a few thousand
+  // resources so that it gets a digest signature.
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *bundlePath
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"HGSCodeSignatureTest-%d.hgs",
+        [[NSProcessInfo processInfo] processIdentifier]]];
+  [fm removeItemAtPath:bundlePath error:nil];
+  NSString *contentsPath
+    = [bundlePath stringByAppendingPathComponent:@"Contents"];
+  NSString *resourcesPath
+    = [contentsPath stringByAppendingPathComponent:@"Resources"];
+  STAssertTrue([fm createDirectoryAtPath:resourcesPath
+             withIntermediateDirectories:YES
+                              attributes:nil
+                                   error:nil], nil);
+  NSDictionary *info
+    = [NSDictionary dictionaryWithObject:@"com.google.hgs.signaturetest"
+                                  forKey:@"CFBundleIdentifier"];
+  STAssertTrue([info writeToFile:[contentsPath stringByAppendingPathComponent:
+                                  @"Info.plist"]
+                      atomically:YES], nil);
+  NSString *lastFile = nil;
+  for (int dir = 0; dir < 20; ++dir) {
+    NSString *dirPath
+      = [resourcesPath stringByAppendingFormat:@"/dir%02d", dir];
+    STAssertTrue([fm createDirectoryAtPath:dirPath
+               withIntermediateDirectories:YES
+                                attributes:nil
+                                     error:nil], nil);
+    for (int file = 0; file < 100; ++file) {
+      NSString *contents
+        = [@"" stringByPadding:(dir * 100 + file) % 4096
+                    withString:[NSString stringWithFormat:@"%d,", file]
+               startingAtIndex:0];
+      lastFile = [dirPath stringByAppendingFormat:@"/file%03d.js", file];
+      STAssertTrue([contents writeToFile:lastFile
+                              atomically:NO
+                                encoding:NSUTF8StringEncoding
+                                   error:nil], nil);
+    }
+  }
+  // Files changed in the last couple of seconds are never cached, so let
+  // the timestamps age before taking the cold digest.
+  [NSThread sleepForTimeInterval:3.0];
+  
+  NSBundle *bundle = [NSBundle bundleWithPath:bundlePath];
+  HGSCodeSignature *sig = [HGSCodeSignature codeSignatureForBundle:bundle];
+  NSDate *start = [NSDate date];
+  NSData *sigData = [sig generateDetachedSignature];
+  NSTimeInterval cold = -[start timeIntervalSinceNow];
+  STAssertNotNil(sigData, @"failed to create digest signature");
+  
+  start = [NSDate date];
+  HGSSignatureStatus status = [sig verifyDetachedSignature:sigData];
+  NSTimeInterval warm = -[start timeIntervalSinceNow];
+  STAssertEquals(status, eSignatureStatusOK, @"failed to validate signature");
+  // The warm pass takes every file digest from the cache.
+  STAssertLessThan(warm, cold, nil);
+  
+  // A fresh signature object over the same bundle agrees.
+  sig = [HGSCodeSignature codeSignatureForBundle:bundle];
+  status = [sig verifyDetachedSignature:sigData];
+  STAssertEquals(status, eSignatureStatusOK, @"failed to validate signature");
+  
+  // An entry moved over from another file (which has a different digest)
+  // is ignored.
+  @synchronized([HGSCodeSignature class]) {
+    NSMutableDictionary *cache = [HGSCodeSignature digestCache];
+    NSString *target = nil;
+    NSData *otherEntry = nil;
+    for (NSString *path in [cache allKeys]) {
+      // The cache uses standardized paths, which may not match lastFile.
+      if ([path hasSuffix:@"/dir19/file099.js"]) {
+        target = path;
+      } else if ([path hasSuffix:@"/dir00/file001.js"]) {
+        otherEntry = [cache objectForKey:path];
+      }
+    }
+    STAssertNotNil(target, nil);
+    STAssertNotNil(otherEntry, nil);
+    if (target && otherEntry) {
+      [cache setObject:otherEntry forKey:target];
+    }
+  }
+  status = [sig verifyDetachedSignature:sigData];
+  STAssertEquals(status, eSignatureStatusOK, @"forged cache entry trusted");
+  
+  // Changing a single resource invalidates the signature.
+  NSFileHandle *handle = [NSFileHandle fileHandleForWritingAtPath:lastFile];
+  STAssertNotNil(handle, nil);
+  [handle seekToEndOfFile];
+  [handle writeData:[@"evil();" dataUsingEncoding:NSUTF8StringEncoding]];
+  [handle closeFile];
+  status = [sig verifyDetachedSignature:sigData];
+  STAssertEquals(status, eSignatureStatusInvalid,
+                 @"modified bundle accepted");
+  
+  // So does removing one.
+  STAssertTrue([fm removeItemAtPath:lastFile error:nil], nil);
+  status = [sig verifyDetachedSignature:sigData];
+  STAssertEquals(status, eSignatureStatusInvalid,
+                 @"bundle with missing file accepted");
+  
+  [fm removeItemAtPath:bundlePath error:nil];
+}
+
+- (void)testLegacyDigest {
+  // Signatures stored with the original digest must keep verifying, so it
+  // must still hash Info.plist and then Resources in the order it always
+  // did, files in subfolders of Resources included twice.
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *bundlePath
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"HGSCodeSignatureLegacyTest-%d.hgs",
+        [[NSProcessInfo processInfo] processIdentifier]]];
+  [fm removeItemAtPath:bundlePath error:nil];
+  NSString *contentsPath
+    = [bundlePath stringByAppendingPathComponent:@"Contents"];
+  NSString *resourcesPath
+    = [contentsPath stringByAppendingPathComponent:@"Resources"];
+  NSString *subPath = [resourcesPath stringByAppendingPathComponent:@"sub"];
+  STAssertTrue([fm createDirectoryAtPath:subPath
+             withIntermediateDirectories:YES
+                              attributes:nil
+                                   error:nil], nil);
+  NSData *plist = [@"plist" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *a = [@"a();" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *b = [@"b();" dataUsingEncoding:NSUTF8StringEncoding];
+  STAssertTrue([plist writeToFile:[contentsPath stringByAppendingPathComponent:
+                                   @"Info.plist"]
+                       atomically:NO], nil);
+  STAssertTrue([a writeToFile:[resourcesPath stringByAppendingPathComponent:
+                               @"a.js"]
+                   atomically:NO], nil);
+  NSString *bPath = [subPath stringByAppendingPathComponent:@"b.js"];
+  STAssertTrue([b writeToFile:bPath atomically:NO], nil);
+
+  unsigned char expected[SHA_DIGEST_LENGTH];
+  SHA_CTX ctx;
+  SHA1_Init(&ctx);
+  SHA1_Update(&ctx, [plist bytes], [plist length]);
+  SHA1_Update(&ctx, [a bytes], [a length]);
+  SHA1_Update(&ctx, [b bytes], [b length]);
+  SHA1_Update(&ctx, [b bytes], [b length]);
+  SHA1_Final(expected, &ctx);
+
+  NSBundle *bundle = [NSBundle bundleWithPath:bundlePath];
+  HGSCodeSignature *sig = [HGSCodeSignature codeSignatureForBundle:bundle];
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  STAssertTrue([sig digest:digest], nil);
+  STAssertEquals(memcmp(digest, expected, sizeof(digest)), 0, nil);
+  // Again, possibly from the cache.
+  memset(digest, 0, sizeof(digest));
+  STAssertTrue([sig digest:digest], nil);
+  STAssertEquals(memcmp(digest, expected, sizeof(digest)), 0, nil);
+
+  // A changed resource changes the digest.
+  STAssertTrue([a writeToFile:bPath atomically:NO], nil);
+  STAssertTrue([sig digest:digest], nil);
+  STAssertTrue(memcmp(digest, expected, sizeof(digest)) != 0, nil);
+
+  [fm removeItemAtPath:bundlePath error:nil];
+}
+
 @end
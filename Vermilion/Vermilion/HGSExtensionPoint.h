@@ -37,6 +37,22 @@
 
 #import <Foundation/Foundation.h>
 
+/*!
+  An object that can install an extension into an extension point when asked.
+  Used to defer creating an extension until its extension point is first
+  queried. HGSProtoExtension conforms to this.
+*/
+@protocol HGSExtensionInstaller <NSObject>
+/*!
+  Install the extension, if it still wants to be installed. Called on the
+  main thread, except when a lookup by identifier on another thread needs
+  the extension right away; see extensionWithIdentifier:.
+*/
+- (void)installDeferredExtension;
+/*! The identifier of the extension this installs. */
+- (NSString *)identifier;
+@end
+
 /*!
   HGSExtensionPoint objects are a place that plugins can register new
   functionality. Each extension point contains a list of all registered
@@ -49,6 +65,10 @@
 @interface HGSExtensionPoint : NSObject {
  @private
   NSMutableDictionary* extensions_;
+  NSMutableArray *pendingInstallers_;
+  // Held while an installer runs, so that a lookup of an extension that is
+  // being installed waits for it.
+  NSRecursiveLock *installLock_;
   Class class_;
 }
 
@@ -77,10 +97,33 @@
 */
 - (BOOL)extendWithObject:(id)extension;
 
+/*!
+  Ask |installer| to install its extension the first time this point is
+  queried (through extensions or extensionWithIdentifier:) instead of right
+  now.
+*/
+- (void)addPendingInstaller:(id<HGSExtensionInstaller>)installer;
+/*!
+  Forget about a pending installer, if it hasn't been asked to install yet.
+*/
+- (void)removePendingInstaller:(id<HGSExtensionInstaller>)installer;
+/*!
+  Runs any pending installers now. Called from any other thread than the
+  main thread this schedules them on the main thread and returns right away,
+  so the caller only sees extensions that have already been installed.
+*/
+- (void)installPendingExtensions;
+/*!
+  Runs the pending installers of every extension point. Must be called on
+  the main thread.
+*/
++ (void)installAllPendingExtensions;
 #pragma mark Access
 
 /*!
-  Returns the extension with the given identifier.
+  Returns the extension with the given identifier. If it is still waiting to
+  be installed it is installed first, on the calling thread if that isn't
+  the main thread, so a pending extension is never missed.
 */
 - (id)extensionWithIdentifier:(NSString *)identifier;
 
@@ -47,6 +47,7 @@ static NSMutableDictionary *sHGSExtensionPoints = nil;
 
 @interface HGSExtensionPoint ()
 - (BOOL)verifyExtension:(id)extension;
+- (id)installPendingExtensionWithIdentifier:(NSString *)identifier;
 @end
 
 @implementation HGSExtensionPoint
@@ -69,10 +70,21 @@ static NSMutableDictionary *sHGSExtensionPoints = nil;
   return point;
 }
 
++ (void)installAllPendingExtensions {
+  HGSAssert([NSThread isMainThread], @"Must be called on the main thread");
+  NSArray *points;
+  @synchronized(sHGSExtensionPoints) {
+    points = [sHGSExtensionPoints allValues];
+  }
+  [points makeObjectsPerformSelector:@selector(installPendingExtensions)];
+}
+
 - (id)init {
   self = [super init];
   if (self != nil) {
     extensions_ = [[NSMutableDictionary alloc] init];
+    pendingInstallers_ = [[NSMutableArray alloc] init];
+    installLock_ = [[NSRecursiveLock alloc] init];
   }
   return self;
 }
@@ -82,6 +94,8 @@ static NSMutableDictionary *sHGSExtensionPoints = nil;
   // Since these get stored away in a static dictionary
   // we never get released.
   [extensions_ release];
+  [pendingInstallers_ release];
+  [installLock_ release];
   [super dealloc];
 }
 // COV_NF_END
@@ -163,6 +177,87 @@ static NSMutableDictionary *sHGSExtensionPoints = nil;
   return wasGood;
 }
 
+- (void)addPendingInstaller:(id<HGSExtensionInstaller>)installer {
+  @synchronized(extensions_) {
+    if ([pendingInstallers_ indexOfObjectIdenticalTo:installer] == NSNotFound) {
+      [pendingInstallers_ addObject:installer];
+    }
+  }
+}
+
+- (void)removePendingInstaller:(id<HGSExtensionInstaller>)installer {
+  @synchronized(extensions_) {
+    [pendingInstallers_ removeObjectIdenticalTo:installer];
+  }
+}
+
+- (void)installPendingExtensions {
+  if (![NSThread isMainThread]) {
+    // Extensions expect to be created on the main thread. Never wait for it
+    // though: the main thread may be waiting on a lock our caller holds.
+    // Searches are started after HGSQueryController has installed
+    // everything, so in practice this only happens while the plugin loader
+    // is still warming up. Lookups by identifier install what they need
+    // themselves, see installPendingExtensionWithIdentifier:.
+    BOOL hasPending;
+    @synchronized(extensions_) {
+      hasPending = [pendingInstallers_ count] > 0;
+    }
+    if (hasPending) {
+      [self performSelectorOnMainThread:@selector(installPendingExtensions)
+                             withObject:nil
+                          waitUntilDone:NO];
+    }
+    return;
+  }
+  // Take them one at a time so that an extension which queries its own
+  // point while being created doesn't get installed twice.
+  for (;;) {
+    id<HGSExtensionInstaller> installer = nil;
+    [installLock_ lock];
+    @synchronized(extensions_) {
+      if ([pendingInstallers_ count]) {
+        installer = [[[pendingInstallers_ objectAtIndex:0] retain] autorelease];
+        [pendingInstallers_ removeObjectAtIndex:0];
+      }
+    }
+    [installer installDeferredExtension];
+    [installLock_ unlock];
+    if (!installer) break;
+  }
+}
+
+// Installs the extension for |identifier| on the calling thread if it is
+// still pending, or waits for it if another thread is installing it. The
+// rest are left to the main thread.
+- (id)installPendingExtensionWithIdentifier:(NSString *)identifier {
+  id result = nil;
+  [installLock_ lock];
+  id<HGSExtensionInstaller> installer = nil;
+  @synchronized(extensions_) {
+    result = [extensions_ objectForKey:identifier];
+    if (!result) {
+      for (id<HGSExtensionInstaller> pending in pendingInstallers_) {
+        if ([[pending identifier] isEqualToString:identifier]) {
+          installer = [[pending retain] autorelease];
+          break;
+        }
+      }
+      if (installer) {
+        [pendingInstallers_ removeObjectIdenticalTo:installer];
+      }
+    }
+  }
+  if (installer) {
+    [installer installDeferredExtension];
+    @synchronized(extensions_) {
+      result = [extensions_ objectForKey:identifier];
+    }
+  }
+  [installLock_ unlock];
+  return result;
+}
+
 - (NSString *)description {
   NSString *result
     = [NSString stringWithFormat:@"%@, Class: '%@', Extensions: %@",
@@ -174,14 +269,19 @@ static NSMutableDictionary *sHGSExtensionPoints = nil;
 #pragma mark Access
 
 - (id)extensionWithIdentifier:(NSString *)identifier {
+  [self installPendingExtensions];
   id result;
   @synchronized(extensions_) {
     result = [extensions_ objectForKey:identifier];
   }
+  if (!result && ![NSThread isMainThread]) {
+    result = [self installPendingExtensionWithIdentifier:identifier];
+  }
   return result;
 }
 
 - (NSArray *)extensions {
+  [self installPendingExtensions];
   NSArray *result;
   @synchronized(extensions_) {
     // This yields a temp array safe to iterate if our data gets changed.
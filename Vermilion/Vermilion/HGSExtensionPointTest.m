@@ -39,6 +39,9 @@
   BOOL gotPointDidAddNotification_;
   BOOL gotPointWillRemoveNotification_;
   BOOL gotPointDidRemoveNotification_;
+  NSUInteger backgroundExtensionCount_;
+  id backgroundExtension_;
+  volatile BOOL backgroundQueryDone_;
 }
 @end
 
@@ -81,6 +84,50 @@
 @implementation DifferentTestExtension
 @end
 
+@interface PendingTestInstaller : NSObject <HGSExtensionInstaller> {
+  HGSExtensionPoint *point_;
+  NSString *identifier_;
+  NSUInteger installCount_;
+}
+- (id)initWithPoint:(HGSExtensionPoint *)point
+         identifier:(NSString *)identifier;
+- (NSUInteger)installCount;
+@end
+
+@implementation PendingTestInstaller
+- (id)initWithPoint:(HGSExtensionPoint *)point
+         identifier:(NSString *)identifier {
+  if ((self = [super init])) {
+    point_ = [point retain];
+    identifier_ = [identifier copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [point_ release];
+  [identifier_ release];
+  [super dealloc];
+}
+
+- (void)installDeferredExtension {
+  ++installCount_;
+  // Querying our own point while installing must not recurse.
+  [point_ extensions];
+  MyTestExtension *extension 
+    = [[[MyTestExtension alloc] initWithIdentifier:identifier_] autorelease];
+  [point_ extendWithObject:extension];
+}
+
+- (NSUInteger)installCount {
+  return installCount_;
+}
+
+- (NSString *)identifier {
+  return identifier_;
+}
+@end
+
 
 @implementation HGSExtensionPointTest
 
@@ -228,6 +275,120 @@
                 @"nsion', Extensions: ("], @"Bad Description: %@", description);
 }
 
+- (void)testPendingInstallers {
+  HGSExtensionPoint *newPoint
+    = [HGSExtensionPoint pointWithIdentifier:@"testPendingInstallers"];
+  [newPoint setKindOfClass:[MyTestExtension class]];
+  PendingTestInstaller *installer1
+    = [[[PendingTestInstaller alloc] initWithPoint:newPoint
+                                        identifier:@"pending1"] autorelease];
+  PendingTestInstaller *installer2
+    = [[[PendingTestInstaller alloc] initWithPoint:newPoint
+                                        identifier:@"pending2"] autorelease];
+  [newPoint addPendingInstaller:installer1];
+  [newPoint addPendingInstaller:installer1];
+  [newPoint addPendingInstaller:installer2];
+  [newPoint removePendingInstaller:installer2];
+  STAssertEquals([installer1 installCount], (NSUInteger)0, nil);
+  
+  // The first query installs whatever is pending, once.
+  STAssertNotNil([newPoint extensionWithIdentifier:@"pending1"], nil);
+  STAssertEquals([installer1 installCount], (NSUInteger)1, nil);
+  STAssertEquals([[newPoint extensions] count], (NSUInteger)1, nil);
+  STAssertEquals([installer1 installCount], (NSUInteger)1, nil);
+  STAssertEquals([installer2 installCount], (NSUInteger)0, nil);
+}
+
+- (void)queryPointInBackground:(HGSExtensionPoint *)point {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  backgroundExtensionCount_ = [[point extensions] count];
+  backgroundQueryDone_ = YES;
+  [pool release];
+}
+
+- (void)testPendingInstallersOffMainThread {
+  HGSExtensionPoint *newPoint
+    = [HGSExtensionPoint pointWithIdentifier:@"testPendingOffMainThread"];
+  [newPoint setKindOfClass:[MyTestExtension class]];
+  PendingTestInstaller *installer
+    = [[[PendingTestInstaller alloc] initWithPoint:newPoint
+                                        identifier:@"pending"] autorelease];
+  [newPoint addPendingInstaller:installer];
+
+  // A background query must not wait on the main thread, which isn't
+  // spinning its run loop here.
+  backgroundQueryDone_ = NO;
+  [NSThread detachNewThreadSelector:@selector(queryPointInBackground:)
+                           toTarget:self
+                         withObject:newPoint];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+  while (!backgroundQueryDone_ && [timeout timeIntervalSinceNow] > 0) {
+    [NSThread sleepForTimeInterval:0.01];
+  }
+  STAssertTrue(backgroundQueryDone_, @"Background query blocked");
+  STAssertEquals(backgroundExtensionCount_, (NSUInteger)0, nil);
+  STAssertEquals([installer installCount], (NSUInteger)0, nil);
+
+  // The install it scheduled runs once the main thread gets to it.
+  [[NSRunLoop currentRunLoop]
+    runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  STAssertEquals([installer installCount], (NSUInteger)1, nil);
+  STAssertNotNil([newPoint extensionWithIdentifier:@"pending"], nil);
+}
+
+- (void)lookUpPendingInBackground:(HGSExtensionPoint *)point {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  backgroundExtension_
+    = [[point extensionWithIdentifier:@"pendingLookup"] retain];
+  backgroundQueryDone_ = YES;
+  [pool release];
+}
+
+- (void)testPendingLookupOffMainThread {
+  HGSExtensionPoint *newPoint
+    = [HGSExtensionPoint pointWithIdentifier:@"testPendingLookup"];
+  [newPoint setKindOfClass:[MyTestExtension class]];
+  PendingTestInstaller *installer
+    = [[[PendingTestInstaller alloc] initWithPoint:newPoint
+                                        identifier:@"pendingLookup"]
+       autorelease];
+  [newPoint addPendingInstaller:installer];
+
+  // A lookup by identifier installs what it asks for itself, without
+  // waiting for the main thread.
+  backgroundQueryDone_ = NO;
+  backgroundExtension_ = nil;
+  [NSThread detachNewThreadSelector:@selector(lookUpPendingInBackground:)
+                           toTarget:self
+                         withObject:newPoint];
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+  while (!backgroundQueryDone_ && [timeout timeIntervalSinceNow] > 0) {
+    [NSThread sleepForTimeInterval:0.01];
+  }
+  STAssertTrue(backgroundQueryDone_, @"Background lookup blocked");
+  STAssertNotNil(backgroundExtension_, nil);
+  STAssertEquals([installer installCount], (NSUInteger)1, nil);
+  [backgroundExtension_ release];
+  backgroundExtension_ = nil;
+
+  // Nothing is left for the main thread to install.
+  [[NSRunLoop currentRunLoop]
+    runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+  STAssertEquals([installer installCount], (NSUInteger)1, nil);
+}
+
+- (void)testInstallAllPendingExtensions {
+  HGSExtensionPoint *newPoint
+    = [HGSExtensionPoint pointWithIdentifier:@"testInstallAllPending"];
+  [newPoint setKindOfClass:[MyTestExtension class]];
+  PendingTestInstaller *installer
+    = [[[PendingTestInstaller alloc] initWithPoint:newPoint
+                                        identifier:@"pendingAll"] autorelease];
+  [newPoint addPendingInstaller:installer];
+  [HGSExtensionPoint installAllPendingExtensions];
+  STAssertEquals([installer installCount], (NSUInteger)1, nil);
+}
+
 - (void)pointDidAddNotification:(NSNotification *)notification {
   STAssertEquals([[notification object] class], [HGSExtensionPoint class], nil);
   NSDictionary *userInfo = [notification userInfo];
@@ -38,6 +38,7 @@
 #import <Vermilion/HGSMemorySearchSource.h>
 #import <Vermilion/HGSAccount.h>
 
+@class GDataEntryBase;
 @class GDataServiceGoogle;
 @class GDataServiceTicket;
 @class HGSGDataServiceIndexContext;
@@ -49,6 +50,16 @@ extern NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey;
 
 /*!
  A wrapper for a GDataServiceSource.
+ 
+ Feeds fetched with
+ fetchFeedWithURL:feedClass:deltaCapable:context:didFinishSelector: are
+ synced rather than refetched. Each feed's ETag and updated stamp are kept
+ (and persisted, along with the feed itself), so an unchanged feed costs a
+ 304 and no parsing. Entries indexed between
+ -[HGSGDataServiceIndexContext beginIndexingEntry:forTicket:] and
+ -[HGSGDataServiceIndexContext endIndexingEntry] are remembered individually,
+ so only added and changed entries are reindexed, and deleted entries drop
+ out of the index.
 */
 @interface HGSGDataServiceSource : HGSMemorySearchSource <HGSAccountClientProtocol> {
  @private
@@ -60,6 +71,10 @@ extern NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey;
   NSTimer *updateTimer_;
   HGSAccount *account_;
   NSTimeInterval previousErrorReportingTime_;
+  NSDictionary *feedSyncStates_;
+  NSDictionary *entryFragments_;
+  NSString *syncStatePath_;
+  BOOL syncStateLoaded_;
 }
 
 @property (readonly, retain) HGSAccount *account;
@@ -76,8 +91,45 @@ extern NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey;
 - (void)ticketHandled:(GDataServiceTicket *)ticket
            forContext:(HGSGDataServiceIndexContext *)context;
 
+/*!
+ Fetch a feed through the sync layer. The request is made conditional on the
+ ETag of the last copy of the feed. finishedSelector has the usual GData form
+ <p><code>
+   - (void)ticket:(GDataServiceTicket *)ticket
+ finishedWithFeed:(GDataFeedBase *)feed
+            error:(NSError *)error;
+ </code></p>
+ and is always called with every current entry of the feed; if the feed
+ hasn't changed it is the cached copy and no parsing was done. The ticket's
+ userData is the context, and the ticket has already been added to it.
+ @param feedURL The feed to fetch.
+ @param feedClass The class of the feed, or nil to infer it from the XML.
+ @param deltaCapable YES if the feed supports updated-min and showdeleted, in
+        which case only entries changed since the last sync are requested and
+        are merged into the cached feed.
+ @param context The context of the current indexing pass.
+ @param finishedSelector The selector to call on the receiver.
+*/
+- (GDataServiceTicket *)fetchFeedWithURL:(NSURL *)feedURL
+                               feedClass:(Class)feedClass
+                            deltaCapable:(BOOL)deltaCapable
+                                 context:(HGSGDataServiceIndexContext *)context
+                       didFinishSelector:(SEL)finishedSelector;
+
+/*!
+ Forget all sync state, so that the next indexing pass refetches and
+ reindexes everything.
+*/
+- (void)resetSyncState;
+
 // Methods to override
-- (GDataServiceTicket *)fetchTicketForService:(GDataServiceGoogle *)service;
+
+/*!
+ Start the fetches for an indexing pass. Usually implemented with
+ fetchFeedWithURL:feedClass:deltaCapable:context:didFinishSelector:.
+*/
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context;
 - (Class)serviceClass;
 
 @end
@@ -92,9 +144,21 @@ extern NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey;
   NSMutableArray *tickets_;
   GDataServiceGoogle *service_;
   HGSMemorySearchSourceDB *database_;
+  NSDictionary *previousFragments_;
+  NSMutableDictionary *fragments_;
+  NSMutableDictionary *feedSyncStates_;
+  NSMutableSet *syncedFeedKeys_;
+  NSDictionary *previousChildKeys_;
+  NSString *currentEntryKey_;
+  HGSMemorySearchSourceDB *currentEntryDatabase_;
+  BOOL feedSyncStatesChanged_;
 }
 
 @property (readonly, retain) GDataServiceGoogle *service;
+/*!
+ The database to index into. Between beginIndexingEntry:forTicket: and
+ endIndexingEntry this is the database for that entry alone.
+*/
 @property (readonly, retain) HGSMemorySearchSourceDB *database;
 /*!
  Is the operation done (either finished or cancelled).
@@ -117,4 +181,18 @@ extern NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey;
 */
 - (void)cancelTickets;
 
+/*!
+ Start indexing an entry from a feed fetched through the sync layer.
+ @result NO if the entry is unchanged since the last sync. Its results, and
+         those of any feeds fetched while it was last indexed, have been kept
+         and the entry should be skipped. Do not call endIndexingEntry.
+*/
+- (BOOL)beginIndexingEntry:(GDataEntryBase *)entry
+                 forTicket:(GDataServiceTicket *)ticket;
+
+/*!
+ Finish indexing the entry started with beginIndexingEntry:forTicket:.
+*/
+- (void)endIndexingEntry;
+
 @end
@@ -35,6 +35,9 @@
 #import "HGSLog.h"
 #import "HGSKeychainItem.h"
 #import "HGSOperation.h"
+#import "HGSDelegate.h"
+#import "HGSPluginLoader.h"
+#import <GTM/GTMTypeCasting.h>
 
 NSString *const kHGSGDataServiceSourceRefreshIntervalKey
   = @"HGSGDataServiceSourceRefreshIntervalKey";
@@ -44,6 +47,81 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   = @"HGSGDataServiceSourceErrorReportingIntervalKey";
 
 
+// Ticket properties used by the sync layer.
+static NSString *const kHGSGDataSyncFeedKey = @"HGSGDataSyncFeed";
+static NSString *const kHGSGDataSyncFeedClassKey = @"HGSGDataSyncFeedClass";
+static NSString *const kHGSGDataSyncSelectorKey = @"HGSGDataSyncSelector";
+static NSString *const kHGSGDataSyncDeltaCapableKey
+  = @"HGSGDataSyncDeltaCapable";
+static NSString *const kHGSGDataSyncIsDeltaKey = @"HGSGDataSyncIsDelta";
+static NSString *const kHGSGDataSyncOwnerKey = @"HGSGDataSyncOwner";
+static NSString *const kHGSGDataSyncRetriedKey = @"HGSGDataSyncRetried";
+
+// Keys for the persisted sync state.
+static NSString *const kHGSGDataSyncVersionKey = @"HGSGDataSyncVersion";
+static NSString *const kHGSGDataSyncVersion = @"1";
+static NSString *const kHGSGDataSyncFeedsKey = @"HGSGDataSyncFeeds";
+static NSString *const kHGSGDataSyncETagKey = @"ETag";
+static NSString *const kHGSGDataSyncUpdatedKey = @"Updated";
+static NSString *const kHGSGDataSyncClassKey = @"FeedClass";
+static NSString *const kHGSGDataSyncXMLKey = @"FeedXML";
+
+// What we remember about a feed between syncs. Immutable once created, so
+// that a cancelled indexing pass can't disturb the state of the next one.
+@interface HGSGDataFeedSyncState : NSObject {
+ @private
+  NSString *ETag_;
+  NSString *updated_;
+  NSString *feedClassName_;
+  GDataFeedBase *feed_;
+  NSData *feedData_;
+}
+@property (readonly, copy) NSString *ETag;
+@property (readonly, copy) NSString *updated;
+
++ (id)stateWithFeed:(GDataFeedBase *)feed
+               ETag:(NSString *)ETag
+            updated:(NSString *)updated;
++ (id)stateWithArchiveRepresentation:(NSDictionary *)archive;
+- (id)initWithFeed:(GDataFeedBase *)feed
+          feedData:(NSData *)feedData
+     feedClassName:(NSString *)feedClassName
+              ETag:(NSString *)ETag
+           updated:(NSString *)updated;
+// The cached feed. Feeds loaded from disk are parsed on first use.
+- (GDataFeedBase *)feed;
+- (NSDictionary *)archiveRepresentation;
+@end
+
+// The part of the index built from a single feed entry.
+@interface HGSGDataEntryFragment : NSObject {
+ @private
+  NSString *stamp_;
+  NSString *parentKey_;
+  HGSMemorySearchSourceDB *database_;
+}
+@property (readonly, copy) NSString *stamp;
+@property (readonly, copy) NSString *parentKey;
+@property (readonly, retain) HGSMemorySearchSourceDB *database;
+- (id)initWithStamp:(NSString *)stamp parentKey:(NSString *)parentKey;
+@end
+
+@interface HGSGDataServiceIndexContext ()
+@property (readonly, copy) NSString *currentEntryKey;
+@property (readonly, assign) BOOL feedSyncStatesChanged;
+- (void)setFeedSyncStates:(NSDictionary *)feedSyncStates
+        previousFragments:(NSDictionary *)previousFragments;
+- (HGSGDataFeedSyncState *)syncStateForFeedKey:(NSString *)feedKey;
+- (void)setSyncState:(HGSGDataFeedSyncState *)state
+          forFeedKey:(NSString *)feedKey;
+- (void)noteSyncedFeedKey:(NSString *)feedKey;
+// The states of the feeds synced during this pass.
+- (NSDictionary *)feedSyncStates;
+- (NSDictionary *)fragments;
+- (void)keepFragmentsForFeedKey:(NSString *)feedKey;
+- (void)carryOverFragmentWithKey:(NSString *)key;
+@end
+
 @interface NSError (GoogleCalendarsSource)
 
 // Create a new error by adding a fetch type to an existing errors userInfo.
@@ -56,8 +134,64 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
                   withJitter:(NSTimeInterval)jitter;
 - (void)loginCredentialsChanged:(NSNotification *)notification;
 - (void)refreshIndex:(NSTimer*)timer;
+- (GDataServiceTicket *)fetchFeedWithURL:(NSURL *)feedURL
+                               feedClass:(Class)feedClass
+                            deltaCapable:(BOOL)deltaCapable
+                                   owner:(NSString *)owner
+                                 context:(HGSGDataServiceIndexContext *)context
+                       didFinishSelector:(SEL)finishedSelector;
+- (void)syncTicket:(GDataServiceTicket *)ticket
+  finishedWithFeed:(GDataFeedBase *)feed
+             error:(NSError *)error;
+- (void)loadSyncStateIfNeeded;
+- (void)saveSyncState;
+- (void)commitSyncForContext:(HGSGDataServiceIndexContext *)context;
 @end
 
+// Returns a copy of |feed| with the changes in |delta| (fetched with
+// updated-min and showdeleted) applied to it.
+static GDataFeedBase *HGSGDataMergeFeed(GDataFeedBase *feed,
+                                        GDataFeedBase *delta) {
+  NSMutableDictionary *changes = [NSMutableDictionary dictionary];
+  NSMutableArray *added = [NSMutableArray array];
+  for (GDataEntryBase *entry in [delta entries]) {
+    NSString *identifier = [entry identifier];
+    if (!identifier) continue;
+    id change = [entry isDeleted] ? (id)[NSNull null] : (id)entry;
+    [changes setObject:change forKey:identifier];
+    if (![entry isDeleted]) {
+      [added addObject:identifier];
+    }
+  }
+  NSMutableArray *entries = [NSMutableArray array];
+  for (GDataEntryBase *entry in [feed entries]) {
+    NSString *identifier = [entry identifier];
+    id change = identifier ? [changes objectForKey:identifier] : nil;
+    if (!change) {
+      [entries addObject:entry];
+    } else if (change != [NSNull null]) {
+      [entries addObject:change];
+      [added removeObject:identifier];
+    }
+  }
+  for (NSString *identifier in added) {
+    [entries addObject:[changes objectForKey:identifier]];
+  }
+  GDataFeedBase *merged = [[feed copy] autorelease];
+  [merged setEntriesWithEntries:entries];
+  return merged;
+}
+
+// What we compare to decide whether an entry has changed since it was
+// last indexed.
+static NSString *HGSGDataEntryStamp(GDataEntryBase *entry) {
+  NSString *stamp = [entry ETag];
+  if (![stamp length]) {
+    stamp = [[entry updatedDate] RFC3339String];
+  }
+  return stamp;
+}
+
 @implementation HGSGDataServiceSource
 
 @synthesize account = account_;
@@ -93,6 +227,13 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
     }
 
     if (account_) {
+      id<HGSDelegate> delegate
+        = [[HGSPluginLoader sharedPluginLoader] delegate];
+      NSString *cacheFolder = [delegate userCacheFolderForApp];
+      NSString *filename
+        = [NSString stringWithFormat:@"%@.gdatasync.plist", [self identifier]];
+      syncStatePath_
+        = [[cacheFolder stringByAppendingPathComponent:filename] retain];
       // Watch for credential changes.
       NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
       [nc addObserver:self
@@ -117,28 +258,44 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   [account_ release];
   [updateTimer_ release];
   [indexOp_ release];
+  [feedSyncStates_ release];
+  [entryFragments_ release];
+  [syncStatePath_ release];
   [super dealloc];
 }
 
 - (void)uninstall {
   [indexOp_ cancel];
   [updateTimer_ invalidate];
+  [self resetSyncState];
   [super uninstall];
 }
 
 #pragma mark -
 #pragma mark Album Fetching
 
-- (void)asyncFetch:(GDataServiceGooglePhotos *)service operation:(NSOperation *)op{
-  GDataServiceTicket *ticket = [self fetchTicketForService:service];
+- (void)asyncFetch:(GDataServiceGoogle *)service
+         operation:(NSOperation *)op {
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
   HGSGDataServiceIndexContext *context
     = [[[HGSGDataServiceIndexContext alloc] initWithOperation:op
                                                       service:service
                                                      database:database]
        autorelease];
-  [context addTicket:ticket];
-  [ticket setUserData:context];
+  [self loadSyncStateIfNeeded];
+  NSDictionary *feedSyncStates = nil;
+  NSDictionary *entryFragments = nil;
+  @synchronized(self) {
+    feedSyncStates = [[feedSyncStates_ retain] autorelease];
+    entryFragments = [[entryFragments_ retain] autorelease];
+  }
+  [context setFeedSyncStates:feedSyncStates
+           previousFragments:entryFragments];
+  GDataServiceTicket *ticket = [self fetchTicketForContext:context];
+  if (ticket) {
+    [context addTicket:ticket];
+    [ticket setUserData:context];
+  }
   CFRunLoopSourceContext rlContext;
   bzero(&rlContext, sizeof(rlContext));
   CFRunLoopSourceRef source = CFRunLoopSourceCreate(NULL, 0, &rlContext);
@@ -150,7 +307,7 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   CFRunLoopRemoveSource(runloop, source, kCFRunLoopDefaultMode);
   CFRelease(source);
   if (![context isCancelled]) {
-    [self replaceCurrentDatabaseWith:database];
+    [self commitSyncForContext:context];
   }
   // If we finished successfully, the below should be a no-op.
   [context cancelTickets];
@@ -224,6 +381,8 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   // Clear the service so that we make a new one with the correct credentials.
   [service_ release];
   service_ = nil;
+  // What we synced belonged to the old login.
+  [self resetSyncState];
   // If the login changes, we should update immediately, and make sure the
   // periodic refresh is enabled (it would have been shut down if the previous
   // credentials were incorrect).
@@ -266,7 +425,8 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   }
 }
 
-- (GDataServiceTicket *)fetchTicketForService:(GDataServiceGoogle *)service {
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context {
   [self doesNotRecognizeSelector:_cmd];
   return nil;
 }
@@ -276,6 +436,241 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   return nil;
 }
 
+#pragma mark -
+#pragma mark Feed Syncing
+
+- (GDataServiceTicket *)fetchFeedWithURL:(NSURL *)feedURL
+                               feedClass:(Class)feedClass
+                            deltaCapable:(BOOL)deltaCapable
+                                 context:(HGSGDataServiceIndexContext *)context
+                       didFinishSelector:(SEL)finishedSelector {
+  // Feeds fetched while indexing an entry belong to that entry.
+  return [self fetchFeedWithURL:feedURL
+                      feedClass:feedClass
+                   deltaCapable:deltaCapable
+                          owner:[context currentEntryKey]
+                        context:context
+              didFinishSelector:finishedSelector];
+}
+
+- (GDataServiceTicket *)fetchFeedWithURL:(NSURL *)feedURL
+                               feedClass:(Class)feedClass
+                            deltaCapable:(BOOL)deltaCapable
+                                   owner:(NSString *)owner
+                                 context:(HGSGDataServiceIndexContext *)context
+                       didFinishSelector:(SEL)finishedSelector {
+  NSString *feedKey = [feedURL absoluteString];
+  if (!feedKey) return nil;
+  HGSGDataFeedSyncState *state = [context syncStateForFeedKey:feedKey];
+  NSURL *url = feedURL;
+  NSString *ETag = nil;
+  BOOL isDelta = NO;
+  if (state) {
+    NSString *updated = [state updated];
+    if (deltaCapable && updated) {
+      GDataQuery *query = [GDataQuery queryWithFeedURL:feedURL];
+      GDataDateTime *updatedMin
+        = [GDataDateTime dateTimeWithRFC3339String:updated];
+      [query setUpdatedMinDateTime:updatedMin];
+      [query setShouldShowDeleted:YES];
+      url = [query URL];
+      isDelta = YES;
+    } else {
+      ETag = [state ETag];
+    }
+  }
+  GDataServiceGoogle *service = [context service];
+  GDataServiceTicket *ticket
+    = [service fetchFeedWithURL:url
+                      feedClass:feedClass
+                           ETag:ETag
+                       delegate:self
+              didFinishSelector:@selector(syncTicket:finishedWithFeed:error:)];
+  if (ticket) {
+    [ticket setUserData:context];
+    [ticket setProperty:feedKey forKey:kHGSGDataSyncFeedKey];
+    [ticket setProperty:NSStringFromSelector(finishedSelector)
+                 forKey:kHGSGDataSyncSelectorKey];
+    [ticket setProperty:[NSNumber numberWithBool:deltaCapable]
+                 forKey:kHGSGDataSyncDeltaCapableKey];
+    [ticket setProperty:[NSNumber numberWithBool:isDelta]
+                 forKey:kHGSGDataSyncIsDeltaKey];
+    if (feedClass) {
+      [ticket setProperty:NSStringFromClass(feedClass)
+                   forKey:kHGSGDataSyncFeedClassKey];
+    }
+    if (owner) {
+      [ticket setProperty:owner forKey:kHGSGDataSyncOwnerKey];
+    }
+    [context addTicket:ticket];
+  }
+  return ticket;
+}
+
+- (void)syncTicket:(GDataServiceTicket *)ticket
+  finishedWithFeed:(GDataFeedBase *)feed
+             error:(NSError *)error {
+  HGSGDataServiceIndexContext *context
+    = GTM_STATIC_CAST(HGSGDataServiceIndexContext, [ticket userData]);
+  HGSAssert(context, nil);
+  NSString *feedKey = [ticket propertyForKey:kHGSGDataSyncFeedKey];
+  HGSGDataFeedSyncState *state = [context syncStateForFeedKey:feedKey];
+  BOOL isDelta = [[ticket propertyForKey:kHGSGDataSyncIsDeltaKey] boolValue];
+  [context noteSyncedFeedKey:feedKey];
+  if (error) {
+    GDataFeedBase *cachedFeed = nil;
+    BOOL notModified = [error code] == kGDataHTTPFetcherStatusNotModified;
+    if (notModified) {
+      cachedFeed = [state feed];
+    }
+    if (cachedFeed) {
+      feed = cachedFeed;
+      error = nil;
+    } else if (notModified
+               && ![ticket propertyForKey:kHGSGDataSyncRetriedKey]) {
+      // A 304 is no use without our copy of the feed, so ask again
+      // unconditionally.
+      [context setSyncState:nil forFeedKey:feedKey];
+      [[context service] clearLastModifiedDates];
+      NSString *className = [ticket propertyForKey:kHGSGDataSyncFeedClassKey];
+      NSString *selectorName = [ticket propertyForKey:kHGSGDataSyncSelectorKey];
+      BOOL deltaCapable
+        = [[ticket propertyForKey:kHGSGDataSyncDeltaCapableKey] boolValue];
+      GDataServiceTicket *retryTicket
+        = [self fetchFeedWithURL:[NSURL URLWithString:feedKey]
+                       feedClass:className ? NSClassFromString(className) : nil
+                    deltaCapable:deltaCapable
+                           owner:[ticket propertyForKey:kHGSGDataSyncOwnerKey]
+                         context:context
+               didFinishSelector:NSSelectorFromString(selectorName)];
+      [retryTicket setProperty:[NSNumber numberWithBool:YES]
+                        forKey:kHGSGDataSyncRetriedKey];
+      [self ticketHandled:ticket forContext:context];
+      return;
+    } else {
+      // Better stale results than none. If a delta failed, updated-min may
+      // be too far back, so fetch the whole feed next time.
+      [context keepFragmentsForFeedKey:feedKey];
+      if (isDelta) {
+        [context setSyncState:nil forFeedKey:feedKey];
+      }
+    }
+  } else {
+    NSString *ETag = isDelta ? nil : [feed ETag];
+    NSString *updated = [[feed updatedDate] RFC3339String];
+    if (isDelta) {
+      GDataFeedBase *cachedFeed = [state feed];
+      if (cachedFeed) {
+        feed = HGSGDataMergeFeed(cachedFeed, feed);
+      }
+    }
+    HGSGDataFeedSyncState *newState
+      = [HGSGDataFeedSyncState stateWithFeed:feed ETag:ETag updated:updated];
+    [context setSyncState:newState forFeedKey:feedKey];
+  }
+  SEL selector
+    = NSSelectorFromString([ticket propertyForKey:kHGSGDataSyncSelectorKey]);
+  NSMethodSignature *sig = [self methodSignatureForSelector:selector];
+  NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:sig];
+  [invocation setTarget:self];
+  [invocation setSelector:selector];
+  [invocation setArgument:&ticket atIndex:2];
+  [invocation setArgument:&feed atIndex:3];
+  [invocation setArgument:&error atIndex:4];
+  [invocation invoke];
+}
+
+- (void)commitSyncForContext:(HGSGDataServiceIndexContext *)context {
+  HGSMemorySearchSourceDB *database = [context database];
+  NSDictionary *fragments = [context fragments];
+  for (HGSGDataEntryFragment *fragment in [fragments objectEnumerator]) {
+    [database addEntriesFromDatabase:[fragment database]];
+  }
+  [self replaceCurrentDatabaseWith:database];
+  @synchronized(self) {
+    [entryFragments_ release];
+    entryFragments_ = [fragments copy];
+    [feedSyncStates_ release];
+    feedSyncStates_ = [[context feedSyncStates] copy];
+  }
+  if ([context feedSyncStatesChanged]) {
+    [self saveSyncState];
+  }
+}
+
+- (void)resetSyncState {
+  @synchronized(self) {
+    [feedSyncStates_ release];
+    feedSyncStates_ = nil;
+    [entryFragments_ release];
+    entryFragments_ = nil;
+    // Nothing to load from disk any more either.
+    syncStateLoaded_ = YES;
+    if (syncStatePath_) {
+      [[NSFileManager defaultManager] removeItemAtPath:syncStatePath_
+                                                 error:nil];
+    }
+  }
+}
+
+- (void)loadSyncStateIfNeeded {
+  @synchronized(self) {
+    if (!syncStateLoaded_) {
+      syncStateLoaded_ = YES;
+      NSDictionary *archive
+        = [NSDictionary dictionaryWithContentsOfFile:syncStatePath_];
+      NSString *version = [archive objectForKey:kHGSGDataSyncVersionKey];
+      if ([version isEqualToString:kHGSGDataSyncVersion]) {
+        NSDictionary *feeds = [archive objectForKey:kHGSGDataSyncFeedsKey];
+        NSMutableDictionary *states
+          = [NSMutableDictionary dictionaryWithCapacity:[feeds count]];
+        for (NSString *feedKey in feeds) {
+          NSDictionary *feedArchive = [feeds objectForKey:feedKey];
+          HGSGDataFeedSyncState *state
+            = [HGSGDataFeedSyncState stateWithArchiveRepresentation:feedArchive];
+          if (state) {
+            [states setObject:state forKey:feedKey];
+          }
+        }
+        [feedSyncStates_ release];
+        feedSyncStates_ = [states copy];
+      }
+    }
+  }
+}
+
+- (void)saveSyncState {
+  NSDictionary *states = nil;
+  @synchronized(self) {
+    states = [[feedSyncStates_ retain] autorelease];
+  }
+  NSMutableDictionary *feeds
+    = [NSMutableDictionary dictionaryWithCapacity:[states count]];
+  for (NSString *feedKey in states) {
+    HGSGDataFeedSyncState *state = [states objectForKey:feedKey];
+    NSDictionary *feedArchive = [state archiveRepresentation];
+    if (feedArchive) {
+      [feeds setObject:feedArchive forKey:feedKey];
+    }
+  }
+  NSDictionary *archive
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       kHGSGDataSyncVersion, kHGSGDataSyncVersionKey,
+       feeds, kHGSGDataSyncFeedsKey,
+       nil];
+  NSString *errorDescription = nil;
+  NSData *data
+    = [NSPropertyListSerialization
+       dataFromPropertyList:archive
+                     format:NSPropertyListBinaryFormat_v1_0
+           errorDescription:&errorDescription];
+  if (!data || ![data writeToFile:syncStatePath_ atomically:YES]) {
+    HGSLogDebug(@"Unable to save sync state for %@ to %@ (%@)",
+                self, syncStatePath_, errorDescription);
+    [errorDescription release];
+  }
+}
+
 #pragma mark -
 #pragma mark HGSAccountClientProtocol Methods
 
@@ -288,6 +683,7 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   // And get rid of the service.
   [service_ release];
   service_ = nil;
+  [self resetSyncState];
 
   return YES;
 }
@@ -299,7 +695,8 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
 @implementation HGSGDataServiceIndexContext
 
 @synthesize service = service_;
-@synthesize database = database_;
+@synthesize currentEntryKey = currentEntryKey_;
+@synthesize feedSyncStatesChanged = feedSyncStatesChanged_;
 
 - (id)initWithOperation:(NSOperation *)operation
                 service:(GDataServiceGoogle *)service
@@ -309,6 +706,9 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
     service_ = [service retain];
     tickets_ = [[NSMutableArray alloc] init];
     database_ = [database retain];
+    fragments_ = [[NSMutableDictionary alloc] init];
+    feedSyncStates_ = [[NSMutableDictionary alloc] init];
+    syncedFeedKeys_ = [[NSMutableSet alloc] init];
   }
   return self;
 }
@@ -318,11 +718,24 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   [tickets_ release];
   [service_ release];
   [database_ release];
+  [previousFragments_ release];
+  [previousChildKeys_ release];
+  [fragments_ release];
+  [feedSyncStates_ release];
+  [syncedFeedKeys_ release];
+  [currentEntryKey_ release];
+  [currentEntryDatabase_ release];
   [super dealloc];
 }
 
+- (HGSMemorySearchSourceDB *)database {
+  return currentEntryDatabase_ ? currentEntryDatabase_ : database_;
+}
+
 - (void)addTicket:(GDataServiceTicket *)ticket {
-  [tickets_ addObject:ticket];
+  if (![tickets_ containsObject:ticket]) {
+    [tickets_ addObject:ticket];
+  }
 }
 
 - (void)removeTicket:(GDataServiceTicket *)ticket {
@@ -341,6 +754,249 @@ NSString *const kHGSGDataServiceSourceErrorReportingIntervalKey
   return [operation_ isCancelled];
 }
 
+- (void)setFeedSyncStates:(NSDictionary *)feedSyncStates
+        previousFragments:(NSDictionary *)previousFragments {
+  [feedSyncStates_ setDictionary:feedSyncStates];
+  [previousFragments_ release];
+  previousFragments_ = [previousFragments copy];
+  // Index the fragments by parent so that carrying over an entry can take
+  // its children along with it.
+  NSMutableDictionary *childKeys = [NSMutableDictionary dictionary];
+  for (NSString *key in previousFragments_) {
+    HGSGDataEntryFragment *fragment = [previousFragments_ objectForKey:key];
+    NSString *parentKey = [fragment parentKey];
+    if (parentKey) {
+      NSMutableArray *children = [childKeys objectForKey:parentKey];
+      if (!children) {
+        children = [NSMutableArray array];
+        [childKeys setObject:children forKey:parentKey];
+      }
+      [children addObject:key];
+    }
+  }
+  [previousChildKeys_ release];
+  previousChildKeys_ = [childKeys copy];
+}
+
+- (HGSGDataFeedSyncState *)syncStateForFeedKey:(NSString *)feedKey {
+  return feedKey ? [feedSyncStates_ objectForKey:feedKey] : nil;
+}
+
+- (void)setSyncState:(HGSGDataFeedSyncState *)state
+          forFeedKey:(NSString *)feedKey {
+  if (!feedKey) return;
+  if (state) {
+    [feedSyncStates_ setObject:state forKey:feedKey];
+  } else {
+    [feedSyncStates_ removeObjectForKey:feedKey];
+  }
+  feedSyncStatesChanged_ = YES;
+}
+
+- (void)noteSyncedFeedKey:(NSString *)feedKey {
+  if (feedKey) {
+    [syncedFeedKeys_ addObject:feedKey];
+  }
+}
+
+- (NSDictionary *)feedSyncStates {
+  // Forget feeds that we no longer fetch.
+  NSMutableDictionary *states = [NSMutableDictionary dictionary];
+  for (NSString *feedKey in syncedFeedKeys_) {
+    HGSGDataFeedSyncState *state = [feedSyncStates_ objectForKey:feedKey];
+    if (state) {
+      [states setObject:state forKey:feedKey];
+    }
+  }
+  if ([states count] != [feedSyncStates_ count]) {
+    feedSyncStatesChanged_ = YES;
+  }
+  return states;
+}
+
+- (NSDictionary *)fragments {
+  return fragments_;
+}
+
+- (BOOL)beginIndexingEntry:(GDataEntryBase *)entry
+                 forTicket:(GDataServiceTicket *)ticket {
+  HGSAssert(!currentEntryKey_, @"Already indexing %@", currentEntryKey_);
+  NSString *feedKey = [ticket propertyForKey:kHGSGDataSyncFeedKey];
+  NSString *identifier = [entry identifier];
+  if (!feedKey || !identifier) {
+    // Not synced, so it just goes into the main database.
+    return YES;
+  }
+  // Entries are keyed by feed as well, as what we index for an entry can
+  // depend on how it was fetched.
+  NSString *key = [NSString stringWithFormat:@"%@ %@", feedKey, identifier];
+  NSString *stamp = HGSGDataEntryStamp(entry);
+  HGSGDataEntryFragment *previous = [previousFragments_ objectForKey:key];
+  if (stamp && [[previous stamp] isEqualToString:stamp]) {
+    [self carryOverFragmentWithKey:key];
+    return NO;
+  }
+  NSString *parentKey = [ticket propertyForKey:kHGSGDataSyncOwnerKey];
+  HGSGDataEntryFragment *fragment
+    = [[[HGSGDataEntryFragment alloc] initWithStamp:stamp
+                                          parentKey:parentKey] autorelease];
+  [fragments_ setObject:fragment forKey:key];
+  currentEntryKey_ = [key copy];
+  currentEntryDatabase_ = [[fragment database] retain];
+  return YES;
+}
+
+- (void)endIndexingEntry {
+  [currentEntryKey_ release];
+  currentEntryKey_ = nil;
+  [currentEntryDatabase_ release];
+  currentEntryDatabase_ = nil;
+}
+
+- (void)carryOverFragmentWithKey:(NSString *)key {
+  if ([fragments_ objectForKey:key]) return;
+  HGSGDataEntryFragment *fragment = [previousFragments_ objectForKey:key];
+  if (fragment) {
+    [fragments_ setObject:fragment forKey:key];
+    for (NSString *childKey in [previousChildKeys_ objectForKey:key]) {
+      [self carryOverFragmentWithKey:childKey];
+    }
+  }
+}
+
+- (void)keepFragmentsForFeedKey:(NSString *)feedKey {
+  if (!feedKey) return;
+  NSString *prefix = [feedKey stringByAppendingString:@" "];
+  for (NSString *key in previousFragments_) {
+    if ([key hasPrefix:prefix]) {
+      [self carryOverFragmentWithKey:key];
+    }
+  }
+}
+
+@end
+
+#pragma mark -
+
+@implementation HGSGDataFeedSyncState
+
+@synthesize ETag = ETag_;
+@synthesize updated = updated_;
+
++ (id)stateWithFeed:(GDataFeedBase *)feed
+               ETag:(NSString *)ETag
+            updated:(NSString *)updated {
+  return [[[self alloc] initWithFeed:feed
+                            feedData:nil
+                       feedClassName:NSStringFromClass([feed class])
+                                ETag:ETag
+                             updated:updated] autorelease];
+}
+
++ (id)stateWithArchiveRepresentation:(NSDictionary *)archive {
+  NSData *feedData = [archive objectForKey:kHGSGDataSyncXMLKey];
+  NSString *className = [archive objectForKey:kHGSGDataSyncClassKey];
+  if (!feedData || !className) return nil;
+  return [[[self alloc] initWithFeed:nil
+                            feedData:feedData
+                       feedClassName:className
+                                ETag:[archive objectForKey:kHGSGDataSyncETagKey]
+                             updated:[archive objectForKey:kHGSGDataSyncUpdatedKey]]
+          autorelease];
+}
+
+- (id)initWithFeed:(GDataFeedBase *)feed
+          feedData:(NSData *)feedData
+     feedClassName:(NSString *)feedClassName
+              ETag:(NSString *)ETag
+           updated:(NSString *)updated {
+  if ((self = [super init])) {
+    feed_ = [feed retain];
+    feedData_ = [feedData retain];
+    feedClassName_ = [feedClassName copy];
+    ETag_ = [ETag copy];
+    updated_ = [updated copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [feed_ release];
+  [feedData_ release];
+  [feedClassName_ release];
+  [ETag_ release];
+  [updated_ release];
+  [super dealloc];
+}
+
+- (GDataFeedBase *)feed {
+  @synchronized(self) {
+    if (!feed_ && feedData_) {
+      Class feedClass = NSClassFromString(feedClassName_);
+      if ([feedClass isSubclassOfClass:[GDataFeedBase class]]) {
+        feed_ = [[feedClass alloc] initWithData:feedData_];
+      }
+      if (!feed_) {
+        HGSLogDebug(@"Unable to restore cached %@", feedClassName_);
+        // Don't try again.
+        [feedData_ release];
+        feedData_ = nil;
+      }
+    }
+  }
+  return [[feed_ retain] autorelease];
+}
+
+- (NSDictionary *)archiveRepresentation {
+  NSData *feedData = nil;
+  @synchronized(self) {
+    if (!feedData_ && feed_) {
+      NSString *xml = [[feed_ XMLElement] XMLString];
+      feedData_ = [[xml dataUsingEncoding:NSUTF8StringEncoding] retain];
+    }
+    feedData = [[feedData_ retain] autorelease];
+  }
+  if (!feedData || !feedClassName_) return nil;
+  NSMutableDictionary *archive
+    = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+       feedData, kHGSGDataSyncXMLKey,
+       feedClassName_, kHGSGDataSyncClassKey,
+       nil];
+  if (ETag_) {
+    [archive setObject:ETag_ forKey:kHGSGDataSyncETagKey];
+  }
+  if (updated_) {
+    [archive setObject:updated_ forKey:kHGSGDataSyncUpdatedKey];
+  }
+  return archive;
+}
+
+@end
+
+#pragma mark -
+
+@implementation HGSGDataEntryFragment
+
+@synthesize stamp = stamp_;
+@synthesize parentKey = parentKey_;
+@synthesize database = database_;
+
+- (id)initWithStamp:(NSString *)stamp parentKey:(NSString *)parentKey {
+  if ((self = [super init])) {
+    stamp_ = [stamp copy];
+    parentKey_ = [parentKey copy];
+    database_ = [[HGSMemorySearchSourceDB database] retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [stamp_ release];
+  [parentKey_ release];
+  [database_ release];
+  [super dealloc];
+}
+
 @end
 
 #pragma mark -
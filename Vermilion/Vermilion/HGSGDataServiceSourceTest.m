@@ -0,0 +1,587 @@
+//
+//  HGSGDataServiceSourceTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import <Vermilion/Vermilion.h>
+#import <GData/GData.h>
+#import <OCMock/OCMock.h>
+
+// The fixture server answers every request to kFixtureHost with pages of an
+// Atom feed built from its entries, honoring If-None-Match, updated-min and
+// showdeleted the way the GData servers do.
+static NSString *const kFixtureHost = @"hgsgdatafixture.invalid";
+static NSString *const kFixtureETagFeed = @"etag";
+static NSString *const kFixtureDeltaFeed = @"delta";
+static const NSUInteger kFixturePageSize = 2;
+static const NSTimeInterval kFixtureEpoch = 300000000;
+
+static NSString *const kFixtureTitleKey = @"title";
+static NSString *const kFixtureUpdatedKey = @"updated";
+static NSString *const kFixtureVersionKey = @"version";
+static NSString *const kFixtureDeletedKey = @"deleted";
+
+static NSMutableDictionary *sFixtureFeeds = nil;
+static NSMutableArray *sFixtureRequests = nil;
+static NSInteger sFixtureClock = 0;
+
+static NSURL *HGSGDataFixtureFeedURL(NSString *feed) {
+  NSString *urlString
+    = [NSString stringWithFormat:@"http://%@/feeds/%@", kFixtureHost, feed];
+  return [NSURL URLWithString:urlString];
+}
+
+static NSString *HGSGDataFixtureEntryID(NSString *feed, NSString *name) {
+  return [NSString stringWithFormat:@"http://%@/entries/%@/%@",
+          kFixtureHost, feed, name];
+}
+
+static NSString *HGSGDataFixtureDateString(NSDate *date) {
+  NSTimeZone *utc = [NSTimeZone timeZoneWithName:@"UTC"];
+  return [[GDataDateTime dateTimeWithDate:date timeZone:utc] RFC3339String];
+}
+
+@interface HGSGDataFixtureURLProtocol : NSURLProtocol
+// Adds the entry to the feed, or changes its title.
++ (void)setTitle:(NSString *)title
+        forEntry:(NSString *)name
+          inFeed:(NSString *)feed;
+// Leaves a tombstone that only showdeleted requests get to see.
++ (void)deleteEntry:(NSString *)name inFeed:(NSString *)feed;
+// The requests served since the last call, one sorted line per request.
++ (NSArray *)takeRequests;
++ (void)reset;
+@end
+
+// NSHTTPURLResponse has no public way to set a status code on 10.5.
+@interface HGSGDataFixtureURLResponse : NSHTTPURLResponse {
+ @private
+  NSInteger statusCode_;
+  NSDictionary *headers_;
+}
+- (id)initWithURL:(NSURL *)url
+       statusCode:(NSInteger)statusCode
+          headers:(NSDictionary *)headers;
+@end
+
+@implementation HGSGDataFixtureURLResponse
+
+- (id)initWithURL:(NSURL *)url
+       statusCode:(NSInteger)statusCode
+          headers:(NSDictionary *)headers {
+  if ((self = [super initWithURL:url
+                        MIMEType:@"application/atom+xml"
+           expectedContentLength:-1
+                textEncodingName:@"utf-8"])) {
+    statusCode_ = statusCode;
+    headers_ = [headers copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [headers_ release];
+  [super dealloc];
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+  return [self retain];
+}
+
+- (NSInteger)statusCode {
+  return statusCode_;
+}
+
+- (NSDictionary *)allHeaderFields {
+  return headers_;
+}
+
+@end
+
+@implementation HGSGDataFixtureURLProtocol
+
++ (void)reset {
+  @synchronized(self) {
+    [sFixtureFeeds release];
+    sFixtureFeeds = [[NSMutableDictionary alloc] init];
+    [sFixtureRequests release];
+    sFixtureRequests = [[NSMutableArray alloc] init];
+    sFixtureClock = 0;
+  }
+}
+
++ (void)setEntry:(NSString *)name
+          inFeed:(NSString *)feed
+           title:(NSString *)title
+         deleted:(BOOL)deleted {
+  @synchronized(self) {
+    NSMutableDictionary *entries = [sFixtureFeeds objectForKey:feed];
+    if (!entries) {
+      entries = [NSMutableDictionary dictionary];
+      [sFixtureFeeds setObject:entries forKey:feed];
+    }
+    NSDictionary *oldEntry = [entries objectForKey:name];
+    if (!title) {
+      title = [oldEntry objectForKey:kFixtureTitleKey];
+    }
+    NSInteger version
+      = [[oldEntry objectForKey:kFixtureVersionKey] integerValue] + 1;
+    sFixtureClock += 1;
+    NSDate *updated
+      = [NSDate dateWithTimeIntervalSinceReferenceDate:kFixtureEpoch
+                                                       + sFixtureClock];
+    NSDictionary *entry
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         title, kFixtureTitleKey,
+         updated, kFixtureUpdatedKey,
+         [NSNumber numberWithInteger:version], kFixtureVersionKey,
+         [NSNumber numberWithBool:deleted], kFixtureDeletedKey,
+         nil];
+    [entries setObject:entry forKey:name];
+  }
+}
+
++ (void)setTitle:(NSString *)title
+        forEntry:(NSString *)name
+          inFeed:(NSString *)feed {
+  [self setEntry:name inFeed:feed title:title deleted:NO];
+}
+
++ (void)deleteEntry:(NSString *)name inFeed:(NSString *)feed {
+  [self setEntry:name inFeed:feed title:nil deleted:YES];
+}
+
++ (NSArray *)takeRequests {
+  NSArray *requests = nil;
+  @synchronized(self) {
+    requests
+      = [sFixtureRequests sortedArrayUsingSelector:@selector(compare:)];
+    [sFixtureRequests removeAllObjects];
+  }
+  return requests;
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+  return [[[request URL] host] isEqualToString:kFixtureHost];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+  return request;
+}
+
+- (void)startLoading {
+  NSURLRequest *request = [self request];
+  NSURL *url = [request URL];
+  NSString *feed = [[url path] lastPathComponent];
+  NSMutableArray *otherParameters = [NSMutableArray array];
+  NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+  for (NSString *pair in [[url query] componentsSeparatedByString:@"&"]) {
+    NSArray *parts = [pair componentsSeparatedByString:@"="];
+    if ([parts count] != 2) continue;
+    NSString *key = [parts objectAtIndex:0];
+    NSString *value = [[parts objectAtIndex:1]
+                       stringByReplacingPercentEscapesUsingEncoding:
+                         NSUTF8StringEncoding];
+    [parameters setObject:value forKey:key];
+    if (![key isEqualToString:@"start-index"]) {
+      [otherParameters addObject:pair];
+    }
+  }
+  NSString *ifNoneMatch = [request valueForHTTPHeaderField:@"If-None-Match"];
+  NSString *updatedMin = [parameters objectForKey:@"updated-min"];
+  BOOL showDeleted
+    = [[parameters objectForKey:@"showdeleted"] isEqualToString:@"true"];
+  NSInteger startIndex = [[parameters objectForKey:@"start-index"] intValue];
+  NSUInteger first = startIndex > 1 ? startIndex - 1 : 0;
+  NSInteger status = 200;
+  NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+  NSMutableString *xml = nil;
+  @synchronized([self class]) {
+    NSDictionary *entries = [sFixtureFeeds objectForKey:feed];
+    NSDate *minDate = nil;
+    if (updatedMin) {
+      minDate = [[GDataDateTime dateTimeWithRFC3339String:updatedMin] date];
+    }
+    NSDate *feedUpdated
+      = [NSDate dateWithTimeIntervalSinceReferenceDate:kFixtureEpoch];
+    NSMutableArray *names = [NSMutableArray array];
+    NSArray *allNames
+      = [[entries allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSString *name in allNames) {
+      NSDictionary *entry = [entries objectForKey:name];
+      NSDate *updated = [entry objectForKey:kFixtureUpdatedKey];
+      feedUpdated = [feedUpdated laterDate:updated];
+      if ([[entry objectForKey:kFixtureDeletedKey] boolValue] && !showDeleted) {
+        continue;
+      }
+      if (minDate && [updated compare:minDate] == NSOrderedAscending) {
+        continue;
+      }
+      [names addObject:name];
+    }
+    // The feed changes whenever any of its entries does.
+    NSString *ETag
+      = [NSString stringWithFormat:@"\"%@-%.0f\"", feed,
+         [feedUpdated timeIntervalSinceReferenceDate] - kFixtureEpoch];
+    [headers setObject:ETag forKey:@"ETag"];
+    if (!entries) {
+      status = 404;
+    } else if ([ifNoneMatch isEqualToString:ETag]) {
+      status = 304;
+    } else {
+      first = MIN(first, [names count]);
+      NSUInteger last = MIN(first + kFixturePageSize, [names count]);
+      xml = [NSMutableString stringWithFormat:
+             @"<feed xmlns='http://www.w3.org/2005/Atom' "
+             @"xmlns:gd='http://schemas.google.com/g/2005' gd:etag='%@'>"
+             @"<id>%@</id><updated>%@</updated><title>%@</title>",
+             ETag, HGSGDataFixtureFeedURL(feed),
+             HGSGDataFixtureDateString(feedUpdated), feed];
+      if (last < [names count]) {
+        NSString *startParameter
+          = [NSString stringWithFormat:@"start-index=%lu",
+             (unsigned long)last + 1];
+        NSArray *nextParameters
+          = [otherParameters arrayByAddingObject:startParameter];
+        [xml appendFormat:@"<link rel='next' type='application/atom+xml' "
+                          @"href='%@?%@'/>",
+         HGSGDataFixtureFeedURL(feed),
+         [nextParameters componentsJoinedByString:@"&amp;"]];
+      }
+      for (NSUInteger i = first; i < last; ++i) {
+        NSString *name = [names objectAtIndex:i];
+        NSDictionary *entry = [entries objectForKey:name];
+        BOOL deleted = [[entry objectForKey:kFixtureDeletedKey] boolValue];
+        [xml appendFormat:@"<entry gd:etag='\"%@-%@\"'><id>%@</id>"
+                          @"<updated>%@</updated><title>%@</title>%@</entry>",
+         name, [entry objectForKey:kFixtureVersionKey],
+         HGSGDataFixtureEntryID(feed, name),
+         HGSGDataFixtureDateString([entry objectForKey:kFixtureUpdatedKey]),
+         [entry objectForKey:kFixtureTitleKey],
+         deleted ? @"<gd:deleted/>" : @""];
+      }
+      [xml appendString:@"</feed>"];
+    }
+    NSString *line
+      = [NSString stringWithFormat:@"%@ %ld%@%@ page %lu",
+         feed, (long)status,
+         ifNoneMatch ? @" if-none-match" : @"",
+         updatedMin ? @" updated-min" : @"",
+         (unsigned long)(first / kFixturePageSize + 1)];
+    [sFixtureRequests addObject:line];
+  }
+  HGSGDataFixtureURLResponse *response
+    = [[[HGSGDataFixtureURLResponse alloc] initWithURL:url
+                                            statusCode:status
+                                               headers:headers] autorelease];
+  id<NSURLProtocolClient> client = [self client];
+  [client URLProtocol:self
+   didReceiveResponse:response
+   cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+  if (xml) {
+    NSData *data = [xml dataUsingEncoding:NSUTF8StringEncoding];
+    [client URLProtocol:self didLoadData:data];
+  }
+  [client URLProtocolDidFinishLoading:self];
+}
+
+- (void)stopLoading {
+}
+
+@end
+
+// Syncs the ETag feed and the updated-min feed, indexing each entry by its
+// id and title.
+@interface HGSGDataFixtureSource : HGSGDataServiceSource {
+ @private
+  NSUInteger indexedCount_;
+}
+// The number of entries indexed (rather than carried over) since it was
+// last reset.
+@property (readwrite, assign) NSUInteger indexedCount;
+@end
+
+@implementation HGSGDataFixtureSource
+
+@synthesize indexedCount = indexedCount_;
+
+- (GDataServiceTicket *)fetchTicketForContext:
+    (HGSGDataServiceIndexContext *)context {
+  [self fetchFeedWithURL:HGSGDataFixtureFeedURL(kFixtureETagFeed)
+               feedClass:[GDataFeedBase class]
+            deltaCapable:NO
+                 context:context
+       didFinishSelector:@selector(ticket:finishedWithFeed:error:)];
+  return [self fetchFeedWithURL:HGSGDataFixtureFeedURL(kFixtureDeltaFeed)
+                      feedClass:[GDataFeedBase class]
+                   deltaCapable:YES
+                        context:context
+              didFinishSelector:@selector(ticket:finishedWithFeed:error:)];
+}
+
+- (Class)serviceClass {
+  return [GDataServiceGoogle class];
+}
+
+// The test runs the indexing passes itself.
+- (void)refreshIndex:(NSTimer *)timer {
+}
+
+- (void)ticket:(GDataServiceTicket *)ticket
+ finishedWithFeed:(GDataFeedBase *)feed
+         error:(NSError *)error {
+  HGSGDataServiceIndexContext *context = [ticket userData];
+  if (!error) {
+    for (GDataEntryBase *entry in [feed entries]) {
+      if ([context beginIndexingEntry:entry forTicket:ticket]) {
+        HGSUnscoredResult *result
+          = [HGSUnscoredResult resultWithURI:[entry identifier]
+                                        name:[[entry title] stringValue]
+                                        type:kHGSTypeWebpage
+                                      source:self
+                                  attributes:nil];
+        [[context database] indexResult:result];
+        indexedCount_ += 1;
+        [context endIndexingEntry];
+      }
+    }
+  }
+  [self ticketHandled:ticket forContext:context];
+}
+
+@end
+
+@interface HGSGDataServiceSource (HGSGDataServiceSourceTest)
+- (void)asyncFetch:(GDataServiceGoogle *)service
+         operation:(NSOperation *)op;
+@end
+
+@interface HGSGDataServiceSourceTest : GTMTestCase {
+ @private
+  NSString *cacheFolder_;
+  id<HGSDelegate> oldDelegate_;
+}
+- (HGSGDataFixtureSource *)fixtureSource;
+- (void)syncSource:(HGSGDataFixtureSource *)source;
+- (NSString *)titleOfEntry:(NSString *)name
+                    inFeed:(NSString *)feed
+                    source:(HGSGDataFixtureSource *)source;
+@end
+
+@implementation HGSGDataServiceSourceTest
+
+- (void)setUp {
+  [super setUp];
+  NSString *folderName
+    = [@"HGSGDataServiceSourceTest-"
+       stringByAppendingString:[[NSProcessInfo processInfo]
+                                globallyUniqueString]];
+  cacheFolder_
+    = [[NSTemporaryDirectory() stringByAppendingPathComponent:folderName]
+       retain];
+  STAssertTrue([[NSFileManager defaultManager]
+                createDirectoryAtPath:cacheFolder_
+          withIntermediateDirectories:YES
+                           attributes:nil
+                                error:NULL], nil);
+  id delegate = [OCMockObject niceMockForProtocol:@protocol(HGSDelegate)];
+  [[[delegate stub] andReturn:cacheFolder_] userCacheFolderForApp];
+  HGSPluginLoader *loader = [HGSPluginLoader sharedPluginLoader];
+  oldDelegate_ = [loader delegate];
+  [loader setDelegate:delegate];
+  [HGSGDataFixtureURLProtocol reset];
+  [NSURLProtocol registerClass:[HGSGDataFixtureURLProtocol class]];
+}
+
+- (void)tearDown {
+  [NSURLProtocol unregisterClass:[HGSGDataFixtureURLProtocol class]];
+  [[HGSPluginLoader sharedPluginLoader] setDelegate:oldDelegate_];
+  [[NSFileManager defaultManager] removeItemAtPath:cacheFolder_ error:NULL];
+  [cacheFolder_ release];
+  cacheFolder_ = nil;
+  [super tearDown];
+}
+
+- (HGSGDataFixtureSource *)fixtureSource {
+  id bundleMock = [OCMockObject niceMockForClass:[NSBundle class]];
+  id accountMock = [OCMockObject niceMockForClass:[HGSSimpleAccount class]];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundleMock, kHGSExtensionBundleKey,
+       @"com.google.qsb.gdatafixture", kHGSExtensionIdentifierKey,
+       accountMock, kHGSExtensionAccountKey,
+       nil];
+  return [[[HGSGDataFixtureSource alloc] initWithConfiguration:config]
+          autorelease];
+}
+
+- (void)syncSource:(HGSGDataFixtureSource *)source {
+  GDataServiceGoogle *service
+    = [[[GDataServiceGoogle alloc] init] autorelease];
+  [service setUserAgent:@"google-qsb-1.0"];
+  [service setServiceShouldFollowNextLinks:YES];
+  NSOperation *op = [[[NSOperation alloc] init] autorelease];
+  [source setIndexedCount:0];
+  [source asyncFetch:service operation:op];
+}
+
+- (NSString *)titleOfEntry:(NSString *)name
+                    inFeed:(NSString *)feed
+                    source:(HGSGDataFixtureSource *)source {
+  NSString *uri = HGSGDataFixtureEntryID(feed, name);
+  return [[source resultForIndexKey:uri] displayName];
+}
+
+- (void)testSync {
+  [HGSGDataFixtureURLProtocol setTitle:@"ETag One"
+                              forEntry:@"e1"
+                                inFeed:kFixtureETagFeed];
+  [HGSGDataFixtureURLProtocol setTitle:@"ETag Two"
+                              forEntry:@"e2"
+                                inFeed:kFixtureETagFeed];
+  [HGSGDataFixtureURLProtocol setTitle:@"ETag Three"
+                              forEntry:@"e3"
+                                inFeed:kFixtureETagFeed];
+  NSArray *deltaTitles
+    = [NSArray arrayWithObjects:@"Delta One", @"Delta Two", @"Delta Three",
+       @"Delta Four", @"Delta Five", nil];
+  for (NSUInteger i = 0; i < [deltaTitles count]; ++i) {
+    NSString *name = [NSString stringWithFormat:@"d%lu", (unsigned long)i + 1];
+    [HGSGDataFixtureURLProtocol setTitle:[deltaTitles objectAtIndex:i]
+                                forEntry:name
+                                  inFeed:kFixtureDeltaFeed];
+  }
+  HGSGDataFixtureSource *source = [self fixtureSource];
+  STAssertNotNil(source, nil);
+  NSString *syncStatePath
+    = [cacheFolder_ stringByAppendingPathComponent:
+       @"com.google.qsb.gdatafixture.gdatasync.plist"];
+
+  // A full sync follows the next links of both feeds.
+  [self syncSource:source];
+  NSArray *expected
+    = [NSArray arrayWithObjects:
+       @"delta 200 page 1",
+       @"delta 200 page 2",
+       @"delta 200 page 3",
+       @"etag 200 page 1",
+       @"etag 200 page 2",
+       nil];
+  STAssertEqualObjects([HGSGDataFixtureURLProtocol takeRequests],
+                       expected, nil);
+  STAssertEquals([source indexedCount], (NSUInteger)8, nil);
+  STAssertEquals([source resultCount], (NSUInteger)8, nil);
+  STAssertEqualObjects([self titleOfEntry:@"e1"
+                                   inFeed:kFixtureETagFeed
+                                   source:source], @"ETag One", nil);
+  STAssertEqualObjects([self titleOfEntry:@"d5"
+                                   inFeed:kFixtureDeltaFeed
+                                   source:source], @"Delta Five", nil);
+  STAssertTrue([[NSFileManager defaultManager]
+                fileExistsAtPath:syncStatePath], nil);
+
+  // Nothing has changed: a 304 for the ETag feed, and only the newest entry
+  // (updated-min is inclusive) for the delta feed. Nothing is reindexed.
+  [self syncSource:source];
+  expected
+    = [NSArray arrayWithObjects:
+       @"delta 200 updated-min page 1",
+       @"etag 304 if-none-match page 1",
+       nil];
+  STAssertEqualObjects([HGSGDataFixtureURLProtocol takeRequests],
+                       expected, nil);
+  STAssertEquals([source indexedCount], (NSUInteger)0, nil);
+  STAssertEquals([source resultCount], (NSUInteger)8, nil);
+
+  // A delta with a change, a deletion and an addition is merged into the
+  // cached feed, and the ETag feed is fetched again since it changed.
+  [HGSGDataFixtureURLProtocol setTitle:@"Delta Two Renamed"
+                              forEntry:@"d2"
+                                inFeed:kFixtureDeltaFeed];
+  [HGSGDataFixtureURLProtocol deleteEntry:@"d3" inFeed:kFixtureDeltaFeed];
+  [HGSGDataFixtureURLProtocol setTitle:@"Delta Six"
+                              forEntry:@"d6"
+                                inFeed:kFixtureDeltaFeed];
+  [HGSGDataFixtureURLProtocol deleteEntry:@"e1" inFeed:kFixtureETagFeed];
+  [self syncSource:source];
+  expected
+    = [NSArray arrayWithObjects:
+       @"delta 200 updated-min page 1",
+       @"delta 200 updated-min page 2",
+       @"etag 200 if-none-match page 1",
+       nil];
+  STAssertEqualObjects([HGSGDataFixtureURLProtocol takeRequests],
+                       expected, nil);
+  STAssertEquals([source indexedCount], (NSUInteger)2, nil);
+  STAssertEquals([source resultCount], (NSUInteger)7, nil);
+  STAssertNil([self titleOfEntry:@"e1"
+                          inFeed:kFixtureETagFeed
+                          source:source], nil);
+  STAssertNil([self titleOfEntry:@"d3"
+                          inFeed:kFixtureDeltaFeed
+                          source:source], nil);
+  STAssertEqualObjects([self titleOfEntry:@"d2"
+                                   inFeed:kFixtureDeltaFeed
+                                   source:source], @"Delta Two Renamed", nil);
+  STAssertEqualObjects([self titleOfEntry:@"d6"
+                                   inFeed:kFixtureDeltaFeed
+                                   source:source], @"Delta Six", nil);
+  STAssertEqualObjects([self titleOfEntry:@"d1"
+                                   inFeed:kFixtureDeltaFeed
+                                   source:source], @"Delta One", nil);
+
+  // After a relaunch the saved state is restored: the ETag feed is still a
+  // 304 and the delta feed still asks only for changes. The entries aren't
+  // saved, so they are all indexed again from the restored feeds.
+  source = [self fixtureSource];
+  STAssertEquals([source resultCount], (NSUInteger)0, nil);
+  [self syncSource:source];
+  expected
+    = [NSArray arrayWithObjects:
+       @"delta 200 updated-min page 1",
+       @"etag 304 if-none-match page 1",
+       nil];
+  STAssertEqualObjects([HGSGDataFixtureURLProtocol takeRequests],
+                       expected, nil);
+  STAssertEquals([source indexedCount], (NSUInteger)7, nil);
+  STAssertEquals([source resultCount], (NSUInteger)7, nil);
+  STAssertNil([self titleOfEntry:@"d3"
+                          inFeed:kFixtureDeltaFeed
+                          source:source], nil);
+  STAssertEqualObjects([self titleOfEntry:@"d2"
+                                   inFeed:kFixtureDeltaFeed
+                                   source:source], @"Delta Two Renamed", nil);
+  STAssertEqualObjects([self titleOfEntry:@"e2"
+                                   inFeed:kFixtureETagFeed
+                                   source:source], @"ETag Two", nil);
+}
+
+@end
@@ -45,6 +45,9 @@
 #import "GTMDebugThreadValidation.h"
 #import "GTMGarbageCollection.h"
 #import "GTMSystemVersion.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSDTrace.h"
+#import <mach/mach_time.h>
 
 static const void *LRURetain(CFAllocatorRef allocator, const void *value);
 static void LRURelease(CFAllocatorRef allocator, const void *value);
@@ -158,6 +161,26 @@ static NSImage *FileSystemImageForURL(NSURL *url) {
   return icon;
 }
 
+// Fires the icon__fetch__start probe and returns the time to pass to
+// IconFetchFinished.
+static uint64_t IconFetchStarted(NSString *urlString) {
+  if (VERMILION_ICON_FETCH_START_ENABLED()) {
+    VERMILION_ICON_FETCH_START((char *)[urlString UTF8String]);
+  }
+  return mach_absolute_time();
+}
+
+static void IconFetchFinished(NSString *urlString, uint64_t startTime,
+                              BOOL found) {
+  [[HGSLatencyHistogramRegistry sharedRegistry]
+   recordMachTime:mach_absolute_time() - startTime
+         forStage:kHGSLatencyStageIcon
+           source:nil];
+  if (VERMILION_ICON_FETCH_FINISH_ENABLED()) {
+    VERMILION_ICON_FETCH_FINISH((char *)[urlString UTF8String], found);
+  }
+}
+
 @class HGSIconOperation;
 
 // Right now we cache up to two different icons per result. A basic version for
@@ -199,7 +222,9 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
 
 - (id)init {
   if ((self = [super init])) {
-    iconOperationQueue_ = [[NSOperationQueue alloc] init];
+    // An HGSOperationQueue, so that icon fetches don't hold up the queue
+    // while they wait on the network.
+    iconOperationQueue_ = [[HGSOperationQueue alloc] init];
     if ([GTMSystemVersion isSnowLeopardOrGreater]) {
       [iconOperationQueue_ setName:@"com.google.qsb.hgsiconcache"];
     }
@@ -518,6 +543,7 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
 
   NSString *urlString = IconURLStringForResult(result);
   if (!urlString) return;
+  uint64_t startTime = IconFetchStarted(urlString);
   NSImage *icon = nil;
   if ([urlString hasPrefix:@"file://"]) {
     if (!icon) {
@@ -532,6 +558,7 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
     NSURL *url = [NSURL URLWithString:urlString];
     icon = FileSystemImageForURL(url);
   }
+  IconFetchFinished(urlString, startTime, icon != nil);
   if ([op isCancelled]) return;
   if (icon) {
     [self setIcon:icon];
@@ -562,10 +589,12 @@ GTMOBJECT_SINGLETON_BOILERPLATE(HGSIconCache, sharedIconCache);
       NSDictionary *dict
         = [NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
                                       forKey:(NSString *)kQLThumbnailOptionIconModeKey];
+      uint64_t startTime = IconFetchStarted(urlString);
       CGImageRef ref = QLThumbnailImageCreate(kCFAllocatorDefault,
                                               (CFURLRef)url,
                                               CGSizeMake(96, 96),
                                               (CFDictionaryRef)dict);
+      IconFetchFinished(urlString, startTime, ref != NULL);
       if ([op isCancelled]) {
         if (ref) {
           CFRelease(ref);
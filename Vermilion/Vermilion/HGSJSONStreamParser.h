@@ -0,0 +1,192 @@
+//
+//  HGSJSONStreamParser.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*!
+ @header
+ @discussion HGSJSONStreamParser
+*/
+
+#import <Foundation/Foundation.h>
+
+@class HGSJSONStreamParser;
+
+/*!
+  Events sent by HGSJSONStreamParser as it walks a JSON document. Every
+  method is optional. Strings and numbers are only guaranteed for the
+  duration of the call, so retain anything that must outlive it.
+  A key is always delivered immediately before the first event of its value.
+*/
+@protocol HGSJSONStreamParserDelegate <NSObject>
+@optional
+- (void)parserDidStartObject:(HGSJSONStreamParser *)parser;
+- (void)parserDidEndObject:(HGSJSONStreamParser *)parser;
+- (void)parserDidStartArray:(HGSJSONStreamParser *)parser;
+- (void)parserDidEndArray:(HGSJSONStreamParser *)parser;
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key;
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string;
+- (void)parser:(HGSJSONStreamParser *)parser foundNumber:(NSNumber *)number;
+- (void)parser:(HGSJSONStreamParser *)parser foundBool:(BOOL)value;
+- (void)parserFoundNull:(HGSJSONStreamParser *)parser;
+@end
+
+/*!
+  @enum HGSJSONStreamParserOptions
+  @constant kHGSJSONStreamParserAllowTrailingCommas Accept a comma directly
+            before a closing ']' or '}'. Firefox writes these in its
+            bookmark backups.
+  @constant kHGSJSONStreamParserSkipNulls Don't report null values. An object
+            member whose value is null is dropped along with its key.
+*/
+enum {
+  kHGSJSONStreamParserAllowTrailingCommas = 1 << 0,
+  kHGSJSONStreamParserSkipNulls = 1 << 1,
+};
+typedef NSUInteger HGSJSONStreamParserOptions;
+
+/*!
+  @enum HGSJSONStreamParserErrorCode
+  @constant kHGSJSONStreamParserSyntaxError Malformed JSON.
+  @constant kHGSJSONStreamParserEncodingError A string was not valid UTF-8.
+  @constant kHGSJSONStreamParserDepthError Nesting exceeded
+            kHGSJSONStreamParserMaxDepth.
+  @constant kHGSJSONStreamParserIncompleteError Input ended mid-document.
+  @constant kHGSJSONStreamParserAbortedError abortParsing was called.
+  @constant kHGSJSONStreamParserReadError The input file couldn't be read.
+*/
+enum {
+  kHGSJSONStreamParserSyntaxError = 1,
+  kHGSJSONStreamParserEncodingError,
+  kHGSJSONStreamParserDepthError,
+  kHGSJSONStreamParserIncompleteError,
+  kHGSJSONStreamParserAbortedError,
+  kHGSJSONStreamParserReadError,
+};
+
+/*! Error domain for errors returned by -parserError. */
+extern NSString *const kHGSJSONStreamParserErrorDomain;
+
+/*! Deepest nesting of arrays and objects the parser will follow. */
+#define kHGSJSONStreamParserMaxDepth 512
+
+/*!
+  An incremental, event driven JSON parser. Input may be fed in arbitrarily
+  sized pieces with parseBytes:length:, so large files never need to be
+  held in memory as a whole, nor converted to an NSString first. Consumers
+  that only need part of a document can pick what they want out of the
+  delegate events instead of building and then walking a Foundation tree.
+
+  For small documents +JSONObjectWithData:options:error: builds the usual
+  NSDictionary/NSArray/NSString/NSNumber tree (with NSNull for nulls unless
+  kHGSJSONStreamParserSkipNulls is set).
+
+  A parser is not thread safe, but separate parsers may run concurrently.
+*/
+@interface HGSJSONStreamParser : NSObject {
+ @private
+  id<HGSJSONStreamParserDelegate> delegate_;  // weak
+  HGSJSONStreamParserOptions options_;
+  NSUInteger delegateFlags_;
+  // Parser state.
+  NSInteger expect_;
+  char *containers_;
+  NSUInteger depth_;
+  NSString *pendingKey_;
+  // Token state.
+  NSInteger token_;
+  BOOL tokenIsKey_;
+  char *buffer_;
+  NSUInteger bufferLength_;
+  NSUInteger bufferCapacity_;
+  const char *literal_;
+  NSUInteger literalIndex_;
+  NSUInteger unicodeDigits_;
+  UInt32 unicodeValue_;
+  UInt32 highSurrogate_;
+  // Small cache so that repeated keys share one NSString.
+  void *keyCache_;
+  unsigned long long offset_;
+  BOOL aborted_;
+  NSError *error_;
+}
+
+/*!
+  Parses a complete document held in memory. Returns nil and sets |error|
+  if the data is not valid JSON.
+*/
++ (id)JSONObjectWithData:(NSData *)data
+                 options:(HGSJSONStreamParserOptions)options
+                   error:(NSError **)error;
+
+/*! Like JSONObjectWithData:options:error:, reading from |path|. */
++ (id)JSONObjectWithContentsOfFile:(NSString *)path
+                           options:(HGSJSONStreamParserOptions)options
+                             error:(NSError **)error;
+
+/*! Designated initializer. |delegate| is not retained. */
+- (id)initWithDelegate:(id<HGSJSONStreamParserDelegate>)delegate
+               options:(HGSJSONStreamParserOptions)options;
+
+/*!
+  Feeds the next piece of the document to the parser, sending delegate
+  events for everything that can be recognized so far. Returns NO once an
+  error has occurred or parsing was aborted.
+*/
+- (BOOL)parseBytes:(const void *)bytes length:(NSUInteger)length;
+
+/*!
+  Tells the parser that the input is complete. Returns YES if exactly one
+  complete JSON value was parsed.
+*/
+- (BOOL)finishParsing;
+
+/*! Parses all of |data| and finishes. */
+- (BOOL)parseData:(NSData *)data;
+
+/*!
+  Streams the file at |path| through the parser in fixed size chunks and
+  finishes.
+*/
+- (BOOL)parseContentsOfFile:(NSString *)path;
+
+/*!
+  Stops parsing. May be called from a delegate method; no further events
+  are sent and parserError reports kHGSJSONStreamParserAbortedError.
+*/
+- (void)abortParsing;
+
+/*! Number of currently open arrays and objects. */
+- (NSUInteger)depth;
+
+/*! The error that stopped parsing, or nil. */
+- (NSError *)parserError;
+
+@end
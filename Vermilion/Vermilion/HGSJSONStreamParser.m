@@ -0,0 +1,866 @@
+//
+//  HGSJSONStreamParser.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <errno.h>
+#import <fcntl.h>
+#import <stdlib.h>
+#import <unistd.h>
+#import <xlocale.h>
+#import "HGSJSONStreamParser.h"
+#import "HGSLog.h"
+
+NSString *const kHGSJSONStreamParserErrorDomain
+  = @"HGSJSONStreamParserErrorDomain";
+
+// Size of the reads done by parseContentsOfFile:.
+static const size_t kHGSJSONReadChunkSize = 64 * 1024;
+
+// Keys up to this length are interned in the key cache.
+#define kHGSJSONKeyCacheMaxKeyLength 24
+#define kHGSJSONKeyCacheSize 64
+
+typedef struct {
+  NSUInteger length;
+  char bytes[kHGSJSONKeyCacheMaxKeyLength];
+  NSString *string;
+} HGSJSONKeyCacheEntry;
+
+// What the parser will accept next when it is between tokens.
+typedef enum {
+  kHGSJSONExpectValue,
+  kHGSJSONExpectArrayValueOrEnd,
+  kHGSJSONExpectArrayValueAfterComma,
+  kHGSJSONExpectKeyOrEnd,
+  kHGSJSONExpectKeyAfterComma,
+  kHGSJSONExpectColon,
+  kHGSJSONExpectCommaOrEnd,
+  kHGSJSONExpectNothing
+} HGSJSONExpectation;
+
+// The token currently being accumulated, if any. Tokens may straddle
+// calls to parseBytes:length:.
+typedef enum {
+  kHGSJSONTokenNone,
+  kHGSJSONTokenString,
+  kHGSJSONTokenStringEscape,
+  kHGSJSONTokenStringUnicode,
+  kHGSJSONTokenNumber,
+  kHGSJSONTokenLiteral
+} HGSJSONToken;
+
+// Which optional delegate methods are implemented.
+enum {
+  kHGSJSONDelegateStartObject = 1 << 0,
+  kHGSJSONDelegateEndObject = 1 << 1,
+  kHGSJSONDelegateStartArray = 1 << 2,
+  kHGSJSONDelegateEndArray = 1 << 3,
+  kHGSJSONDelegateKey = 1 << 4,
+  kHGSJSONDelegateString = 1 << 5,
+  kHGSJSONDelegateNumber = 1 << 6,
+  kHGSJSONDelegateBool = 1 << 7,
+  kHGSJSONDelegateNull = 1 << 8
+};
+
+static const char kHGSJSONTrue[] = "true";
+static const char kHGSJSONFalse[] = "false";
+static const char kHGSJSONNull[] = "null";
+
+static inline BOOL HGSJSONIsNumberChar(unsigned char c) {
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.'
+    || c == 'e' || c == 'E';
+}
+
+static inline int HGSJSONHexValue(unsigned char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Checks |bytes| against the JSON number grammar. |isInteger| is set if
+// there is no fraction or exponent.
+static BOOL HGSJSONIsValidNumber(const char *bytes, NSUInteger length,
+                                 BOOL *isInteger) {
+  const char *p = bytes;
+  const char *end = bytes + length;
+  *isInteger = YES;
+  if (p < end && *p == '-') ++p;
+  if (p == end) return NO;
+  if (*p == '0') {
+    ++p;
+  } else if (*p >= '1' && *p <= '9') {
+    while (p < end && *p >= '0' && *p <= '9') ++p;
+  } else {
+    return NO;
+  }
+  if (p < end && *p == '.') {
+    *isInteger = NO;
+    ++p;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') ++p;
+    if (p == digits) return NO;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    *isInteger = NO;
+    ++p;
+    if (p < end && (*p == '+' || *p == '-')) ++p;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') ++p;
+    if (p == digits) return NO;
+  }
+  return p == end;
+}
+
+// Builds Foundation objects out of parser events for
+// +JSONObjectWithData:options:error:.
+@interface HGSJSONObjectBuilder : NSObject <HGSJSONStreamParserDelegate> {
+ @private
+  NSMutableArray *stack_;
+  NSString *key_;
+  id root_;
+}
+- (id)root;
+@end
+
+@interface HGSJSONStreamParser ()
+- (void)failWithCode:(NSInteger)code
+              offset:(unsigned long long)offset
+         description:(NSString *)description;
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length;
+- (void)appendCodePoint:(UInt32)codePoint;
+- (void)flushHighSurrogate;
+- (void)appendUnicodeEscape;
+- (NSString *)keyFromBuffer;
+- (void)deliverPendingKey;
+- (void)valueDidEnd;
+- (BOOL)pushContainer:(char)type offset:(unsigned long long)offset;
+- (void)popContainer;
+- (void)finishStringAt:(unsigned long long)offset;
+- (void)finishNumberAt:(unsigned long long)offset;
+- (void)finishLiteral;
+@end
+
+@implementation HGSJSONStreamParser
+
++ (id)JSONObjectWithData:(NSData *)data
+                 options:(HGSJSONStreamParserOptions)options
+                   error:(NSError **)error {
+  HGSJSONObjectBuilder *builder
+    = [[[HGSJSONObjectBuilder alloc] init] autorelease];
+  HGSJSONStreamParser *parser
+    = [[[self alloc] initWithDelegate:builder options:options] autorelease];
+  id result = nil;
+  if ([parser parseData:data]) {
+    result = [builder root];
+  } else if (error) {
+    *error = [parser parserError];
+  }
+  return result;
+}
+
++ (id)JSONObjectWithContentsOfFile:(NSString *)path
+                           options:(HGSJSONStreamParserOptions)options
+                             error:(NSError **)error {
+  HGSJSONObjectBuilder *builder
+    = [[[HGSJSONObjectBuilder alloc] init] autorelease];
+  HGSJSONStreamParser *parser
+    = [[[self alloc] initWithDelegate:builder options:options] autorelease];
+  id result = nil;
+  if ([parser parseContentsOfFile:path]) {
+    result = [builder root];
+  } else if (error) {
+    *error = [parser parserError];
+  }
+  return result;
+}
+
+- (id)init {
+  return [self initWithDelegate:nil options:0];
+}
+
+- (id)initWithDelegate:(id<HGSJSONStreamParserDelegate>)delegate
+               options:(HGSJSONStreamParserOptions)options {
+  if ((self = [super init])) {
+    delegate_ = delegate;
+    options_ = options;
+    struct {
+      SEL selector;
+      NSUInteger flag;
+    } methods[] = {
+      { @selector(parserDidStartObject:), kHGSJSONDelegateStartObject },
+      { @selector(parserDidEndObject:), kHGSJSONDelegateEndObject },
+      { @selector(parserDidStartArray:), kHGSJSONDelegateStartArray },
+      { @selector(parserDidEndArray:), kHGSJSONDelegateEndArray },
+      { @selector(parser:foundKey:), kHGSJSONDelegateKey },
+      { @selector(parser:foundString:), kHGSJSONDelegateString },
+      { @selector(parser:foundNumber:), kHGSJSONDelegateNumber },
+      { @selector(parser:foundBool:), kHGSJSONDelegateBool },
+      { @selector(parserFoundNull:), kHGSJSONDelegateNull },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+      if ([delegate respondsToSelector:methods[i].selector]) {
+        delegateFlags_ |= methods[i].flag;
+      }
+    }
+    expect_ = kHGSJSONExpectValue;
+    token_ = kHGSJSONTokenNone;
+    containers_ = malloc(kHGSJSONStreamParserMaxDepth);
+    bufferCapacity_ = 256;
+    buffer_ = malloc(bufferCapacity_);
+    keyCache_ = calloc(kHGSJSONKeyCacheSize, sizeof(HGSJSONKeyCacheEntry));
+    if (!containers_ || !buffer_ || !keyCache_) {
+      // COV_NF_START
+      HGSLog(@"Unable to allocate JSON parser buffers");
+      [self release];
+      return nil;
+      // COV_NF_END
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  HGSJSONKeyCacheEntry *cache = keyCache_;
+  if (cache) {
+    for (NSUInteger i = 0; i < kHGSJSONKeyCacheSize; ++i) {
+      [cache[i].string release];
+    }
+    free(cache);
+  }
+  free(containers_);
+  free(buffer_);
+  [pendingKey_ release];
+  [error_ release];
+  [super dealloc];
+}
+
+- (BOOL)parseBytes:(const void *)bytes length:(NSUInteger)length {
+  if (error_) return NO;
+  const unsigned char *start = bytes;
+  const unsigned char *p = start;
+  const unsigned char *end = start + length;
+  while (p < end && !error_) {
+    switch (token_) {
+      case kHGSJSONTokenString: {
+        // Copy runs of unescaped characters in one go.
+        const unsigned char *run = p;
+        while (p < end && *p != '"' && *p != '\\' && *p >= 0x20) ++p;
+        if (p > run) {
+          [self flushHighSurrogate];
+          [self appendBytes:run length:p - run];
+        }
+        if (p == end) break;
+        unsigned char c = *p++;
+        if (c == '"') {
+          [self flushHighSurrogate];
+          [self finishStringAt:offset_ + (p - start)];
+        } else if (c == '\\') {
+          token_ = kHGSJSONTokenStringEscape;
+        } else {
+          [self failWithCode:kHGSJSONStreamParserSyntaxError
+                      offset:offset_ + (p - start) - 1
+                 description:@"Unescaped control character in string"];
+        }
+        break;
+      }
+
+      case kHGSJSONTokenStringEscape: {
+        unsigned char c = *p++;
+        char unescaped = 0;
+        switch (c) {
+          case '"': unescaped = '"'; break;
+          case '\\': unescaped = '\\'; break;
+          case '/': unescaped = '/'; break;
+          case 'b': unescaped = '\b'; break;
+          case 'f': unescaped = '\f'; break;
+          case 'n': unescaped = '\n'; break;
+          case 'r': unescaped = '\r'; break;
+          case 't': unescaped = '\t'; break;
+          case 'u':
+            token_ = kHGSJSONTokenStringUnicode;
+            unicodeDigits_ = 0;
+            unicodeValue_ = 0;
+            break;
+          default:
+            [self failWithCode:kHGSJSONStreamParserSyntaxError
+                        offset:offset_ + (p - start) - 1
+                   description:@"Invalid escape sequence"];
+            break;
+        }
+        if (unescaped) {
+          [self flushHighSurrogate];
+          [self appendBytes:&unescaped length:1];
+          token_ = kHGSJSONTokenString;
+        }
+        break;
+      }
+
+      case kHGSJSONTokenStringUnicode: {
+        int value = HGSJSONHexValue(*p++);
+        if (value < 0) {
+          [self failWithCode:kHGSJSONStreamParserSyntaxError
+                      offset:offset_ + (p - start) - 1
+                 description:@"Invalid \\u escape"];
+          break;
+        }
+        unicodeValue_ = (unicodeValue_ << 4) | value;
+        if (++unicodeDigits_ == 4) {
+          [self appendUnicodeEscape];
+          token_ = kHGSJSONTokenString;
+        }
+        break;
+      }
+
+      case kHGSJSONTokenNumber: {
+        const unsigned char *run = p;
+        while (p < end && HGSJSONIsNumberChar(*p)) ++p;
+        [self appendBytes:run length:p - run];
+        // The terminating character is handled on the next pass.
+        if (p < end) {
+          [self finishNumberAt:offset_ + (p - start)];
+        }
+        break;
+      }
+
+      case kHGSJSONTokenLiteral:
+        if (*p != (unsigned char)literal_[literalIndex_]) {
+          [self failWithCode:kHGSJSONStreamParserSyntaxError
+                      offset:offset_ + (p - start)
+                 description:@"Invalid literal"];
+          break;
+        }
+        ++p;
+        if (literal_[++literalIndex_] == '\0') {
+          [self finishLiteral];
+        }
+        break;
+
+      case kHGSJSONTokenNone: {
+        unsigned char c = *p;
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+          ++p;
+          break;
+        }
+        unsigned long long offset = offset_ + (p - start);
+        BOOL allowTrailingCommas
+          = (options_ & kHGSJSONStreamParserAllowTrailingCommas) != 0;
+        switch (expect_) {
+          case kHGSJSONExpectKeyOrEnd:
+          case kHGSJSONExpectKeyAfterComma:
+            if (c == '"') {
+              ++p;
+              token_ = kHGSJSONTokenString;
+              tokenIsKey_ = YES;
+              bufferLength_ = 0;
+            } else if (c == '}' && (expect_ == kHGSJSONExpectKeyOrEnd
+                                    || allowTrailingCommas)) {
+              ++p;
+              [self popContainer];
+            } else {
+              [self failWithCode:kHGSJSONStreamParserSyntaxError
+                          offset:offset
+                     description:@"Expected a key"];
+            }
+            break;
+
+          case kHGSJSONExpectColon:
+            if (c == ':') {
+              ++p;
+              expect_ = kHGSJSONExpectValue;
+            } else {
+              [self failWithCode:kHGSJSONStreamParserSyntaxError
+                          offset:offset
+                     description:@"Expected ':'"];
+            }
+            break;
+
+          case kHGSJSONExpectCommaOrEnd: {
+            char container = containers_[depth_ - 1];
+            if (c == ',') {
+              ++p;
+              expect_ = (container == '{') ? kHGSJSONExpectKeyAfterComma
+                                           : kHGSJSONExpectArrayValueAfterComma;
+            } else if ((c == '}' && container == '{')
+                       || (c == ']' && container == '[')) {
+              ++p;
+              [self popContainer];
+            } else {
+              [self failWithCode:kHGSJSONStreamParserSyntaxError
+                          offset:offset
+                     description:@"Expected ',' or the end of a container"];
+            }
+            break;
+          }
+
+          case kHGSJSONExpectNothing:
+            [self failWithCode:kHGSJSONStreamParserSyntaxError
+                        offset:offset
+                   description:@"Unexpected data after the document"];
+            break;
+
+          case kHGSJSONExpectArrayValueOrEnd:
+          case kHGSJSONExpectArrayValueAfterComma:
+            if (c == ']' && (expect_ == kHGSJSONExpectArrayValueOrEnd
+                             || allowTrailingCommas)) {
+              ++p;
+              [self popContainer];
+              break;
+            }
+            // Fall through to parse a value.
+          case kHGSJSONExpectValue:
+            if (c == '{' || c == '[') {
+              ++p;
+              [self pushContainer:c offset:offset];
+            } else if (c == '"') {
+              ++p;
+              token_ = kHGSJSONTokenString;
+              tokenIsKey_ = NO;
+              bufferLength_ = 0;
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+              // Collected, starting with this character, on the next pass.
+              token_ = kHGSJSONTokenNumber;
+              bufferLength_ = 0;
+            } else if (c == 't' || c == 'f' || c == 'n') {
+              token_ = kHGSJSONTokenLiteral;
+              literal_ = (c == 't') ? kHGSJSONTrue
+                : (c == 'f') ? kHGSJSONFalse : kHGSJSONNull;
+              literalIndex_ = 0;
+            } else {
+              [self failWithCode:kHGSJSONStreamParserSyntaxError
+                          offset:offset
+                     description:@"Expected a value"];
+            }
+            break;
+        }
+        break;
+      }
+    }
+  }
+  offset_ += length;
+  return error_ == nil;
+}
+
+- (BOOL)finishParsing {
+  if (error_) return NO;
+  if (token_ == kHGSJSONTokenNumber && depth_ == 0) {
+    [self finishNumberAt:offset_];
+  }
+  if (!error_ && (token_ != kHGSJSONTokenNone
+                  || expect_ != kHGSJSONExpectNothing)) {
+    [self failWithCode:kHGSJSONStreamParserIncompleteError
+                offset:offset_
+           description:@"Unexpected end of input"];
+  }
+  return error_ == nil;
+}
+
+- (BOOL)parseData:(NSData *)data {
+  [self parseBytes:[data bytes] length:[data length]];
+  return [self finishParsing];
+}
+
+- (BOOL)parseContentsOfFile:(NSString *)path {
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  if (fd < 0) {
+    NSString *description
+      = [NSString stringWithFormat:@"Unable to open %@ (%s)",
+         path, strerror(errno)];
+    [self failWithCode:kHGSJSONStreamParserReadError
+                offset:0
+           description:description];
+    return NO;
+  }
+  char *chunk = malloc(kHGSJSONReadChunkSize);
+  ssize_t bytesRead = 0;
+  if (chunk) {
+    do {
+      bytesRead = read(fd, chunk, kHGSJSONReadChunkSize);
+      if (bytesRead > 0) {
+        if (![self parseBytes:chunk length:bytesRead]) break;
+      } else if (bytesRead < 0 && errno == EINTR) {
+        bytesRead = 1;
+      }
+    } while (bytesRead > 0);
+    free(chunk);
+  }
+  if (!chunk || bytesRead < 0) {
+    NSString *description
+      = [NSString stringWithFormat:@"Unable to read %@ (%s)",
+         path, strerror(errno)];
+    [self failWithCode:kHGSJSONStreamParserReadError
+                offset:offset_
+           description:description];
+  }
+  close(fd);
+  return [self finishParsing];
+}
+
+- (void)abortParsing {
+  [self failWithCode:kHGSJSONStreamParserAbortedError
+              offset:offset_
+         description:@"Parsing aborted"];
+}
+
+- (NSUInteger)depth {
+  return depth_;
+}
+
+- (NSError *)parserError {
+  return [[error_ retain] autorelease];
+}
+
+#pragma mark Private
+
+- (void)failWithCode:(NSInteger)code
+              offset:(unsigned long long)offset
+         description:(NSString *)description {
+  if (error_) return;
+  NSString *message = [NSString stringWithFormat:@"%@ at offset %llu",
+                       description, offset];
+  NSDictionary *userInfo
+    = [NSDictionary dictionaryWithObject:message
+                                  forKey:NSLocalizedDescriptionKey];
+  error_ = [[NSError alloc] initWithDomain:kHGSJSONStreamParserErrorDomain
+                                      code:code
+                                  userInfo:userInfo];
+}
+
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length {
+  if (bufferLength_ + length + 1 > bufferCapacity_) {
+    while (bufferLength_ + length + 1 > bufferCapacity_) {
+      bufferCapacity_ *= 2;
+    }
+    buffer_ = reallocf(buffer_, bufferCapacity_);
+    if (!buffer_) {
+      // COV_NF_START
+      HGSLog(@"Unable to grow JSON parser buffer to %lu",
+             (unsigned long)bufferCapacity_);
+      abort();
+      // COV_NF_END
+    }
+  }
+  memcpy(buffer_ + bufferLength_, bytes, length);
+  bufferLength_ += length;
+}
+
+- (void)appendCodePoint:(UInt32)codePoint {
+  char utf8[4];
+  NSUInteger length;
+  if (codePoint < 0x80) {
+    utf8[0] = codePoint;
+    length = 1;
+  } else if (codePoint < 0x800) {
+    utf8[0] = 0xC0 | (codePoint >> 6);
+    utf8[1] = 0x80 | (codePoint & 0x3F);
+    length = 2;
+  } else if (codePoint < 0x10000) {
+    utf8[0] = 0xE0 | (codePoint >> 12);
+    utf8[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+    utf8[2] = 0x80 | (codePoint & 0x3F);
+    length = 3;
+  } else {
+    utf8[0] = 0xF0 | (codePoint >> 18);
+    utf8[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+    utf8[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+    utf8[3] = 0x80 | (codePoint & 0x3F);
+    length = 4;
+  }
+  [self appendBytes:utf8 length:length];
+}
+
+// A high surrogate that isn't followed by a low one becomes U+FFFD.
+- (void)flushHighSurrogate {
+  if (highSurrogate_) {
+    highSurrogate_ = 0;
+    [self appendCodePoint:0xFFFD];
+  }
+}
+
+- (void)appendUnicodeEscape {
+  UInt32 value = unicodeValue_;
+  if (value >= 0xD800 && value <= 0xDBFF) {
+    [self flushHighSurrogate];
+    highSurrogate_ = value;
+    return;
+  }
+  if (value >= 0xDC00 && value <= 0xDFFF) {
+    if (highSurrogate_) {
+      value = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (value - 0xDC00);
+      highSurrogate_ = 0;
+    } else {
+      value = 0xFFFD;
+    }
+  } else {
+    [self flushHighSurrogate];
+  }
+  [self appendCodePoint:value];
+}
+
+// Documents tend to repeat a handful of keys many times over, so short keys
+// are looked up in a small cache before a new string is made.
+- (NSString *)keyFromBuffer {
+  NSUInteger length = bufferLength_;
+  HGSJSONKeyCacheEntry *entry = NULL;
+  if (length <= kHGSJSONKeyCacheMaxKeyLength) {
+    NSUInteger hash = 2166136261U;
+    for (NSUInteger i = 0; i < length; ++i) {
+      hash = (hash ^ (unsigned char)buffer_[i]) * 16777619U;
+    }
+    entry = (HGSJSONKeyCacheEntry *)keyCache_ + hash % kHGSJSONKeyCacheSize;
+    if (entry->string && entry->length == length
+        && memcmp(entry->bytes, buffer_, length) == 0) {
+      return [entry->string retain];
+    }
+  }
+  NSString *key = [[NSString alloc] initWithBytes:buffer_
+                                           length:length
+                                         encoding:NSUTF8StringEncoding];
+  if (key && entry) {
+    [entry->string release];
+    entry->string = [key retain];
+    entry->length = length;
+    memcpy(entry->bytes, buffer_, length);
+  }
+  return key;
+}
+
+- (void)deliverPendingKey {
+  if (pendingKey_) {
+    if (delegateFlags_ & kHGSJSONDelegateKey) {
+      [delegate_ parser:self foundKey:pendingKey_];
+    }
+    [pendingKey_ release];
+    pendingKey_ = nil;
+  }
+}
+
+- (void)valueDidEnd {
+  expect_ = depth_ ? kHGSJSONExpectCommaOrEnd : kHGSJSONExpectNothing;
+}
+
+- (BOOL)pushContainer:(char)type offset:(unsigned long long)offset {
+  if (depth_ == kHGSJSONStreamParserMaxDepth) {
+    [self failWithCode:kHGSJSONStreamParserDepthError
+                offset:offset
+           description:@"Document nested too deeply"];
+    return NO;
+  }
+  [self deliverPendingKey];
+  containers_[depth_++] = type;
+  if (type == '{') {
+    expect_ = kHGSJSONExpectKeyOrEnd;
+    if (delegateFlags_ & kHGSJSONDelegateStartObject) {
+      [delegate_ parserDidStartObject:self];
+    }
+  } else {
+    expect_ = kHGSJSONExpectArrayValueOrEnd;
+    if (delegateFlags_ & kHGSJSONDelegateStartArray) {
+      [delegate_ parserDidStartArray:self];
+    }
+  }
+  return YES;
+}
+
+- (void)popContainer {
+  char type = containers_[--depth_];
+  [self valueDidEnd];
+  if (type == '{') {
+    if (delegateFlags_ & kHGSJSONDelegateEndObject) {
+      [delegate_ parserDidEndObject:self];
+    }
+  } else {
+    if (delegateFlags_ & kHGSJSONDelegateEndArray) {
+      [delegate_ parserDidEndArray:self];
+    }
+  }
+}
+
+- (void)finishStringAt:(unsigned long long)offset {
+  token_ = kHGSJSONTokenNone;
+  NSString *string = nil;
+  if (tokenIsKey_) {
+    string = [self keyFromBuffer];
+  } else {
+    string = [[NSString alloc] initWithBytes:buffer_
+                                      length:bufferLength_
+                                    encoding:NSUTF8StringEncoding];
+  }
+  if (!string) {
+    [self failWithCode:kHGSJSONStreamParserEncodingError
+                offset:offset
+           description:@"String is not valid UTF-8"];
+    return;
+  }
+  if (tokenIsKey_) {
+    [pendingKey_ release];
+    pendingKey_ = string;
+    expect_ = kHGSJSONExpectColon;
+  } else {
+    [self deliverPendingKey];
+    [self valueDidEnd];
+    if (delegateFlags_ & kHGSJSONDelegateString) {
+      [delegate_ parser:self foundString:string];
+    }
+    [string release];
+  }
+}
+
+- (void)finishNumberAt:(unsigned long long)offset {
+  token_ = kHGSJSONTokenNone;
+  BOOL isInteger = NO;
+  if (!HGSJSONIsValidNumber(buffer_, bufferLength_, &isInteger)) {
+    [self failWithCode:kHGSJSONStreamParserSyntaxError
+                offset:offset
+           description:@"Invalid number"];
+    return;
+  }
+  // appendBytes:length: always leaves room for the terminator.
+  buffer_[bufferLength_] = '\0';
+  NSNumber *number = nil;
+  if (isInteger) {
+    errno = 0;
+    long long value = strtoll_l(buffer_, NULL, 10, NULL);
+    if (errno != ERANGE) {
+      number = [[NSNumber alloc] initWithLongLong:value];
+    }
+  }
+  if (!number) {
+    number = [[NSNumber alloc] initWithDouble:strtod_l(buffer_, NULL, NULL)];
+  }
+  [self deliverPendingKey];
+  [self valueDidEnd];
+  if (delegateFlags_ & kHGSJSONDelegateNumber) {
+    [delegate_ parser:self foundNumber:number];
+  }
+  [number release];
+}
+
+- (void)finishLiteral {
+  token_ = kHGSJSONTokenNone;
+  [self valueDidEnd];
+  if (literal_ == kHGSJSONNull) {
+    if (options_ & kHGSJSONStreamParserSkipNulls) {
+      [pendingKey_ release];
+      pendingKey_ = nil;
+    } else {
+      [self deliverPendingKey];
+      if (delegateFlags_ & kHGSJSONDelegateNull) {
+        [delegate_ parserFoundNull:self];
+      }
+    }
+  } else {
+    [self deliverPendingKey];
+    if (delegateFlags_ & kHGSJSONDelegateBool) {
+      [delegate_ parser:self foundBool:(literal_ == kHGSJSONTrue)];
+    }
+  }
+}
+
+@end
+
+@implementation HGSJSONObjectBuilder
+
+- (id)init {
+  if ((self = [super init])) {
+    stack_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [stack_ release];
+  [key_ release];
+  [root_ release];
+  [super dealloc];
+}
+
+- (id)root {
+  return [[root_ retain] autorelease];
+}
+
+- (void)addValue:(id)value {
+  if (key_) {
+    [[stack_ lastObject] setObject:value forKey:key_];
+    [key_ release];
+    key_ = nil;
+  } else if ([stack_ count]) {
+    [[stack_ lastObject] addObject:value];
+  } else {
+    [root_ release];
+    root_ = [value retain];
+  }
+}
+
+- (void)parserDidStartObject:(HGSJSONStreamParser *)parser {
+  NSMutableDictionary *object = [[NSMutableDictionary alloc] init];
+  [self addValue:object];
+  [stack_ addObject:object];
+  [object release];
+}
+
+- (void)parserDidEndObject:(HGSJSONStreamParser *)parser {
+  [stack_ removeLastObject];
+}
+
+- (void)parserDidStartArray:(HGSJSONStreamParser *)parser {
+  NSMutableArray *array = [[NSMutableArray alloc] init];
+  [self addValue:array];
+  [stack_ addObject:array];
+  [array release];
+}
+
+- (void)parserDidEndArray:(HGSJSONStreamParser *)parser {
+  [stack_ removeLastObject];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key {
+  [key_ release];
+  key_ = [key copy];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string {
+  [self addValue:string];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundNumber:(NSNumber *)number {
+  [self addValue:number];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundBool:(BOOL)value {
+  [self addValue:[NSNumber numberWithBool:value]];
+}
+
+- (void)parserFoundNull:(HGSJSONStreamParser *)parser {
+  [self addValue:[NSNull null]];
+}
+
+@end
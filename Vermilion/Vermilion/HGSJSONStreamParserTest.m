@@ -0,0 +1,519 @@
+//
+//  HGSJSONStreamParserTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <malloc/malloc.h>
+#import "GTMSenTestCase.h"
+#import "HGSJSONStreamParser.h"
+#import <JSON/JSON.h>
+
+@interface HGSJSONStreamParserTest : GTMTestCase 
+@end
+
+// Records parser events as strings.
+@interface HGSJSONEventRecorder : NSObject <HGSJSONStreamParserDelegate> {
+ @private
+  NSMutableArray *events_;
+  NSUInteger abortAfter_;
+}
+- (id)initWithAbortAfter:(NSUInteger)abortAfter;
+- (NSArray *)events;
+@end
+
+@implementation HGSJSONEventRecorder
+
+- (id)initWithAbortAfter:(NSUInteger)abortAfter {
+  if ((self = [super init])) {
+    events_ = [[NSMutableArray alloc] init];
+    abortAfter_ = abortAfter;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [events_ release];
+  [super dealloc];
+}
+
+- (NSArray *)events {
+  return events_;
+}
+
+- (void)addEvent:(NSString *)event parser:(HGSJSONStreamParser *)parser {
+  [events_ addObject:event];
+  if ([events_ count] == abortAfter_) {
+    [parser abortParsing];
+  }
+}
+
+- (void)parserDidStartObject:(HGSJSONStreamParser *)parser {
+  [self addEvent:@"{" parser:parser];
+}
+
+- (void)parserDidEndObject:(HGSJSONStreamParser *)parser {
+  [self addEvent:@"}" parser:parser];
+}
+
+- (void)parserDidStartArray:(HGSJSONStreamParser *)parser {
+  [self addEvent:@"[" parser:parser];
+}
+
+- (void)parserDidEndArray:(HGSJSONStreamParser *)parser {
+  [self addEvent:@"]" parser:parser];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key {
+  [self addEvent:[NSString stringWithFormat:@"k:%@", key] parser:parser];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string {
+  [self addEvent:[NSString stringWithFormat:@"s:%@", string] parser:parser];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundNumber:(NSNumber *)number {
+  [self addEvent:[NSString stringWithFormat:@"n:%@", number] parser:parser];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundBool:(BOOL)value {
+  [self addEvent:(value ? @"true" : @"false") parser:parser];
+}
+
+- (void)parserFoundNull:(HGSJSONStreamParser *)parser {
+  [self addEvent:@"null" parser:parser];
+}
+
+@end
+
+// Counts Firefox style bookmark entries without building anything.
+@interface HGSJSONPlaceCounter : NSObject <HGSJSONStreamParserDelegate> {
+ @private
+  BOOL inType_;
+  NSUInteger places_;
+}
+- (NSUInteger)places;
+@end
+
+@implementation HGSJSONPlaceCounter
+
+- (NSUInteger)places {
+  return places_;
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundKey:(NSString *)key {
+  inType_ = [key isEqualToString:@"type"];
+}
+
+- (void)parser:(HGSJSONStreamParser *)parser foundString:(NSString *)string {
+  if (inType_ && [string isEqualToString:@"text/x-moz-place"]) {
+    ++places_;
+  }
+  inType_ = NO;
+}
+
+@end
+
+static size_t HGSJSONBytesInUse(void) {
+  malloc_statistics_t stats;
+  malloc_zone_statistics(NULL, &stats);
+  return stats.size_in_use;
+}
+
+@implementation HGSJSONStreamParserTest
+
+- (void)testDocument {
+  NSString *json
+    = @" {\"a\": [1, -2.5, 1e3, true, false, null, \"x\"],\n"
+      @"  \"b\": {\"c\": {}, \"d\": []}, \"\": \"empty\"} ";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  NSError *error = nil;
+  id result = [HGSJSONStreamParser JSONObjectWithData:data
+                                              options:0
+                                                error:&error];
+  STAssertNil(error, nil);
+  NSArray *a = [NSArray arrayWithObjects:
+                [NSNumber numberWithInt:1],
+                [NSNumber numberWithDouble:-2.5],
+                [NSNumber numberWithDouble:1000],
+                [NSNumber numberWithBool:YES],
+                [NSNumber numberWithBool:NO],
+                [NSNull null],
+                @"x",
+                nil];
+  NSDictionary *b = [NSDictionary dictionaryWithObjectsAndKeys:
+                     [NSDictionary dictionary], @"c",
+                     [NSArray array], @"d",
+                     nil];
+  NSDictionary *expected = [NSDictionary dictionaryWithObjectsAndKeys:
+                            a, @"a",
+                            b, @"b",
+                            @"empty", @"",
+                            nil];
+  STAssertEqualObjects(result, expected, nil);
+  
+  // Top level scalars are allowed.
+  data = [@"42" dataUsingEncoding:NSUTF8StringEncoding];
+  result = [HGSJSONStreamParser JSONObjectWithData:data
+                                           options:0
+                                             error:nil];
+  STAssertEqualObjects(result, [NSNumber numberWithInt:42], nil);
+}
+
+- (void)testEvents {
+  NSString *json
+    = @"{\"a\":[1,{\"b\":null}],\"c\":\"d\",\"e\":null,\"f\":true}";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  HGSJSONEventRecorder *recorder
+    = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:0] autorelease];
+  HGSJSONStreamParser *parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:recorder
+                                             options:0] autorelease];
+  STAssertTrue([parser parseData:data], nil);
+  NSString *events = [[recorder events] componentsJoinedByString:@" "];
+  NSString *expected
+    = @"{ k:a [ n:1 { k:b null } ] k:c s:d k:e null k:f true }";
+  STAssertEqualObjects(events, expected, nil);
+  STAssertEquals([parser depth], (NSUInteger)0, nil);
+  
+  // Skipping nulls drops their keys too.
+  recorder = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:0] autorelease];
+  HGSJSONStreamParserOptions options = kHGSJSONStreamParserSkipNulls;
+  parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:recorder
+                                             options:options] autorelease];
+  STAssertTrue([parser parseData:data], nil);
+  events = [[recorder events] componentsJoinedByString:@" "];
+  STAssertEqualObjects(events, @"{ k:a [ n:1 { } ] k:c s:d k:f true }", nil);
+  
+  // Aborting from the delegate stops everything.
+  recorder = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:3] autorelease];
+  parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:recorder
+                                             options:0] autorelease];
+  STAssertFalse([parser parseData:data], nil);
+  STAssertEquals([[recorder events] count], (NSUInteger)3, nil);
+  STAssertEquals([[parser parserError] code],
+                 (NSInteger)kHGSJSONStreamParserAbortedError, nil);
+}
+
+- (void)testTrailingCommas {
+  NSString *json = @"{\"children\":[{\"a\":1,},{\"b\":2},],}";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  NSError *error = nil;
+  id result = [HGSJSONStreamParser JSONObjectWithData:data
+                                              options:0
+                                                error:&error];
+  STAssertNil(result, nil);
+  STAssertEquals([error code], (NSInteger)kHGSJSONStreamParserSyntaxError,
+                 nil);
+  HGSJSONStreamParserOptions options = kHGSJSONStreamParserAllowTrailingCommas;
+  result = [HGSJSONStreamParser JSONObjectWithData:data
+                                           options:options
+                                             error:&error];
+  NSArray *children = [NSArray arrayWithObjects:
+                       [NSDictionary dictionaryWithObject:
+                        [NSNumber numberWithInt:1] forKey:@"a"],
+                       [NSDictionary dictionaryWithObject:
+                        [NSNumber numberWithInt:2] forKey:@"b"],
+                       nil];
+  STAssertEqualObjects([result objectForKey:@"children"], children, nil);
+  
+  // Only a single trailing comma is allowed, and never on its own.
+  NSArray *invalid = [NSArray arrayWithObjects:
+                      @"[1,,]", @"[,]", @"{,}", @"{\"a\":1,,}", nil];
+  for (NSString *string in invalid) {
+    data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    result = [HGSJSONStreamParser JSONObjectWithData:data
+                                             options:options
+                                               error:nil];
+    STAssertNil(result, @"%@", string);
+  }
+}
+
+- (void)testStrings {
+  NSString *json
+    = @"[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\", \"\\u00e9\\u4E2D\", "
+      @"\"\\ud83d\\ude00\", \"\\ud83dx\", \"\\ude00\"]";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  NSArray *result = [HGSJSONStreamParser JSONObjectWithData:data
+                                                    options:0
+                                                      error:nil];
+  STAssertEquals([result count], (NSUInteger)5, nil);
+  STAssertEqualObjects([result objectAtIndex:0], @"\"\\/\b\f\n\r\t", nil);
+  unichar accents[] = { 0x00E9, 0x4E2D };
+  STAssertEqualObjects([result objectAtIndex:1],
+                       [NSString stringWithCharacters:accents length:2], nil);
+  unichar smiley[] = { 0xD83D, 0xDE00 };
+  STAssertEqualObjects([result objectAtIndex:2],
+                       [NSString stringWithCharacters:smiley length:2], nil);
+  // Unpaired surrogates are replaced.
+  unichar unpaired[] = { 0xFFFD, 'x' };
+  STAssertEqualObjects([result objectAtIndex:3],
+                       [NSString stringWithCharacters:unpaired length:2], nil);
+  STAssertEqualObjects([result objectAtIndex:4],
+                       [NSString stringWithCharacters:unpaired length:1], nil);
+  
+  // Raw UTF-8 is passed through.
+  const char cafeUTF8[] = "[\"caf\xC3\xA9\"]";
+  data = [NSData dataWithBytes:cafeUTF8 length:strlen(cafeUTF8)];
+  result = [HGSJSONStreamParser JSONObjectWithData:data
+                                           options:0
+                                             error:nil];
+  unichar cafe[] = { 'c', 'a', 'f', 0x00E9 };
+  STAssertEqualObjects([result lastObject],
+                       [NSString stringWithCharacters:cafe length:4], nil);
+  
+  // Invalid UTF-8.
+  const char bad[] = "[\"\xC3\x28\"]";
+  data = [NSData dataWithBytes:bad length:strlen(bad)];
+  NSError *error = nil;
+  result = [HGSJSONStreamParser JSONObjectWithData:data
+                                           options:0
+                                             error:&error];
+  STAssertNil(result, nil);
+  STAssertEquals([error code], (NSInteger)kHGSJSONStreamParserEncodingError,
+                 nil);
+}
+
+- (void)testNumbers {
+  NSString *json
+    = @"[0, -0, 12, -34, 1247496902218803, 99999999999999999999, 0.5, "
+      @"-1.25e-2, 2E+2]";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  NSArray *result = [HGSJSONStreamParser JSONObjectWithData:data
+                                                    options:0
+                                                      error:nil];
+  STAssertEquals([result count], (NSUInteger)9, nil);
+  STAssertEquals([[result objectAtIndex:2] intValue], 12, nil);
+  STAssertEquals([[result objectAtIndex:3] intValue], -34, nil);
+  STAssertEquals([[result objectAtIndex:4] longLongValue],
+                 1247496902218803LL, nil);
+  STAssertEqualsWithAccuracy([[result objectAtIndex:5] doubleValue],
+                             1e20, 1e6, nil);
+  STAssertEquals([[result objectAtIndex:6] doubleValue], 0.5, nil);
+  STAssertEquals([[result objectAtIndex:7] doubleValue], -0.0125, nil);
+  STAssertEquals([[result objectAtIndex:8] doubleValue], 200.0, nil);
+  
+  NSArray *invalid = [NSArray arrayWithObjects:
+                      @"01", @"1.", @"-", @"+1", @".5", @"1e", @"1.2.3",
+                      @"[1-2]", @"--1", nil];
+  for (NSString *string in invalid) {
+    data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    result = [HGSJSONStreamParser JSONObjectWithData:data
+                                             options:0
+                                               error:nil];
+    STAssertNil(result, @"%@", string);
+  }
+}
+
+- (void)testMalformed {
+  NSArray *invalid = [NSArray arrayWithObjects:
+                      @"", @" ", @"[", @"{\"a\"", @"{\"a\":}", @"{1:2}",
+                      @"[1 2]", @"[1]]", @"[1] x", @"tru", @"nul",
+                      @"trueish", @"\"abc", @"\"\\x\"", @"\"\\u12G4\"",
+                      @"\"a\tb\"", @"<html></html>", @"{\"a\" 1}", nil];
+  for (NSString *string in invalid) {
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    NSError *error = nil;
+    id result = [HGSJSONStreamParser JSONObjectWithData:data
+                                                options:0
+                                                  error:&error];
+    STAssertNil(result, @"%@", string);
+    STAssertNotNil(error, @"%@", string);
+  }
+  
+  // Nesting is bounded.
+  NSString *deep
+    = [@"" stringByPadding:kHGSJSONStreamParserMaxDepth + 1
+                withString:@"["
+           startingAtIndex:0];
+  NSData *data = [deep dataUsingEncoding:NSUTF8StringEncoding];
+  NSError *error = nil;
+  STAssertNil([HGSJSONStreamParser JSONObjectWithData:data
+                                              options:0
+                                                error:&error], nil);
+  STAssertEquals([error code], (NSInteger)kHGSJSONStreamParserDepthError, nil);
+}
+
+- (void)testChunkedInput {
+  NSString *json
+    = @"{\"title\":\"\\u00e9t\\u00e9\",\"id\":1247496902218803,"
+      @"\"children\":[{\"uri\":\"http://a/\",\"ok\":true,\"n\":null},],"
+      @"\"pi\":3.14159}";
+  NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+  HGSJSONStreamParserOptions options = kHGSJSONStreamParserAllowTrailingCommas;
+  id expected = [HGSJSONStreamParser JSONObjectWithData:data
+                                                options:options
+                                                  error:nil];
+  STAssertNotNil(expected, nil);
+  
+  // Splitting the input anywhere, even one byte at a time, gives the same
+  // events.
+  HGSJSONEventRecorder *wholeRecorder
+    = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:0] autorelease];
+  HGSJSONStreamParser *parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:wholeRecorder
+                                             options:options] autorelease];
+  STAssertTrue([parser parseData:data], nil);
+  const char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  for (NSUInteger chunkSize = 1; chunkSize < 8; ++chunkSize) {
+    HGSJSONEventRecorder *recorder
+      = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:0] autorelease];
+    parser
+      = [[[HGSJSONStreamParser alloc] initWithDelegate:recorder
+                                               options:options] autorelease];
+    for (NSUInteger i = 0; i < length; i += chunkSize) {
+      NSUInteger size = MIN(chunkSize, length - i);
+      STAssertTrue([parser parseBytes:bytes + i length:size], nil);
+    }
+    STAssertTrue([parser finishParsing], nil);
+    STAssertEqualObjects([recorder events], [wholeRecorder events],
+                         @"chunk size %u", chunkSize);
+  }
+  
+  // A number at the end of the input needs finishParsing to complete it.
+  HGSJSONEventRecorder *recorder
+    = [[[HGSJSONEventRecorder alloc] initWithAbortAfter:0] autorelease];
+  parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:recorder
+                                             options:0] autorelease];
+  STAssertTrue([parser parseBytes:"12" length:2], nil);
+  STAssertEquals([[recorder events] count], (NSUInteger)0, nil);
+  STAssertTrue([parser finishParsing], nil);
+  STAssertEqualObjects([recorder events], [NSArray arrayWithObject:@"n:12"],
+                       nil);
+}
+
+- (void)testContentsOfFile {
+  NSString *path
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"HGSJSONStreamParserTest-%d.json",
+        [[NSProcessInfo processInfo] processIdentifier]]];
+  NSString *json = @"{\"a\": [\"b\", 1]}";
+  STAssertTrue([json writeToFile:path
+                      atomically:NO
+                        encoding:NSUTF8StringEncoding
+                           error:nil], nil);
+  NSError *error = nil;
+  id result = [HGSJSONStreamParser JSONObjectWithContentsOfFile:path
+                                                        options:0
+                                                          error:&error];
+  NSArray *array = [NSArray arrayWithObjects:
+                    @"b", [NSNumber numberWithInt:1], nil];
+  STAssertEqualObjects(result,
+                       [NSDictionary dictionaryWithObject:array forKey:@"a"],
+                       nil);
+  STAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path
+                                                          error:nil], nil);
+  result = [HGSJSONStreamParser JSONObjectWithContentsOfFile:path
+                                                     options:0
+                                                       error:&error];
+  STAssertNil(result, nil);
+  STAssertEquals([error code], (NSInteger)kHGSJSONStreamParserReadError, nil);
+}
+
+- (void)testLargeBookmarksFile {
+  // Write a Firefox style bookmarks backup with 100,000 bookmarks.
+  const NSUInteger kBookmarkCount = 100000;
+  NSString *path
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"HGSJSONStreamParserTest-%d.json",
+        [[NSProcessInfo processInfo] processIdentifier]]];
+  NSMutableString *json = [NSMutableString stringWithString:
+                           @"{\"title\":\"\",\"id\":1,"
+                           @"\"type\":\"text/x-moz-place-container\","
+                           @"\"root\":\"placesRoot\",\"children\":["];
+  for (NSUInteger i = 0; i < kBookmarkCount; ++i) {
+    [json appendFormat:
+     @"%@{\"title\":\"Bookmark \\u00e9 %u\",\"id\":%u,\"parent\":1,"
+     @"\"dateAdded\":1247496902218803,\"lastModified\":1247496902638699,"
+     @"\"annos\":[{\"name\":\"bookmarkProperties/description\","
+     @"\"flags\":0,\"expires\":4,\"mimeType\":null,\"type\":3,"
+     @"\"value\":\"Description %u\"}],"
+     @"\"type\":\"text/x-moz-place\",\"uri\":\"http://example.com/%u\"}",
+     (i ? @"," : @""), i, i + 2, i, i];
+  }
+  [json appendString:@"]}"];
+  STAssertTrue([json writeToFile:path
+                      atomically:NO
+                        encoding:NSUTF8StringEncoding
+                           error:nil], nil);
+  
+  // Reading the file and building the tree with JSONValue.
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  size_t startBytes = HGSJSONBytesInUse();
+  NSDate *start = [NSDate date];
+  NSString *contents = [NSString stringWithContentsOfFile:path
+                                                 encoding:NSUTF8StringEncoding
+                                                    error:nil];
+  NSDictionary *sbjsonTree = [contents JSONValue];
+  NSTimeInterval sbjsonTime = -[start timeIntervalSinceNow];
+  size_t sbjsonBytes = HGSJSONBytesInUse() - startBytes;
+  STAssertEquals([[sbjsonTree objectForKey:@"children"] count],
+                 kBookmarkCount, nil);
+  [pool release];
+  
+  // Building the same tree with the stream parser.
+  pool = [[NSAutoreleasePool alloc] init];
+  startBytes = HGSJSONBytesInUse();
+  NSDictionary *tree
+    = [HGSJSONStreamParser JSONObjectWithContentsOfFile:path
+                                                options:0
+                                                  error:nil];
+  size_t treeBytes = HGSJSONBytesInUse() - startBytes;
+  STAssertEquals([[tree objectForKey:@"children"] count], kBookmarkCount, nil);
+  [pool release];
+  
+  // Just picking out the bookmarks as they go by.
+  pool = [[NSAutoreleasePool alloc] init];
+  startBytes = HGSJSONBytesInUse();
+  start = [NSDate date];
+  HGSJSONPlaceCounter *counter
+    = [[[HGSJSONPlaceCounter alloc] init] autorelease];
+  HGSJSONStreamParser *parser
+    = [[[HGSJSONStreamParser alloc] initWithDelegate:counter
+                                             options:0] autorelease];
+  STAssertTrue([parser parseContentsOfFile:path], nil);
+  NSTimeInterval streamTime = -[start timeIntervalSinceNow];
+  size_t streamBytes = HGSJSONBytesInUse() - startBytes;
+  STAssertEquals([counter places], kBookmarkCount, nil);
+  [pool release];
+  
+  // Neither the file contents nor a tree is held when only events are
+  // wanted, so that has to beat reading the file and calling JSONValue.
+  STAssertLessThan(streamBytes, sbjsonBytes, nil);
+  STAssertLessThan(streamBytes, treeBytes, nil);
+  STAssertLessThan(streamTime, sbjsonTime, nil);
+  STAssertTrue([[NSFileManager defaultManager] removeItemAtPath:path
+                                                          error:nil], nil);
+}
+
+@end
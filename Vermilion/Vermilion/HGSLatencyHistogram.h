@@ -0,0 +1,156 @@
+//
+//  HGSLatencyHistogram.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*!
+ @header
+ @discussion HGSLatencyHistogram
+*/
+
+#import <Foundation/Foundation.h>
+
+/*!
+  Stages of the search pipeline that are timed. Queue, run and sort are
+  recorded per source as well as overall.
+*/
+extern NSString *const kHGSLatencyStageQueue;  // Waiting to run
+extern NSString *const kHGSLatencyStageRun;  // Start to finishQuery
+extern NSString *const kHGSLatencyStageSort;  // setRankedResults: filter/sort
+extern NSString *const kHGSLatencyStageMerge;  // HGSQueryController merging
+extern NSString *const kHGSLatencyStageNotify;  // Waiting for the main thread
+extern NSString *const kHGSLatencyStageIcon;  // HGSIconProvider loads
+extern NSString *const kHGSLatencyStageCache;  // HGSSQLiteBackedCache lookups
+
+/*!
+  Environment variable naming a file to write the registry's report to when
+  the process exits. Meant for test runs.
+*/
+extern const char *const kHGSLatencyHistogramFileEnvironmentKey;
+
+/*! Converts a mach_absolute_time() delta to nanoseconds. */
+uint64_t HGSMachTimeToNanoseconds(uint64_t machTime);
+
+#define kHGSLatencyHistogramShardCount 4
+
+/*!
+  A histogram of durations in nanoseconds, with log linear buckets in the
+  style of HdrHistogram: exact below 16ns and within 1/16th (about 6%) of
+  the value above that, up to about five hours.
+
+  Recording takes no locks. Each thread counts into one of a few shards with
+  atomic increments, so threads only contend when they share a shard;
+  readers add the shards up, which is racy only in that a value recorded
+  during a read may or may not be counted.
+
+  Per source histograms handed out by HGSLatencyHistogramRegistry also
+  count everything recorded in them in their stage's pipeline wide
+  histogram, so callers that hold on to one record into it directly.
+*/
+@interface HGSLatencyHistogram : NSObject {
+ @private
+  NSString *stage_;
+  NSString *source_;
+  int32_t *shards_[kHGSLatencyHistogramShardCount];
+  HGSLatencyHistogram *stageHistogram_;
+}
+
+/*! The stage this histogram times. */
+@property (readonly, copy) NSString *stage;
+/*! The source identifier for per source histograms, nil otherwise. */
+@property (readonly, copy) NSString *source;
+
+- (id)initWithStage:(NSString *)stage source:(NSString *)source;
+
+- (void)recordNanoseconds:(uint64_t)nanoseconds;
+/*! Records a mach_absolute_time() delta. */
+- (void)recordMachTime:(uint64_t)machTime;
+
+- (uint64_t)count;
+/*!
+  The highest value (in nanoseconds) that |percentile| percent of the
+  recorded values are no greater than, to the precision of the buckets.
+  0 if nothing has been recorded.
+*/
+- (uint64_t)nanosecondsAtPercentile:(double)percentile;
+- (uint64_t)maximumNanoseconds;
+- (void)reset;
+
+@end
+
+/*!
+  Keeps the latency histograms for the whole search pipeline.
+  Histograms are created on demand and never go away (reset only clears
+  them), so callers that record often can hold on to them.
+
+  The pipeline wide histograms of the stages above are made up front and
+  are looked up without locks. Per source histograms are looked up under a
+  lock, so callers that record per source should look them up once (see
+  -[HGSSearchSource latencyHistogramForStage:]).
+*/
+@interface HGSLatencyHistogramRegistry : NSObject {
+ @private
+  NSMutableDictionary *histograms_;
+  // Never changes once made, so it can be read without locking.
+  NSDictionary *stageHistograms_;
+}
+
++ (HGSLatencyHistogramRegistry *)sharedRegistry;
+
+/*!
+  Returns the histogram for |stage| and |source|. Pass a nil |source| for
+  the pipeline wide histogram of |stage|.
+*/
+- (HGSLatencyHistogram *)histogramForStage:(NSString *)stage
+                                    source:(NSString *)source;
+
+/*!
+  Records |machTime| in the pipeline wide histogram for |stage| and, if
+  |source| isn't nil, in the one for |source| as well. Takes no locks when
+  |source| is nil and |stage| is one of the stages above.
+*/
+- (void)recordMachTime:(uint64_t)machTime
+              forStage:(NSString *)stage
+                source:(NSString *)source;
+
+/*! All histograms, sorted by stage and then source. */
+- (NSArray *)histograms;
+
+/*!
+  One line per histogram with its count and p50, p99, p99.9 and maximum in
+  milliseconds.
+*/
+- (NSString *)report;
+- (BOOL)writeReportToFile:(NSString *)path;
+
+/*! Clears every histogram. */
+- (void)reset;
+
+@end
@@ -0,0 +1,386 @@
+//
+//  HGSLatencyHistogram.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSLatencyHistogram.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdlib.h>
+#import "HGSLog.h"
+
+NSString *const kHGSLatencyStageQueue = @"queue";
+NSString *const kHGSLatencyStageRun = @"run";
+NSString *const kHGSLatencyStageSort = @"sort";
+NSString *const kHGSLatencyStageMerge = @"merge";
+NSString *const kHGSLatencyStageNotify = @"notify";
+NSString *const kHGSLatencyStageIcon = @"icon";
+NSString *const kHGSLatencyStageCache = @"cache";
+
+const char *const kHGSLatencyHistogramFileEnvironmentKey
+  = "HGS_LATENCY_HISTOGRAM_FILE";
+
+// Values below 2^kSubBucketBits get a bucket each. Above that every power
+// of two is split into kSubBucketCount buckets, up to 2^(kMaxMagnitude + 1).
+#define kSubBucketBits 4
+#define kSubBucketCount (1 << kSubBucketBits)
+#define kMaxMagnitude 44
+#define kBucketCount \
+  (kSubBucketCount + (kMaxMagnitude - kSubBucketBits + 1) * kSubBucketCount)
+
+static pthread_key_t gHGSLatencyShardKey;
+static int32_t gHGSLatencyNextShard = 0;
+
+static NSUInteger HGSLatencyBucketForValue(uint64_t value) {
+  if (value < kSubBucketCount) return (NSUInteger)value;
+  const uint64_t kLargest = (1ULL << (kMaxMagnitude + 1)) - 1;
+  if (value > kLargest) {
+    value = kLargest;
+  }
+  int magnitude = 63 - __builtin_clzll(value);
+  int shift = magnitude - kSubBucketBits;
+  NSUInteger subBucket = (NSUInteger)(value >> shift) - kSubBucketCount;
+  return kSubBucketCount + shift * kSubBucketCount + subBucket;
+}
+
+static uint64_t HGSLatencyHighestValueInBucket(NSUInteger bucket) {
+  if (bucket < kSubBucketCount) return bucket;
+  NSUInteger shift = (bucket - kSubBucketCount) / kSubBucketCount;
+  NSUInteger subBucket = (bucket - kSubBucketCount) % kSubBucketCount;
+  uint64_t lowest = (uint64_t)(kSubBucketCount + subBucket) << shift;
+  return lowest + (1ULL << shift) - 1;
+}
+
+uint64_t HGSMachTimeToNanoseconds(uint64_t machTime) {
+  static mach_timebase_info_data_t sTimebaseInfo;
+  if (sTimebaseInfo.denom == 0) {
+    mach_timebase_info(&sTimebaseInfo);
+  }
+  return machTime * sTimebaseInfo.numer / sTimebaseInfo.denom;
+}
+
+// Threads are dealt shards round robin the first time they record anything.
+static NSUInteger HGSLatencyShardForCurrentThread(void) {
+  intptr_t shard = (intptr_t)pthread_getspecific(gHGSLatencyShardKey);
+  if (!shard) {
+    shard = OSAtomicIncrement32(&gHGSLatencyNextShard);
+    pthread_setspecific(gHGSLatencyShardKey, (void *)shard);
+  }
+  return (NSUInteger)shard % kHGSLatencyHistogramShardCount;
+}
+
+static void HGSLatencyWriteReportAtExit(void) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  const char *path = getenv(kHGSLatencyHistogramFileEnvironmentKey);
+  if (path) {
+    HGSLatencyHistogramRegistry *registry
+      = [HGSLatencyHistogramRegistry sharedRegistry];
+    [registry writeReportToFile:[NSString stringWithUTF8String:path]];
+  }
+  [pool release];
+}
+
+@interface HGSLatencyHistogram ()
+// Adds up the shards into |counts|, which holds kBucketCount values.
+- (uint64_t)getCounts:(uint64_t *)counts;
+// Everything recorded in us is recorded in |stageHistogram| as well.
+- (void)setStageHistogram:(HGSLatencyHistogram *)stageHistogram;
+@end
+
+@implementation HGSLatencyHistogram
+
+@synthesize stage = stage_;
+@synthesize source = source_;
+
++ (void)initialize {
+  if (self == [HGSLatencyHistogram class]) {
+    int err = pthread_key_create(&gHGSLatencyShardKey, NULL);
+    if (err) {
+      HGSLog(@"Unable to create latency histogram thread key (%d)", err);
+    }
+  }
+}
+
+- (id)init {
+  return [self initWithStage:nil source:nil];
+}
+
+- (id)initWithStage:(NSString *)stage source:(NSString *)source {
+  if ((self = [super init])) {
+    if (!stage) {
+      HGSLogDebug(@"HGSLatencyHistogram needs a stage");
+      [self release];
+      return nil;
+    }
+    stage_ = [stage copy];
+    source_ = [source copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramShardCount; ++i) {
+    free(shards_[i]);
+  }
+  [stage_ release];
+  [source_ release];
+  [stageHistogram_ release];
+  [super dealloc];
+}
+
+- (void)setStageHistogram:(HGSLatencyHistogram *)stageHistogram {
+  // Only set by the registry before anybody else gets to see us.
+  [stageHistogram_ autorelease];
+  stageHistogram_ = [stageHistogram retain];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p> %@ %@ (%llu)",
+          [self class], self, stage_, source_ ? source_ : @"",
+          [self count]];
+}
+
+- (void)recordNanoseconds:(uint64_t)nanoseconds {
+  NSUInteger shardIndex = HGSLatencyShardForCurrentThread();
+  int32_t *shard = shards_[shardIndex];
+  if (!shard) {
+    int32_t *newShard = calloc(kBucketCount, sizeof(int32_t));
+    if (!newShard) return;
+    void * volatile *slot = (void * volatile *)&shards_[shardIndex];
+    if (OSAtomicCompareAndSwapPtrBarrier(NULL, newShard, slot)) {
+      shard = newShard;
+    } else {
+      free(newShard);
+      shard = shards_[shardIndex];
+    }
+  }
+  OSAtomicIncrement32(&shard[HGSLatencyBucketForValue(nanoseconds)]);
+  [stageHistogram_ recordNanoseconds:nanoseconds];
+}
+
+- (void)recordMachTime:(uint64_t)machTime {
+  [self recordNanoseconds:HGSMachTimeToNanoseconds(machTime)];
+}
+
+- (uint64_t)getCounts:(uint64_t *)counts {
+  uint64_t total = 0;
+  memset(counts, 0, kBucketCount * sizeof(uint64_t));
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramShardCount; ++i) {
+    int32_t *shard = shards_[i];
+    if (!shard) continue;
+    for (NSUInteger bucket = 0; bucket < kBucketCount; ++bucket) {
+      uint64_t count = (uint32_t)shard[bucket];
+      counts[bucket] += count;
+      total += count;
+    }
+  }
+  return total;
+}
+
+- (uint64_t)count {
+  uint64_t counts[kBucketCount];
+  return [self getCounts:counts];
+}
+
+- (uint64_t)nanosecondsAtPercentile:(double)percentile {
+  uint64_t counts[kBucketCount];
+  uint64_t total = [self getCounts:counts];
+  if (!total) return 0;
+  percentile = MIN(MAX(percentile, 0.0), 100.0);
+  uint64_t wanted = (uint64_t)ceil(percentile / 100.0 * total);
+  wanted = MAX(wanted, 1ULL);
+  uint64_t seen = 0;
+  NSUInteger bucket = 0;
+  for (; bucket < kBucketCount; ++bucket) {
+    seen += counts[bucket];
+    if (seen >= wanted) break;
+  }
+  return HGSLatencyHighestValueInBucket(MIN(bucket, kBucketCount - 1));
+}
+
+- (uint64_t)maximumNanoseconds {
+  return [self nanosecondsAtPercentile:100.0];
+}
+
+- (void)reset {
+  for (NSUInteger i = 0; i < kHGSLatencyHistogramShardCount; ++i) {
+    int32_t *shard = shards_[i];
+    if (!shard) continue;
+    for (NSUInteger bucket = 0; bucket < kBucketCount; ++bucket) {
+      // Swap rather than store so a concurrent increment isn't torn.
+      int32_t value;
+      do {
+        value = shard[bucket];
+      } while (!OSAtomicCompareAndSwap32(value, 0, &shard[bucket]));
+    }
+  }
+}
+
+- (NSComparisonResult)compare:(HGSLatencyHistogram *)histogram {
+  NSComparisonResult result = [stage_ compare:[histogram stage]];
+  if (result == NSOrderedSame) {
+    // Pipeline wide histograms go first.
+    NSString *otherSource = [histogram source];
+    if (!source_) {
+      result = otherSource ? NSOrderedAscending : NSOrderedSame;
+    } else if (!otherSource) {
+      result = NSOrderedDescending;
+    } else {
+      result = [source_ compare:otherSource];
+    }
+  }
+  return result;
+}
+
+@end
+
+@implementation HGSLatencyHistogramRegistry
+
++ (HGSLatencyHistogramRegistry *)sharedRegistry {
+  static HGSLatencyHistogramRegistry *sSharedRegistry = nil;
+  @synchronized(self) {
+    if (!sSharedRegistry) {
+      sSharedRegistry = [[self alloc] init];
+      if (getenv(kHGSLatencyHistogramFileEnvironmentKey)) {
+        atexit(HGSLatencyWriteReportAtExit);
+      }
+    }
+  }
+  return sSharedRegistry;
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    NSArray *stages = [NSArray arrayWithObjects:
+                       kHGSLatencyStageQueue, kHGSLatencyStageRun,
+                       kHGSLatencyStageSort, kHGSLatencyStageMerge,
+                       kHGSLatencyStageNotify, kHGSLatencyStageIcon,
+                       kHGSLatencyStageCache, nil];
+    histograms_
+      = [[NSMutableDictionary alloc] initWithCapacity:[stages count]];
+    for (NSString *stage in stages) {
+      HGSLatencyHistogram *histogram
+        = [[[HGSLatencyHistogram alloc] initWithStage:stage source:nil]
+           autorelease];
+      [histograms_ setObject:histogram forKey:stage];
+    }
+    stageHistograms_ = [histograms_ copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [histograms_ release];
+  [stageHistograms_ release];
+  [super dealloc];
+}
+
+- (HGSLatencyHistogram *)histogramForStage:(NSString *)stage
+                                    source:(NSString *)source {
+  if (!stage) return nil;
+  HGSLatencyHistogram *histogram = nil;
+  if (!source) {
+    histogram = [stageHistograms_ objectForKey:stage];
+    if (histogram) return histogram;
+  }
+  // Per source histograms count into their stage's histogram too.
+  HGSLatencyHistogram *stageHistogram
+    = source ? [self histogramForStage:stage source:nil] : nil;
+  // Sources are reverse DNS so they can't contain a space.
+  NSString *key = source ? [stage stringByAppendingFormat:@" %@", source]
+                         : stage;
+  @synchronized(histograms_) {
+    histogram = [histograms_ objectForKey:key];
+    if (!histogram) {
+      histogram = [[[HGSLatencyHistogram alloc] initWithStage:stage
+                                                       source:source]
+                   autorelease];
+      [histogram setStageHistogram:stageHistogram];
+      [histograms_ setObject:histogram forKey:key];
+    }
+  }
+  return histogram;
+}
+
+- (void)recordMachTime:(uint64_t)machTime
+              forStage:(NSString *)stage
+                source:(NSString *)source {
+  [[self histogramForStage:stage source:source] recordMachTime:machTime];
+}
+
+- (NSArray *)histograms {
+  NSArray *histograms = nil;
+  @synchronized(histograms_) {
+    histograms = [histograms_ allValues];
+  }
+  return [histograms sortedArrayUsingSelector:@selector(compare:)];
+}
+
+- (NSString *)report {
+  NSMutableString *report = [NSMutableString stringWithFormat:
+                             @"%-8s %-50s %8s %10s %10s %10s %10s\n",
+                             "stage", "source", "count", "p50 ms",
+                             "p99 ms", "p99.9 ms", "max ms"];
+  for (HGSLatencyHistogram *histogram in [self histograms]) {
+    uint64_t count = [histogram count];
+    if (!count) continue;
+    NSString *source = [histogram source];
+    [report appendFormat:@"%-8s %-50s %8llu %10.3f %10.3f %10.3f %10.3f\n",
+     [[histogram stage] UTF8String],
+     source ? [source UTF8String] : "*",
+     count,
+     [histogram nanosecondsAtPercentile:50.0] / 1e6,
+     [histogram nanosecondsAtPercentile:99.0] / 1e6,
+     [histogram nanosecondsAtPercentile:99.9] / 1e6,
+     [histogram maximumNanoseconds] / 1e6];
+  }
+  return report;
+}
+
+- (BOOL)writeReportToFile:(NSString *)path {
+  NSError *error = nil;
+  BOOL wrote = [[self report] writeToFile:path
+                               atomically:YES
+                                 encoding:NSUTF8StringEncoding
+                                    error:&error];
+  if (!wrote) {
+    HGSLog(@"Unable to write latency histograms to %@ (%@)", path, error);
+  }
+  return wrote;
+}
+
+- (void)reset {
+  for (HGSLatencyHistogram *histogram in [self histograms]) {
+    [histogram reset];
+  }
+}
+
+@end
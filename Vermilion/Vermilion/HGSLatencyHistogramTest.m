@@ -0,0 +1,194 @@
+//
+//  HGSLatencyHistogramTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import "HGSLatencyHistogram.h"
+#import <libkern/OSAtomic.h>
+
+static const NSUInteger kThreadCount = 8;
+static const NSUInteger kRecordsPerThread = 10000;
+
+@interface HGSLatencyHistogramTest : GTMTestCase {
+ @private
+  HGSLatencyHistogram *threadedHistogram_;
+  int32_t threadsFinished_;
+}
+@end
+
+@implementation HGSLatencyHistogramTest
+
+- (void)testInit {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] init] autorelease];
+  STAssertNil(histogram, nil);
+  histogram = [[[HGSLatencyHistogram alloc] initWithStage:kHGSLatencyStageRun
+                                                   source:nil] autorelease];
+  STAssertNotNil(histogram, nil);
+  STAssertEqualObjects([histogram stage], kHGSLatencyStageRun, nil);
+  STAssertNil([histogram source], nil);
+  STAssertEquals([histogram count], 0ULL, nil);
+  STAssertEquals([histogram nanosecondsAtPercentile:50], 0ULL, nil);
+  STAssertEquals([histogram maximumNanoseconds], 0ULL, nil);
+}
+
+- (void)testPercentiles {
+  HGSLatencyHistogram *histogram
+    = [[[HGSLatencyHistogram alloc] initWithStage:kHGSLatencyStageSort
+                                           source:@"com.google.test"]
+       autorelease];
+  // Small values are exact.
+  for (uint64_t i = 1; i <= 10; ++i) {
+    [histogram recordNanoseconds:i];
+  }
+  STAssertEquals([histogram count], 10ULL, nil);
+  STAssertEquals([histogram nanosecondsAtPercentile:50], 5ULL, nil);
+  STAssertEquals([histogram nanosecondsAtPercentile:0], 1ULL, nil);
+  STAssertEquals([histogram maximumNanoseconds], 10ULL, nil);
+
+  // Large values are within a sixteenth.
+  [histogram reset];
+  STAssertEquals([histogram count], 0ULL, nil);
+  for (NSUInteger i = 0; i < 99; ++i) {
+    [histogram recordNanoseconds:1000000];
+  }
+  [histogram recordNanoseconds:500000000];
+  uint64_t p50 = [histogram nanosecondsAtPercentile:50];
+  STAssertGreaterThanOrEqual(p50, 1000000ULL, nil);
+  STAssertLessThan(p50, 1000000ULL + 1000000ULL / 16, nil);
+  uint64_t p99 = [histogram nanosecondsAtPercentile:99];
+  STAssertEquals(p99, p50, nil);
+  uint64_t max = [histogram maximumNanoseconds];
+  STAssertGreaterThanOrEqual(max, 500000000ULL, nil);
+  STAssertLessThan(max, 500000000ULL + 500000000ULL / 16, nil);
+
+  // Values past the top bucket are clamped rather than lost.
+  [histogram recordNanoseconds:UINT64_MAX];
+  STAssertEquals([histogram count], 101ULL, nil);
+  STAssertGreaterThan([histogram maximumNanoseconds], max, nil);
+}
+
+- (void)recordFromThread:(id)ignored {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSUInteger i = 0; i < kRecordsPerThread; ++i) {
+    [threadedHistogram_ recordNanoseconds:i];
+  }
+  OSAtomicIncrement32Barrier(&threadsFinished_);
+  [pool release];
+}
+
+- (void)testConcurrentRecording {
+  threadedHistogram_
+    = [[HGSLatencyHistogram alloc] initWithStage:kHGSLatencyStageQueue
+                                          source:nil];
+  threadsFinished_ = 0;
+  for (NSUInteger i = 0; i < kThreadCount; ++i) {
+    [NSThread detachNewThreadSelector:@selector(recordFromThread:)
+                             toTarget:self
+                           withObject:nil];
+  }
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:30];
+  while (threadsFinished_ < (int32_t)kThreadCount
+         && [timeout timeIntervalSinceNow] > 0) {
+    [NSThread sleepForTimeInterval:0.01];
+  }
+  STAssertEquals(threadsFinished_, (int32_t)kThreadCount, nil);
+  STAssertEquals([threadedHistogram_ count],
+                 (uint64_t)(kThreadCount * kRecordsPerThread), nil);
+  [threadedHistogram_ release];
+  threadedHistogram_ = nil;
+}
+
+- (void)testRegistry {
+  HGSLatencyHistogramRegistry *registry
+    = [[[HGSLatencyHistogramRegistry alloc] init] autorelease];
+  HGSLatencyHistogram *global
+    = [registry histogramForStage:kHGSLatencyStageRun source:nil];
+  STAssertNotNil(global, nil);
+  STAssertEquals([registry histogramForStage:kHGSLatencyStageRun source:nil],
+                 global, nil);
+  STAssertNil([registry histogramForStage:nil source:@"com.google.a"], nil);
+
+  [registry recordMachTime:1000 forStage:kHGSLatencyStageRun
+                    source:@"com.google.b"];
+  [registry recordMachTime:1000 forStage:kHGSLatencyStageRun
+                    source:@"com.google.a"];
+  [registry recordMachTime:1000 forStage:kHGSLatencyStageMerge source:nil];
+  STAssertEquals([global count], 2ULL, nil);
+  HGSLatencyHistogram *perSource
+    = [registry histogramForStage:kHGSLatencyStageRun source:@"com.google.a"];
+  STAssertEquals([perSource count], 1ULL, nil);
+
+  // Recording straight into a per source histogram counts for its stage.
+  [perSource recordMachTime:1000];
+  STAssertEquals([perSource count], 2ULL, nil);
+  STAssertEquals([global count], 3ULL, nil);
+
+  // Every stage has a pipeline wide histogram from the start, sorted by
+  // stage: cache, icon, merge, notify, queue, run, sort.
+  NSArray *histograms = [registry histograms];
+  STAssertEquals([histograms count], (NSUInteger)9, nil);
+  HGSLatencyHistogram *merge = [histograms objectAtIndex:2];
+  STAssertEqualObjects([merge stage], kHGSLatencyStageMerge, nil);
+  STAssertEquals([histograms objectAtIndex:5], global, nil);
+  STAssertEquals([histograms objectAtIndex:6], perSource, nil);
+
+  NSString *report = [registry report];
+  NSArray *lines
+    = [[report stringByTrimmingCharactersInSet:
+        [NSCharacterSet newlineCharacterSet]]
+       componentsSeparatedByString:@"\n"];
+  // Header and one line per histogram.
+  STAssertEquals([lines count], (NSUInteger)5, @"%@", report);
+  STAssertTrue([report rangeOfString:@"com.google.b"].location != NSNotFound,
+               nil);
+
+  NSString *path
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       @"HGSLatencyHistogramTest.txt"];
+  STAssertTrue([registry writeReportToFile:path], nil);
+  NSString *written = [NSString stringWithContentsOfFile:path
+                                                encoding:NSUTF8StringEncoding
+                                                   error:nil];
+  STAssertEqualObjects(written, report, nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+  // Histograms outlive a reset, but are left out of the report while empty.
+  [registry reset];
+  STAssertEquals([global count], 0ULL, nil);
+  STAssertEquals([[registry histograms] count], (NSUInteger)9, nil);
+  lines = [[[registry report] stringByTrimmingCharactersInSet:
+            [NSCharacterSet newlineCharacterSet]]
+           componentsSeparatedByString:@"\n"];
+  STAssertEquals([lines count], (NSUInteger)1, nil);
+}
+
+@end
@@ -63,6 +63,7 @@
 @interface HGSMemorySearchSource : HGSCallbackSearchSource {
  @private
   HGSMemorySearchSourceDB* resultsDatabase_;
+  NSMutableDictionary *keyIndex_;
   NSUInteger cacheHash_;
   NSString *cachePath_;
 }
@@ -74,6 +75,47 @@
 */
 - (void)replaceCurrentDatabaseWith:(HGSMemorySearchSourceDB *)database;
 
+/*!
+ Applies a change to the current database without rebuilding it. Results
+ with any of the URIs in |uris| are removed, then the results in |database|
+ replace any current results with the same URI, or are added if there
+ are none. Only the changed entries are touched, so the cost depends on the
+ size of the change, not the size of the current database. The change is
+ applied atomically with respect to searches.
+ @param database the results to add or replace. Can be nil.
+ @param uris URIs of results to remove. Can be nil.
+*/
+- (void)updateCurrentDatabaseWith:(HGSMemorySearchSourceDB *)database
+          removingResultsWithURIs:(NSArray *)uris;
+
+/*!
+ Adds the results in |database| to the current database. Unlike
+ updateCurrentDatabaseWith:removingResultsWithURIs: nothing is replaced, so
+ results with the same URI as ones already there are kept alongside them.
+ Use it to fill in the database in batches while indexing. The change is
+ applied atomically with respect to searches.
+ @param database the results to add. Can be nil.
+*/
+- (void)addToCurrentDatabase:(HGSMemorySearchSourceDB *)database;
+
+/*!
+ The number of results in the current database.
+*/
+- (NSUInteger)resultCount;
+
+/*!
+ Finds a result in the current database by the key
+ @link indexKeyForResult: indexKeyForResult: @/link returns for it. Use it
+ instead of walking your results to rehydrate archived results or to find
+ the result an update is for. The index is built on the first lookup and
+ kept up to date by updateCurrentDatabaseWith:removingResultsWithURIs:.
+ Thread safe.
+ @param key the key to look up.
+ @result the result, or nil if there is none with that key. If several
+ results have the same key the last one indexed wins.
+*/
+- (HGSResult *)resultForIndexKey:(id)key;
+
 /*!
  Save the contents of the memory index to disk. If the contents of the index
  haven't changed since the last call to saveResultsCache or loadResultsCache,
@@ -127,6 +169,15 @@
 - (HGSScoredResult *)postFilterScoredResult:(HGSScoredResult *)result 
                             matchesForQuery:(HGSQuery *)query
                                pivotObjects:(HGSResultArray *)pivotObjects;
+
+/*!
+ Returns the key resultForIndexKey: finds |result| by. Must be cheap and
+ must always return the same key for the same result. The default version
+ returns the result's URI; override it to look results up by something
+ else, such as an address book record ID. Return nil to leave a result out
+ of the index.
+*/
+- (id)indexKeyForResult:(HGSResult *)result;
  
 @end
 
@@ -137,6 +188,7 @@
 @interface HGSMemorySearchSourceDB : NSObject <NSCopying> {
  @private
   NSMutableArray* storage_;
+  NSMutableDictionary *uriIndex_;
 }
 
 /*!
@@ -182,5 +234,38 @@
  */
 - (void)indexResult:(HGSResult *)hgsResult;
 
+/*!
+ Add all of the results indexed in another database. The results are not
+ tokenized again.
+ @param database the database to add from.
+*/
+- (void)addEntriesFromDatabase:(HGSMemorySearchSourceDB *)database;
+
+/*!
+ Add all of the results indexed in another database, replacing the results
+ already indexed with the same URIs. A replaced result keeps its place; if
+ several results shared a URI, they are all replaced. The results are not
+ tokenized again.
+ @param database the database to add from.
+*/
+- (void)replaceEntriesFromDatabase:(HGSMemorySearchSourceDB *)database;
+
+/*!
+ Remove all the results with a URI.
+ @param uri the URI of the results to remove.
+*/
+- (void)removeResultsWithURI:(NSString *)uri;
+
+/*!
+ @param uri the URI of the results to return.
+ @result the results indexed with that URI, usually zero or one.
+*/
+- (NSArray *)resultsWithURI:(NSString *)uri;
+
+/*!
+ @result the number of indexed results.
+*/
+- (NSUInteger)count;
+
 @end
 
@@ -69,6 +69,8 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 @interface HGSMemorySearchSource ()
 - (NSArray *)rankedResultsFromPreparedDatabase:(HGSMemorySearchSourceDB *)database 
                                forOperation:(HGSCallbackSearchOperation *)operation;
+- (void)addResultToKeyIndex:(HGSResult *)result;
+- (void)removeResultFromKeyIndex:(HGSResult *)result;
 @end
 
 @interface HGSMemorySearchSourceDB ()
@@ -77,6 +79,9 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 - (void)indexResult:(HGSResult *)hgsResult
       tokenizedName:(HGSTokenizedString *)name
          otherTerms:(NSArray *)otherTerms;
+- (NSMutableDictionary *)uriIndex;
+- (void)addObject:(HGSMemorySearchSourceObject *)object;
+- (void)removeObjectAtIndex:(NSUInteger)idx;
 @end
 
 @implementation HGSMemorySearchSourceObject
@@ -120,6 +125,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 
 - (void)dealloc {
   [resultsDatabase_ release];
+  [keyIndex_ release];
   [cachePath_ release];
   [super dealloc];
 }
@@ -279,6 +285,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
   // in an autorelease pool to keep our memory usage down.
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
   HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  [HGSTokenizer beginInterning];
   @try {
     NSDictionary *cache = [NSDictionary dictionaryWithContentsOfFile:cachePath_];
     if (cache) {
@@ -317,6 +324,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
     HGSLog(@"Unable to load results cache for %@ (%@)", self, e);
     cacheHash_ = 0;
   }
+  [HGSTokenizer endInterning];
   [pool release];
   return cacheHash_ != 0;
 }
@@ -325,9 +333,93 @@ static NSString* const kHGSMemorySourceVersion = @"1";
   @synchronized (self) {
     [resultsDatabase_ autorelease];
     resultsDatabase_ = [database copy];
+    // Rebuilt on the next lookup.
+    [keyIndex_ release];
+    keyIndex_ = nil;
   }
 }
 
+- (void)updateCurrentDatabaseWith:(HGSMemorySearchSourceDB *)database
+          removingResultsWithURIs:(NSArray *)uris {
+  @synchronized (self) {
+    if (keyIndex_) {
+      for (NSString *uri in uris) {
+        for (HGSResult *result in [resultsDatabase_ resultsWithURI:uri]) {
+          [self removeResultFromKeyIndex:result];
+        }
+      }
+      for (HGSMemorySearchSourceObject *object in [database storage]) {
+        NSString *uri = [[object result] uri];
+        for (HGSResult *result in [resultsDatabase_ resultsWithURI:uri]) {
+          [self removeResultFromKeyIndex:result];
+        }
+      }
+    }
+    for (NSString *uri in uris) {
+      [resultsDatabase_ removeResultsWithURI:uri];
+    }
+    [resultsDatabase_ replaceEntriesFromDatabase:database];
+    if (keyIndex_) {
+      for (HGSMemorySearchSourceObject *object in [database storage]) {
+        [self addResultToKeyIndex:[object result]];
+      }
+    }
+  }
+}
+
+- (void)addToCurrentDatabase:(HGSMemorySearchSourceDB *)database {
+  @synchronized (self) {
+    [resultsDatabase_ addEntriesFromDatabase:database];
+    if (keyIndex_) {
+      for (HGSMemorySearchSourceObject *object in [database storage]) {
+        [self addResultToKeyIndex:[object result]];
+      }
+    }
+  }
+}
+
+- (HGSResult *)resultForIndexKey:(id)key {
+  HGSResult *result = nil;
+  if (key) {
+    @synchronized (self) {
+      if (!keyIndex_) {
+        NSArray *storage = [resultsDatabase_ storage];
+        keyIndex_
+          = [[NSMutableDictionary alloc] initWithCapacity:[storage count]];
+        for (HGSMemorySearchSourceObject *object in storage) {
+          [self addResultToKeyIndex:[object result]];
+        }
+      }
+      // Make sure it lives on the calling thread's pool.
+      result = [[[keyIndex_ objectForKey:key] retain] autorelease];
+    }
+  }
+  return result;
+}
+
+- (void)addResultToKeyIndex:(HGSResult *)result {
+  id key = [self indexKeyForResult:result];
+  if (key) {
+    [keyIndex_ setObject:result forKey:key];
+  }
+}
+
+- (void)removeResultFromKeyIndex:(HGSResult *)result {
+  id key = [self indexKeyForResult:result];
+  // Another result may have taken over the key since.
+  if (key && [keyIndex_ objectForKey:key] == result) {
+    [keyIndex_ removeObjectForKey:key];
+  }
+}
+
+- (NSUInteger)resultCount {
+  NSUInteger count = 0;
+  @synchronized (self) {
+    count = [resultsDatabase_ count];
+  }
+  return count;
+}
+
 @end
 
 @implementation HGSMemorySearchSource (ProtectedMethods)
@@ -346,6 +438,10 @@ static NSString* const kHGSMemorySourceVersion = @"1";
   return result;
 }
 
+- (id)indexKeyForResult:(HGSResult *)result {
+  return [result uri];
+}
+
 @end
 
 @implementation HGSMemorySearchSourceDB
@@ -369,6 +465,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
 
 - (void)dealloc {
   [storage_ release];
+  [uriIndex_ release];
   [super dealloc];
 }
 
@@ -385,7 +482,7 @@ static NSString* const kHGSMemorySourceVersion = @"1";
                                                      name:name
                                                otherTerms:otherTerms];
     if (object) {
-      [storage_ addObject:object];
+      [self addObject:object];
       [object release];
     }
   }
@@ -419,5 +516,128 @@ static NSString* const kHGSMemorySourceVersion = @"1";
          otherTerms:nil];
 }
 
+- (void)addEntriesFromDatabase:(HGSMemorySearchSourceDB *)database {
+  if (database) {
+    for (HGSMemorySearchSourceObject *object in database->storage_) {
+      [self addObject:object];
+    }
+  }
+}
+
+- (void)replaceEntriesFromDatabase:(HGSMemorySearchSourceDB *)database {
+  if (!database) return;
+  NSMutableDictionary *uriIndex = [self uriIndex];
+  NSMutableSet *replacedURIs = [NSMutableSet set];
+  for (HGSMemorySearchSourceObject *object in database->storage_) {
+    NSString *uri = [[object result] uri];
+    NSMutableIndexSet *indexes = uri ? [uriIndex objectForKey:uri] : nil;
+    if (!indexes || [replacedURIs containsObject:uri]) {
+      [self addObject:object];
+    } else {
+      // The first new entry for a URI takes the place of the first old one,
+      // the other old ones go away.
+      NSUInteger first = [indexes firstIndex];
+      NSMutableIndexSet *staleIndexes = [[indexes mutableCopy] autorelease];
+      [staleIndexes removeIndex:first];
+      [indexes removeIndexes:staleIndexes];
+      [storage_ replaceObjectAtIndex:first withObject:object];
+      for (NSUInteger idx = [staleIndexes lastIndex];
+           idx != NSNotFound;
+           idx = [staleIndexes indexLessThanIndex:idx]) {
+        [self removeObjectAtIndex:idx];
+      }
+    }
+    if (uri) {
+      [replacedURIs addObject:uri];
+    }
+  }
+}
+
+- (void)removeResultsWithURI:(NSString *)uri {
+  if (!uri) return;
+  NSMutableDictionary *uriIndex = [self uriIndex];
+  NSMutableIndexSet *indexes = [uriIndex objectForKey:uri];
+  if (!indexes) return;
+  [[indexes retain] autorelease];
+  [uriIndex removeObjectForKey:uri];
+  // Back to front so the entries we still have to remove don't move.
+  for (NSUInteger idx = [indexes lastIndex];
+       idx != NSNotFound;
+       idx = [indexes indexLessThanIndex:idx]) {
+    [self removeObjectAtIndex:idx];
+  }
+}
+
+- (NSArray *)resultsWithURI:(NSString *)uri {
+  NSIndexSet *indexes = uri ? [[self uriIndex] objectForKey:uri] : nil;
+  NSMutableArray *results
+    = [NSMutableArray arrayWithCapacity:[indexes count]];
+  for (NSUInteger idx = [indexes firstIndex];
+       idx != NSNotFound;
+       idx = [indexes indexGreaterThanIndex:idx]) {
+    [results addObject:[[storage_ objectAtIndex:idx] result]];
+  }
+  return results;
+}
+
+- (NSUInteger)count {
+  return [storage_ count];
+}
+
+// Maps result URIs to the indexes of their entries in storage_. Only built
+// once somebody asks for a keyed change so that databases that are always
+// rebuilt from scratch don't pay for it, and not copied with the database.
+- (NSMutableDictionary *)uriIndex {
+  if (!uriIndex_) {
+    NSUInteger count = [storage_ count];
+    uriIndex_ = [[NSMutableDictionary alloc] initWithCapacity:count];
+    for (NSUInteger idx = 0; idx < count; ++idx) {
+      HGSMemorySearchSourceObject *object = [storage_ objectAtIndex:idx];
+      NSString *uri = [[object result] uri];
+      if (!uri) continue;
+      NSMutableIndexSet *indexes = [uriIndex_ objectForKey:uri];
+      if (!indexes) {
+        indexes = [NSMutableIndexSet indexSet];
+        [uriIndex_ setObject:indexes forKey:uri];
+      }
+      [indexes addIndex:idx];
+    }
+  }
+  return uriIndex_;
+}
+
+- (void)addObject:(HGSMemorySearchSourceObject *)object {
+  [storage_ addObject:object];
+  if (uriIndex_) {
+    NSString *uri = [[object result] uri];
+    if (uri) {
+      NSMutableIndexSet *indexes = [uriIndex_ objectForKey:uri];
+      if (!indexes) {
+        indexes = [NSMutableIndexSet indexSet];
+        [uriIndex_ setObject:indexes forKey:uri];
+      }
+      [indexes addIndex:[storage_ count] - 1];
+    }
+  }
+}
+
+// Removes the entry at |idx| by moving the last entry into its place, so
+// that removing is O(1) instead of shifting everything after it. The caller
+// is responsible for the index set |idx| was in.
+- (void)removeObjectAtIndex:(NSUInteger)idx {
+  NSUInteger lastIdx = [storage_ count] - 1;
+  if (idx != lastIdx) {
+    HGSMemorySearchSourceObject *lastObject = [storage_ objectAtIndex:lastIdx];
+    NSString *uri = [[lastObject result] uri];
+    if (uri) {
+      NSMutableIndexSet *indexes = [uriIndex_ objectForKey:uri];
+      [indexes removeIndex:lastIdx];
+      [indexes addIndex:idx];
+    }
+    [storage_ replaceObjectAtIndex:idx withObject:lastObject];
+  }
+  [storage_ removeLastObject];
+}
+
 @end
 
@@ -39,7 +39,37 @@
 #import "HGSTokenizer.h"
 #import <OCMock/OCMock.h>
 
+static NSString *const kTestRecordIDKey = @"HGSMemorySearchSourceTestRecordID";
+
+// Looks its results up by a record ID, the way the contacts source does.
+@interface HGSMemorySearchSourceTestRecordSource : HGSMemorySearchSource
+@end
+
+@implementation HGSMemorySearchSourceTestRecordSource
+- (id)indexKeyForResult:(HGSResult *)result {
+  return [result valueForKey:kTestRecordIDKey];
+}
+
+- (HGSResult *)resultWithArchivedRepresentation:(NSDictionary *)representation {
+  NSString *recordID = [representation objectForKey:kTestRecordIDKey];
+  return [self resultForIndexKey:recordID];
+}
+
+// How resultWithArchivedRepresentation: used to be implemented.
+- (HGSResult *)scanForArchivedRepresentation:(NSDictionary *)representation
+                                     results:(NSArray *)results {
+  NSString *recordID = [representation objectForKey:kTestRecordIDKey];
+  for (HGSResult *result in results) {
+    if ([[result valueForKey:kTestRecordIDKey] isEqualToString:recordID]) {
+      return result;
+    }
+  }
+  return nil;
+}
+@end
+
 @interface HGSMemorySearchSourceTest : GTMTestCase 
+- (id)sourceOfClass:(Class)sourceClass;
 @end
 
 @implementation HGSMemorySearchSourceTest
@@ -142,4 +172,279 @@
   [memSource replaceCurrentDatabaseWith:database];
   [memSource performSearchOperation:op];
 }
+
+- (void)testKeyedDatabaseUpdates {
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  NSArray *uris = [NSArray arrayWithObjects:@"test:a", @"test:b", @"test:c",
+                   nil];
+  for (NSString *uri in uris) {
+    HGSUnscoredResult *result = [HGSUnscoredResult resultWithURI:uri
+                                                            name:uri
+                                                            type:@"test"
+                                                          source:nil
+                                                      attributes:nil];
+    [database indexResult:result];
+  }
+  STAssertEquals([database count], (NSUInteger)3, nil);
+  STAssertEquals([[database resultsWithURI:@"test:b"] count], (NSUInteger)1,
+                 nil);
+
+  // Replace one and add one.
+  HGSMemorySearchSourceDB *changes = [HGSMemorySearchSourceDB database];
+  HGSUnscoredResult *newB = [HGSUnscoredResult resultWithURI:@"test:b"
+                                                        name:@"New B"
+                                                        type:@"test"
+                                                      source:nil
+                                                  attributes:nil];
+  HGSUnscoredResult *d = [HGSUnscoredResult resultWithURI:@"test:d"
+                                                     name:@"D"
+                                                     type:@"test"
+                                                   source:nil
+                                               attributes:nil];
+  [changes indexResult:newB];
+  [changes indexResult:d];
+  [database replaceEntriesFromDatabase:changes];
+  STAssertEquals([database count], (NSUInteger)4, nil);
+  NSArray *results = [database resultsWithURI:@"test:b"];
+  STAssertEquals([results count], (NSUInteger)1, nil);
+  STAssertEquals([results objectAtIndex:0], newB, nil);
+
+  // Remove from the front so the last entry has to move.
+  [database removeResultsWithURI:@"test:a"];
+  STAssertEquals([database count], (NSUInteger)3, nil);
+  STAssertEquals([[database resultsWithURI:@"test:a"] count], (NSUInteger)0,
+                 nil);
+  STAssertEquals([[database resultsWithURI:@"test:d"] objectAtIndex:0], d,
+                 nil);
+  [database removeResultsWithURI:@"test:d"];
+  [database removeResultsWithURI:@"test:unknown"];
+  STAssertEquals([database count], (NSUInteger)2, nil);
+
+  // Several entries for one URI are replaced together.
+  [database indexResult:newB name:@"Other B" otherTerms:nil];
+  STAssertEquals([[database resultsWithURI:@"test:b"] count], (NSUInteger)2,
+                 nil);
+  changes = [HGSMemorySearchSourceDB database];
+  [changes indexResult:newB name:@"Third B" otherTerms:nil];
+  [database replaceEntriesFromDatabase:changes];
+  STAssertEquals([database count], (NSUInteger)2, nil);
+  STAssertEquals([[database resultsWithURI:@"test:b"] count], (NSUInteger)1,
+                 nil);
+  STAssertEquals([[database resultsWithURI:@"test:c"] count], (NSUInteger)1,
+                 nil);
+
+  // Copies get their own index.
+  HGSMemorySearchSourceDB *copy = [[database copy] autorelease];
+  [copy removeResultsWithURI:@"test:c"];
+  STAssertEquals([copy count], (NSUInteger)1, nil);
+  STAssertEquals([database count], (NSUInteger)2, nil);
+  STAssertEquals([[database resultsWithURI:@"test:c"] count], (NSUInteger)1,
+                 nil);
+}
+
+- (void)testKeyedUpdatePerformance {
+  // Compare updating a single entry in a large database with rebuilding it.
+  const NSUInteger kEntryCount = 50000;
+  NSMutableArray *results = [NSMutableArray arrayWithCapacity:kEntryCount];
+  for (NSUInteger i = 0; i < kEntryCount; ++i) {
+    NSString *uri = [NSString stringWithFormat:@"test:%lu", (unsigned long)i];
+    NSString *name
+      = [NSString stringWithFormat:@"Result number %lu", (unsigned long)i];
+    HGSUnscoredResult *result = [HGSUnscoredResult resultWithURI:uri
+                                                            name:name
+                                                            type:@"test"
+                                                          source:nil
+                                                      attributes:nil];
+    [results addObject:result];
+  }
+
+  NSDate *start = [NSDate date];
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  for (HGSUnscoredResult *result in results) {
+    [database indexResult:result];
+  }
+  HGSMemorySearchSourceDB *rebuilt = [[database copy] autorelease];
+  NSTimeInterval rebuildTime = -[start timeIntervalSinceNow];
+  STAssertEquals([rebuilt count], kEntryCount, nil);
+
+  // The first keyed change builds the URI index.
+  [database removeResultsWithURI:@"test:0"];
+
+  const NSUInteger kUpdateCount = 100;
+  start = [NSDate date];
+  for (NSUInteger i = 1; i <= kUpdateCount; ++i) {
+    HGSMemorySearchSourceDB *changes = [HGSMemorySearchSourceDB database];
+    [changes indexResult:[results objectAtIndex:i]
+                    name:@"Updated"
+              otherTerms:nil];
+    [database replaceEntriesFromDatabase:changes];
+    HGSResult *removed = [results objectAtIndex:kEntryCount - i];
+    [database removeResultsWithURI:[removed uri]];
+  }
+  NSTimeInterval updateTime = -[start timeIntervalSinceNow] / kUpdateCount;
+  STAssertEquals([database count], kEntryCount - kUpdateCount - 1, nil);
+  STAssertLessThan(updateTime * 100, rebuildTime, nil);
+}
+
+- (id)sourceOfClass:(Class)sourceClass {
+  id bundleMock = [OCMockObject niceMockForClass:[NSBundle class]];
+  [[[bundleMock stub] andReturn:@"test.identifier"]
+   objectForInfoDictionaryKey:@"CFBundleIdentifier"];
+  [[[bundleMock stub] andReturn:@"testName"]
+   objectForInfoDictionaryKey:@"CFBundleDisplayName"];
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObject:bundleMock
+                                  forKey:kHGSExtensionBundleKey];
+  return [[[sourceClass alloc] initWithConfiguration:config] autorelease];
+}
+
+- (void)testResultForIndexKey {
+  HGSMemorySearchSourceTestRecordSource *memSource
+    = [self sourceOfClass:[HGSMemorySearchSourceTestRecordSource class]];
+  STAssertNotNil(memSource, nil);
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  for (NSUInteger i = 0; i < 3; ++i) {
+    NSString *recordID = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+    NSDictionary *attributes
+      = [NSDictionary dictionaryWithObject:recordID forKey:kTestRecordIDKey];
+    NSString *uri = [@"test:" stringByAppendingString:recordID];
+    HGSUnscoredResult *result
+      = [HGSUnscoredResult resultWithURI:uri
+                                    name:recordID
+                                    type:@"test"
+                                  source:memSource
+                              attributes:attributes];
+    [database indexResult:result];
+  }
+  [memSource replaceCurrentDatabaseWith:database];
+  HGSResult *result = [memSource resultForIndexKey:@"1"];
+  STAssertEqualObjects([result uri], @"test:1", nil);
+  STAssertNil([memSource resultForIndexKey:@"test:1"], nil);
+  STAssertNil([memSource resultForIndexKey:nil], nil);
+
+  // Keyed updates keep the index up to date.
+  NSDictionary *attributes
+    = [NSDictionary dictionaryWithObject:@"3" forKey:kTestRecordIDKey];
+  HGSUnscoredResult *newResult = [HGSUnscoredResult resultWithURI:@"test:1"
+                                                             name:@"New"
+                                                             type:@"test"
+                                                           source:memSource
+                                                       attributes:attributes];
+  HGSMemorySearchSourceDB *changes = [HGSMemorySearchSourceDB database];
+  [changes indexResult:newResult];
+  [memSource updateCurrentDatabaseWith:changes
+               removingResultsWithURIs:[NSArray arrayWithObject:@"test:2"]];
+  STAssertNil([memSource resultForIndexKey:@"1"], nil);
+  STAssertNil([memSource resultForIndexKey:@"2"], nil);
+  STAssertEquals([memSource resultForIndexKey:@"3"], (HGSResult *)newResult,
+                 nil);
+  STAssertNotNil([memSource resultForIndexKey:@"0"], nil);
+
+  // And replacing the database resets it.
+  [memSource replaceCurrentDatabaseWith:[HGSMemorySearchSourceDB database]];
+  STAssertNil([memSource resultForIndexKey:@"0"], nil);
+
+  // The default key is the URI.
+  HGSMemorySearchSource *uriSource
+    = [self sourceOfClass:[HGSMemorySearchSource class]];
+  [uriSource replaceCurrentDatabaseWith:changes];
+  STAssertEquals([uriSource resultForIndexKey:@"test:1"],
+                 (HGSResult *)newResult, nil);
+}
+
+- (void)testAddToCurrentDatabase {
+  HGSMemorySearchSource *memSource
+    = [self sourceOfClass:[HGSMemorySearchSource class]];
+  HGSMemorySearchSourceDB *batch = [HGSMemorySearchSourceDB database];
+  HGSUnscoredResult *first = [HGSUnscoredResult resultWithURI:@"test:a"
+                                                         name:@"First"
+                                                         type:@"test"
+                                                       source:memSource
+                                                   attributes:nil];
+  [batch indexResult:first];
+  [memSource addToCurrentDatabase:batch];
+  STAssertEquals([memSource resultForIndexKey:@"test:a"], (HGSResult *)first,
+                 nil);
+
+  // Batches are appended, so a result with the same URI doesn't replace the
+  // one already there. The index is kept up to date.
+  batch = [HGSMemorySearchSourceDB database];
+  HGSUnscoredResult *second = [HGSUnscoredResult resultWithURI:@"test:a"
+                                                          name:@"Second"
+                                                          type:@"test"
+                                                        source:memSource
+                                                    attributes:nil];
+  HGSUnscoredResult *other = [HGSUnscoredResult resultWithURI:@"test:b"
+                                                         name:@"Other"
+                                                         type:@"test"
+                                                       source:memSource
+                                                   attributes:nil];
+  [batch indexResult:second];
+  [batch indexResult:other];
+  [memSource addToCurrentDatabase:batch];
+  [memSource addToCurrentDatabase:nil];
+  STAssertEquals([memSource resultCount], (NSUInteger)3, nil);
+  STAssertEquals([memSource resultForIndexKey:@"test:b"], (HGSResult *)other,
+                 nil);
+
+  // Whereas an update replaces them.
+  batch = [HGSMemorySearchSourceDB database];
+  [batch indexResult:first];
+  [memSource updateCurrentDatabaseWith:batch removingResultsWithURIs:nil];
+  STAssertEquals([memSource resultCount], (NSUInteger)2, nil);
+  STAssertEquals([memSource resultForIndexKey:@"test:a"], (HGSResult *)first,
+                 nil);
+}
+
+- (void)testArchivedResultRehydrationPerformance {
+  // Rehydrate archived results against a large source, through the index and
+  // by scanning the results the way sources used to.
+  const NSUInteger kEntryCount = 20000;
+  const NSUInteger kArchivedCount = 1000;
+  HGSMemorySearchSourceTestRecordSource *memSource
+    = [self sourceOfClass:[HGSMemorySearchSourceTestRecordSource class]];
+  NSMutableArray *results = [NSMutableArray arrayWithCapacity:kEntryCount];
+  HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+  for (NSUInteger i = 0; i < kEntryCount; ++i) {
+    NSString *recordID = [NSString stringWithFormat:@"%lu", (unsigned long)i];
+    NSDictionary *attributes
+      = [NSDictionary dictionaryWithObject:recordID forKey:kTestRecordIDKey];
+    NSString *uri = [@"test:" stringByAppendingString:recordID];
+    HGSUnscoredResult *result
+      = [HGSUnscoredResult resultWithURI:uri
+                                    name:recordID
+                                    type:@"test"
+                                  source:memSource
+                              attributes:attributes];
+    [results addObject:result];
+    [database indexResult:result];
+  }
+  [memSource replaceCurrentDatabaseWith:database];
+  NSMutableArray *archived = [NSMutableArray arrayWithCapacity:kArchivedCount];
+  for (NSUInteger i = 0; i < kArchivedCount; ++i) {
+    // Spread them over the whole source.
+    NSUInteger idx = (i * 7919) % kEntryCount;
+    NSString *recordID = [NSString stringWithFormat:@"%lu", (unsigned long)idx];
+    [archived addObject:[NSDictionary dictionaryWithObject:recordID
+                                                    forKey:kTestRecordIDKey]];
+  }
+
+  NSDate *start = [NSDate date];
+  for (NSDictionary *representation in archived) {
+    HGSResult *result
+      = [memSource resultWithArchivedRepresentation:representation];
+    STAssertNotNil(result, nil);
+  }
+  NSTimeInterval indexedTime = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  for (NSDictionary *representation in archived) {
+    HGSResult *result
+      = [memSource scanForArchivedRepresentation:representation
+                                         results:results];
+    STAssertNotNil(result, nil);
+  }
+  NSTimeInterval scanTime = -[start timeIntervalSinceNow];
+  STAssertLessThan(indexedTime * 10, scanTime, nil);
+}
 @end
@@ -37,6 +37,7 @@
 #import <Foundation/Foundation.h>
 
 @class GDataHTTPFetcher;
+@class HGSOperationQueue;
 
 /*!
  An operation that releases its target and userData immediately after it is
@@ -52,6 +53,8 @@
   id target_;
   SEL selector_;
   id userData_;
+  uint64_t enqueueTime_;
+  __weak HGSOperationQueue *queue_;
 }
 
 - (id)initWithTarget:(id)target selector:(SEL)sel object:(id)userData;
@@ -59,8 +62,15 @@
 @end
 
 /*!
- An operation that wraps around a fetcher. All callbacks will be made on the
- operation thread.
+ An operation that wraps around a fetcher.
+ 
+ When it is added to an HGSOperationQueue with no unfinished dependencies,
+ the fetch is started right away on a shared I/O thread, and the operation
+ only becomes ready once the fetcher has finished or failed. The network
+ round trip then does not occupy a slot in the queue. Otherwise the fetch is
+ started when the operation runs, and the operation waits for it. Either
+ way the callbacks are made on the operation thread, exactly as if the
+ fetch had been synchronous.
 */
 @interface HGSFetcherOperation : NSOperation {
  @private
@@ -68,7 +78,12 @@
   id target_;
   SEL didFinishSel_;
   SEL didFailSel_;
-  BOOL finished_;
+  SEL resultSel_;
+  id resultObject_;
+  NSCondition *fetchCondition_;
+  BOOL fetchingAhead_;
+  BOOL fetchStarted_;
+  BOOL fetchDone_;
 }
 
 @property (readonly, retain) GDataHTTPFetcher *fetcher;
@@ -91,7 +106,8 @@
        failedWithError:(NSError *)error
              operation:(NSOperation *)operation;
  </code></p>
-        This selector will be called on the operation thread.
+        This selector will be called on the operation thread, including
+        when the fetch could not be started at all.
 */
 - (id)initWithTarget:(id)target
           forFetcher:(GDataHTTPFetcher *)fetcher
@@ -100,11 +116,64 @@
 @end
 
 /*!
- Shared operation queue that can be used so we don't have multiple unnecessary
- operation queues created.
+ Keys for the dictionary returned by -[HGSOperationQueue statistics].
+ All values are NSNumbers.
+*/
+/*! Operations currently in the queue. */
+extern NSString *const kHGSOperationQueueDepthKey;
+/*! Deepest the queue has been. */
+extern NSString *const kHGSOperationQueueMaxDepthKey;
+/*! Operations whose wait time has been recorded. */
+extern NSString *const kHGSOperationQueueWaitCountKey;
+/*! Mean time in seconds from being queued to starting to run. */
+extern NSString *const kHGSOperationQueueMeanWaitKey;
+/*! Longest time in seconds from being queued to starting to run. */
+extern NSString *const kHGSOperationQueueMaxWaitKey;
+
+/*!
+ Shared operation queues that can be used so we don't have multiple
+ unnecessary operation queues created. There are two lanes:
+ 
+ The interactive queue runs search operations and actions, work that the
+ user is waiting on. It is as wide as the number of cores.
+ 
+ The shared queue is for background work such as indexing and refreshing
+ data from the network. It is throttled to half the cores, and drops to a
+ single operation at a time while any interactive work is in flight so that
+ indexing doesn't hold up searches.
 */
-@interface HGSOperationQueue : NSOperationQueue
+@interface HGSOperationQueue : NSOperationQueue {
+ @private
+  NSUInteger maxDepth_;
+  uint64_t waitCount_;
+  uint64_t totalWaitTime_;
+  uint64_t maxWaitTime_;
+}
 
+/*! The background lane. */
 + (HGSOperationQueue *)sharedOperationQueue;
 
+/*! The latency lane for searches and actions. */
++ (HGSOperationQueue *)interactiveOperationQueue;
+
+/*!
+ Called when interactive work is queued or starts running, and when it ends.
+ Calls must be balanced. The background lane is throttled while there is
+ interactive work outstanding.
+*/
++ (void)beginInteractiveWork;
++ (void)endInteractiveWork;
+
+/*!
+ Record how long (in mach_absolute_time units) an operation sat in the queue
+ before it started. HGSInvocationOperations and HGSSearchOperations record
+ themselves.
+*/
+- (void)noteOperationWaited:(uint64_t)waitTime;
+
+/*!
+ Queue depth and wait time statistics. See kHGSOperationQueueDepthKey et al.
+*/
+- (NSDictionary *)statistics;
+
 @end
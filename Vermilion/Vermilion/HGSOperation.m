@@ -31,20 +31,47 @@
 //
 
 #import "HGSOperation.h"
+#import <mach/mach_time.h>
 #import <GTM/GTMDebugSelectorValidation.h>
-#import <GTM/GTMObjectSingleton.h>
 #import <GData/GDataHTTPFetcher.h>
+#import "HGSLog.h"
+
+NSString *const kHGSOperationQueueDepthKey = @"HGSOperationQueueDepth";
+NSString *const kHGSOperationQueueMaxDepthKey = @"HGSOperationQueueMaxDepth";
+NSString *const kHGSOperationQueueWaitCountKey 
+  = @"HGSOperationQueueWaitCount";
+NSString *const kHGSOperationQueueMeanWaitKey = @"HGSOperationQueueMeanWait";
+NSString *const kHGSOperationQueueMaxWaitKey = @"HGSOperationQueueMaxWait";
+
+static HGSOperationQueue *gHGSSharedOperationQueue = nil;
+static HGSOperationQueue *gHGSInteractiveOperationQueue = nil;
+static NSUInteger gHGSInteractiveWorkCount = 0;
+
+static NSTimeInterval HGSMachTimeToSeconds(uint64_t machTime) {
+  static mach_timebase_info_data_t sTimebaseInfo;
+  if (sTimebaseInfo.denom == 0) {
+    mach_timebase_info(&sTimebaseInfo);
+  }
+  return (double)machTime * sTimebaseInfo.numer / sTimebaseInfo.denom / 1e9;
+}
 
 @interface HGSFetcherOperation ()
++ (NSThread *)ioThread;
++ (void)ioThreadMain:(id)ignored;
+
+- (void)wasAddedToQueue:(HGSOperationQueue *)queue;
+- (void)beginFetch;
+- (BOOL)isFetchDone;
+- (void)beginFetchOnIOThread;
+- (void)stopFetchOnIOThread;
+- (void)fetchDidCompleteWithSelector:(SEL)sel object:(id)object;
+
 - (void)httpFetcher:(GDataHTTPFetcher *)fetcher
    finishedWithData:(NSData *)retrievedData;
 
 - (void)httpFetcher:(GDataHTTPFetcher *)fetcher
     failedWithError:(NSError *)error;
 
-- (void)fetcherStoppedNotification:(NSNotification *)notification;
-
-@property(readwrite, assign, getter=isFinished) BOOL finished;
 @property (readwrite, retain) id target;
 
 @end
@@ -52,6 +79,7 @@
 @interface HGSInvocationOperation ()
 @property (readwrite, retain) id target;
 @property (readwrite, retain) id userData;
+- (void)wasAddedToQueue:(HGSOperationQueue *)queue;
 @end
 
 @implementation HGSInvocationOperation
@@ -85,7 +113,15 @@
   [super cancel];
 }
 
+- (void)wasAddedToQueue:(HGSOperationQueue *)queue {
+  queue_ = queue;
+  enqueueTime_ = mach_absolute_time();
+}
+
 -(void)main {
+  if (queue_) {
+    [queue_ noteOperationWaited:mach_absolute_time() - enqueueTime_];
+  }
   // We get userData first because we don't want a race condition between
   // getting the userData and getting the target. Cancel clears the target
   // first.
@@ -112,20 +148,41 @@
 @end
 
 
-static void HGSFetcherOperationStartFetch(void *info) {
-  HGSFetcherOperation *op = (HGSFetcherOperation *)info;
-  GDataHTTPFetcher *fetcher = [op fetcher];
-  [fetcher beginFetchWithDelegate:op
-                didFinishSelector:@selector(httpFetcher:finishedWithData:)
-                  didFailSelector:@selector(httpFetcher:failedWithError:)];
-}
+static NSThread *gHGSFetcherIOThread = nil;
 
 @implementation HGSFetcherOperation
 
-@synthesize finished = finished_;
 @synthesize target = target_;
 @synthesize fetcher = fetcher_;
 
++ (NSThread *)ioThread {
+  @synchronized(self) {
+    if (!gHGSFetcherIOThread) {
+      gHGSFetcherIOThread
+        = [[NSThread alloc] initWithTarget:self
+                                  selector:@selector(ioThreadMain:)
+                                    object:nil];
+      [gHGSFetcherIOThread setName:@"HGSFetcherOperation I/O"];
+      [gHGSFetcherIOThread start];
+    }
+  }
+  return gHGSFetcherIOThread;
+}
+
++ (void)ioThreadMain:(id)ignored {
+  // All fetchers run their connections on this thread's runloop. The port
+  // keeps the runloop alive while there are no fetches in flight.
+  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+  while (YES) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+    [pool release];
+  }
+  [outerPool release];
+}
+
 - (id)initWithTarget:(id)target
           forFetcher:(GDataHTTPFetcher *)fetcher
    didFinishSelector:(SEL)didFinishSel
@@ -144,11 +201,7 @@ static void HGSFetcherOperationStartFetch(void *info) {
                                                  NULL);
   if ((self = [super init])) {
     fetcher_ = [fetcher retain];
-    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-    [nc addObserver:self
-           selector:@selector(fetcherStoppedNotification:)
-               name:kGDataHTTPFetcherStoppedNotification
-             object:fetcher_];
+    fetchCondition_ = [[NSCondition alloc] init];
     [self setTarget:target];
     didFinishSel_ = didFinishSel;
     didFailSel_ = failedSel;
@@ -156,93 +209,271 @@ static void HGSFetcherOperationStartFetch(void *info) {
   return self;
 }
 
+- (void)dealloc {
+  [fetcher_ release];
+  [resultObject_ release];
+  [fetchCondition_ release];
+  [self setTarget:nil];
+  [super dealloc];
+}
+
+- (void)wasAddedToQueue:(HGSOperationQueue *)queue {
+  // If nothing has to happen before us, fetch now, so that we only take up
+  // a slot in the queue once the data is in. Otherwise main fetches.
+  // The queue isn't watching us yet, so there is no need to tell it that
+  // we aren't ready after all.
+  for (NSOperation *dependency in [self dependencies]) {
+    if (![dependency isFinished]) return;
+  }
+  @synchronized(self) {
+    fetchingAhead_ = YES;
+  }
+  [self beginFetch];
+}
+
+- (void)beginFetch {
+  if ([self isCancelled]) return;
+  BOOL startFetch = NO;
+  @synchronized(self) {
+    startFetch = !fetchStarted_;
+    fetchStarted_ = YES;
+  }
+  if (startFetch) {
+    [self performSelector:@selector(beginFetchOnIOThread)
+                 onThread:[[self class] ioThread]
+               withObject:nil
+            waitUntilDone:NO];
+  }
+}
+
+- (BOOL)isFetchDone {
+  BOOL isDone = NO;
+  @synchronized(self) {
+    isDone = fetchDone_;
+  }
+  return isDone;
+}
+
+- (BOOL)isReady {
+  // A fetch that is already under way has to finish before we are ready,
+  // so that no queue thread waits on the network.
+  if (![super isReady]) return NO;
+  if ([self isCancelled]) return YES;
+  BOOL isReady = NO;
+  @synchronized(self) {
+    isReady = !fetchingAhead_ || fetchDone_;
+  }
+  return isReady;
+}
+
 - (void)cancel {
   [self setTarget:nil];
-  [fetcher_ stopFetching];
+  [self willChangeValueForKey:@"isReady"];
   [super cancel];
+  [self didChangeValueForKey:@"isReady"];
+  // Cancelled operations are always ready, so the queue will run us right
+  // away. Tear down the connection behind us. Work for the I/O thread is
+  // serviced in order, so this can't overtake a pending beginFetch.
+  BOOL stopFetch = NO;
+  @synchronized(self) {
+    stopFetch = fetchStarted_ && !fetchDone_;
+  }
+  if (stopFetch) {
+    [self performSelector:@selector(stopFetchOnIOThread)
+                 onThread:[[self class] ioThread]
+               withObject:nil
+            waitUntilDone:NO];
+  }
+  // Wake up main if it is waiting for the fetch.
+  [fetchCondition_ lock];
+  [fetchCondition_ broadcast];
+  [fetchCondition_ unlock];
 }
 
-- (void)dealloc {
-  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
-  [nc removeObserver:self
-                name:kGDataHTTPFetcherStoppedNotification
-              object:fetcher_];
-  [fetcher_ release];
-  [self setTarget:nil];
-  [super dealloc];
+- (void)beginFetchOnIOThread {
+  if ([self isCancelled]) return;
+  BOOL began 
+    = [fetcher_ beginFetchWithDelegate:self
+                     didFinishSelector:@selector(httpFetcher:finishedWithData:)
+                       didFailSelector:@selector(httpFetcher:failedWithError:)];
+  if (!began) {
+    // The fetcher normally reports the failure to us before returning NO,
+    // in which case this is ignored. Either way the target hears about it.
+    NSError *error
+      = [NSError errorWithDomain:kGDataHTTPFetcherErrorDomain
+                            code:kGDataHTTPFetcherErrorDownloadFailed
+                        userInfo:nil];
+    [self fetchDidCompleteWithSelector:didFailSel_ object:error];
+  }
 }
 
-- (void)fetcherStoppedNotification:(NSNotification *)notification {
-  [self setFinished:YES];
-  CFRunLoopRef rl = CFRunLoopGetCurrent();
-  CFRunLoopStop(rl);
+- (void)stopFetchOnIOThread {
+  [fetcher_ stopFetching];
 }
 
-- (void)main {
-  @try {
-    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-    CFRunLoopSourceContext context;
-    bzero(&context, sizeof(context));
-    context.info = self;
-    context.perform = HGSFetcherOperationStartFetch;
-    CFRunLoopSourceRef source = CFRunLoopSourceCreate(NULL, 0, &context);
-    CFRunLoopSourceSignal(source);
-    CFRunLoopRef runloop = CFRunLoopGetCurrent();
-    CFRunLoopAddSource(runloop, source, kCFRunLoopDefaultMode);
-    [self setFinished:NO];
-    while (![self isFinished]) {
-      CFRunLoopRun();
+- (void)fetchDidCompleteWithSelector:(SEL)sel object:(id)object {
+  BOOL wasDone = NO;
+  @synchronized(self) {
+    wasDone = fetchDone_;
+    if (!wasDone) {
+      resultSel_ = sel;
+      resultObject_ = [object retain];
     }
-    CFRunLoopRemoveSource(runloop, source, kCFRunLoopDefaultMode);
-    CFRelease(source);
-    [pool release];
-  }
-  @catch(NSException *e) {
-    NSLog(@"Exception %@ thrown in operation: %@", e, self);
   }
-  @catch(...) {
-    NSLog(@"Unknown Exception thrown in operation: %@", self);
-    // Do not rethrow exceptions.
+  if (!wasDone) {
+    [self willChangeValueForKey:@"isReady"];
+    @synchronized(self) {
+      fetchDone_ = YES;
+    }
+    [self didChangeValueForKey:@"isReady"];
+    [fetchCondition_ lock];
+    [fetchCondition_ broadcast];
+    [fetchCondition_ unlock];
   }
-  [target_ release];
-  target_ = nil;
 }
 
 - (void)httpFetcher:(GDataHTTPFetcher *)fetcher
    finishedWithData:(NSData *)retrievedData {
-  id target = [self target];
-  if (target) {
-    NSMethodSignature *sig = [target_ methodSignatureForSelector:didFinishSel_];
-    NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:sig];
-    [invocation setTarget:target_];
-    [invocation setSelector:didFinishSel_];
-    [invocation setArgument:&fetcher_ atIndex:2];
-    [invocation setArgument:&retrievedData atIndex:3];
-    [invocation setArgument:&self atIndex:4];
-    [invocation invoke];
-  }
-
+  [self fetchDidCompleteWithSelector:didFinishSel_ object:retrievedData];
 }
 
 - (void)httpFetcher:(GDataHTTPFetcher *)fetcher
     failedWithError:(NSError *)error {
+  [self fetchDidCompleteWithSelector:didFailSel_ object:error];
+}
+
+- (void)main {
+  // Unless the fetch was started when we were queued, start it now and wait
+  // for it.
+  [self beginFetch];
+  [fetchCondition_ lock];
+  while (![self isFetchDone] && ![self isCancelled]) {
+    [fetchCondition_ wait];
+  }
+  [fetchCondition_ unlock];
+  SEL sel = NULL;
+  id object = nil;
+  @synchronized(self) {
+    sel = resultSel_;
+    object = [[resultObject_ retain] autorelease];
+  }
   id target = [self target];
-  if (target) {
-    NSMethodSignature *sig = [target_ methodSignatureForSelector:didFailSel_];
-    NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:sig];
-    [invocation setTarget:target_];
-    [invocation setSelector:didFailSel_];
-    [invocation setArgument:&fetcher_ atIndex:2];
-    [invocation setArgument:&error atIndex:3];
-    [invocation setArgument:&self atIndex:4];
-    [invocation invoke];
+  if (target && sel && ![self isCancelled]) {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    @try {
+      NSMethodSignature *sig = [target methodSignatureForSelector:sel];
+      NSInvocation *invocation 
+        = [NSInvocation invocationWithMethodSignature:sig];
+      [invocation setTarget:target];
+      [invocation setSelector:sel];
+      [invocation setArgument:&fetcher_ atIndex:2];
+      [invocation setArgument:&object atIndex:3];
+      [invocation setArgument:&self atIndex:4];
+      [invocation invoke];
+    }
+    @catch(NSException *e) {
+      NSLog(@"Exception %@ thrown in operation: %@", e, self);
+    }
+    @catch(...) {
+      NSLog(@"Unknown Exception thrown in operation: %@", self);
+      // Do not rethrow exceptions.
+    }
+    [pool release];
   }
+  [self setTarget:nil];
 }
 
 @end
 
 @implementation HGSOperationQueue
 
-GTMOBJECT_SINGLETON_BOILERPLATE(HGSOperationQueue, sharedOperationQueue);
++ (HGSOperationQueue *)sharedOperationQueue {
+  @synchronized(self) {
+    if (!gHGSSharedOperationQueue) {
+      gHGSSharedOperationQueue = [[HGSOperationQueue alloc] init];
+      NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+      NSUInteger width = MAX(cores / 2, (NSUInteger)1);
+      [gHGSSharedOperationQueue setMaxConcurrentOperationCount:width];
+    }
+  }
+  return gHGSSharedOperationQueue;
+}
+
++ (HGSOperationQueue *)interactiveOperationQueue {
+  @synchronized(self) {
+    if (!gHGSInteractiveOperationQueue) {
+      gHGSInteractiveOperationQueue = [[HGSOperationQueue alloc] init];
+      NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+      [gHGSInteractiveOperationQueue setMaxConcurrentOperationCount:cores];
+    }
+  }
+  return gHGSInteractiveOperationQueue;
+}
+
++ (void)beginInteractiveWork {
+  @synchronized(self) {
+    if (gHGSInteractiveWorkCount++ == 0) {
+      [[self sharedOperationQueue] setMaxConcurrentOperationCount:1];
+    }
+  }
+}
+
++ (void)endInteractiveWork {
+  @synchronized(self) {
+    HGSAssert(gHGSInteractiveWorkCount > 0, @"Unbalanced endInteractiveWork");
+    if (gHGSInteractiveWorkCount > 0 && --gHGSInteractiveWorkCount == 0) {
+      NSUInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+      NSUInteger width = MAX(cores / 2, (NSUInteger)1);
+      [[self sharedOperationQueue] setMaxConcurrentOperationCount:width];
+    }
+  }
+}
+
+- (void)addOperation:(NSOperation *)op {
+  if ([op isKindOfClass:[HGSInvocationOperation class]]) {
+    [(HGSInvocationOperation *)op wasAddedToQueue:self];
+  } else if ([op isKindOfClass:[HGSFetcherOperation class]]) {
+    // Before the queue gets to see whether it is ready.
+    [(HGSFetcherOperation *)op wasAddedToQueue:self];
+  }
+  [super addOperation:op];
+  @synchronized(self) {
+    maxDepth_ = MAX(maxDepth_, [self operationCount]);
+  }
+}
+
+- (void)noteOperationWaited:(uint64_t)waitTime {
+  @synchronized(self) {
+    waitCount_ += 1;
+    totalWaitTime_ += waitTime;
+    maxWaitTime_ = MAX(maxWaitTime_, waitTime);
+  }
+}
+
+- (NSDictionary *)statistics {
+  NSUInteger depth = [self operationCount];
+  NSDictionary *statistics = nil;
+  @synchronized(self) {
+    NSTimeInterval meanWait = 0;
+    if (waitCount_) {
+      meanWait = HGSMachTimeToSeconds(totalWaitTime_) / waitCount_;
+    }
+    NSTimeInterval maxWait = HGSMachTimeToSeconds(maxWaitTime_);
+    statistics 
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithUnsignedInteger:depth], 
+         kHGSOperationQueueDepthKey,
+         [NSNumber numberWithUnsignedInteger:maxDepth_], 
+         kHGSOperationQueueMaxDepthKey,
+         [NSNumber numberWithUnsignedLongLong:waitCount_], 
+         kHGSOperationQueueWaitCountKey,
+         [NSNumber numberWithDouble:meanWait], 
+         kHGSOperationQueueMeanWaitKey,
+         [NSNumber numberWithDouble:maxWait], 
+         kHGSOperationQueueMaxWaitKey,
+         nil];
+  }
+  return statistics;
+}
 
 @end
@@ -31,6 +31,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import <libkern/OSAtomic.h>
 #import "GTMSenTestCase.h"
 #import "HGSOperation.h"
 #import <GData/GDataHTTPFetcher.h>
@@ -181,6 +182,215 @@ static NSString * const kGoogleNonExistentUrl = @"http://sgdfgsdfsewfgsd.corp.go
 
 @end
 
+// Stands in for a slow HTTP server. Every request to hgsslowstub: is answered
+// with a short body after kSlowStubLatency seconds.
+static const NSTimeInterval kSlowStubLatency = 2.0;
+static NSString *const kSlowStubScheme = @"hgsslowstub";
+
+@interface HGSSlowStubURLProtocol : NSURLProtocol {
+ @private
+  NSTimer *timer_;
+}
+@end
+
+@implementation HGSSlowStubURLProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request {
+  return [[[request URL] scheme] isEqualToString:kSlowStubScheme];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request {
+  return request;
+}
+
+- (void)startLoading {
+  timer_ = [[NSTimer timerWithTimeInterval:kSlowStubLatency
+                                    target:self
+                                  selector:@selector(respond:)
+                                  userInfo:nil
+                                   repeats:NO] retain];
+  [[NSRunLoop currentRunLoop] addTimer:timer_ forMode:NSRunLoopCommonModes];
+}
+
+- (void)stopLoading {
+  [timer_ invalidate];
+  [timer_ release];
+  timer_ = nil;
+}
+
+- (void)respond:(NSTimer *)timer {
+  NSData *data = [@"stub" dataUsingEncoding:NSUTF8StringEncoding];
+  NSURLResponse *response
+    = [[[NSURLResponse alloc] initWithURL:[[self request] URL]
+                                 MIMEType:@"text/plain"
+                    expectedContentLength:[data length]
+                         textEncodingName:nil] autorelease];
+  id<NSURLProtocolClient> client = [self client];
+  [client URLProtocol:self
+   didReceiveResponse:response
+   cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+  [client URLProtocol:self didLoadData:data];
+  [client URLProtocolDidFinishLoading:self];
+}
+
+@end
+
+@interface HGSFetcherOperationStressTest : GTMTestCase {
+ @private
+  int32_t fetchesFinished_;
+  int32_t workFinished_;
+}
+@end
+
+@implementation HGSFetcherOperationStressTest
+
+- (void)httpFetcher:(GDataHTTPFetcher *)fetcher
+   finishedWithData:(NSData *)retrievedData
+          operation:(NSOperation *)operation {
+  OSAtomicIncrement32Barrier(&fetchesFinished_);
+}
+
+- (void)httpFetcher:(GDataHTTPFetcher *)fetcher
+    failedWithError:(NSError *)error
+          operation:(NSOperation *)operation {
+  STFail(@"Stub fetch failed: %@", error);
+  OSAtomicIncrement32Barrier(&fetchesFinished_);
+}
+
+- (void)doWork:(id)ignored operation:(NSOperation *)operation {
+  OSAtomicIncrement32Barrier(&workFinished_);
+}
+
+- (void)testOutstandingFetchesDoNotBlockQueue {
+  // With 128 slow fetches in front of them on a two wide queue, the work
+  // operations must still all run long before any of the fetches return.
+  [NSURLProtocol registerClass:[HGSSlowStubURLProtocol class]];
+  HGSOperationQueue *queue = [[[HGSOperationQueue alloc] init] autorelease];
+  [queue setMaxConcurrentOperationCount:2];
+  const int32_t kFetchCount = 128;
+  const int32_t kWorkCount = 100;
+  for (int32_t i = 0; i < kFetchCount; ++i) {
+    NSString *urlString
+      = [NSString stringWithFormat:@"%@://latency/%d", kSlowStubScheme, i];
+    NSURLRequest *request
+      = [NSURLRequest requestWithURL:[NSURL URLWithString:urlString]];
+    GDataHTTPFetcher *fetcher
+      = [GDataHTTPFetcher httpFetcherWithRequest:request];
+    NSOperation *op
+      = [[[HGSFetcherOperation alloc] initWithTarget:self
+                                          forFetcher:fetcher
+                                   didFinishSelector:@selector(httpFetcher:finishedWithData:operation:)
+                                     didFailSelector:@selector(httpFetcher:failedWithError:operation:)]
+         autorelease];
+    [queue addOperation:op];
+  }
+  NSDate *start = [NSDate date];
+  for (int32_t i = 0; i < kWorkCount; ++i) {
+    NSOperation *op
+      = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                               selector:@selector(doWork:operation:)
+                                                 object:nil] autorelease];
+    [queue addOperation:op];
+  }
+  while (workFinished_ < kWorkCount
+         && -[start timeIntervalSinceNow] < kSlowStubLatency * 4) {
+    usleep(10000);
+  }
+  NSTimeInterval workTime = -[start timeIntervalSinceNow];
+  STAssertEquals(workFinished_, kWorkCount, nil);
+  STAssertLessThan(workTime, kSlowStubLatency,
+                   @"Work was held up behind outstanding fetches");
+  STAssertLessThan(fetchesFinished_, kFetchCount, nil);
+  [queue waitUntilAllOperationsAreFinished];
+  STAssertEquals(fetchesFinished_, kFetchCount, nil);
+  [NSURLProtocol unregisterClass:[HGSSlowStubURLProtocol class]];
+}
+
+@end
+
+// A fetcher that can't start, and doesn't say why.
+@interface HGSRefusingFetcher : GDataHTTPFetcher
+@end
+
+@implementation HGSRefusingFetcher
+
+- (BOOL)beginFetchWithDelegate:(id)delegate
+             didFinishSelector:(SEL)finishedSEL
+               didFailSelector:(SEL)failedSEL {
+  return NO;
+}
+
+@end
+
+@interface HGSFetcherOperationFailureTest : GTMTestCase {
+ @private
+  int32_t failures_;
+}
+- (void)runRefusedFetchOnQueue:(NSOperationQueue *)queue
+                     dependent:(BOOL)dependent;
+@end
+
+@implementation HGSFetcherOperationFailureTest
+
+- (void)httpFetcher:(GDataHTTPFetcher *)fetcher
+   finishedWithData:(NSData *)retrievedData
+          operation:(NSOperation *)operation {
+  STFail(@"A fetch that never began finished");
+}
+
+- (void)httpFetcher:(GDataHTTPFetcher *)fetcher
+    failedWithError:(NSError *)error
+          operation:(NSOperation *)operation {
+  STAssertEqualObjects([error domain], kGDataHTTPFetcherErrorDomain, nil);
+  OSAtomicIncrement32Barrier(&failures_);
+}
+
+- (void)doWork:(id)ignored operation:(NSOperation *)operation {
+}
+
+- (void)runRefusedFetchOnQueue:(NSOperationQueue *)queue
+                     dependent:(BOOL)dependent {
+  failures_ = 0;
+  NSURL *url = [NSURL URLWithString:@"http://refused.invalid/"];
+  NSURLRequest *request = [NSURLRequest requestWithURL:url];
+  GDataHTTPFetcher *fetcher
+    = [HGSRefusingFetcher httpFetcherWithRequest:request];
+  SEL finished = @selector(httpFetcher:finishedWithData:operation:);
+  SEL failed = @selector(httpFetcher:failedWithError:operation:);
+  NSOperation *op
+    = [[[HGSFetcherOperation alloc] initWithTarget:self
+                                        forFetcher:fetcher
+                                 didFinishSelector:finished
+                                   didFailSelector:failed] autorelease];
+  NSOperation *work = nil;
+  if (dependent) {
+    SEL doWork = @selector(doWork:operation:);
+    work = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                                  selector:doWork
+                                                    object:nil] autorelease];
+    [op addDependency:work];
+  }
+  [queue addOperation:op];
+  if (work) {
+    [queue addOperation:work];
+  }
+  [queue waitUntilAllOperationsAreFinished];
+  STAssertEquals(failures_, (int32_t)1, nil);
+}
+
+- (void)testFetchThatCannotBegin {
+  // Fetched as soon as it is queued.
+  HGSOperationQueue *queue = [[[HGSOperationQueue alloc] init] autorelease];
+  [self runRefusedFetchOnQueue:queue dependent:NO];
+  // Fetched once its dependency is done.
+  [self runRefusedFetchOnQueue:queue dependent:YES];
+  // Fetched from main by a queue that doesn't know about fetchers.
+  NSOperationQueue *plainQueue = [[[NSOperationQueue alloc] init] autorelease];
+  [self runRefusedFetchOnQueue:plainQueue dependent:NO];
+}
+
+@end
+
 @interface HGSInvocationOperationTest : GTMTestCase
 @end
 
@@ -188,3 +398,62 @@ static NSString * const kGoogleNonExistentUrl = @"http://sgdfgsdfsewfgsd.corp.go
 // TODO(dmaclach): Flesh this out.
 @end
 
+@interface HGSOperationQueueTest : GTMTestCase
+- (void)doNothing:(id)userData operation:(NSOperation *)operation;
+@end
+
+@implementation HGSOperationQueueTest
+
+- (void)doNothing:(id)userData operation:(NSOperation *)operation {
+}
+
+- (void)testLanes {
+  HGSOperationQueue *shared = [HGSOperationQueue sharedOperationQueue];
+  HGSOperationQueue *interactive 
+    = [HGSOperationQueue interactiveOperationQueue];
+  STAssertNotNil(shared, nil);
+  STAssertNotNil(interactive, nil);
+  STAssertNotEquals(shared, interactive, nil);
+  STAssertEquals([HGSOperationQueue sharedOperationQueue], shared, nil);
+  NSInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+  STAssertEquals([interactive maxConcurrentOperationCount], cores, nil);
+  
+  // Interactive work throttles the background lane.
+  NSInteger width = [shared maxConcurrentOperationCount];
+  [HGSOperationQueue beginInteractiveWork];
+  [HGSOperationQueue beginInteractiveWork];
+  STAssertEquals([shared maxConcurrentOperationCount], (NSInteger)1, nil);
+  [HGSOperationQueue endInteractiveWork];
+  STAssertEquals([shared maxConcurrentOperationCount], (NSInteger)1, nil);
+  [HGSOperationQueue endInteractiveWork];
+  STAssertEquals([shared maxConcurrentOperationCount], width, nil);
+}
+
+- (void)testStatistics {
+  HGSOperationQueue *shared = [HGSOperationQueue sharedOperationQueue];
+  NSDictionary *before = [shared statistics];
+  for (int i = 0; i < 10; ++i) {
+    HGSInvocationOperation *op 
+      = [[[HGSInvocationOperation alloc] 
+          initWithTarget:self
+                selector:@selector(doNothing:operation:)
+                  object:nil] autorelease];
+    [shared addOperation:op];
+  }
+  [shared waitUntilAllOperationsAreFinished];
+  NSDictionary *after = [shared statistics];
+  unsigned long long waitsBefore 
+    = [[before objectForKey:kHGSOperationQueueWaitCountKey] 
+       unsignedLongLongValue];
+  unsigned long long waitsAfter 
+    = [[after objectForKey:kHGSOperationQueueWaitCountKey] 
+       unsignedLongLongValue];
+  STAssertEquals(waitsAfter - waitsBefore, 10ULL, nil);
+  STAssertGreaterThanOrEqual([[after objectForKey:kHGSOperationQueueMaxDepthKey] 
+                              unsignedIntegerValue], (NSUInteger)1, nil);
+  STAssertGreaterThanOrEqual([[after objectForKey:kHGSOperationQueueMeanWaitKey] 
+                              doubleValue], 0.0, nil);
+}
+
+@end
+
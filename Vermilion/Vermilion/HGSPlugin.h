@@ -96,7 +96,8 @@
 @property (nonatomic, getter=isEnabled) BOOL enabled;
 
 /*!
-  Checks to see that the plugin bundle has a valid API version.
+  Checks to see that the plugin bundle has a valid API version. May be called
+  on any thread.
   @param bundle to check
   @result YES if API is valid
 */
@@ -115,7 +116,8 @@
 - (void)factorProtoExtensions;
 
 /*! 
-  Install all the enabled extensions belonging to this plugin. 
+  Install all the enabled extensions belonging to this plugin. The extensions
+  are created lazily, see -[HGSProtoExtension installWhenNeeded].
 */
 - (void)install;
 
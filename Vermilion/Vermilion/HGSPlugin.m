@@ -211,10 +211,11 @@ static NSString *const kHGSPluginAPIVersionKey
 }
 
 - (void)install {
-  // Lock and load all enable-able sources and actions.
+  // Lock and load all enable-able sources and actions. They are actually
+  // created the first time their extension point is asked for them.
   for (HGSProtoExtension *protoExtension in [self protoExtensions]) {
     if ([protoExtension isEnabled]) {
-      [protoExtension install];
+      [protoExtension installWhenNeeded];
     }
   }
   if ([factorableProtoExtensions_ count]) {
@@ -79,6 +79,19 @@
    An array of paths to SDEFs in plugins.
   */
   NSArray *pluginsSDEFPaths_;
+  
+  /*!
+   Per-plugin timing entries (NSMutableDictionary) in load order, and the
+   same entries keyed by plugin path.
+  */
+  NSMutableArray *timingTrace_;
+  NSMutableDictionary *timingTraceByPath_;
+  
+  /*!
+   Plugins whose deferred extensions have yet to be created by the warm-up
+   pass.
+  */
+  NSMutableArray *warmUpPlugins_;
 }
 
 @property (readwrite, assign, nonatomic) id<HGSDelegate> delegate;
@@ -111,6 +124,18 @@
  the plugins at a later time using  installAndEnablePluginsBasedOnPluginsState:.
 */
 - (NSArray*)pluginsState;
+
+/*!
+ Returns the startup timing trace: one dictionary per plugin bundle that was
+ looked at by the last loadPluginsWithErrors:, in load order. See the
+ kHGSPluginLoaderTrace keys below.
+*/
+- (NSArray *)timingTrace;
+
+/*!
+ Writes timingTrace to |path| as a plist for later analysis.
+*/
+- (BOOL)writeTimingTraceToFile:(NSString *)path;
 @end
 
 /*!
@@ -195,6 +220,13 @@ extern NSString *const kHGSPluginLoaderDidInstallPluginNotification;
 */
 extern NSString *const kHGSPluginLoaderDidLoadPluginNotification;
 
+/*!
+ Notification that the extensions which were deferred while installing the
+ plugins have all been created.
+ Object is the plugin loader.
+*/
+extern NSString *const kHGSPluginLoaderDidWarmUpPluginsNotification;
+
 /*!
   Key representing a plugin (HGSPlugin).
 */
@@ -207,3 +239,29 @@ extern NSString *const kHGSPluginLoaderPluginNameKey;
   Key representing an error loading the plugin.
 */
 extern NSString *const kHGSPluginLoaderErrorKey;
+
+/*!
+  Keys for the timing trace dictionaries. Path of the plugin (NSString).
+*/
+extern NSString *const kHGSPluginLoaderTracePathKey;
+/*!
+  Name of the plugin (NSString).
+*/
+extern NSString *const kHGSPluginLoaderTraceNameKey;
+/*!
+  Seconds spent locating the bundle and reading its Info.plist (NSNumber).
+*/
+extern NSString *const kHGSPluginLoaderTraceDiscoverKey;
+/*!
+  Seconds spent checking the bundle's API version (NSNumber).
+*/
+extern NSString *const kHGSPluginLoaderTraceVerifyKey;
+/*!
+  Seconds spent instantiating the plugin (NSNumber).
+*/
+extern NSString *const kHGSPluginLoaderTraceLoadKey;
+/*!
+  Seconds spent installing the plugin, including any of its extensions that
+  were created by the warm-up pass (NSNumber).
+*/
+extern NSString *const kHGSPluginLoaderTraceInstallKey;
@@ -39,6 +39,33 @@
 #import "HGSLog.h"
 #import "HGSPlugin.h"
 
+// Discovery and verification are mostly waiting on the disk, so run more of
+// them at once than we have cores.
+static const NSInteger kHGSPluginDiscoveryMinConcurrency = 8;
+
+// Everything we learn about a plugin bundle before instantiating it. The
+// discover and verify steps are thread safe and are run in parallel.
+@interface HGSPluginLoadRecord : NSObject {
+ @private
+  NSString *fullPath_;
+  NSString *pluginName_;
+  NSBundle *bundle_;
+  Class pluginClass_;
+  BOOL validAPI_;
+  NSTimeInterval discoverTime_;
+  NSTimeInterval verifyTime_;
+}
+@property (readonly, copy) NSString *fullPath;
+@property (readonly, copy) NSString *pluginName;
+@property (readonly, retain) NSBundle *bundle;
+@property (readonly) Class pluginClass;
+@property (readonly, getter=isValidAPI) BOOL validAPI;
+@property (readonly) NSTimeInterval discoverTime;
+@property (readonly) NSTimeInterval verifyTime;
+- (id)initWithPath:(NSString *)path pluginClass:(Class)pluginClass;
+- (void)discoverAndVerify;
+@end
+
 @interface HGSPluginLoader()
 // Returns an array containing the full paths for all bundles
 // found within the given plugin's path.
@@ -46,6 +73,11 @@
 - (void)loadPluginsAtPath:(NSString*)pluginsPath 
                 sdefPaths:(NSMutableArray *)sdefPaths
                    errors:(NSArray **)errors;
+- (NSMutableDictionary *)traceForPath:(NSString *)path;
+- (void)addTime:(NSTimeInterval)time
+         forKey:(NSString *)key
+        toTrace:(NSMutableDictionary *)trace;
+- (void)warmUpNextPlugin;
 @end
 
 NSString *const kHGSPluginLoaderPluginPathKey
@@ -78,6 +110,69 @@ NSString *const kHGSPluginLoaderDidInstallPluginNotification
   = @"HGSPluginLoaderDidInstallPluginNotification";
 NSString *const kHGSPluginLoaderWillInstallPluginNotification
   = @"HGSPluginLoaderWillInstallPluginNotification";
+NSString *const kHGSPluginLoaderDidWarmUpPluginsNotification
+  = @"HGSPluginLoaderDidWarmUpPluginsNotification";
+NSString *const kHGSPluginLoaderTracePathKey = @"path";
+NSString *const kHGSPluginLoaderTraceNameKey = @"name";
+NSString *const kHGSPluginLoaderTraceDiscoverKey = @"discover";
+NSString *const kHGSPluginLoaderTraceVerifyKey = @"verify";
+NSString *const kHGSPluginLoaderTraceLoadKey = @"load";
+NSString *const kHGSPluginLoaderTraceInstallKey = @"install";
+
+@implementation HGSPluginLoadRecord
+
+@synthesize fullPath = fullPath_;
+@synthesize pluginName = pluginName_;
+@synthesize bundle = bundle_;
+@synthesize pluginClass = pluginClass_;
+@synthesize validAPI = validAPI_;
+@synthesize discoverTime = discoverTime_;
+@synthesize verifyTime = verifyTime_;
+
+- (id)initWithPath:(NSString *)path pluginClass:(Class)pluginClass {
+  if ((self = [super init])) {
+    fullPath_ = [path copy];
+    pluginName_ = [[path lastPathComponent] copy];
+    pluginClass_ = pluginClass;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [fullPath_ release];
+  [pluginName_ release];
+  [bundle_ release];
+  [super dealloc];
+}
+
+- (void)discoverAndVerify {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSDate *startDate = [NSDate date];
+  NSString *fullPath = [fullPath_ stringByResolvingSymlinksAndAliases];
+  if (fullPath) {
+    [fullPath_ autorelease];
+    fullPath_ = [fullPath copy];
+  }
+  bundle_ = [[NSBundle alloc] initWithPath:fullPath_];
+  // Get the name.
+  NSString *betterPluginName 
+    = [bundle_ objectForInfoDictionaryKey:@"CFBundleDisplayName"];
+  if (!betterPluginName) {
+    betterPluginName = [bundle_ objectForInfoDictionaryKey:@"CFBundleName"];
+  }
+  if (betterPluginName) {
+    [pluginName_ autorelease];
+    pluginName_ = [betterPluginName copy];
+  }
+  discoverTime_ = -[startDate timeIntervalSinceNow];
+  
+  startDate = [NSDate date];
+  validAPI_ = bundle_ && [pluginClass_ isPluginBundleValidAPI:bundle_];
+  verifyTime_ = -[startDate timeIntervalSinceNow];
+  [pool release];
+}
+
+@end
 
 @implementation HGSPluginLoader
 
@@ -91,6 +186,8 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
 - (id)init {
   if ((self = [super init])) {
     extensionMap_ = [[NSMutableDictionary alloc] init];
+    timingTrace_ = [[NSMutableArray alloc] init];
+    timingTraceByPath_ = [[NSMutableDictionary alloc] init];
   }
   return self;
 }
@@ -100,6 +197,9 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
 - (void)dealloc {
   [extensionMap_ release];
   [plugins_ release];
+  [timingTrace_ release];
+  [timingTraceByPath_ release];
+  [warmUpPlugins_ release];
   [super dealloc];
 }
 // COV_NF_END
@@ -140,6 +240,8 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
   NSArray *pluginPaths = [[self delegate] pluginFolders];
   NSMutableArray *allErrors = nil;
   NSMutableArray *sdefPaths = [NSMutableArray array];
+  [timingTrace_ removeAllObjects];
+  [timingTraceByPath_ removeAllObjects];
   
   for (NSString *pluginPath in pluginPaths) {
     NSArray *pluginErrors = nil;
@@ -237,7 +339,11 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
       [nc postNotificationName:kHGSPluginLoaderWillInstallPluginNotification
                         object:self
                       userInfo:userInfo];
+      NSDate *startDate = [NSDate date];
       [plugin install];
+      [self addTime:-[startDate timeIntervalSinceNow]
+             forKey:kHGSPluginLoaderTraceInstallKey
+            toTrace:[self traceForPath:[[plugin bundle] bundlePath]]];
       [nc postNotificationName:kHGSPluginLoaderDidInstallPluginNotification
                         object:self
                       userInfo:userInfo];
@@ -246,6 +352,84 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
   }
   [nc postNotificationName:kHGSPluginLoaderDidInstallPluginsNotification 
                     object:self];
+  
+  // Step 5: Extensions are only created when their extension point is first
+  // asked for them. Create whatever is left over a plugin at a time once we
+  // are back in the run loop, so that extensions which nobody has asked for
+  // yet (and which may do work on their own) still start up shortly after
+  // launch.
+  BOOL warmUpScheduled = warmUpPlugins_ != nil;
+  [warmUpPlugins_ release];
+  warmUpPlugins_ = [plugins mutableCopy];
+  if (!warmUpScheduled) {
+    [self performSelector:@selector(warmUpNextPlugin)
+               withObject:nil
+               afterDelay:0];
+  }
+}
+
+- (void)warmUpNextPlugin {
+  if ([warmUpPlugins_ count]) {
+    HGSPlugin *plugin = [[[warmUpPlugins_ objectAtIndex:0] retain] autorelease];
+    [warmUpPlugins_ removeObjectAtIndex:0];
+    if ([plugin isEnabled]) {
+      NSDate *startDate = [NSDate date];
+      NSArray *protoExtensions = [plugin protoExtensions];
+      [protoExtensions
+        makeObjectsPerformSelector:@selector(installDeferredExtension)];
+      [self addTime:-[startDate timeIntervalSinceNow]
+             forKey:kHGSPluginLoaderTraceInstallKey
+            toTrace:[self traceForPath:[[plugin bundle] bundlePath]]];
+    }
+  }
+  if ([warmUpPlugins_ count]) {
+    [self performSelector:@selector(warmUpNextPlugin)
+               withObject:nil
+               afterDelay:0];
+  } else {
+    [warmUpPlugins_ release];
+    warmUpPlugins_ = nil;
+    HGSLogDebug(@"Plugin timing trace: %@", timingTrace_);
+    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    [nc postNotificationName:kHGSPluginLoaderDidWarmUpPluginsNotification 
+                      object:self];
+  }
+}
+
+- (NSMutableDictionary *)traceForPath:(NSString *)path {
+  NSMutableDictionary *trace = nil;
+  if (path) {
+    trace = [timingTraceByPath_ objectForKey:path];
+    if (!trace) {
+      trace 
+        = [NSMutableDictionary dictionaryWithObject:path 
+                                             forKey:kHGSPluginLoaderTracePathKey];
+      [timingTrace_ addObject:trace];
+      [timingTraceByPath_ setObject:trace forKey:path];
+    }
+  }
+  return trace;
+}
+
+- (void)addTime:(NSTimeInterval)time
+         forKey:(NSString *)key
+        toTrace:(NSMutableDictionary *)trace {
+  NSTimeInterval total = [[trace objectForKey:key] doubleValue] + time;
+  [trace setObject:[NSNumber numberWithDouble:total] forKey:key];
+}
+
+- (NSArray *)timingTrace {
+  // Hand out copies so callers don't see later updates.
+  NSMutableArray *trace 
+    = [NSMutableArray arrayWithCapacity:[timingTrace_ count]];
+  for (NSDictionary *entry in timingTrace_) {
+    [trace addObject:[NSDictionary dictionaryWithDictionary:entry]];
+  }
+  return trace;
+}
+
+- (BOOL)writeTimingTraceToFile:(NSString *)path {
+  return [[self timingTrace] writeToFile:path atomically:YES];
 }
 
 - (NSArray *)pluginsState {
@@ -289,35 +473,65 @@ GTM_METHOD_CHECK(NSString, stringByResolvingSymlinksAndAliases);
     [nc postNotificationName:kHGSPluginLoaderWillLoadPluginsNotification 
                       object:self 
                     userInfo:nil];
-    NSMutableArray *ourErrors = [NSMutableArray array];
+    
+    // Discover and verify all of the bundles that we know how to load in
+    // parallel. Instantiating the plugins (which may run plugin code and
+    // post notifications) is then done here, in order.
+    NSOperationQueue *queue = [[[NSOperationQueue alloc] init] autorelease];
+    NSInteger cores = [[NSProcessInfo processInfo] activeProcessorCount];
+    [queue setMaxConcurrentOperationCount:
+     MAX(cores * 2, kHGSPluginDiscoveryMinConcurrency)];
+    NSMutableArray *records 
+      = [NSMutableArray arrayWithCapacity:[bundlePaths count]];
     for (NSString *fullPath in bundlePaths) {
+      Class pluginClass = [extensionMap_ objectForKey:[fullPath pathExtension]];
+      HGSPluginLoadRecord *record 
+        = [[[HGSPluginLoadRecord alloc] initWithPath:fullPath
+                                         pluginClass:pluginClass]
+           autorelease];
+      [records addObject:record];
+      if (pluginClass) {
+        NSInvocationOperation *op
+          = [[[NSInvocationOperation alloc]
+              initWithTarget:record
+                    selector:@selector(discoverAndVerify)
+                      object:nil]
+             autorelease];
+        [queue addOperation:op];
+      }
+    }
+    [queue waitUntilAllOperationsAreFinished];
+    
+    NSMutableArray *ourErrors = [NSMutableArray array];
+    for (HGSPluginLoadRecord *record in records) {
       NSString *errorType = nil;
-      NSString *extension = [fullPath pathExtension];
-      Class pluginClass = [extensionMap_ objectForKey:extension];
-      NSString *pluginName = [fullPath lastPathComponent];
+      NSString *fullPath = [record fullPath];
+      NSString *pluginName = [record pluginName];
       HGSPlugin *plugin = nil;
-      if (pluginClass) {
-        fullPath = [fullPath stringByResolvingSymlinksAndAliases];
-        NSBundle *pluginBundle = [NSBundle bundleWithPath:fullPath];
-        // Get the name.
-        NSString *betterPluginName 
-          = [pluginBundle objectForInfoDictionaryKey:@"CFBundleDisplayName"];
-        if (!betterPluginName) {
-          betterPluginName 
-            = [pluginBundle objectForInfoDictionaryKey:@"CFBundleName"];
-        }
-        if (betterPluginName) {
-          pluginName = betterPluginName;
-        }
+      if ([record pluginClass]) {
+        NSBundle *pluginBundle = [record bundle];
+        NSMutableDictionary *trace = [self traceForPath:fullPath];
+        [trace setObject:pluginName forKey:kHGSPluginLoaderTraceNameKey];
+        [self addTime:[record discoverTime]
+               forKey:kHGSPluginLoaderTraceDiscoverKey
+              toTrace:trace];
+        [self addTime:[record verifyTime]
+               forKey:kHGSPluginLoaderTraceVerifyKey
+              toTrace:trace];
         NSDictionary *willLoadUserInfo 
           = [NSDictionary dictionaryWithObject:pluginName 
                                         forKey:kHGSPluginLoaderPluginNameKey];
         [nc postNotificationName:kHGSPluginLoaderWillLoadPluginNotification
                           object:self 
                         userInfo:willLoadUserInfo];
-        if ([pluginClass isPluginBundleValidAPI:pluginBundle]) {
+        if ([record isValidAPI]) {
+          NSDate *startDate = [NSDate date];
           plugin 
-            = [[[pluginClass alloc] initWithBundle:pluginBundle] autorelease];
+            = [[[[record pluginClass] alloc] initWithBundle:pluginBundle] 
+               autorelease];
+          [self addTime:-[startDate timeIntervalSinceNow]
+                 forKey:kHGSPluginLoaderTraceLoadKey
+                toTrace:trace];
           if (plugin) {
             HGSExtensionPoint *pluginsPoint = [HGSExtensionPoint pluginsPoint];
             [pluginsPoint extendWithObject:plugin];
@@ -42,6 +42,17 @@
 @interface HGSTestLoaderDelegate : NSObject <HGSDelegate> 
 @end
 
+// Stands in for a plugin whose verification has to wait on the disk.
+@interface HGSTestSlowLoaderPlugin : HGSTestLoaderPlugin
+@end
+
+@interface HGSTestFolderLoaderDelegate : HGSTestLoaderDelegate {
+ @private
+  NSString *folder_;
+}
+- (id)initWithFolder:(NSString *)folder;
+@end
+
 @implementation HGSTestLoaderDelegate
 
 - (NSArray *)pluginFolders {
@@ -86,6 +97,26 @@
 @end
 
 
+@implementation HGSTestFolderLoaderDelegate
+
+- (id)initWithFolder:(NSString *)folder {
+  if ((self = [super init])) {
+    folder_ = [folder copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [folder_ release];
+  [super dealloc];
+}
+
+- (NSArray *)pluginFolders {
+  return [NSArray arrayWithObject:folder_];
+}
+
+@end
+
 @interface HGSPluginLoaderTest : GTMTestCase
 @end
 
@@ -119,6 +150,68 @@
   [pluginLoader setDelegate:nil];
 }
 
+- (void)testParallelLoadingAndTimingTrace {
+  // Build a folder of stub plugins whose API check takes a while.
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *folder
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       [NSString stringWithFormat:@"HGSPluginLoaderTest-%d",
+        [[NSProcessInfo processInfo] processIdentifier]]];
+  [fm removeItemAtPath:folder error:nil];
+  const NSUInteger kPluginCount = 48;
+  for (NSUInteger i = 0; i < kPluginCount; ++i) {
+    NSString *contents
+      = [folder stringByAppendingFormat:@"/Stub%02u.hgsslowtest/Contents",
+         (unsigned)i];
+    STAssertTrue([fm createDirectoryAtPath:contents
+               withIntermediateDirectories:YES
+                                attributes:nil
+                                     error:nil], nil);
+    NSDictionary *info
+      = [NSDictionary dictionaryWithObject:
+         [NSString stringWithFormat:@"Stub %u", (unsigned)i]
+                                    forKey:@"CFBundleName"];
+    STAssertTrue([info writeToFile:
+                  [contents stringByAppendingPathComponent:@"Info.plist"]
+                        atomically:YES], nil);
+  }
+  
+  HGSPluginLoader *pluginLoader = [HGSPluginLoader sharedPluginLoader];
+  [pluginLoader registerClass:[HGSTestSlowLoaderPlugin class] 
+                forExtensions:[NSArray arrayWithObject:@"hgsslowtest"]];
+  HGSTestFolderLoaderDelegate *loaderDelegate
+    = [[[HGSTestFolderLoaderDelegate alloc] initWithFolder:folder]
+       autorelease];
+  [pluginLoader setDelegate:loaderDelegate];
+  NSArray *errors = nil;
+  NSDate *startDate = [NSDate date];
+  [pluginLoader loadPluginsWithErrors:&errors];
+  NSTimeInterval wallTime = -[startDate timeIntervalSinceNow];
+  [pluginLoader setDelegate:nil];
+  STAssertNil(errors, @"Errors: %@", errors);
+  
+  // Every plugin shows up in the trace with its name and phase timings.
+  NSArray *trace = [pluginLoader timingTrace];
+  STAssertEquals([trace count], kPluginCount, @"Trace: %@", trace);
+  NSTimeInterval serialTime = 0;
+  for (NSDictionary *entry in trace) {
+    STAssertTrue([[entry objectForKey:kHGSPluginLoaderTraceNameKey]
+                  hasPrefix:@"Stub "], @"Entry: %@", entry);
+    STAssertNotNil([entry objectForKey:kHGSPluginLoaderTraceDiscoverKey], nil);
+    STAssertNotNil([entry objectForKey:kHGSPluginLoaderTraceLoadKey], nil);
+    serialTime 
+      += [[entry objectForKey:kHGSPluginLoaderTraceVerifyKey] doubleValue];
+  }
+  STAssertLessThan(wallTime, serialTime / 2, 
+                   @"plugins do not appear to be verified in parallel");
+  
+  NSString *tracePath = [folder stringByAppendingPathComponent:@"trace.plist"];
+  STAssertTrue([pluginLoader writeTimingTraceToFile:tracePath], nil);
+  STAssertEquals([[NSArray arrayWithContentsOfFile:tracePath] count],
+                 kPluginCount, nil);
+  [fm removeItemAtPath:folder error:nil];
+}
+
 @end
 
 @implementation HGSTestLoaderPlugin
@@ -134,3 +227,9 @@
 }
 @end
 
+@implementation HGSTestSlowLoaderPlugin
++ (BOOL)isPluginBundleValidAPI:(NSBundle *)pluginBundle {
+  [NSThread sleepForTimeInterval:0.05];
+  return YES;
+}
+@end
@@ -36,6 +36,7 @@
 */
 
 #import <Foundation/Foundation.h>
+#import <Vermilion/HGSExtensionPoint.h>
 
 @class HGSPlugin;
 @class HGSExtension;
@@ -65,7 +66,7 @@
   It is likely that this implementation will change somewhat as new types of
   factors are introduced in the future.
 */
-@interface HGSProtoExtension : NSObject {
+@interface HGSProtoExtension : NSObject <HGSExtensionInstaller> {
  @private
   __weak HGSPlugin *plugin_;
   HGSExtension *extension_;
@@ -170,6 +171,12 @@
   the extension to it's extension point.
 */
 - (void)install;
+/*!
+  Arrange for the extension to be installed the first time its extension
+  point is queried (or when the plugin loader warms up extensions after
+  launch), rather than right now.
+*/
+- (void)installWhenNeeded;
 /*!
   Uninstall the extension represented by this protoextension. This will remove
   the extension from it's extension point.
@@ -245,6 +245,11 @@
 }
 
 - (void)install {
+  NSString *pointKey = [self extensionPointKey];
+  if (pointKey) {
+    HGSExtensionPoint *point = [HGSExtensionPoint pointWithIdentifier:pointKey];
+    [point removePendingInstaller:self];
+  }
   if ([self isInstalled]) {
     return;
   }
@@ -317,9 +322,29 @@
   }
 }
 
+- (void)installWhenNeeded {
+  NSString *pointKey = [self extensionPointKey];
+  if (![self isInstalled] && pointKey) {
+    HGSExtensionPoint *point = [HGSExtensionPoint pointWithIdentifier:pointKey];
+    [point addPendingInstaller:self];
+  }
+}
+
+- (void)installDeferredExtension {
+  // The user may have turned us (or our plugin) off since we were deferred.
+  if ([self isEnabled] && [[self plugin] isEnabled]) {
+    [self install];
+  }
+}
+
 - (void)uninstall {
+  NSString *extensionPointKey = [self extensionPointKey];
+  if (extensionPointKey) {
+    HGSExtensionPoint *point
+      = [HGSExtensionPoint pointWithIdentifier:extensionPointKey];
+    [point removePendingInstaller:self];
+  }
   if ([self isInstalled]) {
-    NSString *extensionPointKey = [self extensionPointKey];
     HGSExtensionPoint *point
       = [HGSExtensionPoint pointWithIdentifier:extensionPointKey];
     HGSExtension *extension = [self extension];
@@ -86,11 +86,23 @@ public:
 - (NSArray *)resultsFromObjects:(PyObject *)pythonResults
                  tokenizedQuery:(HGSTokenizedString *)tokenizedQuery
                          source:(HGSSearchSource *)source;
+// Builds results from a batch of result dictionaries decoded from a worker
+// process. Doesn't touch the embedded interpreter.
++ (NSArray *)resultsFromDictionaries:(NSArray *)dictionaries
+                      tokenizedQuery:(HGSTokenizedString *)tokenizedQuery
+                              source:(HGSSearchSource *)source;
+// The Foundation equivalent of objectForResult: for sending a result to a
+// worker process.
++ (NSDictionary *)dictionaryForResult:(HGSResult *)result;
 @end
 
 extern const NSString *kHGSPythonPrivateValuesKey;
 extern const NSString *kHGSPythonThreadExtensionKey;
 
+// Keys for the terms Python sources want their results scored against.
+extern NSString* const kHGSPythonResultMainItemStringKey;
+extern NSString* const kHGSPythonResultOtherItemsStringKey;
+
 // The two keys for things we pull from the config dictionary
 extern NSString *const kPythonModuleNameKey;
 extern NSString *const kPythonClassNameKey;
@@ -250,6 +250,72 @@ static PyMethodDef NotificationMethods[] = {
   { NULL, NULL, 0, NULL }
 };
 
+static NSString *HGSPythonString(const char *utf8) {
+  return utf8 ? [NSString stringWithUTF8String:utf8] : nil;
+}
+
+// Scores and builds a single result. Shared by results coming from the
+// embedded interpreter and results coming back from worker processes.
+static HGSScoredResult *HGSPythonScoredResult(NSString *identifier,
+                                              NSString *displayName,
+                                              NSString *type,
+                                              NSString *snippet,
+                                              NSString *image,
+                                              NSString *defaultAction,
+                                              NSString *mainItem,
+                                              NSString *otherItems,
+                                              NSDictionary *privateValues,
+                                              HGSTokenizedString *query,
+                                              HGSSearchSource *source) {
+  // Score the main term and then the other terms, giving the
+  // other terms a 50% weight.
+  CGFloat score = 0.0;
+  HGSTokenizedString *matchedString = nil;
+  NSIndexSet *matchedIndexes = nil;
+  if (mainItem && query) {
+    HGSTokenizedString *mainItemTokenized
+      = [HGSTokenizer tokenizeString:mainItem];
+    NSArray *otherItemsArray
+      = [(otherItems ? otherItems : @"") componentsSeparatedByString:@" "];
+    NSArray *otherItemsTokenized
+      = [HGSTokenizer tokenizeStrings:otherItemsArray];
+    score = HGSScoreTermForMainAndOtherItems(query,
+                                             mainItemTokenized,
+                                             otherItemsTokenized,
+                                             &matchedString,
+                                             &matchedIndexes);
+  }
+  if (score <= 0.0 && query) return nil;
+
+  NSMutableDictionary *attributes = [NSMutableDictionary dictionary];
+  if ([snippet length]) {
+    [attributes setObject:snippet forKey:kHGSObjectAttributeSnippetKey];
+  }
+  if ([defaultAction length]) {
+    HGSExtensionPoint *actionsPoint = [HGSExtensionPoint actionsPoint];
+    HGSAction *action = [actionsPoint extensionWithIdentifier:defaultAction];
+    if (action) {
+      [attributes setObject:action forKey:kHGSObjectAttributeDefaultActionKey];
+    }
+  }
+  if ([image length]) {
+    NSImage *img = [source imageNamed:image];
+    if (img) {
+      [attributes setObject:img forKey:kHGSObjectAttributeImmediateIconKey];
+    }
+  }
+  [attributes setObject:privateValues forKey:kHGSPythonPrivateValuesKey];
+  return [HGSScoredResult resultWithURI:identifier
+                                   name:displayName
+                                   type:type
+                                 source:source
+                             attributes:attributes
+                                  score:score
+                                  flags:0
+                            matchedTerm:matchedString
+                         matchedIndexes:matchedIndexes];
+}
+
 // A simple wrapper for PyObject which allows it to be used in
 // Objective-C containers
 @implementation HGSPythonObject
@@ -405,6 +471,8 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
       = [result valueForKey:kHGSPythonPrivateValuesKey];
     for (NSString *key in [privateValues allKeys]) {
       HGSPythonObject *wrapper = [privateValues valueForKey:key];
+      // Results from worker processes carry Foundation private values.
+      if (![wrapper isKindOfClass:[HGSPythonObject class]]) continue;
       pyValue = [wrapper object];
       if (pyValue) {
         PyDict_SetItemString(dict, [key UTF8String], pyValue);
@@ -629,73 +697,20 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
             }
           }
           if (identifier) {
-            NSString *displayNameString = nil;
-            if (displayName) {
-              displayNameString = [NSString stringWithUTF8String:displayName];
-            }
-            // Score the main term and then the other terms, giving the
-            // other terms a 50% weight.
-            CGFloat score = 0.0;
-            HGSTokenizedString *matchedString = nil;
-            NSIndexSet *matchedIndexes = nil;
-            if (mainItem && tokenizedQuery) {
-              NSString *itemString = [NSString stringWithUTF8String:mainItem];
-              HGSTokenizedString *mainItemTokenized
-                = [HGSTokenizer tokenizeString:itemString];
-
-              itemString = [NSString stringWithUTF8String:otherItems];
-              NSArray *otherItemsArray
-                = [itemString componentsSeparatedByString:@" "];
-
-              NSArray *otherItemsTokenized
-                = [HGSTokenizer tokenizeStrings:otherItemsArray];
-              score = HGSScoreTermForMainAndOtherItems(tokenizedQuery,
-                                                       mainItemTokenized,
-                                                       otherItemsTokenized,
-                                                       &matchedString,
-                                                       &matchedIndexes);
-            }
-
-            if (score > 0.0 || !tokenizedQuery) {
-              NSMutableDictionary *attributes
-                = [NSMutableDictionary dictionary];
-              NSString *urlString = [NSString stringWithUTF8String:identifier];
-              if (snippet && strlen(snippet) > 0) {
-                [attributes setObject:[NSString stringWithUTF8String:snippet]
-                               forKey:kHGSObjectAttributeSnippetKey];
-              }
-              if (defaultAction && strlen(defaultAction) > 0) {
-                HGSAction *action
-                  = [[HGSExtensionPoint actionsPoint] extensionWithIdentifier:
-                     [NSString stringWithUTF8String:defaultAction]];
-                if (action) {
-                  [attributes setObject:action
-                                 forKey:kHGSObjectAttributeDefaultActionKey];
-                }
-              }
-              if (image && strlen(image) > 0) {
-                NSString *imageString = [NSString stringWithUTF8String:image];
-                NSImage *img = [source imageNamed:imageString];
-                if (img) {
-                  [attributes setObject:img
-                                 forKey:kHGSObjectAttributeImmediateIconKey];
-                }
-              }
-              [attributes setObject:privateValues
-                           forKey:kHGSPythonPrivateValuesKey];
-              HGSScoredResult *scoredResult
-                = [HGSScoredResult resultWithURI:urlString
-                                            name:displayNameString
-                                            type:type
-                                          source:source
-                                      attributes:attributes
-                                           score:score
-                                           flags:0
-                                     matchedTerm:matchedString
-                                  matchedIndexes:matchedIndexes];
-              if (scoredResult) {
-                [results addObject:scoredResult];
-              }
+            HGSScoredResult *scoredResult
+              = HGSPythonScoredResult(HGSPythonString(identifier),
+                                      HGSPythonString(displayName),
+                                      type,
+                                      HGSPythonString(snippet),
+                                      HGSPythonString(image),
+                                      HGSPythonString(defaultAction),
+                                      HGSPythonString(mainItem),
+                                      HGSPythonString(otherItems),
+                                      privateValues,
+                                      tokenizedQuery,
+                                      source);
+            if (scoredResult) {
+              [results addObject:scoredResult];
             }
           }
         }
@@ -705,6 +720,88 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   return results;
 }
 
++ (NSArray *)resultsFromDictionaries:(NSArray *)dictionaries
+                      tokenizedQuery:(HGSTokenizedString *)tokenizedQuery
+                              source:(HGSSearchSource *)source {
+  NSMutableArray *results
+    = [NSMutableArray arrayWithCapacity:[dictionaries count]];
+  for (NSDictionary *dict in dictionaries) {
+    if (![dict isKindOfClass:[NSDictionary class]]) continue;
+    NSString *identifier = nil, *displayName = nil, *snippet = nil;
+    NSString *mainItem = nil, *otherItems = nil;
+    NSString *image = nil, *defaultAction = nil;
+    NSString *type = kHGSTypePython;
+    NSMutableDictionary *privateValues = [NSMutableDictionary dictionary];
+    for (NSString *key in dict) {
+      id value = [dict objectForKey:key];
+      NSString *stringValue
+        = [value isKindOfClass:[NSString class]] ? value : nil;
+      if ([key isEqual:kHGSObjectAttributeURIKey]) {
+        identifier = stringValue;
+      } else if ([key isEqual:kHGSObjectAttributeNameKey]) {
+        displayName = stringValue;
+      } else if ([key isEqual:kHGSObjectAttributeSnippetKey]) {
+        snippet = stringValue;
+      } else if ([key isEqual:kHGSObjectAttributeIconPreviewFileKey]) {
+        image = stringValue;
+      } else if ([key isEqual:kHGSObjectAttributeDefaultActionKey]) {
+        defaultAction = stringValue;
+      } else if ([key isEqual:kHGSObjectAttributeTypeKey]) {
+        if (stringValue) {
+          type = stringValue;
+        }
+      } else if ([key isEqual:kHGSPythonResultMainItemStringKey]) {
+        mainItem = stringValue;
+      } else if ([key isEqual:kHGSPythonResultOtherItemsStringKey]) {
+        otherItems = stringValue;
+      } else {
+        [privateValues setObject:value forKey:key];
+      }
+    }
+    if (identifier) {
+      HGSScoredResult *scoredResult
+        = HGSPythonScoredResult(identifier, displayName, type, snippet, image,
+                                defaultAction, mainItem, otherItems,
+                                privateValues, tokenizedQuery, source);
+      if (scoredResult) {
+        [results addObject:scoredResult];
+      }
+    }
+  }
+  return results;
+}
+
++ (NSDictionary *)dictionaryForResult:(HGSResult *)result {
+  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+  NSString *value = [[result url] absoluteString];
+  if (value) {
+    [dict setObject:value forKey:kHGSObjectAttributeURIKey];
+  }
+  NSString *keys[] = {
+    kHGSObjectAttributeNameKey,
+    kHGSObjectAttributeTypeKey,
+    kHGSObjectAttributeSnippetKey,
+    kHGSObjectAttributeIconPreviewFileKey
+  };
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    value = [result valueForKey:keys[i]];
+    if ([value isKindOfClass:[NSString class]]) {
+      [dict setObject:value forKey:keys[i]];
+    }
+  }
+  // Private values that came from a worker process are plain Foundation
+  // objects and can go back to one; interpreter objects can't.
+  NSDictionary *privateValues
+    = [result valueForKey:kHGSPythonPrivateValuesKey];
+  for (NSString *key in privateValues) {
+    id privateValue = [privateValues objectForKey:key];
+    if (![privateValue isKindOfClass:[HGSPythonObject class]]) {
+      [dict setObject:privateValue forKey:key];
+    }
+  }
+  return dict;
+}
+
 + (NSString *)stringAttribute:(NSString *)attr fromObject:(PyObject *)obj {
   NSString *result = nil;
   if (obj) {
@@ -39,6 +39,10 @@
   PyObject *instance_;
   PyObject *perform_;
   PyObject *appliesTo_;
+  BOOL usesWorkerPool_;
+  // Worker pool answers to AppliesToResults, keyed by the set of result
+  // types asked about. NSNull while a worker is being asked.
+  NSMutableDictionary *appliesToTypes_;
 }
 
 - (id)initWithConfiguration:(NSDictionary *)configuration;
@@ -31,13 +31,45 @@
 //
 
 #import "HGSPythonAction.h"
+#import "HGSPythonWorkerPool.h"
 #import "HGSLog.h"
 #import "HGSBundle.h"
 #import "HGSResult.h"
+#import "HGSOperation.h"
 
 static const char *const kHGSPythonAppliesToResults = "AppliesToResults";
 static const char *const kHGSPythonPerform = "Perform";
 
+// How long to wait on a worker. AppliesToResults is asked while the user
+// is looking at the action list, so it gets very little time. It is never
+// waited for on the main thread.
+static const NSTimeInterval kHGSPythonAppliesToResultsTimeout = 1.0;
+static const NSTimeInterval kHGSPythonPerformTimeout = 30.0;
+
+static NSArray *HGSPythonDictionariesForResults(HGSResultArray *results) {
+  NSMutableArray *array = [NSMutableArray arrayWithCapacity:[results count]];
+  for (HGSResult *result in results) {
+    [array addObject:[HGSPython dictionaryForResult:result]];
+  }
+  return array;
+}
+
+static NSSet *HGSPythonTypesForResults(HGSResultArray *results) {
+  NSMutableSet *types = [NSMutableSet setWithCapacity:[results count]];
+  for (HGSResult *result in results) {
+    [types addObject:[result type]];
+  }
+  return types;
+}
+
+@interface HGSPythonAction ()
+- (BOOL)workerAppliesToResults:(HGSResultArray *)results;
+- (NSNumber *)askWorkerAppliesToResults:(HGSResultArray *)results
+                                  types:(NSSet *)types;
+- (void)askWorkerAppliesToResults:(HGSResultArray *)results
+                        operation:(NSOperation *)operation;
+@end
+
 @implementation HGSPythonAction
 
 - (id)initWithConfiguration:(NSDictionary *)configuration {
@@ -55,6 +87,15 @@ static const char *const kHGSPythonPerform = "Perform";
       [self release];
       return nil;
     }
+    usesWorkerPool_
+      = [[configuration objectForKey:kHGSPythonUsesWorkerPoolKey] boolValue];
+    if (usesWorkerPool_) {
+      appliesToTypes_ = [[NSMutableDictionary alloc] init];
+      [[HGSPythonWorkerPool sharedPool] registerExtension:self
+                                               moduleName:moduleName
+                                                className:className];
+      return self;
+    }
     NSString *resourcePath = [[self bundle] resourcePath];
     HGSPython *sharedPython = [HGSPython sharedPython];
     if (resourcePath) {
@@ -119,6 +160,10 @@ static const char *const kHGSPythonPerform = "Perform";
 }
 
 - (void)dealloc {
+  if (usesWorkerPool_) {
+    [[HGSPythonWorkerPool sharedPool] unregisterExtension:self];
+  }
+  [appliesToTypes_ release];
   if (perform_ || appliesTo_ || instance_ || module_) {
     PythonStackLock gilLock;
     if (perform_) {
@@ -137,13 +182,41 @@ static const char *const kHGSPythonPerform = "Perform";
   [super dealloc];
 }
 
+// Calls Perform in a worker with the same arguments the embedded
+// interpreter would get.
+- (id)workerPerformWithInfo:(NSDictionary *)info {
+  HGSResultArray *directs = [info objectForKey:kHGSActionDirectObjectsKey];
+  if (!directs) return nil;
+  NSMutableArray *args
+    = [NSMutableArray arrayWithObject:HGSPythonDictionariesForResults(directs)];
+  NSMutableDictionary *indirects = [NSMutableDictionary dictionary];
+  for (NSString *key in info) {
+    if (![key isEqual:kHGSActionDirectObjectsKey]) {
+      HGSResultArray *indirectValues = [info objectForKey:key];
+      [indirects setObject:HGSPythonDictionariesForResults(indirectValues)
+                    forKey:key];
+    }
+  }
+  if ([indirects count]) {
+    [args addObject:indirects];
+  }
+  return [[HGSPythonWorkerPool sharedPool]
+          callMethod:[NSString stringWithUTF8String:kHGSPythonPerform]
+         ofExtension:self
+           arguments:args
+             timeout:kHGSPythonPerformTimeout];
+}
+
 - (BOOL)performWithInfo:(NSDictionary *)info {
   BOOL result = NO;
   
   HGSResultArray *directs 
     = [info objectForKey:kHGSActionDirectObjectsKey];
 
-  if (instance_ && directs) {
+  if (usesWorkerPool_) {
+    id value = [self workerPerformWithInfo:info];
+    result = [value isEqual:[NSNumber numberWithBool:YES]];
+  } else if (instance_ && directs) {
     PythonStackLock gilLock;
     HGSPython *sharedPython = [HGSPython sharedPython];
     PyObject *pyDirects = [sharedPython tupleForResults:directs];
@@ -192,7 +265,18 @@ static const char *const kHGSPythonPerform = "Perform";
   HGSResultArray *directs 
     = [info objectForKey:kHGSActionDirectObjectsKey];
 
-  if (instance_ && directs) {
+  if (usesWorkerPool_) {
+    id value = [self workerPerformWithInfo:info];
+    if ([value isKindOfClass:[NSDictionary class]]) {
+      value = [NSArray arrayWithObject:value];
+    }
+    if ([value isKindOfClass:[NSArray class]]) {
+      NSArray *array = [HGSPython resultsFromDictionaries:value
+                                           tokenizedQuery:nil
+                                                   source:nil];
+      results = [HGSResultArray arrayWithResults:array];
+    }
+  } else if (instance_ && directs) {
     PythonStackLock gilLock;
     HGSPython *sharedPython = [HGSPython sharedPython];
     PyObject *pyDirects = [sharedPython tupleForResults:directs];
@@ -241,9 +325,79 @@ static const char *const kHGSPythonPerform = "Perform";
   return results;
 }
 
+// Asks a worker and remembers the answer for |types|. Returns nil, and
+// forgets that we were asking, if the worker didn't answer.
+- (NSNumber *)askWorkerAppliesToResults:(HGSResultArray *)results
+                                  types:(NSSet *)types {
+  NSArray *args
+    = [NSArray arrayWithObject:HGSPythonDictionariesForResults(results)];
+  NSString *method
+    = [NSString stringWithUTF8String:kHGSPythonAppliesToResults];
+  id value = [[HGSPythonWorkerPool sharedPool]
+              callMethod:method
+             ofExtension:self
+               arguments:args
+                 timeout:kHGSPythonAppliesToResultsTimeout];
+  NSNumber *applies = nil;
+  if (value) {
+    BOOL doesApply = [value isEqual:[NSNumber numberWithBool:YES]];
+    applies = [NSNumber numberWithBool:doesApply];
+  }
+  @synchronized (appliesToTypes_) {
+    if (applies) {
+      [appliesToTypes_ setObject:applies forKey:types];
+    } else if ([appliesToTypes_ objectForKey:types] == [NSNull null]) {
+      [appliesToTypes_ removeObjectForKey:types];
+    }
+  }
+  return applies;
+}
+
+- (void)askWorkerAppliesToResults:(HGSResultArray *)results
+                        operation:(NSOperation *)operation {
+  [self askWorkerAppliesToResults:results
+                            types:HGSPythonTypesForResults(results)];
+}
+
+// A round trip to a worker is too slow for the main thread, which asks
+// while the user is looking at the action list. Answers are remembered per
+// set of result types; when the main thread asks about types we don't
+// know yet, a worker is asked in the background and we say NO for now.
+- (BOOL)workerAppliesToResults:(HGSResultArray *)results {
+  NSSet *types = HGSPythonTypesForResults(results);
+  BOOL onMainThread = [NSThread isMainThread];
+  BOOL askInBackground = NO;
+  id applies = nil;
+  @synchronized (appliesToTypes_) {
+    applies = [[[appliesToTypes_ objectForKey:types] retain] autorelease];
+    if (!applies && onMainThread) {
+      [appliesToTypes_ setObject:[NSNull null] forKey:types];
+      askInBackground = YES;
+    }
+  }
+  if ([applies isKindOfClass:[NSNumber class]]) {
+    return [applies boolValue];
+  }
+  if (!onMainThread) {
+    return [[self askWorkerAppliesToResults:results types:types] boolValue];
+  }
+  if (askInBackground) {
+    SEL selector = @selector(askWorkerAppliesToResults:operation:);
+    HGSInvocationOperation *operation
+      = [[[HGSInvocationOperation alloc] initWithTarget:self
+                                               selector:selector
+                                                 object:results]
+         autorelease];
+    [[HGSOperationQueue sharedOperationQueue] addOperation:operation];
+  }
+  return NO;
+}
+
 - (BOOL)appliesToResults:(HGSResultArray *)results {
   BOOL doesApply = [super appliesToResults:results];
-  if (doesApply) {
+  if (doesApply && usesWorkerPool_) {
+    doesApply = [self workerAppliesToResults:results];
+  } else if (doesApply) {
     PythonStackLock gilLock;
     doesApply = NO;
     PyObject *pyResult = [[HGSPython sharedPython] tupleForResults:results];
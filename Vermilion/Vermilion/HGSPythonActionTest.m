@@ -33,6 +33,7 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSPythonAction.h"
+#import "HGSPythonWorkerPool.h"
 #import "HGSResult.h"
 #import "HGSType.h"
 #import "HGSUserMessage.h"
@@ -102,6 +103,42 @@
   STAssertNotNil([action directObjectTypeFilter], nil);
 }
 
+- (void)testWorkerPoolAppliesToResults {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config = [NSDictionary dictionaryWithObjectsAndKeys:
+                          @"VermilionTest", kPythonModuleNameKey,
+                          @"VermilionAction", kPythonClassNameKey,
+                          @"python.test.worker", kHGSExtensionIdentifierKey,
+                          @"*", @"HGSActionDirectObjectTypes",
+                          [NSNumber numberWithBool:YES],
+                          kHGSPythonUsesWorkerPoolKey,
+                          bundle, kHGSExtensionBundleKey,
+                          nil];
+  HGSPythonAction *action
+    = [[[HGSPythonAction alloc] initWithConfiguration:config] autorelease];
+  STAssertNotNil(action, nil);
+  HGSUnscoredResult *result
+    = [HGSUnscoredResult resultWithURI:@"http://www.google.com/"
+                                  name:@"Google"
+                                  type:kHGSTypeWebBookmark
+                                source:nil
+                            attributes:nil];
+  HGSResultArray *results = [HGSResultArray arrayWithResult:result];
+
+  // The main thread never waits for a worker; it gets NO until a worker
+  // has answered for these types in the background.
+  STAssertFalse([action appliesToResults:results], nil);
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:10];
+  BOOL applies = NO;
+  while (!applies && [timeout timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop]
+     runMode:NSDefaultRunLoopMode
+     beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    applies = [action appliesToResults:results];
+  }
+  STAssertTrue(applies, nil);
+}
+
 - (void)displayUserMessage:(NSNotification *)notification {
   NSDictionary *userInfo = [notification userInfo];
   NSString *message = [userInfo objectForKey:kHGSSummaryMessageKey];
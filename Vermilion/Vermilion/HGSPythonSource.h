@@ -37,17 +37,27 @@
 // return any sort of type.
 #define kHGSTypePython HGS_SUBTYPE(kHGSTypeScript, @"python")
 
+@class HGSPythonWorkerRequest;
+
 @interface HGSPythonSource : HGSSearchSource {
  @private
   PyObject *module_;
   PyObject *instance_;
   PyObject *isValidSourceForQuery_;
   PyObject *updateResult_;
+  BOOL usesWorkerPool_;
 }
 - (id)initWithConfiguration:(NSDictionary *)configuration;
+// YES if the source was configured with kHGSPythonUsesWorkerPoolKey and
+// runs in HGSPythonWorkerPool instead of the embedded interpreter. Results
+// such sources reanimate from archives are not passed to UpdateResult.
+- (BOOL)usesWorkerPool;
 @end
 
-@interface HGSPythonSearchOperation : HGSSimpleArraySearchOperation
+@interface HGSPythonSearchOperation : HGSSimpleArraySearchOperation {
+ @private
+  HGSPythonWorkerRequest *request_;
+}
 - (id)initWithQuery:(HGSQuery*)query
              source:(HGSPythonSource *)source;
 @end
@@ -31,6 +31,7 @@
 //
 
 #import "HGSPythonSource.h"
+#import "HGSPythonWorkerPool.h"
 #import "HGSQuery.h"
 #import "HGSLog.h"
 #import "HGSIconProvider.h"
@@ -60,6 +61,15 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
       [self release];
       return nil;
     }
+    usesWorkerPool_
+      = [[configuration objectForKey:kHGSPythonUsesWorkerPoolKey] boolValue];
+    if (usesWorkerPool_) {
+      // Workers load the module themselves the first time they need it.
+      [[HGSPythonWorkerPool sharedPool] registerExtension:self
+                                               moduleName:moduleName
+                                                className:className];
+      return self;
+    }
     HGSPython *sharedPython = [HGSPython sharedPython];
     NSString *resourcePath = [bundle resourcePath];
     if (resourcePath) {
@@ -129,6 +139,9 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
 }
 
 - (void)dealloc {
+  if (usesWorkerPool_) {
+    [[HGSPythonWorkerPool sharedPool] unregisterExtension:self];
+  }
   if (isValidSourceForQuery_ || instance_ || module_) {
     PythonStackLock gilLock;
     if (isValidSourceForQuery_) {
@@ -156,7 +169,9 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
 
 - (BOOL)isValidSourceForQuery:(HGSQuery *)query {
   BOOL isValid = [super isValidSourceForQuery:query];  
-  if (isValid) {
+  // Workers call IsValidSourceForQuery before PerformSearch rather than
+  // making us wait for a round trip here.
+  if (isValid && !usesWorkerPool_) {
     PythonStackLock gilLock;
 
     PyObject *pyQuery = [[HGSPython sharedPython] objectForQuery:query
@@ -192,16 +207,35 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
   return instance_;
 }
 
+- (BOOL)usesWorkerPool {
+  return usesWorkerPool_;
+}
+
 - (NSArray *)archiveKeys {
-  NSArray *archiveKeys 
-    = [NSArray arrayWithObject:kHGSObjectAttributeIconPreviewFileKey];
+  NSArray *archiveKeys = nil;
+  if (usesWorkerPool_) {
+    // Worker results are rebuilt from their archives alone (see
+    // resultWithArchivedRepresentation:), so keep the plugin's private
+    // values too. They came from the worker as property list types, so they
+    // can always be archived.
+    archiveKeys = [NSArray arrayWithObjects:
+                   kHGSObjectAttributeIconPreviewFileKey,
+                   kHGSPythonPrivateValuesKey,
+                   nil];
+  } else {
+    archiveKeys
+      = [NSArray arrayWithObject:kHGSObjectAttributeIconPreviewFileKey];
+  }
   return archiveKeys;
 }
 
 - (HGSResult *)resultWithArchivedRepresentation:(NSDictionary *)representation {
   // Do we allow archiving?
   HGSResult *result = [super resultWithArchivedRepresentation:representation];
-  if (result) {
+  // Results are reanimated while the user waits, often on the main thread,
+  // so worker plugins don't get a round trip to UpdateResult. The archive
+  // already holds everything the worker sent us for the result.
+  if (result && !usesWorkerPool_) {
     // Give the plug-in a chance to update the reanimated result.
     PythonStackLock gilLock;
     HGSPython *sharedPython = [HGSPython sharedPython];
@@ -252,9 +286,22 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
   return self;
 }
 
+- (void)dealloc {
+  [request_ release];
+  [super dealloc];
+}
+
 - (void)main {
   BOOL running = NO;
   HGSPythonSource *source = (HGSPythonSource *)[self source];
+  if ([source usesWorkerPool]) {
+    // The pool calls finishQuery when the worker is done.
+    HGSPythonWorkerPool *pool = [HGSPythonWorkerPool sharedPool];
+    request_ = [[pool searchWithExtension:source
+                                    query:[self query]
+                                operation:self] retain];
+    return;
+  }
   PyObject *instance = [source instance];
   if (instance) {
     HGSQuery *hgsQuery = [self query];
@@ -301,4 +348,11 @@ static const char *const kHGSPythonUpdateResult = "UpdateResult";
   return YES;
 }
 
+- (void)cancel {
+  [super cancel];
+  if (request_) {
+    [[HGSPythonWorkerPool sharedPool] cancelRequest:request_];
+  }
+}
+
 @end
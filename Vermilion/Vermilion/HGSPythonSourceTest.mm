@@ -33,6 +33,7 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSPythonSource.h"
+#import "HGSPythonWorkerPool.h"
 #import "HGSQuery.h"
 #import "HGSResult.h"
 #import "HGSOperation.h"
@@ -40,10 +41,19 @@
 #import "HGSType.h"
 #import "HGSTokenizer.h"
 
+static const NSUInteger kSlowSourceCount = 4;
+
 @interface HGSPythonSourceTest : GTMTestCase {
   NSArray *results_;
 }
 - (void)gotResults:(NSNotification *)note;
+- (HGSPythonSource *)sourceWithClassName:(NSString *)className
+                              identifier:(NSString *)identifier
+                          usesWorkerPool:(BOOL)usesWorkerPool;
+- (HGSQuery *)queryWithString:(NSString *)string;
+- (BOOL)waitForOperations:(NSArray *)operations
+                  timeout:(NSTimeInterval)timeout;
+- (NSTimeInterval)timeSlowSearchesUsingWorkerPool:(BOOL)usesWorkerPool;
 @end
 
 @implementation HGSPythonSourceTest
@@ -138,6 +148,183 @@
   Py_DECREF(setResults);
 }
 
+- (HGSPythonSource *)sourceWithClassName:(NSString *)className
+                              identifier:(NSString *)identifier
+                          usesWorkerPool:(BOOL)usesWorkerPool {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSDictionary *config = [NSDictionary dictionaryWithObjectsAndKeys:
+                          @"VermilionTest", kPythonModuleNameKey,
+                          className, kPythonClassNameKey,
+                          identifier, kHGSExtensionIdentifierKey,
+                          bundle, kHGSExtensionBundleKey,
+                          [NSNumber numberWithBool:usesWorkerPool],
+                          kHGSPythonUsesWorkerPoolKey,
+                          (id)nil];
+  return [[[HGSPythonSource alloc] initWithConfiguration:config] autorelease];
+}
+
+- (HGSQuery *)queryWithString:(NSString *)string {
+  return [[[HGSQuery alloc] initWithString:string
+                            actionArgument:nil
+                           actionOperation:nil
+                              pivotObjects:nil
+                                queryFlags:0] autorelease];
+}
+
+- (BOOL)waitForOperations:(NSArray *)operations
+                  timeout:(NSTimeInterval)timeout {
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  BOOL finished = NO;
+  while (!finished && [deadline timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runUntilDate:
+     [NSDate dateWithTimeIntervalSinceNow:.05]];
+    finished = YES;
+    for (HGSSearchOperation *op in operations) {
+      finished = finished && [op isFinished];
+    }
+  }
+  return finished;
+}
+
+- (NSTimeInterval)timeSlowSearchesUsingWorkerPool:(BOOL)usesWorkerPool {
+  HGSQuery *query = [self queryWithString:@"slow"];
+  NSMutableArray *ops = [NSMutableArray arrayWithCapacity:kSlowSourceCount];
+  for (NSUInteger i = 0; i < kSlowSourceCount; ++i) {
+    NSString *identifier
+      = [NSString stringWithFormat:@"python.test.slow.%d.%u",
+         usesWorkerPool, i];
+    HGSPythonSource *source
+      = [self sourceWithClassName:@"VermilionSlowTest"
+                       identifier:identifier
+                   usesWorkerPool:usesWorkerPool];
+    STAssertNotNil(source, nil);
+    HGSPythonSearchOperation *op = [[[HGSPythonSearchOperation alloc]
+                                     initWithQuery:query
+                                            source:source] autorelease];
+    [ops addObject:op];
+  }
+  NSDate *start = [NSDate date];
+  for (HGSPythonSearchOperation *op in ops) {
+    [op runOnCurrentThread:YES];
+  }
+  STAssertTrue([self waitForOperations:ops timeout:10], nil);
+  NSTimeInterval elapsed = -[start timeIntervalSinceNow];
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  for (HGSPythonSearchOperation *op in ops) {
+    STAssertEquals([op resultCountForFilter:filter], (NSUInteger)1, nil);
+  }
+  return elapsed;
+}
+
+- (void)testWorkerPoolSource {
+  HGSPythonSource *source = [self sourceWithClassName:@"VermilionTest"
+                                           identifier:@"python.test.worker"
+                                       usesWorkerPool:YES];
+  STAssertNotNil(source, nil);
+  STAssertTrue([source usesWorkerPool], nil);
+
+  HGSQuery *query = [self queryWithString:@"Hello world"];
+  STAssertTrue([source isValidSourceForQuery:query], nil);
+  HGSPythonSearchOperation *op = [[[HGSPythonSearchOperation alloc]
+                                   initWithQuery:query
+                                          source:source] autorelease];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(gotResults:)
+             name:kHGSSearchOperationDidUpdateResultsNotification
+           object:op];
+  [op runOnCurrentThread:YES];
+  NSArray *ops = [NSArray arrayWithObject:op];
+  STAssertTrue([self waitForOperations:ops timeout:5], nil);
+  STAssertFalse([op isCancelled], nil);
+
+  // Same results as the embedded interpreter gives in testSource.
+  STAssertEquals([results_ count], (NSUInteger)1, nil);
+  HGSScoredResult *result = [results_ objectAtIndex:0];
+  STAssertEqualStrings([result displayName], @"hello world Result", nil);
+  NSString *snippet = [result valueForKey:kHGSObjectAttributeSnippetKey];
+  STAssertEqualStrings(snippet, @"Localized Value in English",
+                       @"localized string failed");
+  NSDictionary *privateValues
+    = [result valueForKey:kHGSPythonPrivateValuesKey];
+  STAssertEqualObjects([privateValues objectForKey:@"CustomKey"],
+                       @"CustomValue", nil);
+
+  // Archived results are rebuilt on this side, private values and all.
+  NSDictionary *archive = [source archiveRepresentationForResult:result];
+  STAssertNotNil(archive, nil);
+  HGSResult *reanimated = [source resultWithArchivedRepresentation:archive];
+  STAssertEqualStrings([reanimated displayName], [result displayName], nil);
+  STAssertEqualStrings([reanimated uri], [result uri], nil);
+  privateValues = [reanimated valueForKey:kHGSPythonPrivateValuesKey];
+  STAssertEqualObjects([privateValues objectForKey:@"CustomKey"],
+                       @"CustomValue", nil);
+}
+
+- (void)testWorkerPoolThroughput {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  {
+    PythonStackLock stackLock;
+    [[HGSPython sharedPython] appendPythonPath:[bundle resourcePath]];
+  }
+  HGSPythonWorkerPool *pool = [HGSPythonWorkerPool sharedPool];
+  NSUInteger oldMaximum = [pool maximumWorkerCount];
+  [pool setMaximumWorkerCount:kSlowSourceCount];
+
+  // In process every search holds the interpreter lock for its whole run,
+  // so they take turns; in the pool each one gets a process.
+  NSTimeInterval inProcessTime = [self timeSlowSearchesUsingWorkerPool:NO];
+  NSTimeInterval workerTime = [self timeSlowSearchesUsingWorkerPool:YES];
+  [pool setMaximumWorkerCount:oldMaximum];
+  if ([[NSProcessInfo processInfo] activeProcessorCount] > 1) {
+    STAssertLessThan(workerTime, inProcessTime * 0.75,
+                     @"in process %.2fs", inProcessTime);
+  }
+}
+
+- (void)testWorkerPoolCancellation {
+  HGSPythonWorkerPool *pool = [HGSPythonWorkerPool sharedPool];
+  NSUInteger oldMaximum = [pool maximumWorkerCount];
+  [pool setMaximumWorkerCount:MAX(oldMaximum, 2U)];
+  HGSQuery *query = [self queryWithString:@"cancel"];
+  HGSPythonSource *cancellable
+    = [self sourceWithClassName:@"VermilionCancellableTest"
+                     identifier:@"python.test.cancellable"
+                 usesWorkerPool:YES];
+  HGSPythonSource *stuck = [self sourceWithClassName:@"VermilionStuckTest"
+                                          identifier:@"python.test.stuck"
+                                      usesWorkerPool:YES];
+  STAssertNotNil(cancellable, nil);
+  STAssertNotNil(stuck, nil);
+  HGSPythonSearchOperation *cancellableOp
+    = [[[HGSPythonSearchOperation alloc] initWithQuery:query
+                                                source:cancellable]
+       autorelease];
+  HGSPythonSearchOperation *stuckOp
+    = [[[HGSPythonSearchOperation alloc] initWithQuery:query
+                                                source:stuck] autorelease];
+  NSArray *ops = [NSArray arrayWithObjects:cancellableOp, stuckOp, nil];
+  for (HGSPythonSearchOperation *op in ops) {
+    [op runOnCurrentThread:YES];
+  }
+  STAssertFalse([self waitForOperations:ops timeout:.5], nil);
+  NSUInteger workerCount = [pool workerCount];
+  STAssertGreaterThanOrEqual(workerCount, (NSUInteger)2, nil);
+
+  // Cancelling finishes the operations straight away...
+  for (HGSPythonSearchOperation *op in ops) {
+    [op cancel];
+  }
+  STAssertTrue([self waitForOperations:ops timeout:.5], nil);
+
+  // ...and only the worker that ignored it gets killed.
+  NSTimeInterval grace = kHGSPythonWorkerCancelGracePeriod + 1;
+  [[NSRunLoop currentRunLoop] runUntilDate:
+   [NSDate dateWithTimeIntervalSinceNow:grace]];
+  STAssertEquals([pool workerCount], workerCount - 1, nil);
+  [pool setMaximumWorkerCount:oldMaximum];
+}
+
 - (void)gotResults:(NSNotification *)note {
   STAssertTrue([[note object] isKindOfClass:[HGSSearchOperation class]], nil);
   if (results_) {
@@ -0,0 +1,132 @@
+//
+//  HGSPythonWorkerPool.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*!
+ @header
+ @discussion HGSPythonWorkerPool
+*/
+
+#import <Foundation/Foundation.h>
+
+@class HGSExtension;
+@class HGSQuery;
+@class HGSSimpleArraySearchOperation;
+@class HGSPythonWorkerRequest;
+
+/*!
+  Configuration key (NSNumber BOOL) for Python sources and actions. When YES
+  the extension runs in the worker pool instead of the embedded interpreter.
+  Actions in the pool answer AppliesToResults once per set of result types;
+  until a worker has answered, the action doesn't apply on the main thread.
+*/
+extern NSString *const kHGSPythonUsesWorkerPoolKey;
+
+/*!
+  Runs Python plugins in a handful of long lived helper processes
+  (VermilionWorker.py) so that a slow plugin neither holds the embedded
+  interpreter's lock nor serializes the other Python plugins.
+
+  Each request goes to an idle worker; when all workers are busy it waits
+  for the next one to come free. A worker loads a plugin the first time it
+  gets a request for it. Search results come back a batch at a time (one
+  batch per Query.SetResults call) and are converted without touching the
+  embedded interpreter.
+
+  Cancelling a search tells the worker (Query.IsCancelled() turns true) and
+  finishes the search operation straight away. A worker that is still busy
+  with a cancelled request after kHGSPythonWorkerCancelGracePeriod is
+  killed and replaced.
+
+  Messages are frames of a 4 byte big endian length followed by one value
+  in a small tagged binary encoding; see VermilionWorker.py.
+*/
+@interface HGSPythonWorkerPool : NSObject {
+ @private
+  NSMutableArray *workers_;
+  NSMutableArray *pendingRequests_;
+  NSMutableDictionary *plugins_;
+  NSUInteger maximumWorkerCount_;
+  UInt32 nextRequestID_;
+}
+
++ (HGSPythonWorkerPool *)sharedPool;
+
+/*!
+  The most helper processes that will run at once. Defaults to the number
+  of processors, capped at 4.
+*/
+- (NSUInteger)maximumWorkerCount;
+- (void)setMaximumWorkerCount:(NSUInteger)count;
+
+/*! Number of helper processes currently running. */
+- (NSUInteger)workerCount;
+
+/*!
+  Makes |extension| available to workers. |moduleName| and |className| are
+  as for the in process HGSPythonSource and HGSPythonAction. The extension
+  is not retained; call unregisterExtension: before it goes away.
+*/
+- (void)registerExtension:(HGSExtension *)extension
+               moduleName:(NSString *)moduleName
+                className:(NSString *)className;
+- (void)unregisterExtension:(HGSExtension *)extension;
+
+/*!
+  Starts running |query| against the search source |extension| in a worker.
+  Results are delivered to |operation| with setRankedResults: and
+  finishQuery is called on the main thread when the plugin calls Finish().
+  Returns a request to pass to cancelRequest:.
+*/
+- (HGSPythonWorkerRequest *)
+    searchWithExtension:(HGSExtension *)extension
+                  query:(HGSQuery *)query
+              operation:(HGSSimpleArraySearchOperation *)operation;
+
+/*!
+  Calls |method| on |extension|'s plugin instance in a worker with
+  |arguments| (Foundation property list types; HGSResults are sent as
+  dictionaries) and waits up to |timeout| seconds for the value it returns.
+  Returns nil on error or timeout, and NSNull if the method returned None.
+  Must not be called on the main thread with a long timeout.
+*/
+- (id)callMethod:(NSString *)method
+     ofExtension:(HGSExtension *)extension
+       arguments:(NSArray *)arguments
+         timeout:(NSTimeInterval)timeout;
+
+/*! Stops |request| as described above. Safe to call more than once. */
+- (void)cancelRequest:(HGSPythonWorkerRequest *)request;
+
+@end
+
+/*! Seconds a cancelled request may keep a worker busy before it is killed. */
+extern const NSTimeInterval kHGSPythonWorkerCancelGracePeriod;
@@ -0,0 +1,1023 @@
+//
+//  HGSPythonWorkerPool.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSPythonWorkerPool.h"
+#import <signal.h>
+#import <unistd.h>
+#import <libkern/OSByteOrder.h>
+#import "HGSBundle.h"
+#import "HGSExtension.h"
+#import "HGSLog.h"
+#import "HGSPython.h"
+#import "HGSQuery.h"
+#import "HGSResult.h"
+#import "HGSSearchSource.h"
+#import "HGSSimpleArraySearchOperation.h"
+#import "HGSTokenizer.h"
+#import "HGSUserMessage.h"
+
+NSString *const kHGSPythonUsesWorkerPoolKey = @"HGSPythonUsesWorkerPool";
+const NSTimeInterval kHGSPythonWorkerCancelGracePeriod = 1.0;
+
+static NSString *const kHGSPythonWorkerScriptName = @"VermilionWorker";
+static NSString *const kHGSPythonWorkerInterpreterPath = @"/usr/bin/python";
+
+// Anything longer than this means the stream is out of sync.
+static const UInt32 kHGSPythonWorkerMaxFrameLength = 64 * 1024 * 1024;
+
+// Message kinds. Keep in sync with VermilionWorker.py.
+static NSString *const kHGSPythonWorkerInitMessage = @"init";
+static NSString *const kHGSPythonWorkerLoadMessage = @"load";
+static NSString *const kHGSPythonWorkerSearchMessage = @"search";
+static NSString *const kHGSPythonWorkerCancelMessage = @"cancel";
+static NSString *const kHGSPythonWorkerCallMessage = @"call";
+static NSString *const kHGSPythonWorkerResultsMessage = @"results";
+static NSString *const kHGSPythonWorkerFinishMessage = @"finish";
+static NSString *const kHGSPythonWorkerReturnMessage = @"return";
+static NSString *const kHGSPythonWorkerErrorMessage = @"error";
+static NSString *const kHGSPythonWorkerNotifyMessage = @"notify";
+
+// Keys in the plugins_ dictionary entries.
+static NSString *const kHGSPythonWorkerPluginLoadMessageKey = @"load";
+static NSString *const kHGSPythonWorkerPluginExtensionKey = @"extension";
+static NSString *const kHGSPythonWorkerPluginCountKey = @"count";
+
+#pragma mark Encoding
+
+static void HGSPythonWorkerAppendUInt32(NSMutableData *data, UInt32 value) {
+  UInt32 bigEndian = OSSwapHostToBigInt32(value);
+  [data appendBytes:&bigEndian length:sizeof(bigEndian)];
+}
+
+static void HGSPythonWorkerAppendUInt64(NSMutableData *data, UInt64 value) {
+  UInt64 bigEndian = OSSwapHostToBigInt64(value);
+  [data appendBytes:&bigEndian length:sizeof(bigEndian)];
+}
+
+static void HGSPythonWorkerAppendTag(NSMutableData *data, char tag) {
+  [data appendBytes:&tag length:1];
+}
+
+static void HGSPythonWorkerEncode(id value, NSMutableData *data) {
+  if ([value isKindOfClass:[NSURL class]]) {
+    value = [value absoluteString];
+  }
+  if (!value || value == [NSNull null]) {
+    HGSPythonWorkerAppendTag(data, 'N');
+  } else if ([value isKindOfClass:[NSString class]]) {
+    NSData *utf8 = [value dataUsingEncoding:NSUTF8StringEncoding];
+    HGSPythonWorkerAppendTag(data, 's');
+    HGSPythonWorkerAppendUInt32(data, (UInt32)[utf8 length]);
+    [data appendData:utf8];
+  } else if ([value isKindOfClass:[NSNumber class]]) {
+    const char *type = [value objCType];
+    if (CFGetTypeID((CFTypeRef)value) == CFBooleanGetTypeID()) {
+      HGSPythonWorkerAppendTag(data, [value boolValue] ? 'T' : 'F');
+    } else if (type[0] == 'f' || type[0] == 'd') {
+      double doubleValue = [value doubleValue];
+      UInt64 bits;
+      memcpy(&bits, &doubleValue, sizeof(bits));
+      HGSPythonWorkerAppendTag(data, 'f');
+      HGSPythonWorkerAppendUInt64(data, bits);
+    } else {
+      HGSPythonWorkerAppendTag(data, 'i');
+      HGSPythonWorkerAppendUInt64(data, (UInt64)[value longLongValue]);
+    }
+  } else if ([value isKindOfClass:[NSArray class]]) {
+    HGSPythonWorkerAppendTag(data, 'l');
+    HGSPythonWorkerAppendUInt32(data, (UInt32)[value count]);
+    for (id item in value) {
+      HGSPythonWorkerEncode(item, data);
+    }
+  } else if ([value isKindOfClass:[NSDictionary class]]) {
+    HGSPythonWorkerAppendTag(data, 'd');
+    HGSPythonWorkerAppendUInt32(data, (UInt32)[value count]);
+    for (id key in value) {
+      HGSPythonWorkerEncode([key description], data);
+      HGSPythonWorkerEncode([value objectForKey:key], data);
+    }
+  } else {
+    HGSLogDebug(@"Can't send %@ (%@) to a Python worker", value,
+                [value class]);
+    HGSPythonWorkerAppendTag(data, 'N');
+  }
+}
+
+static BOOL HGSPythonWorkerReadUInt32(const UInt8 **bytes, const UInt8 *end,
+                                      UInt32 *value) {
+  if (end - *bytes < (ptrdiff_t)sizeof(UInt32)) return NO;
+  UInt32 bigEndian;
+  memcpy(&bigEndian, *bytes, sizeof(bigEndian));
+  *bytes += sizeof(bigEndian);
+  *value = OSSwapBigToHostInt32(bigEndian);
+  return YES;
+}
+
+static BOOL HGSPythonWorkerReadUInt64(const UInt8 **bytes, const UInt8 *end,
+                                      UInt64 *value) {
+  if (end - *bytes < (ptrdiff_t)sizeof(UInt64)) return NO;
+  UInt64 bigEndian;
+  memcpy(&bigEndian, *bytes, sizeof(bigEndian));
+  *bytes += sizeof(bigEndian);
+  *value = OSSwapBigToHostInt64(bigEndian);
+  return YES;
+}
+
+// Returns nil if the data is malformed. None comes back as NSNull.
+static id HGSPythonWorkerDecode(const UInt8 **bytes, const UInt8 *end) {
+  if (*bytes >= end) return nil;
+  UInt8 tag = **bytes;
+  *bytes += 1;
+  id value = nil;
+  UInt32 count = 0;
+  UInt64 bits = 0;
+  switch (tag) {
+    case 'N':
+      value = [NSNull null];
+      break;
+    case 'T':
+    case 'F':
+      value = [NSNumber numberWithBool:tag == 'T'];
+      break;
+    case 'i':
+      if (HGSPythonWorkerReadUInt64(bytes, end, &bits)) {
+        value = [NSNumber numberWithLongLong:(long long)bits];
+      }
+      break;
+    case 'f':
+      if (HGSPythonWorkerReadUInt64(bytes, end, &bits)) {
+        double doubleValue;
+        memcpy(&doubleValue, &bits, sizeof(doubleValue));
+        value = [NSNumber numberWithDouble:doubleValue];
+      }
+      break;
+    case 's':
+      if (HGSPythonWorkerReadUInt32(bytes, end, &count)
+          && end - *bytes >= (ptrdiff_t)count) {
+        value = [[[NSString alloc] initWithBytes:*bytes
+                                          length:count
+                                        encoding:NSUTF8StringEncoding]
+                 autorelease];
+        *bytes += count;
+      }
+      break;
+    case 'l':
+      if (HGSPythonWorkerReadUInt32(bytes, end, &count)) {
+        // Every item takes at least a byte, so don't trust a count that
+        // couldn't possibly fit.
+        NSUInteger capacity = MIN(count, (NSUInteger)(end - *bytes));
+        NSMutableArray *array = [NSMutableArray arrayWithCapacity:capacity];
+        for (UInt32 i = 0; i < count; ++i) {
+          id item = HGSPythonWorkerDecode(bytes, end);
+          if (!item) {
+            array = nil;
+            break;
+          }
+          [array addObject:item];
+        }
+        value = array;
+      }
+      break;
+    case 'd':
+      if (HGSPythonWorkerReadUInt32(bytes, end, &count)) {
+        NSUInteger capacity = MIN(count, (NSUInteger)(end - *bytes) / 2);
+        NSMutableDictionary *dict
+          = [NSMutableDictionary dictionaryWithCapacity:capacity];
+        for (UInt32 i = 0; i < count; ++i) {
+          id key = HGSPythonWorkerDecode(bytes, end);
+          id item = [key isKindOfClass:[NSString class]]
+            ? HGSPythonWorkerDecode(bytes, end) : nil;
+          if (!item) {
+            dict = nil;
+            break;
+          }
+          [dict setObject:item forKey:key];
+        }
+        value = dict;
+      }
+      break;
+    default:
+      break;
+  }
+  return value;
+}
+
+static BOOL HGSPythonWorkerReadFully(int fd, void *buffer, size_t length) {
+  UInt8 *bytes = buffer;
+  while (length) {
+    ssize_t count = read(fd, bytes, length);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) return NO;
+    bytes += count;
+    length -= count;
+  }
+  return YES;
+}
+
+static BOOL HGSPythonWorkerWriteFully(int fd, const void *buffer,
+                                      size_t length) {
+  const UInt8 *bytes = buffer;
+  while (length) {
+    ssize_t count = write(fd, bytes, length);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) return NO;
+    bytes += count;
+    length -= count;
+  }
+  return YES;
+}
+
+#pragma mark HGSPythonWorkerRequest
+
+typedef enum {
+  kHGSPythonWorkerSearchRequest,
+  kHGSPythonWorkerCallRequest
+} HGSPythonWorkerRequestKind;
+
+@interface HGSPythonWorkerRequest : NSObject {
+ @private
+  HGSPythonWorkerRequestKind kind_;
+  UInt32 identifier_;
+  NSString *pluginID_;
+  NSArray *arguments_;
+  HGSSimpleArraySearchOperation *operation_;
+  HGSTokenizedString *tokenizedQuery_;
+  NSCondition *condition_;
+  id returnValue_;
+  BOOL done_;
+  BOOL cancelled_;
+  NSDate *cancelDeadline_;
+}
+- (id)initWithKind:(HGSPythonWorkerRequestKind)kind
+          pluginID:(NSString *)pluginID
+         arguments:(NSArray *)arguments;
+- (HGSPythonWorkerRequestKind)kind;
+- (UInt32)identifier;
+- (void)setIdentifier:(UInt32)identifier;
+- (NSString *)pluginID;
+- (NSArray *)message;
+- (void)setOperation:(HGSSimpleArraySearchOperation *)operation
+      tokenizedQuery:(HGSTokenizedString *)tokenizedQuery;
+- (void)deliverResults:(NSArray *)batch;
+// Marks the request done: finishes the search operation or wakes up the
+// caller. Only the first call has any effect.
+- (void)completeWithValue:(id)value;
+- (BOOL)isDone;
+- (id)waitForValueUntilDate:(NSDate *)date;
+- (BOOL)isCancelled;
+- (void)setCancelled;
+- (NSDate *)cancelDeadline;
+@end
+
+@implementation HGSPythonWorkerRequest
+
+- (id)initWithKind:(HGSPythonWorkerRequestKind)kind
+          pluginID:(NSString *)pluginID
+         arguments:(NSArray *)arguments {
+  if ((self = [super init])) {
+    kind_ = kind;
+    pluginID_ = [pluginID copy];
+    arguments_ = [arguments retain];
+    condition_ = [[NSCondition alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [pluginID_ release];
+  [arguments_ release];
+  [operation_ release];
+  [tokenizedQuery_ release];
+  [condition_ release];
+  [returnValue_ release];
+  [cancelDeadline_ release];
+  [super dealloc];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p> %u %@ %@",
+          [self class], self, identifier_, pluginID_, arguments_];
+}
+
+- (HGSPythonWorkerRequestKind)kind {
+  return kind_;
+}
+
+- (UInt32)identifier {
+  return identifier_;
+}
+
+- (void)setIdentifier:(UInt32)identifier {
+  identifier_ = identifier;
+}
+
+- (NSString *)pluginID {
+  return pluginID_;
+}
+
+- (NSArray *)message {
+  NSString *kind = (kind_ == kHGSPythonWorkerSearchRequest)
+    ? kHGSPythonWorkerSearchMessage : kHGSPythonWorkerCallMessage;
+  NSArray *message
+    = [NSArray arrayWithObjects:kind,
+       [NSNumber numberWithUnsignedInt:identifier_], pluginID_, nil];
+  return [message arrayByAddingObjectsFromArray:arguments_];
+}
+
+- (void)setOperation:(HGSSimpleArraySearchOperation *)operation
+      tokenizedQuery:(HGSTokenizedString *)tokenizedQuery {
+  [operation_ autorelease];
+  operation_ = [operation retain];
+  [tokenizedQuery_ autorelease];
+  tokenizedQuery_ = [tokenizedQuery retain];
+}
+
+- (void)deliverResults:(NSArray *)batch {
+  if (![batch isKindOfClass:[NSArray class]]) return;
+  HGSSearchSource *source = (HGSSearchSource *)[operation_ source];
+  NSArray *results = [HGSPython resultsFromDictionaries:batch
+                                         tokenizedQuery:tokenizedQuery_
+                                                 source:source];
+  [operation_ setRankedResults:results];
+}
+
+- (void)completeWithValue:(id)value {
+  [condition_ lock];
+  BOOL wasDone = done_;
+  if (!done_) {
+    done_ = YES;
+    returnValue_ = [value retain];
+    [condition_ broadcast];
+  }
+  [condition_ unlock];
+  if (!wasDone && operation_) {
+    // Same as Query.Finish() in the embedded interpreter.
+    [operation_ performSelectorOnMainThread:@selector(finishQuery)
+                                 withObject:nil
+                              waitUntilDone:NO];
+  }
+}
+
+- (BOOL)isDone {
+  [condition_ lock];
+  BOOL done = done_;
+  [condition_ unlock];
+  return done;
+}
+
+- (id)waitForValueUntilDate:(NSDate *)date {
+  [condition_ lock];
+  BOOL waiting = YES;
+  while (!done_ && waiting) {
+    waiting = [condition_ waitUntilDate:date];
+  }
+  id value = [[returnValue_ retain] autorelease];
+  [condition_ unlock];
+  return value;
+}
+
+// The pool's lock guards these.
+- (BOOL)isCancelled {
+  return cancelled_;
+}
+
+- (void)setCancelled {
+  cancelled_ = YES;
+  [cancelDeadline_ release];
+  cancelDeadline_
+    = [[NSDate alloc]
+       initWithTimeIntervalSinceNow:kHGSPythonWorkerCancelGracePeriod];
+}
+
+- (NSDate *)cancelDeadline {
+  return cancelDeadline_;
+}
+
+@end
+
+#pragma mark HGSPythonWorker
+
+@interface HGSPythonWorker : NSObject {
+ @private
+  HGSPythonWorkerPool *pool_;  // weak, pools live forever
+  NSTask *task_;
+  NSPipe *toWorker_;
+  NSPipe *fromWorker_;
+  NSLock *writeLock_;
+  NSMutableSet *loadedPlugins_;
+  HGSPythonWorkerRequest *request_;
+}
+- (id)initWithPool:(HGSPythonWorkerPool *)pool;
+- (BOOL)sendMessage:(NSArray *)message;
+- (void)kill;
+// The pool's lock guards these.
+- (HGSPythonWorkerRequest *)request;
+- (void)setRequest:(HGSPythonWorkerRequest *)request;
+- (BOOL)noteLoadingPlugin:(NSString *)pluginID;
+@end
+
+@interface HGSPythonWorkerPool ()
+- (void)submitRequest:(HGSPythonWorkerRequest *)request;
+- (void)startRequest:(HGSPythonWorkerRequest *)request
+            onWorker:(HGSPythonWorker *)worker;
+- (void)finishRequest:(HGSPythonWorkerRequest *)request
+             onWorker:(HGSPythonWorker *)worker
+            withValue:(id)value;
+- (HGSPythonWorker *)launchWorker;
+- (void)displayNotification:(NSArray *)message;
+- (void)worker:(HGSPythonWorker *)worker didReceiveMessage:(NSArray *)message;
+- (void)workerDidExit:(HGSPythonWorker *)worker;
+- (void)scheduleReap;
+- (void)reapStuckWorkers;
+@end
+
+@implementation HGSPythonWorker
+
+- (id)initWithPool:(HGSPythonWorkerPool *)pool {
+  if ((self = [super init])) {
+    pool_ = pool;
+    NSBundle *bundle = HGSGetPluginBundle();
+    NSString *script = [bundle pathForResource:kHGSPythonWorkerScriptName
+                                        ofType:@"py"];
+    if (!script) {
+      HGSLog(@"Unable to find %@.py", kHGSPythonWorkerScriptName);
+      [self release];
+      return nil;
+    }
+    // Same search path and interpreter version as the embedded interpreter
+    // (see -[HGSPython init]).
+    NSDictionary *processEnvironment
+      = [[NSProcessInfo processInfo] environment];
+    NSMutableDictionary *environment
+      = [NSMutableDictionary dictionaryWithDictionary:processEnvironment];
+    NSString *resourcePath = [bundle resourcePath];
+    NSString *pythonPath = [environment objectForKey:@"PYTHONPATH"];
+    if (pythonPath) {
+      pythonPath = [pythonPath stringByAppendingFormat:@":%@", resourcePath];
+    } else {
+      pythonPath = resourcePath;
+    }
+    [environment setObject:pythonPath forKey:@"PYTHONPATH"];
+    [environment setObject:@"2.5" forKey:@"VERSIONER_PYTHON_VERSION"];
+
+    writeLock_ = [[NSLock alloc] init];
+    loadedPlugins_ = [[NSMutableSet alloc] init];
+    toWorker_ = [[NSPipe alloc] init];
+    fromWorker_ = [[NSPipe alloc] init];
+    task_ = [[NSTask alloc] init];
+    [task_ setLaunchPath:kHGSPythonWorkerInterpreterPath];
+    [task_ setArguments:[NSArray arrayWithObjects:@"-u", script, nil]];
+    [task_ setEnvironment:environment];
+    [task_ setStandardInput:toWorker_];
+    [task_ setStandardOutput:fromWorker_];
+    @try {
+      [task_ launch];
+    }
+    @catch (NSException *e) {
+      HGSLog(@"Unable to launch Python worker: %@", e);
+      [self release];
+      return nil;
+    }
+    // The thread retains us until the worker goes away.
+    [NSThread detachNewThreadSelector:@selector(readMessages:)
+                             toTarget:self
+                           withObject:nil];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [task_ release];
+  [toWorker_ release];
+  [fromWorker_ release];
+  [writeLock_ release];
+  [loadedPlugins_ release];
+  [request_ release];
+  [super dealloc];
+}
+
+- (NSString *)description {
+  return [NSString stringWithFormat:@"<%@: %p> pid %d",
+          [self class], self, [task_ processIdentifier]];
+}
+
+- (void)readMessages:(id)ignored {
+  NSAutoreleasePool *outerPool = [[NSAutoreleasePool alloc] init];
+  int fd = [[fromWorker_ fileHandleForReading] fileDescriptor];
+  NSMutableData *frame = [NSMutableData data];
+  BOOL reading = YES;
+  while (reading) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    UInt32 length = 0;
+    reading = HGSPythonWorkerReadFully(fd, &length, sizeof(length));
+    if (reading) {
+      length = OSSwapBigToHostInt32(length);
+      [frame setLength:length];
+      reading = (length <= kHGSPythonWorkerMaxFrameLength
+                 && HGSPythonWorkerReadFully(fd, [frame mutableBytes],
+                                             length));
+      if (reading) {
+        const UInt8 *bytes = [frame bytes];
+        id message = HGSPythonWorkerDecode(&bytes, bytes + length);
+        if ([message isKindOfClass:[NSArray class]] && [message count] >= 2) {
+          [pool_ worker:self didReceiveMessage:message];
+        } else {
+          HGSLog(@"Malformed message from Python worker %@", self);
+          reading = NO;
+        }
+      }
+    }
+    [pool release];
+  }
+  [self kill];
+  [pool_ workerDidExit:self];
+  [outerPool release];
+}
+
+- (BOOL)sendMessage:(NSArray *)message {
+  NSMutableData *frame = [NSMutableData dataWithLength:sizeof(UInt32)];
+  HGSPythonWorkerEncode(message, frame);
+  UInt32 length
+    = OSSwapHostToBigInt32((UInt32)([frame length] - sizeof(UInt32)));
+  [frame replaceBytesInRange:NSMakeRange(0, sizeof(length))
+                   withBytes:&length];
+  int fd = [[toWorker_ fileHandleForWriting] fileDescriptor];
+  [writeLock_ lock];
+  BOOL sent = HGSPythonWorkerWriteFully(fd, [frame bytes], [frame length]);
+  [writeLock_ unlock];
+  if (!sent) {
+    HGSLogDebug(@"Unable to write to Python worker %@ (%d)", self, errno);
+  }
+  return sent;
+}
+
+- (void)kill {
+  if ([task_ isRunning]) {
+    // SIGKILL rather than -[NSTask terminate]; a plugin stuck in C code
+    // won't get around to running Python's signal handlers.
+    kill([task_ processIdentifier], SIGKILL);
+  }
+}
+
+- (HGSPythonWorkerRequest *)request {
+  return request_;
+}
+
+- (void)setRequest:(HGSPythonWorkerRequest *)request {
+  [request_ autorelease];
+  request_ = [request retain];
+}
+
+- (BOOL)noteLoadingPlugin:(NSString *)pluginID {
+  BOOL isNew = ![loadedPlugins_ containsObject:pluginID];
+  if (isNew) {
+    [loadedPlugins_ addObject:pluginID];
+  }
+  return isNew;
+}
+
+@end
+
+#pragma mark HGSPythonWorkerPool
+
+@implementation HGSPythonWorkerPool
+
++ (HGSPythonWorkerPool *)sharedPool {
+  static HGSPythonWorkerPool *sSharedPool = nil;
+  @synchronized(self) {
+    if (!sSharedPool) {
+      sSharedPool = [[self alloc] init];
+    }
+  }
+  return sSharedPool;
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    workers_ = [[NSMutableArray alloc] init];
+    pendingRequests_ = [[NSMutableArray alloc] init];
+    plugins_ = [[NSMutableDictionary alloc] init];
+    NSUInteger processors
+      = [[NSProcessInfo processInfo] activeProcessorCount];
+    maximumWorkerCount_ = MAX(MIN(processors, 4U), 1U);
+    // A worker that dies while we're writing to it has to show up as a
+    // failed write rather than taking us down with it.
+    signal(SIGPIPE, SIG_IGN);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (HGSPythonWorker *worker in workers_) {
+    [worker kill];
+  }
+  [workers_ release];
+  [pendingRequests_ release];
+  [plugins_ release];
+  [super dealloc];
+}
+
+- (NSUInteger)maximumWorkerCount {
+  @synchronized(self) {
+    return maximumWorkerCount_;
+  }
+  return 0;
+}
+
+- (void)setMaximumWorkerCount:(NSUInteger)count {
+  @synchronized(self) {
+    // Lowering the count doesn't stop workers that are already running.
+    maximumWorkerCount_ = MAX(count, 1U);
+  }
+}
+
+- (NSUInteger)workerCount {
+  @synchronized(self) {
+    return [workers_ count];
+  }
+  return 0;
+}
+
+- (void)registerExtension:(HGSExtension *)extension
+               moduleName:(NSString *)moduleName
+                className:(NSString *)className {
+  NSString *pluginID = [extension identifier];
+  NSBundle *bundle = [extension bundle];
+  NSString *resourcePath = [bundle resourcePath];
+  // Workers can't call back in to look up localized strings, so they get
+  // the plugin's whole table up front.
+  NSString *stringsPath = [bundle pathForResource:@"Localizable"
+                                           ofType:@"strings"];
+  NSDictionary *strings = nil;
+  if (stringsPath) {
+    strings = [NSDictionary dictionaryWithContentsOfFile:stringsPath];
+  }
+  NSArray *loadMessage
+    = [NSArray arrayWithObjects:kHGSPythonWorkerLoadMessage,
+       pluginID, moduleName, className,
+       resourcePath ? (id)resourcePath : [NSNull null],
+       strings ? (id)strings : [NSDictionary dictionary],
+       nil];
+  @synchronized(self) {
+    NSDictionary *plugin = [plugins_ objectForKey:pluginID];
+    NSUInteger count
+      = [[plugin objectForKey:kHGSPythonWorkerPluginCountKey] unsignedIntValue];
+    plugin = [NSDictionary dictionaryWithObjectsAndKeys:
+              loadMessage, kHGSPythonWorkerPluginLoadMessageKey,
+              [NSValue valueWithNonretainedObject:extension],
+              kHGSPythonWorkerPluginExtensionKey,
+              [NSNumber numberWithUnsignedInt:count + 1],
+              kHGSPythonWorkerPluginCountKey,
+              nil];
+    [plugins_ setObject:plugin forKey:pluginID];
+  }
+}
+
+- (void)unregisterExtension:(HGSExtension *)extension {
+  NSString *pluginID = [extension identifier];
+  @synchronized(self) {
+    NSDictionary *plugin = [plugins_ objectForKey:pluginID];
+    NSUInteger count
+      = [[plugin objectForKey:kHGSPythonWorkerPluginCountKey] unsignedIntValue];
+    if (count > 1) {
+      NSMutableDictionary *newPlugin
+        = [NSMutableDictionary dictionaryWithDictionary:plugin];
+      [newPlugin setObject:[NSNumber numberWithUnsignedInt:count - 1]
+                    forKey:kHGSPythonWorkerPluginCountKey];
+      [plugins_ setObject:newPlugin forKey:pluginID];
+    } else {
+      [plugins_ removeObjectForKey:pluginID];
+    }
+  }
+}
+
+- (HGSPythonWorkerRequest *)
+    searchWithExtension:(HGSExtension *)extension
+                  query:(HGSQuery *)query
+              operation:(HGSSimpleArraySearchOperation *)operation {
+  HGSTokenizedString *tokenizedQuery = [query tokenizedQueryString];
+  // Same strings as -[HGSPython objectForQuery:withSearchOperation:].
+  NSString *separator = [HGSTokenizer tokenizerSeparatorString];
+  NSString *normalized
+    = [[tokenizedQuery tokenizedString]
+       stringByReplacingOccurrencesOfString:separator withString:@" "];
+  NSString *raw = [tokenizedQuery originalString];
+  HGSResult *pivotObject = [query pivotObject];
+  id pivot = [NSNull null];
+  if (pivotObject) {
+    pivot = [HGSPython dictionaryForResult:pivotObject];
+  }
+  NSArray *arguments
+    = [NSArray arrayWithObjects:normalized ? normalized : @"",
+       raw ? raw : @"", pivot, nil];
+  HGSPythonWorkerRequest *request
+    = [[[HGSPythonWorkerRequest alloc]
+        initWithKind:kHGSPythonWorkerSearchRequest
+            pluginID:[extension identifier]
+           arguments:arguments] autorelease];
+  [request setOperation:operation tokenizedQuery:tokenizedQuery];
+  [self submitRequest:request];
+  return request;
+}
+
+- (id)callMethod:(NSString *)method
+     ofExtension:(HGSExtension *)extension
+       arguments:(NSArray *)arguments
+         timeout:(NSTimeInterval)timeout {
+  NSArray *callArguments
+    = [NSArray arrayWithObjects:method,
+       arguments ? arguments : [NSArray array], nil];
+  HGSPythonWorkerRequest *request
+    = [[[HGSPythonWorkerRequest alloc]
+        initWithKind:kHGSPythonWorkerCallRequest
+            pluginID:[extension identifier]
+           arguments:callArguments] autorelease];
+  [self submitRequest:request];
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  id value = [request waitForValueUntilDate:deadline];
+  if (![request isDone]) {
+    HGSLog(@"%@ of %@ timed out after %.1fs", method, [extension identifier],
+           timeout);
+    [self cancelRequest:request];
+  }
+  return value;
+}
+
+- (void)cancelRequest:(HGSPythonWorkerRequest *)request {
+  HGSPythonWorker *worker = nil;
+  @synchronized(self) {
+    if ([request isCancelled] || [request isDone]) return;
+    [request setCancelled];
+    if ([pendingRequests_ containsObject:request]) {
+      [pendingRequests_ removeObject:request];
+    } else {
+      for (HGSPythonWorker *candidate in workers_) {
+        if ([candidate request] == request) {
+          worker = [[candidate retain] autorelease];
+          break;
+        }
+      }
+    }
+  }
+  if (worker) {
+    // The worker stays busy until the plugin notices (or it gets killed),
+    // but nobody has to wait for that.
+    NSNumber *requestID = [NSNumber numberWithUnsignedInt:[request identifier]];
+    NSArray *message
+      = [NSArray arrayWithObjects:kHGSPythonWorkerCancelMessage,
+         requestID, nil];
+    [worker sendMessage:message];
+    [self performSelectorOnMainThread:@selector(scheduleReap)
+                           withObject:nil
+                        waitUntilDone:NO];
+  }
+  [request completeWithValue:nil];
+}
+
+#pragma mark Dispatch
+
+// Must be called with the lock held.
+- (HGSPythonWorker *)idleWorker {
+  for (HGSPythonWorker *worker in workers_) {
+    if (![worker request]) {
+      return worker;
+    }
+  }
+  HGSPythonWorker *worker = nil;
+  if ([workers_ count] < maximumWorkerCount_) {
+    worker = [self launchWorker];
+  }
+  return worker;
+}
+
+// Must be called with the lock held.
+- (HGSPythonWorker *)launchWorker {
+  HGSPythonWorker *worker
+    = [[[HGSPythonWorker alloc] initWithPool:self] autorelease];
+  if (worker) {
+    NSDictionary *constants = [NSDictionary dictionaryWithObjectsAndKeys:
+                               kHGSObjectAttributeURIKey, @"IDENTIFIER",
+                               kHGSObjectAttributeNameKey, @"DISPLAY_NAME",
+                               kHGSObjectAttributeSnippetKey, @"SNIPPET",
+                               kHGSObjectAttributeIconPreviewFileKey,
+                               @"IMAGE",
+                               kHGSObjectAttributeDefaultActionKey,
+                               @"DEFAULT_ACTION",
+                               kHGSObjectAttributeTypeKey, @"TYPE",
+                               kHGSPythonResultMainItemStringKey,
+                               @"MAIN_ITEM",
+                               kHGSPythonResultOtherItemsStringKey,
+                               @"OTHER_ITEMS",
+                               nil];
+    NSArray *message
+      = [NSArray arrayWithObjects:kHGSPythonWorkerInitMessage,
+         [NSNumber numberWithInt:0], constants, nil];
+    if ([worker sendMessage:message]) {
+      [workers_ addObject:worker];
+    } else {
+      [worker kill];
+      worker = nil;
+    }
+  }
+  return worker;
+}
+
+- (void)submitRequest:(HGSPythonWorkerRequest *)request {
+  HGSPythonWorker *worker = nil;
+  BOOL failed = NO;
+  @synchronized(self) {
+    [request setIdentifier:++nextRequestID_];
+    worker = [[[self idleWorker] retain] autorelease];
+    if (worker) {
+      [worker setRequest:request];
+    } else if ([workers_ count]) {
+      [pendingRequests_ addObject:request];
+    } else {
+      failed = YES;
+    }
+  }
+  if (worker) {
+    [self startRequest:request onWorker:worker];
+  } else if (failed) {
+    HGSLog(@"No Python workers available for %@", request);
+    [request completeWithValue:nil];
+  }
+}
+
+- (void)startRequest:(HGSPythonWorkerRequest *)request
+            onWorker:(HGSPythonWorker *)worker {
+  NSArray *loadMessage = nil;
+  BOOL registered = NO;
+  @synchronized(self) {
+    NSString *pluginID = [request pluginID];
+    NSDictionary *plugin = [plugins_ objectForKey:pluginID];
+    registered = plugin != nil;
+    if (registered && [worker noteLoadingPlugin:pluginID]) {
+      loadMessage = [plugin objectForKey:kHGSPythonWorkerPluginLoadMessageKey];
+    }
+  }
+  if (!registered) {
+    HGSLogDebug(@"%@ isn't registered with the Python worker pool", request);
+    [self finishRequest:request onWorker:worker withValue:nil];
+  } else if ((loadMessage && ![worker sendMessage:loadMessage])
+             || ![worker sendMessage:[request message]]) {
+    // Killing it fails the request and restarts anything pending once its
+    // reader thread sees the pipe close.
+    [worker kill];
+  }
+}
+
+- (void)finishRequest:(HGSPythonWorkerRequest *)request
+             onWorker:(HGSPythonWorker *)worker
+            withValue:(id)value {
+  HGSPythonWorkerRequest *next = nil;
+  @synchronized(self) {
+    if ([worker request] == request) {
+      if ([pendingRequests_ count]) {
+        next = [pendingRequests_ objectAtIndex:0];
+      }
+      [worker setRequest:next];
+      if (next) {
+        [pendingRequests_ removeObjectAtIndex:0];
+      }
+    }
+  }
+  [request completeWithValue:value];
+  if (next) {
+    [self startRequest:next onWorker:worker];
+  }
+}
+
+- (void)worker:(HGSPythonWorker *)worker didReceiveMessage:(NSArray *)message {
+  NSString *kind = [message objectAtIndex:0];
+  if ([kind isEqual:kHGSPythonWorkerNotifyMessage]) {
+    [self displayNotification:message];
+    return;
+  }
+  HGSPythonWorkerRequest *request = nil;
+  BOOL cancelled = NO;
+  @synchronized(self) {
+    request = [[[worker request] retain] autorelease];
+    cancelled = [request isCancelled];
+  }
+  UInt32 requestID = [[message objectAtIndex:1] unsignedIntValue];
+  if ([request identifier] != requestID) return;
+  id value = [message count] > 2 ? [message objectAtIndex:2] : nil;
+  if ([kind isEqual:kHGSPythonWorkerResultsMessage]) {
+    if (!cancelled) {
+      [request deliverResults:value];
+    }
+  } else if ([kind isEqual:kHGSPythonWorkerFinishMessage]
+             || [kind isEqual:kHGSPythonWorkerReturnMessage]) {
+    [self finishRequest:request onWorker:worker withValue:value];
+  } else if ([kind isEqual:kHGSPythonWorkerErrorMessage]) {
+    HGSLog(@"Python worker error for %@:\n%@", request, value);
+    [self finishRequest:request onWorker:worker withValue:nil];
+  } else {
+    HGSLogDebug(@"Unknown message from Python worker %@: %@", worker, kind);
+  }
+}
+
+- (void)workerDidExit:(HGSPythonWorker *)worker {
+  HGSPythonWorkerRequest *request = nil;
+  NSArray *pending = nil;
+  @synchronized(self) {
+    request = [[[worker request] retain] autorelease];
+    [worker setRequest:nil];
+    [workers_ removeObject:worker];
+    pending = [[pendingRequests_ copy] autorelease];
+    [pendingRequests_ removeAllObjects];
+  }
+  if (request && ![request isCancelled]) {
+    HGSLog(@"Python worker %@ exited while running %@", worker, request);
+  }
+  [request completeWithValue:nil];
+  for (HGSPythonWorkerRequest *next in pending) {
+    [self submitRequest:next];
+  }
+}
+
+- (void)displayNotification:(NSArray *)message {
+  // [notify, pluginID, message, description, name]
+  if ([message count] < 5) return;
+  HGSExtension *extension = nil;
+  @synchronized(self) {
+    NSDictionary *plugin = [plugins_ objectForKey:[message objectAtIndex:1]];
+    NSValue *value = [plugin objectForKey:kHGSPythonWorkerPluginExtensionKey];
+    extension = [[[value nonretainedObjectValue] retain] autorelease];
+  }
+  NSString *text = [message objectAtIndex:2];
+  if (!extension || ![text isKindOfClass:[NSString class]]) return;
+  NSString *description = [message objectAtIndex:3];
+  if (![description isKindOfClass:[NSString class]]) {
+    description = nil;
+  }
+  NSString *name = [message objectAtIndex:4];
+  if (![name isKindOfClass:[NSString class]]) {
+    name = nil;
+  }
+  [HGSUserMessenger displayUserMessage:text
+                           description:description
+                                  name:name
+                                 image:[extension icon]
+                                  type:kHGSUserMessageNoteType];
+}
+
+#pragma mark Reaping
+
+- (void)scheduleReap {
+  // A little slack so the deadline has certainly passed.
+  [self performSelector:@selector(reapStuckWorkers)
+             withObject:nil
+             afterDelay:kHGSPythonWorkerCancelGracePeriod + 0.1];
+}
+
+- (void)reapStuckWorkers {
+  NSMutableArray *stuck = [NSMutableArray array];
+  NSDate *now = [NSDate date];
+  @synchronized(self) {
+    for (HGSPythonWorker *worker in workers_) {
+      HGSPythonWorkerRequest *request = [worker request];
+      if ([request isCancelled]
+          && [[request cancelDeadline] compare:now] != NSOrderedDescending) {
+        [stuck addObject:worker];
+      }
+    }
+  }
+  for (HGSPythonWorker *worker in stuck) {
+    HGSLog(@"Killing Python worker %@, still busy with cancelled %@",
+           worker, [worker request]);
+    [worker kill];
+  }
+}
+
+@end
@@ -35,6 +35,7 @@
 #import <GTM/GTMDefines.h>
 
 @class HGSQuery;
+@class HGSQueryUpdateCoalescer;
 @class HGSTypeFilter;
 
 /*!
@@ -64,6 +65,7 @@
   __weak NSTimer* slowSourceTimer_;
   NSMutableDictionary *conformingResultsCache_;
   NSSet *emptySet_;
+  HGSQueryUpdateCoalescer *updateCoalescer_;
 }
 
 - (id)initWithQuery:(HGSQuery*)query;
@@ -91,11 +93,24 @@
 */
 - (void)cancel;
 
+/*!
+  Stops the query because a newer one replaces it. Like cancel, but also
+  drops the results cached for this query.
+*/
+- (void)supersede;
+
 /*!
  Returns the number of results for filter typeFilter.
 */
 - (NSUInteger)resultCountForFilter:(HGSTypeFilter *)typeFilter;
 
+/*!
+ Returns the number of results for each filter in |typeFilters| as
+ NSNumbers, in the same order. Cheaper than calling resultCountForFilter:
+ for each of them as most operations only look at each result once.
+*/
+- (NSArray *)resultCountsForFilters:(NSArray *)typeFilters;
+
 /*!
  Returns a set of results based on the current results we have from the query.
  @param range The range of results to return
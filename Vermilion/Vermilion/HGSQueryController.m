@@ -38,10 +38,13 @@
 #import "HGSSearchOperation.h"
 #import "HGSCoreExtensionPoints.h"
 #import "HGSSearchSourceRanker.h"
+#import "HGSSearchSourceScheduler.h"
 #import "HGSMixer.h"
 #import "HGSLog.h"
 #import "HGSTypeFilter.h"
 #import "HGSDTrace.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSQueryUpdateCoalescer.h"
 #import "HGSOperation.h"
 #import "HGSMemorySearchSource.h"
 #import "HGSBundle.h"
@@ -77,10 +80,11 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 
 @interface HGSQueryController()
 - (void)cancelPendingSearchOperations:(NSTimer*)timer;
+- (void)operationDeadlineExpired:(HGSSearchOperation *)operation;
 - (void)invalidateSlowSourceTimer;
 - (void)searchOperationWillStart:(NSNotification *)notification;
 - (void)searchOperationDidFinish:(NSNotification *)notification;
-- (void)searchOperationDidUpdateResults:(NSNotification *)notification;
+- (void)searchOperationsDidUpdateResults:(NSArray *)operations;
 @end
 
 @implementation HGSQueryController
@@ -117,17 +121,34 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
   [pendingQueryOperations_ release];
   [queryOperationsWithResults_ release];
   [emptySet_ release];
+  [updateCoalescer_ release];
   [super dealloc];
 }
 
 - (void)startQuery {
+  // Extensions are installed lazily on the main thread. Make sure everything
+  // is in place before any search operation can go looking for sources or
+  // actions from another thread.
+  [HGSExtensionPoint installAllPendingExtensions];
   // Spin through the Sources checking to see if they are valid for the source
   // and kick off the SearchOperations.
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   [nc postNotificationName:kHGSQueryControllerWillStartNotification object:self];
   HGSSearchSourceRanker *sourceRanker
     = [HGSSearchSourceRanker sharedSearchSourceRanker];
-  for (HGSSearchSource *source in [sourceRanker orderedSourcesByPerformance]) {
+  HGSSearchSourceScheduler *scheduler
+    = [HGSSearchSourceScheduler sharedSearchSourceScheduler];
+  NSArray *sources
+    = [scheduler scheduledSources:[sourceRanker orderedSourcesByPerformance]];
+  // All of our operations report their updates through one coalescer so we
+  // hear about them at most once a frame.
+  SEL updateSelector = @selector(searchOperationsDidUpdateResults:);
+  updateCoalescer_
+    = [[HGSQueryUpdateCoalescer alloc]
+       initWithTarget:self
+             selector:updateSelector
+               window:kHGSQueryUpdateCoalescerDefaultWindow];
+  for (HGSSearchSource *source in sources) {
     // Check if the source likes the query string
     if ([source isValidSourceForQuery:parsedQuery_]) {
       HGSSearchOperation* operation;
@@ -141,10 +162,7 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
                selector:@selector(searchOperationDidFinish:)
                    name:kHGSSearchOperationDidFinishNotification
                  object:operation];
-        [nc addObserver:self
-               selector:@selector(searchOperationDidUpdateResults:)
-                   name:kHGSSearchOperationDidUpdateResultsNotification
-                 object:operation];
+        [operation setUpdateCoalescer:updateCoalescer_];
         [queryOperations_ addObject:operation];
         [pendingQueryOperations_ addObject:operation];
       }
@@ -224,6 +242,16 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
   }
 }
 
+- (void)operationDeadlineExpired:(HGSSearchOperation *)operation {
+  if ([operation isFinished]
+      || ![pendingQueryOperations_ containsObject:operation]) return;
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  if ([sd boolForKey:kHGSValidateSearchSourceBehaviorsPrefKey]) {
+    HGSLog(@"Missed its deadline, canceling SearchOperation %@", operation);
+  }
+  [operation cancel];
+}
+
 - (HGSQuery *)query {
   return parsedQuery_;
 }
@@ -235,10 +263,24 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
     [nc removeObserver:self name:nil object:operation];
     [operation cancel];
   }
+  [NSObject cancelPreviousPerformRequestsWithTarget:self];
   [self invalidateSlowSourceTimer];
+  // Updates from operations that are still winding down are dropped on
+  // their own threads from here on.
+  [updateCoalescer_ invalidate];
   cancelled_ = YES;
 }
 
+- (void)supersede {
+  // Nobody will look at our results again, so don't hold on to anything we
+  // cached for them. Operations are cancelled straight away so they give
+  // their threads back to the next query.
+  @synchronized (conformingResultsCache_) {
+    [conformingResultsCache_ removeAllObjects];
+  }
+  [self cancel];
+}
+
 - (BOOL)queriesFinished {
   return ([pendingQueryOperations_ count] == 0) ? YES : NO;
 }
@@ -260,6 +302,26 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
   return count;
 }
 
+- (NSArray *)resultCountsForFilters:(NSArray *)typeFilters {
+  NSUInteger filterCount = [typeFilters count];
+  if (!filterCount) return [NSArray array];
+  NSUInteger *counts = calloc(filterCount, sizeof(NSUInteger));
+  if (!counts) return nil;
+  NSMutableDictionary *typeMatches = [NSMutableDictionary dictionary];
+  for (HGSSearchOperation *op in queryOperationsWithResults_) {
+    [op addResultCountsForFilters:typeFilters
+                      typeMatches:typeMatches
+                         toCounts:counts];
+  }
+  NSMutableArray *resultCounts
+    = [NSMutableArray arrayWithCapacity:filterCount];
+  for (NSUInteger i = 0; i < filterCount; ++i) {
+    [resultCounts addObject:[NSNumber numberWithUnsignedInteger:counts[i]]];
+  }
+  free(counts);
+  return resultCounts;
+}
+
 - (HGSConformingResultCache *)cachedResultsForFilter:(HGSTypeFilter *)filter {
   HGSConformingResultCache *cache
     = [conformingResultsCache_ objectForKey:filter];
@@ -282,6 +344,13 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
     NSUInteger *opsIndexes = [cache indexes];
     NSUInteger rankedCount = [rankedResults count];
     if (maxRange > rankedCount) {
+      uint64_t startTime = mach_absolute_time();
+      NSString *queryString
+        = [[parsedQuery_ tokenizedQueryString] originalString];
+      if (VERMILION_MERGE_START_ENABLED()) {
+        VERMILION_MERGE_START((char *)[queryString UTF8String],
+                              (int)maxRange);
+      }
       NSArray *queryOperationsWithResults
         = [queryOperationsWithResults_ allObjects];
       NSUInteger opsCount = [queryOperationsWithResults count];
@@ -360,6 +429,14 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
         }
       }
       free(opsMaxIndexes);
+      [[HGSLatencyHistogramRegistry sharedRegistry]
+       recordMachTime:mach_absolute_time() - startTime
+             forStage:kHGSLatencyStageMerge
+               source:nil];
+      if (VERMILION_MERGE_FINISH_ENABLED()) {
+        VERMILION_MERGE_FINISH((char *)[queryString UTF8String],
+                               (int)rankedCount);
+      }
     }
     if (range.location < rankedCount) {
       NSUInteger totalLength = rankedCount - range.location;
@@ -388,6 +465,23 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
                            (char *)[queryString UTF8String],
                            (char *)[ptr UTF8String]);
   }
+  // Sources we have timings for get their own, shorter, deadlines. They are
+  // timed from when the operation starts running, not from when it was
+  // queued, so time spent waiting for a thread doesn't count against them.
+  if ([operation isFinished]
+      || ![pendingQueryOperations_ containsObject:operation]) return;
+  HGSSearchSourceScheduler *scheduler
+    = [HGSSearchSourceScheduler sharedSearchSourceScheduler];
+  NSTimeInterval deadline = [scheduler deadlineForSource:[operation source]];
+  NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+  if (deadline >= [sd doubleForKey:kQuerySlowSourceTimeoutSecondsPrefKey]) {
+    return;
+  }
+  NSTimeInterval elapsed
+    = HGSMachTimeToNanoseconds([operation elapsedRunTime]) / 1e9;
+  [self performSelector:@selector(operationDeadlineExpired:)
+             withObject:operation
+             afterDelay:MAX(deadline - elapsed, 0)];
 }
 
 //
@@ -404,6 +498,13 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
             @"ERROR: Received duplicate finished notifications from operation %@",
             [operation description]);
 
+  SEL deadlineSelector = @selector(operationDeadlineExpired:);
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:deadlineSelector
+                                             object:operation];
+  // Results the operation posted just before finishing may still be waiting
+  // in the coalescer. They have to be counted before we say we are done.
+  [updateCoalescer_ flushOperation:operation];
   [pendingQueryOperations_ removeObject:operation];
   HGSSearchSource *source = [operation source];
 
@@ -426,14 +527,14 @@ NSString *const kQuerySlowSourceTimeoutSecondsPrefKey = @"slowSourceTimeout";
 }
 
 //
-// -searchOperationDidUpdateResults:
+// -searchOperationsDidUpdateResults:
 //
-// Called when a source has added more results.
+// Called by our update coalescer with the operations that have added more
+// results since the last call.
 //
-- (void)searchOperationDidUpdateResults:(NSNotification *)notification {
-  HGSSearchOperation *operation = [notification object];
+- (void)searchOperationsDidUpdateResults:(NSArray *)operations {
   @synchronized (self) {
-    [queryOperationsWithResults_ addObject:operation];
+    [queryOperationsWithResults_ addObjectsFromArray:operations];
   }
   @synchronized (conformingResultsCache_) {
     [conformingResultsCache_ removeAllObjects];
@@ -33,9 +33,103 @@
 
 #import "GTMSenTestCase.h"
 #import "HGSQueryController.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSExtensionPoint.h"
+#import "HGSMemorySearchSource.h"
+#import "HGSQuery.h"
+#import "HGSResult.h"
+#import "HGSType.h"
+#import "HGSTypeFilter.h"
+
+static NSString *const kQuickSourceQuery = @"zqxquicksource";
+
+// Answers kQuickSourceQuery with one result as fast as it can, so that its
+// results and its finishing land inside one update window.
+@interface HGSQueryControllerTestQuickSource : HGSMemorySearchSource
+@end
+
+@implementation HGSQueryControllerTestQuickSource
+
+- (id)init {
+  NSBundle *bundle = [NSBundle bundleForClass:[self class]];
+  NSString *identifier = @"com.google.qsb.test.querycontroller.quick";
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       bundle, kHGSExtensionBundleKey,
+       identifier, kHGSExtensionIdentifierKey,
+       identifier, kHGSExtensionUserVisibleNameKey,
+       nil];
+  if ((self = [super initWithConfiguration:config])) {
+    HGSUnscoredResult *result
+      = [HGSUnscoredResult resultWithURI:@"http://quick.invalid/"
+                                    name:kQuickSourceQuery
+                                    type:kHGSTypeWebpage
+                                  source:self
+                              attributes:nil];
+    HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+    [database indexResult:result];
+    [self replaceCurrentDatabaseWith:database];
+  }
+  return self;
+}
+
+- (BOOL)isValidSourceForQuery:(HGSQuery *)query {
+  NSString *string = [[query tokenizedQueryString] originalString];
+  return [string isEqualToString:kQuickSourceQuery];
+}
 
-@interface HGSQueryControllerTest : GTMTestCase 
+@end
+
+@interface HGSQueryControllerTest : GTMTestCase {
+ @private
+  NSUInteger resultCountAtFinish_;
+  BOOL finished_;
+}
 @end
 
 @implementation HGSQueryControllerTest
+
+- (void)queryControllerDidFinish:(NSNotification *)notification {
+  HGSQueryController *controller = [notification object];
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  resultCountAtFinish_ = [controller resultCountForFilter:filter];
+  finished_ = YES;
+}
+
+- (void)testResultsPostedJustBeforeFinishing {
+  HGSQueryControllerTestQuickSource *source
+    = [[[HGSQueryControllerTestQuickSource alloc] init] autorelease];
+  STAssertNotNil(source, nil);
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertTrue([sourcesPoint extendWithObject:source], nil);
+  HGSQuery *query
+    = [[[HGSQuery alloc] initWithString:kQuickSourceQuery
+                         actionArgument:nil
+                        actionOperation:nil
+                           pivotObjects:nil
+                             queryFlags:0] autorelease];
+  HGSQueryController *controller
+    = [[[HGSQueryController alloc] initWithQuery:query] autorelease];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidFinish:)
+             name:kHGSQueryControllerDidFinishNotification
+           object:controller];
+  finished_ = NO;
+  [controller startQuery];
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (!finished_ && [deadline timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop]
+     runMode:NSDefaultRunLoopMode
+     beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+  }
+  [nc removeObserver:self name:nil object:controller];
+  [controller cancel];
+  [sourcesPoint removeExtension:source];
+  STAssertTrue(finished_, nil);
+  // The source's update and its finish arrive well inside one coalescer
+  // window; the update must still be counted by the time we hear it's done.
+  STAssertEquals(resultCountAtFinish_, (NSUInteger)1, nil);
+}
+
 @end
@@ -0,0 +1,165 @@
+//
+//  HGSQueryTrace.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*!
+ @header
+ @discussion HGSQueryTrace
+*/
+
+#import <Foundation/Foundation.h>
+
+@class HGSLatencyHistogram;
+@class HGSQueryController;
+
+/*!
+  User default (NSString path). When set, QSB records a query trace while it
+  runs and writes it to this path when it quits.
+*/
+extern NSString *const kHGSQueryTraceFilePrefKey;
+
+/*!
+  Most results kept per source in a trace's corpus. The corpus is what
+  replay searches, so it only needs the results users actually saw.
+*/
+#define kHGSQueryTraceMaximumCorpusSize 2000
+
+/*!
+  Keys for the dictionaries in -[HGSQueryTraceReplayer keystrokes].
+*/
+extern NSString *const kHGSQueryTraceKeystrokeQueryKey;  // NSString
+extern NSString *const kHGSQueryTraceKeystrokeResultCountKey;  // NSNumber
+// NSNumber nanoseconds from the start of the query
+extern NSString *const kHGSQueryTraceKeystrokeFirstResultKey;
+extern NSString *const kHGSQueryTraceKeystrokeFinalResultKey;
+// NSNumber BOOL, YES if the next query started before this one finished
+extern NSString *const kHGSQueryTraceKeystrokeCancelledKey;
+
+/*!
+  Records every query HGSQueryController runs as a trace (a property list)
+  that HGSQueryTraceReplayer can run again later.
+
+  For each query the trace has its text, the time since the previous query
+  (typically the time between keystrokes), its pivots and flags, and for
+  each source that ran how long it took and how many results it returned.
+  For each source it has the corpus size (for memory sources, the number of
+  indexed results, otherwise the number of distinct results returned) and
+  the results it returned, up to kHGSQueryTraceMaximumCorpusSize.
+
+  Queries for action arguments aren't recorded. Traces hold the names and
+  URIs of results, so they are as private as the user's index.
+
+  Must be used from the main thread.
+*/
+@interface HGSQueryTraceRecorder : NSObject {
+ @private
+  NSMutableArray *events_;
+  NSMutableDictionary *sources_;
+  NSMutableArray *pendingQueries_;
+  NSDate *startDate_;
+  NSDate *lastQueryDate_;
+  BOOL recording_;
+}
+
+@property (readonly, assign, getter=isRecording) BOOL recording;
+
+- (void)startRecording;
+- (void)stopRecording;
+
+/*! The trace recorded so far. */
+- (NSDictionary *)trace;
+- (BOOL)writeToFile:(NSString *)path;
+
+@end
+
+/*!
+  Runs a recorded trace through HGSQueryController and measures, for every
+  query, the time to its first result and the time until it finishes.
+
+  Each recorded source is replaced by a memory search source that indexes
+  the recorded corpus, takes as long as the recorded source did for each
+  query (scaled by sourceLatencyScale) and only runs for the queries the
+  recorded source ran for. So the scores and the ordering come from the
+  current scoring and mixing code, and the timing from the current
+  scheduling, while the input stays the same from run to run. Any other
+  sources installed in the sources extension point run as well, so replay
+  is meant for processes (like unit tests) that haven't loaded plugins.
+
+  Must be used from the main thread, which it runs the run loop on.
+*/
+@interface HGSQueryTraceReplayer : NSObject {
+ @private
+  NSDictionary *trace_;
+  NSMutableArray *keystrokes_;
+  HGSLatencyHistogram *firstResultHistogram_;
+  HGSLatencyHistogram *finalResultHistogram_;
+  HGSQueryController *queryController_;
+  NSMutableDictionary *currentKeystroke_;
+  uint64_t queryStartTime_;
+  double keystrokeTimeScale_;
+  double sourceLatencyScale_;
+  NSTimeInterval queryTimeout_;
+}
+
+/*!
+  How much of the recorded time between queries to wait before starting
+  the next one. At the default of 0 every query runs until it finishes (or
+  times out); at 1.0 queries start as they did for the user, and a query
+  that hasn't finished when the next one starts is cancelled, as QSB does.
+*/
+@property (assign) double keystrokeTimeScale;
+/*! Multiplies the recorded source run times. Defaults to 1.0. */
+@property (assign) double sourceLatencyScale;
+/*! Seconds to wait for a query to finish. Defaults to 10. */
+@property (assign) NSTimeInterval queryTimeout;
+
+/*!
+  One dictionary per replayed query, with the query string, its result
+  count and the times to its first and final results in nanoseconds.
+  A time is missing if the query never got that far.
+*/
+@property (readonly, retain) NSArray *keystrokes;
+@property (readonly, retain) HGSLatencyHistogram *firstResultHistogram;
+@property (readonly, retain) HGSLatencyHistogram *finalResultHistogram;
+
++ (id)replayerWithContentsOfFile:(NSString *)path;
+- (id)initWithTrace:(NSDictionary *)trace;
+
+/*!
+  Replays the whole trace. Returns NO if the trace couldn't be replayed.
+  Can be called more than once; each call starts new measurements.
+*/
+- (BOOL)replay;
+
+/*! The percentiles of both histograms, one line each. */
+- (NSString *)report;
+
+@end
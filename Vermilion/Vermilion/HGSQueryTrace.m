@@ -0,0 +1,681 @@
+//
+//  HGSQueryTrace.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSQueryTrace.h"
+#import <mach/mach_time.h>
+#import "HGSBundle.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSExtensionPoint.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSLog.h"
+#import "HGSMemorySearchSource.h"
+#import "HGSQuery.h"
+#import "HGSQueryController.h"
+#import "HGSResult.h"
+#import "HGSSearchOperation.h"
+#import "HGSTokenizer.h"
+#import "HGSTypeFilter.h"
+
+NSString *const kHGSQueryTraceFilePrefKey = @"HGSQueryTraceFile";
+
+NSString *const kHGSQueryTraceKeystrokeQueryKey = @"query";
+NSString *const kHGSQueryTraceKeystrokeResultCountKey = @"resultCount";
+NSString *const kHGSQueryTraceKeystrokeFirstResultKey = @"firstResult";
+NSString *const kHGSQueryTraceKeystrokeFinalResultKey = @"finalResult";
+NSString *const kHGSQueryTraceKeystrokeCancelledKey = @"cancelled";
+
+// Trace keys. A trace looks like:
+// { version = 1;
+//   events = ( { time = <seconds since the first query>;
+//                interval = <seconds since the previous query>;
+//                query = "...";
+//                pivots = ( <result>, ... );
+//                flags = <HGSQueryFlags>;
+//                sourceRuns = { <source id> = { runTime = <ns>;
+//                                               resultCount = n; }; }; },
+//              ... );
+//   sources = { <source id> = { corpusSize = n;
+//                               corpus = ( <result>, ... ); }; }; }
+// where a <result> is { name; uri; type; snippet (optional);
+//                       source (pivots only) }.
+static NSString *const kHGSQueryTraceVersionKey = @"version";
+static NSString *const kHGSQueryTraceEventsKey = @"events";
+static NSString *const kHGSQueryTraceSourcesKey = @"sources";
+static NSString *const kHGSQueryTraceTimeKey = @"time";
+static NSString *const kHGSQueryTraceIntervalKey = @"interval";
+static NSString *const kHGSQueryTraceQueryKey = @"query";
+static NSString *const kHGSQueryTracePivotsKey = @"pivots";
+static NSString *const kHGSQueryTraceFlagsKey = @"flags";
+static NSString *const kHGSQueryTraceSourceRunsKey = @"sourceRuns";
+static NSString *const kHGSQueryTraceRunTimeKey = @"runTime";
+static NSString *const kHGSQueryTraceResultCountKey = @"resultCount";
+static NSString *const kHGSQueryTraceCorpusSizeKey = @"corpusSize";
+static NSString *const kHGSQueryTraceCorpusKey = @"corpus";
+static NSString *const kHGSQueryTraceNameKey = @"name";
+static NSString *const kHGSQueryTraceURIKey = @"uri";
+static NSString *const kHGSQueryTraceTypeKey = @"type";
+static NSString *const kHGSQueryTraceSnippetKey = @"snippet";
+static NSString *const kHGSQueryTraceSourceKey = @"source";
+// Only used while recording.
+static NSString *const kHGSQueryTraceCorpusURIsKey = @"corpusURIs";
+
+static const NSInteger kHGSQueryTraceVersion = 1;
+
+// Queries that are cancelled never tell us they are done, so we only keep
+// track of the last few.
+static const NSUInteger kHGSQueryTraceMaximumPendingQueries = 8;
+
+// Identifies a query by its pivots and text, which is what replay has to go
+// on when deciding which sources to run.
+static NSString *HGSQueryTraceKey(NSString *queryString, NSArray *pivotURIs) {
+  return [NSString stringWithFormat:@"%@|%@",
+          [pivotURIs componentsJoinedByString:@" "],
+          queryString ? queryString : @""];
+}
+
+static NSString *HGSQueryTraceKeyForQuery(HGSQuery *query) {
+  NSMutableArray *pivotURIs = [NSMutableArray array];
+  for (HGSResult *pivot in [query pivotObjects]) {
+    [pivotURIs addObject:[pivot uri]];
+  }
+  NSString *queryString = [[query tokenizedQueryString] originalString];
+  return HGSQueryTraceKey(queryString, pivotURIs);
+}
+
+static NSMutableDictionary *HGSQueryTraceDictionaryForResult(
+    HGSResult *result) {
+  NSMutableDictionary *dict
+    = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+       [result displayName], kHGSQueryTraceNameKey,
+       [result uri], kHGSQueryTraceURIKey,
+       [result type], kHGSQueryTraceTypeKey,
+       nil];
+  id snippet = [result valueForKey:kHGSObjectAttributeSnippetKey];
+  if ([snippet isKindOfClass:[NSString class]]) {
+    [dict setObject:snippet forKey:kHGSQueryTraceSnippetKey];
+  }
+  return dict;
+}
+
+@interface HGSQueryTraceRecorder ()
+- (void)queryControllerWillStart:(NSNotification *)notification;
+- (void)queryControllerDidFinish:(NSNotification *)notification;
+- (void)searchOperationDidFinish:(NSNotification *)notification;
+- (NSUInteger)indexOfPendingQuery:(HGSQuery *)query;
+@end
+
+// Stands in for a recorded source during replay.
+@interface HGSQueryTraceStubSource : HGSMemorySearchSource {
+ @private
+  NSDictionary *runTimes_;
+  double latencyScale_;
+}
+- (id)initWithIdentifier:(NSString *)identifier
+                  corpus:(NSArray *)corpus
+                runTimes:(NSDictionary *)runTimes
+            latencyScale:(double)latencyScale;
+@end
+
+@interface HGSQueryTraceReplayer ()
+- (void)startQueryForEvent:(NSDictionary *)event
+                     stubs:(NSDictionary *)stubs;
+- (void)runUntilDate:(NSDate *)date;
+- (void)waitForCurrentQuery;
+- (void)finishCurrentQuery;
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification;
+- (void)queryControllerDidFinish:(NSNotification *)notification;
+@end
+
+@implementation HGSQueryTraceRecorder
+
+@synthesize recording = recording_;
+
+- (id)init {
+  if ((self = [super init])) {
+    events_ = [[NSMutableArray alloc] init];
+    sources_ = [[NSMutableDictionary alloc] init];
+    pendingQueries_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stopRecording];
+  [events_ release];
+  [sources_ release];
+  [pendingQueries_ release];
+  [startDate_ release];
+  [lastQueryDate_ release];
+  [super dealloc];
+}
+
+- (void)startRecording {
+  if (recording_) return;
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerWillStart:)
+             name:kHGSQueryControllerWillStartNotification
+           object:nil];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidFinish:)
+             name:kHGSQueryControllerDidFinishNotification
+           object:nil];
+  [nc addObserver:self
+         selector:@selector(searchOperationDidFinish:)
+             name:kHGSSearchOperationDidFinishNotification
+           object:nil];
+  recording_ = YES;
+}
+
+- (void)stopRecording {
+  if (!recording_) return;
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [pendingQueries_ removeAllObjects];
+  recording_ = NO;
+}
+
+- (NSDictionary *)trace {
+  NSMutableDictionary *sources
+    = [NSMutableDictionary dictionaryWithCapacity:[sources_ count]];
+  for (NSString *identifier in sources_) {
+    NSMutableDictionary *source
+      = [[[sources_ objectForKey:identifier] mutableCopy] autorelease];
+    [source removeObjectForKey:kHGSQueryTraceCorpusURIsKey];
+    [sources setObject:source forKey:identifier];
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithInteger:kHGSQueryTraceVersion],
+          kHGSQueryTraceVersionKey,
+          events_, kHGSQueryTraceEventsKey,
+          sources, kHGSQueryTraceSourcesKey,
+          nil];
+}
+
+- (BOOL)writeToFile:(NSString *)path {
+  NSString *error = nil;
+  NSPropertyListFormat format = NSPropertyListBinaryFormat_v1_0;
+  NSData *data
+    = [NSPropertyListSerialization dataFromPropertyList:[self trace]
+                                                 format:format
+                                       errorDescription:&error];
+  if (!data) {
+    HGSLog(@"Unable to serialize query trace (%@)", error);
+    [error release];
+    return NO;
+  }
+  BOOL wrote = [data writeToFile:path atomically:YES];
+  if (!wrote) {
+    HGSLog(@"Unable to write query trace to %@", path);
+  }
+  return wrote;
+}
+
+- (NSUInteger)indexOfPendingQuery:(HGSQuery *)query {
+  NSUInteger count = [pendingQueries_ count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    NSArray *pending = [pendingQueries_ objectAtIndex:i];
+    if ([pending objectAtIndex:0] == query) return i;
+  }
+  return NSNotFound;
+}
+
+- (void)queryControllerWillStart:(NSNotification *)notification {
+  HGSQuery *query = [[notification object] query];
+  if (!query || [query actionArgument]) return;
+  NSDate *now = [NSDate date];
+  if (!startDate_) {
+    startDate_ = [now retain];
+  }
+  NSTimeInterval interval
+    = lastQueryDate_ ? [now timeIntervalSinceDate:lastQueryDate_] : 0;
+  [lastQueryDate_ release];
+  lastQueryDate_ = [now retain];
+
+  NSMutableArray *pivots = [NSMutableArray array];
+  for (HGSResult *pivot in [query pivotObjects]) {
+    NSMutableDictionary *dict = HGSQueryTraceDictionaryForResult(pivot);
+    NSString *sourceID = [[pivot source] identifier];
+    if (sourceID) {
+      [dict setObject:sourceID forKey:kHGSQueryTraceSourceKey];
+    }
+    [pivots addObject:dict];
+  }
+  NSString *queryString = [[query tokenizedQueryString] originalString];
+  NSMutableDictionary *event
+    = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithDouble:[now timeIntervalSinceDate:startDate_]],
+       kHGSQueryTraceTimeKey,
+       [NSNumber numberWithDouble:interval], kHGSQueryTraceIntervalKey,
+       queryString ? queryString : @"", kHGSQueryTraceQueryKey,
+       pivots, kHGSQueryTracePivotsKey,
+       [NSNumber numberWithUnsignedInteger:[query flags]],
+       kHGSQueryTraceFlagsKey,
+       [NSMutableDictionary dictionary], kHGSQueryTraceSourceRunsKey,
+       nil];
+  [events_ addObject:event];
+  [pendingQueries_ addObject:[NSArray arrayWithObjects:query, event, nil]];
+  if ([pendingQueries_ count] > kHGSQueryTraceMaximumPendingQueries) {
+    [pendingQueries_ removeObjectAtIndex:0];
+  }
+}
+
+- (void)queryControllerDidFinish:(NSNotification *)notification {
+  NSUInteger idx = [self indexOfPendingQuery:[[notification object] query]];
+  if (idx != NSNotFound) {
+    [pendingQueries_ removeObjectAtIndex:idx];
+  }
+}
+
+- (void)searchOperationDidFinish:(NSNotification *)notification {
+  HGSSearchOperation *operation = [notification object];
+  if ([operation isCancelled]) return;
+  NSUInteger idx = [self indexOfPendingQuery:[operation query]];
+  if (idx == NSNotFound) return;
+  NSDictionary *event = [[pendingQueries_ objectAtIndex:idx] objectAtIndex:1];
+  HGSSearchSource *source = [operation source];
+  NSString *identifier = [source identifier];
+  if (!identifier) return;
+
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  NSUInteger resultCount = [operation resultCountForFilter:filter];
+  uint64_t runTime = HGSMachTimeToNanoseconds([operation runTime]);
+  NSDictionary *run
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithUnsignedLongLong:runTime],
+       kHGSQueryTraceRunTimeKey,
+       [NSNumber numberWithUnsignedInteger:resultCount],
+       kHGSQueryTraceResultCountKey,
+       nil];
+  [[event objectForKey:kHGSQueryTraceSourceRunsKey] setObject:run
+                                                       forKey:identifier];
+
+  NSMutableDictionary *sourceDict = [sources_ objectForKey:identifier];
+  if (!sourceDict) {
+    sourceDict = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                  [NSMutableArray array], kHGSQueryTraceCorpusKey,
+                  [NSMutableSet set], kHGSQueryTraceCorpusURIsKey,
+                  nil];
+    [sources_ setObject:sourceDict forKey:identifier];
+  }
+  NSMutableArray *corpus = [sourceDict objectForKey:kHGSQueryTraceCorpusKey];
+  NSMutableSet *corpusURIs
+    = [sourceDict objectForKey:kHGSQueryTraceCorpusURIsKey];
+  if ([corpus count] < kHGSQueryTraceMaximumCorpusSize) {
+    NSArray *results
+      = [operation sortedRankedResultsInRange:NSMakeRange(0, resultCount)
+                                   typeFilter:filter];
+    for (HGSResult *result in results) {
+      if ([corpus count] >= kHGSQueryTraceMaximumCorpusSize) break;
+      NSString *uri = [result uri];
+      if (!uri || [corpusURIs containsObject:uri]) continue;
+      [corpusURIs addObject:uri];
+      [corpus addObject:HGSQueryTraceDictionaryForResult(result)];
+    }
+  }
+  NSUInteger corpusSize = [corpusURIs count];
+  if ([source isKindOfClass:[HGSMemorySearchSource class]]) {
+    corpusSize = [(HGSMemorySearchSource *)source resultCount];
+  }
+  [sourceDict setObject:[NSNumber numberWithUnsignedInteger:corpusSize]
+                 forKey:kHGSQueryTraceCorpusSizeKey];
+}
+
+@end
+
+@implementation HGSQueryTraceStubSource
+
+- (id)initWithIdentifier:(NSString *)identifier
+                  corpus:(NSArray *)corpus
+                runTimes:(NSDictionary *)runTimes
+            latencyScale:(double)latencyScale {
+  NSDictionary *config
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       HGSGetPluginBundle(), kHGSExtensionBundleKey,
+       identifier, kHGSExtensionIdentifierKey,
+       identifier, kHGSExtensionUserVisibleNameKey,
+       nil];
+  if ((self = [super initWithConfiguration:config])) {
+    runTimes_ = [runTimes copy];
+    latencyScale_ = latencyScale;
+    HGSMemorySearchSourceDB *database = [HGSMemorySearchSourceDB database];
+    for (NSDictionary *entry in corpus) {
+      NSString *snippet = [entry objectForKey:kHGSQueryTraceSnippetKey];
+      NSDictionary *attributes = nil;
+      if (snippet) {
+        attributes
+          = [NSDictionary dictionaryWithObject:snippet
+                                        forKey:kHGSObjectAttributeSnippetKey];
+      }
+      NSString *name = [entry objectForKey:kHGSQueryTraceNameKey];
+      NSString *uri = [entry objectForKey:kHGSQueryTraceURIKey];
+      NSString *type = [entry objectForKey:kHGSQueryTraceTypeKey];
+      HGSUnscoredResult *result
+        = [HGSUnscoredResult resultWithURI:uri
+                                      name:name
+                                      type:type
+                                    source:self
+                                attributes:attributes];
+      if (result) {
+        [database indexResult:result name:name otherTerm:snippet];
+      }
+    }
+    [self replaceCurrentDatabaseWith:database];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [runTimes_ release];
+  [super dealloc];
+}
+
+- (BOOL)isValidSourceForQuery:(HGSQuery *)query {
+  return [runTimes_ objectForKey:HGSQueryTraceKeyForQuery(query)] != nil;
+}
+
+- (void)performSearchOperation:(HGSCallbackSearchOperation *)operation {
+  NSNumber *runTime
+    = [runTimes_ objectForKey:HGSQueryTraceKeyForQuery([operation query])];
+  NSTimeInterval latency = [runTime doubleValue] / 1e9 * latencyScale_;
+  NSDate *end = [NSDate dateWithTimeIntervalSinceNow:latency];
+  // Sleep in slices so that cancelled operations get out of the way the way
+  // a well behaved source would.
+  while (![operation isCancelled] && [end timeIntervalSinceNow] > 0) {
+    [NSThread sleepForTimeInterval:MIN([end timeIntervalSinceNow], 0.005)];
+  }
+  if ([operation isCancelled]) return;
+  [super performSearchOperation:operation];
+}
+
+@end
+
+@implementation HGSQueryTraceReplayer
+
+@synthesize keystrokeTimeScale = keystrokeTimeScale_;
+@synthesize sourceLatencyScale = sourceLatencyScale_;
+@synthesize queryTimeout = queryTimeout_;
+@synthesize keystrokes = keystrokes_;
+@synthesize firstResultHistogram = firstResultHistogram_;
+@synthesize finalResultHistogram = finalResultHistogram_;
+
++ (id)replayerWithContentsOfFile:(NSString *)path {
+  NSDictionary *trace = [NSDictionary dictionaryWithContentsOfFile:path];
+  if (!trace) {
+    HGSLog(@"Unable to read query trace from %@", path);
+    return nil;
+  }
+  return [[[self alloc] initWithTrace:trace] autorelease];
+}
+
+- (id)init {
+  return [self initWithTrace:nil];
+}
+
+- (id)initWithTrace:(NSDictionary *)trace {
+  if ((self = [super init])) {
+    NSNumber *version = [trace objectForKey:kHGSQueryTraceVersionKey];
+    if ([version integerValue] != kHGSQueryTraceVersion) {
+      HGSLogDebug(@"Unsupported query trace version %@", version);
+      [self release];
+      return nil;
+    }
+    trace_ = [trace retain];
+    sourceLatencyScale_ = 1.0;
+    queryTimeout_ = 10.0;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self finishCurrentQuery];
+  [trace_ release];
+  [keystrokes_ release];
+  [firstResultHistogram_ release];
+  [finalResultHistogram_ release];
+  [super dealloc];
+}
+
+- (BOOL)replay {
+  NSArray *events = [trace_ objectForKey:kHGSQueryTraceEventsKey];
+  NSDictionary *sources = [trace_ objectForKey:kHGSQueryTraceSourcesKey];
+  if (![events isKindOfClass:[NSArray class]]
+      || ![sources isKindOfClass:[NSDictionary class]]) {
+    HGSLog(@"Query trace is missing its events or sources");
+    return NO;
+  }
+
+  [keystrokes_ release];
+  keystrokes_ = [[NSMutableArray alloc] initWithCapacity:[events count]];
+  [firstResultHistogram_ release];
+  firstResultHistogram_
+    = [[HGSLatencyHistogram alloc] initWithStage:@"first" source:nil];
+  [finalResultHistogram_ release];
+  finalResultHistogram_
+    = [[HGSLatencyHistogram alloc] initWithStage:@"final" source:nil];
+
+  // Work out which queries each source ran for, and how long it took.
+  NSMutableDictionary *runTimesBySource = [NSMutableDictionary dictionary];
+  for (NSDictionary *event in events) {
+    NSMutableArray *pivotURIs = [NSMutableArray array];
+    for (NSDictionary *pivot in [event objectForKey:kHGSQueryTracePivotsKey]) {
+      [pivotURIs addObject:[pivot objectForKey:kHGSQueryTraceURIKey]];
+    }
+    NSString *key
+      = HGSQueryTraceKey([event objectForKey:kHGSQueryTraceQueryKey],
+                         pivotURIs);
+    NSDictionary *runs = [event objectForKey:kHGSQueryTraceSourceRunsKey];
+    for (NSString *identifier in runs) {
+      NSMutableDictionary *runTimes
+        = [runTimesBySource objectForKey:identifier];
+      if (!runTimes) {
+        runTimes = [NSMutableDictionary dictionary];
+        [runTimesBySource setObject:runTimes forKey:identifier];
+      }
+      NSDictionary *run = [runs objectForKey:identifier];
+      [runTimes setObject:[run objectForKey:kHGSQueryTraceRunTimeKey]
+                   forKey:key];
+    }
+  }
+
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  NSMutableDictionary *stubs = [NSMutableDictionary dictionary];
+  for (NSString *identifier in runTimesBySource) {
+    NSDictionary *source = [sources objectForKey:identifier];
+    HGSQueryTraceStubSource *stub
+      = [[[HGSQueryTraceStubSource alloc]
+          initWithIdentifier:identifier
+                      corpus:[source objectForKey:kHGSQueryTraceCorpusKey]
+                    runTimes:[runTimesBySource objectForKey:identifier]
+                latencyScale:sourceLatencyScale_] autorelease];
+    if (stub && [sourcesPoint extendWithObject:stub]) {
+      [stubs setObject:stub forKey:identifier];
+    } else {
+      HGSLog(@"Unable to install replay source for %@", identifier);
+    }
+  }
+
+  NSDate *replayStart = [NSDate date];
+  for (NSDictionary *event in events) {
+    if (keystrokeTimeScale_ > 0) {
+      NSTimeInterval time
+        = [[event objectForKey:kHGSQueryTraceTimeKey] doubleValue];
+      NSDate *startDate
+        = [replayStart addTimeInterval:time * keystrokeTimeScale_];
+      [self runUntilDate:startDate];
+    }
+    [self finishCurrentQuery];
+    [self startQueryForEvent:event stubs:stubs];
+    if (keystrokeTimeScale_ <= 0) {
+      [self waitForCurrentQuery];
+    }
+  }
+  [self waitForCurrentQuery];
+  [self finishCurrentQuery];
+
+  for (HGSQueryTraceStubSource *stub in [stubs allValues]) {
+    [sourcesPoint removeExtension:stub];
+  }
+  return YES;
+}
+
+- (void)startQueryForEvent:(NSDictionary *)event
+                     stubs:(NSDictionary *)stubs {
+  NSMutableArray *pivots = [NSMutableArray array];
+  for (NSDictionary *pivot in [event objectForKey:kHGSQueryTracePivotsKey]) {
+    NSString *sourceID = [pivot objectForKey:kHGSQueryTraceSourceKey];
+    NSString *uri = [pivot objectForKey:kHGSQueryTraceURIKey];
+    NSString *name = [pivot objectForKey:kHGSQueryTraceNameKey];
+    NSString *type = [pivot objectForKey:kHGSQueryTraceTypeKey];
+    HGSUnscoredResult *result
+      = [HGSUnscoredResult resultWithURI:uri
+                                    name:name
+                                    type:type
+                                  source:[stubs objectForKey:sourceID]
+                              attributes:nil];
+    if (result) {
+      [pivots addObject:result];
+    }
+  }
+  HGSResultArray *pivotObjects
+    = [pivots count] ? [HGSResultArray arrayWithResults:pivots] : nil;
+  NSString *queryString = [event objectForKey:kHGSQueryTraceQueryKey];
+  HGSQueryFlags flags
+    = [[event objectForKey:kHGSQueryTraceFlagsKey] unsignedIntegerValue];
+  HGSQuery *query
+    = [[[HGSQuery alloc] initWithString:queryString
+                         actionArgument:nil
+                        actionOperation:nil
+                           pivotObjects:pivotObjects
+                             queryFlags:flags] autorelease];
+  queryController_ = [[HGSQueryController alloc] initWithQuery:query];
+  currentKeystroke_
+    = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
+       queryString, kHGSQueryTraceKeystrokeQueryKey, nil];
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidUpdateResults:)
+             name:kHGSQueryControllerDidUpdateResultsNotification
+           object:queryController_];
+  [nc addObserver:self
+         selector:@selector(queryControllerDidFinish:)
+             name:kHGSQueryControllerDidFinishNotification
+           object:queryController_];
+  queryStartTime_ = mach_absolute_time();
+  [queryController_ startQuery];
+}
+
+- (void)runUntilDate:(NSDate *)date {
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  while ([date timeIntervalSinceNow] > 0) {
+    NSDate *until = [NSDate dateWithTimeIntervalSinceNow:0.01];
+    [runLoop runMode:NSDefaultRunLoopMode
+          beforeDate:[until earlierDate:date]];
+  }
+}
+
+- (void)waitForCurrentQuery {
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:queryTimeout_];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  while (queryController_
+         && ![currentKeystroke_
+              objectForKey:kHGSQueryTraceKeystrokeFinalResultKey]
+         && [deadline timeIntervalSinceNow] > 0) {
+    [runLoop runMode:NSDefaultRunLoopMode
+          beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+  }
+}
+
+- (void)finishCurrentQuery {
+  if (!queryController_) return;
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc removeObserver:self name:nil object:queryController_];
+  if (![currentKeystroke_
+        objectForKey:kHGSQueryTraceKeystrokeFinalResultKey]) {
+    [queryController_ cancel];
+    [currentKeystroke_ setObject:[NSNumber numberWithBool:YES]
+                          forKey:kHGSQueryTraceKeystrokeCancelledKey];
+  }
+  [keystrokes_ addObject:currentKeystroke_];
+  [currentKeystroke_ release];
+  currentKeystroke_ = nil;
+  [queryController_ release];
+  queryController_ = nil;
+}
+
+- (void)queryControllerDidUpdateResults:(NSNotification *)notification {
+  if ([currentKeystroke_
+       objectForKey:kHGSQueryTraceKeystrokeFirstResultKey]) return;
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  if ([queryController_ resultCountForFilter:filter] == 0) return;
+  uint64_t elapsed
+    = HGSMachTimeToNanoseconds(mach_absolute_time() - queryStartTime_);
+  [currentKeystroke_ setObject:[NSNumber numberWithUnsignedLongLong:elapsed]
+                        forKey:kHGSQueryTraceKeystrokeFirstResultKey];
+  [firstResultHistogram_ recordNanoseconds:elapsed];
+}
+
+- (void)queryControllerDidFinish:(NSNotification *)notification {
+  // Results that come in with the last operation only show up here.
+  [self queryControllerDidUpdateResults:notification];
+  uint64_t elapsed
+    = HGSMachTimeToNanoseconds(mach_absolute_time() - queryStartTime_);
+  HGSTypeFilter *filter = [HGSTypeFilter filterAllowingAllTypes];
+  NSUInteger resultCount = [queryController_ resultCountForFilter:filter];
+  [currentKeystroke_ setObject:[NSNumber numberWithUnsignedLongLong:elapsed]
+                        forKey:kHGSQueryTraceKeystrokeFinalResultKey];
+  [currentKeystroke_ setObject:[NSNumber numberWithUnsignedInteger:resultCount]
+                        forKey:kHGSQueryTraceKeystrokeResultCountKey];
+  [finalResultHistogram_ recordNanoseconds:elapsed];
+}
+
+- (NSString *)report {
+  NSMutableString *report = [NSMutableString stringWithFormat:
+                             @"%-14s %8s %10s %10s %10s %10s\n",
+                             "", "count", "p50 ms", "p90 ms", "p99 ms",
+                             "max ms"];
+  HGSLatencyHistogram *histograms[] = {
+    firstResultHistogram_, finalResultHistogram_
+  };
+  const char *names[] = { "first result", "final result" };
+  for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); ++i) {
+    HGSLatencyHistogram *histogram = histograms[i];
+    [report appendFormat:@"%-14s %8llu %10.3f %10.3f %10.3f %10.3f\n",
+     names[i], [histogram count],
+     [histogram nanosecondsAtPercentile:50.0] / 1e6,
+     [histogram nanosecondsAtPercentile:90.0] / 1e6,
+     [histogram nanosecondsAtPercentile:99.0] / 1e6,
+     [histogram maximumNanoseconds] / 1e6];
+  }
+  return report;
+}
+
+@end
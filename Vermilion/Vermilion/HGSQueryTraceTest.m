@@ -0,0 +1,239 @@
+//
+//  HGSQueryTraceTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import "HGSQueryTrace.h"
+#import "HGSCoreExtensionPoints.h"
+#import "HGSExtensionPoint.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSType.h"
+
+static NSString *const kTraceSourceA = @"com.google.qsb.test.trace.a";
+static NSString *const kTraceSourceB = @"com.google.qsb.test.trace.b";
+
+@interface HGSQueryTraceTest : GTMTestCase
+@end
+
+// Builds a trace of someone typing "foo" with both sources answering every
+// keystroke in |runTime| nanoseconds.
+static NSDictionary *HGSQueryTraceTestTrace(double interval,
+                                            unsigned long long runTime) {
+  NSDictionary *run
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithUnsignedLongLong:runTime], @"runTime",
+       [NSNumber numberWithInt:1], @"resultCount",
+       nil];
+  NSDictionary *runs = [NSDictionary dictionaryWithObjectsAndKeys:
+                        run, kTraceSourceA, run, kTraceSourceB, nil];
+  NSMutableArray *events = [NSMutableArray array];
+  NSArray *queries = [NSArray arrayWithObjects:@"f", @"fo", @"foo", nil];
+  for (NSUInteger i = 0; i < [queries count]; ++i) {
+    NSDictionary *event
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         [NSNumber numberWithDouble:i * interval], @"time",
+         [NSNumber numberWithDouble:i ? interval : 0], @"interval",
+         [queries objectAtIndex:i], @"query",
+         [NSArray array], @"pivots",
+         [NSNumber numberWithInt:0], @"flags",
+         runs, @"sourceRuns",
+         nil];
+    [events addObject:event];
+  }
+  NSDictionary *foo
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       @"Foo Fighters", @"name",
+       @"http://www.foofighters.com/", @"uri",
+       kHGSTypeWebpage, @"type",
+       nil];
+  NSDictionary *food
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       @"Food Network", @"name",
+       @"http://www.foodnetwork.com/", @"uri",
+       kHGSTypeWebpage, @"type",
+       @"Recipes", @"snippet",
+       nil];
+  NSDictionary *bar
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       @"Bar", @"name",
+       @"file:///tmp/Bar", @"uri",
+       kHGSTypeFile, @"type",
+       nil];
+  NSDictionary *sourceA
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithInt:2], @"corpusSize",
+       [NSArray arrayWithObjects:foo, bar, nil], @"corpus",
+       nil];
+  NSDictionary *sourceB
+    = [NSDictionary dictionaryWithObjectsAndKeys:
+       [NSNumber numberWithInt:1], @"corpusSize",
+       [NSArray arrayWithObject:food], @"corpus",
+       nil];
+  NSDictionary *sources = [NSDictionary dictionaryWithObjectsAndKeys:
+                           sourceA, kTraceSourceA,
+                           sourceB, kTraceSourceB,
+                           nil];
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithInt:1], @"version",
+          events, @"events",
+          sources, @"sources",
+          nil];
+}
+
+@implementation HGSQueryTraceTest
+
+- (void)testInit {
+  HGSQueryTraceReplayer *replayer
+    = [[[HGSQueryTraceReplayer alloc] init] autorelease];
+  STAssertNil(replayer, nil);
+  NSDictionary *trace
+    = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:2]
+                                  forKey:@"version"];
+  replayer = [[[HGSQueryTraceReplayer alloc] initWithTrace:trace] autorelease];
+  STAssertNil(replayer, nil);
+  trace = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:1]
+                                      forKey:@"version"];
+  replayer = [[[HGSQueryTraceReplayer alloc] initWithTrace:trace] autorelease];
+  STAssertNotNil(replayer, nil);
+  STAssertFalse([replayer replay], nil);
+}
+
+- (void)testReplay {
+  NSDictionary *trace = HGSQueryTraceTestTrace(0.1, 1000000ULL);
+  HGSQueryTraceReplayer *replayer
+    = [[[HGSQueryTraceReplayer alloc] initWithTrace:trace] autorelease];
+  STAssertNotNil(replayer, nil);
+  STAssertTrue([replayer replay], nil);
+  NSArray *keystrokes = [replayer keystrokes];
+  STAssertEquals([keystrokes count], (NSUInteger)3, nil);
+  for (NSDictionary *keystroke in keystrokes) {
+    NSNumber *first
+      = [keystroke objectForKey:kHGSQueryTraceKeystrokeFirstResultKey];
+    NSNumber *final
+      = [keystroke objectForKey:kHGSQueryTraceKeystrokeFinalResultKey];
+    STAssertNotNil(first, @"%@", keystroke);
+    STAssertNotNil(final, @"%@", keystroke);
+    STAssertLessThanOrEqual([first unsignedLongLongValue],
+                            [final unsignedLongLongValue], nil);
+    // Each source takes at least the recorded millisecond.
+    STAssertGreaterThanOrEqual([final unsignedLongLongValue], 1000000ULL, nil);
+    STAssertNil([keystroke objectForKey:kHGSQueryTraceKeystrokeCancelledKey],
+                nil);
+  }
+  // Every keystroke finds Foo Fighters and Food Network, and none Bar.
+  for (NSDictionary *keystroke in keystrokes) {
+    NSNumber *count
+      = [keystroke objectForKey:kHGSQueryTraceKeystrokeResultCountKey];
+    STAssertEquals([count unsignedIntegerValue], (NSUInteger)2, nil);
+  }
+  STAssertEquals([[replayer firstResultHistogram] count], 3ULL, nil);
+  STAssertEquals([[replayer finalResultHistogram] count], 3ULL, nil);
+  NSArray *lines = [[replayer report] componentsSeparatedByString:@"\n"];
+  STAssertEquals([lines count], (NSUInteger)4, nil);
+
+  // The stub sources are only installed while replaying.
+  HGSExtensionPoint *sourcesPoint = [HGSExtensionPoint sourcesPoint];
+  STAssertNil([sourcesPoint extensionWithIdentifier:kTraceSourceA], nil);
+}
+
+- (void)testReplayCancelsSupersededQueries {
+  // Sources take much longer than the user takes to type.
+  NSDictionary *trace = HGSQueryTraceTestTrace(0.05, 500000000ULL);
+  HGSQueryTraceReplayer *replayer
+    = [[[HGSQueryTraceReplayer alloc] initWithTrace:trace] autorelease];
+  [replayer setKeystrokeTimeScale:1.0];
+  STAssertTrue([replayer replay], nil);
+  NSArray *keystrokes = [replayer keystrokes];
+  STAssertEquals([keystrokes count], (NSUInteger)3, nil);
+  for (NSUInteger i = 0; i < 2; ++i) {
+    NSDictionary *keystroke = [keystrokes objectAtIndex:i];
+    STAssertTrue([[keystroke
+                   objectForKey:kHGSQueryTraceKeystrokeCancelledKey] boolValue],
+                 @"%@", keystroke);
+    STAssertNil([keystroke objectForKey:kHGSQueryTraceKeystrokeFinalResultKey],
+                nil);
+  }
+  NSDictionary *last = [keystrokes lastObject];
+  STAssertNotNil([last objectForKey:kHGSQueryTraceKeystrokeFinalResultKey],
+                 nil);
+  STAssertEquals([[replayer finalResultHistogram] count], 1ULL, nil);
+
+  // Scaling the sources down lets every query finish.
+  [replayer setSourceLatencyScale:0.01];
+  STAssertTrue([replayer replay], nil);
+  STAssertEquals([[replayer finalResultHistogram] count], 3ULL, nil);
+}
+
+- (void)testRecordReplayedTrace {
+  HGSQueryTraceRecorder *recorder
+    = [[[HGSQueryTraceRecorder alloc] init] autorelease];
+  [recorder startRecording];
+  STAssertTrue([recorder isRecording], nil);
+  NSDictionary *trace = HGSQueryTraceTestTrace(0.1, 1000000ULL);
+  HGSQueryTraceReplayer *replayer
+    = [[[HGSQueryTraceReplayer alloc] initWithTrace:trace] autorelease];
+  STAssertTrue([replayer replay], nil);
+  [recorder stopRecording];
+  STAssertFalse([recorder isRecording], nil);
+
+  NSDictionary *recorded = [recorder trace];
+  NSArray *events = [recorded objectForKey:@"events"];
+  STAssertEquals([events count], (NSUInteger)3, nil);
+  NSDictionary *event = [events objectAtIndex:1];
+  STAssertEqualObjects([event objectForKey:@"query"], @"fo", nil);
+  NSDictionary *runs = [event objectForKey:@"sourceRuns"];
+  STAssertNotNil([runs objectForKey:kTraceSourceA], nil);
+  STAssertNotNil([runs objectForKey:kTraceSourceB], nil);
+  NSDictionary *sources = [recorded objectForKey:@"sources"];
+  NSDictionary *sourceA = [sources objectForKey:kTraceSourceA];
+  // Only the results that were returned make it into the corpus, but the
+  // corpus size is the size of the whole memory source.
+  STAssertEquals([[sourceA objectForKey:@"corpus"] count], (NSUInteger)1, nil);
+  STAssertEquals([[sourceA objectForKey:@"corpusSize"] intValue], 2, nil);
+
+  // The recording round trips through a file and replays the same way.
+  NSString *path
+    = [NSTemporaryDirectory() stringByAppendingPathComponent:
+       @"HGSQueryTraceTest.plist"];
+  STAssertTrue([recorder writeToFile:path], nil);
+  HGSQueryTraceReplayer *rereplayer
+    = [HGSQueryTraceReplayer replayerWithContentsOfFile:path];
+  STAssertNotNil(rereplayer, nil);
+  STAssertTrue([rereplayer replay], nil);
+  NSArray *keystrokes = [rereplayer keystrokes];
+  STAssertEquals([keystrokes count], (NSUInteger)3, nil);
+  NSNumber *count = [[keystrokes objectAtIndex:1]
+                     objectForKey:kHGSQueryTraceKeystrokeResultCountKey];
+  STAssertEquals([count unsignedIntegerValue], (NSUInteger)2, nil);
+  [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+@end
@@ -0,0 +1,106 @@
+//
+//  HGSQueryUpdateCoalescer.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+/*!
+ @header
+ @discussion HGSQueryUpdateCoalescer
+*/
+
+#import <Foundation/Foundation.h>
+
+/*!
+  The default delivery window, about one display frame.
+*/
+extern const NSTimeInterval kHGSQueryUpdateCoalescerDefaultWindow;
+
+/*!
+  Batches the result updates of the search operations of one query so the
+  main thread hears about them once per window instead of once per update.
+
+  Operations report updates from any thread. The first update of a batch
+  puts a single timer on the main run loop; when it fires, every operation
+  that reported during the window gets its
+  kHGSSearchOperationDidUpdateResultsNotification posted, and then the target
+  is sent the selector with an array of those operations, each listed once.
+
+  Once invalidated, a coalescer drops pending and future updates on the
+  thread that reports them, so updates for a query that has been superseded
+  never reach the main thread.
+*/
+@interface HGSQueryUpdateCoalescer : NSObject {
+ @private
+  id target_;  // weak
+  SEL selector_;
+  NSTimeInterval window_;
+  NSMutableArray *pendingOperations_;
+  NSTimer *deliveryTimer_;
+  BOOL invalidated_;
+  NSUInteger updateCount_;
+  NSUInteger deliveryCount_;
+  uint64_t deliveryTime_;
+}
+
+/*!
+  The selector takes one argument, the NSArray of operations that updated.
+  Target is not retained.
+*/
+- (id)initWithTarget:(id)target
+            selector:(SEL)selector
+              window:(NSTimeInterval)window;
+
+/*! Notes that |operation| has new results. Can be called from any thread. */
+- (void)noteUpdatedOperation:(id)operation;
+
+/*!
+  Delivers |operation|'s pending update, if it has one, right away instead
+  of at the end of the window. Used when an operation finishes so that its
+  last results are in place before anyone hears that it is done. Must be
+  called on the main thread.
+*/
+- (void)flushOperation:(id)operation;
+
+/*!
+  Drops pending updates and stops delivering. Must be called on the main
+  thread.
+*/
+- (void)invalidate;
+
+/*! Updates reported, including ones that were dropped. */
+- (NSUInteger)updateCount;
+
+/*! Batches delivered to the target. */
+- (NSUInteger)deliveryCount;
+
+/*! Total main thread time spent delivering batches, in nanoseconds. */
+- (uint64_t)deliveryTime;
+
+@end
@@ -0,0 +1,162 @@
+//
+//  HGSQueryUpdateCoalescer.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSQueryUpdateCoalescer.h"
+#import <mach/mach_time.h>
+#import "HGSSearchOperation.h"
+#import "HGSLatencyHistogram.h"
+
+const NSTimeInterval kHGSQueryUpdateCoalescerDefaultWindow = 1.0 / 60.0;
+
+@interface HGSQueryUpdateCoalescer ()
+- (void)deliverUpdates:(NSTimer *)timer;
+- (void)deliverOperations:(NSArray *)operations;
+@end
+
+@implementation HGSQueryUpdateCoalescer
+
+- (id)initWithTarget:(id)target
+            selector:(SEL)selector
+              window:(NSTimeInterval)window {
+  if ((self = [super init])) {
+    target_ = target;
+    selector_ = selector;
+    window_ = window;
+    pendingOperations_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [pendingOperations_ release];
+  [super dealloc];
+}
+
+- (void)noteUpdatedOperation:(id)operation {
+  @synchronized (self) {
+    ++updateCount_;
+    if (invalidated_) return;
+    if (![pendingOperations_ containsObject:operation]) {
+      [pendingOperations_ addObject:operation];
+    }
+    if (!deliveryTimer_) {
+      // CFRunLoopAddTimer is safe to call from any thread. The run loop
+      // retains the timer, and the timer retains us, until it fires or is
+      // invalidated.
+      deliveryTimer_ = [NSTimer timerWithTimeInterval:window_
+                                               target:self
+                                             selector:@selector(deliverUpdates:)
+                                             userInfo:nil
+                                              repeats:NO];
+      CFRunLoopAddTimer(CFRunLoopGetMain(),
+                        (CFRunLoopTimerRef)deliveryTimer_,
+                        kCFRunLoopCommonModes);
+    }
+  }
+}
+
+- (void)deliverUpdates:(NSTimer *)timer {
+  NSArray *operations = nil;
+  @synchronized (self) {
+    if (deliveryTimer_ == timer) {
+      deliveryTimer_ = nil;
+    }
+    if (invalidated_) return;
+    operations = [[pendingOperations_ copy] autorelease];
+    [pendingOperations_ removeAllObjects];
+  }
+  [self deliverOperations:operations];
+}
+
+- (void)flushOperation:(id)operation {
+  NSArray *operations = nil;
+  @synchronized (self) {
+    if (invalidated_ || ![pendingOperations_ containsObject:operation]) {
+      return;
+    }
+    [pendingOperations_ removeObject:operation];
+    operations = [NSArray arrayWithObject:operation];
+    // Leave the timer running for any other operations; if there are none
+    // it finds nothing to deliver.
+  }
+  [self deliverOperations:operations];
+}
+
+- (void)deliverOperations:(NSArray *)operations {
+  if (![operations count]) return;
+  uint64_t startTime = mach_absolute_time();
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  for (id operation in operations) {
+    [nc postNotificationName:kHGSSearchOperationDidUpdateResultsNotification
+                      object:operation];
+  }
+  [target_ performSelector:selector_ withObject:operations];
+  uint64_t elapsed = mach_absolute_time() - startTime;
+  @synchronized (self) {
+    ++deliveryCount_;
+    deliveryTime_ += HGSMachTimeToNanoseconds(elapsed);
+  }
+}
+
+- (void)invalidate {
+  NSTimer *timer = nil;
+  @synchronized (self) {
+    invalidated_ = YES;
+    target_ = nil;
+    [pendingOperations_ removeAllObjects];
+    timer = deliveryTimer_;
+    deliveryTimer_ = nil;
+  }
+  // The timer may be the last thing holding on to us.
+  [[self retain] autorelease];
+  [timer invalidate];
+}
+
+- (NSUInteger)updateCount {
+  @synchronized (self) {
+    return updateCount_;
+  }
+}
+
+- (NSUInteger)deliveryCount {
+  @synchronized (self) {
+    return deliveryCount_;
+  }
+}
+
+- (uint64_t)deliveryTime {
+  @synchronized (self) {
+    return deliveryTime_;
+  }
+}
+
+@end
@@ -0,0 +1,217 @@
+//
+//  HGSQueryUpdateCoalescerTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import "HGSQueryUpdateCoalescer.h"
+#import "HGSSearchOperation.h"
+#import <libkern/OSAtomic.h>
+
+// Roughly the number of sources a full query fans out to.
+static const NSUInteger kOperationCount = 30;
+static const NSUInteger kUpdatesPerOperation = 2000;
+
+@interface HGSQueryUpdateCoalescerTest : GTMTestCase {
+ @private
+  HGSQueryUpdateCoalescer *coalescer_;
+  NSMutableArray *batches_;
+  NSUInteger notificationCount_;
+  int32_t threadsFinished_;
+}
+@end
+
+@implementation HGSQueryUpdateCoalescerTest
+
+- (void)setUp {
+  batches_ = [[NSMutableArray alloc] init];
+  notificationCount_ = 0;
+  threadsFinished_ = 0;
+}
+
+- (void)tearDown {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [coalescer_ invalidate];
+  [coalescer_ release];
+  coalescer_ = nil;
+  [batches_ release];
+  batches_ = nil;
+}
+
+- (void)operationsDidUpdate:(NSArray *)operations {
+  STAssertTrue([NSThread isMainThread], nil);
+  [batches_ addObject:operations];
+}
+
+- (void)operationDidUpdate:(NSNotification *)notification {
+  ++notificationCount_;
+}
+
+- (void)spinRunLoopFor:(NSTimeInterval)seconds {
+  NSDate *until = [NSDate dateWithTimeIntervalSinceNow:seconds];
+  while ([until timeIntervalSinceNow] > 0) {
+    [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                             beforeDate:until];
+  }
+}
+
+- (void)updateFromThread:(id)operation {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (NSUInteger i = 0; i < kUpdatesPerOperation; ++i) {
+    [coalescer_ noteUpdatedOperation:operation];
+  }
+  OSAtomicIncrement32Barrier(&threadsFinished_);
+  [pool release];
+}
+
+- (void)testSingleThread {
+  coalescer_ = [[HGSQueryUpdateCoalescer alloc]
+                initWithTarget:self
+                      selector:@selector(operationsDidUpdate:)
+                        window:0.01];
+  NSString *opA = @"a";
+  NSString *opB = @"b";
+  [coalescer_ noteUpdatedOperation:opA];
+  [coalescer_ noteUpdatedOperation:opB];
+  [coalescer_ noteUpdatedOperation:opA];
+  STAssertEquals([batches_ count], (NSUInteger)0, @"Delivered synchronously");
+  [self spinRunLoopFor:0.1];
+  STAssertEquals([batches_ count], (NSUInteger)1, nil);
+  NSArray *expected = [NSArray arrayWithObjects:opA, opB, nil];
+  STAssertEqualObjects([batches_ objectAtIndex:0], expected, nil);
+  STAssertEquals([coalescer_ updateCount], (NSUInteger)3, nil);
+  STAssertEquals([coalescer_ deliveryCount], (NSUInteger)1, nil);
+
+  // A later update starts a new batch.
+  [coalescer_ noteUpdatedOperation:opB];
+  [self spinRunLoopFor:0.1];
+  STAssertEquals([batches_ count], (NSUInteger)2, nil);
+  STAssertEqualObjects([batches_ objectAtIndex:1],
+                       [NSArray arrayWithObject:opB], nil);
+}
+
+- (void)testPostsOperationNotifications {
+  coalescer_ = [[HGSQueryUpdateCoalescer alloc]
+                initWithTarget:self
+                      selector:@selector(operationsDidUpdate:)
+                        window:0.01];
+  NSString *op = @"op";
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(operationDidUpdate:)
+           name:kHGSSearchOperationDidUpdateResultsNotification
+         object:op];
+  for (NSUInteger i = 0; i < 100; ++i) {
+    [coalescer_ noteUpdatedOperation:op];
+  }
+  [self spinRunLoopFor:0.1];
+  STAssertEquals(notificationCount_, (NSUInteger)1, nil);
+}
+
+- (void)testFlushOperation {
+  coalescer_ = [[HGSQueryUpdateCoalescer alloc]
+                initWithTarget:self
+                      selector:@selector(operationsDidUpdate:)
+                        window:0.01];
+  NSString *opA = @"a";
+  NSString *opB = @"b";
+  [coalescer_ noteUpdatedOperation:opA];
+  [coalescer_ noteUpdatedOperation:opB];
+  // Flushing delivers just that operation, straight away.
+  [coalescer_ flushOperation:opA];
+  STAssertEquals([batches_ count], (NSUInteger)1, nil);
+  STAssertEqualObjects([batches_ objectAtIndex:0],
+                       [NSArray arrayWithObject:opA], nil);
+  // Nothing pending for it, so nothing happens.
+  [coalescer_ flushOperation:opA];
+  STAssertEquals([batches_ count], (NSUInteger)1, nil);
+  // The rest still goes out at the end of the window.
+  [self spinRunLoopFor:0.1];
+  STAssertEquals([batches_ count], (NSUInteger)2, nil);
+  STAssertEqualObjects([batches_ objectAtIndex:1],
+                       [NSArray arrayWithObject:opB], nil);
+}
+
+- (void)testInvalidate {
+  coalescer_ = [[HGSQueryUpdateCoalescer alloc]
+                initWithTarget:self
+                      selector:@selector(operationsDidUpdate:)
+                        window:0.01];
+  [coalescer_ noteUpdatedOperation:@"pending"];
+  [coalescer_ invalidate];
+  [coalescer_ noteUpdatedOperation:@"late"];
+  [self spinRunLoopFor:0.1];
+  STAssertEquals([batches_ count], (NSUInteger)0, nil);
+  STAssertEquals([coalescer_ updateCount], (NSUInteger)2, nil);
+  STAssertEquals([coalescer_ deliveryCount], (NSUInteger)0, nil);
+}
+
+// Many operations hammering the coalescer from their own threads, the way a
+// burst of sources reports in while the user types. Most of the updates have
+// to be merged, and every operation has to be delivered.
+- (void)testConcurrentUpdates {
+  coalescer_ = [[HGSQueryUpdateCoalescer alloc]
+                initWithTarget:self
+                      selector:@selector(operationsDidUpdate:)
+                        window:kHGSQueryUpdateCoalescerDefaultWindow];
+  NSMutableArray *operations = [NSMutableArray array];
+  for (NSUInteger i = 0; i < kOperationCount; ++i) {
+    NSString *operation = [NSString stringWithFormat:@"operation %u", i];
+    [operations addObject:operation];
+    [NSThread detachNewThreadSelector:@selector(updateFromThread:)
+                             toTarget:self
+                           withObject:operation];
+  }
+  NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:30];
+  while (threadsFinished_ < (int32_t)kOperationCount
+         && [timeout timeIntervalSinceNow] > 0) {
+    [self spinRunLoopFor:0.01];
+  }
+  STAssertEquals(threadsFinished_, (int32_t)kOperationCount, nil);
+  // Let the last batch go out.
+  [self spinRunLoopFor:kHGSQueryUpdateCoalescerDefaultWindow * 4];
+
+  NSUInteger updateCount = [coalescer_ updateCount];
+  NSUInteger deliveryCount = [coalescer_ deliveryCount];
+  STAssertEquals(updateCount, kOperationCount * kUpdatesPerOperation, nil);
+  STAssertEquals([batches_ count], deliveryCount, nil);
+  STAssertLessThan(deliveryCount * 10, updateCount, nil);
+
+  NSMutableSet *updated = [NSMutableSet set];
+  for (NSArray *batch in batches_) {
+    NSSet *batchSet = [NSSet setWithArray:batch];
+    STAssertEquals([batchSet count], [batch count],
+                   @"Operations should only be listed once per batch");
+    [updated unionSet:batchSet];
+  }
+  STAssertEqualObjects(updated, [NSSet setWithArray:operations], nil);
+}
+
+@end
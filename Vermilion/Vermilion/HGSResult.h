@@ -132,11 +132,20 @@ extern NSString* const kHGSObjectStatusStaleValue;
  @public
   NSUInteger hash_;
   HGSIconProvider *iconProvider_;
+ @private
+  // Values (or NSNull) that the source has provided.
+  NSMutableDictionary *valueCache_;
 }
 
 /*!
  Get an attribute by name. |-valueForKey:| may return a placeholder value that
  is to be updated later via KVO.
+ 
+ Values provided by the source (including the lack of one) are remembered,
+ unless the key is one of the source's volatileResultKeys. Values provided by
+ the HGSDelegate are not, since the delegate's values may refer back to the
+ result.
+ A KVO change notification for a key on the result forgets its value.
  */
 - (id)valueForKey:(NSString*)key;
 
@@ -99,6 +99,9 @@ NSString* const kHGSObjectStatusStaleValue = @"HGSObjectStatusStaleValue";
 
 @interface HGSResult ()
 -(NSDictionary *)attributes;
+// Asks the source, and then the delegate, for a value for |key|. Only the
+// source's answer is cached, and only if the key isn't volatile.
+- (id)providedValueForKey:(NSString *)key;
 @end
 
 @interface HGSUnscoredContactResult : HGSUnscoredResult
@@ -122,6 +125,7 @@ NSString* const kHGSObjectStatusStaleValue = @"HGSObjectStatusStaleValue";
 - (void)dealloc {
   [iconProvider_ invalidate];
   [iconProvider_ release];
+  [valueCache_ release];
   [super dealloc];
 }
 
@@ -154,14 +158,7 @@ NSString* const kHGSObjectStatusStaleValue = @"HGSObjectStatusStaleValue";
       }
     }
     if (!value) {
-      // If we haven't provided a value, ask our source for a value.
-      value = [[self source] provideValueForKey:key result:self];
-    }
-    if (!value) {
-      // If neither self or source provides a value, ask our HGSDelegate.
-      HGSPluginLoader *loader = [HGSPluginLoader sharedPluginLoader];
-      id <HGSDelegate> delegate = [loader delegate];
-      value = [delegate provideValueForKey:key result:self];
+      value = [self providedValueForKey:key];
     }
   }
   if (!value) {
@@ -171,6 +168,57 @@ NSString* const kHGSObjectStatusStaleValue = @"HGSObjectStatusStaleValue";
   return [[value retain] autorelease];
 }
 
+- (id)providedValueForKey:(NSString *)key {
+  // Icons already have their own cache in the icon provider (and sources that
+  // provide their own icons may change them at any time).
+  HGSSearchSource *source = [self source];
+  BOOL cacheable 
+    = !([key isEqualToString:kHGSObjectAttributeIconKey]
+        || [key isEqualToString:kHGSObjectAttributeImmediateIconKey]
+        || [[source volatileResultKeys] containsObject:key]);
+  id value = nil;
+  BOOL cached = NO;
+  if (cacheable) {
+    @synchronized(self) {
+      value = [[[valueCache_ objectForKey:key] retain] autorelease];
+    }
+    cached = value != nil;
+    if (value == [NSNull null]) {
+      value = nil;
+    }
+  }
+  if (!cached) {
+    // If we haven't provided a value, ask our source for a value.
+    value = [source provideValueForKey:key result:self];
+    if (cacheable) {
+      @synchronized(self) {
+        if (!valueCache_) {
+          valueCache_ = [[NSMutableDictionary alloc] init];
+        }
+        [valueCache_ setObject:value ? value : [NSNull null] forKey:key];
+      }
+    }
+  }
+  if (!value) {
+    // If neither self or source provides a value, ask our HGSDelegate.
+    // What the delegate provides is never cached here. It may hold on to us
+    // (the QSB table result does), and it keeps its own caches with their
+    // own lifetimes.
+    HGSPluginLoader *loader = [HGSPluginLoader sharedPluginLoader];
+    id <HGSDelegate> delegate = [loader delegate];
+    value = [delegate provideValueForKey:key result:self];
+  }
+  return value;
+}
+
+- (void)didChangeValueForKey:(NSString *)key {
+  // Forget the old value before any observers come asking for the new one.
+  @synchronized(self) {
+    [valueCache_ removeObjectForKey:key];
+  }
+  [super didChangeValueForKey:key];
+}
+
 - (id)valueForUndefinedKey:(NSString *)key {
   return nil;
 }
@@ -35,11 +35,44 @@
 #import <GTM/GTMNSFileHandle+UniqueName.h>
 #import <OCMock/OCMock.h>
 #import "HGSResult.h"
+#import "HGSDelegate.h"
+#import "HGSPluginLoader.h"
 #import "HGSSearchSource.h"
 
 @interface HGSResultTest : GTMTestCase
 @end
 
+// Stands in for a source that computes its values on demand.
+@interface HGSCountingTestSource : NSObject {
+ @private
+  NSUInteger provideCount_;
+}
+- (NSUInteger)provideCount;
+- (NSSet *)volatileResultKeys;
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result;
+@end
+
+@implementation HGSCountingTestSource
+
+- (NSUInteger)provideCount {
+  return provideCount_;
+}
+
+- (NSSet *)volatileResultKeys {
+  return [NSSet setWithObject:@"volatile"];
+}
+
+- (id)provideValueForKey:(NSString *)key result:(HGSResult *)result {
+  ++provideCount_;
+  id value = nil;
+  if (![key isEqualToString:@"missing"]) {
+    value = [NSString stringWithFormat:@"%@ of %@", key, [result displayName]];
+  }
+  return value;
+}
+
+@end
+
 @implementation HGSResultTest
 
 - (void)testStaticInit {
@@ -110,6 +143,7 @@
   [[[searchSourceMock expect]
     andReturn:kHGSObjectAttributeSnippetKey]
    provideValueForKey:kHGSObjectAttributeSnippetKey result:infoObject];
+  [[[searchSourceMock stub] andReturn:nil] volatileResultKeys];
   STAssertEqualStrings(kHGSObjectAttributeSnippetKey,
                        [infoObject valueForKey:kHGSObjectAttributeSnippetKey],
                        @"didn't find template");
@@ -139,6 +173,77 @@
   STAssertNil(emptyObject, @"created object from empty dict");
 }
 
+- (void)testValueCache {
+  HGSCountingTestSource *source 
+    = [[[HGSCountingTestSource alloc] init] autorelease];
+  HGSUnscoredResult *result 
+    = [HGSUnscoredResult resultWithURI:@"http://someplace/"
+                                  name:@"name"
+                                  type:@"test"
+                                source:(HGSSearchSource *)source
+                            attributes:nil];
+  
+  // Provided values are asked for once, including missing ones.
+  STAssertEqualObjects([result valueForKey:@"cached"], @"cached of name", nil);
+  STAssertEqualObjects([result valueForKey:@"cached"], @"cached of name", nil);
+  STAssertNil([result valueForKey:@"missing"], nil);
+  STAssertNil([result valueForKey:@"missing"], nil);
+  STAssertEquals([source provideCount], (NSUInteger)2, nil);
+  
+  // Volatile keys are asked for every time.
+  [result valueForKey:@"volatile"];
+  [result valueForKey:@"volatile"];
+  STAssertEquals([source provideCount], (NSUInteger)4, nil);
+  
+  // A KVO change notification forgets the value.
+  [result willChangeValueForKey:@"cached"];
+  [result didChangeValueForKey:@"cached"];
+  [result valueForKey:@"cached"];
+  STAssertEquals([source provideCount], (NSUInteger)5, nil);
+
+  // What the delegate provides is asked for every time, since it may hold
+  // on to the result. The source's lack of a value is still remembered.
+  HGSPluginLoader *loader = [HGSPluginLoader sharedPluginLoader];
+  id<HGSDelegate> oldDelegate = [loader delegate];
+  id delegate = [OCMockObject mockForProtocol:@protocol(HGSDelegate)];
+  [[[delegate expect] andReturn:@"delegate"] provideValueForKey:@"missing"
+                                                         result:result];
+  [[[delegate expect] andReturn:@"delegate"] provideValueForKey:@"missing"
+                                                         result:result];
+  [loader setDelegate:delegate];
+  STAssertEqualObjects([result valueForKey:@"missing"], @"delegate", nil);
+  STAssertEqualObjects([result valueForKey:@"missing"], @"delegate", nil);
+  [loader setDelegate:oldDelegate];
+  [delegate verify];
+  STAssertEquals([source provideCount], (NSUInteger)5, nil);
+  
+  // Repeated lookups on a set of results, like the UI makes for every row on
+  // every keystroke, only go to the source once per result for a cached key.
+  NSMutableArray *results = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 100; ++i) {
+    NSString *name = [NSString stringWithFormat:@"result %u", (unsigned)i];
+    HGSUnscoredResult *newResult
+      = [HGSUnscoredResult resultWithURI:@"http://someplace/"
+                                    name:name
+                                    type:@"test"
+                                  source:(HGSSearchSource *)source
+                              attributes:nil];
+    [results addObject:newResult];
+  }
+  NSString *keys[] = { @"cached", @"volatile" };
+  NSUInteger expectedProvides[] = { 100, 10000 };
+  for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); ++k) {
+    NSUInteger startCount = [source provideCount];
+    for (NSUInteger pass = 0; pass < 100; ++pass) {
+      for (HGSResult *scanResult in results) {
+        [scanResult valueForKey:keys[k]];
+      }
+    }
+    STAssertEquals([source provideCount] - startCount, expectedProvides[k],
+                   @"Key: %@", keys[k]);
+  }
+}
+
 - (void)testTypeCalls {
   NSString* url = @"http://someplace/";
   STAssertNotNil(url, nil);
@@ -32,8 +32,11 @@
 
 #import "HGSSQLiteBackedCache.h"
 #import "HGSLog.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSDTrace.h"
 
 #import "GTMSQLite.h"
+#import <mach/mach_time.h>
 
 static NSTimeInterval const kCacheDefaultFlushInterval = 60.0; // once a minute
 static NSTimeInterval const kCacheDefaultMaximumAge = 3600 * 24 * 7 * 2; // 2 weeks
@@ -349,6 +352,7 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
 
 // Read value from an SQL backend.
 - (id)valueForKey:(NSString *)key {
+  uint64_t startTime = mach_absolute_time();
   NSString* selectStatement = @"SELECT value FROM cache WHERE key = ?";
   int errorCode;
   GTMSQLiteStatement *statement =
@@ -371,6 +375,21 @@ static NSString* const kMetaDataSchema = @"CREATE TABLE IF NOT EXISTS metadata (
     HGSLog(@"Error occurred executing statement: %@", [db_ lastErrorString]);
     return nil;
   }
+  [[HGSLatencyHistogramRegistry sharedRegistry]
+   recordMachTime:mach_absolute_time() - startTime
+         forStage:kHGSLatencyStageCache
+           source:nil];
+  if (result == SQLITE_ROW) {
+    if (VERMILION_CACHE_HIT_ENABLED()) {
+      VERMILION_CACHE_HIT((char *)[dbPath_ fileSystemRepresentation],
+                          (char *)[key UTF8String]);
+    }
+  } else {
+    if (VERMILION_CACHE_MISS_ENABLED()) {
+      VERMILION_CACHE_MISS((char *)[dbPath_ fileSystemRepresentation],
+                           (char *)[key UTF8String]);
+    }
+  }
   if (result != SQLITE_ROW) {
     // Not found.
     [statement finalizeStatement];
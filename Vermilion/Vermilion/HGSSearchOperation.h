@@ -39,6 +39,7 @@
 */
 
 @class HGSQuery;
+@class HGSQueryUpdateCoalescer;
 @class HGSSearchSource;
 @class HGSScoredResult;
 @class HGSTypeFilter;
@@ -56,6 +57,12 @@
   HGSQuery *query_;
   uint64_t queueTime_;
   uint64_t runTime_;
+  // Non-zero while we are counted as interactive work by HGSOperationQueue.
+  int32_t interactiveWork_;
+  // Set once by whichever comes first, the operation starting to run or
+  // being cancelled before it ran.
+  int32_t started_;
+  HGSQueryUpdateCoalescer *updateCoalescer_;
 }
 
 @property (readonly, retain) HGSSearchSource *source;
@@ -71,6 +78,11 @@
 @property (readonly, assign, getter=isFinished) BOOL finished;
 @property (readonly, assign, getter=isCancelled) BOOL cancelled;
 @property (readonly, retain) NSString *displayName;
+/*!
+ Batches the operation's result updates with those of the other operations
+ for its query. Set by HGSQueryController before the operation runs.
+*/
+@property (readwrite, retain) HGSQueryUpdateCoalescer *updateCoalescer;
 
 - (id)initWithQuery:(HGSQuery*)query source:(HGSSearchSource *)source;
 
@@ -82,9 +94,17 @@
 */
 - (void)finishQuery;
 
+/*!
+ Tells observers that the results have changed. Can be called from any
+ thread. Goes through the update coalescer if there is one, otherwise posts
+ kHGSSearchOperationDidUpdateResultsNotification on the main thread.
+*/
+- (void)postResultsDidUpdate;
+
 /*!
  Cancels this operation and clears the observer so no more notification will
- come in.
+ come in. An operation that hasn't started running yet is finished straight
+ away, so kHGSSearchOperationDidFinishNotification is still posted.
 */
 - (void)cancel;
 
@@ -93,6 +113,27 @@
  on the current thread, otherwise it will be posted to an NSOperationQueue.
 */
 - (void)runOnCurrentThread:(BOOL)onThread;
+
+/*!
+ How long (in absolute time) the operation has been running. 0 if it hasn't
+ started yet or has already finished.
+*/
+- (uint64_t)elapsedRunTime;
+
+/*!
+ Adds the number of results each filter in |filters| lets through to the
+ matching entry in |counts|. The default version calls resultCountForFilter:
+ once per filter. Subclasses that have all their results at hand count them
+ in a single pass instead.
+ @param filters HGSTypeFilters to count results for.
+ @param typeMatches Caches the indexes of the filters in |filters| that
+        accept a type, keyed by type. Share it between calls with the same
+        |filters|.
+ @param counts One count per filter.
+*/
+- (void)addResultCountsForFilters:(NSArray *)filters
+                      typeMatches:(NSMutableDictionary *)typeMatches
+                         toCounts:(NSUInteger *)counts;
 @end
 
 /*!
@@ -32,9 +32,14 @@
 
 #import "HGSSearchOperation.h"
 #import <mach/mach_time.h>
+#import <libkern/OSAtomic.h>
 #import "HGSSearchSource.h"
+#import "HGSTypeFilter.h"
 #import "HGSOperation.h"
 #import "HGSLog.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSDTrace.h"
+#import "HGSQueryUpdateCoalescer.h"
 #import "NSNotificationCenter+MainThread.h"
 
 NSString *const kHGSSearchOperationWillStartNotification 
@@ -48,6 +53,7 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 
 @interface HGSSearchOperation ()
 @property (assign, getter=isFinished) BOOL finished;
+- (void)endInteractiveWork;
 @end
 
 @implementation HGSSearchOperation
@@ -57,6 +63,7 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 @synthesize finished = finished_;
 @synthesize runTime = runTime_;
 @synthesize queueTime = queueTime_;
+@synthesize updateCoalescer = updateCoalescer_;
 @dynamic concurrent;
 @dynamic cancelled;
 
@@ -77,6 +84,7 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 - (void)dealloc {
   [source_ release];
   [query_ release];
+  [updateCoalescer_ release];
   [super dealloc];
 }
 
@@ -90,12 +98,28 @@ NSString *const kHGSSearchOperationWasCancelledNotification
     // do anything from a threading pov.  If |operation_| were in a queue to run,
     // the queue would have a retain on it, so it won't get freed from under it.
     queryCancelled_ = YES;
+    [self endInteractiveWork];
     [operation_ cancel];
     [operation_ release];
     operation_ = nil;
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationWasCancelledNotification
                                       object:self];
+    // If it never got to run, nothing else is going to finish it.
+    if (OSAtomicCompareAndSwap32Barrier(0, 1, &started_)) {
+      [self finishQuery];
+    }
+  }
+}
+
+- (void)postResultsDidUpdate {
+  HGSQueryUpdateCoalescer *coalescer = [self updateCoalescer];
+  if (coalescer) {
+    [coalescer noteUpdatedOperation:self];
+  } else {
+    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidUpdateResultsNotification
+                                      object:self];
   }
 }
 
@@ -125,12 +149,32 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 }
   
 - (void)queryOperation:(id)ignored {
-  if (![self isCancelled]) {
+  // Cancelled before it ran, and cancel has already finished it.
+  if (!OSAtomicCompareAndSwap32Barrier(0, 1, &started_)) return;
+  if ([self isCancelled]) {
+    // Cancelled just as it started to run; we own finishing it.
+    [self finishQuery];
+  } else {
+    // Set the start time before saying we started, observers time our
+    // deadline from it.
+    runTime_ = mach_absolute_time();
     NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
     [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationWillStartNotification
                                       object:self];
-    runTime_ = mach_absolute_time();
     queueTime_ = runTime_ - queueTime_;
+    if (interactiveWork_) {
+      HGSOperationQueue *queue = [HGSOperationQueue interactiveOperationQueue];
+      [queue noteOperationWaited:queueTime_];
+    }
+    NSString *identifier = [source_ identifier];
+    [[source_ latencyHistogramForStage:kHGSLatencyStageQueue]
+     recordMachTime:queueTime_];
+    if (VERMILION_OPERATION_RUN_ENABLED()) {
+      NSString *ptr = [NSString stringWithFormat:@"%p", self];
+      VERMILION_OPERATION_RUN((char *)[identifier UTF8String],
+                              (char *)[ptr UTF8String],
+                              HGSMachTimeToNanoseconds(queueTime_));
+    }
     if ([self isConcurrent]) {
       if ([NSThread currentThread] == [NSThread mainThread]) {
         [self wrappedMain];
@@ -159,7 +203,15 @@ NSString *const kHGSSearchOperationWasCancelledNotification
   }
 }
 
+// Safe to call more than once, and from any thread.
+- (void)endInteractiveWork {
+  if (OSAtomicCompareAndSwap32Barrier(1, 0, &interactiveWork_)) {
+    [HGSOperationQueue endInteractiveWork];
+  }
+}
+
 - (void)finishQuery {
+  [self endInteractiveWork];
   [operation_ release];
   operation_ = nil;
   if ([self isFinished]) {
@@ -173,13 +225,50 @@ NSString *const kHGSSearchOperationWasCancelledNotification
     // Never send the notification twice
     return;
   }
-  runTime_ = mach_absolute_time() - runTime_;
+  // runTime_ is still 0 if the operation was cancelled before it ran.
+  BOOL ran = runTime_ != 0;
+  if (ran) {
+    runTime_ = mach_absolute_time() - runTime_;
+  }
   [self setFinished:YES];
+  BOOL cancelled = [self isCancelled];
+  NSString *identifier = [source_ identifier];
+  if (ran && !cancelled) {
+    [[source_ latencyHistogramForStage:kHGSLatencyStageRun]
+     recordMachTime:runTime_];
+  }
+  if (ran && VERMILION_OPERATION_FINISH_ENABLED()) {
+    NSString *ptr = [NSString stringWithFormat:@"%p", self];
+    VERMILION_OPERATION_FINISH((char *)[identifier UTF8String],
+                               (char *)[ptr UTF8String],
+                               HGSMachTimeToNanoseconds(runTime_),
+                               cancelled);
+  }
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
   [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidFinishNotification
                                     object:self];
 }
 
+- (void)addResultCountsForFilters:(NSArray *)filters
+                      typeMatches:(NSMutableDictionary *)typeMatches
+                         toCounts:(NSUInteger *)counts {
+  HGSTypeFilter *sourceFilter = [[self source] resultTypeFilter];
+  NSUInteger idx = 0;
+  for (HGSTypeFilter *filter in filters) {
+    if ([sourceFilter intersectsWithFilter:filter]) {
+      counts[idx] += [self resultCountForFilter:filter];
+    }
+    ++idx;
+  }
+}
+
+- (uint64_t)elapsedRunTime {
+  // Until the operation finishes runTime_ holds the time it started at.
+  uint64_t startTime = runTime_;
+  if (!startTime || [self isFinished]) return 0;
+  return mach_absolute_time() - startTime;
+}
+
 - (void)main {
   // Since SearchSources are the only thing that needs to create these, we use
   // their pref for enabling extra logging to help developers out.
@@ -241,11 +330,20 @@ NSString *const kHGSSearchOperationWasCancelledNotification
 - (void)runOnCurrentThread:(BOOL)onThread {
   NSOperation *operation = [self searchOperation];
   queueTime_ = mach_absolute_time();
+  if (VERMILION_OPERATION_QUEUE_ENABLED()) {
+    NSString *ptr = [NSString stringWithFormat:@"%p", self];
+    VERMILION_OPERATION_QUEUE((char *)[[source_ identifier] UTF8String],
+                              (char *)[ptr UTF8String]);
+  }
   if (onThread) {
     [self queryOperation:nil];
   } else {
-    HGSOperationQueue *queue = [HGSOperationQueue sharedOperationQueue];
+    // Search operations get their own lane so that they don't wait behind
+    // indexing in the shared queue.
+    HGSOperationQueue *queue = [HGSOperationQueue interactiveOperationQueue];
     [operation setQueuePriority:NSOperationQueuePriorityVeryHigh];
+    interactiveWork_ = 1;
+    [HGSOperationQueue beginInteractiveWork];
     [queue addOperation:operation];
   }
 }
@@ -32,10 +32,48 @@
 
 
 #import "GTMSenTestCase.h"
+#import <OCMock/OCMock.h>
 #import "HGSSearchOperation.h"
+#import "HGSSearchSource.h"
+#import "HGSQuery.h"
 
-@interface HGSSearchOperationTest : GTMTestCase 
+@interface HGSSearchOperationTest : GTMTestCase {
+ @private
+  NSUInteger finishCount_;
+}
 @end
 
 @implementation HGSSearchOperationTest
+
+- (void)searchOperationDidFinish:(NSNotification *)notification {
+  ++finishCount_;
+}
+
+- (void)testCancelBeforeRunning {
+  id source = [OCMockObject niceMockForClass:[HGSSearchSource class]];
+  HGSQuery *query
+    = [[[HGSQuery alloc] initWithString:@"cancel"
+                         actionArgument:nil
+                        actionOperation:nil
+                           pivotObjects:nil
+                             queryFlags:0] autorelease];
+  HGSSearchOperation *operation
+    = [[[HGSSearchOperation alloc] initWithQuery:query
+                                          source:source] autorelease];
+  STAssertNotNil(operation, nil);
+  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  [nc addObserver:self
+         selector:@selector(searchOperationDidFinish:)
+             name:kHGSSearchOperationDidFinishNotification
+           object:operation];
+  finishCount_ = 0;
+  // Never queued, so only cancel can finish it.
+  [operation cancel];
+  [operation cancel];
+  [nc removeObserver:self name:nil object:operation];
+  STAssertTrue([operation isCancelled], nil);
+  STAssertTrue([operation isFinished], nil);
+  STAssertEquals(finishCount_, (NSUInteger)1, nil);
+}
+
 @end
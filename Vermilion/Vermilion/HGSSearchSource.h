@@ -41,6 +41,7 @@
 @class HGSQuery;
 @class HGSSearchOperation;
 @class HGSTypeFilter;
+@class HGSLatencyHistogram;
 
 /*!
   An abstraction for searching a particular collection of data. There will be
@@ -58,8 +59,14 @@
  @protected
   NSSet *pivotableTypes_;
   NSSet *utisToExcludeFromDiskSources_;
+  NSSet *volatileResultKeys_;
   HGSTypeFilter *resultTypeFilter_;
   BOOL cannotArchive_;
+ @private
+  // Looked up on first use; see latencyHistogramForStage:.
+  HGSLatencyHistogram *queueHistogram_;
+  HGSLatencyHistogram *runHistogram_;
+  HGSLatencyHistogram *sortHistogram_;
 }
 
 /*!
@@ -103,6 +110,15 @@
 */
 @property (readonly) BOOL providesIconsForResults;
 
+/*!
+  Keys whose values provideValueForKey:result: may answer differently from one
+  call to the next for the same result (presence, live status, etc.). Values
+  for all other keys are cached by the result the first time they are asked
+  for. Defaults to the value of "HGSSearchSourceVolatileResultKeys" from the
+  config dict.
+*/
+@property (readonly) NSSet *volatileResultKeys;
+
 /*!
  A definition of the types that this source will provide. It is made up of
  the value of "HGSSearchSourceSupportedTypes" and 
@@ -126,7 +142,10 @@
 
 /*!
   Fetch the actual value. This returns value. In some cases you will get a temp
-  value that will be updated in the future via KVO.
+  value that will be updated in the future via KVO. Unless |key| is one of
+  volatileResultKeys this is called at most once per key per result, so
+  sources that update a value later must post KVO change notifications on the
+  result.
   @result Base implementation returns nil.
 */
 - (id)provideValueForKey:(NSString *)key result:(HGSResult *)result;
@@ -177,6 +196,14 @@
 */
 - (Class)resultClass;
 
+/*!
+  Returns this source's histogram for |stage| from the shared
+  HGSLatencyHistogramRegistry. The queue, run and sort histograms are only
+  looked up once, so recording in them takes no locks. Can be called on any
+  thread.
+*/
+- (HGSLatencyHistogram *)latencyHistogramForStage:(NSString *)stage;
+
 @end
 
 /*!
@@ -217,6 +244,11 @@ extern NSString *const kHGSSearchSourcePivotableTypesKey;
 */
 extern NSString *const kHGSSearchSourceCannotArchiveKey;
 
+/*!
+ Configuration dictionary key that controls volatileResultKeys.
+*/
+extern NSString *const kHGSSearchSourceVolatileResultKeysKey;
+
 /*!
  A simple way to register a source for things that we generate in non-standard
  ways, such as items that are dragged in, or otherwise.
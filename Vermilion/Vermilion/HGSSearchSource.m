@@ -39,6 +39,8 @@
 #import "HGSCoreExtensionPoints.h"
 #import "HGSTokenizer.h"
 #import "HGSTypeFilter.h"
+#import "HGSLatencyHistogram.h"
+#import <libkern/OSAtomic.h>
 #import "HGSType.h"
 #import "HGSActionArgument.h"
 
@@ -52,12 +54,15 @@ NSString *const kHGSSearchSourcePivotableTypesKey
   = @"HGSSearchSourcePivotableTypes";
 NSString *const kHGSSearchSourceCannotArchiveKey
 = @"HGSSearchSourceCannotArchive";
+NSString *const kHGSSearchSourceVolatileResultKeysKey
+  = @"HGSSearchSourceVolatileResultKeys";
 
 @implementation HGSSearchSource
 @synthesize pivotableTypes = pivotableTypes_;
 @synthesize cannotArchive = cannotArchive_;
 @synthesize resultTypeFilter = resultTypeFilter_;
 @synthesize utisToExcludeFromDiskSources = utisToExcludeFromDiskSources_;
+@synthesize volatileResultKeys = volatileResultKeys_;
 
 + (void)initialize {
   if (self == [HGSSearchSource class]) {
@@ -87,6 +92,9 @@ NSString *const kHGSSearchSourceCannotArchiveKey
     value = [configuration objectForKey:kHGSSearchSourceCannotArchiveKey];
     cannotArchive_ = [value boolValue];
     
+    value = [configuration objectForKey:kHGSSearchSourceVolatileResultKeysKey];
+    volatileResultKeys_ = [[NSSet qsb_setFromId:value] retain];
+    
     value = [configuration objectForKey:kHGSSearchSourceSupportedTypesKey];
     NSSet *supportedTypes = [NSSet qsb_setFromId:value];
     if (!supportedTypes) {
@@ -106,6 +114,7 @@ NSString *const kHGSSearchSourceCannotArchiveKey
 - (void)dealloc {
   [pivotableTypes_ release];
   [utisToExcludeFromDiskSources_ release];
+  [volatileResultKeys_ release];
   [resultTypeFilter_ release];
   [super dealloc];
 }
@@ -245,6 +254,31 @@ NSString *const kHGSSearchSourceCannotArchiveKey
   return [HGSUnscoredResult class];
 }
 
+- (HGSLatencyHistogram *)latencyHistogramForStage:(NSString *)stage {
+  HGSLatencyHistogram **cached = NULL;
+  if ([stage isEqualToString:kHGSLatencyStageQueue]) {
+    cached = &queueHistogram_;
+  } else if ([stage isEqualToString:kHGSLatencyStageRun]) {
+    cached = &runHistogram_;
+  } else if ([stage isEqualToString:kHGSLatencyStageSort]) {
+    cached = &sortHistogram_;
+  }
+  HGSLatencyHistogram *histogram = cached ? *cached : nil;
+  if (!histogram) {
+    HGSLatencyHistogramRegistry *registry
+      = [HGSLatencyHistogramRegistry sharedRegistry];
+    histogram = [registry histogramForStage:stage source:[self identifier]];
+    if (cached) {
+      // The registry keeps its histograms for good and always hands out the
+      // same one, so threads racing here store the same pointer and we
+      // don't need to retain it.
+      OSMemoryBarrier();
+      *cached = histogram;
+    }
+  }
+  return histogram;
+}
+
 @end
 
 @implementation HGSSimpleNamedSearchSource
@@ -91,6 +91,13 @@
 */
 - (UInt64)averageTimeForSource:(HGSSearchSource *)source;
 
+/*!
+ Returns how far, on average, a source's run times are from its average
+ time, in absolute time. Together with averageTimeForSource: it gives an
+ idea of how long a run of the source is likely to take.
+*/
+- (UInt64)timeDeviationForSource:(HGSSearchSource *)source;
+
 /*!
  Total number of promotions.
 */
@@ -41,6 +41,8 @@ static NSString *const kHGSSearchSourceRankerDataPointRunTimeKey
   = @"runtime";
 static NSString *const kHGSSearchSourceRankerDataPointPromotionsKey
   = @"promotions";
+static NSString *const kHGSSearchSourceRankerDataPointDeviationKey
+  = @"deviation";
 static NSString *const kHGSSearchSourceRankerDataKey
   = @"HGSSearchSourceRankerData";
 static NSString *const kHGSSearchSourceRankerSourceIDKey
@@ -50,6 +52,7 @@ static NSString *const kHGSSearchSourceRankerSourceIDKey
 @interface HGSSearchSourceRankerDataPoint : NSObject {
  @private
   UInt64 averageTime_;
+  UInt64 deviation_;
   UInt64 promotions_;
   BOOL firstRunCompleted_;
 }
@@ -58,6 +61,7 @@ static NSString *const kHGSSearchSourceRankerSourceIDKey
 - (void)addTimeDataPoint:(UInt64)machTime;
 - (void)promote;
 - (UInt64)averageTime;
+- (UInt64)deviation;
 - (UInt64)promotionCount;
 @end
 
@@ -257,6 +261,19 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   return avgTime;
 }
 
+- (UInt64)timeDeviationForSource:(HGSSearchSource *)source {
+  UInt64 deviation = 0;
+  NSString *sourceID = [source identifier];
+  @synchronized (self) {
+    HGSSearchSourceRankerDataPoint *dp
+      = [rankDictionary_ objectForKey:sourceID];
+    if (dp) {
+      deviation = [dp deviation];
+    }
+  }
+  return deviation;
+}
+
 - (NSArray *)orderedSourcesByPerformance {
   NSMutableArray *sources
     = [NSMutableArray arrayWithArray:[sourcesPoint_ extensions]];
@@ -333,6 +350,8 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
     NSNumber *number
       = [dict objectForKey:kHGSSearchSourceRankerDataPointRunTimeKey];
     averageTime_ = [number unsignedLongLongValue];
+    number = [dict objectForKey:kHGSSearchSourceRankerDataPointDeviationKey];
+    deviation_ = [number unsignedLongLongValue];
     number = [dict objectForKey:kHGSSearchSourceRankerDataPointPromotionsKey];
     promotions_ = [number unsignedLongLongValue];
   }
@@ -342,6 +361,8 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
 - (void)encodeToDictionary:(NSMutableDictionary *)dict {
   [dict setObject:[NSNumber numberWithUnsignedLongLong:[self averageTime]]
            forKey:kHGSSearchSourceRankerDataPointRunTimeKey];
+  [dict setObject:[NSNumber numberWithUnsignedLongLong:deviation_]
+           forKey:kHGSSearchSourceRankerDataPointDeviationKey];
   [dict setObject:[NSNumber numberWithUnsignedLongLong:promotions_]
            forKey:kHGSSearchSourceRankerDataPointPromotionsKey];
  }
@@ -351,6 +372,11 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
     // Calculate a very simple moving average, but only if we already
     // have data to work with.
     if (averageTime_ > 0) {
+      // The deviation is a moving average of how far each run is from the
+      // average, weighted the same way.
+      UInt64 difference = machTime > averageTime_ ? machTime - averageTime_
+                                                  : averageTime_ - machTime;
+      deviation_ = ((difference * 2) + deviation_) / 3;
       averageTime_ = ((machTime * 2) + averageTime_) / 3;
     } else {
       averageTime_ = machTime;
@@ -364,6 +390,10 @@ static NSInteger HGSSourceRangePromotionSort(id a, id b, void *context) {
   return averageTime_;
 }
 
+- (UInt64)deviation {
+  return deviation_;
+}
+
 - (NSString *)description {
   return [NSString stringWithFormat:@"promotions %lu averageTime: %llu)",
           [self promotionCount], [self averageTime]];
@@ -0,0 +1,105 @@
+//
+//  HGSSearchSourceScheduler.h
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <GTM/GTMDefines.h>
+
+/*!
+ @header
+ @discussion HGSSearchSourceScheduler
+*/
+
+@class HGSSearchSource;
+@class HGSSearchSourceRanker;
+
+/*!
+ User default (NSNumber seconds) for the latency budget of a keystroke.
+ Defaults to 0.25.
+*/
+GTM_EXTERN NSString *const kHGSSearchLatencyBudgetPrefKey;
+
+/*!
+ Decides in which order HGSQueryController starts sources and how long it
+ gives each of them, using the run times and promotions that
+ HGSSearchSourceRanker keeps.
+
+ A source's value is how often its results get promoted; its expected time
+ is its average run time. Sources start in order of value per millisecond,
+ so that with a limited number of threads the sources most likely to give
+ a useful result soonest go first.
+
+ Each source gets a deadline of twice its average time or its average plus
+ four deviations, whichever is longer, but never less than the latency
+ budget or more than maximumDeadline. Sources we know nothing about get
+ maximumDeadline.
+*/
+@interface HGSSearchSourceScheduler : NSObject {
+ @private
+  HGSSearchSourceRanker *ranker_;
+  NSTimeInterval latencyBudget_;
+  NSTimeInterval maximumDeadline_;
+}
+
+/*! Seconds. See kHGSSearchLatencyBudgetPrefKey. */
+@property (assign) NSTimeInterval latencyBudget;
+/*!
+ Seconds. The longest deadline any source gets. Defaults to 60.
+ HGSQueryController also never lets a source run longer than its slow
+ source timeout.
+*/
+@property (assign) NSTimeInterval maximumDeadline;
+
+/*! The scheduler for the shared HGSSearchSourceRanker. */
++ (HGSSearchSourceScheduler *)sharedSearchSourceScheduler;
+
+/*! Designated initializer. */
+- (id)initWithRanker:(HGSSearchSourceRanker *)ranker;
+
+/*! The share of all promotions that went to |source|, from 0 to 1. */
+- (double)valueForSource:(HGSSearchSource *)source;
+
+/*! Average run time of |source| in seconds, 0 if we don't know it yet. */
+- (NSTimeInterval)expectedTimeForSource:(HGSSearchSource *)source;
+
+/*!
+ Returns |sources| in the order they should be started, highest value per
+ millisecond first. Sources that tie keep their order in |sources|.
+*/
+- (NSArray *)scheduledSources:(NSArray *)sources;
+
+/*!
+ Seconds after an operation of |source| starts running after which it is
+ cancelled.
+*/
+- (NSTimeInterval)deadlineForSource:(HGSSearchSource *)source;
+
+@end
@@ -0,0 +1,170 @@
+//
+//  HGSSearchSourceScheduler.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "HGSSearchSourceScheduler.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSLog.h"
+#import "HGSSearchSource.h"
+#import "HGSSearchSourceRanker.h"
+
+NSString *const kHGSSearchLatencyBudgetPrefKey = @"searchLatencyBudget";
+
+// Expected time used to order sources that we have no timings for yet.
+// Slow enough that sources we know to be fast and useful go first.
+static const NSTimeInterval kHGSSearchSourceSchedulerUnknownTime = 0.1;
+
+typedef struct {
+  HGSSearchSource *source;
+  double priority;
+  NSUInteger index;
+} HGSSearchSourceSchedulerEntry;
+
+static int HGSSearchSourceSchedulerEntryCompare(const void *a, const void *b) {
+  const HGSSearchSourceSchedulerEntry *entryA = a;
+  const HGSSearchSourceSchedulerEntry *entryB = b;
+  if (entryA->priority > entryB->priority) return -1;
+  if (entryA->priority < entryB->priority) return 1;
+  if (entryA->index < entryB->index) return -1;
+  if (entryA->index > entryB->index) return 1;
+  return 0;
+}
+
+static NSTimeInterval HGSSearchSourceSchedulerSeconds(UInt64 machTime) {
+  return HGSMachTimeToNanoseconds(machTime) / 1e9;
+}
+
+@implementation HGSSearchSourceScheduler
+
+@synthesize latencyBudget = latencyBudget_;
+@synthesize maximumDeadline = maximumDeadline_;
+
++ (void)initialize {
+  if (self == [HGSSearchSourceScheduler class]) {
+    NSDictionary *defaultsDict
+      = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:0.25]
+                                    forKey:kHGSSearchLatencyBudgetPrefKey];
+    NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+    [sd registerDefaults:defaultsDict];
+  }
+}
+
++ (HGSSearchSourceScheduler *)sharedSearchSourceScheduler {
+  static HGSSearchSourceScheduler *sharedScheduler = nil;
+  @synchronized (self) {
+    if (!sharedScheduler) {
+      HGSSearchSourceRanker *ranker
+        = [HGSSearchSourceRanker sharedSearchSourceRanker];
+      sharedScheduler
+        = [[HGSSearchSourceScheduler alloc] initWithRanker:ranker];
+      NSUserDefaults *sd = [NSUserDefaults standardUserDefaults];
+      [sharedScheduler setLatencyBudget:
+       [sd doubleForKey:kHGSSearchLatencyBudgetPrefKey]];
+    }
+  }
+  return sharedScheduler;
+}
+
+- (id)init {
+  return [self initWithRanker:nil];
+}
+
+- (id)initWithRanker:(HGSSearchSourceRanker *)ranker {
+  if ((self = [super init])) {
+    if (!ranker) {
+      HGSLogDebug(@"HGSSearchSourceScheduler needs a ranker");
+      [self release];
+      return nil;
+    }
+    ranker_ = [ranker retain];
+    latencyBudget_ = 0.25;
+    maximumDeadline_ = 60.0;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [ranker_ release];
+  [super dealloc];
+}
+
+- (double)valueForSource:(HGSSearchSource *)source {
+  UInt64 total = [ranker_ promotionCount];
+  if (!total) return 0;
+  return (double)[ranker_ promotionCountForSource:source] / total;
+}
+
+- (NSTimeInterval)expectedTimeForSource:(HGSSearchSource *)source {
+  return HGSSearchSourceSchedulerSeconds([ranker_ averageTimeForSource:source]);
+}
+
+- (NSArray *)scheduledSources:(NSArray *)sources {
+  NSUInteger count = [sources count];
+  if (count < 2) return sources;
+  HGSSearchSourceSchedulerEntry *entries
+    = malloc(count * sizeof(HGSSearchSourceSchedulerEntry));
+  if (!entries) return sources;
+  UInt64 total = [ranker_ promotionCount];
+  for (NSUInteger i = 0; i < count; ++i) {
+    HGSSearchSource *source = [sources objectAtIndex:i];
+    NSTimeInterval expected = [self expectedTimeForSource:source];
+    if (expected <= 0) {
+      expected = kHGSSearchSourceSchedulerUnknownTime;
+    }
+    // Smooth the value so sources nobody has promoted yet are still
+    // ordered by speed.
+    double value
+      = (double)([ranker_ promotionCountForSource:source] + 1) / (total + 1);
+    entries[i].source = source;
+    entries[i].priority = value / MAX(expected * 1000.0, 1.0);
+    entries[i].index = i;
+  }
+  qsort(entries, count, sizeof(HGSSearchSourceSchedulerEntry),
+        HGSSearchSourceSchedulerEntryCompare);
+  NSMutableArray *scheduled = [NSMutableArray arrayWithCapacity:count];
+  for (NSUInteger i = 0; i < count; ++i) {
+    [scheduled addObject:entries[i].source];
+  }
+  free(entries);
+  return scheduled;
+}
+
+- (NSTimeInterval)deadlineForSource:(HGSSearchSource *)source {
+  NSTimeInterval average = [self expectedTimeForSource:source];
+  if (average <= 0) return maximumDeadline_;
+  NSTimeInterval deviation
+    = HGSSearchSourceSchedulerSeconds([ranker_ timeDeviationForSource:source]);
+  NSTimeInterval deadline = MAX(average * 2, average + deviation * 4);
+  deadline = MAX(deadline, latencyBudget_);
+  return MIN(deadline, maximumDeadline_);
+}
+
+@end
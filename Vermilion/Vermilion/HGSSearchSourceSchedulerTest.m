@@ -0,0 +1,322 @@
+//
+//  HGSSearchSourceSchedulerTest.m
+//
+//  Copyright (c) 2009 Google Inc. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are
+//  met:
+//
+//    * Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//    * Redistributions in binary form must reproduce the above
+//  copyright notice, this list of conditions and the following disclaimer
+//  in the documentation and/or other materials provided with the
+//  distribution.
+//    * Neither the name of Google Inc. nor the names of its
+//  contributors may be used to endorse or promote products derived from
+//  this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "GTMSenTestCase.h"
+#import <OCMock/OCMock.h>
+#import <mach/mach_time.h>
+
+#import "HGSSearchSourceScheduler.h"
+#import "HGSSearchSourceRanker.h"
+#import "HGSExtensionPoint.h"
+#import "HGSSearchSource.h"
+
+// A made up source for the simulation. Latencies are in milliseconds; a
+// |tailChance| of the runs take between |tailMin| and |tailMax| instead of
+// between |min| and |max|. |useful| is the chance one of its results is the
+// one the user wants.
+typedef struct {
+  NSString *identifier;
+  double min;
+  double max;
+  double tailChance;
+  double tailMin;
+  double tailMax;
+  double useful;
+  UInt64 promotions;
+} HGSSchedulerTestSource;
+
+static const HGSSchedulerTestSource kTestSources[] = {
+  { @"com.google.qsb.test.fast1", 1, 5, 0, 0, 0, 0.02, 1 },
+  { @"com.google.qsb.test.fast2", 4, 8, 0, 0, 0, 0.02, 1 },
+  { @"com.google.qsb.test.fast3", 8, 12, 0, 0, 0, 0.02, 2 },
+  { @"com.google.qsb.test.fast4", 12, 18, 0, 0, 0, 0.02, 2 },
+  { @"com.google.qsb.test.fast5", 16, 22, 0, 0, 0, 0.02, 2 },
+  { @"com.google.qsb.test.fast6", 20, 28, 0, 0, 0, 0.02, 3 },
+  { @"com.google.qsb.test.good", 30, 50, 0, 0, 0, 0.6, 60 },
+  { @"com.google.qsb.test.okay", 15, 35, 0, 0, 0, 0.3, 30 },
+  { @"com.google.qsb.test.slow", 200, 600, 0.1, 2500, 3500, 0.05, 4 },
+};
+
+static const NSUInteger kTestSourceCount
+  = sizeof(kTestSources) / sizeof(kTestSources[0]);
+
+// Threads available to run sources on.
+static const NSUInteger kTestSlots = 2;
+static const NSUInteger kTestQueries = 2000;
+
+// Small deterministic generator so the simulation always plays out the same.
+static double HGSSchedulerTestRandom(UInt32 *state) {
+  *state = *state * 1664525 + 1013904223;
+  return (double)(*state >> 8) / (double)(1 << 24);
+}
+
+static double HGSSchedulerTestLatency(const HGSSchedulerTestSource *source,
+                                      UInt32 *state) {
+  double roll = HGSSchedulerTestRandom(state);
+  double spread = HGSSchedulerTestRandom(state);
+  if (roll < source->tailChance) {
+    return source->tailMin + spread * (source->tailMax - source->tailMin);
+  }
+  return source->min + spread * (source->max - source->min);
+}
+
+static UInt64 HGSSchedulerTestMachTime(double milliseconds) {
+  mach_timebase_info_data_t timebase;
+  mach_timebase_info(&timebase);
+  return (UInt64)(milliseconds * 1e6 * timebase.denom / timebase.numer);
+}
+
+// Runs |sources| in order on kTestSlots threads, each one taking
+// |latencies[i]| ms unless that is past |deadlines[i]|, in which case it is
+// cancelled at its deadline. Returns when the first useful result arrives,
+// or -1 if none does. |lost| is incremented for every useful result that
+// was cancelled.
+static double HGSSchedulerTestRunQuery(NSArray *sources,
+                                       NSDictionary *indexes,
+                                       const double *latencies,
+                                       const BOOL *useful,
+                                       const double *deadlines,
+                                       NSUInteger *lost) {
+  double slots[kTestSlots] = { 0 };
+  double firstUseful = -1;
+  for (HGSSearchSource *source in sources) {
+    NSUInteger i
+      = [[indexes objectForKey:[source identifier]] unsignedIntegerValue];
+    NSUInteger slot = 0;
+    for (NSUInteger j = 1; j < kTestSlots; ++j) {
+      if (slots[j] < slots[slot]) slot = j;
+    }
+    BOOL cancelled = latencies[i] > deadlines[i];
+    double finish = slots[slot] + (cancelled ? deadlines[i] : latencies[i]);
+    slots[slot] = finish;
+    if (useful[i]) {
+      if (cancelled) {
+        ++(*lost);
+      } else if (firstUseful < 0 || finish < firstUseful) {
+        firstUseful = finish;
+      }
+    }
+  }
+  return firstUseful;
+}
+
+static NSInteger HGSSchedulerTestCompareAverage(id a, id b, void *context) {
+  HGSSearchSourceRanker *ranker = context;
+  UInt64 timeA = [ranker averageTimeForSource:a];
+  UInt64 timeB = [ranker averageTimeForSource:b];
+  if (timeA < timeB) return NSOrderedAscending;
+  if (timeA > timeB) return NSOrderedDescending;
+  return NSOrderedSame;
+}
+
+@interface HGSSearchSourceSchedulerTest : GTMTestCase {
+ @private
+  HGSSearchSourceRanker *ranker_;
+  HGSSearchSourceScheduler *scheduler_;
+  id sourcesPoint_;
+  NSMutableArray *sources_;
+  NSMutableDictionary *indexes_;
+}
+@end
+
+@implementation HGSSearchSourceSchedulerTest
+
+- (void)setUp {
+  // Give the ranker the average and deviation of each source the way it
+  // would have learnt them.
+  UInt32 state = 42;
+  NSMutableArray *rankerData = [NSMutableArray array];
+  sources_ = [[NSMutableArray alloc] init];
+  indexes_ = [[NSMutableDictionary alloc] init];
+  id bundle = [OCMockObject mockForClass:[NSBundle class]];
+  for (NSUInteger i = 0; i < kTestSourceCount; ++i) {
+    const HGSSchedulerTestSource *testSource = &kTestSources[i];
+    double samples[500];
+    double sum = 0;
+    for (NSUInteger j = 0; j < 500; ++j) {
+      samples[j] = HGSSchedulerTestLatency(testSource, &state);
+      sum += samples[j];
+    }
+    double average = sum / 500;
+    double deviation = 0;
+    for (NSUInteger j = 0; j < 500; ++j) {
+      deviation += fabs(samples[j] - average);
+    }
+    deviation /= 500;
+    NSDictionary *entry
+      = [NSDictionary dictionaryWithObjectsAndKeys:
+         testSource->identifier, @"HGSSearchSourceRankerSourceID",
+         [NSNumber numberWithUnsignedLongLong:
+          HGSSchedulerTestMachTime(average)], @"runtime",
+         [NSNumber numberWithUnsignedLongLong:
+          HGSSchedulerTestMachTime(deviation)], @"deviation",
+         [NSNumber numberWithUnsignedLongLong:testSource->promotions],
+         @"promotions",
+         nil];
+    [rankerData addObject:entry];
+
+    NSString *name = testSource->identifier;
+    [[[bundle expect] andReturn:name] qsb_localizedInfoPListStringForKey:name];
+    HGSSimpleNamedSearchSource *source
+      = [HGSSimpleNamedSearchSource sourceWithName:name
+                                        identifier:testSource->identifier
+                                            bundle:bundle];
+    STAssertNotNil(source, nil);
+    [sources_ addObject:source];
+    [indexes_ setObject:[NSNumber numberWithUnsignedInteger:i]
+                 forKey:testSource->identifier];
+  }
+  sourcesPoint_
+    = [[OCMockObject mockForClass:[HGSExtensionPoint class]] retain];
+  ranker_ = [[HGSSearchSourceRanker alloc] initWithRankerData:rankerData
+                                                 sourcesPoint:sourcesPoint_];
+  STAssertNotNil(ranker_, nil);
+  scheduler_ = [[HGSSearchSourceScheduler alloc] initWithRanker:ranker_];
+  STAssertNotNil(scheduler_, nil);
+}
+
+- (void)tearDown {
+  [scheduler_ release];
+  [ranker_ release];
+  [sourcesPoint_ release];
+  [sources_ release];
+  [indexes_ release];
+}
+
+- (void)testScheduledOrder {
+  NSArray *scheduled = [scheduler_ scheduledSources:sources_];
+  STAssertEquals([scheduled count], [sources_ count], nil);
+  // The good source is slower than the okay one but worth twice as much.
+  STAssertEqualObjects([[scheduled objectAtIndex:0] identifier],
+                       @"com.google.qsb.test.good", nil);
+  STAssertEqualObjects([[scheduled objectAtIndex:1] identifier],
+                       @"com.google.qsb.test.okay", nil);
+  STAssertEqualObjects([[scheduled lastObject] identifier],
+                       @"com.google.qsb.test.slow", nil);
+
+  // Sources without any data keep their order.
+  HGSSearchSourceRanker *emptyRanker
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:[NSArray array]
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  HGSSearchSourceScheduler *scheduler
+    = [[[HGSSearchSourceScheduler alloc] initWithRanker:emptyRanker]
+       autorelease];
+  STAssertEqualObjects([scheduler scheduledSources:sources_], sources_, nil);
+}
+
+- (void)testDeadlines {
+  [scheduler_ setLatencyBudget:0.25];
+  [scheduler_ setMaximumDeadline:10];
+  HGSSearchSource *fast = [sources_ objectAtIndex:0];
+  HGSSearchSource *slow = [sources_ lastObject];
+  STAssertEqualsWithAccuracy([scheduler_ deadlineForSource:fast], 0.25, 0.001,
+                             nil);
+  NSTimeInterval slowDeadline = [scheduler_ deadlineForSource:slow];
+  STAssertGreaterThan(slowDeadline,
+                      2 * [scheduler_ expectedTimeForSource:slow], nil);
+  STAssertLessThan(slowDeadline, 10.0, nil);
+  [scheduler_ setMaximumDeadline:1];
+  STAssertEqualsWithAccuracy([scheduler_ deadlineForSource:slow], 1.0, 0.001,
+                             nil);
+
+  HGSSearchSourceRanker *emptyRanker
+    = [[[HGSSearchSourceRanker alloc] initWithRankerData:[NSArray array]
+                                            sourcesPoint:sourcesPoint_]
+       autorelease];
+  HGSSearchSourceScheduler *scheduler
+    = [[[HGSSearchSourceScheduler alloc] initWithRanker:emptyRanker]
+       autorelease];
+  STAssertEqualsWithAccuracy([scheduler deadlineForSource:fast],
+                             [scheduler maximumDeadline], 0.001, nil);
+}
+
+// Plays the same queries through the old order (fastest average first, no
+// deadlines other than the slow source timeout) and through the scheduler,
+// and compares how soon the first useful result shows up.
+- (void)testSimulatedTimeToFirstUsefulResult {
+  [scheduler_ setLatencyBudget:0.25];
+  [scheduler_ setMaximumDeadline:60];
+  NSArray *baselineOrder
+    = [sources_ sortedArrayUsingFunction:HGSSchedulerTestCompareAverage
+                                 context:ranker_];
+  NSArray *scheduledOrder = [scheduler_ scheduledSources:sources_];
+  double baselineDeadlines[kTestSourceCount];
+  double scheduledDeadlines[kTestSourceCount];
+  for (NSUInteger i = 0; i < kTestSourceCount; ++i) {
+    HGSSearchSource *source = [sources_ objectAtIndex:i];
+    baselineDeadlines[i] = 60000;
+    scheduledDeadlines[i] = [scheduler_ deadlineForSource:source] * 1000;
+  }
+
+  UInt32 state = 7;
+  double baselineTotal = 0;
+  double scheduledTotal = 0;
+  NSUInteger baselineLost = 0;
+  NSUInteger scheduledLost = 0;
+  NSUInteger counted = 0;
+  NSUInteger missed = 0;
+  for (NSUInteger query = 0; query < kTestQueries; ++query) {
+    double latencies[kTestSourceCount];
+    BOOL useful[kTestSourceCount];
+    for (NSUInteger i = 0; i < kTestSourceCount; ++i) {
+      latencies[i] = HGSSchedulerTestLatency(&kTestSources[i], &state);
+      useful[i] = HGSSchedulerTestRandom(&state) < kTestSources[i].useful;
+    }
+    double baseline
+      = HGSSchedulerTestRunQuery(baselineOrder, indexes_, latencies, useful,
+                                 baselineDeadlines, &baselineLost);
+    double scheduled
+      = HGSSchedulerTestRunQuery(scheduledOrder, indexes_, latencies, useful,
+                                 scheduledDeadlines, &scheduledLost);
+    if (baseline < 0) continue;
+    if (scheduled < 0) {
+      // The only useful result missed its deadline.
+      ++missed;
+      continue;
+    }
+    baselineTotal += baseline;
+    scheduledTotal += scheduled;
+    ++counted;
+  }
+  STAssertGreaterThan(counted, kTestQueries / 2, nil);
+  double baselineMean = baselineTotal / counted;
+  double scheduledMean = scheduledTotal / counted;
+  STAssertLessThan(scheduledMean, baselineMean * 0.75,
+                   @"baseline %fms scheduled %fms",
+                   baselineMean, scheduledMean);
+  STAssertEquals(baselineLost, (NSUInteger)0, nil);
+  STAssertLessThan(scheduledLost, kTestQueries / 100, nil);
+  STAssertLessThanOrEqual(missed, scheduledLost, nil);
+}
+
+@end
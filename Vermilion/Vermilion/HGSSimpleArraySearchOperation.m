@@ -32,16 +32,17 @@
 
 #import "HGSSimpleArraySearchOperation.h"
 #import "HGSLog.h"
-#import "NSNotificationCenter+MainThread.h"
-#import "GTMMethodCheck.h"
 #import "HGSMixer.h"
 #import "HGSResult.h"
 #import "HGSTypeFilter.h"
 #import "HGSActionArgument.h"
 #import "HGSQuery.h"
+#import "HGSSearchSource.h"
+#import "HGSLatencyHistogram.h"
+#import "HGSDTrace.h"
+#import <mach/mach_time.h>
 
 @implementation HGSSimpleArraySearchOperation
-GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:object:userInfo:);
 
 - (void)dealloc {
   [results_ release];
@@ -58,7 +59,11 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
   // should be calling finishQuery shortly to let it know it's done.
   NSUInteger resultsCount = [results count];
   if (resultsCount == 0) return;
-  NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+  uint64_t startTime = mach_absolute_time();
+  NSString *identifier = [[self source] identifier];
+  if (VERMILION_SORT_START_ENABLED()) {
+    VERMILION_SORT_START((char *)[identifier UTF8String], (int)resultsCount);
+  }
   HGSQuery *query = [self query];
   HGSActionArgument *actionArg = [query actionArgument];
   if (actionArg) {
@@ -81,13 +86,17 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
   } 
   NSArray *sortedResults 
     = [results sortedArrayUsingFunction:HGSMixerScoredResultSort context:nil];
+  [[[self source] latencyHistogramForStage:kHGSLatencyStageSort]
+   recordMachTime:mach_absolute_time() - startTime];
+  if (VERMILION_SORT_FINISH_ENABLED()) {
+    VERMILION_SORT_FINISH((char *)[identifier UTF8String],
+                          (int)[sortedResults count]);
+  }
   @synchronized (self) {
     [results_ autorelease];
     results_ = [sortedResults retain];
   }
-  [nc hgs_postOnMainThreadNotificationName:kHGSSearchOperationDidUpdateResultsNotification
-                                    object:self
-                                  userInfo:nil];
+  [self postResultsDidUpdate];
 }
 
 - (NSUInteger)resultCountForFilter:(HGSTypeFilter *)filter {
@@ -106,6 +115,34 @@ GTM_METHOD_CHECK(NSNotificationCenter, hgs_postOnMainThreadNotificationName:obje
   return count;
 }
 
+- (void)addResultCountsForFilters:(NSArray *)filters
+                      typeMatches:(NSMutableDictionary *)typeMatches
+                         toCounts:(NSUInteger *)counts {
+  @synchronized (self) {
+    for (HGSResult *result in results_) {
+      NSString *type = [result type];
+      NSIndexSet *matches = [typeMatches objectForKey:type];
+      if (!matches) {
+        NSMutableIndexSet *newMatches = [NSMutableIndexSet indexSet];
+        NSUInteger idx = 0;
+        for (HGSTypeFilter *filter in filters) {
+          if ([filter isValidType:type]) {
+            [newMatches addIndex:idx];
+          }
+          ++idx;
+        }
+        [typeMatches setObject:newMatches forKey:type];
+        matches = newMatches;
+      }
+      for (NSUInteger idx = [matches firstIndex];
+           idx != NSNotFound;
+           idx = [matches indexGreaterThanIndex:idx]) {
+        counts[idx] += 1;
+      }
+    }
+  }
+}
+
 - (NSArray *)sortedRankedResultsInRange:(NSRange)range
                              typeFilter:(HGSTypeFilter *)typeFilter {
   NSArray *sortedResults = nil;
@@ -40,6 +40,7 @@
 #import "HGSPluginLoader.h"
 #import "HGSDelegate.h"
 #import "HGSType.h"
+#import "HGSJSONStreamParser.h"
 
 #import <GData/GDataHTTPFetcher.h>
 #import "GTMDefines.h"
@@ -47,7 +48,6 @@
 #import "GTMMethodCheck.h"
 #import "GTMNSString+URLArguments.h"
 #import "GTMNSDictionary+URLArguments.h"
-#import "JSON/JSON.h"
 #import "NSString+ReadableURL.h"
 #import "GTMNSNumber+64Bit.h"
 
@@ -507,20 +507,20 @@ GTM_METHOD_CHECK(NSNumber, gtm_numberWithCGFloat:);
   return suggestions;
 }
 
-// Parses the JSON response into Foundation objects.
+// Parses the JSON response into Foundation objects. Responses are small and
+// are cached whole, so they are built straight from the raw bytes rather than
+// being decoded into an NSString first.
 - (NSArray *)responseWithJSONData:(NSData *)responseData {
-  // Parse response.
-  NSString *jsonResponse = [[[NSString alloc] initWithData:responseData
-                                                  encoding:NSUTF8StringEncoding]
-                            autorelease];
-  NSArray *response = [jsonResponse JSONValue];
-
+  NSError *error = nil;
+  NSArray *response = [HGSJSONStreamParser JSONObjectWithData:responseData
+                                                      options:0
+                                                        error:&error];
   if (!response) {
-    HGSLog(@"Unable to parse JSON");
+    HGSLog(@"Unable to parse JSON (%@)", error);
     return [NSArray array];
   }
 
-  if ([response count] < 2) {
+  if (![response isKindOfClass:[NSArray class]] || [response count] < 2) {
     HGSLog(@"JSON Response does not match expected format.");
     return [NSArray array];
   }
@@ -46,7 +46,7 @@
  This tokenizer breaks all Roman languages and CZJK.
 */ 
 
-@interface HGSTokenizedString : NSObject <NSCopying> {
+@interface HGSTokenizedString : NSObject <NSCopying, NSCoding> {
  @private
   NSString *originalString_;
   NSString *tokenizedString_;
@@ -80,4 +80,21 @@
 + (NSArray *)tokenizeStrings:(NSArray *)strings;
 + (NSString *)tokenizerSeparatorString;
 + (unichar)tokenizerSeparator;
+
+/*!
+ Start interning tokenized strings on the current thread. Until the matching
+ call to endInterning, tokenizeString: and tokenizeStrings: hand back the
+ same HGSTokenizedString for strings they have already seen instead of
+ tokenizing them again. Meant to bracket bulk indexing passes where sources
+ see the same album names, domains or company names over and over. The pool
+ is bounded, and it is thrown away by endInterning so it never keeps strings
+ alive past the indexing pass. Calls may be nested.
+*/
++ (void)beginInterning;
+/*!
+ Stop interning on the current thread.
+ @result An estimate of the bytes saved by sharing tokenized strings while
+         interning was on. Only meaningful for the outermost call.
+*/
++ (NSUInteger)endInterning;
 @end
@@ -32,6 +32,8 @@
 
 #import "HGSTokenizer.h"    
 #import <vector>
+#import <pthread.h>
+#import <objc/runtime.h>
 #import "GTMGarbageCollection.h"
 #import "HGSLog.h"
 #import "HGSBundle.h"
@@ -41,24 +43,169 @@ typedef struct HGSRangeMapping {
   NSRange codomain_;
 } HGSRangeMapping;
 
+// An entry from HGSTokenizerExceptions.plist in a form the fast path can
+// compare against without creating any strings.
+typedef struct HGSTokenizerException {
+  std::vector<UniChar> key_;
+  std::vector<std::vector<UniChar> > parts_;
+} HGSTokenizerException;
+
+typedef enum {
+  kHGSFastPathCharUnsupported = 0,
+  kHGSFastPathCharBreak,
+  kHGSFastPathCharUpper,
+  kHGSFastPathCharLower,
+  kHGSFastPathCharDigit
+} HGSFastPathCharClass;
+
+// Upper bound on the number of strings a thread will intern during a single
+// indexing pass.
+static const NSUInteger kHGSTokenizerInternPoolMaxCount = 50000;
+
+// Words this long may have more subtokens than the CF path will collect, so
+// we leave them to CF.
+static const CFIndex kHGSFastPathMaxWordLength = 100;
+
+// Diacritic folding for Latin-1 (0xC0 - 0xFF). Characters that don't have
+// a canonical decomposition onto an ASCII letter map to 0 and send the string
+// down the CF path.
+static const UniChar kHGSLatin1Folding[] = {
+  'A', 'A', 'A', 'A', 'A', 'A', 0,   'C',  // 0xC0
+  'E', 'E', 'E', 'E', 'I', 'I', 'I', 'I',  // 0xC8
+  0,   'N', 'O', 'O', 'O', 'O', 'O', 0,    // 0xD0
+  0,   'U', 'U', 'U', 'U', 'Y', 0,   0,    // 0xD8
+  'a', 'a', 'a', 'a', 'a', 'a', 0,   'c',  // 0xE0
+  'e', 'e', 'e', 'e', 'i', 'i', 'i', 'i',  // 0xE8
+  0,   'n', 'o', 'o', 'o', 'o', 'o', 0,    // 0xF0
+  0,   'u', 'u', 'u', 'u', 'y', 0,   'y'   // 0xF8
+};
+
+// Classifies an ASCII character for the fast path. Anything that can play a
+// part in a UAX #29 word (MidLetter, MidNum, MidNumLet, ExtendNumLet) or that
+// we aren't sure about is unsupported.
+static inline HGSFastPathCharClass HGSFastPathClassify(UniChar c) {
+  if (c >= 'a' && c <= 'z') return kHGSFastPathCharLower;
+  if (c >= 'A' && c <= 'Z') return kHGSFastPathCharUpper;
+  if (c >= '0' && c <= '9') return kHGSFastPathCharDigit;
+  switch (c) {
+    case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+    case '!': case '"': case '#': case '$': case '%': case '&': case '(':
+    case ')': case '*': case '+': case '-': case '/': case '<': case '=':
+    case '>': case '?': case '@': case '[': case '\\': case ']': case '^':
+    case '`': case '{': case '|': case '}': case '~':
+      return kHGSFastPathCharBreak;
+    default:
+      return kHGSFastPathCharUnsupported;
+  }
+}
+
+// Mirrors the subtokens CFStringTokenizer hands back for a simple word
+// (camelcase and letter/number transitions) after we have rejoined the
+// numbers.
+static inline BOOL HGSFastPathIsSubTokenBoundary(const UniChar *chars,
+                                                 CFIndex indx,
+                                                 CFIndex end) {
+  HGSFastPathCharClass prev = HGSFastPathClassify(chars[indx - 1]);
+  HGSFastPathCharClass curr = HGSFastPathClassify(chars[indx]);
+  if ((prev == kHGSFastPathCharDigit) != (curr == kHGSFastPathCharDigit)) {
+    return YES;
+  }
+  if (prev == kHGSFastPathCharLower && curr == kHGSFastPathCharUpper) {
+    return YES;
+  }
+  // "NSString" breaks as "NS" "String".
+  if (prev == kHGSFastPathCharUpper && curr == kHGSFastPathCharUpper
+      && indx + 1 < end
+      && HGSFastPathClassify(chars[indx + 1]) == kHGSFastPathCharLower) {
+    return YES;
+  }
+  return NO;
+}
+
 @interface HGSTokenizedString ()
 // The mapping from the original string to the tokenized string
 @property (readonly, assign) HGSRangeMapping *mappings;
 @property (readwrite, retain) NSString *tokenizedString;
 - (id)initWithString:(NSString *)string 
             capacity:(NSUInteger)capacity;
+// Rough number of bytes this instance owns beyond its original string.
+- (NSUInteger)estimatedSize;
 @end
 
 @interface HGSTokenizerInternal : NSObject {
 @private
   CFStringTokenizerRef tokenizer_;
   CFCharacterSetRef numberSet_;
+  NSLocale *fastPathLocale_;
+  BOOL fastPathLocaleAllowed_;
+  // Scratch buffers for the fast path, reused from call to call.
+  std::vector<UniChar> *foldedChars_;
+  std::vector<UniChar> *tokenizedChars_;
+  std::vector<NSRange> *tokenRanges_;
+  std::vector<HGSRangeMapping> *tokenMappings_;
+  // Interning state, see +[HGSTokenizer beginInterning].
+  NSMutableDictionary *internPool_;
+  NSUInteger internDepth_;
+  NSUInteger internBytesSaved_;
 }
 
 - (HGSTokenizedString *)tokenizeString:(NSString *)string;
+- (HGSTokenizedString *)tokenizeString:(NSString *)string
+                      allowingFastPath:(BOOL)allowFastPath;
+- (void)beginInterning;
+- (NSUInteger)endInterning;
+@end
+
+@interface HGSTokenizerInternal ()
+- (BOOL)fastPathAllowedForLocale:(NSLocale *)locale;
+- (HGSTokenizedString *)fastTokenizeString:(NSString *)string;
+- (HGSTokenizedString *)cfTokenizeString:(NSString *)string
+                                  locale:(CFLocaleRef)currentLocale;
+@end
+
+@interface HGSTokenizer ()
+// The tokenizer (and its scratch buffers) for the current thread.
++ (HGSTokenizerInternal *)internalTokenizer;
 @end
 
+@interface HGSTokenizer (HGSTokenizerTesting)
+// Lets tests compare the fast path against the CF path.
++ (HGSTokenizedString *)tokenizeString:(NSString *)string
+                      allowingFastPath:(BOOL)allowFastPath;
+@end
+
+static NSString *const kHGSTokenizedStringOriginalKey = @"original";
+static NSString *const kHGSTokenizedStringTokenizedKey = @"tokenized";
+static NSString *const kHGSTokenizedStringMappingsKey = @"mappings";
+
 static NSDictionary *gHGSTokenizerExceptions = nil;
+static std::vector<HGSTokenizerException> *gHGSTokenizerFastExceptions = NULL;
+static pthread_key_t gHGSTokenizerThreadKey;
+
+static const HGSTokenizerException *HGSFindTokenizerException(
+    const UniChar *chars, CFIndex length) {
+  std::vector<HGSTokenizerException>::const_iterator it;
+  for (it = gHGSTokenizerFastExceptions->begin(); 
+       it != gHGSTokenizerFastExceptions->end(); ++it) {
+    if ((CFIndex)it->key_.size() == length
+        && memcmp(&it->key_[0], chars, length * sizeof(UniChar)) == 0) {
+      return &(*it);
+    }
+  }
+  return NULL;
+}
+
+static std::vector<UniChar> HGSUniCharsFromString(NSString *string) {
+  std::vector<UniChar> chars([string length]);
+  if (!chars.empty()) {
+    [string getCharacters:&chars[0]];
+  }
+  return chars;
+}
+
+static void HGSTokenizerThreadKeyDestructor(void *value) {
+  [(id)value release];
+}
 
 @implementation HGSTokenizerInternal
 + (void)initialize {
@@ -69,6 +216,16 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
     gHGSTokenizerExceptions = [NSDictionary dictionaryWithContentsOfFile:path];
     HGSAssert(gHGSTokenizerExceptions, nil);
     [gHGSTokenizerExceptions retain];
+    gHGSTokenizerFastExceptions = new std::vector<HGSTokenizerException>;
+    for (NSString *key in gHGSTokenizerExceptions) {
+      HGSTokenizerException exception;
+      exception.key_ = HGSUniCharsFromString(key);
+      NSArray *parts = [gHGSTokenizerExceptions objectForKey:key];
+      for (NSString *part in parts) {
+        exception.parts_.push_back(HGSUniCharsFromString(part));
+      }
+      gHGSTokenizerFastExceptions->push_back(exception);
+    }
   }
 }
 
@@ -87,6 +244,10 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
       = CFCharacterSetCreateWithCharactersInString(NULL, 
                                                    CFSTR("0123456789,."));
     HGSAssert(tokenizer_, nil);
+    foldedChars_ = new std::vector<UniChar>;
+    tokenizedChars_ = new std::vector<UniChar>;
+    tokenRanges_ = new std::vector<NSRange>;
+    tokenMappings_ = new std::vector<HGSRangeMapping>;
   }
   return self;
 }
@@ -100,11 +261,179 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
     CFRelease(numberSet_);
     numberSet_ = NULL;
   }
+  [fastPathLocale_ release];
+  [internPool_ release];
+  delete foldedChars_;
+  delete tokenizedChars_;
+  delete tokenRanges_;
+  delete tokenMappings_;
   [super dealloc];
 }
   
 - (HGSTokenizedString *)tokenizeString:(NSString *)string {
-  CFLocaleRef currentLocale = (CFLocaleRef)[NSLocale currentLocale];
+  HGSTokenizedString *tokenizedString = [internPool_ objectForKey:string];
+  if (tokenizedString) {
+    internBytesSaved_ += [tokenizedString estimatedSize];
+    // Callers may outlive the pool.
+    return [[tokenizedString retain] autorelease];
+  }
+  tokenizedString = [self tokenizeString:string allowingFastPath:YES];
+  if (internPool_ && tokenizedString
+      && [internPool_ count] < kHGSTokenizerInternPoolMaxCount) {
+    [internPool_ setObject:tokenizedString 
+                    forKey:[tokenizedString originalString]];
+  }
+  return tokenizedString;
+}
+
+- (void)beginInterning {
+  if (internDepth_++ == 0) {
+    internPool_ = [[NSMutableDictionary alloc] init];
+    internBytesSaved_ = 0;
+  }
+}
+
+- (NSUInteger)endInterning {
+  HGSAssert(internDepth_ > 0, @"Unbalanced call to endInterning");
+  NSUInteger bytesSaved = internBytesSaved_;
+  if (internDepth_ > 0 && --internDepth_ == 0) {
+    HGSLogDebug(@"Tokenizer interned %u strings saving ~%u bytes", 
+                [internPool_ count], bytesSaved);
+    [internPool_ release];
+    internPool_ = nil;
+  }
+  return bytesSaved;
+}
+
+- (HGSTokenizedString *)tokenizeString:(NSString *)string
+                      allowingFastPath:(BOOL)allowFastPath {
+  NSLocale *currentLocale = [NSLocale currentLocale];
+  HGSTokenizedString *tokenizedString = nil;
+  if (allowFastPath && [self fastPathAllowedForLocale:currentLocale]) {
+    tokenizedString = [self fastTokenizeString:string];
+  }
+  if (!tokenizedString) {
+    tokenizedString = [self cfTokenizeString:string
+                                      locale:(CFLocaleRef)currentLocale];
+  }
+  return tokenizedString;
+}
+
+- (BOOL)fastPathAllowedForLocale:(NSLocale *)locale {
+  if (locale != fastPathLocale_) {
+    [fastPathLocale_ release];
+    fastPathLocale_ = [locale retain];
+    // These locales have special casing rules for 'I' that the fast path
+    // doesn't attempt to reproduce.
+    NSString *language = [locale objectForKey:NSLocaleLanguageCode];
+    fastPathLocaleAllowed_ = !([language isEqualToString:@"tr"]
+                               || [language isEqualToString:@"az"]
+                               || [language isEqualToString:@"lt"]);
+  }
+  return fastPathLocaleAllowed_;
+}
+
+// Tokenizes strings made up of ASCII and foldable Latin-1 without going
+// through CFStringFold and CFStringTokenizer. Returns nil if the string
+// contains anything it can't handle exactly the same way the CF path does,
+// in which case the caller falls back to the CF path.
+- (HGSTokenizedString *)fastTokenizeString:(NSString *)string {
+  CFStringRef cfString = (CFStringRef)string;
+  CFIndex length = CFStringGetLength(cfString);
+  std::vector<UniChar> &chars = *foldedChars_;
+  chars.resize(length);
+  if (length) {
+    CFStringGetCharacters(cfString, CFRangeMake(0, length), &chars[0]);
+  }
+  for (CFIndex i = 0; i < length; ++i) {
+    UniChar c = chars[i];
+    if (c >= 0x80) {
+      if (c < 0xC0 || c > 0xFF) return nil;
+      c = kHGSLatin1Folding[c - 0xC0];
+      if (!c) return nil;
+      chars[i] = c;
+    }
+    if (HGSFastPathClassify(c) == kHGSFastPathCharUnsupported) return nil;
+  }
+  
+  std::vector<NSRange> &ranges = *tokenRanges_;
+  ranges.clear();
+  CFIndex i = 0;
+  while (i < length) {
+    if (HGSFastPathClassify(chars[i]) == kHGSFastPathCharBreak) {
+      ++i;
+      continue;
+    }
+    CFIndex wordStart = i;
+    while (i < length 
+           && HGSFastPathClassify(chars[i]) != kHGSFastPathCharBreak) {
+      ++i;
+    }
+    if (i - wordStart >= kHGSFastPathMaxWordLength) return nil;
+    CFIndex subTokenStart = wordStart;
+    for (CFIndex j = wordStart + 1; j < i; ++j) {
+      if (HGSFastPathIsSubTokenBoundary(&chars[0], j, i)) {
+        ranges.push_back(NSMakeRange(subTokenStart, j - subTokenStart));
+        subTokenStart = j;
+      }
+    }
+    ranges.push_back(NSMakeRange(subTokenStart, i - subTokenStart));
+  }
+  
+  // Case fold once the subtoken boundaries are known.
+  for (CFIndex j = 0; j < length; ++j) {
+    if (chars[j] >= 'A' && chars[j] <= 'Z') {
+      chars[j] += 'a' - 'A';
+    }
+  }
+  
+  std::vector<UniChar> &tokenized = *tokenizedChars_;
+  std::vector<HGSRangeMapping> &mappings = *tokenMappings_;
+  tokenized.clear();
+  mappings.clear();
+  UniChar separator = [HGSTokenizer tokenizerSeparator];
+  std::vector<NSRange>::const_iterator it;
+  for (it = ranges.begin(); it != ranges.end(); ++it) {
+    NSRange range = *it;
+    const UniChar *token = &chars[range.location];
+    const HGSTokenizerException *exception 
+      = HGSFindTokenizerException(token, range.length);
+    size_t partCount = exception ? exception->parts_.size() : 1;
+    for (size_t part = 0; part < partCount; ++part) {
+      if (exception) {
+        range.length = exception->parts_[part].size();
+        token = range.length ? &exception->parts_[part][0] : NULL;
+      }
+      if (!mappings.empty()) {
+        tokenized.push_back(separator);
+      }
+      HGSRangeMapping mapping;
+      mapping.codomain_ = range;
+      mapping.domain_ = NSMakeRange(tokenized.size(), range.length);
+      mappings.push_back(mapping);
+      tokenized.insert(tokenized.end(), token, token + range.length);
+      range.location += range.length;
+    }
+  }
+  
+  size_t tokenCount = mappings.size();
+  HGSTokenizedString *tokenizedString 
+    = [[[HGSTokenizedString alloc] initWithString:string
+                                         capacity:tokenCount] autorelease];
+  if (tokenCount) {
+    memcpy([tokenizedString mappings], &mappings[0], 
+           tokenCount * sizeof(HGSRangeMapping));
+  }
+  CFStringRef finalString 
+    = CFStringCreateWithCharacters(NULL, 
+                                   tokenized.empty() ? NULL : &tokenized[0], 
+                                   tokenized.size());
+  [tokenizedString setTokenizedString:GTMCFAutorelease(finalString)];
+  return tokenizedString;
+}
+
+- (HGSTokenizedString *)cfTokenizeString:(NSString *)string
+                                  locale:(CFLocaleRef)currentLocale {
   CFOptionFlags options = (kCFCompareDiacriticInsensitive 
                            | kCFCompareWidthInsensitive);
   CFMutableStringRef normalizedString 
@@ -248,20 +577,31 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
 }
 #endif
 
++ (void)initialize {
+  if (self == [HGSTokenizer class]) {
+    int err = pthread_key_create(&gHGSTokenizerThreadKey, 
+                                 HGSTokenizerThreadKeyDestructor);
+    if (err) {
+      HGSLog(@"Unable to create tokenizer thread key (%d)", err);
+    }
+  }
+}
+
++ (HGSTokenizerInternal *)internalTokenizer {
+  HGSTokenizerInternal *internalTokenizer 
+    = (HGSTokenizerInternal *)pthread_getspecific(gHGSTokenizerThreadKey);
+  if (!internalTokenizer) {
+    // Released by HGSTokenizerThreadKeyDestructor when the thread exits.
+    internalTokenizer = [[HGSTokenizerInternal alloc] init];
+    pthread_setspecific(gHGSTokenizerThreadKey, internalTokenizer);
+  }
+  return internalTokenizer;
+}
+
 + (HGSTokenizedString *)tokenizeString:(NSString *)string {
   HGSTokenizedString *tokenizedString = nil;
   if (string) {
-    NSThread *currentThread = [NSThread currentThread];
-    NSMutableDictionary *threadDictionary = [currentThread threadDictionary];
-    NSString *kHGSTokenizerThreadTokenizer = @"HGSTokenizerThreadTokenizer";
-    HGSTokenizerInternal *internalTokenizer 
-      = [threadDictionary objectForKey:kHGSTokenizerThreadTokenizer];
-    if (!internalTokenizer) {
-      internalTokenizer = [[[HGSTokenizerInternal alloc] init] autorelease];
-      [threadDictionary setObject:internalTokenizer 
-                           forKey:kHGSTokenizerThreadTokenizer];
-    }
-    tokenizedString = [internalTokenizer tokenizeString:string];
+    tokenizedString = [[self internalTokenizer] tokenizeString:string];
   }
   return tokenizedString;
 }
@@ -276,6 +616,14 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
   return array;
 }
 
++ (void)beginInterning {
+  [[self internalTokenizer] beginInterning];
+}
+
++ (NSUInteger)endInterning {
+  return [[self internalTokenizer] endInterning];
+}
+
 + (NSString *)tokenizerSeparatorString {
   return @"˽";
 }
@@ -286,6 +634,20 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
 
 @end
 
+@implementation HGSTokenizer (HGSTokenizerTesting)
+
++ (HGSTokenizedString *)tokenizeString:(NSString *)string
+                      allowingFastPath:(BOOL)allowFastPath {
+  HGSTokenizedString *tokenizedString = nil;
+  if (string) {
+    tokenizedString = [[self internalTokenizer] tokenizeString:string
+                                              allowingFastPath:allowFastPath];
+  }
+  return tokenizedString;
+}
+
+@end
+
 @implementation HGSTokenizedString
 @synthesize originalString = originalString_;
 @synthesize tokenizedString = tokenizedString_;
@@ -338,6 +700,13 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
   return isGood;
 }
 
+- (NSUInteger)estimatedSize {
+  return (class_getInstanceSize([self class])
+          + count_ * sizeof(HGSRangeMapping)
+          + class_getInstanceSize([tokenizedString_ class])
+          + [tokenizedString_ length] * sizeof(unichar));
+}
+
 - (NSUInteger)tokenizedLength {
   return [tokenizedString_ length];
 }
@@ -355,5 +724,50 @@ static NSDictionary *gHGSTokenizerExceptions = nil;
   return [self retain];
 }
 
+// The mappings are archived as little endian 32 bit values so that archives
+// can move between 32 and 64 bit processes.
+- (id)initWithCoder:(NSCoder *)coder {
+  HGSAssert([coder allowsKeyedCoding], nil);
+  NSString *string = [coder decodeObjectForKey:kHGSTokenizedStringOriginalKey];
+  NSUInteger length = 0;
+  const uint32_t *values 
+    = (const uint32_t *)[coder decodeBytesForKey:kHGSTokenizedStringMappingsKey
+                                  returnedLength:&length];
+  NSUInteger count = length / (sizeof(uint32_t) * 4);
+  if ((self = [self initWithString:string capacity:count])) {
+    NSString *tokenizedString 
+      = [coder decodeObjectForKey:kHGSTokenizedStringTokenizedKey];
+    if (!originalString_ || !tokenizedString) {
+      [self release];
+      return nil;
+    }
+    for (NSUInteger i = 0; i < count; ++i) {
+      const uint32_t *mapping = values + i * 4;
+      mappings_[i].domain_.location = NSSwapLittleIntToHost(mapping[0]);
+      mappings_[i].domain_.length = NSSwapLittleIntToHost(mapping[1]);
+      mappings_[i].codomain_.location = NSSwapLittleIntToHost(mapping[2]);
+      mappings_[i].codomain_.length = NSSwapLittleIntToHost(mapping[3]);
+    }
+    [self setTokenizedString:tokenizedString];
+  }
+  return self;
+}
+
+- (void)encodeWithCoder:(NSCoder *)coder {
+  HGSAssert([coder allowsKeyedCoding], nil);
+  [coder encodeObject:originalString_ forKey:kHGSTokenizedStringOriginalKey];
+  [coder encodeObject:tokenizedString_ forKey:kHGSTokenizedStringTokenizedKey];
+  std::vector<uint32_t> values(count_ * 4);
+  for (NSUInteger i = 0; i < count_; ++i) {
+    values[i * 4] = NSSwapHostIntToLittle(mappings_[i].domain_.location);
+    values[i * 4 + 1] = NSSwapHostIntToLittle(mappings_[i].domain_.length);
+    values[i * 4 + 2] = NSSwapHostIntToLittle(mappings_[i].codomain_.location);
+    values[i * 4 + 3] = NSSwapHostIntToLittle(mappings_[i].codomain_.length);
+  }
+  [coder encodeBytes:(const uint8_t *)(values.empty() ? NULL : &values[0])
+              length:values.size() * sizeof(uint32_t)
+              forKey:kHGSTokenizedStringMappingsKey];
+}
+
 @end
 
@@ -39,6 +39,11 @@
 @interface HGSTokenizerTest : GTMTestCase
 @end
 
+@interface HGSTokenizer (HGSTokenizerTesting)
++ (HGSTokenizedString *)tokenizeString:(NSString *)string
+                      allowingFastPath:(BOOL)allowFastPath;
+@end
+
 @implementation HGSTokenizerTest
 
 - (void)testInit {
@@ -166,4 +171,142 @@
   }
 }
 
+- (NSString *)randomStringFromCharacters:(NSString *)characters
+                               maxLength:(NSUInteger)maxLength {
+  NSUInteger length = random() % (maxLength + 1);
+  NSUInteger characterCount = [characters length];
+  NSMutableString *string = [NSMutableString stringWithCapacity:length];
+  for (NSUInteger i = 0; i < length; ++i) {
+    unichar c = [characters characterAtIndex:random() % characterCount];
+    [string appendFormat:@"%C", c];
+  }
+  return string;
+}
+
+- (void)testFastPathMatchesCFPath {
+  // Mostly characters the fast path handles, with a sprinkling of ones
+  // that force it back onto the CF path so we exercise both.
+  NSString *characters 
+    = @"abcdefxyzABCDEFXYZ0123456789   -/#@()!?&+"
+      @"ÀÉéñüÇÿ"
+      @".,:;'_Øßæ日本";
+  srandom(1234);
+  for (NSUInteger i = 0; i < 20000; ++i) {
+    NSString *string = [self randomStringFromCharacters:characters 
+                                              maxLength:24];
+    HGSTokenizedString *fast = [HGSTokenizer tokenizeString:string 
+                                           allowingFastPath:YES];
+    HGSTokenizedString *slow = [HGSTokenizer tokenizeString:string 
+                                           allowingFastPath:NO];
+    STAssertEqualObjects([fast tokenizedString], [slow tokenizedString], 
+                         @"Tokenizing '%@'", string);
+    NSUInteger length = [slow tokenizedLength];
+    for (NSUInteger j = 0; j <= length; ++j) {
+      STAssertEquals([fast mapIndexFromTokenizedToOriginal:j],
+                     [slow mapIndexFromTokenizedToOriginal:j],
+                     @"Mapping %u of '%@'", j, string);
+    }
+  }
+  
+  // Words that appear in the exceptions list.
+  NSArray *strings = [NSArray arrayWithObjects:@"Firefox", @"THUNDERBIRD", 
+                      @"AdobePhotoshop", @"Firefox3 Thunderbird2", nil];
+  for (NSString *string in strings) {
+    HGSTokenizedString *fast = [HGSTokenizer tokenizeString:string 
+                                           allowingFastPath:YES];
+    HGSTokenizedString *slow = [HGSTokenizer tokenizeString:string 
+                                           allowingFastPath:NO];
+    STAssertEqualObjects([fast tokenizedString], [slow tokenizedString], 
+                         @"Tokenizing '%@'", string);
+  }
+}
+
+- (void)testFastPathPerformance {
+  NSArray *names = [NSArray arrayWithObjects:
+                    @"Adobe Photoshop CS4",
+                    @"iTunes Music Library",
+                    @"NSStringFormatter",
+                    @"The Beatles - Abbey Road (Remastered)",
+                    @"Café del Mar Volume 12",
+                    @"http://www.example.com/path/to/page?query=1",
+                    @"MacPython2 Build 4711",
+                    nil];
+  const NSUInteger kIterations = 2000;
+  NSTimeInterval times[2];
+  for (int fastPath = 0; fastPath < 2; ++fastPath) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSDate *start = [NSDate date];
+    for (NSUInteger i = 0; i < kIterations; ++i) {
+      for (NSString *name in names) {
+        [HGSTokenizer tokenizeString:name allowingFastPath:fastPath];
+      }
+    }
+    times[fastPath] = -[start timeIntervalSinceNow];
+    [pool release];
+  }
+  STAssertLessThan(times[1], times[0], nil);
+}
+
+- (void)testCoding {
+  HGSTokenizedString *tokenized 
+    = [HGSTokenizer tokenizeString:@"MacPython2.4 Firefox"];
+  NSData *data = [NSKeyedArchiver archivedDataWithRootObject:tokenized];
+  STAssertNotNil(data, nil);
+  HGSTokenizedString *unarchived 
+    = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+  STAssertEqualObjects(unarchived, tokenized, nil);
+  STAssertEqualObjects([unarchived tokenizedString], 
+                       [tokenized tokenizedString], nil);
+  for (NSUInteger i = 0; i <= [tokenized tokenizedLength]; ++i) {
+    STAssertEquals([unarchived mapIndexFromTokenizedToOriginal:i],
+                   [tokenized mapIndexFromTokenizedToOriginal:i], 
+                   @"Index %u", i);
+  }
+}
+
+- (void)testInterning {
+  NSString *album = [NSString stringWithFormat:@"Abbey %@", @"Road"];
+  NSString *sameAlbum = [NSString stringWithFormat:@"Abbey %@", @"Road"];
+  HGSTokenizedString *first = [HGSTokenizer tokenizeString:album];
+  HGSTokenizedString *second = [HGSTokenizer tokenizeString:sameAlbum];
+  STAssertNotEquals(first, second, nil);
+  
+  [HGSTokenizer beginInterning];
+  first = [HGSTokenizer tokenizeString:album];
+  second = [HGSTokenizer tokenizeString:sameAlbum];
+  STAssertEquals(first, second, nil);
+  // Nested calls share the outer pool.
+  [HGSTokenizer beginInterning];
+  NSArray *tokenized 
+    = [HGSTokenizer tokenizeStrings:[NSArray arrayWithObject:sameAlbum]];
+  STAssertEquals([tokenized objectAtIndex:0], first, nil);
+  [HGSTokenizer endInterning];
+  NSUInteger bytesSaved = [HGSTokenizer endInterning];
+  STAssertGreaterThan(bytesSaved, (NSUInteger)0, nil);
+  
+  // Interning is over so we get a fresh instance again.
+  second = [HGSTokenizer tokenizeString:sameAlbum];
+  STAssertNotEquals(first, second, nil);
+  STAssertEqualObjects([first tokenizedString], [second tokenizedString], nil);
+}
+
+- (void)testInterningSavings {
+  // Something that looks like an iTunes library: lots of tracks sharing a
+  // much smaller set of artists and albums.
+  NSMutableArray *corpus = [NSMutableArray array];
+  for (NSUInteger i = 0; i < 5000; ++i) {
+    [corpus addObject:[NSString stringWithFormat:@"Artist Number %u", i % 200]];
+    [corpus addObject:[NSString stringWithFormat:@"Greatest Hits Vol %u", 
+                       i % 500]];
+  }
+  [HGSTokenizer beginInterning];
+  NSArray *tokenized = [HGSTokenizer tokenizeStrings:corpus];
+  NSUInteger bytesSaved = [HGSTokenizer endInterning];
+  STAssertEquals([tokenized count], [corpus count], nil);
+  // Every repeat is handed the pooled copy, so each one counts toward the
+  // savings.
+  NSUInteger repeats = [corpus count] - [[NSSet setWithArray:corpus] count];
+  STAssertGreaterThanOrEqual(bytesSaved, repeats * sizeof(unichar), nil);
+}
+
 @end
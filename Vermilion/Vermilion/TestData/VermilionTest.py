@@ -110,6 +110,52 @@ class VermilionTest(object):
     return True
 
 
+class VermilionSlowTest(object):
+  """Keeps the interpreter busy for a while before returning a result."""
+
+  def __init__(self, extension=None):
+    self.extension = extension
+
+  def PerformSearch(self, query):
+    deadline = time.time() + 0.5
+    while time.time() < deadline:
+      pass
+    result = {}
+    result[Vermilion.IDENTIFIER] = "file:///dev/null"
+    result[Vermilion.DISPLAY_NAME] = "%s Slow Result" % query.normalized_query
+    result[Vermilion.TYPE] = "python.test.type"
+    result[Vermilion.MAIN_ITEM] = query.normalized_query
+    result[Vermilion.OTHER_ITEMS] = ""
+    query.SetResults([result])
+    query.Finish()
+
+  def IsValidSourceForQuery(self, query):
+    return True
+
+
+class VermilionCancellableTest(object):
+  """Searches until the query is cancelled."""
+
+  def __init__(self, extension=None):
+    self.extension = extension
+
+  def PerformSearch(self, query):
+    while not query.IsCancelled():
+      time.sleep(0.01)
+    query.Finish()
+
+
+class VermilionStuckTest(object):
+  """Never finishes and never checks for cancellation."""
+
+  def __init__(self, extension=None):
+    self.extension = extension
+
+  def PerformSearch(self, query):
+    while True:
+      pass
+
+
 class VermilionAction(object):
 
   def __init__(self, extension=None):
@@ -56,6 +56,13 @@
 */
 + (HGSKeychainItem*)keychainItemForService:(NSString*)serviceName
                                   username:(NSString*)username;
+/*!
+ Like keychainItemForService:username: but only looks in |keychain|. A NULL
+ |keychain| searches the default keychain search list.
+*/
++ (HGSKeychainItem*)keychainItemForService:(NSString*)serviceName
+                                  username:(NSString*)username
+                                inKeychain:(SecKeychainRef)keychain;
 /*!
  Returns the first keychain item for the given host.
  If the username can be anything, pass nil for |username|.
@@ -70,6 +77,14 @@
 + (HGSKeychainItem*)addKeychainItemForService:(NSString*)serviceName
                                  withUsername:(NSString*)username
                                      password:(NSString*)password;
+/*!
+ Adds a new keychain item for |service| to |keychain|, or to the default
+ keychain if |keychain| is NULL.
+*/
++ (HGSKeychainItem*)addKeychainItemForService:(NSString*)serviceName
+                                 withUsername:(NSString*)username
+                                     password:(NSString*)password
+                                   toKeychain:(SecKeychainRef)keychain;
 
 /*! Designated initializer */
 - (HGSKeychainItem*)initWithRef:(SecKeychainItemRef)ref;
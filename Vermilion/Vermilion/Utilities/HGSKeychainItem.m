@@ -36,13 +36,21 @@
 @implementation HGSKeychainItem
 + (HGSKeychainItem*)keychainItemForService:(NSString*)serviceName
                                   username:(NSString*)username {
+  return [self keychainItemForService:serviceName
+                             username:username
+                           inKeychain:NULL];
+}
+
++ (HGSKeychainItem*)keychainItemForService:(NSString*)serviceName
+                                  username:(NSString*)username
+                                inKeychain:(SecKeychainRef)keychain {
   SecKeychainItemRef itemRef;
   const char* serviceCString = [serviceName UTF8String];
   UInt32 serviceLength = serviceCString ? (UInt32)strlen(serviceCString) : 0;
   const char* accountCString = [username UTF8String];
   UInt32 accountLength = accountCString ? (UInt32)strlen(accountCString) : 0;
   HGSKeychainItem *item = nil;
-  OSStatus result = SecKeychainFindGenericPassword(NULL,
+  OSStatus result = SecKeychainFindGenericPassword(keychain,
                                                    serviceLength, serviceCString,
                                                    accountLength, accountCString,
                                                    0, NULL,
@@ -112,6 +120,16 @@
 + (HGSKeychainItem*)addKeychainItemForService:(NSString*)serviceName
                                  withUsername:(NSString*)username
                                      password:(NSString*)password {
+  return [self addKeychainItemForService:serviceName
+                            withUsername:username
+                                password:password
+                              toKeychain:NULL];
+}
+
++ (HGSKeychainItem*)addKeychainItemForService:(NSString*)serviceName
+                                 withUsername:(NSString*)username
+                                     password:(NSString*)password
+                                   toKeychain:(SecKeychainRef)keychain {
   const char* serviceCString = [serviceName UTF8String];
   UInt32 serviceLength = serviceCString ? (UInt32)strlen(serviceCString) : 0;
   const char* accountCString = [username UTF8String];
@@ -119,7 +137,7 @@
   const char* passwordData = [password UTF8String];
   UInt32 passwordLength = passwordData ? (UInt32)strlen(passwordData) : 0;
   SecKeychainItemRef keychainItemRef;
-  OSStatus result = SecKeychainAddGenericPassword(NULL, serviceLength, serviceCString,
+  OSStatus result = SecKeychainAddGenericPassword(keychain, serviceLength, serviceCString,
                                                   accountLength, accountCString,
                                                   passwordLength, passwordData, &keychainItemRef);
   HGSKeychainItem *item = nil;
@@ -31,7 +31,32 @@
 //
 
 #import "NSNotificationCenter+MainThread.h"
+#import <mach/mach_time.h>
+#import "HGSLatencyHistogram.h"
+#import "HGSDTrace.h"
 
+@interface NSNotificationCenter (MainThreadPrivate)
+- (void)hgs_postQueuedNotification:(NSArray *)args;
+@end
+
+@implementation NSNotificationCenter (MainThreadPrivate)
+
+- (void)hgs_postQueuedNotification:(NSArray *)args {
+  NSNotification *notification = [args objectAtIndex:0];
+  uint64_t queuedTime = [[args objectAtIndex:1] unsignedLongLongValue];
+  uint64_t waited = mach_absolute_time() - queuedTime;
+  [[HGSLatencyHistogramRegistry sharedRegistry]
+   recordMachTime:waited
+         forStage:kHGSLatencyStageNotify
+           source:nil];
+  if (VERMILION_NOTIFICATION_DELIVER_ENABLED()) {
+    VERMILION_NOTIFICATION_DELIVER((char *)[[notification name] UTF8String],
+                                   HGSMachTimeToNanoseconds(waited));
+  }
+  [self postNotification:notification];
+}
+
+@end
 
 @implementation NSNotificationCenter (MainThread)
 
@@ -49,8 +74,13 @@
   if ([NSThread isMainThread]) {
     [self postNotification:notification];
   } else {
-    [self performSelectorOnMainThread:@selector(postNotification:)
-                           withObject:notification
+    // Note when it was queued so we can time how long the main thread
+    // took to get to it.
+    NSNumber *queuedTime
+      = [NSNumber numberWithUnsignedLongLong:mach_absolute_time()];
+    NSArray *args = [NSArray arrayWithObjects:notification, queuedTime, nil];
+    [self performSelectorOnMainThread:@selector(hgs_postQueuedNotification:)
+                           withObject:args
                         waitUntilDone:NO];
   }
 }
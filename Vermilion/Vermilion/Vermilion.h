@@ -46,6 +46,8 @@
 #import <Vermilion/HGSGDataServiceSource.h>
 #import <Vermilion/HGSGDataUploadAction.h>
 #import <Vermilion/HGSIconProvider.h>
+#import <Vermilion/HGSJSONStreamParser.h>
+#import <Vermilion/HGSLatencyHistogram.h>
 #import <Vermilion/HGSLog.h>
 #import <Vermilion/HGSMemorySearchSource.h>
 #import <Vermilion/HGSMixer.h>
@@ -56,6 +58,8 @@
 #import <Vermilion/HGSProtoExtension.h>
 #import <Vermilion/HGSQuery.h>
 #import <Vermilion/HGSQueryController.h>
+#import <Vermilion/HGSQueryTrace.h>
+#import <Vermilion/HGSQueryUpdateCoalescer.h>
 #import <Vermilion/HGSResult.h>
 #import <Vermilion/HGSSearchOperation.h>
 #import <Vermilion/HGSSearchSource.h>
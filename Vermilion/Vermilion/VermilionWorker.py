@@ -0,0 +1,301 @@
+#!/usr/bin/python
+#
+# Copyright (c) 2009 Google Inc. All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+# 
+# * Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+# * Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following disclaimer
+# in the documentation and/or other materials provided with the
+# distribution.
+# * Neither the name of Google Inc. nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Out of process host for Quick Search Box Python plugins.
+
+HGSPythonWorkerPool runs a few copies of this script and hands them
+searches and method calls for the plugins that ask for it (the
+HGSPythonUsesWorkerPool configuration key). Plugins see the same
+Vermilion, VermilionLocalize and VermilionNotify modules they get in the
+embedded interpreter, plus Query.IsCancelled().
+
+Every message is a 4 byte big endian length followed by one value:
+  N            None
+  T / F        True / False
+  i + 8 bytes  signed big endian integer
+  f + 8 bytes  big endian double
+  s + 4 bytes  length, then UTF-8 bytes
+  l + 4 bytes  count, then that many values
+  d + 4 bytes  count, then that many key and value pairs
+A message is a list whose first two items are its kind and a request id.
+"""
+
+__author__ = 'hawk@google.com (Chris Hawk)'
+
+import imp
+import os
+import struct
+import sys
+import thread
+import traceback
+
+# Our replies go down the original stdout. Anything a plugin prints goes
+# to stderr so it can't corrupt the stream.
+_output = os.fdopen(os.dup(1), 'wb', 0)
+os.dup2(2, 1)
+sys.stdout = sys.stderr
+_input = os.fdopen(os.dup(0), 'rb', 0)
+
+_write_lock = thread.allocate_lock()
+_instances = {}      # plugin id -> plugin instance
+_load_errors = {}    # plugin id -> why it didn't load
+_strings = {}        # plugin id -> localized strings
+_queries = {}        # request id -> running Query
+
+
+def _Encode(value, out):
+  """Appends the encoding of value to the list of strings out."""
+  if value is None:
+    out.append('N')
+  elif isinstance(value, bool):
+    out.append(value and 'T' or 'F')
+  elif isinstance(value, (int, long)) and -2**63 <= value < 2**63:
+    out.append('i' + struct.pack('>q', value))
+  elif isinstance(value, float):
+    out.append('f' + struct.pack('>d', value))
+  elif isinstance(value, (list, tuple)):
+    out.append('l' + struct.pack('>I', len(value)))
+    for item in value:
+      _Encode(item, out)
+  elif isinstance(value, dict):
+    out.append('d' + struct.pack('>I', len(value)))
+    for key, item in value.iteritems():
+      _Encode(str(key), out)
+      _Encode(item, out)
+  else:
+    if isinstance(value, unicode):
+      value = value.encode('utf-8')
+    elif isinstance(value, str):
+      # The host drops the whole message if a string isn't valid UTF-8.
+      value = value.decode('utf-8', 'replace').encode('utf-8')
+    else:
+      value = str(value)
+    out.append('s' + struct.pack('>I', len(value)) + value)
+
+
+def _Decode(data, offset):
+  """Returns the value at data[offset:] and the offset just past it."""
+  tag = data[offset]
+  offset += 1
+  if tag == 'N':
+    return None, offset
+  if tag == 'T':
+    return True, offset
+  if tag == 'F':
+    return False, offset
+  if tag == 'i':
+    return struct.unpack('>q', data[offset:offset + 8])[0], offset + 8
+  if tag == 'f':
+    return struct.unpack('>d', data[offset:offset + 8])[0], offset + 8
+  count = struct.unpack('>I', data[offset:offset + 4])[0]
+  offset += 4
+  if tag == 's':
+    return data[offset:offset + count], offset + count
+  if tag == 'l':
+    items = []
+    for unused in xrange(count):
+      item, offset = _Decode(data, offset)
+      items.append(item)
+    return items, offset
+  if tag == 'd':
+    items = {}
+    for unused in xrange(count):
+      key, offset = _Decode(data, offset)
+      items[key], offset = _Decode(data, offset)
+    return items, offset
+  raise ValueError('Unknown tag %r' % tag)
+
+
+def _Send(message):
+  out = []
+  _Encode(message, out)
+  data = ''.join(out)
+  _write_lock.acquire()
+  try:
+    try:
+      _output.write(struct.pack('>I', len(data)) + data)
+    except (IOError, OSError):
+      # The host has gone away.
+      os._exit(1)
+  finally:
+    _write_lock.release()
+
+
+def _ReadFully(length):
+  chunks = []
+  while length:
+    chunk = _input.read(length)
+    if not chunk:
+      return None
+    chunks.append(chunk)
+    length -= len(chunk)
+  return ''.join(chunks)
+
+
+def _Receive():
+  """Returns the next message from the host, or None once it's gone."""
+  header = _ReadFully(4)
+  if header is None:
+    return None
+  data = _ReadFully(struct.unpack('>I', header)[0])
+  if data is None:
+    return None
+  return _Decode(data, 0)[0]
+
+
+class Query(object):
+  """Stands in for the Vermilion.Query the embedded interpreter provides."""
+
+  def __init__(self, normalized_query, raw_query, pivot_object=None,
+               request_id=None):
+    self.normalized_query = normalized_query
+    self.raw_query = raw_query
+    self.pivot_object = pivot_object
+    self._request_id = request_id
+    self._cancelled = False
+    self._finished = False
+
+  def SetResults(self, results):
+    """Replaces the results of the query."""
+    if not self._cancelled and not self._finished:
+      _Send(['results', self._request_id, list(results)])
+
+  def Finish(self):
+    """Indicate that query processing has completed."""
+    if not self._finished:
+      self._finished = True
+      _queries.pop(self._request_id, None)
+      _Send(['finish', self._request_id])
+
+  def IsCancelled(self):
+    """True once the user has moved on. Long searches should check it."""
+    return self._cancelled
+
+
+def _LocalizeString(string, extension):
+  return _strings.get(extension, {}).get(string, string)
+
+
+def _DisplayNotification(message, extension, description=None, name=None,
+                         image=None):
+  _Send(['notify', extension, message, description, name])
+
+
+def _InstallModules(constants):
+  import Vermilion
+  for name, value in constants.iteritems():
+    setattr(Vermilion, name, value)
+  Vermilion.Query = Query
+  localize = imp.new_module('VermilionLocalize')
+  localize.String = _LocalizeString
+  sys.modules['VermilionLocalize'] = localize
+  notify = imp.new_module('VermilionNotify')
+  notify.DisplayNotification = _DisplayNotification
+  sys.modules['VermilionNotify'] = notify
+
+
+def _Load(plugin_id, module_name, class_name, resource_path, strings):
+  import Vermilion
+  _strings[plugin_id] = strings
+  try:
+    if resource_path:
+      Vermilion.AddPathToSysPath(resource_path)
+    module = __import__(module_name)
+    _instances[plugin_id] = getattr(module, class_name)(plugin_id)
+  except:
+    _load_errors[plugin_id] = traceback.format_exc()
+
+
+def _Search(request_id, plugin_id, normalized_query, raw_query,
+            pivot_object):
+  instance = _instances.get(plugin_id)
+  if instance is None:
+    _Send(['error', request_id, _load_errors.get(plugin_id, 'not loaded')])
+    return
+  query = Query(normalized_query, raw_query, pivot_object, request_id)
+  _queries[request_id] = query
+  try:
+    # The host leaves this to us so it never has to wait on a worker.
+    is_valid = getattr(instance, 'IsValidSourceForQuery', None)
+    valid = True
+    if is_valid:
+      result = is_valid(query)
+      if isinstance(result, bool):
+        valid = result
+    if valid:
+      instance.PerformSearch(query)
+    else:
+      query.Finish()
+  except:
+    traceback.print_exc()
+    query.Finish()
+
+
+def _Call(request_id, plugin_id, method, args):
+  instance = _instances.get(plugin_id)
+  if instance is None:
+    _Send(['error', request_id, _load_errors.get(plugin_id, 'not loaded')])
+    return
+  function = getattr(instance, method, None)
+  if function is None:
+    _Send(['return', request_id, None])
+    return
+  try:
+    value = function(*args)
+  except:
+    _Send(['error', request_id, traceback.format_exc()])
+    return
+  _Send(['return', request_id, value])
+
+
+def main():
+  while True:
+    message = _Receive()
+    if message is None:
+      break
+    kind, request_id = message[0], message[1]
+    if kind == 'init':
+      _InstallModules(message[2])
+    elif kind == 'load':
+      _Load(*message[1:])
+    elif kind == 'search':
+      thread.start_new_thread(_Search, (request_id,) + tuple(message[2:]))
+    elif kind == 'call':
+      thread.start_new_thread(_Call, (request_id,) + tuple(message[2:]))
+    elif kind == 'cancel':
+      query = _queries.get(request_id)
+      if query:
+        query._cancelled = True
+  # Don't wait around for plugin threads that never finished.
+  os._exit(0)
+
+
+if __name__ == '__main__':
+  main()